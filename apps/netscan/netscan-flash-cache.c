@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2016, Yanzi Networks AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the name of the copyright holders nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Network cache storage in a flash sector reserved by the
+ *         platform at NETSCAN_CONF_FLASH_CACHE_ADDRESS.
+ *
+ *         The cache is appended as records to the sector, which is
+ *         only erased when full. Each record is a header word with
+ *         magic and length, the data padded to whole words and a
+ *         CRC32 word. The last complete record is the current cache.
+ */
+
+#include "contiki-conf.h"
+#include "netscan.h"
+
+#ifdef NETSCAN_CONF_FLASH_CACHE_ADDRESS
+
+#include "dev/sparrow-flash.h"
+#include "lib/crc32.h"
+#include <string.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/ip/uip-debug.h"
+
+#define FLASH_CACHE_ADDRESS NETSCAN_CONF_FLASH_CACHE_ADDRESS
+
+#ifdef NETSCAN_CONF_FLASH_CACHE_SIZE
+#define FLASH_CACHE_SIZE NETSCAN_CONF_FLASH_CACHE_SIZE
+#else
+#define FLASH_CACHE_SIZE 2048
+#endif
+
+/* For platforms where the flash might not be present at runtime */
+#ifdef NETSCAN_CONF_FLASH_CACHE_IS_AVAILABLE
+#define FLASH_CACHE_IS_AVAILABLE() NETSCAN_CONF_FLASH_CACHE_IS_AVAILABLE()
+#else
+#define FLASH_CACHE_IS_AVAILABLE() 1
+#endif
+
+#define RECORD_MAGIC      0x4e430000UL
+#define RECORD_MAGIC_MASK 0xffff0000UL
+#define RECORD_LEN_MASK   0x0000ffffUL
+#define ERASED            0xffffffffUL
+
+#define MAX_DATA_LEN (NETSCAN_CACHE_SIZE * sizeof(netscan_cache_entry_t))
+#define WORDS(len)   (((len) + 3) / 4)
+
+static uint32_t record_buf[WORDS(MAX_DATA_LEN) + 2];
+/*---------------------------------------------------------------------------*/
+static uint32_t
+read_word(uint32_t offset)
+{
+  return *(const uint32_t *)(uintptr_t)(FLASH_CACHE_ADDRESS + offset);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Find the last valid record and the first free offset.
+ */
+static uint32_t
+find_last_record(uint32_t *free_offset)
+{
+  uint32_t offset, header, len, last;
+
+  last = ERASED;
+  for(offset = 0; offset + 8 <= FLASH_CACHE_SIZE; ) {
+    header = read_word(offset);
+    if(header == ERASED) {
+      if(read_word(offset + 4) != ERASED) {
+        /* Interrupted write - the next write will erase the sector */
+        offset = FLASH_CACHE_SIZE;
+      }
+      break;
+    }
+    len = header & RECORD_LEN_MASK;
+    if((header & RECORD_MAGIC_MASK) != RECORD_MAGIC
+       || offset + 8 + WORDS(len) * 4 > FLASH_CACHE_SIZE) {
+      /* Broken sector - the next write will erase it */
+      offset = FLASH_CACHE_SIZE;
+      break;
+    }
+    if(crc32((const uint8_t *)(uintptr_t)(FLASH_CACHE_ADDRESS + offset + 4), len)
+       == read_word(offset + 4 + WORDS(len) * 4)) {
+      last = offset;
+    }
+    offset += 8 + WORDS(len) * 4;
+  }
+  if(free_offset != NULL) {
+    *free_offset = offset;
+  }
+  return last;
+}
+/*---------------------------------------------------------------------------*/
+static int
+cache_read(uint8_t *data, int len)
+{
+  uint32_t offset, record_len;
+
+  if(!FLASH_CACHE_IS_AVAILABLE()) {
+    return 0;
+  }
+  offset = find_last_record(NULL);
+  if(offset == ERASED) {
+    return 0;
+  }
+  record_len = read_word(offset) & RECORD_LEN_MASK;
+  if(record_len > len) {
+    record_len = len;
+  }
+  memcpy(data, (const uint8_t *)(uintptr_t)(FLASH_CACHE_ADDRESS + offset + 4),
+         record_len);
+  return record_len;
+}
+/*---------------------------------------------------------------------------*/
+static int
+cache_write(const uint8_t *data, int len)
+{
+  uint32_t offset, last, words, i;
+  int success = 1;
+
+  if(len > MAX_DATA_LEN || !FLASH_CACHE_IS_AVAILABLE()) {
+    return 0;
+  }
+
+  last = find_last_record(&offset);
+  if(last != ERASED && (read_word(last) & RECORD_LEN_MASK) == len
+     && memcmp((const uint8_t *)(uintptr_t)(FLASH_CACHE_ADDRESS + last + 4),
+               data, len) == 0) {
+    /* Already stored */
+    return 1;
+  }
+
+  words = WORDS(len);
+  memset(record_buf, 0xff, sizeof(record_buf));
+  record_buf[0] = RECORD_MAGIC | len;
+  memcpy(&record_buf[1], data, len);
+  record_buf[1 + words] = crc32(data, len);
+
+  if(sparrow_flash_unlock() != SPARROW_FLASH_COMPLETE) {
+    return 0;
+  }
+  if(offset + (words + 2) * 4 > FLASH_CACHE_SIZE) {
+    PRINTF("netscan: erasing network cache sector\n");
+    if(sparrow_flash_erase_sector(FLASH_CACHE_ADDRESS) != SPARROW_FLASH_COMPLETE) {
+      success = 0;
+    }
+    offset = 0;
+  }
+  /* Write the header last to never leave a valid looking broken record */
+  for(i = 1; success && i < words + 2; i++) {
+    if(sparrow_flash_program_word(FLASH_CACHE_ADDRESS + offset + i * 4,
+                                  record_buf[i]) != SPARROW_FLASH_COMPLETE) {
+      success = 0;
+    }
+  }
+  if(success &&
+     sparrow_flash_program_word(FLASH_CACHE_ADDRESS + offset,
+                                record_buf[0]) != SPARROW_FLASH_COMPLETE) {
+    success = 0;
+  }
+  if(sparrow_flash_lock() != SPARROW_FLASH_COMPLETE) {
+    success = 0;
+  }
+  PRINTF("netscan: stored %d bytes network cache at %lu: %s\n", len,
+         (unsigned long)offset, success ? "ok" : "failed");
+  return success;
+}
+/*---------------------------------------------------------------------------*/
+const struct netscan_cache_storage netscan_flash_cache_storage = {
+  cache_read,
+  cache_write
+};
+/*---------------------------------------------------------------------------*/
+#endif /* NETSCAN_CONF_FLASH_CACHE_ADDRESS */
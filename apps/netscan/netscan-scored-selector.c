@@ -0,0 +1,451 @@
+/*
+ * Copyright (c) 2016, Yanzi Networks AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *   3. Neither the name of the copyright holders nor the
+ *      names of its contributors may be used to endorse or promote products
+ *      derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Netscan selector that collects the networks heard during a
+ *         full scan and joins the one with the lowest cost.
+ *
+ *         The cost of a network is based on the ETX announced in its
+ *         beacons, the signal strength of the best beacon, whether
+ *         owner and location match this node, the number of beacons
+ *         from other networks on the same channel, and earlier join
+ *         failures. If the node has not joined the selected network
+ *         within NETSCAN_SCORED_JOIN_TIME, the next best network is
+ *         tried before a new scan is started.
+ *
+ *         Enable with:
+ *           #define NETSCAN_CONF_SELECTOR netscan_scored_selector
+ */
+
+#include "contiki.h"
+#include "netscan.h"
+#include "sparrow-beacon.h"
+#include "net/packetbuf.h"
+#include "net/rpl/rpl.h"
+#include "net/mac/frame802154.h"
+#include <string.h>
+
+#ifdef HAVE_SPARROW_OAM
+#include "sparrow.h"
+#endif /* HAVE_SPARROW_OAM */
+
+#define DEBUG DEBUG_NONE
+#include "net/ip/uip-debug.h"
+
+/* Number of networks remembered during a scan */
+#ifdef NETSCAN_SCORED_CONF_CANDIDATES
+#define NETSCAN_SCORED_CANDIDATES NETSCAN_SCORED_CONF_CANDIDATES
+#else
+#define NETSCAN_SCORED_CANDIDATES 4
+#endif
+
+/* Join any PAN id instead of only IEEE802154_PANID */
+#ifdef NETSCAN_SCORED_CONF_ANY_PANID
+#define NETSCAN_SCORED_ANY_PANID NETSCAN_SCORED_CONF_ANY_PANID
+#else
+#define NETSCAN_SCORED_ANY_PANID 0
+#endif
+
+/* Time to wait for a DAG after selecting a network */
+#ifdef NETSCAN_SCORED_CONF_JOIN_TIME
+#define NETSCAN_SCORED_JOIN_TIME NETSCAN_SCORED_CONF_JOIN_TIME
+#else
+#define NETSCAN_SCORED_JOIN_TIME (CLOCK_SECOND * 30)
+#endif
+
+/*
+ * Costs are in the same unit as the ETX in the beacons, where 128 is
+ * one transmission.
+ */
+#ifdef NETSCAN_SCORED_CONF_UNKNOWN_ETX
+#define UNKNOWN_ETX_COST NETSCAN_SCORED_CONF_UNKNOWN_ETX
+#else
+#define UNKNOWN_ETX_COST 1024
+#endif
+
+/* Beacons weaker than this RSSI cost RSSI_COST per dB */
+#ifdef NETSCAN_SCORED_CONF_RSSI_GOOD
+#define RSSI_GOOD NETSCAN_SCORED_CONF_RSSI_GOOD
+#else
+#define RSSI_GOOD -70
+#endif
+#define RSSI_COST 16
+
+/* Beacons with lower LQI cost LQI_COST per step (disabled by default) */
+#ifdef NETSCAN_SCORED_CONF_LQI_GOOD
+#define LQI_GOOD NETSCAN_SCORED_CONF_LQI_GOOD
+#else
+#define LQI_GOOD 0
+#endif
+#define LQI_COST 8
+
+#define OWNER_MISMATCH_COST    4096
+#define OWNER_UNKNOWN_COST      512
+#define LOCATION_MISMATCH_COST  256
+/* Per beacon from other networks on the same channel */
+#define CHANNEL_LOAD_COST        64
+/* Per earlier join failure */
+#define JOIN_FAILURE_COST      2048
+#define MAX_JOIN_FAILURES         3
+
+#define MAX_PAYLOAD 32
+
+typedef struct {
+  uint16_t panid;
+  uint8_t channel;
+  uint8_t beacons;
+  uint8_t tried;
+  uint8_t payload_len;
+  int32_t cost;
+  uint8_t payload[MAX_PAYLOAD];
+} candidate_t;
+
+typedef struct {
+  uint16_t panid;
+  uint8_t channel;
+  uint8_t count;
+} join_failure_t;
+
+static candidate_t candidates[NETSCAN_SCORED_CANDIDATES];
+static uint8_t candidate_count;
+/* Beacons heard per channel (11 - 26) during the scan */
+static uint8_t channel_beacons[16];
+static join_failure_t failures[NETSCAN_SCORED_CANDIDATES];
+/* Set when the scan is complete and a network has been selected */
+static uint8_t round_done;
+static candidate_t *selected;
+static struct ctimer join_timer;
+/*---------------------------------------------------------------------------*/
+static uint32_t
+get_beacon_value(uint8_t (* get)(const uint8_t *, uint8_t, uint8_t *, uint8_t),
+                 const uint8_t *payload, uint8_t length, uint8_t size)
+{
+  uint8_t buf[4];
+  uint32_t value;
+  int i, n;
+
+  n = get(payload, length, buf, size);
+  for(value = 0, i = 0; i < n; i++) {
+    value = (value << 8) | buf[i];
+  }
+  return value;
+}
+/*---------------------------------------------------------------------------*/
+static join_failure_t *
+find_failure(int channel, uint16_t panid)
+{
+  int i;
+  for(i = 0; i < NETSCAN_SCORED_CANDIDATES; i++) {
+    if(failures[i].count > 0 && failures[i].channel == channel
+       && failures[i].panid == panid) {
+      return &failures[i];
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_failure(int channel, uint16_t panid)
+{
+  join_failure_t *f;
+  int i;
+
+  f = find_failure(channel, panid);
+  if(f == NULL) {
+    /* Reuse a free entry or the entry with fewest failures */
+    f = &failures[0];
+    for(i = 1; i < NETSCAN_SCORED_CANDIDATES; i++) {
+      if(failures[i].count < f->count) {
+        f = &failures[i];
+      }
+    }
+    f->channel = channel;
+    f->panid = panid;
+    f->count = 0;
+  }
+  if(f->count < MAX_JOIN_FAILURES) {
+    f->count++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Cost of a beacon, not including the load and the join failures
+ * which are added when the scan is complete.
+ */
+static int32_t
+beacon_cost(const uint8_t *payload, uint8_t length)
+{
+  int32_t cost;
+  int16_t rssi;
+  uint16_t lqi;
+  uint32_t etx;
+#ifdef HAVE_SPARROW_OAM
+  uint32_t owner, beacon_owner;
+#endif /* HAVE_SPARROW_OAM */
+
+  etx = 0;
+  if(payload != NULL && length > 0) {
+    etx = get_beacon_value(sparrow_beacon_get_etx, payload, length, 2);
+  }
+  cost = etx > 0 ? etx : UNKNOWN_ETX_COST;
+
+  /* The beacon is still in packetbuf during the scan callback */
+  rssi = (int16_t)packetbuf_attr(PACKETBUF_ATTR_RSSI);
+  if(rssi != 0 && rssi < RSSI_GOOD) {
+    cost += (RSSI_GOOD - rssi) * RSSI_COST;
+  }
+  lqi = packetbuf_attr(PACKETBUF_ATTR_LINK_QUALITY);
+  if(lqi != 0 && lqi < LQI_GOOD) {
+    cost += (LQI_GOOD - lqi) * LQI_COST;
+  }
+
+#ifdef HAVE_SPARROW_OAM
+  if(payload != NULL && length > 0) {
+    owner = sparrow_get_owner_id();
+    if(owner != 0) {
+      beacon_owner = get_beacon_value(sparrow_beacon_get_owner,
+                                      payload, length, 4);
+      if(beacon_owner == 0) {
+        cost += OWNER_UNKNOWN_COST;
+      } else if(beacon_owner != owner) {
+        cost += OWNER_MISMATCH_COST;
+      }
+    }
+    if(sparrow_is_location_set() &&
+       get_beacon_value(sparrow_beacon_get_location, payload, length, 4)
+       != sparrow_get_location_id()) {
+      cost += LOCATION_MISMATCH_COST;
+    }
+  }
+#endif /* HAVE_SPARROW_OAM */
+
+  PRINTF("netscan-scored: beacon etx %lu rssi %d lqi %u cost %ld\n",
+         (unsigned long)etx, rssi, lqi, (long)cost);
+  return cost;
+}
+/*---------------------------------------------------------------------------*/
+static void
+reset_round(void)
+{
+  ctimer_stop(&join_timer);
+  candidate_count = 0;
+  selected = NULL;
+  round_done = 0;
+  memset(channel_beacons, 0, sizeof(channel_beacons));
+}
+/*---------------------------------------------------------------------------*/
+static candidate_t *
+best_candidate(void)
+{
+  candidate_t *best;
+  int i;
+
+  best = NULL;
+  for(i = 0; i < candidate_count; i++) {
+    if(!candidates[i].tried && (best == NULL || candidates[i].cost < best->cost)) {
+      best = &candidates[i];
+    }
+  }
+  return best;
+}
+/*---------------------------------------------------------------------------*/
+static int
+select_best(void)
+{
+  selected = best_candidate();
+  if(selected == NULL) {
+    return 0;
+  }
+  PRINTF("netscan-scored: selecting ch %d pan id %04x cost %ld\n",
+         selected->channel, selected->panid, (long)selected->cost);
+  selected->tried = 1;
+  netscan_select_network(selected->channel, selected->panid);
+  netscan_set_beacon_payload(selected->payload, selected->payload_len);
+  ctimer_restart(&join_timer);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int is_done(void);
+
+static void
+handle_join_timer(void *ptr)
+{
+  join_failure_t *f;
+
+  if(selected == NULL) {
+    return;
+  }
+  if(is_done()) {
+    f = find_failure(selected->channel, selected->panid);
+    if(f != NULL) {
+      f->count = 0;
+    }
+    return;
+  }
+
+  PRINTF("netscan-scored: failed to join ch %d pan id %04x\n",
+         selected->channel, selected->panid);
+  add_failure(selected->channel, selected->panid);
+  if(!select_best()) {
+    /* No more networks to try */
+    netscan_start();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+  memset(failures, 0, sizeof(failures));
+  reset_round();
+  ctimer_set(&join_timer, NETSCAN_SCORED_JOIN_TIME, handle_join_timer, NULL);
+  ctimer_stop(&join_timer);
+}
+/*---------------------------------------------------------------------------*/
+static int
+is_done(void)
+{
+#if UIP_CONF_IPV6_RPL
+  return rpl_get_any_dag() != NULL;
+#else /* UIP_CONF_IPV6_RPL */
+  return 1;
+#endif /* UIP_CONF_IPV6_RPL */
+}
+/*---------------------------------------------------------------------------*/
+static netscan_action_t
+beacon_received(int channel, uint16_t panid, const linkaddr_t *source,
+                const uint8_t *payload, uint8_t payload_length)
+{
+  candidate_t *c;
+  int32_t cost;
+  int i;
+
+  if(round_done) {
+    /* A new scan has been started */
+    reset_round();
+  }
+
+  if(channel >= 11 && channel <= 26 && channel_beacons[channel - 11] < 0xff) {
+    channel_beacons[channel - 11]++;
+  }
+
+  if(!NETSCAN_SCORED_ANY_PANID && panid != IEEE802154_PANID) {
+    return NETSCAN_CONTINUE;
+  }
+
+  cost = beacon_cost(payload, payload_length);
+
+  c = NULL;
+  for(i = 0; i < candidate_count; i++) {
+    if(candidates[i].channel == channel && candidates[i].panid == panid) {
+      c = &candidates[i];
+      break;
+    }
+  }
+
+  if(c == NULL) {
+    if(candidate_count < NETSCAN_SCORED_CANDIDATES) {
+      c = &candidates[candidate_count++];
+    } else {
+      /* Replace the worst network if this one is better */
+      c = &candidates[0];
+      for(i = 1; i < candidate_count; i++) {
+        if(candidates[i].cost > c->cost) {
+          c = &candidates[i];
+        }
+      }
+      if(c->cost <= cost) {
+        return NETSCAN_CONTINUE;
+      }
+    }
+    memset(c, 0, sizeof(candidate_t));
+    c->channel = channel;
+    c->panid = panid;
+  } else if(c->cost <= cost) {
+    /* Keep the best beacon of the network */
+    if(c->beacons < 0xff) {
+      c->beacons++;
+    }
+    return NETSCAN_CONTINUE;
+  }
+
+  if(c->beacons < 0xff) {
+    c->beacons++;
+  }
+  c->cost = cost;
+  c->payload_len = 0;
+  if(payload != NULL && payload_length <= MAX_PAYLOAD) {
+    memcpy(c->payload, payload, payload_length);
+    c->payload_len = payload_length;
+  }
+  return NETSCAN_CONTINUE;
+}
+/*---------------------------------------------------------------------------*/
+static netscan_action_t
+channel_done(int channel, int is_last_channel)
+{
+  join_failure_t *f;
+  int i, others;
+
+  if(round_done) {
+    reset_round();
+  }
+
+  if(!is_last_channel) {
+    return NETSCAN_CONTINUE;
+  }
+
+  /* Add the channel load and earlier join failures */
+  for(i = 0; i < candidate_count; i++) {
+    others = channel_beacons[candidates[i].channel - 11] - candidates[i].beacons;
+    if(others > 0) {
+      candidates[i].cost += others * CHANNEL_LOAD_COST;
+    }
+    f = find_failure(candidates[i].channel, candidates[i].panid);
+    if(f != NULL) {
+      candidates[i].cost += f->count * JOIN_FAILURE_COST;
+    }
+  }
+
+  if(!select_best()) {
+    /* Nothing heard - let netscan continue or start over */
+    reset_round();
+    return NETSCAN_CONTINUE;
+  }
+  round_done = 1;
+  return NETSCAN_STOP;
+}
+/*---------------------------------------------------------------------------*/
+const struct netscan_selector netscan_scored_selector = {
+  init,
+  is_done,
+  beacon_received,
+  channel_done
+};
+/*---------------------------------------------------------------------------*/
@@ -48,6 +48,8 @@
 #include "net/rpl/rpl-private.h"
 #include "net/net-control.h"
 #include "netscan.h"
+#include "sparrow-beacon.h"
+#include <string.h>
 
 #ifdef NETSCAN_CONF_LEDS
 #define NETSCAN_LEDS NETSCAN_CONF_LEDS
@@ -80,6 +82,27 @@
 #define DEBUG DEBUG_NONE
 #include "net/ip/uip-debug.h"
 
+/* Time spent on each cached channel before falling back to a full scan */
+#ifdef NETSCAN_CONF_CACHE_SCAN_TIME
+#define NETSCAN_CACHE_SCAN_TIME NETSCAN_CONF_CACHE_SCAN_TIME
+#else
+#define NETSCAN_CACHE_SCAN_TIME ((CLOCK_SECOND * 3) / 10)
+#endif
+
+/* Cached networks are forgotten after this many scans without beacons */
+#ifdef NETSCAN_CONF_CACHE_MAX_MISSES
+#define NETSCAN_CACHE_MAX_MISSES NETSCAN_CONF_CACHE_MAX_MISSES
+#else
+#define NETSCAN_CACHE_MAX_MISSES 3
+#endif
+
+#if NETSCAN_CONF_STATS
+netscan_stats_t netscan_stats;
+#define NETSCAN_STAT(code) (code)
+#else /* NETSCAN_CONF_STATS */
+#define NETSCAN_STAT(code)
+#endif /* NETSCAN_CONF_STATS */
+
 #ifndef TRUE
 #define TRUE 1
 #endif
@@ -89,6 +112,9 @@
 #endif
 
 extern const struct netscan_selector NETSCAN_SELECTOR;
+#ifdef NETSCAN_CACHE_STORAGE
+extern const struct netscan_cache_storage NETSCAN_CACHE_STORAGE;
+#endif /* NETSCAN_CACHE_STORAGE */
 
 typedef enum {
   STATE_STOPPED,
@@ -106,6 +132,176 @@ static net_control_key_t control_key = NET_CONTROL_KEY_NONE;
 #endif /* UIP_CONF_IPV6_RPL */
 static struct ctimer netscan_timer;
 static scan_state_t state = STATE_STOPPED;
+
+static netscan_cache_entry_t cache[NETSCAN_CACHE_SIZE];
+static uint8_t cache_count;
+/* Set while only the cached channels are being scanned */
+static uint8_t cache_scan;
+static clock_time_t scan_start;
+/*----------------------------------------------------------------*/
+static int
+cache_find(int channel, uint16_t panid)
+{
+  int i;
+  for(i = 0; i < cache_count; i++) {
+    if(cache[i].channel == channel && cache[i].panid == panid) {
+      return i;
+    }
+  }
+  return -1;
+}
+/*----------------------------------------------------------------*/
+static void
+cache_remove(int index)
+{
+  cache_count--;
+  memmove(&cache[index], &cache[index + 1],
+          (cache_count - index) * sizeof(netscan_cache_entry_t));
+}
+/*----------------------------------------------------------------*/
+/*
+ * Move an entry (or a new entry if index is -1) to the specified
+ * position, dropping the last entry if the cache is full.
+ */
+static netscan_cache_entry_t *
+cache_move(int index, int position)
+{
+  netscan_cache_entry_t entry;
+
+  if(index >= 0) {
+    entry = cache[index];
+    cache_remove(index);
+  } else {
+    memset(&entry, 0, sizeof(entry));
+    if(cache_count >= NETSCAN_CACHE_SIZE) {
+      cache_count--;
+    }
+  }
+  if(position > cache_count) {
+    position = cache_count;
+  }
+  memmove(&cache[position + 1], &cache[position],
+          (cache_count - position) * sizeof(netscan_cache_entry_t));
+  cache[position] = entry;
+  cache_count++;
+  return &cache[position];
+}
+/*----------------------------------------------------------------*/
+static void
+cache_beacon_received(int channel, uint16_t panid,
+                      const uint8_t *payload, uint8_t length)
+{
+  netscan_cache_entry_t *e;
+  uint8_t buf[4];
+  uint16_t etx;
+  uint32_t owner;
+  int i, n;
+
+  i = cache_find(channel, panid);
+  if(i != 0) {
+    /* Most recently seen networks first, after the selected network */
+    e = cache_move(i, cache_count > 0 &&
+                   (cache[0].flags & NETSCAN_CACHE_FLAG_SELECTED) ? 1 : 0);
+  } else {
+    e = &cache[0];
+  }
+  if(i < 0) {
+    e->channel = channel;
+    e->panid = panid;
+  }
+
+  if(payload != NULL && length > 0) {
+    n = sparrow_beacon_get_etx(payload, length, buf, 2);
+    for(etx = 0, i = 0; i < n; i++) {
+      etx = (etx << 8) | buf[i];
+    }
+    if(etx > 0 && (e->etx == 0 || etx < e->etx ||
+                   (e->flags & NETSCAN_CACHE_FLAG_HEARD) == 0)) {
+      e->etx = etx;
+    }
+
+    n = sparrow_beacon_get_owner(payload, length, buf, 4);
+    for(owner = 0, i = 0; i < n; i++) {
+      owner = (owner << 8) | buf[i];
+    }
+    if(owner != 0) {
+      e->owner = owner;
+    }
+  }
+  e->flags |= NETSCAN_CACHE_FLAG_HEARD;
+  e->misses = 0;
+}
+/*----------------------------------------------------------------*/
+static void
+cache_channel_done(int channel)
+{
+  int i;
+  for(i = cache_count - 1; i >= 0; i--) {
+    if(cache[i].channel == channel &&
+       (cache[i].flags & NETSCAN_CACHE_FLAG_HEARD) == 0) {
+      cache[i].misses++;
+      if(cache[i].misses >= NETSCAN_CACHE_MAX_MISSES) {
+        PRINTF("netscan: forgetting network ch %d pan id %04x\n",
+               channel, cache[i].panid);
+        cache_remove(i);
+      }
+    }
+  }
+}
+/*----------------------------------------------------------------*/
+static void
+cache_save(void)
+{
+#ifdef NETSCAN_CACHE_STORAGE
+  if(!NETSCAN_CACHE_STORAGE.write((const uint8_t *)cache,
+                                  cache_count * sizeof(netscan_cache_entry_t))) {
+    PRINTF("netscan: failed to save network cache\n");
+  }
+#endif /* NETSCAN_CACHE_STORAGE */
+}
+/*----------------------------------------------------------------*/
+static void
+cache_load(void)
+{
+  int i;
+
+  cache_count = 0;
+#ifdef NETSCAN_CACHE_STORAGE
+  cache_count = NETSCAN_CACHE_STORAGE.read((uint8_t *)cache, sizeof(cache))
+    / sizeof(netscan_cache_entry_t);
+#endif /* NETSCAN_CACHE_STORAGE */
+
+  for(i = cache_count - 1; i >= 0; i--) {
+    if(cache[i].channel < 11 || cache[i].channel > 26) {
+      cache_remove(i);
+    } else {
+      cache[i].flags &= ~NETSCAN_CACHE_FLAG_HEARD;
+    }
+  }
+  PRINTF("netscan: %u networks in cache\n", cache_count);
+}
+/*----------------------------------------------------------------*/
+int
+netscan_cache_count(void)
+{
+  return cache_count;
+}
+/*----------------------------------------------------------------*/
+const netscan_cache_entry_t *
+netscan_cache_get(int index)
+{
+  if(index < 0 || index >= cache_count) {
+    return NULL;
+  }
+  return &cache[index];
+}
+/*----------------------------------------------------------------*/
+void
+netscan_cache_clear(void)
+{
+  cache_count = 0;
+  cache_save();
+}
 /*----------------------------------------------------------------*/
 static CC_INLINE void
 suppress_dio_output(uint8_t suppress)
@@ -133,6 +329,35 @@ timeout(void *ptr)
   }
 }
 /*----------------------------------------------------------------*/
+static void
+start_scan(void)
+{
+  uint8_t channels[NETSCAN_CACHE_SIZE];
+  int i, j, count;
+
+  for(i = 0; i < cache_count; i++) {
+    cache[i].flags &= ~NETSCAN_CACHE_FLAG_HEARD;
+  }
+
+  if(!cache_scan) {
+    NETSCAN_STAT(netscan_stats.scans++);
+    handler_802154_active_scan(radio_scan_callback);
+    return;
+  }
+
+  /* Probe the channels of the cached networks, in cache order */
+  for(count = 0, i = 0; i < cache_count; i++) {
+    for(j = 0; j < count && channels[j] != cache[i].channel; j++);
+    if(j == count) {
+      channels[count++] = cache[i].channel;
+    }
+  }
+  PRINTF("netscan: probing %d cached channels\n", count);
+  NETSCAN_STAT(netscan_stats.cache_scans++);
+  handler_802154_active_scan_channels(radio_scan_callback, channels, count,
+                                      NETSCAN_CACHE_SCAN_TIME);
+}
+/*----------------------------------------------------------------*/
 /*
  * Start a new scan
  */
@@ -145,7 +370,10 @@ netscan_start(void)
   clear_all_network_state();
 
   state = STATE_SCANNING;
-  handler_802154_active_scan(radio_scan_callback);
+  scan_start = clock_time();
+  /* Try the cached networks before a full scan */
+  cache_scan = cache_count > 0;
+  start_scan();
 }
 /*----------------------------------------------------------------*/
 /*
@@ -158,11 +386,40 @@ netscan_stop(void)
 
   suppress_dio_output(FALSE);
   state = STATE_STOPPED;
+  cache_scan = FALSE;
 }
 /* ----------------------------------------------------------------*/
 void
 netscan_select_network(int channel, uint16_t panid)
 {
+  netscan_cache_entry_t *e;
+  int i;
+
+  PRINTF("netscan: selected ch %d pan id %04x after %lu ticks\n",
+         channel, panid, (unsigned long)(clock_time() - scan_start));
+#if NETSCAN_CONF_STATS
+  netscan_stats.join_time = ((clock_time() - scan_start) * 1000UL) / CLOCK_SECOND;
+  if(netscan_stats.boot_join_time == 0) {
+    netscan_stats.boot_join_time = (clock_time() * 1000UL) / CLOCK_SECOND;
+  }
+  if(cache_scan) {
+    netscan_stats.cache_joins++;
+  }
+#endif /* NETSCAN_CONF_STATS */
+
+  for(i = 0; i < cache_count; i++) {
+    cache[i].flags &= ~NETSCAN_CACHE_FLAG_SELECTED;
+  }
+  i = cache_find(channel, panid);
+  e = cache_move(i, 0);
+  if(i < 0) {
+    e->channel = channel;
+    e->panid = panid;
+  }
+  e->flags |= NETSCAN_CACHE_FLAG_SELECTED;
+  e->misses = 0;
+  cache_save();
+
   clear_all_network_state();
   NETSTACK_RADIO.set_value(RADIO_PARAM_CHANNEL, channel);
   NETSTACK_RADIO.set_value(RADIO_PARAM_PAN_ID, panid);
@@ -235,8 +492,15 @@ radio_scan_callback(int channel, frame802154_t *frame,
     PRINTF("netscan: Active scan completed.\n");
 
     if(state == STATE_SCANNING || state == STATE_WAITING_FOR_SELECTOR) {
-      state = STATE_IDLE;
-      ctimer_restart(&netscan_timer);
+      if(cache_scan) {
+        /* No cached network selected - continue with a full scan */
+        cache_scan = FALSE;
+        state = STATE_SCANNING;
+        start_scan();
+      } else {
+        state = STATE_IDLE;
+        ctimer_restart(&netscan_timer);
+      }
     }
     return CALLBACK_STATUS_CONTINUE;
 
@@ -250,6 +514,9 @@ radio_scan_callback(int channel, frame802154_t *frame,
     PRINTLLADDR((uip_lladdr_t *)frame->src_addr);
     PRINTF("\n");
 
+    cache_beacon_received(channel, frame->src_pid,
+                          frame->payload, frame->payload_len);
+
     if(NETSCAN_SELECTOR.beacon_received) {
       switch(NETSCAN_SELECTOR.beacon_received(channel, frame->src_pid,
                                               (linkaddr_t *)frame->src_addr,
@@ -272,6 +539,8 @@ radio_scan_callback(int channel, frame802154_t *frame,
   case CALLBACK_ACTION_CHANNEL_DONE:
   case CALLBACK_ACTION_CHANNEL_DONE_LAST_CHANNEL:
     LEDS_TOGGLE();
+    NETSCAN_STAT(netscan_stats.channels_scanned++);
+    cache_channel_done(channel);
 
     if(cba == CALLBACK_ACTION_CHANNEL_DONE_LAST_CHANNEL) {
       final_channel = TRUE;
@@ -298,7 +567,7 @@ radio_scan_callback(int channel, frame802154_t *frame,
     /* This will cause channel change, clear routes */
     clear_all_network_state();
 
-    if(final_channel == TRUE) {
+    if(final_channel == TRUE && !cache_scan) {
       LEDS_OFF();
       state = STATE_IDLE;
       ctimer_restart(&netscan_timer);
@@ -362,6 +631,12 @@ clear_all_network_state(void)
 void
 netscan_init(void)
 {
+  cache_load();
+
+  if(NETSCAN_SELECTOR.init) {
+    NETSCAN_SELECTOR.init();
+  }
+
 #if UIP_CONF_IPV6_RPL
   if(control_key == NET_CONTROL_KEY_NONE) {
     control_key = net_control_alloc_key();
@@ -50,6 +50,64 @@
 #endif /* NETSCAN_CONF_SELECTOR */
 #endif /* NETSCAN_SELECTOR */
 
+#ifdef NETSCAN_CONF_CACHE_SIZE
+#define NETSCAN_CACHE_SIZE NETSCAN_CONF_CACHE_SIZE
+#else
+#define NETSCAN_CACHE_SIZE 4
+#endif /* NETSCAN_CONF_CACHE_SIZE */
+
+#ifdef NETSCAN_CONF_CACHE_STORAGE
+#define NETSCAN_CACHE_STORAGE NETSCAN_CONF_CACHE_STORAGE
+#elif defined(NETSCAN_CONF_FLASH_CACHE_ADDRESS)
+#define NETSCAN_CACHE_STORAGE netscan_flash_cache_storage
+#endif /* NETSCAN_CONF_CACHE_STORAGE */
+
+#ifndef NETSCAN_CONF_STATS
+#define NETSCAN_CONF_STATS 0
+#endif
+
+/* The network that was last selected */
+#define NETSCAN_CACHE_FLAG_SELECTED 0x01
+/* Beacon received from the network during current scan */
+#define NETSCAN_CACHE_FLAG_HEARD    0x02
+
+/*
+ * A network seen in earlier scans. The cache is ordered with the last
+ * selected network first, followed by the most recently seen networks.
+ */
+typedef struct {
+  uint8_t channel;
+  uint8_t flags;
+  uint16_t panid;
+  uint16_t etx;          /* Best ETX announced in beacons, 0 if unknown */
+  uint8_t misses;        /* Scans of the channel without beacons */
+  uint8_t reserved;
+  uint32_t owner;        /* Owner announced in beacons, 0 if unknown */
+} netscan_cache_entry_t;
+
+/*
+ * Storage for the network cache between reboots. Read returns the
+ * number of bytes read (0 if no cache has been stored) and write
+ * returns non-zero on success.
+ */
+struct netscan_cache_storage {
+  int (* read)(uint8_t *data, int len);
+  int (* write)(const uint8_t *data, int len);
+};
+
+#if NETSCAN_CONF_STATS
+typedef struct netscan_stats {
+  uint32_t join_time;        /* msec from scan start to network selection */
+  uint32_t boot_join_time;   /* msec from boot to first network selection */
+  uint16_t scans;
+  uint16_t cache_scans;
+  uint16_t cache_joins;      /* Networks selected in a cache scan */
+  uint16_t channels_scanned;
+} netscan_stats_t;
+
+extern netscan_stats_t netscan_stats;
+#endif /* NETSCAN_CONF_STATS */
+
 typedef enum {
   NETSCAN_CONTINUE,
   NETSCAN_WAIT,
@@ -62,6 +120,10 @@ void netscan_stop(void);
 void netscan_select_network(int channel, uint16_t panid);
 int netscan_set_beacon_payload(const uint8_t *payload, uint8_t payload_length);
 
+int netscan_cache_count(void);
+const netscan_cache_entry_t *netscan_cache_get(int index);
+void netscan_cache_clear(void);
+
 struct netscan_selector {
   void (* init)(void);
   int  (* is_done)(void);
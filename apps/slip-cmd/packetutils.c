@@ -32,9 +32,73 @@
 #include "dev/radio.h"
 #include "net/packetbuf.h"
 
+#include <string.h>
+
 #define DEBUG DEBUG_NONE
 #include "net/ip/uip-debug.h"
 
+#ifdef PACKETUTILS_CONF_DELTA_ATTS
+#define PACKETUTILS_DELTA_ATTS PACKETUTILS_CONF_DELTA_ATTS
+#else
+#define PACKETUTILS_DELTA_ATTS 1
+#endif
+
+/*
+ * Number of peers with separate delta coding state, such as the serial
+ * radios of a border router. The peer is selected with
+ * packetutils_set_atts_context() before serializing or deserializing.
+ */
+#ifdef PACKETUTILS_CONF_ATTS_CONTEXTS
+#define PACKETUTILS_ATTS_CONTEXTS PACKETUTILS_CONF_ATTS_CONTEXTS
+#else
+#define PACKETUTILS_ATTS_CONTEXTS 1
+#endif
+
+/* Absolute values are sent regularly to recover from lost frames */
+#ifdef PACKETUTILS_CONF_KEYFRAME_INTERVAL
+#define PACKETUTILS_KEYFRAME_INTERVAL PACKETUTILS_CONF_KEYFRAME_INTERVAL
+#else
+#define PACKETUTILS_KEYFRAME_INTERVAL 16
+#endif
+
+/**
+ * Compact attribute encoding:
+ *
+ *   header   marker (bit 7), delta bitmap follows (bit 6),
+ *            version (bit 4-5), frame counter (bit 0-3)
+ *   varint   presence bitmap, bit n - 1 for attribute n
+ *   varint   delta bitmap, only when bit 6 in header is set
+ *   varint   value for each present attribute, in attribute order
+ *
+ * Attributes are zero when not present. An attribute marked in the
+ * delta bitmap is relative to the previous frame: a zigzag coded
+ * difference when present and unchanged when not present. A frame
+ * without delta bitmap is a keyframe.
+ */
+#define PACKETUTILS_COMPACT_MARKER        0x80
+#define PACKETUTILS_COMPACT_DELTA         0x40
+#define PACKETUTILS_COMPACT_VERSION_SHIFT 4
+#define PACKETUTILS_COMPACT_VERSION       1
+#define PACKETUTILS_COMPACT_COUNT_MASK    0x0f
+
+/* Attributes that usually change little between frames */
+#define DELTA_ATTRS ((1 << PACKETUTILS_ATTR_CHANNEL) |      \
+                     (1 << PACKETUTILS_ATTR_LINK_QUALITY) | \
+                     (1 << PACKETUTILS_ATTR_RSSI))
+
+/* Delta coding state for one peer */
+struct atts_context {
+  uint8_t tx_count;
+  uint8_t rx_count;
+  uint16_t rx_known;
+  uint16_t tx_prev[PACKETUTILS_ATTR_MAX];
+  uint16_t rx_prev[PACKETUTILS_ATTR_MAX];
+};
+
+static uint8_t atts_encoding = PACKETUTILS_ATTS_LEGACY;
+static struct atts_context atts_contexts[PACKETUTILS_ATTS_CONTEXTS];
+static struct atts_context *ctx = &atts_contexts[0];
+
 /**
  * NOTE: Never ever change the order in the map tables because that
  * would break backward compatibility! Support for any new attributes
@@ -93,8 +157,229 @@ packetutils_to_radio_param(int8_t radio_param)
   return RADIO_MAP[radio_param];
 }
 /*---------------------------------------------------------------------------*/
-int
-packetutils_serialize_atts(uint8_t *data, int size)
+void
+packetutils_set_atts_encoding(uint8_t encoding)
+{
+  atts_encoding = encoding;
+
+  /* Restart the delta coding in both directions for all peers */
+  memset(atts_contexts, 0, sizeof(atts_contexts));
+}
+/*---------------------------------------------------------------------------*/
+void
+packetutils_set_atts_context(uint8_t context)
+{
+  if(context < PACKETUTILS_ATTS_CONTEXTS) {
+    ctx = &atts_contexts[context];
+  }
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+packetutils_get_atts_encoding(void)
+{
+  return atts_encoding;
+}
+/*---------------------------------------------------------------------------*/
+static int
+varint_len(uint16_t v)
+{
+  return v < 0x80 ? 1 : (v < 0x4000 ? 2 : 3);
+}
+/*---------------------------------------------------------------------------*/
+static int
+put_varint(uint8_t *data, int pos, int size, uint16_t v)
+{
+  while(v >= 0x80) {
+    if(pos >= size) {
+      return -1;
+    }
+    data[pos++] = (v & 0x7f) | 0x80;
+    v >>= 7;
+  }
+  if(pos >= size) {
+    return -1;
+  }
+  data[pos++] = v;
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static int
+get_varint(const uint8_t *data, int pos, int size, uint16_t *v)
+{
+  uint32_t value = 0;
+  int shift;
+  for(shift = 0; shift < 21; shift += 7) {
+    if(pos >= size) {
+      return -1;
+    }
+    value |= (uint32_t)(data[pos] & 0x7f) << shift;
+    if((data[pos++] & 0x80) == 0) {
+      if(value > 0xffff) {
+        return -1;
+      }
+      *v = value;
+      return pos;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+zigzag(uint16_t diff)
+{
+  return (uint16_t)(diff << 1) ^ (uint16_t)((int16_t)diff >> 15);
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+unzigzag(uint16_t v)
+{
+  return (v >> 1) ^ (uint16_t)-(v & 1);
+}
+/*---------------------------------------------------------------------------*/
+/* Serialize the attribute values, indexed by PACKETUTILS_ATTR_* */
+static int
+serialize_atts_compact(const uint16_t *val, uint8_t *data, int size)
+{
+  uint16_t coded[PACKETUTILS_ATTR_MAX];
+  uint16_t present = 0;
+  uint16_t delta = 0;
+  uint8_t keyframe;
+  int i, pos;
+
+  keyframe = !PACKETUTILS_DELTA_ATTS
+    || (ctx->tx_count % PACKETUTILS_KEYFRAME_INTERVAL) == 0;
+
+  PRINTF("packetutils: serializing compact packet atts %u%s:", ctx->tx_count,
+         keyframe ? " (key)" : "");
+  for(i = 1; i < PACKETUTILS_ATTR_MAX; i++) {
+    if(val[i] == 0) {
+      /* Absent attributes are always zero */
+      continue;
+    }
+    if(!keyframe && (DELTA_ATTRS & (1 << i))) {
+      if(val[i] == ctx->tx_prev[i]) {
+        /* Unchanged since previous frame - no value needed */
+        delta |= 1 << (i - 1);
+        continue;
+      }
+      coded[i] = zigzag(val[i] - ctx->tx_prev[i]);
+      if(varint_len(coded[i]) < varint_len(val[i])) {
+        present |= 1 << (i - 1);
+        delta |= 1 << (i - 1);
+        continue;
+      }
+    }
+    present |= 1 << (i - 1);
+    coded[i] = val[i];
+  }
+
+  if(size < 1) {
+    return -1;
+  }
+  data[0] = PACKETUTILS_COMPACT_MARKER
+    | (PACKETUTILS_COMPACT_VERSION << PACKETUTILS_COMPACT_VERSION_SHIFT)
+    | (ctx->tx_count & PACKETUTILS_COMPACT_COUNT_MASK);
+  pos = put_varint(data, 1, size, present);
+  if(delta != 0) {
+    data[0] |= PACKETUTILS_COMPACT_DELTA;
+    if(pos > 0) {
+      pos = put_varint(data, pos, size, delta);
+    }
+  }
+  for(i = 1; i < PACKETUTILS_ATTR_MAX && pos > 0; i++) {
+    if(present & (1 << (i - 1))) {
+      pos = put_varint(data, pos, size, coded[i]);
+      PRINTF(" %d%s%d", i, (delta & (1 << (i - 1))) ? "~" : "=", val[i]);
+    }
+  }
+  PRINTF(" (%d bytes)\n", pos);
+  if(pos < 0) {
+    return -1;
+  }
+
+  /* Only remember the values once the frame is known to be encoded */
+  for(i = 1; i < PACKETUTILS_ATTR_MAX; i++) {
+    if(DELTA_ATTRS & (1 << i)) {
+      ctx->tx_prev[i] = val[i];
+    }
+  }
+  ctx->tx_count++;
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static int
+deserialize_atts_compact(const uint8_t *data, int size)
+{
+  uint16_t present, delta = 0, val;
+  uint8_t count;
+  int i, pos, attr;
+
+  if(((data[0] >> PACKETUTILS_COMPACT_VERSION_SHIFT) & 3)
+     != PACKETUTILS_COMPACT_VERSION) {
+    PRINTF("packetutils: *** unsupported atts version 0x%02x\n", data[0]);
+    return -1;
+  }
+  count = data[0] & PACKETUTILS_COMPACT_COUNT_MASK;
+  pos = get_varint(data, 1, size, &present);
+  if(pos > 0 && (data[0] & PACKETUTILS_COMPACT_DELTA)) {
+    pos = get_varint(data, pos, size, &delta);
+  }
+  if(pos < 0) {
+    PRINTF("packetutils: *** truncated atts. size=%d!\n", size);
+    return -1;
+  }
+
+  if(count != ctx->rx_count && ctx->rx_known != 0) {
+    /* A frame has been lost and the previous values are unknown until
+       they are sent as absolute values again */
+    PRINTF("packetutils: lost atts frame %u (got %u)\n", ctx->rx_count, count);
+    ctx->rx_known = 0;
+  }
+  ctx->rx_count = (count + 1) & PACKETUTILS_COMPACT_COUNT_MASK;
+
+  PRINTF("packetutils: deserializing compact packet atts %u:", count);
+  for(i = 1; i < PACKETUTILS_ATTR_MAX; i++) {
+    val = 0;
+    if(present & (1 << (i - 1))) {
+      pos = get_varint(data, pos, size, &val);
+      if(pos < 0) {
+        PRINTF(" *** truncated. size=%d!\n", size);
+        return -1;
+      }
+      if(delta & (1 << (i - 1))) {
+        val = ctx->rx_prev[i] + unzigzag(val);
+      }
+    } else if(delta & (1 << (i - 1))) {
+      val = ctx->rx_prev[i];
+    }
+    if(DELTA_ATTRS & (1 << i)) {
+      ctx->rx_prev[i] = val;
+      if((delta & (1 << (i - 1))) == 0) {
+        ctx->rx_known |= 1 << i;
+      } else if((ctx->rx_known & (1 << i)) == 0) {
+        /* Value relative to an unknown frame */
+        continue;
+      }
+    }
+    if(val != 0) {
+      attr = ATTR_MAP[i];
+      PRINTF(" %d=%d", attr, val);
+      packetbuf_set_attr(attr, val);
+    }
+  }
+  /* Remaining presence bits are attributes unknown to this version */
+  present >>= PACKETUTILS_ATTR_MAX - 1;
+  for(; present != 0 && pos > 0; present >>= 1) {
+    if(present & 1) {
+      pos = get_varint(data, pos, size, &val);
+    }
+  }
+  PRINTF("\n");
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static int
+serialize_atts_legacy(uint8_t *data, int size)
 {
   int i;
   /* set the length first later */
@@ -102,6 +387,7 @@ packetutils_serialize_atts(uint8_t *data, int size)
   int cnt = 0;
   /* assume that values are 16-bit */
   uint16_t val;
+
   PRINTF("packetutils: serializing packet atts");
   for(i = 0; i < PACKETUTILS_ATTR_MAX; i++) {
     val = packetbuf_attr(ATTR_MAP[i]);
@@ -123,10 +409,73 @@ packetutils_serialize_atts(uint8_t *data, int size)
 }
 /*---------------------------------------------------------------------------*/
 int
+packetutils_serialize_atts(uint8_t *data, int size)
+{
+  uint16_t val[PACKETUTILS_ATTR_MAX];
+  int i;
+
+  if(atts_encoding != PACKETUTILS_ATTS_COMPACT) {
+    return serialize_atts_legacy(data, size);
+  }
+  for(i = 0; i < PACKETUTILS_ATTR_MAX; i++) {
+    val[i] = packetbuf_attr(ATTR_MAP[i]);
+  }
+  return serialize_atts_compact(val, data, size);
+}
+/*---------------------------------------------------------------------------*/
+int
+packetutils_encode_queued_atts(uint8_t *data, int len, int size)
+{
+  uint16_t val[PACKETUTILS_ATTR_MAX];
+  /* Header, presence and delta bitmaps, and at most 3 bytes per value */
+  uint8_t atts[PACKETUTILS_ATTR_MAX * 3 + 7];
+  int i, cnt, pos, n;
+
+  if(atts_encoding != PACKETUTILS_ATTS_COMPACT
+     || len < 1 || (data[0] & PACKETUTILS_COMPACT_MARKER)) {
+    /* Nothing to encode */
+    return len;
+  }
+  cnt = data[0];
+  pos = 1 + cnt * 3;
+  if(pos > len) {
+    return -1;
+  }
+
+  memset(val, 0, sizeof(val));
+  for(i = 1; i < pos; i += 3) {
+    if(data[i] < PACKETUTILS_ATTR_MAX) {
+      val[data[i]] = (data[i + 1] << 8) | data[i + 2];
+    }
+  }
+
+  /* The encoded attributes and the payload must fit in size bytes */
+  n = size - (len - pos);
+  if(n > (int)sizeof(atts)) {
+    n = sizeof(atts);
+  }
+  n = serialize_atts_compact(val, atts, n);
+  if(n < 0) {
+    /* No room - keep the absolute values which are always accepted */
+    return len;
+  }
+  memmove(&data[n], &data[pos], len - pos);
+  memcpy(data, atts, n);
+  return len - pos + n;
+}
+/*---------------------------------------------------------------------------*/
+int
 packetutils_deserialize_atts(const uint8_t *data, int size)
 {
   int i, cnt, pos, attr;
 
+  if(size < 1) {
+    return -1;
+  }
+  if(data[0] & PACKETUTILS_COMPACT_MARKER) {
+    return deserialize_atts_compact(data, size);
+  }
+
   pos = 0;
   cnt = data[pos++];
   PRINTF("packetutils: deserializing %d packet atts:", cnt);
@@ -148,15 +497,31 @@ packetutils_deserialize_atts(const uint8_t *data, int size)
   return pos;
 }
 /*---------------------------------------------------------------------------*/
+/* Append the packet data after n bytes of serialized attributes */
+static int
+serialize_packetbuf(uint8_t *data, int size, int n)
+{
+  if(n < 0) {
+    return -1;
+  }
+  if(n + packetbuf_totlen() > size) {
+    PRINTF("packetutils: *** too large packet. size=%d!\n", size);
+    return -1;
+  }
+  return n + packetbuf_copyto(&data[n]);
+}
+/*---------------------------------------------------------------------------*/
 int
 packetutils_serialize_packetbuf(uint8_t *data, int size)
 {
-  int n;
-
-  n = packetutils_serialize_atts(data, size);
-  /* TODO: add packet data also!!! */
-
-  return n;
+  return serialize_packetbuf(data, size,
+                             packetutils_serialize_atts(data, size));
+}
+/*---------------------------------------------------------------------------*/
+int
+packetutils_serialize_packetbuf_queued(uint8_t *data, int size)
+{
+  return serialize_packetbuf(data, size, serialize_atts_legacy(data, size));
 }
 /*---------------------------------------------------------------------------*/
 int
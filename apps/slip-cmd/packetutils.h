@@ -75,6 +75,26 @@ enum {
   PACKETUTILS_ATTR_MAX
 };
 
+/**
+ * Packet attribute encodings. The legacy encoding is a count byte
+ * followed by index and 16-bit value for each attribute. The compact
+ * encoding is a header byte with the high bit set, a presence bitmap
+ * and varint values, optionally delta coded against the previous
+ * frame. Both encodings are always accepted when deserializing but
+ * the compact encoding must only be sent when the peer supports it.
+ */
+#define PACKETUTILS_ATTS_LEGACY  0
+#define PACKETUTILS_ATTS_COMPACT 1
+
+void packetutils_set_atts_encoding(uint8_t encoding);
+uint8_t packetutils_get_atts_encoding(void);
+
+/**
+ * Select the peer whose delta coding state is used by the following
+ * serialization calls. Only needed when talking to several peers.
+ */
+void packetutils_set_atts_context(uint8_t context);
+
 int8_t packetutils_from_radio_param(int radio_param);
 int packetutils_to_radio_param(int8_t radio_param);
 
@@ -85,4 +105,23 @@ int packetutils_deserialize_atts(const uint8_t *data, int size);
 int packetutils_deserialize_packetbuf(const uint8_t *data, int len);
 int packetutils_serialize_packetbuf(uint8_t *data, int size);
 
+/**
+ * Serialize the packetbuf for a frame that is queued before it is
+ * sent. The attributes are written as absolute values in the legacy
+ * encoding and must be encoded with packetutils_encode_queued_atts()
+ * when the frame is sent, so that the delta coding follows the order
+ * of the frames on the link even if queued frames are reordered or
+ * dropped.
+ */
+int packetutils_serialize_packetbuf_queued(uint8_t *data, int size);
+
+/**
+ * Encode the attributes of a frame serialized with
+ * packetutils_serialize_packetbuf_queued() in place, with the current
+ * encoding and context. The frame is kept as is if the encoded frame
+ * would not fit in size bytes. Returns the new frame length or -1 if
+ * the attributes are invalid.
+ */
+int packetutils_encode_queued_atts(uint8_t *data, int len, int size);
+
 #endif /* PACKETUTILS_H_ */
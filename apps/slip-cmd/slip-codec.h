@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2016, Yanzi Networks AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *    3. Neither the name of the copyright holders nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         SLIP framing of the serial protocol between the native border
+ *         router and the serial radio.
+ */
+
+#ifndef SLIP_CODEC_H_
+#define SLIP_CODEC_H_
+
+#include "contiki-conf.h"
+
+#define SLIP_END     0300
+#define SLIP_ESC     0333
+#define SLIP_ESC_END 0334
+#define SLIP_ESC_ESC 0335
+
+/* Worst case length of a SLIP encoded frame */
+#define SLIP_CODEC_MAX_ENCODED_LEN(len) ((len) * 2 + 2)
+
+/*---------------------------------------------------------------------------*/
+/*
+ * Encode a frame with leading and trailing SLIP_END into dst which
+ * must fit SLIP_CODEC_MAX_ENCODED_LEN(len) bytes. Returns the encoded
+ * length.
+ */
+static inline int
+slip_codec_encode(uint8_t *dst, const uint8_t *src, int len)
+{
+  int i, pos;
+
+  pos = 0;
+  dst[pos++] = SLIP_END;
+  for(i = 0; i < len; i++) {
+    switch(src[i]) {
+    case SLIP_END:
+      dst[pos++] = SLIP_ESC;
+      dst[pos++] = SLIP_ESC_END;
+      break;
+    case SLIP_ESC:
+      dst[pos++] = SLIP_ESC;
+      dst[pos++] = SLIP_ESC_ESC;
+      break;
+    default:
+      dst[pos++] = src[i];
+      break;
+    }
+  }
+  dst[pos++] = SLIP_END;
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Decode one received byte into buf at *pos. The caller must check
+ * for overflow after each byte. Returns 1 when the byte was SLIP_END
+ * and the frame in buf (if any) is complete.
+ */
+static inline int
+slip_codec_decode(uint8_t *state, uint8_t c, uint8_t *buf, int *pos)
+{
+  switch(c) {
+  case SLIP_END:
+    *state = 0;
+    return 1;
+  case SLIP_ESC:
+    *state = SLIP_ESC;
+    break;
+  case SLIP_ESC_END:
+    buf[(*pos)++] = *state == SLIP_ESC ? SLIP_END : SLIP_ESC_END;
+    *state = 0;
+    break;
+  case SLIP_ESC_ESC:
+    buf[(*pos)++] = *state == SLIP_ESC ? SLIP_ESC : SLIP_ESC_ESC;
+    *state = 0;
+    break;
+  default:
+    buf[(*pos)++] = c;
+    *state = 0;
+    break;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+#endif /* SLIP_CODEC_H_ */
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2016, SICS, Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Streaming decoder for delta firmware images.
+ */
+
+#include "delta-decoder.h"
+
+enum {
+  STATE_OP,
+  STATE_INSERT,
+  STATE_COPY_ARGS,
+};
+
+/* Source offset (4 bytes) and length (2 bytes) */
+#define COPY_ARGS_LENGTH 6
+/*---------------------------------------------------------------------------*/
+void
+delta_decoder_init(delta_decoder_t *d, const uint8_t *source,
+                   uint32_t source_length, uint32_t length)
+{
+  d->source = source;
+  d->source_length = source_length;
+  d->length = length;
+  d->position = 0;
+  d->copy_offset = 0;
+  d->remaining = 0;
+  d->state = STATE_OP;
+  d->arg_count = 0;
+}
+/*---------------------------------------------------------------------------*/
+delta_decoder_status_t
+delta_decoder_input(delta_decoder_t *d, const uint8_t *data, uint32_t len,
+                    int (* put)(uint8_t c))
+{
+  uint32_t i = 0;
+  uint8_t op;
+
+  while(i < len && d->position < d->length) {
+    switch(d->state) {
+    case STATE_OP:
+      op = data[i++];
+      if(op == DELTA_DECODER_OP_COPY) {
+        d->copy_offset = 0;
+        d->remaining = 0;
+        d->arg_count = 0;
+        d->state = STATE_COPY_ARGS;
+      } else if(op < DELTA_DECODER_OP_COPY) {
+        d->remaining = op + 1;
+        if(d->remaining > d->length - d->position) {
+          return DELTA_DECODER_ERROR;
+        }
+        d->state = STATE_INSERT;
+      } else {
+        return DELTA_DECODER_ERROR;
+      }
+      break;
+    case STATE_INSERT:
+      if(!put(data[i++])) {
+        return DELTA_DECODER_ERROR;
+      }
+      d->position++;
+      if(--d->remaining == 0) {
+        d->state = STATE_OP;
+      }
+      break;
+    case STATE_COPY_ARGS:
+      if(d->arg_count < 4) {
+        d->copy_offset = (d->copy_offset << 8) | data[i++];
+      } else {
+        d->remaining = (d->remaining << 8) | data[i++];
+      }
+      if(++d->arg_count < COPY_ARGS_LENGTH) {
+        break;
+      }
+      d->remaining++;
+      if(d->copy_offset > d->source_length
+         || d->remaining > d->source_length - d->copy_offset
+         || d->remaining > d->length - d->position) {
+        return DELTA_DECODER_ERROR;
+      }
+      for(; d->remaining > 0; d->remaining--) {
+        if(!put(d->source[d->copy_offset++])) {
+          return DELTA_DECODER_ERROR;
+        }
+        d->position++;
+      }
+      d->state = STATE_OP;
+      break;
+    default:
+      return DELTA_DECODER_ERROR;
+    }
+  }
+  return d->position >= d->length ? DELTA_DECODER_DONE : DELTA_DECODER_OK;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2016, SICS, Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Streaming decoder for delta firmware images.
+ *
+ *         The delta is a sequence of operations that build the new
+ *         image from the source (running) image:
+ *
+ *         0x00 - 0x7f  insert the following (op + 1) bytes
+ *         0x80         copy (length + 1) bytes from the source image,
+ *                      followed by a 32-bit source offset and a
+ *                      16-bit length, both in network byte order
+ */
+
+#ifndef DELTA_DECODER_H_
+#define DELTA_DECODER_H_
+
+#include <stdint.h>
+
+#define DELTA_DECODER_OP_COPY       0x80
+
+typedef enum {
+  DELTA_DECODER_OK,
+  DELTA_DECODER_DONE,
+  DELTA_DECODER_ERROR,
+} delta_decoder_status_t;
+
+typedef struct {
+  const uint8_t *source;
+  uint32_t source_length;
+  uint32_t length;
+  uint32_t position;
+  uint32_t copy_offset;
+  uint32_t remaining;
+  uint8_t state;
+  uint8_t arg_count;
+} delta_decoder_t;
+
+/**
+ * Prepare the decoder for a new delta producing "length" bytes from
+ * the source image.
+ */
+void delta_decoder_init(delta_decoder_t *d, const uint8_t *source,
+                        uint32_t source_length, uint32_t length);
+
+/**
+ * Apply the next part of the delta. The output is passed byte by byte
+ * to "put" which returns non-zero on success. Data after the last
+ * operation (padding) is ignored.
+ */
+delta_decoder_status_t delta_decoder_input(delta_decoder_t *d,
+                                           const uint8_t *data, uint32_t len,
+                                           int (* put)(uint8_t c));
+
+#endif /* DELTA_DECODER_H_ */
@@ -1,7 +1,7 @@
 
 /*--------------------------------------------------------------------*/
 /* Sparrow OAM Instance - DO NOT EDIT - automatically generated file. */
-/* Generated by instance-gen.py on 2016-07-14 15:13:38.               */
+/* Generated by instance-gen.py on 2026-10-19 04:45:31.               */
 /*--------------------------------------------------------------------*/
 
 /*
@@ -58,6 +58,13 @@
 #define VARIABLE_IMAGE_LENGTH            0x107
 #define VARIABLE_IMAGE_CRC32             0x108
 #define VARIABLE_IMAGE_SHA256            0x109
+#define VARIABLE_WRITE_SESSION           0x10a
+#define VARIABLE_WRITE_PROGRESS          0x10b
+#define VARIABLE_WRITE_BITMAP            0x10c
+#define VARIABLE_WRITE_CRC32             0x10d
+#define VARIABLE_WRITE_BLOCK_SIZE        0x10e
+#define VARIABLE_COMPRESSED_FLASH        0x10f
+#define VARIABLE_COMPRESSED_PROGRESS     0x110
 
 static const sparrow_oam_variable_t instance_flash_variables[] = {
 { 0x100,  4, SPARROW_OAM_WRITABILITY_WO, SPARROW_OAM_FORMAT_INTEGER,  SPARROW_OAM_VECTOR_DEPTH_DONT_CHECK },
@@ -70,6 +77,13 @@ static const sparrow_oam_variable_t instance_flash_variables[] = {
 { 0x107,  4, SPARROW_OAM_WRITABILITY_RO, SPARROW_OAM_FORMAT_INTEGER,  0 },
 { 0x108,  4, SPARROW_OAM_WRITABILITY_RO, SPARROW_OAM_FORMAT_INTEGER,  0 },
 { 0x109, 32, SPARROW_OAM_WRITABILITY_RO, SPARROW_OAM_FORMAT_INTEGER,  0 },
+{ 0x10a,  4, SPARROW_OAM_WRITABILITY_RW, SPARROW_OAM_FORMAT_INTEGER,  0 },
+{ 0x10b,  4, SPARROW_OAM_WRITABILITY_RO, SPARROW_OAM_FORMAT_INTEGER,  0 },
+{ 0x10c,  4, SPARROW_OAM_WRITABILITY_RO, SPARROW_OAM_FORMAT_INTEGER,  SPARROW_OAM_VECTOR_DEPTH_DONT_CHECK },
+{ 0x10d,  4, SPARROW_OAM_WRITABILITY_RO, SPARROW_OAM_FORMAT_INTEGER,  0 },
+{ 0x10e,  4, SPARROW_OAM_WRITABILITY_RO, SPARROW_OAM_FORMAT_INTEGER,  0 },
+{ 0x10f,  4, SPARROW_OAM_WRITABILITY_WO, SPARROW_OAM_FORMAT_INTEGER,  SPARROW_OAM_VECTOR_DEPTH_DONT_CHECK },
+{ 0x110,  4, SPARROW_OAM_WRITABILITY_RO, SPARROW_OAM_FORMAT_INTEGER,  0 },
 };
 
 #endif /* INSTANCE_FLASH_VAR_H_ */
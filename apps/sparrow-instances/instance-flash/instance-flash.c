@@ -39,6 +39,23 @@
 /**
  * Flash instance. Implements object 0x0090DA0303010010.
  * Currently hard-coded for 2 instances.
+ *
+ * Images are either written chunk by chunk with write control enabled
+ * in each PDU, or streamed using a write session. A write session
+ * stays open across PDUs, erases sectors lazily just ahead of the
+ * written data, and does not reply to successful chunk writes. The
+ * host instead reads the write progress (cumulative ack) once per PDU
+ * and the received block bitmap to find gaps to resend.
+ *
+ * Chunks written in a session must start on a block boundary and only
+ * the last chunk of the image may be shorter than a block.
+ *
+ * A compressed image or a delta against the running image (see
+ * image-trailer.h) can instead be written in order to the compressed
+ * flash variable of an open session. It is decoded directly into the
+ * image slot and verified against the CRC32 in its header when
+ * complete. The host reads the compressed progress to know where to
+ * continue after lost PDUs.
  */
 
 #include "sparrow-oam.h"
@@ -47,6 +64,14 @@
 #include "dev/sparrow-device.h"
 #include "dev/sparrow-flash.h"
 #include "instance-flash-var.h"
+#include "lzss-decoder.h"
+#include "delta-decoder.h"
+#ifdef HAVE_CRC_SEGMENTED
+#include "crc.h"
+#else
+#include "lib/crc32.h"
+#endif /* HAVE_CRC_SEGMENTED */
+#include <string.h>
 
 #define DEBUG 0
 #if DEBUG
@@ -62,9 +87,550 @@ static uint8_t backupWrite_enable = FALSE;
 #define FLASH_WRITE_CONTROL_ERASE 0x911
 #define FLASH_WRITE_CONTROL_WRITE_ENABLE 0x23
 
+#ifdef INSTANCE_FLASH_CONF_SECTOR_SIZE
+#define SECTOR_SIZE INSTANCE_FLASH_CONF_SECTOR_SIZE
+#else
+#define SECTOR_SIZE 2048
+#endif /* INSTANCE_FLASH_CONF_SECTOR_SIZE */
+
+/* Number of sectors to erase ahead of the written data in a session */
+#ifdef INSTANCE_FLASH_CONF_ERASE_AHEAD
+#define ERASE_AHEAD INSTANCE_FLASH_CONF_ERASE_AHEAD
+#else
+#define ERASE_AHEAD 1
+#endif /* INSTANCE_FLASH_CONF_ERASE_AHEAD */
+
+/* Minimum block size for the received block bitmap */
+#ifdef INSTANCE_FLASH_CONF_BLOCK_SIZE
+#define BLOCK_SIZE INSTANCE_FLASH_CONF_BLOCK_SIZE
+#else
+#define BLOCK_SIZE 256
+#endif /* INSTANCE_FLASH_CONF_BLOCK_SIZE */
+
+#ifdef INSTANCE_FLASH_CONF_MAX_BLOCKS
+#define MAX_BLOCKS INSTANCE_FLASH_CONF_MAX_BLOCKS
+#else
+#define MAX_BLOCKS 1024
+#endif /* INSTANCE_FLASH_CONF_MAX_BLOCKS */
+
+/* Close a write session after this many milliseconds without activity */
+#ifdef INSTANCE_FLASH_CONF_SESSION_TIMEOUT
+#define SESSION_TIMEOUT INSTANCE_FLASH_CONF_SESSION_TIMEOUT
+#else
+#define SESSION_TIMEOUT 120000
+#endif /* INSTANCE_FLASH_CONF_SESSION_TIMEOUT */
+
+/* Decompressed data is buffered and written to flash in chunks of this size */
+#ifdef INSTANCE_FLASH_CONF_OUTPUT_BUFFER_SIZE
+#define OUTPUT_BUFFER_SIZE INSTANCE_FLASH_CONF_OUTPUT_BUFFER_SIZE
+#else
+#define OUTPUT_BUFFER_SIZE 64
+#endif /* INSTANCE_FLASH_CONF_OUTPUT_BUFFER_SIZE */
+
+/*
+ * The bitmap is kept as 32-bit words in network byte order with block
+ * n as bit (n % 32) in word (n / 32) to be directly readable as a vector.
+ */
+#define BITMAP_WORDS           ((MAX_BLOCKS + 31) / 32)
+#define BITMAP_BYTE(n)         ((((n) >> 5) << 2) + 3 - (((n) >> 3) & 3))
+#define BITMAP_MASK(n)         (1 << ((n) & 7))
+#define BITMAP_IS_SET(n)       (session.received[BITMAP_BYTE(n)] & BITMAP_MASK(n))
+
+static struct {
+  const image_info_t *image;
+  uint64_t last_activity;
+  uint32_t id;
+  uint32_t block_size;
+  uint32_t blocks;
+  uint32_t next_block;
+  /* All offsets below are in bytes from the image start */
+  uint32_t erased;
+  uint32_t end;
+  uint32_t contiguous;
+  uint32_t crc;
+#ifndef HAVE_CRC_SEGMENTED
+  /* The contiguous length "crc" was computed over */
+  uint32_t crc_end;
+#endif /* HAVE_CRC_SEGMENTED */
+  uint8_t received[BITMAP_WORDS * 4];
+} session;
+
+#define DECOMPRESS_IDLE   0
+#define DECOMPRESS_ACTIVE 1
+#define DECOMPRESS_DONE   2
+
+#define DECOMPRESS_FORMAT_LZSS  1
+#define DECOMPRESS_FORMAT_DELTA 2
+
+static struct {
+  union {
+    lzss_decoder_t lzss;
+    delta_decoder_t delta;
+  } decoder;
+  /* Compressed bytes consumed, including the header */
+  uint32_t consumed;
+  /* Decompressed bytes written to flash */
+  uint32_t flushed;
+  uint32_t crc32;
+  uint16_t buffered;
+  uint8_t state;
+  uint8_t format;
+  uint8_t error;
+  uint32_t buffer[OUTPUT_BUFFER_SIZE / 4];
+} decompress;
+
 SPARROW_OAM_INSTANCE_NAME(instance_flash_primary);
 SPARROW_OAM_INSTANCE_NAME(instance_flash_backup);
 
+/*---------------------------------------------------------------------------*/
+static uint8_t
+is_sector_erased(uint32_t address)
+{
+  const uint32_t *p = (const uint32_t *)(uintptr_t)address;
+  int i;
+  for(i = 0; i < SECTOR_SIZE / 4; i++) {
+    if(p[i] != 0xffffffff) {
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Erase all sectors from the session erase cursor to "end" (bytes
+ * from image start). Sectors already erased are skipped.
+ * Return TRUE on success.
+ */
+static uint8_t
+session_erase_to(uint32_t end)
+{
+  uint8_t success = TRUE;
+  uint32_t address;
+
+  if(end > session.image->length) {
+    end = session.image->length;
+  }
+  if(session.erased >= end) {
+    return TRUE;
+  }
+
+  if(sparrow_flash_unlock() != SPARROW_FLASH_COMPLETE) {
+    PRINTF("instance_flash: Failed to unlock flash\n");
+    return FALSE;
+  }
+
+  for(; session.erased < end; session.erased += SECTOR_SIZE) {
+    address = session.image->start_address + session.erased;
+    if(!is_sector_erased(address)
+       && sparrow_flash_erase_sector(address) != SPARROW_FLASH_COMPLETE) {
+      success = FALSE;
+      break;
+    }
+  }
+
+  if(sparrow_flash_lock() != SPARROW_FLASH_COMPLETE) {
+    PRINTF("instance_flash: Failed to lock flash\n");
+    success = FALSE;
+  }
+  return success;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+session_open(const image_info_t *image, uint32_t id)
+{
+  if(session.image == image && session.id == id) {
+    /* Same session reopened - resume from current progress */
+    session.last_activity = uptime_read();
+    return TRUE;
+  }
+
+  /* Lazy erase requires uniform sectors */
+  if(image->number_of_sectors != 0) {
+    return FALSE;
+  }
+
+  memset(&session, 0, sizeof(session));
+  memset(&decompress, 0, sizeof(decompress));
+  session.image = image;
+  session.id = id;
+  session.block_size = BLOCK_SIZE;
+  while((image->length + session.block_size - 1) / session.block_size > MAX_BLOCKS) {
+    session.block_size <<= 1;
+  }
+  session.blocks = (image->length + session.block_size - 1) / session.block_size;
+#ifdef HAVE_CRC_SEGMENTED
+  session.crc = crc_segmented_start();
+#else /* HAVE_CRC_SEGMENTED */
+  session.crc_end = 0xffffffff;
+#endif /* HAVE_CRC_SEGMENTED */
+  session.last_activity = uptime_read();
+  PRINTF("instance_flash: session 0x%lx opened, %lu blocks of %lu bytes\n",
+         (unsigned long)id, (unsigned long)session.blocks,
+         (unsigned long)session.block_size);
+  return TRUE;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Close the session. Any old data after the written image is erased
+ * to make sure no stale trailer remains in the image slot.
+ */
+static uint8_t
+session_close(void)
+{
+  uint8_t success;
+
+  success = session_erase_to(session.image->length);
+  session.image = NULL;
+  session.id = 0;
+  return success;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Advance the cumulative ack to "end" (bytes from image start) and
+ * include the new data in the running CRC.
+ */
+static void
+session_advance(uint32_t end)
+{
+  if(end > session.contiguous) {
+#ifdef HAVE_CRC_SEGMENTED
+    session.crc = crc_segmented_add_bytes(session.crc,
+                                          (const uint8_t *)(uintptr_t)
+                                          (session.image->start_address + session.contiguous),
+                                          end - session.contiguous);
+#endif /* HAVE_CRC_SEGMENTED */
+    session.contiguous = end;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+session_mark_received(uint32_t start, uint32_t end)
+{
+  uint32_t block;
+
+  if(end > session.end) {
+    session.end = end;
+  }
+  if((start % session.block_size) != 0) {
+    /* Unaligned chunks are written but never marked as received */
+    return;
+  }
+  for(block = start / session.block_size;
+      block <= (end - 1) / session.block_size; block++) {
+    session.received[BITMAP_BYTE(block)] |= BITMAP_MASK(block);
+  }
+
+  /* Advance the cumulative ack over all blocks received without gaps */
+  while(session.next_block < session.blocks && BITMAP_IS_SET(session.next_block)) {
+    session.next_block++;
+  }
+  end = session.next_block * session.block_size;
+  if(end > session.end) {
+    end = session.end;
+  }
+  session_advance(end);
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+session_get_crc32(void)
+{
+#ifdef HAVE_CRC_SEGMENTED
+  return crc_segmented_finalize(session.crc);
+#else
+  /* Only recompute when more contiguous data has been written */
+  if(session.crc_end != session.contiguous) {
+    session.crc = crc32((const uint8_t *)(uintptr_t)session.image->start_address,
+                        session.contiguous);
+    session.crc_end = session.contiguous;
+  }
+  return session.crc;
+#endif /* HAVE_CRC_SEGMENTED */
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+session_write(const sparrow_tlv_t *request)
+{
+  uint32_t start;
+  uint32_t end;
+  uint8_t error;
+
+  start = request->offset * 4;
+  end = start + request->elements * 4;
+  if(start >= session.image->length) {
+    return SPARROW_TLV_ERROR_INVALID_VECTOR_OFFSET;
+  }
+  if(end > session.image->length || end <= start) {
+    return SPARROW_TLV_ERROR_BAD_NUMBER_OF_ELEMENTS;
+  }
+
+  session.last_activity = uptime_read();
+
+  if(!session_erase_to(end + ERASE_AHEAD * SECTOR_SIZE)) {
+    return SPARROW_TLV_ERROR_HARDWARE_ERROR;
+  }
+
+  error = instance_flash_write_flash(session.image, request->offset,
+                                     request->elements,
+                                     (const uint32_t *)request->data);
+  if(error == SPARROW_TLV_ERROR_NO_ERROR) {
+    session_mark_received(start, end);
+  }
+  return error;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Write the buffered decompressed data to flash. The buffer is always
+ * a multiple of 32-bit words since the image length must be.
+ */
+static uint8_t
+decompress_flush(void)
+{
+  uint32_t end;
+
+  if(decompress.buffered == 0) {
+    return TRUE;
+  }
+  end = decompress.flushed + decompress.buffered;
+  if(!session_erase_to(end + ERASE_AHEAD * SECTOR_SIZE)
+     || instance_flash_write_flash(session.image, decompress.flushed / 4,
+                                   decompress.buffered / 4,
+                                   decompress.buffer) != SPARROW_TLV_ERROR_NO_ERROR) {
+    decompress.error = SPARROW_TLV_ERROR_HARDWARE_ERROR;
+    return FALSE;
+  }
+  decompress.flushed = end;
+  decompress.buffered = 0;
+  session.end = end;
+  session_advance(end);
+  return TRUE;
+}
+/*---------------------------------------------------------------------------*/
+static int
+decompress_put(uint8_t c)
+{
+  ((uint8_t *)decompress.buffer)[decompress.buffered++] = c;
+  if(decompress.buffered == OUTPUT_BUFFER_SIZE) {
+    return decompress_flush();
+  }
+  return TRUE;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Back references are read from the image already written to flash,
+ * which means no RAM is needed for the decompression window.
+ */
+static uint8_t
+decompress_get(uint32_t position)
+{
+  if(position >= decompress.flushed) {
+    return ((uint8_t *)decompress.buffer)[position - decompress.flushed];
+  }
+  return *(const uint8_t *)(uintptr_t)(session.image->start_address + position);
+}
+/*---------------------------------------------------------------------------*/
+static const lzss_output_t decompress_output = {
+  decompress_put, decompress_get
+};
+/*---------------------------------------------------------------------------*/
+static uint8_t
+is_valid_length(uint32_t length)
+{
+  return length > 0 && (length & 3) == 0 && length <= session.image->length;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+decompress_start_lzss(const uint8_t *data, uint32_t len)
+{
+  const image_compressed_header_t *header;
+  uint32_t length;
+
+  if(len < sizeof(image_compressed_header_t)) {
+    return SPARROW_TLV_ERROR_BAD_NUMBER_OF_ELEMENTS;
+  }
+  header = (const image_compressed_header_t *)data;
+  length = sparrow_tlv_get_int32_from_data((const uint8_t *)&header->length);
+  if(header->algorithm != IMAGE_COMPRESSION_LZSS || !is_valid_length(length)) {
+    return SPARROW_TLV_ERROR_INVALID_ARGUMENT;
+  }
+  if(!lzss_decoder_init(&decompress.decoder.lzss, header->window_bits,
+                        header->lookahead_bits, length)) {
+    return SPARROW_TLV_ERROR_INVALID_ARGUMENT;
+  }
+  decompress.format = DECOMPRESS_FORMAT_LZSS;
+  decompress.crc32 = sparrow_tlv_get_int32_from_data((const uint8_t *)&header->crc32);
+  decompress.consumed = sizeof(image_compressed_header_t);
+  PRINTF("instance_flash: decompressing %lu bytes\n", (unsigned long)length);
+  return SPARROW_TLV_ERROR_NO_ERROR;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * A delta is applied to the running image, which must be the exact
+ * image the delta was created from.
+ */
+static uint8_t
+decompress_start_delta(const uint8_t *data, uint32_t len)
+{
+  const image_delta_header_t *header;
+  const image_info_t *source;
+  uint64_t source_version;
+  uint32_t source_length;
+  uint32_t length;
+  uint8_t running;
+
+  if(len < sizeof(image_delta_header_t)) {
+    return SPARROW_TLV_ERROR_BAD_NUMBER_OF_ELEMENTS;
+  }
+  running = SPARROW_DEVICE.get_running_image();
+  if(running < 1 || running > IMAGE_TRAILER_MAX_IMAGE_COUNT) {
+    return SPARROW_TLV_ERROR_HARDWARE_ERROR;
+  }
+  source = &image_trailer_get_images()[running - 1];
+
+  header = (const image_delta_header_t *)data;
+  source_version = (uint64_t)sparrow_tlv_get_int32_from_data((const uint8_t *)&header->source_version) << 32;
+  source_version |= sparrow_tlv_get_int32_from_data((const uint8_t *)&header->source_version + 4);
+  source_length = sparrow_tlv_get_int32_from_data((const uint8_t *)&header->source_length);
+  length = sparrow_tlv_get_int32_from_data((const uint8_t *)&header->length);
+  if(!is_valid_length(length)) {
+    return SPARROW_TLV_ERROR_INVALID_ARGUMENT;
+  }
+  if(source_version != image_trailer_get_image_version(source)
+     || source_length != image_trailer_get_image_length(source)
+     || sparrow_tlv_get_int32_from_data((const uint8_t *)&header->source_crc32)
+     != image_trailer_get_image_crc32(source)) {
+    PRINTF("instance_flash: delta for another source image\n");
+    return SPARROW_TLV_ERROR_INVALID_ARGUMENT;
+  }
+
+  delta_decoder_init(&decompress.decoder.delta,
+                     (const uint8_t *)(uintptr_t)source->start_address,
+                     source_length, length);
+  decompress.format = DECOMPRESS_FORMAT_DELTA;
+  decompress.crc32 = sparrow_tlv_get_int32_from_data((const uint8_t *)&header->crc32);
+  decompress.consumed = sizeof(image_delta_header_t);
+  PRINTF("instance_flash: applying delta for %lu bytes\n", (unsigned long)length);
+  return SPARROW_TLV_ERROR_NO_ERROR;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+decompress_start(const uint8_t *data, uint32_t len)
+{
+  uint32_t magic;
+  uint8_t error;
+
+  if(len < 4) {
+    return SPARROW_TLV_ERROR_BAD_NUMBER_OF_ELEMENTS;
+  }
+  magic = sparrow_tlv_get_int32_from_data(data);
+  if(magic == IMAGE_COMPRESSED_MAGIC) {
+    error = decompress_start_lzss(data, len);
+  } else if(magic == IMAGE_DELTA_MAGIC) {
+    error = decompress_start_delta(data, len);
+  } else {
+    error = SPARROW_TLV_ERROR_INVALID_ARGUMENT;
+  }
+  if(error == SPARROW_TLV_ERROR_NO_ERROR) {
+    decompress.state = DECOMPRESS_ACTIVE;
+  }
+  return error;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Decode the next part of the stream. Returns TRUE when the complete
+ * image has been written to flash.
+ */
+static uint8_t
+decompress_input(const uint8_t *data, uint32_t len)
+{
+  if(decompress.format == DECOMPRESS_FORMAT_DELTA) {
+    switch(delta_decoder_input(&decompress.decoder.delta, data, len, decompress_put)) {
+    case DELTA_DECODER_OK:
+      return FALSE;
+    case DELTA_DECODER_DONE:
+      return TRUE;
+    default:
+      break;
+    }
+  } else {
+    switch(lzss_decoder_input(&decompress.decoder.lzss, data, len, &decompress_output)) {
+    case LZSS_DECODER_OK:
+      return FALSE;
+    case LZSS_DECODER_DONE:
+      return TRUE;
+    default:
+      break;
+    }
+  }
+  if(decompress.error == SPARROW_TLV_ERROR_NO_ERROR) {
+    decompress.error = SPARROW_TLV_ERROR_INVALID_ARGUMENT;
+  }
+  return FALSE;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Write compressed or delta data. The data must be written in order
+ * but already consumed data is accepted (and ignored) to handle resends.
+ */
+static uint8_t
+decompress_write(const sparrow_tlv_t *request)
+{
+  const uint8_t *data;
+  uint32_t start;
+  uint32_t len;
+  uint8_t error;
+  uint8_t done;
+
+  if(decompress.error != SPARROW_TLV_ERROR_NO_ERROR) {
+    /* The session must be reopened after a failure */
+    return decompress.error;
+  }
+
+  start = request->offset * 4;
+  len = request->elements * 4;
+  if(start > decompress.consumed) {
+    /* Gap in the compressed data */
+    return SPARROW_TLV_ERROR_INVALID_VECTOR_OFFSET;
+  }
+
+  session.last_activity = uptime_read();
+
+  if(decompress.state == DECOMPRESS_IDLE) {
+    if(session.end > 0) {
+      /* Uncompressed data has already been written in this session */
+      return SPARROW_TLV_ERROR_WRITE_ACCESS_DENIED;
+    }
+    error = decompress_start(request->data, len);
+    if(error != SPARROW_TLV_ERROR_NO_ERROR) {
+      return error;
+    }
+  }
+
+  if(decompress.state == DECOMPRESS_DONE || start + len <= decompress.consumed) {
+    /* Resent or padding data */
+    return SPARROW_TLV_ERROR_NO_ERROR;
+  }
+
+  data = request->data + (decompress.consumed - start);
+  len -= decompress.consumed - start;
+  done = decompress_input(data, len);
+  decompress.consumed += len;
+
+  if(decompress.error != SPARROW_TLV_ERROR_NO_ERROR) {
+    return decompress.error;
+  }
+  if(done) {
+    if(!decompress_flush()) {
+      return decompress.error;
+    }
+    if(session_get_crc32() != decompress.crc32) {
+      PRINTF("instance_flash: decoded image has bad CRC32\n");
+      decompress.error = SPARROW_TLV_ERROR_INVALID_ARGUMENT;
+      return decompress.error;
+    }
+    decompress.state = DECOMPRESS_DONE;
+  }
+  return SPARROW_TLV_ERROR_NO_ERROR;
+}
 /*---------------------------------------------------------------------------*/
 
 /**
@@ -117,6 +683,18 @@ flash_process_request(const sparrow_oam_instance_t *instance,
      * Payload variables
      */
     if(request->variable == VARIABLE_FLASH) {
+      if(session.image == image) {
+        /* Streaming write - only errors are replied */
+        if(decompress.state != DECOMPRESS_IDLE) {
+          error = SPARROW_TLV_ERROR_WRITE_ACCESS_DENIED;
+        } else {
+          error = session_write(request);
+        }
+        if(error == SPARROW_TLV_ERROR_NO_ERROR) {
+          return 0;
+        }
+        return sparrow_tlv_write_reply_error(request, error, reply, len);
+      }
       if(*write_enable) {
         error = instance_flash_write_flash(image, request->offset, request->elements, (uint32_t *)request->data);
       } else {
@@ -128,6 +706,16 @@ flash_process_request(const sparrow_oam_instance_t *instance,
       } else {
         return sparrow_tlv_write_reply_error(request, error, reply, len);
       }
+    } else if(request->variable == VARIABLE_COMPRESSED_FLASH) {
+      if(session.image != image) {
+        return sparrow_tlv_write_reply_error(request, SPARROW_TLV_ERROR_WRITE_ACCESS_DENIED, reply, len);
+      }
+      /* Same as streaming write - only errors are replied */
+      error = decompress_write(request);
+      if(error == SPARROW_TLV_ERROR_NO_ERROR) {
+        return 0;
+      }
+      return sparrow_tlv_write_reply_error(request, error, reply, len);
     } else if(request->variable == VARIABLE_WRITE_CONTROL) {
       if(!image_index || image_index == SPARROW_DEVICE.get_running_image()) {
         return sparrow_tlv_write_reply_error(request, SPARROW_TLV_ERROR_WRITE_ACCESS_DENIED, reply, len);
@@ -138,6 +726,11 @@ flash_process_request(const sparrow_oam_instance_t *instance,
       local32 |= request->data[3];
 
       if(local32 == FLASH_WRITE_CONTROL_ERASE) {
+        if(session.image == image) {
+          /* Erasing the image invalidates any ongoing write session */
+          session.image = NULL;
+          session.id = 0;
+        }
         if(instance_flash_erase_image(image) != TRUE) {
           return sparrow_tlv_write_reply_error(request, SPARROW_TLV_ERROR_HARDWARE_ERROR, reply, len);
         }
@@ -146,6 +739,23 @@ flash_process_request(const sparrow_oam_instance_t *instance,
         *write_enable = TRUE;
         return sparrow_tlv_write_reply32(request, reply, len, sparrow_tlv_zeroes);
       }
+    } else if(request->variable == VARIABLE_WRITE_SESSION) {
+      if(!image_index || image_index == SPARROW_DEVICE.get_running_image()) {
+        return sparrow_tlv_write_reply_error(request, SPARROW_TLV_ERROR_WRITE_ACCESS_DENIED, reply, len);
+      }
+      local32 = sparrow_tlv_get_int32_from_data(request->data);
+      if(local32 != 0) {
+        if(session.image != NULL && session.image != image) {
+          /* Only one image can be written at a time */
+          return sparrow_tlv_write_reply_error(request, SPARROW_TLV_ERROR_DEVICE_BUSY, reply, len);
+        }
+        if(!session_open(image, local32)) {
+          return sparrow_tlv_write_reply_error(request, SPARROW_TLV_ERROR_HARDWARE_ERROR, reply, len);
+        }
+      } else if(session.image == image && !session_close()) {
+        return sparrow_tlv_write_reply_error(request, SPARROW_TLV_ERROR_HARDWARE_ERROR, reply, len);
+      }
+      return sparrow_tlv_write_reply32(request, reply, len, request->data);
     }
     return sparrow_tlv_write_reply_error(request, SPARROW_TLV_ERROR_UNKNOWN_VARIABLE, reply, len);
   } else if((request->opcode == SPARROW_TLV_OPCODE_GET_REQUEST) || (request->opcode == SPARROW_TLV_OPCODE_VECTOR_GET_REQUEST)) {
@@ -178,6 +788,35 @@ flash_process_request(const sparrow_oam_instance_t *instance,
     } else if(request->variable == VARIABLE_IMAGE_CRC32) {
       local32 = image_trailer_get_image_crc32(image);
       return sparrow_tlv_write_reply32int(request, reply, len, local32);
+    } else if(request->variable == VARIABLE_WRITE_SESSION) {
+      local32 = session.image == image ? session.id : 0;
+      return sparrow_tlv_write_reply32int(request, reply, len, local32);
+    } else if(session.image != image &&
+              request->variable >= VARIABLE_WRITE_PROGRESS &&
+              request->variable <= VARIABLE_COMPRESSED_PROGRESS) {
+      /* Session variables are only available in an open session */
+      return sparrow_tlv_write_reply_error(request, SPARROW_TLV_ERROR_READ_ACCESS_DENIED, reply, len);
+    } else if(request->variable == VARIABLE_WRITE_PROGRESS) {
+      /* Number of 32-bit words written without gaps */
+      return sparrow_tlv_write_reply32int(request, reply, len, session.contiguous / 4);
+    } else if(request->variable == VARIABLE_WRITE_CRC32) {
+      return sparrow_tlv_write_reply32int(request, reply, len, session_get_crc32());
+    } else if(request->variable == VARIABLE_WRITE_BLOCK_SIZE) {
+      return sparrow_tlv_write_reply32int(request, reply, len, session.block_size);
+    } else if(request->variable == VARIABLE_COMPRESSED_PROGRESS) {
+      /* Number of 32-bit words of compressed data consumed */
+      return sparrow_tlv_write_reply32int(request, reply, len, decompress.consumed / 4);
+    } else if(request->variable == VARIABLE_WRITE_BITMAP) {
+      if(request->opcode != SPARROW_TLV_OPCODE_VECTOR_GET_REQUEST) {
+        return sparrow_tlv_write_reply_error(request, SPARROW_TLV_ERROR_NO_VECTOR_ACCESS, reply, len);
+      }
+      if(request->offset >= (session.blocks + 31) / 32) {
+        return sparrow_tlv_write_reply_error(request, SPARROW_TLV_ERROR_INVALID_VECTOR_OFFSET, reply, len);
+      }
+      if(request->offset + request->elements > (session.blocks + 31) / 32) {
+        return sparrow_tlv_write_reply_error(request, SPARROW_TLV_ERROR_BAD_NUMBER_OF_ELEMENTS, reply, len);
+      }
+      return sparrow_tlv_write_reply_vector(request, reply, len, session.received);
     }
     return sparrow_tlv_write_reply_error(request, SPARROW_TLV_ERROR_UNKNOWN_VARIABLE, reply, len);
   }
@@ -195,6 +834,14 @@ flash_oam_notification(sparrow_oam_nt_t type, uint8_t parameter)
     /* On new PDU; clear all write and erase enable states. */
     primaryWrite_enable = FALSE;
     backupWrite_enable = FALSE;
+
+    /* Write sessions stay open across PDUs until idle too long */
+    if(session.image != NULL
+       && uptime_elapsed(session.last_activity) > SESSION_TIMEOUT) {
+      PRINTF("instance_flash: session 0x%lx timed out\n", (unsigned long)session.id);
+      session.image = NULL;
+      session.id = 0;
+    }
   }
   return 0;
 }
@@ -217,7 +864,7 @@ instance_flash_erase_image(const image_info_t *image)
 
   if(image->number_of_sectors == 0) {
     for(p = image->start_address; p < image->start_address + image->length; p += 4) {
-      if(*((uint32_t *)p) != 0xffffffff) {
+      if(*((uint32_t *)(uintptr_t)p) != 0xffffffff) {
         if(sparrow_flash_erase_sector(p) != SPARROW_FLASH_COMPLETE) {
           success = FALSE;
           break;
@@ -258,7 +905,7 @@ instance_flash_write_flash(const image_info_t *image,
     return SPARROW_TLV_ERROR_INVALID_VECTOR_OFFSET;
   }
 
-  if(((offset * 4) + (length * 4)) >= image->length) {
+  if(((offset * 4) + (length * 4)) > image->length) {
     return SPARROW_TLV_ERROR_BAD_NUMBER_OF_ELEMENTS;
   }
 
@@ -268,7 +915,7 @@ instance_flash_write_flash(const image_info_t *image,
   }
 
   for(i = 0; i < length; i++) {
-    uint32_t present = *((uint32_t *)(image->start_address + (offset + i) * 4));
+    uint32_t present = *((uint32_t *)(uintptr_t)(image->start_address + (offset + i) * 4));
     if(present == 0xffffffff) {
       status = sparrow_flash_program_word(image->start_address + (offset + i) * 4, data[i]);
       if(status != SPARROW_FLASH_COMPLETE) {
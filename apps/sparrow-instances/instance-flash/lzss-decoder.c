@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2016, SICS, Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Streaming LZSS decoder for compressed firmware images.
+ */
+
+#include "lzss-decoder.h"
+
+enum {
+  STATE_TAG,
+  STATE_LITERAL,
+  STATE_DISTANCE,
+  STATE_COUNT,
+};
+/*---------------------------------------------------------------------------*/
+static int
+get_bits(lzss_decoder_t *d, uint8_t count, uint16_t *value)
+{
+  if(d->bit_count < count) {
+    return 0;
+  }
+  d->bit_count -= count;
+  *value = (d->bits >> d->bit_count) & ((1UL << count) - 1);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Decode as much as possible from the buffered bits.
+ */
+static lzss_decoder_status_t
+decode(lzss_decoder_t *d, const lzss_output_t *output)
+{
+  uint16_t value;
+  uint16_t count;
+
+  while(d->position < d->length) {
+    switch(d->state) {
+    case STATE_TAG:
+      if(!get_bits(d, 1, &value)) {
+        return LZSS_DECODER_OK;
+      }
+      d->state = value ? STATE_LITERAL : STATE_DISTANCE;
+      break;
+    case STATE_LITERAL:
+      if(!get_bits(d, 8, &value)) {
+        return LZSS_DECODER_OK;
+      }
+      if(!output->put(value)) {
+        return LZSS_DECODER_ERROR;
+      }
+      d->position++;
+      d->state = STATE_TAG;
+      break;
+    case STATE_DISTANCE:
+      if(!get_bits(d, d->window_bits, &value)) {
+        return LZSS_DECODER_OK;
+      }
+      d->distance = value + 1;
+      if(d->distance > d->position) {
+        /* Reference before the start of the image */
+        return LZSS_DECODER_ERROR;
+      }
+      d->state = STATE_COUNT;
+      break;
+    case STATE_COUNT:
+      if(!get_bits(d, d->lookahead_bits, &value)) {
+        return LZSS_DECODER_OK;
+      }
+      count = value + 1;
+      if(count > d->length - d->position) {
+        return LZSS_DECODER_ERROR;
+      }
+      for(; count > 0; count--) {
+        if(!output->put(output->get(d->position - d->distance))) {
+          return LZSS_DECODER_ERROR;
+        }
+        d->position++;
+      }
+      d->state = STATE_TAG;
+      break;
+    default:
+      return LZSS_DECODER_ERROR;
+    }
+  }
+  return LZSS_DECODER_DONE;
+}
+/*---------------------------------------------------------------------------*/
+int
+lzss_decoder_init(lzss_decoder_t *d, uint8_t window_bits,
+                  uint8_t lookahead_bits, uint32_t length)
+{
+  if(window_bits < LZSS_DECODER_MIN_WINDOW_BITS
+     || window_bits > LZSS_DECODER_MAX_WINDOW_BITS
+     || lookahead_bits < 1
+     || lookahead_bits > LZSS_DECODER_MAX_LOOKAHEAD_BITS) {
+    return 0;
+  }
+  d->length = length;
+  d->position = 0;
+  d->bits = 0;
+  d->bit_count = 0;
+  d->distance = 0;
+  d->state = STATE_TAG;
+  d->window_bits = window_bits;
+  d->lookahead_bits = lookahead_bits;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+lzss_decoder_status_t
+lzss_decoder_input(lzss_decoder_t *d, const uint8_t *data, uint32_t len,
+                   const lzss_output_t *output)
+{
+  lzss_decoder_status_t status = LZSS_DECODER_OK;
+  uint32_t i;
+
+  if(d->position >= d->length) {
+    return LZSS_DECODER_DONE;
+  }
+
+  for(i = 0; i < len; i++) {
+    /* Less than 16 bits are pending here so 8 more always fit */
+    d->bits = (d->bits << 8) | data[i];
+    d->bit_count += 8;
+    status = decode(d, output);
+    if(status != LZSS_DECODER_OK) {
+      break;
+    }
+  }
+  return status;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2016, SICS, Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Streaming LZSS decoder for compressed firmware images.
+ *
+ *         The compressed stream is a sequence of bit fields, most
+ *         significant bit first. A '1' tag bit is followed by an 8-bit
+ *         literal. A '0' tag bit is followed by a back reference of
+ *         window_bits (distance - 1) and lookahead_bits (count - 1).
+ *
+ *         The decoder keeps no history window of its own. Back
+ *         references are resolved through the output, which for the
+ *         flash instance is the image already written to flash.
+ */
+
+#ifndef LZSS_DECODER_H_
+#define LZSS_DECODER_H_
+
+#include <stdint.h>
+
+#define LZSS_DECODER_MIN_WINDOW_BITS     4
+#define LZSS_DECODER_MAX_WINDOW_BITS     15
+#define LZSS_DECODER_MAX_LOOKAHEAD_BITS  8
+
+typedef enum {
+  LZSS_DECODER_OK,
+  LZSS_DECODER_DONE,
+  LZSS_DECODER_ERROR,
+} lzss_decoder_status_t;
+
+typedef struct {
+  /** Append one decoded byte. Returns non-zero on success. */
+  int (* put)(uint8_t c);
+  /** Read back a decoded byte at the specified position. */
+  uint8_t (* get)(uint32_t position);
+} lzss_output_t;
+
+typedef struct {
+  uint32_t length;
+  uint32_t position;
+  uint32_t bits;
+  uint16_t distance;
+  uint8_t bit_count;
+  uint8_t state;
+  uint8_t window_bits;
+  uint8_t lookahead_bits;
+} lzss_decoder_t;
+
+/**
+ * Prepare the decoder for a new stream producing "length" bytes.
+ * Returns non-zero if the parameters are supported.
+ */
+int lzss_decoder_init(lzss_decoder_t *d, uint8_t window_bits,
+                      uint8_t lookahead_bits, uint32_t length);
+
+/**
+ * Decode the next part of the compressed stream. Data after the end
+ * of the stream (padding) is ignored.
+ */
+lzss_decoder_status_t lzss_decoder_input(lzss_decoder_t *d,
+                                         const uint8_t *data, uint32_t len,
+                                         const lzss_output_t *output);
+
+#endif /* LZSS_DECODER_H_ */
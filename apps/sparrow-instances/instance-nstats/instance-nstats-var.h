@@ -1,7 +1,8 @@
 
-/*-------------------------------------------------------------------*/
-/* Sparrow OAM Instance - Do not edit - automatically generated file.*/
-/*-------------------------------------------------------------------*/
+/*--------------------------------------------------------------------*/
+/* Sparrow OAM Instance - DO NOT EDIT - automatically generated file. */
+/* Generated by instance-gen.py on 2026-10-19 04:53:28.               */
+/*--------------------------------------------------------------------*/
 
 /*
  * Copyright (c) 2016, SICS, Swedish ICT.
@@ -33,9 +34,9 @@
  *
  */
 
-/*-------------------------------------------------------------------*/
-/* Sparrow OAM Instance - Do not edit - automatically generated file.*/
-/*-------------------------------------------------------------------*/
+/*--------------------------------------------------------------------*/
+/* Sparrow OAM Instance - DO NOT EDIT - automatically generated file. */
+/*--------------------------------------------------------------------*/
 
 
 #ifndef INSTANCE_NSTATS_VAR_H_
@@ -63,6 +64,7 @@ typedef enum {
   NSTATS_DATA_TYPE_RADIO                 = 5,
   NSTATS_DATA_TYPE_NET_CONFIG            = 6,
   NSTATS_DATA_TYPE_SLEEP                 = 7,
+  NSTATS_DATA_TYPE_NETSCAN               = 8,
 } nstats_data_type_t;
 
 /* Variables for instance nstats */
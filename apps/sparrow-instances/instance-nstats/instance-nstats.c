@@ -53,6 +53,9 @@
 #ifdef HAVE_NETSELECT
 #include "netselect.h"
 #endif /* HAVE_NETSELECT */
+#ifdef HAVE_NETSCAN
+#include "netscan.h"
+#endif /* HAVE_NETSCAN */
 #include "instance-nstats-var.h"
 
 SPARROW_OAM_INSTANCE_NAME(instance_nstats);
@@ -221,6 +224,23 @@ write_stat(uint8_t type, uint8_t *reply, size_t len)
     }
 #endif /* defined HAVE_NETSELECT && NETSELECT_CONF_STATS */
     return 0;
+  case INSTANCE_NSTATS_DATA_NETSCAN:
+#if defined HAVE_NETSCAN && NETSCAN_CONF_STATS
+    if(len >= sizeof(network_stats_netscan_t)) {
+      network_stats_netscan_t *ns;
+      ns = (network_stats_netscan_t *)reply;
+      memset(ns, 0, sizeof(network_stats_netscan_t));
+      sparrow_tlv_write_int32_to_buf(ns->join_time, netscan_stats.join_time);
+      sparrow_tlv_write_int32_to_buf(ns->boot_join_time, netscan_stats.boot_join_time);
+      sparrow_tlv_write_int16_to_buf(ns->scans, netscan_stats.scans);
+      sparrow_tlv_write_int16_to_buf(ns->cache_scans, netscan_stats.cache_scans);
+      sparrow_tlv_write_int16_to_buf(ns->cache_joins, netscan_stats.cache_joins);
+      sparrow_tlv_write_int16_to_buf(ns->channels_scanned, netscan_stats.channels_scanned);
+      ns->cache_size = netscan_cache_count();
+      return sizeof(network_stats_netscan_t);
+    }
+#endif /* defined HAVE_NETSCAN && NETSCAN_CONF_STATS */
+    return 0;
   case INSTANCE_NSTATS_DATA_RADIO:
     return 0;
   case INSTANCE_NSTATS_DATA_CONFIG:
@@ -54,6 +54,7 @@
 #define INSTANCE_NSTATS_DATA_NETSELECT           4
 #define INSTANCE_NSTATS_DATA_RADIO               5
 #define INSTANCE_NSTATS_DATA_CONFIG              6
+#define INSTANCE_NSTATS_DATA_NETSCAN             8
 
 /* INSTANCE_NSTATS_DATA_DEFAULT */
 typedef struct {
@@ -95,6 +96,18 @@ typedef struct {
   uint8_t reserved[3];
 } network_stats_netselect_t;
 
+/* INSTANCE_NSTATS_DATA_NETSCAN */
+typedef struct {
+  uint8_t join_time[4];              /* Milliseconds from scan start to last network selection */
+  uint8_t boot_join_time[4];         /* Milliseconds from boot to first network selection */
+  uint8_t scans[2];                  /* Number of full scans since boot */
+  uint8_t cache_scans[2];            /* Number of scans of cached networks since boot */
+  uint8_t cache_joins[2];            /* Number of networks selected from cache scans */
+  uint8_t channels_scanned[2];
+  uint8_t cache_size;                /* Number of networks in the cache */
+  uint8_t reserved[3];
+} network_stats_netscan_t;
+
 /* INSTANCE_NSTATS_DATA_BEACONS */
 typedef struct {
   uint8_t beacons_received[2];
@@ -245,6 +245,65 @@ sparrow_encap_write_header_with_error(uint8_t *buf, size_t len, sparrow_encap_pd
 }
 /*----------------------------------------------------------------*/
 
+/*
+ * Add a sub frame at position "pos" in the aggregate payload "buf".
+ *
+ * Return the new length of the aggregate payload, or 0 if the sub
+ * frame does not fit.
+ */
+size_t
+sparrow_encap_aggregate_add(uint8_t *buf, size_t maxlen, size_t pos,
+                            uint8_t payload_type,
+                            const uint8_t *data, size_t len)
+{
+  if(len > 0xffff || pos + SPARROW_ENCAP_AGGREGATE_HEADER_LEN + len > maxlen) {
+    return 0;
+  }
+  buf[pos++] = payload_type;
+  buf[pos++] = (len >> 8) & 0xff;
+  buf[pos++] = len & 0xff;
+  memcpy(&buf[pos], data, len);
+  return pos + len;
+}
+/*----------------------------------------------------------------*/
+
+/*
+ * Get the sub frame at position "pos" in the aggregate payload and
+ * advance "pos" to the next sub frame.
+ *
+ * Return 1 if a sub frame was found, 0 at the end of the payload, or
+ * (negative) error if the payload is malformed.
+ */
+int
+sparrow_encap_aggregate_next(const uint8_t *payload, size_t len,
+                             size_t *pos, uint8_t *payload_type,
+                             const uint8_t **data, size_t *data_len)
+{
+  size_t p = *pos;
+
+  if(p >= len) {
+    return 0;
+  }
+  if(p + SPARROW_ENCAP_AGGREGATE_HEADER_LEN > len) {
+    return SPARROW_ENCAP_ERROR_SHORT;
+  }
+  *payload_type = payload[p];
+  *data_len = ((size_t)payload[p + 1] << 8) | payload[p + 2];
+  p += SPARROW_ENCAP_AGGREGATE_HEADER_LEN;
+  if(p + *data_len > len) {
+    return SPARROW_ENCAP_ERROR_SHORT;
+  }
+  if(*payload_type == 0 || *payload_type == SPARROW_ENCAP_PAYLOAD_AGGREGATE
+     || *payload_type > SPARROW_ENCAP_PAYLOAD_MAX) {
+    /* Nested aggregates are not allowed */
+    return SPARROW_ENCAP_ERROR_BAD_PAYLOAD_TYPE;
+  }
+  *data = &payload[p];
+  *pos = p + *data_len;
+  return 1;
+}
+/*----------------------------------------------------------------*/
+
 /*
  * Do any finalization if needed.
  *
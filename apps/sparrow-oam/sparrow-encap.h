@@ -60,7 +60,15 @@
 #define SPARROW_ENCAP_PAYLOAD_RECEIVE_REPORT        11
 #define SPARROW_ENCAP_PAYLOAD_SLEEP_REPORT          12
 #define SPARROW_ENCAP_PAYLOAD_SILENTLY_DISCARD      13
-#define SPARROW_ENCAP_PAYLOAD_MAX                   13
+#define SPARROW_ENCAP_PAYLOAD_AGGREGATE             14
+#define SPARROW_ENCAP_PAYLOAD_MAX                   14
+
+/*
+ * An aggregate payload carries several sub frames under one encap
+ * header and CRC. Each sub frame is the payload type (1 byte) and the
+ * payload length (2 bytes, network byte order) followed by the payload.
+ */
+#define SPARROW_ENCAP_AGGREGATE_HEADER_LEN           3
 
 #define SPARROW_ENCAP_ERROR_OK                       0
 #define SPARROW_ENCAP_ERROR_SHORT                   -1
@@ -85,6 +93,23 @@ typedef enum {
 #define SPARROW_ENCAP_FP_LENOPT_OPTION_CRC       1
 #define SPARROW_ENCAP_FP_LENOPT_OPTION_SEQNO_CRC 2
 
+/*
+ * With the SEQNO_CRC option the payload is preceded by a 16-bit sequence
+ * number and a 16-bit cumulative acknowledgement, both in network byte
+ * order. Sequence number 0 is used for frames that are not sequenced and
+ * acknowledgement 0 means that nothing has been received yet. A receive
+ * report without payload only carries the acknowledgement and is also
+ * sent directly when a gap in the sequence numbers is detected.
+ *
+ * A session starts with the version request from the border router.
+ * The serial radio accepts the next sequenced frame after the request
+ * as the first in order, and the border router does not sequence its
+ * frames until the radio has replied. A restarted radio announces
+ * itself explicitly and a sequence number is never taken as a sign of
+ * a restart.
+ */
+#define SPARROW_ENCAP_SEQNO_LEN                  4
+
 typedef enum {
   SPARROW_ENCAP_IVMODE_NONE   = 0,
   SPARROW_ENCAP_IVMODE_128BIT = 1,
@@ -121,4 +146,12 @@ size_t sparrow_encap_finalize(uint8_t *buf, size_t maxlen, sparrow_encap_pdu_inf
 
 void sparrow_encap_init_pdu_info_for_event(sparrow_encap_pdu_info_t *pinfo);
 
+size_t sparrow_encap_aggregate_add(uint8_t *buf, size_t maxlen, size_t pos,
+                                   uint8_t payload_type,
+                                   const uint8_t *data, size_t len);
+
+int sparrow_encap_aggregate_next(const uint8_t *payload, size_t len,
+                                 size_t *pos, uint8_t *payload_type,
+                                 const uint8_t **data, size_t *data_len);
+
 #endif /* SPARROW_ENCAP_H_ */
@@ -42,6 +42,7 @@
 #include "net/packetbuf.h"
 #include "dev/radio.h"
 #include "dev/watchdog.h"
+#include <stddef.h>
 
 #define DEBUG 0
 #if DEBUG
@@ -59,70 +60,187 @@ radio_802154_handle_collisions(int on)
   handle_collisions = on != 0;
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * The received frames are stored back to back in a byte ring, each
+ * taking the frame header and its actual length rounded up to
+ * RADIO_802154_RX_ALIGN. The write offset is only updated by the
+ * writer (ISR) and the read offset only by the reader which makes the
+ * ring safe without disabling interrupts. When a frame does not fit at
+ * the end of the ring, the writer stores it at the start and marks the
+ * end with a zero length frame header.
+ */
+#define RING_BYTES  (sizeof(((struct radio_802154_state *)0)->rx_ring))
+#define HDR_LEN     offsetof(radio_802154_rf_buffer_t, buffer)
+#define FRAME_SIZE(len) \
+  ((HDR_LEN + (len) + RADIO_802154_RX_ALIGN - 1) & ~(RADIO_802154_RX_ALIGN - 1))
+#define RING_BUF(state, pos) \
+  ((radio_802154_rf_buffer_t *)((uint8_t *)(state)->rx_ring + (pos)))
+/*---------------------------------------------------------------------------*/
+/* Returns the ring offset for a new frame or -1 if the ring is full */
+static int
+find_room(const struct radio_802154_state *state, uint16_t size)
+{
+  uint16_t r = state->read_pos;
+  uint16_t w = state->write_pos;
+
+  if(w >= r) {
+    /* Free space at the end and before the read offset. The write
+       offset must never catch up with the read offset from behind. */
+    if(RING_BYTES - w > size || (RING_BYTES - w == size && r > 0)) {
+      return w;
+    }
+    if(r > size) {
+      return 0;
+    }
+  } else if(r - w > size) {
+    return w;
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
 int
 radio_802154_rx_buf_is_empty(const struct radio_802154_driver *radio)
 {
-  return radio->state->read_buf == radio->state->write_buf;
+  return radio->state->read_pos == radio->state->write_pos;
 }
 /*---------------------------------------------------------------------------*/
 int
 radio_802154_rx_buf_has_empty(const struct radio_802154_driver *radio)
 {
-  return (radio->state->write_buf + 1) % RADIO_802154_BUFFER_COUNT != radio->state->read_buf;
+  return find_room(radio->state, FRAME_SIZE(RADIO_802154_BUFFER_SIZE)) >= 0;
 }
 /*---------------------------------------------------------------------------*/
 radio_802154_rf_buffer_t *
-radio_802154_get_writebuf(const struct radio_802154_driver *radio)
+radio_802154_get_writebuf_len(const struct radio_802154_driver *radio, uint8_t len)
 {
-  if(radio_802154_rx_buf_has_empty(radio)) {
-    radio_802154_rf_buffer_t *buffer;
-    buffer = &radio->state->rx_bufs[radio->state->write_buf];
-    return buffer;
+  struct radio_802154_state *state = radio->state;
+  int pos;
+
+  if(len > RADIO_802154_BUFFER_SIZE) {
+    state->rx_stats.drop_too_long++;
+    return NULL;
   }
-  return NULL;
+
+  pos = find_room(state, FRAME_SIZE(len));
+  if(pos < 0) {
+    state->alloc_size = 0;
+    state->rx_stats.drop_full++;
+    return NULL;
+  }
+  state->alloc_pos = pos;
+  state->alloc_size = FRAME_SIZE(len);
+  return RING_BUF(state, pos);
+}
+/*---------------------------------------------------------------------------*/
+radio_802154_rf_buffer_t *
+radio_802154_get_writebuf(const struct radio_802154_driver *radio)
+{
+  return radio_802154_get_writebuf_len(radio, RADIO_802154_BUFFER_SIZE);
 }
 /*---------------------------------------------------------------------------*/
 void
 radio_802154_release_writebuf(const struct radio_802154_driver *radio, uint8_t packet_ok)
 {
+  struct radio_802154_state *state = radio->state;
+  radio_802154_rf_buffer_t *buffer;
+  uint16_t size, pos, used;
+  uint8_t frames;
+
   /* This should not happen... since it was already allocated */
-  if(!radio_802154_rx_buf_has_empty(radio)) {
+  if(state->alloc_size == 0) {
+    return;
+  }
+
+  buffer = RING_BUF(state, state->alloc_pos);
+  size = FRAME_SIZE(buffer->len);
+  if(!packet_ok || buffer->len == 0 || size > state->alloc_size) {
+    state->alloc_size = 0;
+    state->rx_stats.drop_bad++;
     return;
   }
-  if(packet_ok) {
-    /* move the write buffer index only if the packet in it is ok */
-    radio->state->write_buf = (radio->state->write_buf + 1) % RADIO_802154_BUFFER_COUNT;
-    PRINTF("Released write buffer - write: %d read: %d\n",
-           radio->state->write_buf, radio->state->read_buf);
+  state->alloc_size = 0;
+
+  /* move the write offset only if the packet in it is ok */
+  if(state->alloc_pos != state->write_pos && state->write_pos < RING_BYTES) {
+    /* The frame was stored at the start of the ring - mark the end */
+    RING_BUF(state, state->write_pos)->len = 0;
+  }
+  pos = state->alloc_pos + size;
+  if(pos >= RING_BYTES) {
+    pos = 0;
+  }
+
+  state->write_count++;
+  frames = state->write_count - state->read_count;
+  if(frames > state->rx_stats.high_water_frames) {
+    state->rx_stats.high_water_frames = frames;
+  }
+  if(pos >= state->read_pos) {
+    used = pos - state->read_pos;
+  } else {
+    used = RING_BYTES - state->read_pos + pos;
   }
+  if(used > state->rx_stats.high_water_bytes) {
+    state->rx_stats.high_water_bytes = used;
+  }
+
+  state->write_pos = pos;
+  PRINTF("Released write buffer - write: %d read: %d\n",
+         state->write_pos, state->read_pos);
 }
 
 /*---------------------------------------------------------------------------*/
 radio_802154_rf_buffer_t *
 radio_802154_get_readbuf(const struct radio_802154_driver *radio)
 {
+  struct radio_802154_state *state = radio->state;
+  radio_802154_rf_buffer_t *buffer;
+
   if(radio_802154_rx_buf_is_empty(radio)) {
     return NULL;
   }
-  return &radio->state->rx_bufs[radio->state->read_buf];
+  buffer = RING_BUF(state, state->read_pos);
+  if(buffer->len == 0) {
+    /* End of ring marker - the next frame is at the start */
+    state->read_pos = 0;
+    buffer = RING_BUF(state, 0);
+  }
+  return buffer;
 }
 /*---------------------------------------------------------------------------*/
 void
 radio_802154_release_readbuf(const struct radio_802154_driver *radio)
 {
-  if(radio_802154_rx_buf_is_empty(radio)) {
+  struct radio_802154_state *state = radio->state;
+  radio_802154_rf_buffer_t *buffer;
+  uint16_t pos;
+
+  buffer = radio_802154_get_readbuf(radio);
+  if(buffer == NULL) {
     return;
   }
-  radio->state->read_buf = (radio->state->read_buf + 1) % RADIO_802154_BUFFER_COUNT;
+  pos = state->read_pos + FRAME_SIZE(buffer->len);
+  if(pos >= RING_BYTES) {
+    pos = 0;
+  }
+  state->read_count++;
+  state->read_pos = pos;
   PRINTF("Released read buffer - write: %d read: %d\n",
-         radio->state->write_buf, radio->state->read_buf);
+         state->write_pos, state->read_pos);
 }
 /*---------------------------------------------------------------------------*/
 void
 radio_802154_clear(const struct radio_802154_driver *radio)
 {
   /* Drop any buffers */
-  radio->state->read_buf = radio->state->write_buf;
+  radio->state->read_pos = radio->state->write_pos;
+  radio->state->read_count = radio->state->write_count;
+}
+/*---------------------------------------------------------------------------*/
+const struct radio_802154_rx_stats *
+radio_802154_get_rx_stats(const struct radio_802154_driver *radio)
+{
+  return &radio->state->rx_stats;
 }
 /*---------------------------------------------------------------------------*/
 /* called from receive Interrupt */
@@ -151,7 +269,7 @@ radio_802154_handle_ack(const struct radio_802154_driver *radio,
   }
 
   /* Need to store the packet - could be something else or in sniffer mode */
-  rf_buf = radio_802154_get_writebuf(radio);
+  rf_buf = radio_802154_get_writebuf_len(radio, len);
   if(rf_buf != NULL) {
     memcpy(rf_buf->buffer, buf, len);
     rf_buf->len = len;
@@ -51,6 +51,29 @@
 #define RADIO_802154_BUFFER_SIZE    128
 #define RADIO_802154_ACK_LEN        3
 
+/*
+ * Received frames are packed by their actual length into a byte ring.
+ * The default ring takes the same RAM as RADIO_802154_BUFFER_COUNT
+ * fixed buffers. It holds many more short frames, but at some ring
+ * positions only RADIO_802154_BUFFER_COUNT - 2 full size frames, due to
+ * the frame alignment and since up to one frame is lost at the end of
+ * the ring when the frames wrap around. Set
+ * RADIO_802154_CONF_RX_RING_SIZE to RADIO_802154_RX_RING_SIZE_FOR(n)
+ * for a ring that holds n full size frames wherever it starts.
+ */
+#define RADIO_802154_RX_RING_SIZE_FOR(frames) \
+  (((frames) + 1) * (sizeof(radio_802154_rf_buffer_t) + RADIO_802154_RX_ALIGN))
+
+#ifdef RADIO_802154_CONF_RX_RING_SIZE
+#define RADIO_802154_RX_RING_SIZE RADIO_802154_CONF_RX_RING_SIZE
+#else /* RADIO_802154_CONF_RX_RING_SIZE */
+#define RADIO_802154_RX_RING_SIZE \
+  (RADIO_802154_BUFFER_COUNT * sizeof(radio_802154_rf_buffer_t))
+#endif /* RADIO_802154_CONF_RX_RING_SIZE */
+
+/* Alignment of the frames in the ring */
+#define RADIO_802154_RX_ALIGN       4
+
 #define RADIO_802154_DRIVER(name, driver, ack_detect, ack_receive, collision, retransmit, transmit_packet) \
   static struct radio_802154_state name##_state;                        \
   static const struct radio_802154_driver name = {                      \
@@ -68,16 +91,35 @@ typedef struct radio_802154_rf_buffer {
   uint8_t buffer[RADIO_802154_BUFFER_SIZE];
 } radio_802154_rf_buffer_t;
 
+struct radio_802154_rx_stats {
+  /* Max number of bytes and frames in the ring */
+  uint16_t high_water_bytes;
+  uint8_t high_water_frames;
+  /* Frames dropped because the ring was full */
+  uint32_t drop_full;
+  /* Frames dropped because they were too long for a buffer */
+  uint32_t drop_too_long;
+  /* Frames dropped by the driver after allocation (bad CRC, etc) */
+  uint32_t drop_bad;
+};
+
 struct radio_802154_state {
-  volatile uint8_t read_buf;
-  volatile uint8_t write_buf;
+  /* Offsets in the RX ring - written by the reader and writer only */
+  volatile uint16_t read_pos;
+  volatile uint16_t write_pos;
+  volatile uint8_t read_count;
+  volatile uint8_t write_count;
+  /* The write buffer currently allocated */
+  uint16_t alloc_pos;
+  uint16_t alloc_size;
   volatile uint8_t acked;
   uint8_t last_tx_no;
   uint8_t last_out_seq;
   uint8_t rx_mode;
   uint8_t tx_mode;
 
-  radio_802154_rf_buffer_t rx_bufs[RADIO_802154_BUFFER_COUNT];
+  struct radio_802154_rx_stats rx_stats;
+  uint32_t rx_ring[(RADIO_802154_RX_RING_SIZE + 3) / 4];
 };
 
 
@@ -98,11 +140,14 @@ struct radio_802154_driver {
 
 /* Check if there are anything in buffers */
 int radio_802154_rx_buf_is_empty(const struct radio_802154_driver *radio);
-/* Check if there are any free buffers */
+/* Check if there is room for a full size frame */
 int radio_802154_rx_buf_has_empty(const struct radio_802154_driver *radio);
 
 /* To be called from ISR to get a buffer to write to. */
 radio_802154_rf_buffer_t *radio_802154_get_writebuf(const struct radio_802154_driver *radio);
+/* Same as above but only reserves room for a frame of the specified length */
+radio_802154_rf_buffer_t *radio_802154_get_writebuf_len(const struct radio_802154_driver *radio, uint8_t len);
+/* Only the len bytes specified in the buffer are kept if the packet is ok */
 void radio_802154_release_writebuf(const struct radio_802154_driver *radio, uint8_t packet_ok);
 
 radio_802154_rf_buffer_t *radio_802154_get_readbuf(const struct radio_802154_driver *radio);
@@ -110,6 +155,8 @@ void radio_802154_release_readbuf(const struct radio_802154_driver *radio);
 
 void radio_802154_clear(const struct radio_802154_driver *radio);
 
+const struct radio_802154_rx_stats *radio_802154_get_rx_stats(const struct radio_802154_driver *radio);
+
 /* Will check if the packet is an ACK and if it has a correct sequence no
  * if not - the packet will be buffered */
 radio_802154_rf_buffer_t *radio_802154_handle_ack(const struct radio_802154_driver *radio, const uint8_t *buf, int len);
@@ -0,0 +1,327 @@
+/*
+ * Copyright (c) 2016, Yanzi Networks AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *    3. Neither the name of the copyright holders nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Counters and gauges registered by module with optional per
+ *         neighbor and per channel link statistics.
+ */
+
+#include "lib/instrument.h"
+#include "net/netstack.h"
+#include "net/mac/mac.h"
+#include <string.h>
+
+static struct instrument_group *groups;
+static uint32_t snapshot[INSTRUMENT_SNAPSHOT_WORDS];
+static int snapshot_words;
+
+#if INSTRUMENT_LINK_STATS
+struct instrument_link {
+  uint32_t count[INSTRUMENT_LINK_MAX];
+  uint16_t rssi[INSTRUMENT_RSSI_BUCKETS];
+};
+
+struct instrument_nbr {
+  linkaddr_t addr;
+  unsigned long last_seen;
+  struct instrument_link link;
+};
+
+static struct instrument_nbr nbrs[INSTRUMENT_LINK_NBRS];
+static struct instrument_link channels[INSTRUMENT_LINK_CHANNELS];
+#endif /* INSTRUMENT_LINK_STATS */
+/*---------------------------------------------------------------------------*/
+void
+instrument_register(struct instrument_group *group)
+{
+  struct instrument_group *g;
+  for(g = groups; g != NULL; g = g->next) {
+    if(g == group) {
+      return;
+    }
+  }
+  group->next = groups;
+  groups = group;
+}
+/*---------------------------------------------------------------------------*/
+struct instrument_group *
+instrument_get(uint8_t id)
+{
+  struct instrument_group *g;
+  for(g = groups; g != NULL; g = g->next) {
+    if(g->id == id) {
+      return g;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+write32(uint32_t *dst, uint32_t value)
+{
+  uint8_t *p = (uint8_t *)dst;
+  p[0] = (value >> 24) & 0xff;
+  p[1] = (value >> 16) & 0xff;
+  p[2] = (value >> 8) & 0xff;
+  p[3] = value & 0xff;
+}
+/*---------------------------------------------------------------------------*/
+void
+instrument_copy_to_network(uint32_t *dst, const uint32_t *src, int count)
+{
+  int i;
+  for(i = 0; i < count; i++) {
+    write32(&dst[i], src[i]);
+  }
+}
+/*---------------------------------------------------------------------------*/
+#if INSTRUMENT_LINK_STATS
+#ifdef INSTRUMENT_CONF_LINK_CHANNEL
+/* Channel of the frame being handled, for platforms with several radios */
+int INSTRUMENT_CONF_LINK_CHANNEL(void);
+#endif /* INSTRUMENT_CONF_LINK_CHANNEL */
+
+static int
+current_channel(void)
+{
+  int channel;
+#ifdef INSTRUMENT_CONF_LINK_CHANNEL
+  channel = INSTRUMENT_CONF_LINK_CHANNEL();
+#else /* INSTRUMENT_CONF_LINK_CHANNEL */
+  radio_value_t value;
+  if(NETSTACK_RADIO.get_value(RADIO_PARAM_CHANNEL, &value) != RADIO_RESULT_OK) {
+    return -1;
+  }
+  channel = value;
+#endif /* INSTRUMENT_CONF_LINK_CHANNEL */
+  channel -= INSTRUMENT_LINK_FIRST_CHANNEL;
+  if(channel < 0 || channel >= INSTRUMENT_LINK_CHANNELS) {
+    return -1;
+  }
+  return channel;
+}
+/*---------------------------------------------------------------------------*/
+static struct instrument_link *
+get_nbr(const linkaddr_t *addr)
+{
+  struct instrument_nbr *oldest = &nbrs[0];
+  int i;
+
+  if(addr == NULL || linkaddr_cmp(addr, &linkaddr_null)) {
+    return NULL;
+  }
+  for(i = 0; i < INSTRUMENT_LINK_NBRS; i++) {
+    if(linkaddr_cmp(&nbrs[i].addr, addr)) {
+      nbrs[i].last_seen = clock_seconds();
+      return &nbrs[i].link;
+    }
+    if(nbrs[i].last_seen < oldest->last_seen) {
+      oldest = &nbrs[i];
+    }
+  }
+  /* Replace the least recently seen neighbor */
+  memset(oldest, 0, sizeof(struct instrument_nbr));
+  linkaddr_copy(&oldest->addr, addr);
+  oldest->last_seen = clock_seconds();
+  return &oldest->link;
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_rssi(struct instrument_link *link, int rssi)
+{
+  int bucket;
+  bucket = (rssi - INSTRUMENT_RSSI_MIN) / INSTRUMENT_RSSI_STEP;
+  if(bucket < 0) {
+    bucket = 0;
+  } else if(bucket >= INSTRUMENT_RSSI_BUCKETS) {
+    bucket = INSTRUMENT_RSSI_BUCKETS - 1;
+  }
+  link->rssi[bucket]++;
+}
+/*---------------------------------------------------------------------------*/
+void
+instrument_link_rx(const linkaddr_t *from, int rssi)
+{
+  struct instrument_link *link;
+  int channel;
+
+  link = get_nbr(from);
+  if(link != NULL) {
+    link->count[INSTRUMENT_LINK_RX]++;
+    add_rssi(link, rssi);
+  }
+  channel = current_channel();
+  if(channel >= 0) {
+    channels[channel].count[INSTRUMENT_LINK_RX]++;
+    add_rssi(&channels[channel], rssi);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_tx(struct instrument_link *link, int status, int transmissions)
+{
+  link->count[INSTRUMENT_LINK_TX]++;
+  link->count[INSTRUMENT_LINK_TX_ATTEMPTS] += transmissions;
+  switch(status) {
+  case MAC_TX_OK:
+    break;
+  case MAC_TX_NOACK:
+    link->count[INSTRUMENT_LINK_NOACK]++;
+    break;
+  case MAC_TX_COLLISION:
+    link->count[INSTRUMENT_LINK_CCA_FAIL]++;
+    break;
+  default:
+    link->count[INSTRUMENT_LINK_TX_ERR]++;
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+instrument_link_tx(const linkaddr_t *to, int status, int transmissions)
+{
+  struct instrument_link *link;
+  int channel;
+
+  if(status == MAC_TX_DEFERRED) {
+    return;
+  }
+  link = get_nbr(to);
+  if(link != NULL) {
+    add_tx(link, status, transmissions);
+  }
+  channel = current_channel();
+  if(channel >= 0) {
+    add_tx(&channels[channel], status, transmissions);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+instrument_link_crc_error(void)
+{
+  int channel;
+  channel = current_channel();
+  if(channel >= 0) {
+    channels[channel].count[INSTRUMENT_LINK_CRC]++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+instrument_link_clear(void)
+{
+  memset(nbrs, 0, sizeof(nbrs));
+  memset(channels, 0, sizeof(channels));
+}
+/*---------------------------------------------------------------------------*/
+static int
+write_link(uint32_t *dst, const linkaddr_t *addr, const struct instrument_link *link)
+{
+  uint8_t *p = (uint8_t *)dst;
+  int i, n;
+
+  memset(p, 0, 8);
+  if(addr != NULL) {
+    memcpy(p, addr, LINKADDR_SIZE);
+  }
+  n = 2;
+  for(i = 0; i < INSTRUMENT_LINK_MAX; i++) {
+    write32(&dst[n++], link->count[i]);
+  }
+  for(i = 0; i < INSTRUMENT_RSSI_BUCKETS; i += 2) {
+    write32(&dst[n++], ((uint32_t)link->rssi[i] << 16) | link->rssi[i + 1]);
+  }
+  return n;
+}
+#endif /* INSTRUMENT_LINK_STATS */
+/*---------------------------------------------------------------------------*/
+int
+instrument_snapshot_update(void)
+{
+  struct instrument_group *g;
+  int n, reserved;
+
+  /* Leave room for the end marker and the link section headers */
+  reserved = INSTRUMENT_LINK_STATS ? 3 : 1;
+
+  write32(&snapshot[0], ((uint32_t)'I' << 24) | ((uint32_t)'S' << 16)
+          | (INSTRUMENT_VERSION << 8));
+  write32(&snapshot[1], clock_seconds());
+  n = 2;
+
+  for(g = groups; g != NULL; g = g->next) {
+    if(n + 1 + g->count + reserved > INSTRUMENT_SNAPSHOT_WORDS) {
+      break;
+    }
+    write32(&snapshot[n++], ((uint32_t)g->type << 24) | ((uint32_t)g->id << 16) | g->count);
+    instrument_copy_to_network(&snapshot[n], g->values, g->count);
+    n += g->count;
+  }
+
+#if INSTRUMENT_LINK_STATS
+  {
+    int i, count, header;
+
+    header = n++;
+    for(i = count = 0; i < INSTRUMENT_LINK_NBRS
+          && n + INSTRUMENT_LINK_ENTRY_WORDS + 2 <= INSTRUMENT_SNAPSHOT_WORDS; i++) {
+      if(!linkaddr_cmp(&nbrs[i].addr, &linkaddr_null)) {
+        n += write_link(&snapshot[n], &nbrs[i].addr, &nbrs[i].link);
+        count++;
+      }
+    }
+    write32(&snapshot[header], ((uint32_t)INSTRUMENT_TYPE_NBRS << 24) | count);
+
+    header = n++;
+    for(i = 0; i < INSTRUMENT_LINK_CHANNELS
+          && n + INSTRUMENT_LINK_ENTRY_WORDS + 1 <= INSTRUMENT_SNAPSHOT_WORDS; i++) {
+      n += write_link(&snapshot[n], NULL, &channels[i]);
+    }
+    write32(&snapshot[header], ((uint32_t)INSTRUMENT_TYPE_CHANNELS << 24)
+            | ((uint32_t)INSTRUMENT_LINK_FIRST_CHANNEL << 16) | i);
+  }
+#endif /* INSTRUMENT_LINK_STATS */
+
+  write32(&snapshot[n++], INSTRUMENT_TYPE_END);
+  snapshot_words = n;
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+const uint32_t *
+instrument_snapshot_get(int *words)
+{
+  if(snapshot_words == 0) {
+    instrument_snapshot_update();
+  }
+  if(words != NULL) {
+    *words = snapshot_words;
+  }
+  return snapshot;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2016, Yanzi Networks AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *    3. Neither the name of the copyright holders nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Counters and gauges registered by module with optional per
+ *         neighbor and per channel link statistics.
+ *
+ *         The values are kept in native byte order and are only
+ *         converted when a snapshot is serialized. A snapshot is a
+ *         vector of 32 bits words in network byte order:
+ *
+ *         header:  'I' 'S' version 0, seconds since boot
+ *         group:   type(8) id(8) count(16), <count> values
+ *         links:   type(8) first channel(8) count(16), <count> entries
+ *                  of address (2 words, zero for channel entries),
+ *                  INSTRUMENT_LINK_MAX counters, and
+ *                  INSTRUMENT_RSSI_BUCKETS 16 bits RSSI counters
+ *         end:     0
+ */
+
+#ifndef INSTRUMENT_H_
+#define INSTRUMENT_H_
+
+#include "contiki.h"
+#include "net/linkaddr.h"
+
+#ifdef INSTRUMENT_CONF_LINK_STATS
+#define INSTRUMENT_LINK_STATS INSTRUMENT_CONF_LINK_STATS
+#else
+#define INSTRUMENT_LINK_STATS 0
+#endif
+
+#ifdef INSTRUMENT_CONF_LINK_NBRS
+#define INSTRUMENT_LINK_NBRS INSTRUMENT_CONF_LINK_NBRS
+#else
+#define INSTRUMENT_LINK_NBRS 16
+#endif
+
+#ifdef INSTRUMENT_CONF_LINK_FIRST_CHANNEL
+#define INSTRUMENT_LINK_FIRST_CHANNEL INSTRUMENT_CONF_LINK_FIRST_CHANNEL
+#else
+#define INSTRUMENT_LINK_FIRST_CHANNEL 11
+#endif
+
+#ifdef INSTRUMENT_CONF_LINK_CHANNELS
+#define INSTRUMENT_LINK_CHANNELS INSTRUMENT_CONF_LINK_CHANNELS
+#else
+#define INSTRUMENT_LINK_CHANNELS 16
+#endif
+
+/* Max size of a serialized snapshot in 32 bits words */
+#ifdef INSTRUMENT_CONF_SNAPSHOT_WORDS
+#define INSTRUMENT_SNAPSHOT_WORDS INSTRUMENT_CONF_SNAPSHOT_WORDS
+#elif INSTRUMENT_LINK_STATS
+#define INSTRUMENT_SNAPSHOT_WORDS (64 + 2 + \
+  (INSTRUMENT_LINK_NBRS + INSTRUMENT_LINK_CHANNELS) * INSTRUMENT_LINK_ENTRY_WORDS)
+#else
+#define INSTRUMENT_SNAPSHOT_WORDS 64
+#endif
+
+#define INSTRUMENT_VERSION 0
+
+/* Section types in a snapshot */
+#define INSTRUMENT_TYPE_END      0
+#define INSTRUMENT_TYPE_COUNTERS 1
+#define INSTRUMENT_TYPE_GAUGES   2
+#define INSTRUMENT_TYPE_NBRS     3
+#define INSTRUMENT_TYPE_CHANNELS 4
+
+/* Group identifiers */
+#define INSTRUMENT_ID_BRM                 1
+#define INSTRUMENT_ID_BRM_DEBUG           2
+#define INSTRUMENT_ID_SERIAL_RADIO        3
+#define INSTRUMENT_ID_SERIAL_RADIO_DEBUG  4
+
+struct instrument_group {
+  struct instrument_group *next;
+  uint32_t *values;
+  uint8_t type;
+  uint8_t id;
+  uint8_t count;
+};
+
+/**
+ * Define a group of counters or gauges. Use INSTRUMENT_DECLARE() in a
+ * header to access the group from other files.
+ */
+#define INSTRUMENT_GROUP(name, type, id, count)                         \
+  uint32_t name##_values[count];                                        \
+  struct instrument_group name = { NULL, name##_values, type, id, count }
+#define INSTRUMENT_DECLARE(name)                                        \
+  extern uint32_t name##_values[];                                      \
+  extern struct instrument_group name
+
+#define INSTRUMENT_INC(name, x)    (name##_values[x]++)
+#define INSTRUMENT_ADD(name, x, y) (name##_values[x] += (y))
+#define INSTRUMENT_SET(name, x, y) (name##_values[x] = (y))
+#define INSTRUMENT_GET(name, x)    (name##_values[x])
+
+void instrument_register(struct instrument_group *group);
+struct instrument_group *instrument_get(uint8_t id);
+
+/**
+ * \brief Copy values in network byte order
+ */
+void instrument_copy_to_network(uint32_t *dst, const uint32_t *src, int count);
+
+/**
+ * \brief Serialize a new snapshot of all groups and link statistics.
+ * \return The snapshot size in 32 bits words
+ */
+int instrument_snapshot_update(void);
+
+/**
+ * \brief The last serialized snapshot in network byte order
+ */
+const uint32_t *instrument_snapshot_get(int *words);
+
+/* Link counters */
+enum {
+  INSTRUMENT_LINK_RX,
+  INSTRUMENT_LINK_TX,
+  INSTRUMENT_LINK_TX_ATTEMPTS,
+  INSTRUMENT_LINK_NOACK,
+  INSTRUMENT_LINK_CCA_FAIL,
+  INSTRUMENT_LINK_TX_ERR,
+  INSTRUMENT_LINK_CRC,
+
+  INSTRUMENT_LINK_MAX
+};
+
+/* RSSI histogram with 8 dB buckets starting at -100 dBm */
+#define INSTRUMENT_RSSI_BUCKETS   8
+#define INSTRUMENT_RSSI_MIN       -100
+#define INSTRUMENT_RSSI_STEP      8
+
+#define INSTRUMENT_LINK_ENTRY_WORDS \
+  (2 + INSTRUMENT_LINK_MAX + INSTRUMENT_RSSI_BUCKETS / 2)
+
+#if INSTRUMENT_LINK_STATS
+void instrument_link_rx(const linkaddr_t *from, int rssi);
+void instrument_link_tx(const linkaddr_t *to, int status, int transmissions);
+void instrument_link_crc_error(void);
+void instrument_link_clear(void);
+#define INSTRUMENT_LINK_RX(from, rssi)            instrument_link_rx(from, rssi)
+#define INSTRUMENT_LINK_TX(to, status, tx)        instrument_link_tx(to, status, tx)
+#define INSTRUMENT_LINK_CRC_ERROR()               instrument_link_crc_error()
+#else /* INSTRUMENT_LINK_STATS */
+#define INSTRUMENT_LINK_RX(from, rssi)
+#define INSTRUMENT_LINK_TX(to, status, tx)
+#define INSTRUMENT_LINK_CRC_ERROR()
+#endif /* INSTRUMENT_LINK_STATS */
+
+#endif /* INSTRUMENT_H_ */
@@ -59,6 +59,7 @@
  */
 
 #include <string.h>
+#include <stdint.h>
 
 #include "contiki.h"
 #include "dev/watchdog.h"
@@ -204,6 +205,116 @@ void uip_log(char *msg);
 #define IS_COMPRESSABLE_PROTO(x) (x == UIP_PROTO_UDP)
 #endif /* COMPRESS_EXT_HDR */
 
+/* Fast path for UDP between addresses in the context 0 prefix */
+#ifdef SICSLOWPAN_CONF_IPHC_FAST_PATH
+#define IPHC_FAST_PATH SICSLOWPAN_CONF_IPHC_FAST_PATH
+#else
+#define IPHC_FAST_PATH 1
+#endif
+
+#if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS == 0
+/* The fast path compresses with context 0 */
+#undef IPHC_FAST_PATH
+#define IPHC_FAST_PATH 0
+#endif
+
+#if IPHC_FAST_PATH && SICSLOWPAN_IPHC_BENCHMARK
+/* Allow the benchmark to compare with the generic path */
+static uint8_t iphc_fast_path = 1;
+#else
+#define iphc_fast_path IPHC_FAST_PATH
+#endif
+
+/*
+ * Queue fragments per next hop instead of sending all fragments of a
+ * datagram back to back. Each next hop has at most one fragment in
+ * flight and is paced by its observed number of transmissions.
+ */
+#ifdef SICSLOWPAN_CONF_FRAG_QUEUE
+#define SICSLOWPAN_FRAG_QUEUE SICSLOWPAN_CONF_FRAG_QUEUE
+#else
+#define SICSLOWPAN_FRAG_QUEUE 0
+#endif
+
+#if !SICSLOWPAN_CONF_FRAG
+#undef SICSLOWPAN_FRAG_QUEUE
+#define SICSLOWPAN_FRAG_QUEUE 0
+#endif
+
+#if SICSLOWPAN_FRAG_QUEUE
+#include "lib/list.h"
+#include "lib/memb.h"
+#include "sys/ctimer.h"
+
+/* Number of next hops with queued datagrams */
+#ifdef SICSLOWPAN_CONF_FRAG_QUEUE_NBRS
+#define FRAG_QUEUE_NBRS SICSLOWPAN_CONF_FRAG_QUEUE_NBRS
+#else
+#define FRAG_QUEUE_NBRS 8
+#endif
+
+/* Total number of queued datagrams */
+#ifdef SICSLOWPAN_CONF_FRAG_QUEUE_DATAGRAMS
+#define FRAG_QUEUE_DATAGRAMS SICSLOWPAN_CONF_FRAG_QUEUE_DATAGRAMS
+#else
+#define FRAG_QUEUE_DATAGRAMS 8
+#endif
+
+/* Max number of queued datagrams for a single next hop */
+#ifdef SICSLOWPAN_CONF_FRAG_QUEUE_NBR_DATAGRAMS
+#define FRAG_QUEUE_NBR_DATAGRAMS SICSLOWPAN_CONF_FRAG_QUEUE_NBR_DATAGRAMS
+#else
+#define FRAG_QUEUE_NBR_DATAGRAMS 4
+#endif
+
+/* Max number of fragments for a single datagram */
+#ifdef SICSLOWPAN_CONF_FRAG_QUEUE_MAX_FRAGS
+#define FRAG_QUEUE_MAX_FRAGS SICSLOWPAN_CONF_FRAG_QUEUE_MAX_FRAGS
+#else
+#define FRAG_QUEUE_MAX_FRAGS 16
+#endif
+
+/*
+ * Number of datagrams to the same next hop that are interleaved. This
+ * should not be more than the number of reassembly contexts in the
+ * receiving nodes.
+ */
+#ifdef SICSLOWPAN_CONF_FRAG_QUEUE_INTERLEAVE
+#define FRAG_QUEUE_INTERLEAVE SICSLOWPAN_CONF_FRAG_QUEUE_INTERLEAVE
+#else
+#define FRAG_QUEUE_INTERLEAVE 2
+#endif
+
+/* Gap between fragments to a next hop with one transmission per fragment */
+#ifdef SICSLOWPAN_CONF_FRAG_QUEUE_GAP
+#define FRAG_QUEUE_GAP SICSLOWPAN_CONF_FRAG_QUEUE_GAP
+#else
+#define FRAG_QUEUE_GAP (CLOCK_SECOND / 64)
+#endif
+
+/* Datagrams not completely sent within this time are dropped */
+#ifdef SICSLOWPAN_CONF_FRAG_QUEUE_MAXAGE
+#define FRAG_QUEUE_MAXAGE SICSLOWPAN_CONF_FRAG_QUEUE_MAXAGE
+#else
+#define FRAG_QUEUE_MAXAGE (4 * CLOCK_SECOND)
+#endif
+
+/*
+ * Min time to wait for the TX confirmation of a fragment. The wait is
+ * extended by the smoothed confirmation delay, which includes any
+ * queueing below the MAC such as the serial line to a radio.
+ */
+#ifdef SICSLOWPAN_CONF_FRAG_QUEUE_TX_TIMEOUT
+#define FRAG_QUEUE_TX_TIMEOUT SICSLOWPAN_CONF_FRAG_QUEUE_TX_TIMEOUT
+#else
+#define FRAG_QUEUE_TX_TIMEOUT (2 * CLOCK_SECOND)
+#endif
+
+/* Fixed point divisor and max value for the smoothed transmissions */
+#define FRAG_QUEUE_ETX_DIVISOR 16
+#define FRAG_QUEUE_ETX_MAX     (8 * FRAG_QUEUE_ETX_DIVISOR)
+#endif /* SICSLOWPAN_FRAG_QUEUE */
+
 /** \name General variables
  *  @{
  */
@@ -689,8 +800,11 @@ set_packet_attrs(void)
 
 /** Addresses contexts for IPHC. */
 #if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
+/* Contexts are indexed by context number */
 static struct sicslowpan_addr_context
 addr_contexts[SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS];
+/* One more than the highest context number that has been in use */
+static uint8_t addr_contexts_end;
 #endif
 
 /** pointer to an address context. */
@@ -732,16 +846,32 @@ static const uint8_t ttl_values[] = {0, 1, 64, 255};
 /** \name IPHC related functions
  * @{                                                                 */
 /*--------------------------------------------------------------------*/
-/** \brief find the context corresponding to prefix ipaddr */
+#if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
+/** \brief check the context lifetime and remove the context if expired */
+static int
+addr_context_is_valid(struct sicslowpan_addr_context *c)
+{
+  if(c->expires != 0 && (long)(clock_seconds() - c->expires) >= 0) {
+    PRINTF("IPHC: context %u expired\n", c->number);
+    c->used = 0;
+    return 0;
+  }
+  return 1;
+}
+#endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
+/*--------------------------------------------------------------------*/
+/** \brief find the context for compression of prefix ipaddr */
 static struct sicslowpan_addr_context*
 addr_context_lookup_by_prefix(uip_ipaddr_t *ipaddr)
 {
 /* Remove code to avoid warnings and save flash if no context is used */
 #if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
   int i;
-  for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
+  for(i = 0; i < addr_contexts_end; i++) {
     if((addr_contexts[i].used == 1) &&
-       uip_ipaddr_prefixcmp(&addr_contexts[i].prefix, ipaddr, 64)) {
+       (addr_contexts[i].flags & SICSLOWPAN_CONTEXT_COMPRESS) &&
+       uip_ipaddr_prefixcmp(&addr_contexts[i].prefix, ipaddr, 64) &&
+       addr_context_is_valid(&addr_contexts[i])) {
       return &addr_contexts[i];
     }
   }
@@ -755,12 +885,10 @@ addr_context_lookup_by_number(uint8_t number)
 {
 /* Remove code to avoid warnings and save flash if no context is used */
 #if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
-  int i;
-  for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
-    if((addr_contexts[i].used == 1) &&
-       addr_contexts[i].number == number) {
-      return &addr_contexts[i];
-    }
+  if(number < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS &&
+     addr_contexts[number].used == 1 &&
+     addr_context_is_valid(&addr_contexts[number])) {
+    return &addr_contexts[number];
   }
 #endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
   return NULL;
@@ -826,6 +954,138 @@ uncompress_addr(uip_ipaddr_t *ipaddr, uint8_t const prefix[],
   PRINTF("\n");
 }
 
+/*--------------------------------------------------------------------*/
+/* Compress the UDP ports and write the NHC byte at nhc. The checksum is
+ * always carried inline.
+ */
+static void
+compress_udp_hdr(struct uip_udp_hdr *udp_buf, uint8_t *nhc)
+{
+  PRINTF("IPHC: Uncompressed UDP ports on send side: %x, %x\n",
+         UIP_HTONS(udp_buf->srcport), UIP_HTONS(udp_buf->destport));
+  /* Mask out the last 4 bits can be used as a mask */
+  if(((UIP_HTONS(udp_buf->srcport) & 0xfff0) == SICSLOWPAN_UDP_4_BIT_PORT_MIN) &&
+     ((UIP_HTONS(udp_buf->destport) & 0xfff0) == SICSLOWPAN_UDP_4_BIT_PORT_MIN)) {
+    /* we can compress 12 bits of both source and dest */
+    *nhc = SICSLOWPAN_NHC_UDP_CS_P_11;
+    PRINTF("IPHC: remove 12 b of both source & dest with prefix 0xFOB\n");
+    *hc06_ptr =
+      (uint8_t)((UIP_HTONS(udp_buf->srcport) -
+                 SICSLOWPAN_UDP_4_BIT_PORT_MIN) << 4) +
+      (uint8_t)((UIP_HTONS(udp_buf->destport) -
+                 SICSLOWPAN_UDP_4_BIT_PORT_MIN));
+    hc06_ptr += 1;
+  } else if((UIP_HTONS(udp_buf->destport) & 0xff00) == SICSLOWPAN_UDP_8_BIT_PORT_MIN) {
+    /* we can compress 8 bits of dest, leave source. */
+    *nhc = SICSLOWPAN_NHC_UDP_CS_P_01;
+    PRINTF("IPHC: leave source, remove 8 bits of dest with prefix 0xF0\n");
+    memcpy(hc06_ptr, &udp_buf->srcport, 2);
+    *(hc06_ptr + 2) =
+      (uint8_t)((UIP_HTONS(udp_buf->destport) -
+                 SICSLOWPAN_UDP_8_BIT_PORT_MIN));
+    hc06_ptr += 3;
+  } else if((UIP_HTONS(udp_buf->srcport) & 0xff00) == SICSLOWPAN_UDP_8_BIT_PORT_MIN) {
+    /* we can compress 8 bits of src, leave dest. Copy compressed port */
+    *nhc = SICSLOWPAN_NHC_UDP_CS_P_10;
+    PRINTF("IPHC: remove 8 bits of source with prefix 0xF0, leave dest. hch: %i\n", *nhc);
+    *hc06_ptr =
+      (uint8_t)((UIP_HTONS(udp_buf->srcport) -
+                 SICSLOWPAN_UDP_8_BIT_PORT_MIN));
+    memcpy(hc06_ptr + 1, &udp_buf->destport, 2);
+    hc06_ptr += 3;
+  } else {
+    /* we cannot compress. Copy uncompressed ports, full checksum  */
+    *nhc = SICSLOWPAN_NHC_UDP_CS_P_00;
+    PRINTF("IPHC: cannot compress UDP headers\n");
+    memcpy(hc06_ptr, &udp_buf->srcport, 4);
+    hc06_ptr += 4;
+  }
+  /* always inline the checksum  */
+  memcpy(hc06_ptr, &udp_buf->udpchksum, 2);
+  hc06_ptr += 2;
+}
+
+#if IPHC_FAST_PATH
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Compress the dominant packets without the generic field checks
+ *
+ * Handles UDP without extension headers between unicast addresses in
+ * the context 0 prefix (the DODAG prefix), with traffic class and flow
+ * label zero and a compressible hop limit. The result is identical to
+ * the generic compression.
+ *
+ * \return 1 if the packet was compressed, 0 if the generic path is needed
+ */
+static int
+compress_hdr_iphc_fast(linkaddr_t *link_destaddr)
+{
+  struct sicslowpan_addr_context *c;
+  uint8_t iphc0, iphc1;
+#if SICSLOWPAN_CONTEXT_STATS
+  uint8_t *addr_ptr;
+#endif /* SICSLOWPAN_CONTEXT_STATS */
+
+  if(UIP_IP_BUF->vtc != 0x60 || UIP_IP_BUF->tcflow != 0 ||
+     UIP_IP_BUF->flow != 0 || UIP_IP_BUF->proto != UIP_PROTO_UDP) {
+    return 0;
+  }
+
+  iphc0 = SICSLOWPAN_DISPATCH_IPHC | SICSLOWPAN_IPHC_FL_C |
+    SICSLOWPAN_IPHC_TC_C | SICSLOWPAN_IPHC_NH_C;
+  switch(UIP_IP_BUF->ttl) {
+  case 64:
+    iphc0 |= SICSLOWPAN_IPHC_TTL_64;
+    break;
+  case 255:
+    iphc0 |= SICSLOWPAN_IPHC_TTL_255;
+    break;
+  case 1:
+    iphc0 |= SICSLOWPAN_IPHC_TTL_1;
+    break;
+  default:
+    return 0;
+  }
+
+  /* Context 0 is always the first match in the context lookup */
+  c = &addr_contexts[0];
+  if(c->used != 1 || (c->flags & SICSLOWPAN_CONTEXT_COMPRESS) == 0 ||
+     !uip_ipaddr_prefixcmp(&c->prefix, &UIP_IP_BUF->srcipaddr, 64) ||
+     !uip_ipaddr_prefixcmp(&c->prefix, &UIP_IP_BUF->destipaddr, 64) ||
+     uip_is_addr_mcast(&UIP_IP_BUF->destipaddr) ||
+     uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr) ||
+     !addr_context_is_valid(c)) {
+    return 0;
+  }
+
+  hc06_ptr = packetbuf_ptr + 2;
+  iphc1 = SICSLOWPAN_IPHC_SAC | SICSLOWPAN_IPHC_DAC;
+
+#if SICSLOWPAN_CONTEXT_STATS
+  addr_ptr = hc06_ptr;
+#endif /* SICSLOWPAN_CONTEXT_STATS */
+  iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_SAM_BIT,
+                            &UIP_IP_BUF->srcipaddr, &uip_lladdr);
+  iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_DAM_BIT,
+                            &UIP_IP_BUF->destipaddr,
+                            (uip_lladdr_t *)link_destaddr);
+#if SICSLOWPAN_CONTEXT_STATS
+  c->packets++;
+  c->bytes_saved += 32 - (hc06_ptr - addr_ptr);
+#endif /* SICSLOWPAN_CONTEXT_STATS */
+
+  /* NHC byte followed by the ports and checksum */
+  hc06_ptr++;
+  compress_udp_hdr(UIP_UDP_BUF(0), hc06_ptr - 1);
+
+  PACKETBUF_IPHC_BUF[0] = iphc0;
+  PACKETBUF_IPHC_BUF[1] = iphc1;
+  uncomp_hdr_len = UIP_IPH_LEN + UIP_UDPH_LEN;
+  packetbuf_hdr_len = hc06_ptr - packetbuf_ptr;
+  return 1;
+}
+#endif /* IPHC_FAST_PATH */
+
 /*--------------------------------------------------------------------*/
 /**
  * \brief Compress IP/UDP header
@@ -865,6 +1125,10 @@ static void
 compress_hdr_iphc(linkaddr_t *link_destaddr)
 {
   uint8_t tmp, iphc0, iphc1, *next_hdr, *next_nhc;
+  struct sicslowpan_addr_context *src_context, *dest_context;
+#if SICSLOWPAN_CONTEXT_STATS
+  uint8_t *addr_ptr;
+#endif /* SICSLOWPAN_CONTEXT_STATS */
 #if DEBUG
   { uint16_t ndx;
     PRINTF("before compression (%d,%d): ", UIP_IP_BUF->len[1],
@@ -877,6 +1141,12 @@ compress_hdr_iphc(linkaddr_t *link_destaddr)
   }
 #endif
 
+#if IPHC_FAST_PATH
+  if(iphc_fast_path && compress_hdr_iphc_fast(link_destaddr)) {
+    return;
+  }
+#endif /* IPHC_FAST_PATH */
+
   hc06_ptr = packetbuf_ptr + 2;
   /*
    * As we copy some bit-length fields, in the IPHC encoding bytes,
@@ -896,11 +1166,21 @@ compress_hdr_iphc(linkaddr_t *link_destaddr)
    */
 
 
-  /* check if dest context exists (for allocating third byte) */
-  /* TODO: fix this so that it remembers the looked up values for
-     avoiding two lookups - or set the lookup values immediately */
-  if(addr_context_lookup_by_prefix(&UIP_IP_BUF->destipaddr) != NULL ||
-     addr_context_lookup_by_prefix(&UIP_IP_BUF->srcipaddr) != NULL) {
+  /* Look up the contexts once - the source can not be unspecified
+     and the destination not multicast for context based compression */
+  src_context = NULL;
+  dest_context = NULL;
+  if(!uip_is_addr_unspecified(&UIP_IP_BUF->srcipaddr)) {
+    src_context = addr_context_lookup_by_prefix(&UIP_IP_BUF->srcipaddr);
+  }
+  if(!uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
+    dest_context = addr_context_lookup_by_prefix(&UIP_IP_BUF->destipaddr);
+  }
+
+  /* Context 0 is implied without the CID flag - only allocate the
+     third byte when another context is used */
+  if((src_context != NULL && src_context->number != 0) ||
+     (dest_context != NULL && dest_context->number != 0)) {
     /* set context flag and increase hc06_ptr */
     PRINTF("IPHC: compressing dest or src ipaddr - setting CID\n");
     iphc1 |= SICSLOWPAN_IPHC_CID;
@@ -992,17 +1272,29 @@ compress_hdr_iphc(linkaddr_t *link_destaddr)
     PRINTF("IPHC: compressing unspecified - setting SAC\n");
     iphc1 |= SICSLOWPAN_IPHC_SAC;
     iphc1 |= SICSLOWPAN_IPHC_SAM_00;
-  } else if((context = addr_context_lookup_by_prefix(&UIP_IP_BUF->srcipaddr))
-     != NULL) {
+  } else if(src_context != NULL) {
     /* elide the prefix - indicate by CID and set context + SAC */
-    PRINTF("IPHC: compressing src with context - setting CID & SAC ctx: %d\n",
-           context->number);
-    iphc1 |= SICSLOWPAN_IPHC_CID | SICSLOWPAN_IPHC_SAC;
-    PACKETBUF_IPHC_BUF[2] |= context->number << 4;
+    PRINTF("IPHC: compressing src with context - setting SAC ctx: %d\n",
+           src_context->number);
+    iphc1 |= SICSLOWPAN_IPHC_SAC;
+    if(iphc1 & SICSLOWPAN_IPHC_CID) {
+      PACKETBUF_IPHC_BUF[2] |= src_context->number << 4;
+    }
     /* compession compare with this nodes address (source) */
 
+#if SICSLOWPAN_CONTEXT_STATS
+    addr_ptr = hc06_ptr;
+#endif /* SICSLOWPAN_CONTEXT_STATS */
     iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_SAM_BIT,
                               &UIP_IP_BUF->srcipaddr, &uip_lladdr);
+#if SICSLOWPAN_CONTEXT_STATS
+    src_context->packets++;
+    src_context->bytes_saved += 16 - (hc06_ptr - addr_ptr);
+    if((iphc1 & SICSLOWPAN_IPHC_CID) && src_context->number != 0) {
+      /* The context byte is paid by the context that needed it */
+      src_context->bytes_saved--;
+    }
+#endif /* SICSLOWPAN_CONTEXT_STATS */
     /* No context found for this address */
   } else if(uip_is_addr_linklocal(&UIP_IP_BUF->srcipaddr) &&
             UIP_IP_BUF->destipaddr.u16[1] == 0 &&
@@ -1046,15 +1338,30 @@ compress_hdr_iphc(linkaddr_t *link_destaddr)
     }
   } else {
     /* Address is unicast, try to compress */
-    if((context = addr_context_lookup_by_prefix(&UIP_IP_BUF->destipaddr)) != NULL) {
+    if(dest_context != NULL) {
       /* elide the prefix */
       iphc1 |= SICSLOWPAN_IPHC_DAC;
-      PACKETBUF_IPHC_BUF[2] |= context->number;
+      if(iphc1 & SICSLOWPAN_IPHC_CID) {
+        PACKETBUF_IPHC_BUF[2] |= dest_context->number;
+      }
       /* compession compare with link adress (destination) */
 
+#if SICSLOWPAN_CONTEXT_STATS
+      addr_ptr = hc06_ptr;
+#endif /* SICSLOWPAN_CONTEXT_STATS */
       iphc1 |= compress_addr_64(SICSLOWPAN_IPHC_DAM_BIT,
                                 &UIP_IP_BUF->destipaddr,
                                 (uip_lladdr_t *)link_destaddr);
+#if SICSLOWPAN_CONTEXT_STATS
+      if(dest_context != src_context) {
+        dest_context->packets++;
+      }
+      dest_context->bytes_saved += 16 - (hc06_ptr - addr_ptr);
+      if((iphc1 & SICSLOWPAN_IPHC_CID) && dest_context->number != 0 &&
+         (src_context == NULL || src_context->number == 0)) {
+        dest_context->bytes_saved--;
+      }
+#endif /* SICSLOWPAN_CONTEXT_STATS */
       /* No context found for this address */
     } else if(uip_is_addr_linklocal(&UIP_IP_BUF->destipaddr) &&
               UIP_IP_BUF->destipaddr.u16[1] == 0 &&
@@ -1132,50 +1439,7 @@ compress_hdr_iphc(linkaddr_t *link_destaddr)
       /* allocate a byte for the next header posision as UDP has no next */
       hc06_ptr++;
       struct uip_udp_hdr *udp_buf = UIP_UDP_BUF(ext_hdr_len);
-      PRINTF("IPHC: Uncompressed UDP ports on send side: %x, %x\n",
-             UIP_HTONS(udp_buf->srcport), UIP_HTONS(udp_buf->destport));
-      /* Mask out the last 4 bits can be used as a mask */
-      if(((UIP_HTONS(udp_buf->srcport) & 0xfff0) == SICSLOWPAN_UDP_4_BIT_PORT_MIN) &&
-         ((UIP_HTONS(udp_buf->destport) & 0xfff0) == SICSLOWPAN_UDP_4_BIT_PORT_MIN)) {
-        /* we can compress 12 bits of both source and dest */
-        *next_nhc = SICSLOWPAN_NHC_UDP_CS_P_11;
-        PRINTF("IPHC: remove 12 b of both source & dest with prefix 0xFOB\n");
-        *hc06_ptr =
-          (uint8_t)((UIP_HTONS(udp_buf->srcport) -
-                     SICSLOWPAN_UDP_4_BIT_PORT_MIN) << 4) +
-          (uint8_t)((UIP_HTONS(udp_buf->destport) -
-                     SICSLOWPAN_UDP_4_BIT_PORT_MIN));
-        hc06_ptr += 1;
-      } else if((UIP_HTONS(udp_buf->destport) & 0xff00) == SICSLOWPAN_UDP_8_BIT_PORT_MIN) {
-        /* we can compress 8 bits of dest, leave source. */
-        *next_nhc = SICSLOWPAN_NHC_UDP_CS_P_01;
-        PRINTF("IPHC: leave source, remove 8 bits of dest with prefix 0xF0\n");
-        memcpy(hc06_ptr, &udp_buf->srcport, 2);
-        *(hc06_ptr + 2) =
-          (uint8_t)((UIP_HTONS(udp_buf->destport) -
-                     SICSLOWPAN_UDP_8_BIT_PORT_MIN));
-        hc06_ptr += 3;
-      } else if((UIP_HTONS(udp_buf->srcport) & 0xff00) == SICSLOWPAN_UDP_8_BIT_PORT_MIN) {
-        /* we can compress 8 bits of src, leave dest. Copy compressed port */
-        *next_nhc = SICSLOWPAN_NHC_UDP_CS_P_10;
-        PRINTF("IPHC: remove 8 bits of source with prefix 0xF0, leave dest. hch: %i\n", *next_nhc);
-        *hc06_ptr =
-          (uint8_t)((UIP_HTONS(udp_buf->srcport) -
-                     SICSLOWPAN_UDP_8_BIT_PORT_MIN));
-        memcpy(hc06_ptr + 1, &udp_buf->destport, 2);
-        hc06_ptr += 3;
-      } else {
-        /* we cannot compress. Copy uncompressed ports, full checksum  */
-        *next_nhc = SICSLOWPAN_NHC_UDP_CS_P_00;
-        PRINTF("IPHC: cannot compress UDP headers\n");
-        memcpy(hc06_ptr, &udp_buf->srcport, 4);
-        hc06_ptr += 4;
-      }
-      /* always inline the checksum  */
-      if(1) {
-        memcpy(hc06_ptr, &udp_buf->udpchksum, 2);
-        hc06_ptr += 2;
-      }
+      compress_udp_hdr(udp_buf, next_nhc);
       uncomp_hdr_len += UIP_UDPH_LEN;
       /* this is the final header... */
       next_hdr = NULL;
@@ -1208,6 +1472,197 @@ compress_hdr_iphc(linkaddr_t *link_destaddr)
   return;
 }
 
+/*--------------------------------------------------------------------*/
+/* Uncompress the LOWPAN_UDP header at hc06_ptr into udp_buf. Returns 0
+ * if the port compression is not supported.
+ */
+static int
+uncompress_udp_hdr(struct uip_udp_hdr *udp_buf, uint16_t ip_len,
+                   uint8_t ext_hdr_len)
+{
+  uint8_t checksum_compressed;
+  uint16_t udp_len;
+
+  checksum_compressed = *hc06_ptr & SICSLOWPAN_NHC_UDP_CHECKSUMC;
+  PRINTF("IPHC: Incoming header value: %i\n", *hc06_ptr);
+  switch(*hc06_ptr & SICSLOWPAN_NHC_UDP_CS_P_11) {
+  case SICSLOWPAN_NHC_UDP_CS_P_00:
+    /* 1 byte for NHC, 4 byte for ports, 2 bytes chksum */
+    memcpy(&udp_buf->srcport, hc06_ptr + 1, 2);
+    memcpy(&udp_buf->destport, hc06_ptr + 3, 2);
+    PRINTF("IPHC: Uncompressed UDP ports (ptr+5): %x, %x\n",
+           UIP_HTONS(udp_buf->srcport),
+           UIP_HTONS(udp_buf->destport));
+    hc06_ptr += 5;
+    break;
+
+  case SICSLOWPAN_NHC_UDP_CS_P_01:
+    /* 1 byte for NHC + source 16bit inline, dest = 0xF0 + 8 bit inline */
+    PRINTF("IPHC: Decompressing destination\n");
+    memcpy(&udp_buf->srcport, hc06_ptr + 1, 2);
+    udp_buf->destport = UIP_HTONS(SICSLOWPAN_UDP_8_BIT_PORT_MIN + (*(hc06_ptr + 3)));
+    PRINTF("IPHC: Uncompressed UDP ports (ptr+4): %x, %x\n",
+           UIP_HTONS(udp_buf->srcport), UIP_HTONS(udp_buf->destport));
+    hc06_ptr += 4;
+    break;
+
+  case SICSLOWPAN_NHC_UDP_CS_P_10:
+    /* 1 byte for NHC + source = 0xF0 + 8bit inline, dest = 16 bit inline*/
+    PRINTF("IPHC: Decompressing source\n");
+    udp_buf->srcport = UIP_HTONS(SICSLOWPAN_UDP_8_BIT_PORT_MIN +
+                                 (*(hc06_ptr + 1)));
+    memcpy(&udp_buf->destport, hc06_ptr + 2, 2);
+    PRINTF("IPHC: Uncompressed UDP ports (ptr+4): %x, %x\n",
+           UIP_HTONS(udp_buf->srcport), UIP_HTONS(udp_buf->destport));
+    hc06_ptr += 4;
+    break;
+
+  case SICSLOWPAN_NHC_UDP_CS_P_11:
+    /* 1 byte for NHC, 1 byte for ports */
+    udp_buf->srcport = UIP_HTONS(SICSLOWPAN_UDP_4_BIT_PORT_MIN +
+                                 (*(hc06_ptr + 1) >> 4));
+    udp_buf->destport = UIP_HTONS(SICSLOWPAN_UDP_4_BIT_PORT_MIN +
+                                  ((*(hc06_ptr + 1)) & 0x0F));
+    PRINTF("IPHC: Uncompressed UDP ports (ptr+2): %x, %x\n",
+           UIP_HTONS(udp_buf->srcport), UIP_HTONS(udp_buf->destport));
+    hc06_ptr += 2;
+    break;
+  default:
+    PRINTF("sicslowpan uncompress_hdr: error unsupported UDP compression\n");
+    return 0;
+  }
+  if(!checksum_compressed) { /* has_checksum, default  */
+    memcpy(&udp_buf->udpchksum, hc06_ptr, 2);
+    hc06_ptr += 2;
+    PRINTF("IPHC: sicslowpan uncompress_hdr: checksum included\n");
+  } else {
+    PRINTF("IPHC: sicslowpan uncompress_hdr: checksum *NOT* included\n");
+  }
+
+  /* length field in UDP header (8 byte header + payload) */
+  udp_len = 8 + packetbuf_datalen() - (hc06_ptr - packetbuf_ptr);
+  udp_buf->udplen = UIP_HTONS(ip_len == 0 ? udp_len :
+                              ip_len - UIP_IPH_LEN - ext_hdr_len);
+  PRINTF("Setting UDP length: %u (ext: %u) ip_len: %d udp_len:%d\n",
+         UIP_HTONS(udp_buf->udplen), ext_hdr_len, ip_len, udp_len);
+
+  uncomp_hdr_len += UIP_UDPH_LEN;
+  return 1;
+}
+/*--------------------------------------------------------------------*/
+/* Set the compressed header length and the IP payload length after
+ * the headers have been uncompressed.
+ */
+static void
+uncompress_ip_len(uint8_t *buf, uint16_t ip_len)
+{
+  packetbuf_hdr_len = hc06_ptr - packetbuf_ptr;
+
+  /* IP length field. */
+  if(ip_len == 0) {
+    int len = packetbuf_datalen() - packetbuf_hdr_len + uncomp_hdr_len - UIP_IPH_LEN;
+    PRINTF("IP payload length: %d. %u - %u + %u - %u\n", len,
+           packetbuf_datalen(), packetbuf_hdr_len, uncomp_hdr_len, UIP_IPH_LEN);
+
+    /* This is not a fragmented packet */
+    SICSLOWPAN_IP_BUF(buf)->len[0] = len >> 8;
+    SICSLOWPAN_IP_BUF(buf)->len[1] = len & 0x00FF;
+  } else {
+    /* This is a 1st fragment */
+    SICSLOWPAN_IP_BUF(buf)->len[0] = (ip_len - UIP_IPH_LEN) >> 8;
+    SICSLOWPAN_IP_BUF(buf)->len[1] = (ip_len - UIP_IPH_LEN) & 0x00FF;
+  }
+}
+
+#if IPHC_FAST_PATH
+/*--------------------------------------------------------------------*/
+/* Uncompress a context based unicast address with SAM/DAM mode 1 - 3.
+ * Same result as uncompress_addr() with unc_ctxconf[mode].
+ */
+static void
+uncompress_ctx_addr(uip_ipaddr_t *ipaddr, const uint8_t *prefix, uint8_t mode,
+                    uip_lladdr_t *lladdr)
+{
+  memcpy(ipaddr, prefix, 8);
+  if(mode == 3) {
+    memset(&ipaddr->u8[8], 0, 8);
+    uip_ds6_set_addr_iid(ipaddr, lladdr);
+  } else if(mode == 2) {
+    /* 16 bits uncompression => 0000:00ff:fe00:XXXX */
+    memset(&ipaddr->u8[8], 0, 6);
+    ipaddr->u8[11] = 0xff;
+    ipaddr->u8[12] = 0xfe;
+    memcpy(&ipaddr->u8[14], hc06_ptr, 2);
+    hc06_ptr += 2;
+  } else {
+    memcpy(&ipaddr->u8[8], hc06_ptr, 8);
+    hc06_ptr += 8;
+  }
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Uncompress the packets produced by compress_hdr_iphc_fast()
+ *
+ * Handles UDP with both addresses in context 0 without CID, traffic
+ * class and flow label elided and a compressed hop limit. The result is
+ * identical to the generic decompression.
+ *
+ * \return 1 if the packet was uncompressed, 0 if the generic path is needed
+ */
+static int
+uncompress_hdr_iphc_fast(uint8_t *buf, uint16_t ip_len)
+{
+  uint8_t iphc0, iphc1, sam, dam;
+  uint8_t *nhc;
+
+  iphc0 = PACKETBUF_IPHC_BUF[0];
+  iphc1 = PACKETBUF_IPHC_BUF[1];
+  sam = (iphc1 & SICSLOWPAN_IPHC_SAM_11) >> SICSLOWPAN_IPHC_SAM_BIT;
+  dam = (iphc1 & SICSLOWPAN_IPHC_DAM_11) >> SICSLOWPAN_IPHC_DAM_BIT;
+  if((iphc0 & ~SICSLOWPAN_IPHC_TTL_255) !=
+     (SICSLOWPAN_DISPATCH_IPHC | SICSLOWPAN_IPHC_FL_C |
+      SICSLOWPAN_IPHC_TC_C | SICSLOWPAN_IPHC_NH_C) ||
+     (iphc0 & SICSLOWPAN_IPHC_TTL_255) == SICSLOWPAN_IPHC_TTL_I ||
+     (iphc1 & (SICSLOWPAN_IPHC_CID | SICSLOWPAN_IPHC_SAC |
+               SICSLOWPAN_IPHC_M | SICSLOWPAN_IPHC_DAC)) !=
+     (SICSLOWPAN_IPHC_SAC | SICSLOWPAN_IPHC_DAC) ||
+     sam == 0 || dam == 0) {
+    return 0;
+  }
+
+  /* The NHC follows the inline part of the addresses */
+  nhc = packetbuf_ptr + packetbuf_hdr_len + 2 +
+    (unc_ctxconf[sam] & 0x0f) + (unc_ctxconf[dam] & 0x0f);
+  if((*nhc & SICSLOWPAN_NHC_UDP_MASK) != SICSLOWPAN_NHC_UDP_ID) {
+    return 0;
+  }
+
+  context = addr_context_lookup_by_number(0);
+  if(context == NULL) {
+    return 0;
+  }
+
+  SICSLOWPAN_IP_BUF(buf)->vtc = 0x60;
+  SICSLOWPAN_IP_BUF(buf)->tcflow = 0;
+  SICSLOWPAN_IP_BUF(buf)->flow = 0;
+  SICSLOWPAN_IP_BUF(buf)->proto = UIP_PROTO_UDP;
+  SICSLOWPAN_IP_BUF(buf)->ttl = ttl_values[iphc0 & SICSLOWPAN_IPHC_TTL_255];
+
+  hc06_ptr = packetbuf_ptr + packetbuf_hdr_len + 2;
+  uncompress_ctx_addr(&SICSLOWPAN_IP_BUF(buf)->srcipaddr, context->prefix, sam,
+                      (uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_SENDER));
+  uncompress_ctx_addr(&SICSLOWPAN_IP_BUF(buf)->destipaddr, context->prefix, dam,
+                      (uip_lladdr_t *)packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
+  uncomp_hdr_len += UIP_IPH_LEN;
+
+  /* All port compressions are supported */
+  uncompress_udp_hdr((struct uip_udp_hdr *)SICSLOWPAN_IPPAYLOAD_BUF(buf),
+                     ip_len, 0);
+  uncompress_ip_len(buf, ip_len);
+  return 1;
+}
+#endif /* IPHC_FAST_PATH */
+
 /*--------------------------------------------------------------------*/
 /**
  * \brief Uncompress IPHC (i.e., IPHC and LOWPAN_UDP) headers and put
@@ -1229,6 +1684,13 @@ static void
 uncompress_hdr_iphc(uint8_t *buf, uint16_t ip_len)
 {
   uint8_t tmp, iphc0, iphc1;
+
+#if IPHC_FAST_PATH
+  if(iphc_fast_path && uncompress_hdr_iphc_fast(buf, ip_len)) {
+    return;
+  }
+#endif /* IPHC_FAST_PATH */
+
   /* at least two byte will be used for the encoding */
   hc06_ptr = packetbuf_ptr + packetbuf_hdr_len + 2;
 
@@ -1433,94 +1895,14 @@ uncompress_hdr_iphc(uint8_t *buf, uint16_t ip_len)
 
   /* The next header is compressed, NHC is following */
   if(nhc && (*hc06_ptr & SICSLOWPAN_NHC_UDP_MASK) == SICSLOWPAN_NHC_UDP_ID) {
-    struct uip_udp_hdr *udp_buf = (struct uip_udp_hdr *)ip_payload;
-    uint8_t checksum_compressed;
     *last_nextheader = UIP_PROTO_UDP;
-    checksum_compressed = *hc06_ptr & SICSLOWPAN_NHC_UDP_CHECKSUMC;
-    PRINTF("IPHC: Incoming header value: %i\n", *hc06_ptr);
-    switch(*hc06_ptr & SICSLOWPAN_NHC_UDP_CS_P_11) {
-    case SICSLOWPAN_NHC_UDP_CS_P_00:
-      /* 1 byte for NHC, 4 byte for ports, 2 bytes chksum */
-      memcpy(&udp_buf->srcport, hc06_ptr + 1, 2);
-      memcpy(&udp_buf->destport, hc06_ptr + 3, 2);
-      PRINTF("IPHC: Uncompressed UDP ports (ptr+5): %x, %x\n",
-             UIP_HTONS(udp_buf->srcport),
-             UIP_HTONS(udp_buf->destport));
-      hc06_ptr += 5;
-      break;
-
-    case SICSLOWPAN_NHC_UDP_CS_P_01:
-      /* 1 byte for NHC + source 16bit inline, dest = 0xF0 + 8 bit inline */
-      PRINTF("IPHC: Decompressing destination\n");
-      memcpy(&udp_buf->srcport, hc06_ptr + 1, 2);
-      udp_buf->destport = UIP_HTONS(SICSLOWPAN_UDP_8_BIT_PORT_MIN + (*(hc06_ptr + 3)));
-      PRINTF("IPHC: Uncompressed UDP ports (ptr+4): %x, %x\n",
-             UIP_HTONS(udp_buf->srcport), UIP_HTONS(udp_buf->destport));
-      hc06_ptr += 4;
-      break;
-
-    case SICSLOWPAN_NHC_UDP_CS_P_10:
-      /* 1 byte for NHC + source = 0xF0 + 8bit inline, dest = 16 bit inline*/
-      PRINTF("IPHC: Decompressing source\n");
-      udp_buf->srcport = UIP_HTONS(SICSLOWPAN_UDP_8_BIT_PORT_MIN +
-                                   (*(hc06_ptr + 1)));
-      memcpy(&udp_buf->destport, hc06_ptr + 2, 2);
-      PRINTF("IPHC: Uncompressed UDP ports (ptr+4): %x, %x\n",
-             UIP_HTONS(udp_buf->srcport), UIP_HTONS(udp_buf->destport));
-      hc06_ptr += 4;
-      break;
-
-    case SICSLOWPAN_NHC_UDP_CS_P_11:
-      /* 1 byte for NHC, 1 byte for ports */
-      udp_buf->srcport = UIP_HTONS(SICSLOWPAN_UDP_4_BIT_PORT_MIN +
-                                   (*(hc06_ptr + 1) >> 4));
-      udp_buf->destport = UIP_HTONS(SICSLOWPAN_UDP_4_BIT_PORT_MIN +
-                                    ((*(hc06_ptr + 1)) & 0x0F));
-      PRINTF("IPHC: Uncompressed UDP ports (ptr+2): %x, %x\n",
-             UIP_HTONS(udp_buf->srcport), UIP_HTONS(udp_buf->destport));
-      hc06_ptr += 2;
-      break;
-    default:
-      PRINTF("sicslowpan uncompress_hdr: error unsupported UDP compression\n");
+    if(!uncompress_udp_hdr((struct uip_udp_hdr *)ip_payload, ip_len,
+                           ext_hdr_len)) {
       return;
     }
-    if(!checksum_compressed) { /* has_checksum, default  */
-      memcpy(&udp_buf->udpchksum, hc06_ptr, 2);
-      hc06_ptr += 2;
-      PRINTF("IPHC: sicslowpan uncompress_hdr: checksum included\n");
-    } else {
-      PRINTF("IPHC: sicslowpan uncompress_hdr: checksum *NOT* included\n");
-    }
-
-    /* length field in UDP header (8 byte header + payload) */
-    uint16_t udp_len = 8 + packetbuf_datalen() - (hc06_ptr - packetbuf_ptr);
-    udp_buf->udplen = UIP_HTONS(ip_len == 0 ? udp_len :
-                                ip_len - UIP_IPH_LEN - ext_hdr_len);
-    PRINTF("Setting UDP length: %u (ext: %u) ip_len: %d udp_len:%d\n",
-           UIP_HTONS(udp_buf->udplen), ext_hdr_len, ip_len, udp_len);
-
-    uncomp_hdr_len += UIP_UDPH_LEN;
   }
 
-  packetbuf_hdr_len = hc06_ptr - packetbuf_ptr;
-
-  /* IP length field. */
-  if(ip_len == 0) {
-    int len = packetbuf_datalen() - packetbuf_hdr_len + uncomp_hdr_len - UIP_IPH_LEN;
-    PRINTF("IP payload length: %d. %u - %u + %u - %u\n", len,
-           packetbuf_datalen(), packetbuf_hdr_len, uncomp_hdr_len, UIP_IPH_LEN);
-
-    /* This is not a fragmented packet */
-    SICSLOWPAN_IP_BUF(buf)->len[0] = len >> 8;
-    SICSLOWPAN_IP_BUF(buf)->len[1] = len & 0x00FF;
-  } else {
-    /* This is a 1st fragment */
-    SICSLOWPAN_IP_BUF(buf)->len[0] = (ip_len - UIP_IPH_LEN) >> 8;
-    SICSLOWPAN_IP_BUF(buf)->len[1] = (ip_len - UIP_IPH_LEN) & 0x00FF;
-  }
-
-
-  return;
+  uncompress_ip_len(buf, ip_len);
 }
 /** @} */
 #endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
@@ -1572,12 +1954,13 @@ packet_sent(void *ptr, int status, int transmissions)
 }
 /*--------------------------------------------------------------------*/
 /**
- * \brief This function is called by the 6lowpan code to send out a
- * packet.
+ * \brief Send the packet in packetbuf with a specific sent callback.
  * \param dest the link layer destination address of the packet
+ * \param sent the callback for the result of the transmission
+ * \param ptr the callback argument
  */
 static void
-send_packet(linkaddr_t *dest)
+send_packet_with_callback(linkaddr_t *dest, mac_callback_t sent, void *ptr)
 {
   /* Set the link layer destination address for the packet as a
    * packetbuf attribute. The MAC layer can access the destination
@@ -1592,13 +1975,389 @@ send_packet(linkaddr_t *dest)
 
   /* Provide a callback function to receive the result of
      a packet transmission. */
-  NETSTACK_LLSEC.send(&packet_sent, NULL);
+  NETSTACK_LLSEC.send(sent, ptr);
 
   /* If we are sending multiple packets in a row, we need to let the
      watchdog know that we are still alive. */
   watchdog_periodic();
 }
 /*--------------------------------------------------------------------*/
+/**
+ * \brief This function is called by the 6lowpan code to send out a
+ * packet.
+ * \param dest the link layer destination address of the packet
+ */
+static void
+send_packet(linkaddr_t *dest)
+{
+  send_packet_with_callback(dest, &packet_sent, NULL);
+}
+/*--------------------------------------------------------------------*/
+#if SICSLOWPAN_FRAG_QUEUE
+/*
+ * Fragments are queued per next hop. Each next hop has at most one
+ * fragment in flight and the fragments of its first datagrams are
+ * interleaved round-robin. When the TX confirmation arrives the next
+ * fragment to that next hop is sent after a gap that is scaled by the
+ * smoothed number of transmissions. Under pressure whole datagrams are
+ * dropped since a datagram missing any fragment is useless to the
+ * receiver.
+ */
+struct frag_datagram {
+  struct frag_datagram *next;
+  clock_time_t created;
+  uint8_t count;
+  uint8_t sent;
+  struct queuebuf *frags[FRAG_QUEUE_MAX_FRAGS];
+};
+
+struct frag_nbr {
+  struct frag_nbr *next;
+  linkaddr_t addr;
+  LIST_STRUCT(datagrams);
+  struct ctimer timer;
+  /* The datagram of the fragment in flight, if it has more fragments */
+  struct frag_datagram *inflight;
+  clock_time_t sent_at;
+  /* Identifies the fragment in flight in the TX confirmation */
+  uint16_t token;
+  uint16_t etx;
+  uint8_t busy;
+  uint8_t rr;
+};
+
+MEMB(frag_datagram_memb, struct frag_datagram, FRAG_QUEUE_DATAGRAMS);
+MEMB(frag_nbr_memb, struct frag_nbr, FRAG_QUEUE_NBRS);
+LIST(frag_nbr_list);
+
+static uint16_t frag_queue_last_token;
+/* Smoothed time from sending a fragment to its TX confirmation */
+static clock_time_t frag_queue_tx_delay;
+
+static void frag_queue_timeout(void *ptr);
+/*--------------------------------------------------------------------*/
+static void
+frag_datagram_free(struct frag_nbr *nbr, struct frag_datagram *dg)
+{
+  int i;
+  list_remove(nbr->datagrams, dg);
+  if(nbr->inflight == dg) {
+    nbr->inflight = NULL;
+  }
+  for(i = dg->sent; i < dg->count; i++) {
+    queuebuf_free(dg->frags[i]);
+  }
+  memb_free(&frag_datagram_memb, dg);
+}
+/*--------------------------------------------------------------------*/
+static void
+frag_nbr_release(struct frag_nbr *nbr)
+{
+  if(nbr->busy == 0 && list_head(nbr->datagrams) == NULL) {
+    ctimer_stop(&nbr->timer);
+    list_remove(frag_nbr_list, nbr);
+    memb_free(&frag_nbr_memb, nbr);
+  }
+}
+/*--------------------------------------------------------------------*/
+static struct frag_nbr *
+frag_nbr_lookup(const linkaddr_t *addr)
+{
+  struct frag_nbr *nbr;
+  for(nbr = list_head(frag_nbr_list); nbr != NULL; nbr = list_item_next(nbr)) {
+    if(linkaddr_cmp(&nbr->addr, addr)) {
+      return nbr;
+    }
+  }
+  return NULL;
+}
+/*--------------------------------------------------------------------*/
+static struct frag_nbr *
+frag_nbr_get(const linkaddr_t *addr)
+{
+  struct frag_nbr *nbr;
+  nbr = frag_nbr_lookup(addr);
+  if(nbr != NULL) {
+    return nbr;
+  }
+  nbr = memb_alloc(&frag_nbr_memb);
+  if(nbr == NULL) {
+    return NULL;
+  }
+  memset(nbr, 0, sizeof(struct frag_nbr));
+  linkaddr_copy(&nbr->addr, addr);
+  LIST_STRUCT_INIT(nbr, datagrams);
+  nbr->etx = FRAG_QUEUE_ETX_DIVISOR;
+  list_add(frag_nbr_list, nbr);
+  return nbr;
+}
+/*--------------------------------------------------------------------*/
+/*
+ * Drop the newest unsent datagram of the next hop with the longest
+ * queue to make room for a datagram to the specified next hop. Next
+ * hops with queues that are not longer are never penalized.
+ */
+static int
+frag_queue_drop_for(struct frag_nbr *nbr)
+{
+  struct frag_nbr *n, *victim = NULL;
+  struct frag_datagram *dg, *last;
+  int len, victim_len;
+
+  victim_len = list_length(nbr->datagrams);
+  for(n = list_head(frag_nbr_list); n != NULL; n = list_item_next(n)) {
+    len = list_length(n->datagrams);
+    if(len > victim_len) {
+      victim = n;
+      victim_len = len;
+    }
+  }
+  if(victim == NULL) {
+    return 0;
+  }
+
+  last = NULL;
+  for(dg = list_head(victim->datagrams); dg != NULL; dg = list_item_next(dg)) {
+    if(dg != victim->inflight && dg->sent == 0) {
+      last = dg;
+    }
+  }
+  if(last == NULL) {
+    return 0;
+  }
+  PRINTFO("frag queue: dropping datagram with %u fragments to make room\n",
+          last->count);
+  frag_datagram_free(victim, last);
+  if(victim != nbr) {
+    frag_nbr_release(victim);
+  }
+  return 1;
+}
+/*--------------------------------------------------------------------*/
+static struct frag_datagram *
+frag_queue_new(const linkaddr_t *dest, int fragments)
+{
+  struct frag_nbr *nbr;
+  struct frag_datagram *dg;
+
+  if(fragments > FRAG_QUEUE_MAX_FRAGS) {
+    PRINTFO("frag queue: too many fragments %d, dropping packet\n", fragments);
+    return NULL;
+  }
+
+  nbr = frag_nbr_get(dest);
+  if(nbr == NULL) {
+    PRINTFO("frag queue: no free next hop, dropping packet\n");
+    return NULL;
+  }
+
+  if(list_length(nbr->datagrams) >= FRAG_QUEUE_NBR_DATAGRAMS) {
+    PRINTFO("frag queue: next hop queue full, dropping packet\n");
+    return NULL;
+  }
+
+  /* Keep one queuebuf free for non-fragmented packets */
+  while(queuebuf_numfree() - 1 < fragments) {
+    if(!frag_queue_drop_for(nbr)) {
+      PRINTFO("frag queue: not enough free bufs, dropping packet\n");
+      frag_nbr_release(nbr);
+      return NULL;
+    }
+  }
+
+  dg = memb_alloc(&frag_datagram_memb);
+  if(dg == NULL && frag_queue_drop_for(nbr)) {
+    dg = memb_alloc(&frag_datagram_memb);
+  }
+  if(dg == NULL) {
+    PRINTFO("frag queue: no free datagram, dropping packet\n");
+    frag_nbr_release(nbr);
+    return NULL;
+  }
+  dg->created = clock_time();
+  dg->count = 0;
+  dg->sent = 0;
+  return dg;
+}
+/*--------------------------------------------------------------------*/
+static struct frag_datagram *
+frag_queue_next(struct frag_nbr *nbr)
+{
+  struct frag_datagram *dg, *next;
+  int i;
+
+  /* Drop datagrams that can no longer be reassembled in time */
+  for(dg = list_head(nbr->datagrams); dg != NULL; dg = next) {
+    next = list_item_next(dg);
+    if(clock_time() - dg->created > FRAG_QUEUE_MAXAGE) {
+      PRINTFO("frag queue: dropping old datagram (%u/%u sent)\n",
+              dg->sent, dg->count);
+      frag_datagram_free(nbr, dg);
+    }
+  }
+
+  dg = list_head(nbr->datagrams);
+  if(dg == NULL) {
+    return NULL;
+  }
+  /* Round-robin among the first datagrams */
+  i = nbr->rr++ % FRAG_QUEUE_INTERLEAVE;
+  for(; i > 0; i--) {
+    next = list_item_next(dg);
+    if(next == NULL) {
+      return list_head(nbr->datagrams);
+    }
+    dg = next;
+  }
+  return dg;
+}
+/*--------------------------------------------------------------------*/
+static clock_time_t
+frag_queue_tx_timeout(void)
+{
+  clock_time_t timeout;
+  /* Allow for the confirmation delay to grow while the queues fill up */
+  timeout = FRAG_QUEUE_TX_TIMEOUT + 4 * frag_queue_tx_delay;
+  return timeout < FRAG_QUEUE_MAXAGE ? timeout : FRAG_QUEUE_MAXAGE;
+}
+/*--------------------------------------------------------------------*/
+static void
+frag_queue_sent(void *ptr, int status, int transmissions)
+{
+  struct frag_nbr *nbr;
+  uint16_t token = (uint16_t)(uintptr_t)ptr;
+  clock_time_t delay;
+  uint16_t tx;
+
+  if(status == MAC_TX_DEFERRED) {
+    /* The MAC layer will report again later */
+    return;
+  }
+
+  packet_sent(NULL, status, transmissions);
+
+  /* The next hop might have been released and reused since the send */
+  for(nbr = list_head(frag_nbr_list); nbr != NULL; nbr = list_item_next(nbr)) {
+    if(nbr->busy && nbr->token == token) {
+      break;
+    }
+  }
+  if(nbr == NULL) {
+    PRINTFO("frag queue: late tx confirmation %u\n", token);
+    return;
+  }
+  nbr->busy = 0;
+
+  delay = clock_time() - nbr->sent_at;
+  frag_queue_tx_delay = (frag_queue_tx_delay * 7 + delay) / 8;
+
+  tx = transmissions > 0 ? transmissions : 1;
+  if(status != MAC_TX_OK && tx < SICSLOWPAN_MAX_MAC_TRANSMISSIONS) {
+    tx = SICSLOWPAN_MAX_MAC_TRANSMISSIONS;
+  }
+  tx *= FRAG_QUEUE_ETX_DIVISOR;
+  if(tx > FRAG_QUEUE_ETX_MAX) {
+    tx = FRAG_QUEUE_ETX_MAX;
+  }
+  nbr->etx = (nbr->etx * 3 + tx) / 4;
+
+  if(status != MAC_TX_OK && nbr->inflight != NULL) {
+    PRINTFO("frag queue: fragment tx failed (%d), dropping datagram\n", status);
+    frag_datagram_free(nbr, nbr->inflight);
+  }
+  nbr->inflight = NULL;
+
+  ctimer_set(&nbr->timer,
+             (clock_time_t)((unsigned long)FRAG_QUEUE_GAP * nbr->etx / FRAG_QUEUE_ETX_DIVISOR),
+             frag_queue_timeout, nbr);
+}
+/*--------------------------------------------------------------------*/
+static void
+frag_queue_send(struct frag_nbr *nbr)
+{
+  struct frag_datagram *dg;
+  struct queuebuf *q;
+
+  dg = frag_queue_next(nbr);
+  if(dg == NULL) {
+    frag_nbr_release(nbr);
+    return;
+  }
+
+  q = dg->frags[dg->sent];
+  dg->frags[dg->sent] = NULL;
+  dg->sent++;
+  queuebuf_to_packetbuf(q);
+  queuebuf_free(q);
+
+  if(dg->sent < dg->count) {
+    nbr->inflight = dg;
+  } else {
+    /* Last fragment - the datagram is done */
+    frag_datagram_free(nbr, dg);
+    nbr->inflight = NULL;
+  }
+
+  /* The confirmation might be called directly by the MAC layer */
+  nbr->busy = 1;
+  if(++frag_queue_last_token == 0) {
+    frag_queue_last_token = 1;
+  }
+  nbr->token = frag_queue_last_token;
+  nbr->sent_at = clock_time();
+  ctimer_set(&nbr->timer, frag_queue_tx_timeout(), frag_queue_timeout, nbr);
+  send_packet_with_callback(&nbr->addr, frag_queue_sent,
+                            (void *)(uintptr_t)nbr->token);
+}
+/*--------------------------------------------------------------------*/
+static void
+frag_queue_timeout(void *ptr)
+{
+  struct frag_nbr *nbr = ptr;
+  if(nbr->busy) {
+    PRINTFO("frag queue: no tx confirmation, dropping datagram\n");
+    nbr->busy = 0;
+    nbr->etx = FRAG_QUEUE_ETX_MAX;
+    if(nbr->inflight != NULL) {
+      frag_datagram_free(nbr, nbr->inflight);
+    }
+  }
+  frag_queue_send(nbr);
+}
+/*--------------------------------------------------------------------*/
+static void
+frag_queue_free(const linkaddr_t *dest, struct frag_datagram *dg)
+{
+  struct frag_nbr *nbr;
+  int i;
+  for(i = 0; i < dg->count; i++) {
+    queuebuf_free(dg->frags[i]);
+  }
+  memb_free(&frag_datagram_memb, dg);
+  nbr = frag_nbr_lookup(dest);
+  if(nbr != NULL) {
+    frag_nbr_release(nbr);
+  }
+}
+/*--------------------------------------------------------------------*/
+static void
+frag_queue_add(const linkaddr_t *dest, struct frag_datagram *dg)
+{
+  struct frag_nbr *nbr;
+  /* The next hop was allocated by frag_queue_new() */
+  nbr = frag_nbr_lookup(dest);
+  if(nbr == NULL) {
+    frag_queue_free(dest, dg);
+    return;
+  }
+  list_add(nbr->datagrams, dg);
+  /* Send directly unless waiting for a confirmation or the gap */
+  if(!nbr->busy && ctimer_expired(&nbr->timer)) {
+    frag_queue_send(nbr);
+  }
+}
+#endif /* SICSLOWPAN_FRAG_QUEUE */
+/*--------------------------------------------------------------------*/
 /** \brief Take an IP packet and format it to be sent on an 802.15.4
  *  network using 6lowpan.
  *  \param localdest The MAC address of the destination
@@ -1699,6 +2458,10 @@ output(const uip_lladdr_t *localdest)
 
     struct queuebuf *q;
     uint16_t frag_tag;
+#if SICSLOWPAN_FRAG_QUEUE
+    struct frag_datagram *dg;
+    int frag1_len, fragn_len;
+#endif /* SICSLOWPAN_FRAG_QUEUE */
 
     /*
      * The outbound IPv6 packet is too large to fit into a single 15.4
@@ -1707,7 +2470,16 @@ output(const uip_lladdr_t *localdest)
      * IPv6/IPHC/HC_UDP dispatchs/headers.
      * The following fragments contain only the fragn dispatch.
      */
-#if NETSTACK_USING_QUEUEBUF
+#if SICSLOWPAN_FRAG_QUEUE
+    /* Exact number of fragments: FRAG1 + the remaining payload in FRAGN */
+    frag1_len = (max_payload - packetbuf_hdr_len - SICSLOWPAN_FRAG1_HDR_LEN) & 0xfffffff8;
+    fragn_len = (max_payload - SICSLOWPAN_FRAGN_HDR_LEN) & 0xfffffff8;
+    dg = frag_queue_new(&dest, 1 + ((int)uip_len - (int)uncomp_hdr_len - frag1_len
+                                    + fragn_len - 1) / fragn_len);
+    if(dg == NULL) {
+      return 0;
+    }
+#elif NETSTACK_USING_QUEUEBUF
     /*
      * If the underlying MAC driver uses queue buffers, drop the packet if
      * the required fragments are more than the available queue buffers.
@@ -1756,8 +2528,14 @@ output(const uip_lladdr_t *localdest)
     q = queuebuf_new_from_packetbuf();
     if(q == NULL) {
       PRINTFO("could not allocate queuebuf for first fragment, dropping packet\n");
+#if SICSLOWPAN_FRAG_QUEUE
+      frag_queue_free(&dest, dg);
+#endif /* SICSLOWPAN_FRAG_QUEUE */
       return 0;
     }
+#if SICSLOWPAN_FRAG_QUEUE
+    dg->frags[dg->count++] = q;
+#else /* SICSLOWPAN_FRAG_QUEUE */
     send_packet(&dest);
     queuebuf_to_packetbuf(q);
     queuebuf_free(q);
@@ -1770,6 +2548,7 @@ output(const uip_lladdr_t *localdest)
       PRINTFO("error in fragment tx, dropping subsequent fragments.\n");
       return 0;
     }
+#endif /* SICSLOWPAN_FRAG_QUEUE */
 
     /* set processed_ip_out_len to what we already sent from the IP payload*/
     processed_ip_out_len = packetbuf_payload_len + uncomp_hdr_len;
@@ -1802,8 +2581,22 @@ output(const uip_lladdr_t *localdest)
       q = queuebuf_new_from_packetbuf();
       if(q == NULL) {
         PRINTFO("could not allocate queuebuf, dropping fragment\n");
+#if SICSLOWPAN_FRAG_QUEUE
+        frag_queue_free(&dest, dg);
+#endif /* SICSLOWPAN_FRAG_QUEUE */
+        return 0;
+      }
+#if SICSLOWPAN_FRAG_QUEUE
+      processed_ip_out_len += packetbuf_payload_len;
+      if(dg->count >= FRAG_QUEUE_MAX_FRAGS) {
+        queuebuf_free(q);
+        frag_queue_free(&dest, dg);
         return 0;
       }
+      dg->frags[dg->count++] = q;
+    }
+    frag_queue_add(&dest, dg);
+#else /* SICSLOWPAN_FRAG_QUEUE */
       send_packet(&dest);
       queuebuf_to_packetbuf(q);
       queuebuf_free(q);
@@ -1818,6 +2611,7 @@ output(const uip_lladdr_t *localdest)
         return 0;
       }
     }
+#endif /* SICSLOWPAN_FRAG_QUEUE */
 #else /* SICSLOWPAN_CONF_FRAG */
     PRINTFO("sicslowpan output: Packet too large to be sent without fragmentation support; dropping packet\n");
     return 0;
@@ -2101,43 +2895,185 @@ sicslowpan_init(void)
  * #define SICSLOWPAN_CONF_ADDR_CONTEXT_0 {addr_contexts[0].prefix[0]=0xbb;addr_contexts[0].prefix[1]=0xbb;}
  */
 #if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
+  {
+    int i;
+    for(i = 0; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
+      addr_contexts[i].used = 0;
+      addr_contexts[i].number = i;
+      addr_contexts[i].flags = SICSLOWPAN_CONTEXT_COMPRESS;
+      addr_contexts[i].expires = 0;
+    }
+  }
   addr_contexts[0].used   = 1;
-  addr_contexts[0].number = 0;
 #ifdef SICSLOWPAN_CONF_ADDR_CONTEXT_0
   SICSLOWPAN_CONF_ADDR_CONTEXT_0;
 #else
   addr_contexts[0].prefix[0] = UIP_DS6_DEFAULT_PREFIX_0;
   addr_contexts[0].prefix[1] = UIP_DS6_DEFAULT_PREFIX_1;
 #endif
+  addr_contexts_end = 1;
 #endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0 */
 
 #if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 1
-  {
-    int i;
-    for(i = 1; i < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS; i++) {
 #ifdef SICSLOWPAN_CONF_ADDR_CONTEXT_1
-      if (i==1) {
-        addr_contexts[1].used   = 1;
-        addr_contexts[1].number = 1;
-        SICSLOWPAN_CONF_ADDR_CONTEXT_1;
+  addr_contexts[1].used   = 1;
+  SICSLOWPAN_CONF_ADDR_CONTEXT_1;
+  addr_contexts_end = 2;
+#endif /* SICSLOWPAN_CONF_ADDR_CONTEXT_1 */
+#endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 1 */
+
+#if SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 2
 #ifdef SICSLOWPAN_CONF_ADDR_CONTEXT_2
-      } else if (i==2) {
-        addr_contexts[2].used   = 1;
-        addr_contexts[2].number = 2;
-        SICSLOWPAN_CONF_ADDR_CONTEXT_2;
+  addr_contexts[2].used   = 1;
+  SICSLOWPAN_CONF_ADDR_CONTEXT_2;
+  addr_contexts_end = 3;
+#endif /* SICSLOWPAN_CONF_ADDR_CONTEXT_2 */
+#endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 2 */
+
+#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
+}
+/*--------------------------------------------------------------------*/
+int
+sicslowpan_context_set(uint8_t number, const uint8_t *prefix,
+                       uint8_t flags, unsigned long lifetime)
+{
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 && \
+  SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
+  struct sicslowpan_addr_context *c;
+  int changed;
+
+  if(number >= SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS || number > 15) {
+    return -1;
+  }
+  if(lifetime == 0) {
+    sicslowpan_context_remove(number);
+    return 1;
+  }
+
+  flags &= SICSLOWPAN_CONTEXT_COMPRESS;
+  c = &addr_contexts[number];
+  changed = addr_context_lookup_by_number(number) == NULL
+    || memcmp(c->prefix, prefix, sizeof(c->prefix)) != 0
+    || c->flags != flags;
+
+  if(changed) {
+    PRINTF("IPHC: context %u set to %02x%02x:%02x%02x:%02x%02x:%02x%02x::/64 %s\n",
+           number, prefix[0], prefix[1], prefix[2], prefix[3],
+           prefix[4], prefix[5], prefix[6], prefix[7],
+           flags & SICSLOWPAN_CONTEXT_COMPRESS ? "compress" : "decompress only");
+#if SICSLOWPAN_CONTEXT_STATS
+    if(memcmp(c->prefix, prefix, sizeof(c->prefix)) != 0) {
+      c->packets = 0;
+      c->bytes_saved = 0;
+    }
+#endif /* SICSLOWPAN_CONTEXT_STATS */
+    memcpy(c->prefix, prefix, sizeof(c->prefix));
+    c->flags = flags;
+    c->used = 1;
+  }
+  if(lifetime == SICSLOWPAN_CONTEXT_LIFETIME_INFINITE) {
+    c->expires = 0;
+  } else {
+    c->expires = clock_seconds() + lifetime;
+    if(c->expires == 0) {
+      c->expires = 1;
+    }
+  }
+  if(number >= addr_contexts_end) {
+    addr_contexts_end = number + 1;
+  }
+  return changed;
+#else
+  return -1;
 #endif
-      } else {
-        addr_contexts[i].used = 0;
-      }
+}
+/*--------------------------------------------------------------------*/
+void
+sicslowpan_context_remove(uint8_t number)
+{
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 && \
+  SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
+  if(number < SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS) {
+    PRINTF("IPHC: context %u removed\n", number);
+    addr_contexts[number].used = 0;
+  }
+#endif
+}
+/*--------------------------------------------------------------------*/
+const struct sicslowpan_addr_context *
+sicslowpan_context_get(uint8_t number)
+{
+#if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 && \
+  SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 0
+  return addr_context_lookup_by_number(number);
 #else
-      addr_contexts[i].used = 0;
-#endif /* SICSLOWPAN_CONF_ADDR_CONTEXT_1 */
-    }
+  return NULL;
+#endif
+}
+/*--------------------------------------------------------------------*/
+unsigned long
+sicslowpan_context_lifetime(const struct sicslowpan_addr_context *context)
+{
+  unsigned long now;
+
+  if(context->expires == 0) {
+    return SICSLOWPAN_CONTEXT_LIFETIME_INFINITE;
   }
-#endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 1 */
+  now = clock_seconds();
+  if((long)(context->expires - now) <= 0) {
+    return 0;
+  }
+  return context->expires - now;
+}
+#if SICSLOWPAN_IPHC_BENCHMARK && SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
+/*--------------------------------------------------------------------*/
+int
+sicslowpan_iphc_bench_compress(const linkaddr_t *link_destaddr, uint8_t fast)
+{
+  linkaddr_t dest;
 
-#endif /* SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06 */
+  uncomp_hdr_len = 0;
+  packetbuf_hdr_len = 0;
+  packetbuf_clear();
+  packetbuf_ptr = packetbuf_dataptr();
+  linkaddr_copy(&dest, link_destaddr);
+
+#if IPHC_FAST_PATH
+  iphc_fast_path = fast;
+#endif /* IPHC_FAST_PATH */
+  compress_hdr_iphc(&dest);
+#if IPHC_FAST_PATH
+  iphc_fast_path = 1;
+#endif /* IPHC_FAST_PATH */
+
+  if(uip_len - uncomp_hdr_len + packetbuf_hdr_len > PACKETBUF_SIZE) {
+    /* Would need fragmentation */
+    return -1;
+  }
+  /* Copy the payload as for an unfragmented packet */
+  memcpy(packetbuf_ptr + packetbuf_hdr_len,
+         (uint8_t *)UIP_IP_BUF + uncomp_hdr_len, uip_len - uncomp_hdr_len);
+  packetbuf_set_datalen(uip_len - uncomp_hdr_len + packetbuf_hdr_len);
+  return packetbuf_hdr_len;
+}
+/*--------------------------------------------------------------------*/
+int
+sicslowpan_iphc_bench_uncompress(uint8_t *buf, uint8_t fast)
+{
+  uncomp_hdr_len = 0;
+  packetbuf_hdr_len = 0;
+  packetbuf_ptr = packetbuf_dataptr();
+
+#if IPHC_FAST_PATH
+  iphc_fast_path = fast;
+#endif /* IPHC_FAST_PATH */
+  uncompress_hdr_iphc(buf, 0);
+#if IPHC_FAST_PATH
+  iphc_fast_path = 1;
+#endif /* IPHC_FAST_PATH */
+  return packetbuf_hdr_len;
 }
+#endif /* SICSLOWPAN_IPHC_BENCHMARK */
 /*--------------------------------------------------------------------*/
 int
 sicslowpan_get_last_rssi(void)
@@ -226,6 +226,36 @@
 /*   uint16_t udpchksum; */
 /* }; */
 
+#ifdef SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS
+#define SICSLOWPAN_MAX_ADDR_CONTEXTS SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS
+#else
+#define SICSLOWPAN_MAX_ADDR_CONTEXTS 0
+#endif
+
+/* Keep per context statistics of saved header bytes */
+#ifdef SICSLOWPAN_CONF_CONTEXT_STATS
+#define SICSLOWPAN_CONTEXT_STATS SICSLOWPAN_CONF_CONTEXT_STATS
+#else
+#define SICSLOWPAN_CONTEXT_STATS 0
+#endif
+
+/* Export the header compression for host benchmarks */
+#ifdef SICSLOWPAN_CONF_IPHC_BENCHMARK
+#define SICSLOWPAN_IPHC_BENCHMARK SICSLOWPAN_CONF_IPHC_BENCHMARK
+#else
+#define SICSLOWPAN_IPHC_BENCHMARK 0
+#endif
+
+/**
+ * \name Address context flags and lifetime
+ * @{
+ */
+/** The context may be used for compression (same bit as C in 6CO) */
+#define SICSLOWPAN_CONTEXT_COMPRESS           0x10
+/** Lifetime of contexts that never expire */
+#define SICSLOWPAN_CONTEXT_LIFETIME_INFINITE  0xffffffffUL
+/** @} */
+
 /**
  * \brief An address context for IPHC address compression
  * each context can have upto 8 bytes
@@ -234,6 +264,15 @@ struct sicslowpan_addr_context {
   uint8_t used; /* possibly use as prefix-length */
   uint8_t number;
   uint8_t prefix[8];
+  uint8_t flags;
+  /* clock_seconds() when the context expires or 0 if it never expires */
+  unsigned long expires;
+#if SICSLOWPAN_CONTEXT_STATS
+  /* packets compressed using this context */
+  uint32_t packets;
+  /* address bytes saved compared to sending the addresses inline */
+  uint32_t bytes_saved;
+#endif /* SICSLOWPAN_CONTEXT_STATS */
 };
 
 /**
@@ -332,6 +371,41 @@ struct sicslowpan_nh_compressor {
 
 int sicslowpan_get_last_rssi(void);
 
+/**
+ * \brief Add or update an address context.
+ * \param number The context number (0 - 15)
+ * \param prefix The 64 bit context prefix
+ * \param flags SICSLOWPAN_CONTEXT_COMPRESS if the context may be used
+ *              for compression, otherwise only for decompression.
+ * \param lifetime Lifetime in seconds or SICSLOWPAN_CONTEXT_LIFETIME_INFINITE
+ * \retval 1 if the context was added or changed
+ * \retval 0 if only the lifetime was updated
+ * \retval -1 if the context number is not supported
+ */
+int sicslowpan_context_set(uint8_t number, const uint8_t *prefix,
+                           uint8_t flags, unsigned long lifetime);
+void sicslowpan_context_remove(uint8_t number);
+const struct sicslowpan_addr_context *sicslowpan_context_get(uint8_t number);
+/** \brief Remaining lifetime of a context in seconds */
+unsigned long sicslowpan_context_lifetime(const struct sicslowpan_addr_context *context);
+
+#if SICSLOWPAN_IPHC_BENCHMARK
+/**
+ * \brief Compress the IP header in uip_buf into packetbuf.
+ * \param fast 0 to force the generic compression
+ * \return The compressed header length
+ */
+int sicslowpan_iphc_bench_compress(const linkaddr_t *link_destaddr, uint8_t fast);
+/**
+ * \brief Uncompress the header in packetbuf into buf.
+ *
+ * The sender and receiver addresses in packetbuf must be set.
+ * \param fast 0 to force the generic decompression
+ * \return The compressed header length
+ */
+int sicslowpan_iphc_bench_uncompress(uint8_t *buf, uint8_t fast);
+#endif /* SICSLOWPAN_IPHC_BENCHMARK */
+
 extern const struct network_driver sicslowpan_driver;
 
 /* Memory allocation for short term packet creation, etc */
@@ -89,6 +89,53 @@ typedef struct {
   uint8_t aux_sec_len;     /**<  Length (in bytes) of aux security header field */
 } field_length_t;
 
+/*
+ * Header layouts of frames without security are cached by FCF, which
+ * is all that decides the layout. Set FRAME802154_CONF_LAYOUT_CACHE_SIZE
+ * to 0 to always use the generic code.
+ */
+#ifdef FRAME802154_CONF_LAYOUT_CACHE_SIZE
+#define FRAME802154_LAYOUT_CACHE_SIZE FRAME802154_CONF_LAYOUT_CACHE_SIZE
+#else
+#define FRAME802154_LAYOUT_CACHE_SIZE 8
+#endif
+
+#if FRAME802154_LAYOUT_CACHE_SIZE > 0
+/* FCF bits that decide the layout: frame type, PAN ID compression,
+   sequence number suppression, address modes and frame version */
+#define LAYOUT_FCF_MASK 0xfd47
+
+typedef struct {
+  uint16_t fcf;
+  uint8_t hdr_len;         /**<  Header length, 0 if the entry is unused */
+  uint8_t parse;           /**<  Non-zero if the parser can use the layout */
+  uint8_t seqno_len;
+  uint8_t dest_pid_len;
+  uint8_t dest_addr_len;
+  uint8_t src_pid_len;
+  uint8_t src_addr_len;
+} frame_layout_t;
+
+static frame_layout_t layout_cache[FRAME802154_LAYOUT_CACHE_SIZE];
+
+/*
+ * The cache is also used from interrupt context, such as by TSCH, which
+ * may preempt a thread that reads or updates an entry. The sequence
+ * count is odd while an entry is updated. Readers work on a copy of the
+ * entry and drop it if the count changed, and an update is skipped when
+ * it interrupts another update.
+ */
+static volatile uint8_t layout_sequence;
+#define LAYOUT_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+#if FRAME802154_LAYOUT_BENCHMARK
+/* Allow host tests to compare with the generic code */
+static uint8_t use_layout_cache = 1;
+#else
+#define use_layout_cache 1
+#endif
+#endif /* FRAME802154_LAYOUT_CACHE_SIZE > 0 */
+
 /*----------------------------------------------------------------------------*/
 CC_INLINE static uint8_t
 addr_len(uint8_t mode)
@@ -312,19 +359,8 @@ frame802154_extract_linkaddr(frame802154_t *frame,
 }
 /*----------------------------------------------------------------------------*/
 static void
-field_len(frame802154_t *p, field_length_t *flen)
+set_panid_compression(frame802154_t *p)
 {
-  int has_src_panid;
-  int has_dest_panid;
-
-  /* init flen to zeros */
-  memset(flen, 0, sizeof(field_length_t));
-
-  /* Determine lengths of each field based on fcf and other args */
-  if((p->fcf.sequence_number_suppression & 1) == 0) {
-    flen->seqno_len = 1;
-  }
-
   /* IEEE802.15.4e changes the meaning of PAN ID Compression (see Table 2a).
    * In this case, we leave the decision whether to compress PAN ID or not
    * up to the caller. */
@@ -337,6 +373,23 @@ field_len(frame802154_t *p, field_length_t *flen)
       p->fcf.panid_compression = 0;
     }
   }
+}
+/*----------------------------------------------------------------------------*/
+static void
+field_len(frame802154_t *p, field_length_t *flen)
+{
+  int has_src_panid;
+  int has_dest_panid;
+
+  /* init flen to zeros */
+  memset(flen, 0, sizeof(field_length_t));
+
+  /* Determine lengths of each field based on fcf and other args */
+  if((p->fcf.sequence_number_suppression & 1) == 0) {
+    flen->seqno_len = 1;
+  }
+
+  set_panid_compression(p);
 
   frame802154_has_panid(&p->fcf, &has_src_panid, &has_dest_panid);
 
@@ -370,6 +423,211 @@ field_len(frame802154_t *p, field_length_t *flen)
   }
 #endif /* LLSEC802154_USES_AUX_HEADER */
 }
+#if FRAME802154_LAYOUT_CACHE_SIZE > 0
+/*----------------------------------------------------------------------------*/
+static uint16_t
+pack_fcf(const frame802154_fcf_t *fcf)
+{
+  return (fcf->frame_type & 7) |
+    ((fcf->security_enabled & 1) << 3) |
+    ((fcf->frame_pending & 1) << 4) |
+    ((fcf->ack_required & 1) << 5) |
+    ((fcf->panid_compression & 1) << 6) |
+    ((fcf->sequence_number_suppression & 1) << 8) |
+    ((fcf->ie_list_present & 1) << 9) |
+    ((fcf->dest_addr_mode & 3) << 10) |
+    ((fcf->frame_version & 3) << 12) |
+    ((fcf->src_addr_mode & 3) << 14);
+}
+/*----------------------------------------------------------------------------*/
+/*
+ * Find the layout of a frame without security, computing it the
+ * first time an FCF is seen. Returns 0 for reserved address modes,
+ * which are left to the generic code.
+ */
+static int
+get_layout(uint16_t fcf_bits, frame_layout_t *layout)
+{
+  frame_layout_t *l;
+  frame802154_fcf_t fcf;
+  uint8_t sequence;
+  int has_src_panid;
+  int has_dest_panid;
+
+  fcf_bits &= LAYOUT_FCF_MASK;
+  l = &layout_cache[(fcf_bits ^ (fcf_bits >> 9)) % FRAME802154_LAYOUT_CACHE_SIZE];
+  sequence = layout_sequence;
+  LAYOUT_BARRIER();
+  if((sequence & 1) == 0) {
+    *layout = *l;
+    LAYOUT_BARRIER();
+    if(layout->hdr_len != 0 && layout->fcf == fcf_bits
+       && layout_sequence == sequence) {
+      return 1;
+    }
+  }
+
+  memset(&fcf, 0, sizeof(fcf));
+  fcf.frame_type = fcf_bits & 7;
+  fcf.panid_compression = (fcf_bits >> 6) & 1;
+  fcf.sequence_number_suppression = (fcf_bits >> 8) & 1;
+  fcf.dest_addr_mode = (fcf_bits >> 10) & 3;
+  fcf.frame_version = (fcf_bits >> 12) & 3;
+  fcf.src_addr_mode = (fcf_bits >> 14) & 3;
+  if(fcf.dest_addr_mode == 1 || fcf.src_addr_mode == 1) {
+    return 0;
+  }
+
+  frame802154_has_panid(&fcf, &has_src_panid, &has_dest_panid);
+  layout->fcf = fcf_bits;
+  layout->seqno_len = fcf.sequence_number_suppression ? 0 : 1;
+  layout->dest_pid_len = has_dest_panid ? 2 : 0;
+  layout->dest_addr_len = addr_len(fcf.dest_addr_mode);
+  layout->src_pid_len = has_src_panid ? 2 : 0;
+  layout->src_addr_len = addr_len(fcf.src_addr_mode);
+  /* The parser only reads a PAN ID that is followed by an address */
+  layout->parse = (layout->dest_pid_len == 0 || layout->dest_addr_len != 0) &&
+    (layout->src_pid_len == 0 || layout->src_addr_len != 0);
+  layout->hdr_len = 2 + layout->seqno_len + layout->dest_pid_len +
+    layout->dest_addr_len + layout->src_pid_len + layout->src_addr_len;
+
+  /* Store the layout, marking the entry unused until it is complete */
+  sequence = layout_sequence;
+  if((sequence & 1) == 0) {
+    layout_sequence = sequence + 1;
+    LAYOUT_BARRIER();
+    l->hdr_len = 0;
+    LAYOUT_BARRIER();
+    l->fcf = layout->fcf;
+    l->parse = layout->parse;
+    l->seqno_len = layout->seqno_len;
+    l->dest_pid_len = layout->dest_pid_len;
+    l->dest_addr_len = layout->dest_addr_len;
+    l->src_pid_len = layout->src_pid_len;
+    l->src_addr_len = layout->src_addr_len;
+    LAYOUT_BARRIER();
+    l->hdr_len = layout->hdr_len;
+    LAYOUT_BARRIER();
+    layout_sequence = sequence + 2;
+  }
+  return 1;
+}
+/*----------------------------------------------------------------------------*/
+static CC_INLINE uint8_t *
+write_addr(uint8_t *buf, const uint8_t *addr, uint8_t len)
+{
+  if(len == 8) {
+    buf[0] = addr[7];
+    buf[1] = addr[6];
+    buf[2] = addr[5];
+    buf[3] = addr[4];
+    buf[4] = addr[3];
+    buf[5] = addr[2];
+    buf[6] = addr[1];
+    buf[7] = addr[0];
+  } else if(len == 2) {
+    buf[0] = addr[1];
+    buf[1] = addr[0];
+  }
+  return buf + len;
+}
+/*----------------------------------------------------------------------------*/
+static CC_INLINE const uint8_t *
+read_addr(uint8_t *addr, const uint8_t *buf, uint8_t len)
+{
+  if(len == 8) {
+    addr[0] = buf[7];
+    addr[1] = buf[6];
+    addr[2] = buf[5];
+    addr[3] = buf[4];
+    addr[4] = buf[3];
+    addr[5] = buf[2];
+    addr[6] = buf[1];
+    addr[7] = buf[0];
+  } else {
+    linkaddr_copy((linkaddr_t *)addr, &linkaddr_null);
+    if(len == 2) {
+      addr[0] = buf[1];
+      addr[1] = buf[0];
+    }
+  }
+  return buf + len;
+}
+/*----------------------------------------------------------------------------*/
+static int
+create_layout(frame802154_t *p, uint8_t *buf, int buf_len,
+              uint16_t fcf_bits, const frame_layout_t *l)
+{
+  uint8_t *pos;
+
+  if(l->hdr_len > buf_len) {
+    return 0;
+  }
+
+  buf[0] = fcf_bits & 0xff;
+  buf[1] = fcf_bits >> 8;
+  pos = buf + 2;
+  if(l->seqno_len) {
+    *pos++ = p->seq;
+  }
+  if(l->dest_pid_len) {
+    *pos++ = p->dest_pid & 0xff;
+    *pos++ = p->dest_pid >> 8;
+  }
+  pos = write_addr(pos, p->dest_addr, l->dest_addr_len);
+  if(l->src_pid_len) {
+    *pos++ = p->src_pid & 0xff;
+    *pos++ = p->src_pid >> 8;
+  }
+  write_addr(pos, p->src_addr, l->src_addr_len);
+  return l->hdr_len;
+}
+/*----------------------------------------------------------------------------*/
+static int
+parse_layout(uint8_t *data, int len, frame802154_t *pf,
+             const frame_layout_t *l)
+{
+  const uint8_t *p;
+
+  p = data + 2;
+  if(l->seqno_len) {
+    pf->seq = *p++;
+  }
+
+  if(l->dest_addr_len) {
+    if(l->dest_pid_len) {
+      pf->dest_pid = p[0] + (p[1] << 8);
+      p += 2;
+    } else {
+      pf->dest_pid = 0;
+    }
+    p = read_addr(pf->dest_addr, p, l->dest_addr_len);
+  } else {
+    linkaddr_copy((linkaddr_t *)&(pf->dest_addr), &linkaddr_null);
+    pf->dest_pid = 0;
+  }
+
+  if(l->src_addr_len) {
+    if(l->src_pid_len) {
+      pf->src_pid = p[0] + (p[1] << 8);
+      p += 2;
+      if(!l->dest_pid_len) {
+        pf->dest_pid = pf->src_pid;
+      }
+    } else {
+      pf->src_pid = pf->dest_pid;
+    }
+    read_addr(pf->src_addr, p, l->src_addr_len);
+  } else {
+    linkaddr_copy((linkaddr_t *)&(pf->src_addr), &linkaddr_null);
+    pf->src_pid = 0;
+  }
+
+  pf->payload_len = len - l->hdr_len;
+  pf->payload = data + l->hdr_len;
+  return l->hdr_len;
+}
+#endif /* FRAME802154_LAYOUT_CACHE_SIZE > 0 */
 /*----------------------------------------------------------------------------*/
 /**
  *   \brief Calculates the length of the frame header.  This function is
@@ -384,6 +642,16 @@ int
 frame802154_hdrlen(frame802154_t *p)
 {
   field_length_t flen;
+#if FRAME802154_LAYOUT_CACHE_SIZE > 0
+  frame_layout_t layout;
+
+  if(use_layout_cache && (p->fcf.security_enabled & 1) == 0) {
+    set_panid_compression(p);
+    if(get_layout(pack_fcf(&p->fcf), &layout)) {
+      return layout.hdr_len;
+    }
+  }
+#endif /* FRAME802154_LAYOUT_CACHE_SIZE > 0 */
   field_len(p, &flen);
   return 2 + flen.seqno_len + flen.dest_pid_len + flen.dest_addr_len +
          flen.src_pid_len + flen.src_addr_len + flen.aux_sec_len;
@@ -411,6 +679,18 @@ frame802154_create(frame802154_t *p, uint8_t *buf, int buf_len)
 #if LLSEC802154_USES_EXPLICIT_KEYS
   uint8_t key_id_mode;
 #endif /* LLSEC802154_USES_EXPLICIT_KEYS */
+#if FRAME802154_LAYOUT_CACHE_SIZE > 0
+  frame_layout_t layout;
+  uint16_t fcf_bits;
+
+  if(use_layout_cache && (p->fcf.security_enabled & 1) == 0) {
+    set_panid_compression(p);
+    fcf_bits = pack_fcf(&p->fcf);
+    if(get_layout(fcf_bits, &layout)) {
+      return create_layout(p, buf, buf_len, fcf_bits, &layout);
+    }
+  }
+#endif /* FRAME802154_LAYOUT_CACHE_SIZE > 0 */
 
   field_len(p, &flen);
 
@@ -515,6 +795,9 @@ frame802154_parse(uint8_t *data, int len, frame802154_t *pf)
 #if LLSEC802154_USES_EXPLICIT_KEYS
   uint8_t key_id_mode;
 #endif /* LLSEC802154_USES_EXPLICIT_KEYS */
+#if FRAME802154_LAYOUT_CACHE_SIZE > 0
+  frame_layout_t layout;
+#endif /* FRAME802154_LAYOUT_CACHE_SIZE > 0 */
 
   if(len < 2) {
     return 0;
@@ -537,6 +820,16 @@ frame802154_parse(uint8_t *data, int len, frame802154_t *pf)
 
   /* copy fcf and seqNum */
   memcpy(&pf->fcf, &fcf, sizeof(frame802154_fcf_t));
+
+#if FRAME802154_LAYOUT_CACHE_SIZE > 0
+  if(use_layout_cache && fcf.security_enabled == 0) {
+    if(get_layout(p[0] | (p[1] << 8), &layout)
+       && layout.parse && layout.hdr_len <= len) {
+      return parse_layout(data, len, pf, &layout);
+    }
+  }
+#endif /* FRAME802154_LAYOUT_CACHE_SIZE > 0 */
+
   p += 2;                             /* Skip first two bytes */
 
   if(fcf.sequence_number_suppression == 0) {
@@ -654,4 +947,14 @@ frame802154_parse(uint8_t *data, int len, frame802154_t *pf)
   /* return header length if successful */
   return c > len ? 0 : c;
 }
+#if FRAME802154_LAYOUT_BENCHMARK
+/*----------------------------------------------------------------------------*/
+void
+frame802154_set_layout_cache(uint8_t enabled)
+{
+#if FRAME802154_LAYOUT_CACHE_SIZE > 0
+  use_layout_cache = enabled;
+#endif /* FRAME802154_LAYOUT_CACHE_SIZE > 0 */
+}
+#endif /* FRAME802154_LAYOUT_BENCHMARK */
 /** \}   */
@@ -86,6 +86,13 @@
 #define FRAME802154_SUPPR_SEQNO 0
 #endif /* FRAME802154_CONF_SUPPR_SEQNO */
 
+/* Allow host tests to switch off the header layout cache */
+#ifdef FRAME802154_CONF_LAYOUT_BENCHMARK
+#define FRAME802154_LAYOUT_BENCHMARK FRAME802154_CONF_LAYOUT_BENCHMARK
+#else /* FRAME802154_CONF_LAYOUT_BENCHMARK */
+#define FRAME802154_LAYOUT_BENCHMARK 0
+#endif /* FRAME802154_CONF_LAYOUT_BENCHMARK */
+
 /* Macros & Defines */
 
 /** \brief These are some definitions of values used in the FCF.  See the 802.15.4 spec for details.
@@ -235,6 +242,10 @@ int frame802154_check_dest_panid(frame802154_t *frame);
 int frame802154_is_broadcast_addr(uint8_t mode, uint8_t *addr);
 /* Check and extract source and destination linkaddr from frame */
 int frame802154_extract_linkaddr(frame802154_t *frame, linkaddr_t *source_address, linkaddr_t *dest_address);
+#if FRAME802154_LAYOUT_BENCHMARK
+/* Use the header layout cache (non-zero) or the generic code (0) */
+void frame802154_set_layout_cache(uint8_t enabled);
+#endif /* FRAME802154_LAYOUT_BENCHMARK */
 
 /** @} */
 #endif /* FRAME_802154_H */
@@ -53,6 +53,16 @@
 #define HANDLER_802154_ACTIVE_SCAN_TIME ((CLOCK_SECOND * 6) / 10)
 #endif /* HANDLER_802154_CONF_ACTIVE_SCAN_TIME */
 
+/*
+ * A channel is left early when no more beacons have been received
+ * within this time after the last beacon. Zero disables.
+ */
+#ifdef HANDLER_802154_CONF_ACTIVE_SCAN_QUIET_TIME
+#define HANDLER_802154_ACTIVE_SCAN_QUIET_TIME HANDLER_802154_CONF_ACTIVE_SCAN_QUIET_TIME
+#else /* HANDLER_802154_CONF_ACTIVE_SCAN_QUIET_TIME */
+#define HANDLER_802154_ACTIVE_SCAN_QUIET_TIME (CLOCK_SECOND / 5)
+#endif /* HANDLER_802154_CONF_ACTIVE_SCAN_QUIET_TIME */
+
 #ifndef HANDLER_802154_DISABLE_RANDOM_CHANNEL
 #define HANDLER_802154_DISABLE_RANDOM_CHANNEL 0
 #endif /* HANDLER_802154_DISABLE_RANDOM_CHANNEL */
@@ -72,10 +82,12 @@ static int last_channel = 0;
 static uint8_t chseqno = 0;
 static int scan = 0; /* flag if scan is already active */
 static struct ctimer scan_timer;
+static clock_time_t scan_time;
 static struct ctimer beacon_send_timer;
 
 static void handle_beacon(frame802154_t *frame);
 static void handle_beacon_send_timer(void *p);
+static void handle_scan_timer(void *p);
 static scan_callback_t callback;
 static uint8_t beacon_payload[HANDLER_802154_BEACON_PAYLOAD_BUFFER_SIZE] = { 0xfe, 0x00 };
 static uint8_t beacon_payload_len = 0;
@@ -83,10 +95,9 @@ static int others_beacon_reply;
 
 static net_control_key_t net_key;
 
-#if (HANDLER_802154_DISABLE_RANDOM_CHANNEL == 0)
-uint8_t channel_list[CHANNEL_HIGH - CHANNEL_LOW + 1];
-uint8_t channel_index;
-#endif /* (HANDLER_802154_DISABLE_RANDOM_CHANNEL == 0) */
+static uint8_t channel_list[CHANNEL_HIGH - CHANNEL_LOW + 1];
+static uint8_t channel_count;
+static uint8_t channel_index;
 /*---------------------------------------------------------------------------*/
 /* the init function assumes that the framer 802.15.4 is active and
    used */
@@ -138,8 +149,17 @@ handle_beacon(frame802154_t *frame)
     if(callback(value, frame, CALLBACK_ACTION_RX) == CALLBACK_STATUS_FINISHED) {
       /* scan is over - application is satisfied */
       end_scan();
+      return;
     }
   }
+
+  /* Leave the channel early if no more beacons arrive */
+  if(HANDLER_802154_ACTIVE_SCAN_QUIET_TIME > 0 && scan > 1 &&
+     !ctimer_expired(&scan_timer) &&
+     timer_remaining(&scan_timer.etimer.timer) > HANDLER_802154_ACTIVE_SCAN_QUIET_TIME) {
+    ctimer_set(&scan_timer, HANDLER_802154_ACTIVE_SCAN_QUIET_TIME,
+               &handle_scan_timer, callback);
+  }
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -255,98 +275,102 @@ handle_scan_timer(void *p)
       end_scan();
       return;
     } else if(callback_status == CALLBACK_STATUS_NEED_MORE_TIME) {
-      ctimer_reset(&scan_timer);
+      ctimer_set(&scan_timer, scan_time, &handle_scan_timer, callback);
       return;
     }
   }
 
   scan++;
 
-#if HANDLER_802154_DISABLE_RANDOM_CHANNEL
-  if(current_channel == CHANNEL_HIGH) {
-    /* Last channel has been scanned. Report that the process is over. */
-    end_scan();
-    return;
-  }
-
-  if(current_channel == 0) {
-    current_channel = CHANNEL_LOW;
-    last_channel == CHANNEL_HIGH;
-  } else {
-    current_channel++;
-  }
-#else /* HANDLER_802154_DISABLE_RANDOM_CHANNEL */
-  if(channel_index > (CHANNEL_HIGH - CHANNEL_LOW)) {
+  if(channel_index >= channel_count) {
     /* Last channel has been scanned. Report that the process is over. */
     end_scan();
     return;
   }
-
-  if(current_channel == 0) {
-    /* new scan, randomize channels */
-    int i;
-    int j;
-    channel_index = 0;
-
-    /* Initialize a random list as shown by Durstenfelds' Fisher–Yates shuffle. */
-    for(i = 0; i <= (CHANNEL_HIGH - CHANNEL_LOW); i++) {
-      j = random_rand() % (i + 1);
-      if(j != i) {
-        channel_list[i] = channel_list[j];
-      }
-      channel_list[j] = i + CHANNEL_LOW;
-    }
-    last_channel = channel_list[(CHANNEL_HIGH - CHANNEL_LOW)];
-#if 0
-    printf("New netscan search: channel order: ");
-    for(i = 0; i <= (CHANNEL_HIGH - CHANNEL_LOW); i++) {
-      printf("%d ", channel_list[i]);
-    }
-    printf("\n");
-#endif /* 0 */
-  }
   current_channel = channel_list[channel_index++];
-#endif /* HANDLER_802154_DISABLE_RANDOM_CHANNEL */
 
   NETSTACK_RADIO.set_value(RADIO_PARAM_RX_MODE, 0);
   NETSTACK_RADIO.set_value(RADIO_PARAM_CHANNEL, current_channel);
 
   handler_802154_send_beacon_request();
 
-  ctimer_reset(&scan_timer);
+  ctimer_set(&scan_timer, scan_time, &handle_scan_timer, callback);
 }
 /*---------------------------------------------------------------------------*/
 /*
- * active scan - will scan all 16 channels in the 802.15.4 network
+ * Active scan of the specified channels in the specified order, with
+ * "time" spent on each channel. All 16 channels in the 802.15.4
+ * network are scanned if no channels are specified.
  * NOTE: this assumes 16 channels, starting from 11. Needs to be changed
  * if running on other than 2.4 GHz
  */
 int
-handler_802154_active_scan(scan_callback_t cb)
+handler_802154_active_scan_channels(scan_callback_t cb,
+                                    const uint8_t *channels, uint8_t count,
+                                    clock_time_t time)
 {
+  int i;
+
   if(net_key == NET_CONTROL_KEY_NONE) {
     net_key = net_control_alloc_key();
   }
 
   /* if no scan is active - start one */
   if(!scan) {
+    if(channels != NULL && count > 0) {
+      channel_count = 0;
+      for(i = 0; i < count && channel_count < sizeof(channel_list); i++) {
+        if(channels[i] >= CHANNEL_LOW && channels[i] <= CHANNEL_HIGH) {
+          channel_list[channel_count++] = channels[i];
+        }
+      }
+      if(channel_count == 0) {
+        return 0;
+      }
+    } else {
+      channel_count = CHANNEL_HIGH - CHANNEL_LOW + 1;
+#if HANDLER_802154_DISABLE_RANDOM_CHANNEL
+      for(i = 0; i < channel_count; i++) {
+        channel_list[i] = i + CHANNEL_LOW;
+      }
+#else /* HANDLER_802154_DISABLE_RANDOM_CHANNEL */
+      /* Initialize a random list as shown by Durstenfelds' Fisher–Yates shuffle. */
+      for(i = 0; i < channel_count; i++) {
+        int j = random_rand() % (i + 1);
+        if(j != i) {
+          channel_list[i] = channel_list[j];
+        }
+        channel_list[j] = i + CHANNEL_LOW;
+      }
+#endif /* HANDLER_802154_DISABLE_RANDOM_CHANNEL */
+    }
+    last_channel = channel_list[channel_count - 1];
+
     callback = cb;
+    scan_time = time;
     current_channel = 0;
-#if (HANDLER_802154_DISABLE_RANDOM_CHANNEL == 0)
     channel_index = 0;
-#endif /* (HANDLER_802154_DISABLE_RANDOM_CHANNEL == 0) */
     scan = 1;
     /* suppress beacons during scan */
     net_control_set(NET_CONTROL_SUPPRESS_BEACON, net_key, 1);
     chseqno = frame802154_next_seqno();
     NETSTACK_RADIO.set_value(RADIO_PARAM_RX_MODE, 0);
-    ctimer_set(&scan_timer, HANDLER_802154_ACTIVE_SCAN_TIME,
-               &handle_scan_timer, callback);
+    ctimer_set(&scan_timer, scan_time, &handle_scan_timer, callback);
     return 1;
   }
   return 0;
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * active scan - will scan all 16 channels in the 802.15.4 network
+ */
+int
+handler_802154_active_scan(scan_callback_t cb)
+{
+  return handler_802154_active_scan_channels(cb, NULL, 0,
+                                             HANDLER_802154_ACTIVE_SCAN_TIME);
+}
+/*---------------------------------------------------------------------------*/
 int
 handler_802154_frame_received(frame802154_t *frame)
 {
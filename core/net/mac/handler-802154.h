@@ -60,6 +60,9 @@ typedef int (* scan_callback_t)(int channel, frame802154_t *frame,
 void handler_802154_join(uint16_t panid);
 
 int handler_802154_active_scan(scan_callback_t callback);
+int handler_802154_active_scan_channels(scan_callback_t callback,
+                                        const uint8_t *channels, uint8_t count,
+                                        clock_time_t time);
 int handler_802154_set_beacon_payload(const uint8_t *payload, uint8_t len);
 uint8_t *handler_802154_get_beacon_payload(uint8_t *len);
 void handler_802154_send_beacon_request(void);
@@ -62,6 +62,50 @@
 #endif /* TSCH_LOG_LEVEL */
 #include "net/net-debug.h"
 
+/*
+ * Decode EACKs with only the time correction IE, as sent by
+ * tsch_packet_create_eack(), without the generic IE parser.
+ */
+#ifdef TSCH_PACKET_CONF_FAST_PARSE
+#define TSCH_PACKET_FAST_PARSE TSCH_PACKET_CONF_FAST_PARSE
+#else
+#define TSCH_PACKET_FAST_PARSE 1
+#endif
+
+/* Header IE descriptor of the ACK/NACK time correction IE (id 0x1e, length 2) */
+#define ACK_NACK_TIME_CORRECTION_IE ((0x1e << 7) | 2)
+
+#if TSCH_PACKET_FAST_PARSE
+/*---------------------------------------------------------------------------*/
+/*
+ * Parse the information elements of an EACK. EACKs with only the time
+ * correction IE, as sent by tsch_packet_create_eack(), are decoded
+ * directly.
+ */
+static int
+parse_eack_ies(const uint8_t *buf, int len, struct ieee802154_ies *ies)
+{
+  uint16_t time_sync_field;
+  int16_t drift_us;
+
+  if(len != 4 ||
+     buf[0] != (ACK_NACK_TIME_CORRECTION_IE & 0xff) ||
+     buf[1] != (ACK_NACK_TIME_CORRECTION_IE >> 8)) {
+    return frame802154e_parse_information_elements(buf, len, ies);
+  }
+  if(ies != NULL) {
+    time_sync_field = buf[2] | (buf[3] << 8);
+    drift_us = time_sync_field & 0x0fff;
+    if(drift_us & 0x0800) {
+      /* Negative drift, add the sign bits */
+      drift_us |= 0xf000;
+    }
+    ies->ie_time_correction = drift_us;
+    ies->ie_is_nack = (time_sync_field & 0x8000) != 0;
+  }
+  return len;
+}
+#endif /* TSCH_PACKET_FAST_PARSE */
 /*---------------------------------------------------------------------------*/
 /* Construct enhanced ACK packet and return ACK length */
 int
@@ -174,7 +218,12 @@ tsch_packet_parse_eack(const uint8_t *buf, int buf_size,
     }
 #endif /* LLSEC802154_ENABLED */
     /* Parse information elements. We need to substract the MIC length, as the exact payload len is needed while parsing */
-    if((ret = frame802154e_parse_information_elements(buf + curr_len, buf_size - curr_len - mic_len, ies)) == -1) {
+#if TSCH_PACKET_FAST_PARSE
+    ret = parse_eack_ies(buf + curr_len, buf_size - curr_len - mic_len, ies);
+#else /* TSCH_PACKET_FAST_PARSE */
+    ret = frame802154e_parse_information_elements(buf + curr_len, buf_size - curr_len - mic_len, ies);
+#endif /* TSCH_PACKET_FAST_PARSE */
+    if(ret == -1) {
       return 0;
     }
     curr_len += ret;
@@ -372,7 +372,6 @@ rpl_set_root_with_version(uint8_t instance_id, uip_ipaddr_t *dag_id,
   rpl_instance_t *instance;
   int i;
 
-  version = RPL_LOLLIPOP_INIT;
   instance = rpl_get_instance(instance_id);
   if(instance != NULL) {
     for(i = 0; i < RPL_MAX_DAG_PER_INSTANCE; ++i) {
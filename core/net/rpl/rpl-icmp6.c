@@ -56,6 +56,9 @@
 #include "net/net-control.h"
 #include "net/ipv6/multicast/uip-mcast6.h"
 #include "random.h"
+#if RPL_WITH_6CO
+#include "net/ipv6/sicslowpan.h"
+#endif /* RPL_WITH_6CO */
 
 #include <limits.h>
 #include <string.h>
@@ -278,6 +281,88 @@ dis_output(uip_ipaddr_t *addr)
   uip_icmp6_send(addr, ICMP6_RPL, RPL_CODE_DIS, 2);
 }
 /*---------------------------------------------------------------------------*/
+#if RPL_WITH_6CO
+/*
+ * 6CO: | Context Length | Res | C | CID | Reserved | Valid Lifetime |
+ * followed by the context prefix. Only 64 bit contexts are supported.
+ */
+#define RPL_6CO_LEN 14
+static void
+dio_6co_input(const rpl_dio_t *dio, unsigned char *opt, int len)
+{
+  rpl_dag_t *dag;
+  const struct sicslowpan_addr_context *context;
+  uint8_t cid;
+  uint16_t lifetime;
+
+  /*
+   * Only learn the contexts of the DAG that has been joined, never on
+   * the root. Called after the DIO has been processed, which is when a
+   * node without DAG joins.
+   */
+  dag = rpl_get_any_dag();
+  if(dag == NULL || dag->rank == ROOT_RANK(dag->instance) ||
+     !uip_ipaddr_cmp(&dag->dag_id, &dio->dag_id)) {
+    return;
+  }
+  if(len < RPL_6CO_LEN || opt[0] != 64) {
+    PRINTF("RPL: Unsupported 6CO option, len %d\n", len);
+    return;
+  }
+  cid = opt[1] & 0x0f;
+  lifetime = get16(opt, 4);
+
+  /* Contexts configured without lifetime are never replaced */
+  context = sicslowpan_context_get(cid);
+  if(context != NULL &&
+     sicslowpan_context_lifetime(context) == SICSLOWPAN_CONTEXT_LIFETIME_INFINITE) {
+    return;
+  }
+
+  if(sicslowpan_context_set(cid, &opt[6], opt[1] & SICSLOWPAN_CONTEXT_COMPRESS,
+                            lifetime * 60UL) > 0) {
+    /* Tell the rest of the PAN about the new context */
+    rpl_reset_dio_timer(dag->instance);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+dio_6co_output(unsigned char *buffer, int pos)
+{
+  const struct sicslowpan_addr_context *context;
+  unsigned long lifetime;
+  int i;
+
+  /* Contexts without lifetime are configured on all nodes */
+  for(i = 0; i < SICSLOWPAN_MAX_ADDR_CONTEXTS; i++) {
+    context = sicslowpan_context_get(i);
+    if(context == NULL) {
+      continue;
+    }
+    lifetime = sicslowpan_context_lifetime(context);
+    if(lifetime == SICSLOWPAN_CONTEXT_LIFETIME_INFINITE || lifetime == 0) {
+      continue;
+    }
+    /* The valid lifetime is in minutes */
+    lifetime = (lifetime + 59) / 60;
+    if(lifetime > 0xffff) {
+      lifetime = 0xffff;
+    }
+    buffer[pos++] = RPL_OPTION_6CO;
+    buffer[pos++] = 14;
+    buffer[pos++] = 64;
+    buffer[pos++] = (context->flags & SICSLOWPAN_CONTEXT_COMPRESS) | context->number;
+    buffer[pos++] = 0; /* reserved */
+    buffer[pos++] = 0;
+    set16(buffer, pos, lifetime);
+    pos += 2;
+    memcpy(&buffer[pos], context->prefix, 8);
+    pos += 8;
+  }
+  return pos;
+}
+#endif /* RPL_WITH_6CO */
+/*---------------------------------------------------------------------------*/
 static void
 dio_input(void)
 {
@@ -288,6 +373,11 @@ dio_input(void)
   int i;
   int len;
   uip_ipaddr_t from;
+#if RPL_WITH_6CO
+  unsigned char co[SICSLOWPAN_MAX_ADDR_CONTEXTS][RPL_6CO_LEN];
+  uint8_t co_len[SICSLOWPAN_MAX_ADDR_CONTEXTS];
+  int co_count = 0;
+#endif /* RPL_WITH_6CO */
 
   memset(&dio, 0, sizeof(dio));
 
@@ -452,6 +542,16 @@ dio_input(void)
       PRINTF("RPL: Copying prefix information\n");
       memcpy(&dio.prefix_info.prefix, &buffer[i + 16], 16);
       break;
+#if RPL_WITH_6CO
+    case RPL_OPTION_6CO:
+      /* Handled once it is known if the DIO is from the joined DAG */
+      if(co_count < SICSLOWPAN_MAX_ADDR_CONTEXTS) {
+        co_len[co_count] = len - 2 < RPL_6CO_LEN ? len - 2 : RPL_6CO_LEN;
+        memcpy(co[co_count], &buffer[i + 2], co_len[co_count]);
+        co_count++;
+      }
+      break;
+#endif /* RPL_WITH_6CO */
     default:
       PRINTF("RPL: Unsupported suboption type in DIO: %u\n",
 	(unsigned)subopt_type);
@@ -464,6 +564,12 @@ dio_input(void)
 
   rpl_process_dio(&from, &dio);
 
+#if RPL_WITH_6CO
+  for(i = 0; i < co_count; i++) {
+    dio_6co_input(&dio, co[i], co_len[i]);
+  }
+#endif /* RPL_WITH_6CO */
+
  discard:
   uip_clear_buf();
 }
@@ -600,6 +706,10 @@ dio_output(rpl_instance_t *instance, uip_ipaddr_t *uc_addr)
            dag->prefix_info.length);
   }
 
+#if RPL_WITH_6CO
+  pos = dio_6co_output(buffer, pos);
+#endif /* RPL_WITH_6CO */
+
 #if RPL_LEAF_ONLY
 #if (DEBUG) & DEBUG_PRINT
   if(uc_addr == NULL) {
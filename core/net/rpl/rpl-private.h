@@ -90,6 +90,23 @@
 #define RPL_OPTION_PREFIX_INFO           8
 #define RPL_OPTION_TARGET_DESC           9
 
+/* There is no RPL option assigned for 6LoWPAN contexts - the 6CO
+   option (RFC 6775) is carried in the DIO using its ND option type */
+#ifdef RPL_CONF_OPTION_6CO
+#define RPL_OPTION_6CO                   RPL_CONF_OPTION_6CO
+#else
+#define RPL_OPTION_6CO                   34
+#endif
+
+/* Distribute 6LoWPAN address contexts in DIOs */
+#ifdef RPL_CONF_WITH_6CO
+#define RPL_WITH_6CO                     RPL_CONF_WITH_6CO
+#elif defined(SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS)
+#define RPL_WITH_6CO                     (SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS > 1)
+#else
+#define RPL_WITH_6CO                     0
+#endif
+
 #define RPL_DAO_K_FLAG                   0x80 /* DAO ACK requested */
 #define RPL_DAO_D_FLAG                   0x40 /* DODAG ID present */
 
@@ -54,6 +54,7 @@
 #include "dev/rfcore-xreg.h"
 #include "lib/random.h"
 #include "dev/radio-802154-dev.h"
+#include "lib/instrument.h"
 
 #include <string.h>
 /*---------------------------------------------------------------------------*/
@@ -273,7 +274,7 @@ write_to_rxbuf(void)
 
   } else {
 
-    rx_buf = radio_802154_get_writebuf(&radio_dev);
+    rx_buf = radio_802154_get_writebuf_len(&radio_dev, len);
     if(rx_buf == NULL) {
       PRINTF("no buffer - flush and give up\n");
       /* Give up and flush? */
@@ -320,6 +321,7 @@ write_to_rxbuf(void)
   /* MS bit CRC OK/Not OK, 7 LS Bits, Correlation value */
   if((crc_corr & CRC_BIT_MASK) == 0) {
     RIMESTATS_ADD(badcrc);
+    INSTRUMENT_LINK_CRC_ERROR();
     PRINTF("RF: Bad CRC\n");
     CC2538_RF_CSP_ISFLUSHRX();
 
@@ -1104,6 +1106,7 @@ read_poll_mode(void *buf, unsigned short bufsize)
     RIMESTATS_ADD(llrx);
   } else {
     RIMESTATS_ADD(badcrc);
+    INSTRUMENT_LINK_CRC_ERROR();
     PRINTF("RF: Bad CRC\n");
     CC2538_RF_CSP_ISFLUSHRX();
     return 0;
@@ -1526,4 +1529,10 @@ cc2538_rf_set_central_freq(uint8_t frequency)
   return set_frequency(frequency);
 }
 /*---------------------------------------------------------------------------*/
+const struct radio_802154_rx_stats *
+cc2538_rf_get_rx_stats(void)
+{
+  return radio_802154_get_rx_stats(&radio_dev);
+}
+/*---------------------------------------------------------------------------*/
 /** @} */
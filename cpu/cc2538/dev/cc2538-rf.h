@@ -191,6 +191,14 @@ int8_t cc2538_rf_set_central_freq(uint8_t freq);
  */
 uint8_t cc2538_rf_get_central_freq(void);
 /*---------------------------------------------------------------------------*/
+/**
+ * \brief Read the statistics of the RX frame ring.
+ *
+ * Returns the high water marks and drop counters of the received
+ * frames, see radio_802154_get_rx_stats().
+ */
+const struct radio_802154_rx_stats *cc2538_rf_get_rx_stats(void);
+/*---------------------------------------------------------------------------*/
 #endif /* CC2538_RF_H__ */
 
 /**
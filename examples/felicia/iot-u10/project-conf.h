@@ -61,6 +61,7 @@ uint32_t INSTANCE_TEMPERATURE_ARCH_INIT(void);
 /* Network statistics */
 #define RPL_CONF_STATS 1
 /* #define HANDLER_802154_CONF_STATS 1 */
+#define NETSCAN_CONF_STATS 1
 
 /* #define RPL_CALLBACK_PARENT_SWITCH \ */
 /*   instance_nstats_preferred_parent_callback */
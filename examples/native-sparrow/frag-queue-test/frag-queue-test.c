@@ -0,0 +1,473 @@
+/*
+ * Copyright (c) 2016, Yanzi Networks AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *    3. Neither the name of the copyright holders nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Host test of the 6LoWPAN per next hop fragment queue.
+ *
+ *         Datagrams are sent through sicslowpan and the fragments are
+ *         recorded by a test RDC, which confirms them after a delay
+ *         that is set per next hop. The test checks the round-robin
+ *         interleave, that datagrams are only dropped whole, and that
+ *         late confirmations and slow links are handled.
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ip/tcpip.h"
+#include "net/ipv6/sicslowpan.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/mac/mac.h"
+#include "net/netstack.h"
+#include "net/packetbuf.h"
+#include "net/queuebuf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UIP_IP_BUF ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+#define DATAGRAM_LEN      400
+#define MAX_NODES         16
+#define MAX_DATAGRAMS     32
+#define MAX_CONFIRMATIONS 16
+
+/* Confirmation delay of most next hops */
+#define CONFIRM_DELAY     (CLOCK_SECOND / 200)
+
+/* How the test RDC confirms the fragments to a next hop */
+typedef struct {
+  clock_time_t delay;
+  /* Confirm this fragment (1 = first) with MAC_TX_NOACK, 0 = none */
+  uint8_t fail;
+  /* Keep the confirmations until released by the test */
+  uint8_t hold;
+  uint8_t sent;
+  uint8_t inflight;
+} test_node_t;
+
+/* The fragments seen by the test RDC for each datagram */
+typedef struct {
+  uint8_t node;
+  uint8_t frames;
+  uint8_t complete;
+  uint8_t failed;
+  uint8_t after_fail;
+  uint16_t end;
+} test_datagram_t;
+
+typedef struct {
+  struct ctimer timer;
+  mac_callback_t sent;
+  void *ptr;
+  uint8_t node;
+  uint8_t status;
+  uint8_t held;
+  uint8_t used;
+} test_confirmation_t;
+
+static test_node_t nodes[MAX_NODES];
+static test_datagram_t datagrams[MAX_DATAGRAMS];
+static test_confirmation_t confirmations[MAX_CONFIRMATIONS];
+/* The order of the fragments, as node numbers and datagram ids */
+static uint8_t frame_order[256];
+static uint8_t frame_datagram[256];
+static int frame_count;
+static int max_inflight;
+
+static int failures;
+
+PROCESS(frag_queue_test_process, "Fragment queue test");
+AUTOSTART_PROCESSES(&frag_queue_test_process);
+/*---------------------------------------------------------------------------*/
+static void
+check(const char *name, int condition)
+{
+  if(!condition) {
+    printf("FAIL %s\n", name);
+    failures++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+confirm(void *ptr)
+{
+  test_confirmation_t *c = ptr;
+  if(nodes[c->node].inflight > 0) {
+    nodes[c->node].inflight--;
+  }
+  c->used = 0;
+  c->sent(c->ptr, c->status, c->status == MAC_TX_OK ? 1 : 3);
+}
+/*---------------------------------------------------------------------------*/
+static void
+release_held(uint8_t node)
+{
+  int i;
+  for(i = 0; i < MAX_CONFIRMATIONS; i++) {
+    if(confirmations[i].used && confirmations[i].held
+       && confirmations[i].node == node) {
+      confirmations[i].held = 0;
+      ctimer_set(&confirmations[i].timer, 1, confirm, &confirmations[i]);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+record_fragment(uint8_t node, uint8_t status)
+{
+  const uint8_t *data;
+  test_datagram_t *d;
+  uint16_t len, size, end;
+  uint8_t id;
+
+  data = packetbuf_dataptr();
+  len = packetbuf_datalen();
+  if(len < 5 || ((data[0] & 0xf8) != SICSLOWPAN_DISPATCH_FRAG1
+                 && (data[0] & 0xf8) != SICSLOWPAN_DISPATCH_FRAGN)) {
+    return;
+  }
+
+  /* The payload of each datagram is filled with its id */
+  id = data[len - 1];
+  if(id >= MAX_DATAGRAMS) {
+    return;
+  }
+  d = &datagrams[id];
+  d->node = node;
+  d->frames++;
+  if(d->failed) {
+    d->after_fail++;
+  }
+  if(status != MAC_TX_OK) {
+    d->failed = 1;
+  }
+  if((data[0] & 0xf8) == SICSLOWPAN_DISPATCH_FRAGN) {
+    size = ((data[0] & 0x07) << 8) | data[1];
+    end = data[4] * 8 + len - 5;
+    if(end > d->end) {
+      d->end = end;
+    }
+    if(end == size) {
+      d->complete = 1;
+    }
+  }
+
+  if(frame_count < (int)sizeof(frame_order)) {
+    frame_order[frame_count] = node;
+    frame_datagram[frame_count] = id;
+    frame_count++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_packet(mac_callback_t sent, void *ptr)
+{
+  test_confirmation_t *c;
+  test_node_t *n;
+  uint8_t node;
+  int i;
+
+  node = packetbuf_addr(PACKETBUF_ADDR_RECEIVER)->u8[LINKADDR_SIZE - 1];
+  if(node >= MAX_NODES) {
+    node = 0;
+  }
+  n = &nodes[node];
+
+  c = NULL;
+  for(i = 0; i < MAX_CONFIRMATIONS; i++) {
+    if(!confirmations[i].used) {
+      c = &confirmations[i];
+      break;
+    }
+  }
+  if(c == NULL) {
+    printf("FAIL no free confirmation\n");
+    failures++;
+    mac_call_sent_callback(sent, ptr, MAC_TX_ERR_FATAL, 0);
+    return;
+  }
+
+  n->sent++;
+  if(node > 0) {
+    n->inflight++;
+    if(n->inflight > max_inflight) {
+      max_inflight = n->inflight;
+    }
+  }
+
+  c->used = 1;
+  c->sent = sent;
+  c->ptr = ptr;
+  c->node = node;
+  c->status = n->sent == n->fail ? MAC_TX_NOACK : MAC_TX_OK;
+  c->held = n->hold;
+  record_fragment(node, c->status);
+  if(!c->held) {
+    ctimer_set(&c->timer, n->delay, confirm, c);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
+{
+  if(buf_list != NULL) {
+    queuebuf_to_packetbuf(buf_list->buf);
+    send_packet(sent, ptr);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+packet_input(void)
+{
+}
+/*---------------------------------------------------------------------------*/
+static int
+on(void)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+off(int keep_radio_on)
+{
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned short
+channel_check_interval(void)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+init(void)
+{
+  int i;
+  for(i = 0; i < MAX_NODES; i++) {
+    nodes[i].delay = CONFIRM_DELAY;
+  }
+}
+/*---------------------------------------------------------------------------*/
+const struct rdc_driver frag_queue_test_rdc_driver = {
+  "frag-queue-test",
+  init,
+  send_packet,
+  send_list,
+  packet_input,
+  on,
+  off,
+  channel_check_interval,
+};
+/*---------------------------------------------------------------------------*/
+/* Send a fragmented UDP datagram to a link local next hop */
+static int
+send_datagram(uint8_t node, uint8_t id)
+{
+  uip_lladdr_t lladdr;
+  struct uip_udp_hdr *udp;
+
+  memset(&lladdr, 0, sizeof(lladdr));
+  lladdr.addr[0] = 0x02;
+  lladdr.addr[sizeof(lladdr.addr) - 1] = node;
+
+  memset(uip_buf, id, DATAGRAM_LEN);
+  memset(UIP_IP_BUF, 0, UIP_IPUDPH_LEN);
+  UIP_IP_BUF->vtc = 0x60;
+  UIP_IP_BUF->len[0] = (DATAGRAM_LEN - UIP_IPH_LEN) >> 8;
+  UIP_IP_BUF->len[1] = (DATAGRAM_LEN - UIP_IPH_LEN) & 0xff;
+  UIP_IP_BUF->proto = UIP_PROTO_UDP;
+  UIP_IP_BUF->ttl = 64;
+  uip_create_linklocal_prefix(&UIP_IP_BUF->srcipaddr);
+  uip_ds6_set_addr_iid(&UIP_IP_BUF->srcipaddr, &uip_lladdr);
+  uip_create_linklocal_prefix(&UIP_IP_BUF->destipaddr);
+  uip_ds6_set_addr_iid(&UIP_IP_BUF->destipaddr, &lladdr);
+  udp = (struct uip_udp_hdr *)&uip_buf[UIP_LLH_LEN + UIP_IPH_LEN];
+  udp->srcport = UIP_HTONS(5683);
+  udp->destport = UIP_HTONS(5683);
+  udp->udplen = UIP_HTONS(DATAGRAM_LEN - UIP_IPH_LEN);
+  uip_len = DATAGRAM_LEN;
+
+  return tcpip_output(&lladdr);
+}
+/*---------------------------------------------------------------------------*/
+static int
+count_frames(uint8_t node, int from, int to)
+{
+  int i, count;
+  count = 0;
+  for(i = from; i < to && i < frame_count; i++) {
+    if(frame_order[i] == node) {
+      count++;
+    }
+  }
+  return count;
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_datagrams(const char *name, uint8_t first, uint8_t last)
+{
+  int i;
+  printf("%-16s", name);
+  for(i = first; i <= last; i++) {
+    printf(" %u:%u%s", i, datagrams[i].frames,
+           datagrams[i].complete ? "" : datagrams[i].frames ? "!" : "-");
+  }
+  printf("\n");
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(frag_queue_test_process, ev, data)
+{
+  static struct etimer et;
+  static int i, first, count, whole;
+
+  PROCESS_BEGIN();
+
+  /*
+   * Interleave: the first two datagrams to a next hop share it
+   * round-robin, the third waits, and another next hop is not held
+   * up behind them.
+   */
+  first = frame_count;
+  send_datagram(1, 1);
+  send_datagram(1, 2);
+  send_datagram(1, 3);
+  send_datagram(2, 4);
+  etimer_set(&et, CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  print_datagrams("interleave", 1, 4);
+  for(i = 1; i <= 4; i++) {
+    check("interleave: datagram sent", datagrams[i].complete);
+  }
+  check("interleave: one fragment in flight", max_inflight == 1);
+  count = 0;
+  for(i = first; i < frame_count && count < 4; i++) {
+    if(frame_order[i] == 1) {
+      check("interleave: round-robin",
+            frame_datagram[i] == (count & 1 ? 2 : 1));
+      count++;
+    }
+  }
+  for(i = first; i < frame_count; i++) {
+    if(frame_datagram[i] == 3) {
+      break;
+    }
+  }
+  check("interleave: third datagram waits",
+        count_frames(1, first, i) > datagrams[1].frames);
+  i = frame_count - 1;
+  while(i > first && frame_order[i] != 2) {
+    i--;
+  }
+  check("interleave: other next hop",
+        count_frames(1, first, i) < datagrams[1].frames + datagrams[2].frames);
+
+  /* A failed fragment drops the rest of its datagram only */
+  nodes[3].fail = 3;
+  send_datagram(3, 5);
+  send_datagram(3, 6);
+  etimer_set(&et, CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  print_datagrams("failed fragment", 5, 6);
+  check("failed fragment: datagram dropped",
+        datagrams[5].failed && !datagrams[5].complete
+        && datagrams[5].after_fail == 0);
+  check("failed fragment: next datagram sent", datagrams[6].complete);
+
+  /*
+   * Out of queuebufs: datagrams to a next hop with a long queue are
+   * refused or dropped whole to make room for another next hop.
+   */
+  nodes[4].delay = CLOCK_SECOND / 20;
+  for(i = 7; i <= 10; i++) {
+    send_datagram(4, i);
+  }
+  send_datagram(5, 11);
+  etimer_set(&et, 2 * CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  print_datagrams("out of bufs", 7, 11);
+  whole = 1;
+  count = 0;
+  for(i = 7; i <= 10; i++) {
+    if(datagrams[i].frames == 0) {
+      count++;
+    } else if(!datagrams[i].complete) {
+      whole = 0;
+    }
+  }
+  check("out of bufs: whole datagrams dropped", whole && count > 0);
+  check("out of bufs: other next hop sent", datagrams[11].complete);
+
+  /*
+   * Late confirmation: the fragment to next hop 6 times out and the
+   * entry is reused for next hop 7 before the failed confirmation
+   * arrives. It must not drop the datagram to next hop 7.
+   */
+  nodes[6].hold = 1;
+  nodes[6].fail = 1;
+  send_datagram(6, 12);
+  etimer_set(&et, 3 * CLOCK_SECOND / 2);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  nodes[7].delay = CLOCK_SECOND / 10;
+  send_datagram(7, 13);
+  etimer_set(&et, CLOCK_SECOND / 20);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  release_held(6);
+  etimer_set(&et, 2 * CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  print_datagrams("late confirm", 12, 13);
+  check("late confirm: timed out datagram dropped",
+        datagrams[12].frames == 1 && !datagrams[12].complete);
+  check("late confirm: reused entry not affected", datagrams[13].complete);
+
+  /*
+   * Slow confirmations extend the TX timeout: after a next hop that
+   * confirms after 200 ms, confirmations after 500 ms, twice the
+   * configured timeout, must not time out.
+   */
+  nodes[8].delay = CLOCK_SECOND / 5;
+  send_datagram(8, 14);
+  etimer_set(&et, 2 * CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  nodes[9].delay = CLOCK_SECOND / 2;
+  send_datagram(9, 15);
+  etimer_set(&et, 4 * CLOCK_SECOND);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  print_datagrams("slow confirm", 14, 15);
+  check("slow confirm: datagram sent", datagrams[14].complete);
+  check("slow confirm: longer timeout", datagrams[15].complete);
+
+  check("one fragment in flight per next hop", max_inflight == 1);
+
+  printf("%s\n", failures > 0 ? "FAILED" : "OK");
+  exit(failures > 0 ? 1 : 0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2016, Yanzi Networks AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *    3. Neither the name of the copyright holders nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Host test of the header layout cache in frame802154.
+ *
+ *         Random frames are parsed, and frames are created from random
+ *         parameters, both with the layout cache and with the generic
+ *         code. The results must be identical: return values, header
+ *         lengths, created bytes and parsed fields. Cache entries are
+ *         also evicted and looked up again. The time to create
+ *         and parse a data frame with long addresses is reported for
+ *         both.
+ */
+
+#include "contiki.h"
+#include "net/mac/frame802154.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_FRAMES  1000000
+#define BENCH_ROUNDS    2000000
+#define MAX_FRAME       64
+#define MAX_REPORTS     10
+
+static uint32_t rand_state;
+static int failures;
+
+extern int contiki_argc;
+extern char **contiki_argv;
+
+PROCESS(frame802154_test_process, "frame802154 test");
+AUTOSTART_PROCESSES(&frame802154_test_process);
+/*---------------------------------------------------------------------------*/
+/* Own generator to get the same frames on all hosts */
+static uint32_t
+next_rand(void)
+{
+  rand_state ^= rand_state << 13;
+  rand_state ^= rand_state >> 17;
+  rand_state ^= rand_state << 5;
+  return rand_state;
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *what, long frame, const uint8_t *buf, int len)
+{
+  int i;
+
+  failures++;
+  if(failures > MAX_REPORTS) {
+    return;
+  }
+  printf("FAIL %s frame %ld len %d:", what, frame, len);
+  for(i = 0; i < len && i < 24; i++) {
+    printf(" %02x", buf[i]);
+  }
+  printf("\n");
+}
+/*---------------------------------------------------------------------------*/
+static void
+compare_parse(long frame, uint8_t *buf, int len)
+{
+  frame802154_t generic, cached;
+  int r1, r2;
+
+  /* Same fill to compare fields that the parser leaves untouched */
+  memset(&generic, 0x5a, sizeof(generic));
+  memset(&cached, 0x5a, sizeof(cached));
+  frame802154_set_layout_cache(0);
+  r1 = frame802154_parse(buf, len, &generic);
+  frame802154_set_layout_cache(1);
+  r2 = frame802154_parse(buf, len, &cached);
+
+  if(r1 != r2 || generic.payload != cached.payload
+     || generic.payload_len != cached.payload_len
+     || memcmp(&generic, &cached, offsetof(frame802154_t, payload)) != 0) {
+    report("parse", frame, buf, len);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_parse(long frame)
+{
+  uint8_t buf[MAX_FRAME];
+  int len, i;
+
+  for(i = 0; i < MAX_FRAME; i++) {
+    buf[i] = next_rand();
+  }
+  len = next_rand() % 40;
+  if(frame & 1) {
+    /* Mostly frames without security, which can use the cache */
+    buf[0] &= ~8;
+  }
+  compare_parse(frame, buf, len);
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_create(long frame)
+{
+  uint8_t b1[MAX_FRAME], b2[MAX_FRAME];
+  frame802154_t generic, cached;
+  int i, buf_len, h1, h2, r1, r2;
+
+  memset(&generic, 0, sizeof(generic));
+  for(i = 0; i < 8; i++) {
+    generic.dest_addr[i] = next_rand();
+    generic.src_addr[i] = next_rand();
+  }
+  generic.fcf.frame_type = next_rand() & 7;
+  generic.fcf.frame_pending = next_rand() & 1;
+  generic.fcf.ack_required = next_rand() & 1;
+  generic.fcf.panid_compression = next_rand() & 1;
+  generic.fcf.sequence_number_suppression = next_rand() & 1;
+  generic.fcf.ie_list_present = next_rand() & 1;
+  generic.fcf.dest_addr_mode = next_rand() & 3;
+  generic.fcf.src_addr_mode = next_rand() & 3;
+  generic.fcf.frame_version = next_rand() % 3;
+  generic.fcf.security_enabled = (next_rand() & 3) == 0;
+  generic.aux_hdr.security_control.security_level = 5;
+  generic.seq = next_rand();
+  generic.dest_pid = next_rand() & 1 ? IEEE802154_PANID : next_rand();
+  generic.src_pid = next_rand() & 1 ? IEEE802154_PANID : next_rand();
+  cached = generic;
+  buf_len = next_rand() % 30;
+  memset(b1, 0, sizeof(b1));
+  memset(b2, 0, sizeof(b2));
+
+  frame802154_set_layout_cache(0);
+  h1 = frame802154_hdrlen(&generic);
+  r1 = frame802154_create(&generic, b1, buf_len);
+  frame802154_set_layout_cache(1);
+  h2 = frame802154_hdrlen(&cached);
+  r2 = frame802154_create(&cached, b2, buf_len);
+
+  if(h1 != h2 || r1 != r2 || memcmp(b1, b2, sizeof(b1)) != 0
+     || memcmp(&generic, &cached, sizeof(generic)) != 0) {
+    report("create", frame, b1, r1);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+parse_fcf(long frame, uint16_t fcf)
+{
+  uint8_t buf[MAX_FRAME];
+  int i;
+
+  for(i = 0; i < MAX_FRAME; i++) {
+    buf[i] = next_rand();
+  }
+  buf[0] = fcf & 0xff;
+  buf[1] = fcf >> 8;
+  compare_parse(frame, buf, 40);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * A layout evicted by another FCF must be computed again when looked
+ * up. Each pair of FCFs without security is parsed in turn, so the
+ * pairs that share a cache entry replace each other.
+ */
+static long
+test_eviction(void)
+{
+  static uint16_t fcfs[4 * 2 * 2 * 3 * 3 * 3];
+  static const uint8_t modes[] = { 0, 2, 3 };
+  int n, i, j, type, pc, sup, dest, src, version;
+  long frame;
+
+  n = 0;
+  for(type = 0; type < 4; type++) {
+    for(pc = 0; pc < 2; pc++) {
+      for(sup = 0; sup < 2; sup++) {
+        for(dest = 0; dest < 3; dest++) {
+          for(src = 0; src < 3; src++) {
+            for(version = 0; version < 3; version++) {
+              fcfs[n++] = type | (pc << 6) | (sup << 8) | (modes[dest] << 10)
+                | (version << 12) | (modes[src] << 14);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  frame = 0;
+  for(i = 0; i < n; i++) {
+    for(j = 0; j < n; j++) {
+      parse_fcf(frame++, fcfs[i]);
+      parse_fcf(frame++, fcfs[j]);
+      parse_fcf(frame++, fcfs[i]);
+    }
+  }
+  return frame;
+}
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench(const char *name, uint8_t use_cache)
+{
+  static volatile int sink;
+  uint8_t buf[MAX_FRAME];
+  frame802154_t f, parsed;
+  double start, create_time, parse_time;
+  long i;
+  int len;
+
+  /* Data frame with long addresses and PAN ID compression */
+  memset(&f, 0, sizeof(f));
+  f.fcf.frame_type = FRAME802154_DATAFRAME;
+  f.fcf.ack_required = 1;
+  f.fcf.dest_addr_mode = FRAME802154_LONGADDRMODE;
+  f.fcf.src_addr_mode = FRAME802154_LONGADDRMODE;
+  f.fcf.frame_version = FRAME802154_IEEE802154_2006;
+  f.dest_pid = f.src_pid = IEEE802154_PANID;
+
+  frame802154_set_layout_cache(use_cache);
+  start = now();
+  for(i = 0; i < BENCH_ROUNDS; i++) {
+    f.seq = i;
+    sink += frame802154_hdrlen(&f);
+    sink += frame802154_create(&f, buf, sizeof(buf));
+  }
+  create_time = now() - start;
+
+  len = frame802154_create(&f, buf, sizeof(buf)) + 20;
+  start = now();
+  for(i = 0; i < BENCH_ROUNDS; i++) {
+    buf[2] = i;
+    sink += frame802154_parse(buf, len, &parsed);
+  }
+  parse_time = now() - start;
+  frame802154_set_layout_cache(1);
+
+  printf("%-8s create %6.1f ns  parse %6.1f ns\n", name,
+         create_time * 1e9 / BENCH_ROUNDS, parse_time * 1e9 / BENCH_ROUNDS);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(frame802154_test_process, ev, data)
+{
+  long frames, i;
+
+  PROCESS_BEGIN();
+
+  frames = DEFAULT_FRAMES;
+  rand_state = 1;
+  if(contiki_argc > 1) {
+    frames = atol(contiki_argv[1]);
+  }
+  if(contiki_argc > 2) {
+    rand_state = strtoul(contiki_argv[2], NULL, 0);
+    if(rand_state == 0) {
+      rand_state = 1;
+    }
+  }
+
+  for(i = 0; i < frames; i++) {
+    test_parse(i);
+    test_create(i);
+  }
+  printf("%ld frames parsed and created, %d differences\n", frames, failures);
+  i = failures;
+  frames = test_eviction();
+  printf("%ld frames parsed after layout evictions, %ld differences\n",
+         frames, failures - i);
+
+  bench("generic", 0);
+  bench("layout", 1);
+
+  printf("%s\n", failures > 0 ? "FAILED" : "OK");
+  exit(failures > 0 ? 1 : 0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
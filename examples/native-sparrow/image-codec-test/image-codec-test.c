@@ -0,0 +1,596 @@
+/*
+ * Copyright (c) 2016, Yanzi Networks AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *    3. Neither the name of the copyright holders nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Host test of the firmware image decoders in instance-flash.
+ *
+ *         Without arguments, synthetic images are encoded with small
+ *         reference encoders and decoded again with the streaming LZSS
+ *         and delta decoders, fed in chunks of different sizes. Broken
+ *         streams must be rejected.
+ *
+ *         With files created by tools/sparrow/lzss.py or imagediff.py
+ *         the decoders are checked against the expected image and the
+ *         apply time on the native flash emulation is reported. The
+ *         test program can also write a source and a new image for
+ *         the tools.
+ */
+
+#include "contiki.h"
+#include "lib/crc32.h"
+#include "lzss-decoder.h"
+#include "delta-decoder.h"
+#include "image-trailer.h"
+#include "dev/native-flash.h"
+#include "dev/sparrow-flash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_IMAGE_SIZE  NATIVE_FLASH_IMAGE_LENGTH
+#define TEST_IMAGE_SIZE (64 * 1024)
+#define FILE_IMAGE_SIZE (128 * 1024)
+#define WINDOW_BITS     11
+#define LOOKAHEAD_BITS  4
+
+/* Flash file used when SPARROW_FLASH_FILE is not set */
+#define FLASH_FILE       "image-codec-test-flash.bin"
+/* Bytes written to flash at a time, as the instance-flash output buffer */
+#define FLASH_WRITE_SIZE 64
+
+/* Chunk sizes used to feed the decoders, 0 = everything at once */
+static const uint32_t chunk_sizes[] = { 1, 3, 4, 7, 64, 1000, 0 };
+
+static uint8_t source[MAX_IMAGE_SIZE];
+static uint8_t image[MAX_IMAGE_SIZE];
+static uint8_t encoded[MAX_IMAGE_SIZE * 2];
+static uint8_t output[MAX_IMAGE_SIZE];
+static uint32_t output_len;
+static int failures;
+
+extern int contiki_argc;
+extern char **contiki_argv;
+
+PROCESS(image_codec_test_process, "Image codec test");
+AUTOSTART_PROCESSES(&image_codec_test_process);
+/*---------------------------------------------------------------------------*/
+static int
+put(uint8_t c)
+{
+  if(output_len >= sizeof(output)) {
+    return 0;
+  }
+  output[output_len++] = c;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t
+get(uint32_t position)
+{
+  return output[position];
+}
+/*---------------------------------------------------------------------------*/
+static const lzss_output_t lzss_output = { put, get };
+/*---------------------------------------------------------------------------*/
+static void
+check(int ok, const char *name, uint32_t chunk)
+{
+  if(!ok) {
+    printf("FAIL %s (chunk %lu)\n", name, (unsigned long)chunk);
+    failures++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+get32(const uint8_t *p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | (p[2] << 8) | p[3];
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+load_file(const char *filename, uint8_t *buf, uint32_t size)
+{
+  FILE *f;
+  size_t len;
+
+  f = fopen(filename, "rb");
+  if(f == NULL) {
+    perror(filename);
+    exit(1);
+  }
+  len = fread(buf, 1, size, f);
+  fclose(f);
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+save_file(const char *filename, const uint8_t *buf, uint32_t len)
+{
+  FILE *f;
+
+  f = fopen(filename, "wb");
+  if(f == NULL || fwrite(buf, 1, len, f) != len) {
+    perror(filename);
+    exit(1);
+  }
+  fclose(f);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Firmware-like test image: code with repeated instruction patterns,
+ * tables, some random data and erased (0xff) areas.
+ */
+static void
+make_image(uint8_t *buf, uint32_t len, unsigned seed)
+{
+  uint32_t i;
+
+  srand(seed);
+  for(i = 0; i < len; i++) {
+    switch((i / 4096) % 4) {
+    case 0:
+      buf[i] = (i & 3) == 3 ? 0x47 : rand() % 16;
+      break;
+    case 1:
+      buf[i] = i / 16;
+      break;
+    case 2:
+      buf[i] = rand();
+      break;
+    default:
+      buf[i] = 0xff;
+      break;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* The next version of the image with inserted, removed and changed code */
+static void
+mutate_image(const uint8_t *src, uint8_t *dst, uint32_t len)
+{
+  memcpy(dst, src, len);
+  memmove(&dst[1000 + 37], &dst[1000], 8000);
+  memset(&dst[1000], 0x5a, 37);
+  memmove(&dst[20000], &dst[20100], 10000);
+  dst[40000] ^= 0x10;
+  dst[40004] ^= 0x10;
+  memcpy(&dst[50000], &src[30000], 2000);
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Reference LZSS encoder (greedy, exhaustive search) producing the
+ * bit stream read by lzss-decoder.c.
+ */
+static uint32_t
+lzss_encode(const uint8_t *data, uint32_t len, uint8_t *out)
+{
+  uint32_t bits = 0, pos = 0, i, j, n, best, distance;
+  int bit_count = 0;
+  uint32_t window = 1UL << WINDOW_BITS;
+  uint32_t max_count = 1UL << LOOKAHEAD_BITS;
+
+#define WRITE_BITS(value, count) do {                                   \
+    bits = (bits << (count)) | (value);                                 \
+    bit_count += (count);                                               \
+    while(bit_count >= 8) {                                             \
+      bit_count -= 8;                                                   \
+      out[pos++] = bits >> bit_count;                                   \
+    }                                                                   \
+  } while(0)
+
+  for(i = 0; i < len; i += n) {
+    best = 0;
+    distance = 0;
+    for(j = i > window ? i - window : 0; j < i; j++) {
+      for(n = 0; n < max_count && i + n < len && data[j + n] == data[i + n]; n++);
+      if(n > best) {
+        best = n;
+        distance = i - j;
+      }
+    }
+    if(best > 1) {
+      WRITE_BITS(0, 1);
+      WRITE_BITS(distance - 1, WINDOW_BITS);
+      WRITE_BITS(best - 1, LOOKAHEAD_BITS);
+      n = best;
+    } else {
+      WRITE_BITS(1, 1);
+      WRITE_BITS(data[i], 8);
+      n = 1;
+    }
+  }
+  if(bit_count > 0) {
+    WRITE_BITS(0, 8 - bit_count);
+  }
+#undef WRITE_BITS
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+/* Reference delta encoder with copies of aligned 16 byte blocks */
+static uint32_t
+delta_encode(const uint8_t *src, uint32_t src_len,
+             const uint8_t *dst, uint32_t len, uint8_t *out)
+{
+  uint32_t pos = 0, i, j, n, best, offset, insert = 0;
+
+  for(i = 0; i < len; i += n) {
+    best = 0;
+    offset = 0;
+    for(j = 0; j + 16 <= src_len; j += 16) {
+      for(n = 0; n < 0x10000 && i + n < len && j + n < src_len
+            && src[j + n] == dst[i + n]; n++);
+      if(n > best) {
+        best = n;
+        offset = j;
+      }
+    }
+    if(best >= 8) {
+      n = best;
+      out[pos++] = DELTA_DECODER_OP_COPY;
+      out[pos++] = offset >> 24;
+      out[pos++] = offset >> 16;
+      out[pos++] = offset >> 8;
+      out[pos++] = offset;
+      out[pos++] = (n - 1) >> 8;
+      out[pos++] = n - 1;
+      insert = 0;
+    } else {
+      n = 1;
+      if(insert == 0 || out[insert] == 0x7f) {
+        insert = pos;
+        out[pos++] = 0;
+      } else {
+        out[insert]++;
+      }
+      out[pos++] = dst[i];
+    }
+  }
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static int
+lzss_decode(const uint8_t *data, uint32_t len, uint32_t length,
+            uint8_t window_bits, uint8_t lookahead_bits, uint32_t chunk)
+{
+  lzss_decoder_t d;
+  lzss_decoder_status_t status = LZSS_DECODER_OK;
+  uint32_t i, n;
+
+  output_len = 0;
+  if(!lzss_decoder_init(&d, window_bits, lookahead_bits, length)) {
+    return LZSS_DECODER_ERROR;
+  }
+  for(i = 0; i < len && status == LZSS_DECODER_OK; i += n) {
+    n = chunk == 0 || len - i < chunk ? len - i : chunk;
+    status = lzss_decoder_input(&d, data + i, n, &lzss_output);
+  }
+  return status;
+}
+/*---------------------------------------------------------------------------*/
+static int
+delta_decode(const uint8_t *src, uint32_t src_len, const uint8_t *data,
+             uint32_t len, uint32_t length, uint32_t chunk)
+{
+  delta_decoder_t d;
+  delta_decoder_status_t status = DELTA_DECODER_OK;
+  uint32_t i, n;
+
+  output_len = 0;
+  delta_decoder_init(&d, src, src_len, length);
+  for(i = 0; i < len && status == DELTA_DECODER_OK; i += n) {
+    n = chunk == 0 || len - i < chunk ? len - i : chunk;
+    status = delta_decoder_input(&d, data + i, n, put);
+  }
+  return status;
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_lzss(void)
+{
+  uint32_t len, i;
+
+  make_image(image, TEST_IMAGE_SIZE, 1);
+  len = lzss_encode(image, TEST_IMAGE_SIZE, encoded);
+  printf("lzss: %u -> %lu bytes\n", TEST_IMAGE_SIZE, (unsigned long)len);
+
+  for(i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); i++) {
+    check(lzss_decode(encoded, len, TEST_IMAGE_SIZE, WINDOW_BITS,
+                      LOOKAHEAD_BITS, chunk_sizes[i]) == LZSS_DECODER_DONE
+          && output_len == TEST_IMAGE_SIZE
+          && memcmp(output, image, TEST_IMAGE_SIZE) == 0,
+          "lzss round trip", chunk_sizes[i]);
+  }
+
+  /* Padding after the stream is ignored */
+  memset(encoded + len, 0, 4);
+  check(lzss_decode(encoded, len + 4, TEST_IMAGE_SIZE, WINDOW_BITS,
+                    LOOKAHEAD_BITS, 7) == LZSS_DECODER_DONE,
+        "lzss padding", 7);
+
+  /* A truncated stream never completes */
+  check(lzss_decode(encoded, len / 2, TEST_IMAGE_SIZE, WINDOW_BITS,
+                    LOOKAHEAD_BITS, 64) == LZSS_DECODER_OK,
+        "lzss truncated", 64);
+
+  /* A back reference before the start of the image */
+  encoded[0] = 0x00;
+  check(lzss_decode(encoded, len, TEST_IMAGE_SIZE, WINDOW_BITS,
+                    LOOKAHEAD_BITS, 1) == LZSS_DECODER_ERROR,
+        "lzss bad reference", 1);
+
+  /* Unsupported parameters */
+  check(lzss_decode(encoded, len, TEST_IMAGE_SIZE,
+                    LZSS_DECODER_MAX_WINDOW_BITS + 1, LOOKAHEAD_BITS, 0)
+        == LZSS_DECODER_ERROR, "lzss window bits", 0);
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_delta(void)
+{
+  uint32_t len, i;
+
+  make_image(source, TEST_IMAGE_SIZE, 2);
+  mutate_image(source, image, TEST_IMAGE_SIZE);
+  len = delta_encode(source, TEST_IMAGE_SIZE, image, TEST_IMAGE_SIZE, encoded);
+  printf("delta: %u -> %lu bytes\n", TEST_IMAGE_SIZE, (unsigned long)len);
+
+  for(i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); i++) {
+    check(delta_decode(source, TEST_IMAGE_SIZE, encoded, len, TEST_IMAGE_SIZE,
+                       chunk_sizes[i]) == DELTA_DECODER_DONE
+          && output_len == TEST_IMAGE_SIZE
+          && memcmp(output, image, TEST_IMAGE_SIZE) == 0,
+          "delta round trip", chunk_sizes[i]);
+  }
+
+  check(delta_decode(source, TEST_IMAGE_SIZE, encoded, len / 2,
+                     TEST_IMAGE_SIZE, 64) == DELTA_DECODER_OK,
+        "delta truncated", 64);
+
+  /* A copy beyond the end of the source image */
+  encoded[0] = DELTA_DECODER_OP_COPY;
+  encoded[1] = (TEST_IMAGE_SIZE - 8) >> 24;
+  encoded[2] = (TEST_IMAGE_SIZE - 8) >> 16;
+  encoded[3] = (TEST_IMAGE_SIZE - 8) >> 8;
+  encoded[4] = (TEST_IMAGE_SIZE - 8) & 0xff;
+  encoded[5] = 0;
+  encoded[6] = 15;
+  check(delta_decode(source, TEST_IMAGE_SIZE, encoded, len, TEST_IMAGE_SIZE, 3)
+        == DELTA_DECODER_ERROR, "delta bad copy", 3);
+
+  /* An unknown operation */
+  encoded[0] = DELTA_DECODER_OP_COPY + 1;
+  check(delta_decode(source, TEST_IMAGE_SIZE, encoded, len, TEST_IMAGE_SIZE, 0)
+        == DELTA_DECODER_ERROR, "delta bad operation", 0);
+}
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Open the flash emulation unless the platform already did so from
+ * SPARROW_FLASH_FILE.
+ */
+static void
+flash_open(void)
+{
+  if(!native_flash_is_enabled() && !native_flash_init(FLASH_FILE)) {
+    printf("no flash emulation\n");
+    exit(1);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+is_sector_erased(uint32_t address)
+{
+  const uint32_t *p = (const uint32_t *)(uintptr_t)address;
+  int i;
+  for(i = 0; i < NATIVE_FLASH_SECTOR_SIZE / 4; i++) {
+    if(p[i] != 0xffffffff) {
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Erase the sectors of the image slot up to "end" that are not already
+ * erased, in the same way as the write session in instance-flash.
+ */
+static int
+flash_erase_to(uint32_t start_address, uint32_t *erased, uint32_t end)
+{
+  if(end > NATIVE_FLASH_IMAGE_LENGTH) {
+    end = NATIVE_FLASH_IMAGE_LENGTH;
+  }
+  for(; *erased < end; *erased += NATIVE_FLASH_SECTOR_SIZE) {
+    if(!is_sector_erased(start_address + *erased)
+       && sparrow_flash_erase_sector(start_address + *erased) != SPARROW_FLASH_COMPLETE) {
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Write an image to an image slot the way the flash instance writes a
+ * decoded stream: FLASH_WRITE_SIZE bytes at a time, with the sectors
+ * erased one sector ahead of the data and only erased words programmed.
+ */
+static int
+flash_write_image(int slot, const uint8_t *data, uint32_t len)
+{
+  uint32_t start_address, erased, offset, word;
+  const uint32_t *present;
+  int ok;
+
+  start_address = NATIVE_FLASH_IMAGE_START + slot * NATIVE_FLASH_IMAGE_LENGTH;
+  erased = 0;
+  ok = sparrow_flash_unlock() == SPARROW_FLASH_COMPLETE;
+  for(offset = 0; ok && offset < len; offset += 4) {
+    if((offset % FLASH_WRITE_SIZE) == 0) {
+      ok = flash_erase_to(start_address, &erased,
+                          offset + FLASH_WRITE_SIZE + NATIVE_FLASH_SECTOR_SIZE);
+    }
+    present = (const uint32_t *)(uintptr_t)(start_address + offset);
+    memcpy(&word, data + offset, sizeof(word));
+    if(ok && *present == 0xffffffff) {
+      ok = sparrow_flash_program_word(start_address + offset, word)
+        == SPARROW_FLASH_COMPLETE;
+    }
+  }
+  sparrow_flash_lock();
+  return ok && memcmp((const void *)(uintptr_t)start_address, data, len) == 0;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Apply the decoded image to the second image slot and report the
+ * flash operations and the time measured on the flash emulation.
+ */
+static void
+report_apply(const char *name, uint32_t encoded_len, double decode_time)
+{
+  native_flash_stats_t before;
+  const native_flash_stats_t *stats;
+  double start, elapsed;
+  uint32_t erases, programs;
+
+  before = *native_flash_get_stats();
+  start = now();
+  check(flash_write_image(1, output, output_len), "flash apply", 0);
+  elapsed = now() - start;
+  stats = native_flash_get_stats();
+  erases = stats->erase_count - before.erase_count;
+  programs = stats->program_count - before.program_count;
+
+  printf("%s: %lu -> %lu bytes (%.1f%%), decode %.1f ms\n",
+         name, (unsigned long)encoded_len, (unsigned long)output_len,
+         100.0 * encoded_len / output_len, decode_time * 1e3);
+  printf("%s: flash %lu of %lu sectors erased, %lu words programmed,"
+         " busy %.1f ms, apply %.1f ms, %.1f KB/s\n",
+         name, (unsigned long)erases,
+         (unsigned long)(NATIVE_FLASH_IMAGE_LENGTH / NATIVE_FLASH_SECTOR_SIZE),
+         (unsigned long)programs,
+         (stats->busy_usec - before.busy_usec) / 1e3, elapsed * 1e3,
+         output_len / 1024.0 / (decode_time + elapsed));
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_compressed_file(const char *filename, const char *image_file)
+{
+  const image_compressed_header_t *h;
+  uint32_t len, image_len, length;
+  double start;
+
+  len = load_file(filename, encoded, sizeof(encoded));
+  image_len = load_file(image_file, image, sizeof(image));
+  h = (const image_compressed_header_t *)encoded;
+  if(len < sizeof(*h) || get32(encoded) != IMAGE_COMPRESSED_MAGIC) {
+    printf("%s: not a compressed image\n", filename);
+    exit(1);
+  }
+  length = get32((const uint8_t *)&h->length);
+  flash_open();
+
+  start = now();
+  check(lzss_decode(encoded + sizeof(*h), len - sizeof(*h), length,
+                    h->window_bits, h->lookahead_bits, 0) == LZSS_DECODER_DONE
+        && crc32(output, output_len) == get32((const uint8_t *)&h->crc32)
+        && output_len == image_len && memcmp(output, image, image_len) == 0,
+        filename, 0);
+  report_apply(filename, len, now() - start);
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_delta_file(const char *filename, const char *source_file,
+                 const char *image_file)
+{
+  const image_delta_header_t *h;
+  uint32_t len, source_len, image_len, length;
+  double start;
+
+  len = load_file(filename, encoded, sizeof(encoded));
+  source_len = load_file(source_file, source, sizeof(source));
+  image_len = load_file(image_file, image, sizeof(image));
+  h = (const image_delta_header_t *)encoded;
+  if(len < sizeof(*h) || get32(encoded) != IMAGE_DELTA_MAGIC) {
+    printf("%s: not a delta image\n", filename);
+    exit(1);
+  }
+  length = get32((const uint8_t *)&h->length);
+
+  /* The running image is in the first slot, copies are read from flash */
+  flash_open();
+  check(flash_write_image(0, source, source_len), "flash source", 0);
+
+  start = now();
+  check(delta_decode((const uint8_t *)(uintptr_t)NATIVE_FLASH_IMAGE_START,
+                     source_len, encoded + sizeof(*h),
+                     len - sizeof(*h), length, 0) == DELTA_DECODER_DONE
+        && crc32(output, output_len) == get32((const uint8_t *)&h->crc32)
+        && output_len == image_len && memcmp(output, image, image_len) == 0,
+        filename, 0);
+  report_apply(filename, len, now() - start);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(image_codec_test_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  if(contiki_argc == 4 && strcmp(contiki_argv[1], "-w") == 0) {
+    make_image(source, FILE_IMAGE_SIZE, 3);
+    mutate_image(source, image, FILE_IMAGE_SIZE);
+    save_file(contiki_argv[2], source, FILE_IMAGE_SIZE);
+    save_file(contiki_argv[3], image, FILE_IMAGE_SIZE);
+    exit(0);
+  } else if(contiki_argc == 4 && strcmp(contiki_argv[1], "-z") == 0) {
+    check_compressed_file(contiki_argv[2], contiki_argv[3]);
+  } else if(contiki_argc == 5 && strcmp(contiki_argv[1], "-D") == 0) {
+    check_delta_file(contiki_argv[2], contiki_argv[3], contiki_argv[4]);
+  } else if(contiki_argc == 1) {
+    test_lzss();
+    test_delta();
+  } else {
+    printf("usage: %s [-w source image | -z image.lz image |"
+           " -D image.delta source image]\n", contiki_argv[0]);
+    exit(1);
+  }
+
+  printf("%s\n", failures > 0 ? "FAILED" : "OK");
+  exit(failures > 0 ? 1 : 0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,402 @@
+/*
+ * Copyright (c) 2016, Yanzi Networks AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *    3. Neither the name of the copyright holders nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Benchmark of the 6LoWPAN IPHC header compression.
+ *
+ *         Replays IPv6 packets from a pcap (or a synthetic mix) through
+ *         compression and decompression with the fast path and the
+ *         generic path, verifies that the results are identical and
+ *         reports packets/s.
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ipv6/sicslowpan.h"
+#include "net/packetbuf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_PACKETS       4096
+#define DEFAULT_ROUNDS    50
+#define REPETITIONS       5
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_RAW      101
+#define LINKTYPE_IPV6     229
+/* OAM port used by the sparrow devices */
+#define OAM_PORT          49111
+
+#define UIP_IP_BUF ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+struct bench_packet {
+  uint16_t len;
+  uint8_t data[UIP_BUFSIZE - UIP_LLH_LEN];
+};
+
+static struct bench_packet packets[MAX_PACKETS];
+static int packet_count;
+static uint8_t uncompressed[UIP_BUFSIZE];
+
+extern int contiki_argc;
+extern char **contiki_argv;
+
+PROCESS(iphc_bench_process, "IPHC benchmark");
+AUTOSTART_PROCESSES(&iphc_bench_process);
+/*---------------------------------------------------------------------------*/
+static uint32_t
+read32(const uint8_t *p, int swap)
+{
+  if(swap) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | (p[2] << 8) | p[3];
+  }
+  return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | (p[1] << 8) | p[0];
+}
+/*---------------------------------------------------------------------------*/
+static int
+load_pcap(const char *filename)
+{
+  FILE *fp;
+  uint8_t hdr[24];
+  uint8_t frame[2048];
+  uint32_t magic, linktype, caplen;
+  int swap, offset;
+
+  fp = fopen(filename, "rb");
+  if(fp == NULL) {
+    perror(filename);
+    return 0;
+  }
+  if(fread(hdr, 1, sizeof(hdr), fp) != sizeof(hdr)) {
+    fclose(fp);
+    return 0;
+  }
+  magic = read32(hdr, 0);
+  if(magic == 0xa1b2c3d4 || magic == 0xa1b23c4d) {
+    swap = 0;
+  } else if(magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1) {
+    swap = 1;
+  } else {
+    printf("%s: not a pcap file\n", filename);
+    fclose(fp);
+    return 0;
+  }
+  linktype = read32(&hdr[20], swap);
+  if(linktype == LINKTYPE_ETHERNET) {
+    offset = 14;
+  } else if(linktype == LINKTYPE_RAW || linktype == LINKTYPE_IPV6) {
+    offset = 0;
+  } else {
+    printf("%s: unsupported link type %lu\n", filename, (unsigned long)linktype);
+    fclose(fp);
+    return 0;
+  }
+
+  while(packet_count < MAX_PACKETS && fread(hdr, 1, 16, fp) == 16) {
+    caplen = read32(&hdr[8], swap);
+    if(caplen > sizeof(frame) || fread(frame, 1, caplen, fp) != caplen) {
+      break;
+    }
+    if(offset > 0 && (caplen < 14 || frame[12] != 0x86 || frame[13] != 0xdd)) {
+      continue;
+    }
+    if(caplen < (uint32_t)offset + UIP_IPH_LEN || (frame[offset] & 0xf0) != 0x60 ||
+       caplen - offset > sizeof(packets[0].data)) {
+      continue;
+    }
+    packets[packet_count].len = caplen - offset;
+    memcpy(packets[packet_count].data, &frame[offset], caplen - offset);
+    packet_count++;
+  }
+  fclose(fp);
+  return packet_count;
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_addr(uint8_t *addr, int type, int node)
+{
+  memset(addr, 0, 16);
+  switch(type) {
+  case 0:
+    /* DODAG prefix with link-derived IID */
+    addr[0] = UIP_DS6_DEFAULT_PREFIX_0;
+    addr[1] = UIP_DS6_DEFAULT_PREFIX_1;
+    addr[8] = 0x02;
+    addr[9] = 0x12;
+    addr[10] = 0x4b;
+    addr[14] = node >> 8;
+    addr[15] = node;
+    break;
+  case 1:
+    /* External server */
+    addr[0] = 0x20;
+    addr[1] = 0x01;
+    addr[2] = 0x0d;
+    addr[3] = 0xb8;
+    addr[15] = node;
+    break;
+  default:
+    /* Link local */
+    addr[0] = 0xfe;
+    addr[1] = 0x80;
+    addr[8] = 0x02;
+    addr[9] = 0x12;
+    addr[10] = 0x4b;
+    addr[15] = node;
+    break;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+generate_packets(void)
+{
+  struct bench_packet *p;
+  struct uip_ip_hdr *ip;
+  struct uip_udp_hdr *udp;
+  int i, payload;
+
+  srand(4711);
+  for(i = 0; i < MAX_PACKETS; i++) {
+    p = &packets[i];
+    memset(p->data, 0, sizeof(p->data));
+    ip = (struct uip_ip_hdr *)p->data;
+    udp = (struct uip_udp_hdr *)&p->data[UIP_IPH_LEN];
+    payload = 20 + rand() % 60;
+    ip->vtc = 0x60;
+    ip->proto = UIP_PROTO_UDP;
+    ip->ttl = (i & 1) ? 64 : 255;
+    udp->srcport = UIP_HTONS(OAM_PORT);
+    udp->destport = UIP_HTONS(OAM_PORT);
+    udp->udplen = UIP_HTONS(UIP_UDPH_LEN + payload);
+    udp->udpchksum = rand();
+    if(i % 8 < 6) {
+      /* OAM traffic within the PAN */
+      set_addr(ip->srcipaddr.u8, 0, 1);
+      set_addr(ip->destipaddr.u8, 0, 2 + rand() % 100);
+      if(i % 8 == 1) {
+        udp->srcport = UIP_HTONS(0xf0b0 + rand() % 16);
+      }
+    } else if(i % 8 == 6) {
+      /* Traffic to an external server */
+      set_addr(ip->srcipaddr.u8, 0, 2 + rand() % 100);
+      set_addr(ip->destipaddr.u8, 1, 1);
+      ip->ttl = 63;
+    } else {
+      /* Link local with traffic class */
+      set_addr(ip->srcipaddr.u8, 2, 1);
+      set_addr(ip->destipaddr.u8, 2, 2 + rand() % 100);
+      ip->vtc = 0x6b;
+    }
+    ip->len[0] = (UIP_UDPH_LEN + payload) >> 8;
+    ip->len[1] = (UIP_UDPH_LEN + payload) & 0xff;
+    p->len = UIP_IPH_LEN + UIP_UDPH_LEN + payload;
+  }
+  packet_count = MAX_PACKETS;
+}
+/*---------------------------------------------------------------------------*/
+static void
+addr_to_lladdr(linkaddr_t *lladdr, const uip_ipaddr_t *addr)
+{
+  /* Derive the link address from the IID as for autoconfigured addresses */
+  if(uip_is_addr_mcast(addr)) {
+    linkaddr_copy(lladdr, &linkaddr_null);
+  } else {
+    memcpy(lladdr->u8, &addr->u8[16 - LINKADDR_SIZE], LINKADDR_SIZE);
+    lladdr->u8[0] ^= 0x02;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+load_packet(const struct bench_packet *p, linkaddr_t *src, linkaddr_t *dest)
+{
+  memcpy(UIP_IP_BUF, p->data, p->len);
+  uip_len = p->len;
+  addr_to_lladdr(src, &UIP_IP_BUF->srcipaddr);
+  addr_to_lladdr(dest, &UIP_IP_BUF->destipaddr);
+  memcpy(uip_lladdr.addr, src->u8, sizeof(uip_lladdr.addr));
+}
+/*---------------------------------------------------------------------------*/
+static int
+compress_packet(const struct bench_packet *p, uint8_t fast)
+{
+  linkaddr_t src, dest;
+  int len;
+
+  load_packet(p, &src, &dest);
+  len = sicslowpan_iphc_bench_compress(&dest, fast);
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &src);
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &dest);
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static int
+verify(void)
+{
+  static uint8_t generic[PACKETBUF_SIZE];
+  static uint8_t generic_hdr[UIP_IPH_LEN + UIP_UDPH_LEN];
+  int i, len, generic_len, hdr_len, errors, roundtrip_errors;
+
+  errors = 0;
+  roundtrip_errors = 0;
+  for(i = 0; i < packet_count; i++) {
+    generic_len = compress_packet(&packets[i], 0);
+    if(generic_len < 0) {
+      /* Needs fragmentation - not part of the benchmark */
+      packets[i--] = packets[--packet_count];
+      continue;
+    }
+    memcpy(generic, packetbuf_dataptr(), packetbuf_datalen());
+    len = compress_packet(&packets[i], 1);
+    if(len != generic_len || memcmp(generic, packetbuf_dataptr(), len) != 0) {
+      printf("packet %d: compressed header differs\n", i);
+      errors++;
+      continue;
+    }
+
+    /* The UDP header is uncompressed as well */
+    hdr_len = UIP_IPH_LEN;
+    if(packets[i].data[6] == UIP_PROTO_UDP) {
+      hdr_len += UIP_UDPH_LEN;
+    }
+    memset(uncompressed, 0, sizeof(uncompressed));
+    sicslowpan_iphc_bench_uncompress(uncompressed, 0);
+    memcpy(generic_hdr, uncompressed, hdr_len);
+    memset(uncompressed, 0, sizeof(uncompressed));
+    sicslowpan_iphc_bench_uncompress(uncompressed, 1);
+    if(memcmp(uncompressed, generic_hdr, hdr_len) != 0) {
+      printf("packet %d: uncompressed header differs\n", i);
+      errors++;
+    } else if(memcmp(uncompressed, packets[i].data, hdr_len) != 0) {
+      /* Inconsistent length fields in the capture */
+      roundtrip_errors++;
+    }
+  }
+  if(roundtrip_errors > 0) {
+    printf("%d packets not restored by decompression\n", roundtrip_errors);
+  }
+  return errors;
+}
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(const char *name, uint8_t fast, int rounds)
+{
+  static uint8_t compressed[MAX_PACKETS][PACKETBUF_SIZE];
+  static uint16_t compressed_len[MAX_PACKETS];
+  static linkaddr_t src[MAX_PACKETS], dest[MAX_PACKETS];
+  double start, elapsed, compress_time, uncompress_time;
+  int i, r, rep;
+
+  for(i = 0; i < packet_count; i++) {
+    compress_packet(&packets[i], fast);
+    compressed_len[i] = packetbuf_datalen();
+    memcpy(compressed[i], packetbuf_dataptr(), compressed_len[i]);
+    linkaddr_copy(&src[i], packetbuf_addr(PACKETBUF_ADDR_SENDER));
+    linkaddr_copy(&dest[i], packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
+  }
+
+  /* Best of several repetitions to reduce the noise */
+  compress_time = uncompress_time = 0;
+  for(rep = 0; rep < REPETITIONS; rep++) {
+    start = now();
+    for(r = 0; r < rounds; r++) {
+      for(i = 0; i < packet_count; i++) {
+        /* Only the headers are needed for the compression */
+        memcpy(UIP_IP_BUF, packets[i].data, UIP_IPH_LEN + UIP_UDPH_LEN);
+        uip_len = packets[i].len;
+        memcpy(uip_lladdr.addr, src[i].u8, sizeof(uip_lladdr.addr));
+        sicslowpan_iphc_bench_compress(&dest[i], fast);
+      }
+    }
+    elapsed = now() - start;
+    if(rep == 0 || elapsed < compress_time) {
+      compress_time = elapsed;
+    }
+
+    start = now();
+    for(r = 0; r < rounds; r++) {
+      for(i = 0; i < packet_count; i++) {
+        memcpy(packetbuf_dataptr(), compressed[i], compressed_len[i]);
+        packetbuf_set_datalen(compressed_len[i]);
+        packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &src[i]);
+        packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &dest[i]);
+        sicslowpan_iphc_bench_uncompress(uncompressed, fast);
+      }
+    }
+    elapsed = now() - start;
+    if(rep == 0 || elapsed < uncompress_time) {
+      uncompress_time = elapsed;
+    }
+  }
+
+  printf("%-8s compress %10.0f packets/s  uncompress %10.0f packets/s\n",
+         name, (double)rounds * packet_count / compress_time,
+         (double)rounds * packet_count / uncompress_time);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(iphc_bench_process, ev, data)
+{
+  int rounds;
+
+  PROCESS_BEGIN();
+
+  rounds = DEFAULT_ROUNDS;
+  if(contiki_argc > 1 && strcmp(contiki_argv[1], "-") != 0) {
+    if(load_pcap(contiki_argv[1]) == 0) {
+      printf("no IPv6 packets in %s\n", contiki_argv[1]);
+      exit(1);
+    }
+  } else {
+    generate_packets();
+  }
+  if(contiki_argc > 2) {
+    rounds = atoi(contiki_argv[2]);
+  }
+
+  if(verify() > 0) {
+    printf("fast path and generic path differ\n");
+    exit(1);
+  }
+  printf("%d packets, %d rounds\n", packet_count, rounds);
+  run("generic", 0, rounds);
+  run("fast", 1, rounds);
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
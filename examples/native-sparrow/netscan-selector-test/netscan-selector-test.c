@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2016, Yanzi Networks AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *    3. Neither the name of the copyright holders nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Host test of the scored netscan selector.
+ *
+ *         Canned beacon sets are fed to netscan_scored_selector in the
+ *         order of a full scan and the selected network is checked.
+ *         The join fallback is tested by letting the join time expire
+ *         without a DAG.
+ */
+
+#include "contiki.h"
+#include "netscan.h"
+#include "net/packetbuf.h"
+#include "net/mac/frame802154.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OTHER_PANID 0x1234
+#define NO_RSSI     0
+
+extern const struct netscan_selector netscan_scored_selector;
+
+typedef struct {
+  uint8_t channel;
+  uint16_t panid;
+  uint16_t etx;              /* 0 = beacon without payload */
+  int8_t rssi;
+} test_beacon_t;
+
+typedef struct {
+  const char *name;
+  const test_beacon_t *beacons;
+  int count;
+  int channel;               /* Expected channel, 0 = no network selected */
+  uint16_t etx;              /* Expected ETX in the beacon payload, or 0 */
+} test_case_t;
+
+#define BEACONS(b) b, sizeof(b) / sizeof(test_beacon_t)
+
+static const test_beacon_t lowest_etx[] = {
+  { 15, IEEE802154_PANID, 512, NO_RSSI },
+  { 20, IEEE802154_PANID, 256, NO_RSSI },
+  { 25, IEEE802154_PANID, 384, NO_RSSI },
+};
+static const test_beacon_t unknown_etx[] = {
+  { 11, IEEE802154_PANID, 0, NO_RSSI },
+  { 12, IEEE802154_PANID, 900, NO_RSSI },
+};
+static const test_beacon_t weak_signal[] = {
+  { 15, IEEE802154_PANID, 256, -90 },
+  { 16, IEEE802154_PANID, 384, -60 },
+};
+static const test_beacon_t other_panid[] = {
+  { 11, OTHER_PANID, 128, NO_RSSI },
+  { 12, IEEE802154_PANID, 512, NO_RSSI },
+};
+static const test_beacon_t busy_channel[] = {
+  { 15, IEEE802154_PANID, 256, NO_RSSI },
+  { 15, OTHER_PANID, 128, NO_RSSI },
+  { 15, OTHER_PANID, 128, NO_RSSI },
+  { 15, OTHER_PANID, 128, NO_RSSI },
+  { 15, OTHER_PANID, 128, NO_RSSI },
+  { 15, OTHER_PANID, 128, NO_RSSI },
+  { 20, IEEE802154_PANID, 512, NO_RSSI },
+};
+static const test_beacon_t best_beacon[] = {
+  { 15, IEEE802154_PANID, 800, NO_RSSI },
+  { 15, IEEE802154_PANID, 300, NO_RSSI },
+  { 15, IEEE802154_PANID, 600, NO_RSSI },
+  { 20, IEEE802154_PANID, 400, NO_RSSI },
+};
+static const test_beacon_t many_networks[] = {
+  { 11, IEEE802154_PANID, 900, NO_RSSI },
+  { 13, IEEE802154_PANID, 800, NO_RSSI },
+  { 15, IEEE802154_PANID, 700, NO_RSSI },
+  { 17, IEEE802154_PANID, 600, NO_RSSI },
+  { 19, IEEE802154_PANID, 950, NO_RSSI },
+  { 21, IEEE802154_PANID, 500, NO_RSSI },
+  { 23, IEEE802154_PANID, 200, NO_RSSI },
+};
+static const test_beacon_t only_other_panids[] = {
+  { 11, OTHER_PANID, 128, NO_RSSI },
+  { 26, OTHER_PANID, 128, NO_RSSI },
+};
+
+static const test_case_t test_cases[] = {
+  { "lowest etx", BEACONS(lowest_etx), 20, 256 },
+  { "unknown etx", BEACONS(unknown_etx), 12, 900 },
+  { "weak signal", BEACONS(weak_signal), 16, 384 },
+  { "other pan id", BEACONS(other_panid), 12, 512 },
+  { "busy channel", BEACONS(busy_channel), 20, 512 },
+  { "best beacon", BEACONS(best_beacon), 15, 300 },
+  { "many networks", BEACONS(many_networks), 23, 200 },
+  { "only other pan ids", BEACONS(only_other_panids), 0, 0 },
+  { "nothing heard", NULL, 0, 0, 0 },
+};
+
+/* Beacons for the join fallback test */
+static const test_beacon_t join_networks[] = {
+  { 15, IEEE802154_PANID, 256, NO_RSSI },
+  { 20, IEEE802154_PANID, 384, NO_RSSI },
+  { 25, IEEE802154_PANID, 512, NO_RSSI },
+};
+static const test_beacon_t rescan_networks[] = {
+  { 15, IEEE802154_PANID, 256, NO_RSSI },
+  { 18, IEEE802154_PANID, 1000, NO_RSSI },
+};
+
+/* The calls from the selector to netscan */
+static int selected_channel;
+static uint16_t selected_panid;
+static uint8_t selected_payload[32];
+static uint8_t selected_payload_len;
+static int start_count;
+
+static int failures;
+
+PROCESS(netscan_selector_test_process, "Netscan selector test");
+AUTOSTART_PROCESSES(&netscan_selector_test_process);
+/*---------------------------------------------------------------------------*/
+void
+netscan_select_network(int channel, uint16_t panid)
+{
+  selected_channel = channel;
+  selected_panid = panid;
+}
+/*---------------------------------------------------------------------------*/
+int
+netscan_set_beacon_payload(const uint8_t *payload, uint8_t payload_length)
+{
+  if(payload_length > sizeof(selected_payload)) {
+    return 0;
+  }
+  memcpy(selected_payload, payload, payload_length);
+  selected_payload_len = payload_length;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+netscan_start(void)
+{
+  start_count++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+clear_selection(void)
+{
+  selected_channel = 0;
+  selected_panid = 0;
+  selected_payload_len = 0;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+get_selected_etx(void)
+{
+  /* Sparrow beacon: 0xfe, ETX TLV (length, type 5, value), end */
+  if(selected_payload_len == 6 && selected_payload[2] == 5) {
+    return (selected_payload[3] << 8) | selected_payload[4];
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+check(const char *name, int condition)
+{
+  if(!condition) {
+    printf("FAIL %s: selected ch %d pan id %04x etx %u, %d scans started\n",
+           name, selected_channel, selected_panid, get_selected_etx(),
+           start_count);
+    failures++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+receive_beacon(const test_beacon_t *b)
+{
+  uint8_t payload[6];
+
+  payload[0] = 0xfe;
+  payload[1] = 4;
+  payload[2] = 5;
+  payload[3] = b->etx >> 8;
+  payload[4] = b->etx & 0xff;
+  payload[5] = 0;
+
+  /* The selector reads the signal strength from packetbuf */
+  packetbuf_clear();
+  packetbuf_set_attr(PACKETBUF_ATTR_RSSI, (uint16_t)(int16_t)b->rssi);
+  if(b->etx == 0) {
+    netscan_scored_selector.beacon_received(b->channel, b->panid, NULL,
+                                            NULL, 0);
+  } else {
+    netscan_scored_selector.beacon_received(b->channel, b->panid, NULL,
+                                            payload, sizeof(payload));
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Feed the beacons channel by channel as a full scan. Returns the
+ * action for the last channel.
+ */
+static netscan_action_t
+scan(const test_beacon_t *beacons, int count)
+{
+  netscan_action_t action;
+  int channel, i;
+
+  action = NETSCAN_CONTINUE;
+  for(channel = 11; channel <= 26; channel++) {
+    for(i = 0; i < count; i++) {
+      if(beacons[i].channel == channel) {
+        receive_beacon(&beacons[i]);
+      }
+    }
+    action = netscan_scored_selector.channel_done(channel, channel == 26);
+    if(channel < 26 && action != NETSCAN_CONTINUE) {
+      printf("FAIL scan stopped at channel %d\n", channel);
+      failures++;
+    }
+  }
+  return action;
+}
+/*---------------------------------------------------------------------------*/
+static void
+run_test_cases(void)
+{
+  const test_case_t *t;
+  netscan_action_t action;
+  int i;
+
+  for(i = 0; i < (int)(sizeof(test_cases) / sizeof(test_case_t)); i++) {
+    t = &test_cases[i];
+    netscan_scored_selector.init();
+    clear_selection();
+    action = scan(t->beacons, t->count);
+    if(t->channel == 0) {
+      check(t->name, action == NETSCAN_CONTINUE && selected_channel == 0);
+    } else {
+      check(t->name, action == NETSCAN_STOP
+            && selected_channel == t->channel
+            && selected_panid == IEEE802154_PANID
+            && get_selected_etx() == t->etx);
+    }
+    printf("%-20s ch %2d etx %4u\n", t->name, selected_channel,
+           get_selected_etx());
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(netscan_selector_test_process, ev, data)
+{
+  static struct etimer et;
+  static int expected[] = { 20, 25 };
+  static int i;
+
+  PROCESS_BEGIN();
+
+  run_test_cases();
+
+  /* The next best network is tried when the join time expires */
+  netscan_scored_selector.init();
+  clear_selection();
+  start_count = 0;
+  scan(join_networks, sizeof(join_networks) / sizeof(test_beacon_t));
+
+  /* Check halfway between the join timeouts */
+  etimer_set(&et, NETSCAN_SCORED_CONF_JOIN_TIME / 2);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  check("join first", selected_channel == 15);
+  for(i = 0; i < 2; i++) {
+    etimer_set(&et, NETSCAN_SCORED_CONF_JOIN_TIME);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+    printf("join timeout         ch %2d\n", selected_channel);
+    check("join fallback", selected_channel == expected[i] && start_count == 0);
+  }
+
+  /* A new scan is started when all networks have failed */
+  etimer_set(&et, NETSCAN_SCORED_CONF_JOIN_TIME);
+  PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+  check("join rescan", start_count == 1);
+
+  /* Networks that failed to join cost more in the next scan */
+  clear_selection();
+  scan(rescan_networks, sizeof(rescan_networks) / sizeof(test_beacon_t));
+  printf("after join failures  ch %2d etx %4u\n", selected_channel,
+         get_selected_etx());
+  check("join failure cost", selected_channel == 18);
+
+  printf("%s\n", failures > 0 ? "FAILED" : "OK");
+  exit(failures > 0 ? 1 : 0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
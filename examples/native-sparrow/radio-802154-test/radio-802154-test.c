@@ -0,0 +1,518 @@
+/*
+ * Copyright (c) 2016, Yanzi Networks AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *    3. Neither the name of the copyright holders nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Host test of the RX frame ring in radio-802154-dev.
+ *
+ *         A few directed tests check the capacity and the drop counters,
+ *         followed by a stress run of random frame sizes, bursts, dropped
+ *         frames and frames written while the reader holds a frame. The
+ *         ring is compared against a FIFO model of the queued frames.
+ */
+
+#include "contiki.h"
+#include "dev/radio.h"
+#include "dev/radio-802154-dev.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_OPS     1000000
+#define MAX_QUEUED      256
+#define MAX_REPORTS     10
+
+/* Same layout as in radio-802154-dev.c */
+#define RING_BYTES      (sizeof(test_radio_state.rx_ring))
+#define HDR_LEN         offsetof(radio_802154_rf_buffer_t, buffer)
+#define FRAME_SIZE(len) \
+  ((HDR_LEN + (len) + RADIO_802154_RX_ALIGN - 1) & ~(RADIO_802154_RX_ALIGN - 1))
+#define MAX_FRAME_SIZE  FRAME_SIZE(RADIO_802154_BUFFER_SIZE)
+
+/*
+ * Full size frames that the ring must hold wherever it starts. The
+ * default ring has the RAM of RADIO_802154_BUFFER_COUNT fixed buffers,
+ * less the frame alignment and up to one frame lost on a wrap.
+ */
+#ifdef RX_RING_FRAMES
+#define MIN_FULL_FRAMES RX_RING_FRAMES
+#else
+#define MIN_FULL_FRAMES (RADIO_802154_BUFFER_COUNT - 2)
+#endif
+
+/* Frame sizes of an ACK and a short data frame */
+#define ACK_LEN         5
+#define SHORT_LEN       20
+
+/* How a frame is written by the driver */
+enum {
+  WRITE_OK,        /* Reserve the frame length */
+  WRITE_FULL,      /* Reserve a full frame and then keep the length */
+  WRITE_BAD,       /* Released as not ok, for example bad CRC */
+  WRITE_OVERRUN,   /* Length larger than reserved */
+};
+
+struct queued {
+  radio_802154_rf_buffer_t *buf;
+  uint8_t len;
+  uint8_t seed;
+};
+
+static const struct radio_driver test_driver;
+RADIO_802154_DRIVER(test_radio, test_driver, 0, 0, 0, 0, NULL);
+
+static struct queued queue[MAX_QUEUED];
+static int queue_first;
+static int queue_count;
+static int queue_bytes;
+static int max_queue_count;
+
+static uint32_t drop_full;
+static uint32_t drop_too_long;
+static uint32_t drop_bad;
+static unsigned long frames_written;
+static unsigned long frames_read;
+static unsigned long wraps;
+static uint16_t last_pos;
+
+static uint32_t rand_state;
+static int failures;
+
+extern int contiki_argc;
+extern char **contiki_argv;
+
+PROCESS(radio_802154_test_process, "radio-802154-dev test");
+AUTOSTART_PROCESSES(&radio_802154_test_process);
+/*---------------------------------------------------------------------------*/
+/* Own generator to get the same sequence on all hosts */
+static uint32_t
+next_rand(void)
+{
+  rand_state ^= rand_state << 13;
+  rand_state ^= rand_state >> 17;
+  rand_state ^= rand_state << 5;
+  return rand_state;
+}
+/*---------------------------------------------------------------------------*/
+/* Random frame length, frames shorter than an ACK are never stored */
+static uint8_t
+random_len(uint8_t max)
+{
+  return RADIO_802154_ACK_LEN + next_rand() % (max - RADIO_802154_ACK_LEN + 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *what, long op)
+{
+  failures++;
+  if(failures <= MAX_REPORTS) {
+    printf("FAIL %s at %ld (queued %d frames %d bytes, read %u write %u)\n",
+           what, op, queue_count, queue_bytes,
+           test_radio_state.read_pos, test_radio_state.write_pos);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+ring_pos(const radio_802154_rf_buffer_t *buf)
+{
+  return (const uint8_t *)buf - (const uint8_t *)test_radio_state.rx_ring;
+}
+/*---------------------------------------------------------------------------*/
+static void
+fill(radio_802154_rf_buffer_t *buf, uint8_t len, uint8_t seed)
+{
+  int i;
+
+  buf->rssi = seed;
+  buf->crc_corr = seed ^ 0x80;
+  buf->len = len;
+#if RADIO_802154_WITH_TIMESTAMP
+  buf->timestamp = seed * 257;
+#endif
+  for(i = 0; i < len; i++) {
+    buf->buffer[i] = seed + i * 7;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+is_intact(const radio_802154_rf_buffer_t *buf, const struct queued *q)
+{
+  int i;
+
+  if(buf != q->buf || buf->len != q->len || buf->rssi != (int8_t)q->seed
+     || buf->crc_corr != (q->seed ^ 0x80)) {
+    return 0;
+  }
+#if RADIO_802154_WITH_TIMESTAMP
+  if(buf->timestamp != (uint16_t)(q->seed * 257)) {
+    return 0;
+  }
+#endif
+  for(i = 0; i < q->len; i++) {
+    if(buf->buffer[i] != (uint8_t)(q->seed + i * 7)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/* Checks that a new write buffer is inside the ring and free */
+static int
+is_free(const radio_802154_rf_buffer_t *buf, int size)
+{
+  int pos, i, start, end;
+
+  pos = ring_pos(buf);
+  if(pos < 0 || pos % RADIO_802154_RX_ALIGN != 0 || pos + size > RING_BYTES) {
+    return 0;
+  }
+  for(i = 0; i < queue_count; i++) {
+    const struct queued *q = &queue[(queue_first + i) % MAX_QUEUED];
+    start = ring_pos(q->buf);
+    end = start + FRAME_SIZE(q->len);
+    if(pos < end && start < pos + size) {
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * An allocation may only fail when the free space, less what is lost
+ * at the end of the ring by a wrap, is smaller than the frame.
+ */
+static int
+may_be_full(int size)
+{
+  return queue_bytes + size + MAX_FRAME_SIZE >= RING_BYTES;
+}
+/*---------------------------------------------------------------------------*/
+static void
+write_frame(long op, uint8_t len, int mode)
+{
+  radio_802154_rf_buffer_t *buf;
+  struct queued *q;
+  int size;
+  uint8_t seed;
+
+  if(mode == WRITE_FULL) {
+    buf = radio_802154_get_writebuf(&test_radio);
+    size = MAX_FRAME_SIZE;
+  } else {
+    buf = radio_802154_get_writebuf_len(&test_radio, len);
+    size = FRAME_SIZE(len);
+  }
+  if(buf == NULL) {
+    drop_full++;
+    if(!may_be_full(size)) {
+      report("no write buffer with free space", op);
+    }
+    return;
+  }
+  if(!is_free(buf, size)) {
+    report("write buffer overlaps queued frames", op);
+    return;
+  }
+
+  seed = next_rand();
+  fill(buf, len, seed);
+  if(mode == WRITE_BAD) {
+    radio_802154_release_writebuf(&test_radio, 0);
+    drop_bad++;
+    return;
+  }
+  if(mode == WRITE_OVERRUN) {
+    /* Only the length is changed, the data would overrun the frame */
+    buf->len = len + RADIO_802154_RX_ALIGN;
+    radio_802154_release_writebuf(&test_radio, 1);
+    drop_bad++;
+    return;
+  }
+  radio_802154_release_writebuf(&test_radio, 1);
+
+  if(queue_count == MAX_QUEUED) {
+    report("too many queued frames", op);
+    return;
+  }
+  if(ring_pos(buf) < last_pos) {
+    wraps++;
+  }
+  last_pos = ring_pos(buf);
+  q = &queue[(queue_first + queue_count) % MAX_QUEUED];
+  q->buf = buf;
+  q->len = len;
+  q->seed = seed;
+  queue_count++;
+  queue_bytes += FRAME_SIZE(len);
+  if(queue_count > max_queue_count) {
+    max_queue_count = queue_count;
+  }
+  frames_written++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+random_write(long op)
+{
+  uint8_t len;
+  uint32_t r;
+  int mode;
+
+  r = next_rand();
+  /* Mostly ACKs and short frames with some full size frames */
+  switch(r % 8) {
+  case 0: case 1: case 2:
+    len = ACK_LEN;
+    break;
+  case 3: case 4:
+    len = random_len(SHORT_LEN);
+    break;
+  case 5:
+    len = RADIO_802154_BUFFER_SIZE;
+    break;
+  default:
+    len = random_len(RADIO_802154_BUFFER_SIZE);
+    break;
+  }
+  switch((r >> 16) % 32) {
+  case 0:
+    mode = WRITE_BAD;
+    break;
+  case 1:
+    mode = len + RADIO_802154_RX_ALIGN <= RADIO_802154_BUFFER_SIZE
+      ? WRITE_OVERRUN : WRITE_BAD;
+    break;
+  case 2: case 3: case 4: case 5:
+    mode = WRITE_FULL;
+    break;
+  default:
+    mode = WRITE_OK;
+    break;
+  }
+  write_frame(op, len, mode);
+}
+/*---------------------------------------------------------------------------*/
+/* Returns 1 if a queued frame was read */
+static int
+read_frame(long op, int writes)
+{
+  radio_802154_rf_buffer_t *buf;
+  const struct queued *q;
+
+  buf = radio_802154_get_readbuf(&test_radio);
+  if(queue_count == 0) {
+    if(buf != NULL) {
+      report("read buffer from empty ring", op);
+    }
+    return 0;
+  }
+  q = &queue[queue_first];
+  if(buf == NULL || !is_intact(buf, q)) {
+    report("read buffer differs", op);
+    return 0;
+  }
+
+  /* Frames received while the reader holds the frame */
+  for(; writes > 0; writes--) {
+    random_write(op);
+  }
+  if(!is_intact(buf, q)) {
+    report("read buffer overwritten", op);
+  }
+
+  radio_802154_release_readbuf(&test_radio);
+  queue_first = (queue_first + 1) % MAX_QUEUED;
+  queue_count--;
+  queue_bytes -= FRAME_SIZE(q->len);
+  frames_read++;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+clear(void)
+{
+  radio_802154_clear(&test_radio);
+  queue_first = (queue_first + queue_count) % MAX_QUEUED;
+  queue_count = 0;
+  queue_bytes = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_state(long op)
+{
+  const struct radio_802154_rx_stats *stats;
+
+  if(radio_802154_rx_buf_is_empty(&test_radio) != (queue_count == 0)) {
+    report("empty state", op);
+  }
+  if(!radio_802154_rx_buf_has_empty(&test_radio)
+     && !may_be_full(MAX_FRAME_SIZE)) {
+    report("no room for a full frame", op);
+  }
+
+  stats = radio_802154_get_rx_stats(&test_radio);
+  if(stats->drop_full != drop_full || stats->drop_too_long != drop_too_long
+     || stats->drop_bad != drop_bad) {
+    report("drop counters", op);
+  }
+  if(stats->high_water_frames != max_queue_count
+     || stats->high_water_bytes > RING_BYTES) {
+    report("high water marks", op);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Moves the empty ring to a random position and fills it with frames
+ * of one length. Returns the number of frames that fit.
+ */
+static int
+fill_ring(uint8_t len)
+{
+  uint32_t full;
+  int i;
+
+  clear();
+  write_frame(-1, random_len(RADIO_802154_BUFFER_SIZE), WRITE_OK);
+  read_frame(-1, 0);
+
+  full = drop_full;
+  for(i = 0; i < MAX_QUEUED && drop_full == full; i++) {
+    write_frame(-1, len, WRITE_OK);
+  }
+  return queue_count;
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_directed(void)
+{
+  int count, min_full, min_ack, i;
+
+  /* One frame of each length in order */
+  for(i = RADIO_802154_ACK_LEN; i <= RADIO_802154_BUFFER_SIZE; i++) {
+    write_frame(-1, i, WRITE_OK);
+    read_frame(-1, 0);
+    check_state(-1);
+  }
+
+  min_full = min_ack = MAX_QUEUED;
+  for(i = 0; i < 1000; i++) {
+    count = fill_ring(RADIO_802154_BUFFER_SIZE);
+    if(count < min_full) {
+      min_full = count;
+    }
+    count = fill_ring(ACK_LEN);
+    if(count < min_ack) {
+      min_ack = count;
+    }
+    check_state(-1);
+  }
+  printf("ring of %u bytes holds at least %d full size frames, %d ACKs\n",
+         (unsigned)RING_BYTES, min_full, min_ack);
+  if(min_full < MIN_FULL_FRAMES) {
+    report("ring holds too few full size frames", -1);
+  }
+  if(min_ack < RING_BYTES / FRAME_SIZE(ACK_LEN) - 2) {
+    report("ring not filled by ACKs", -1);
+  }
+
+  /* Drain the ring and check that all frames are kept */
+  fill_ring(SHORT_LEN);
+  while(read_frame(-1, 0));
+  check_state(-1);
+
+  if(radio_802154_get_writebuf_len(&test_radio, RADIO_802154_BUFFER_SIZE + 1)
+     != NULL) {
+    report("too long frame accepted", -1);
+  }
+  drop_too_long++;
+  check_state(-1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+test_stress(long ops)
+{
+  long op;
+  int write_share;
+  uint32_t r;
+
+  write_share = 50;
+  for(op = 0; op < ops; op++) {
+    r = next_rand();
+    /* Alternate between bursts of received frames and a busy reader */
+    if(r % 1024 == 0) {
+      write_share = 20 + (r >> 10) % 61;
+    }
+    r >>= 10;
+    if(r % 100000 == 0) {
+      clear();
+    } else if(r % 100 < write_share) {
+      random_write(op);
+    } else {
+      read_frame(op, r % 8 == 0 ? (r >> 8) % 4 : 0);
+    }
+    check_state(op);
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(radio_802154_test_process, ev, data)
+{
+  long ops;
+
+  PROCESS_BEGIN();
+
+  ops = DEFAULT_OPS;
+  rand_state = 1;
+  if(contiki_argc > 1) {
+    ops = atol(contiki_argv[1]);
+  }
+  if(contiki_argc > 2) {
+    rand_state = strtoul(contiki_argv[2], NULL, 0);
+    if(rand_state == 0) {
+      rand_state = 1;
+    }
+  }
+
+  test_directed();
+  test_stress(ops);
+
+  printf("%ld operations: %lu frames written, %lu read, %lu wraps\n",
+         ops, frames_written, frames_read, wraps);
+  printf("max %d frames queued, dropped %lu full, %lu too long, %lu bad\n",
+         max_queue_count, (unsigned long)drop_full,
+         (unsigned long)drop_too_long, (unsigned long)drop_bad);
+  if(ops > 0 && (wraps == 0 || drop_full == 0)) {
+    report("stress run did not wrap and fill the ring", ops);
+  }
+
+  printf("%s\n", failures > 0 ? "FAILED" : "OK");
+  exit(failures > 0 ? 1 : 0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,533 @@
+/*
+ * Copyright (c) 2016, Yanzi Networks AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *    3. Neither the name of the copyright holders nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Micro-benchmarks of the sparrow protocol stack.
+ *
+ *         Runs each benchmark until the timing is stable and writes the
+ *         result as CSV with ns/op and bytes/s for regression tracking.
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/sicslowpan.h"
+#include "net/mac/frame802154.h"
+#include "net/packetbuf.h"
+#include "lib/crc32.h"
+#include "sparrow.h"
+#include "sparrow-oam.h"
+#include "sparrow-encap.h"
+#include "sparrow-tlv.h"
+#include "packetutils.h"
+#include "slip-codec.h"
+#include "er-coap.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Minimum time for one timed repetition of a benchmark */
+#define MIN_TIME          0.05
+#define REPETITIONS       5
+
+#define BUFFER_SIZE       512
+#define FRAME_PAYLOAD_LEN 96
+#define CRC_DATA_LEN      256
+#define IPHC_PAYLOAD_LEN  32
+
+#define UIP_IP_BUF ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+struct bench {
+  const char *name;
+  void (* setup)(void);
+  /* Runs one operation and returns the number of bytes processed */
+  int (* run)(void);
+};
+
+static uint8_t frame[BUFFER_SIZE];
+static int frame_len;
+static uint8_t buffer[SLIP_CODEC_MAX_ENCODED_LEN(BUFFER_SIZE)];
+static int buffer_len;
+static sparrow_encap_pdu_info_t pinfo;
+
+/* Keeps the results alive to avoid optimizing away the operations */
+static volatile int sink;
+
+extern int contiki_argc;
+extern char **contiki_argv;
+
+PROCESS(sparrow_bench_process, "Sparrow benchmark");
+AUTOSTART_PROCESSES(&sparrow_bench_process);
+/*---------------------------------------------------------------------------*/
+static void
+fill_random(uint8_t *data, int len)
+{
+  int i;
+  for(i = 0; i < len; i++) {
+    data[i] = rand();
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Serial frames as sent by enc-dev.c: encapsulation header with
+ * length option, payload and CRC32.
+ */
+static int
+write_serial_frame(uint8_t *buf, size_t size, const uint8_t *data, int len)
+{
+  uint8_t finger[4];
+  sparrow_encap_pdu_info_t info;
+  uint32_t crc_value;
+  int enc_res;
+
+  finger[0] = 0;
+  finger[1] = SPARROW_ENCAP_FP_LENOPT_OPTION_CRC;
+  finger[2] = len >> 8;
+  finger[3] = len & 0xff;
+
+  info.version = SPARROW_ENCAP_VERSION1;
+  info.fp = finger;
+  info.iv = NULL;
+  info.payload_len = len;
+  info.payload_type = SPARROW_ENCAP_PAYLOAD_SERIAL;
+  info.fpmode = SPARROW_ENCAP_FP_MODE_LENOPT;
+  info.fplen = 4;
+  info.ivmode = SPARROW_ENCAP_IVMODE_NONE;
+  info.ivlen = 0;
+
+  enc_res = sparrow_encap_write_header(buf, size, &info);
+  memcpy(buf + enc_res, data, len);
+  crc_value = crc32(buf, enc_res + len);
+  buf[enc_res + len + 0] = (crc_value >> 0L) & 0xff;
+  buf[enc_res + len + 1] = (crc_value >> 8L) & 0xff;
+  buf[enc_res + len + 2] = (crc_value >> 16L) & 0xff;
+  buf[enc_res + len + 3] = (crc_value >> 24L) & 0xff;
+  return sparrow_encap_finalize(buf, size, &info, enc_res + len + 4);
+}
+/*---------------------------------------------------------------------------*/
+static void
+setup_serial_frame(void)
+{
+  uint8_t payload[FRAME_PAYLOAD_LEN];
+
+  fill_random(payload, sizeof(payload));
+  frame_len = write_serial_frame(frame, sizeof(frame), payload, sizeof(payload));
+}
+/*---------------------------------------------------------------------------*/
+static int
+run_encap_parse(void)
+{
+  sink = sparrow_encap_parse_and_verify(frame, frame_len, &pinfo);
+  return frame_len;
+}
+/*---------------------------------------------------------------------------*/
+static int
+run_encap_finalize(void)
+{
+  sink = write_serial_frame(buffer, sizeof(buffer), frame, FRAME_PAYLOAD_LEN);
+  return sink;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Discovery of the product instance followed by a few status
+ * variables as a unit controller does after boot.
+ */
+static void
+setup_oam_request(void)
+{
+  sparrow_tlv_t t;
+  static const struct {
+    uint16_t variable;
+    uint8_t element_size;
+  } vars[] = {
+    { 0x000, 8 },  /* object type */
+    { 0x001, 16 }, /* object id */
+    { 0x002, 32 }, /* object label */
+    { 0x003, 4 },  /* number of instances */
+    { 0x0c9, 8 },  /* unit boot timer */
+    { 0x0cc, 16 }, /* software revision */
+    { 0x0e6, 4 },  /* received OAM pdus */
+    { 0x0e7, 4 },  /* transmitted OAM pdus */
+  };
+  int i;
+
+  sparrow_oam_init();
+
+  frame_len = 0;
+  for(i = 0; i < sizeof(vars) / sizeof(vars[0]); i++) {
+    sparrow_tlv_init_get32(&t, 0, vars[i].variable);
+    t.element_size = vars[i].element_size;
+    frame_len += sparrow_tlv_to_bytes(&t, frame + frame_len,
+                                      sizeof(frame) - frame_len);
+  }
+  memset(&pinfo, 0, sizeof(pinfo));
+  pinfo.version = SPARROW_ENCAP_VERSION1;
+  pinfo.payload_type = SPARROW_ENCAP_PAYLOAD_TLV;
+}
+/*---------------------------------------------------------------------------*/
+static int
+run_oam_process_request(void)
+{
+  sink = sparrow_oam_process_request(frame, frame_len, buffer, sizeof(buffer),
+                                     &pinfo);
+  return frame_len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+setup_slip(void)
+{
+  /* Random data gives a realistic share of bytes needing escape */
+  fill_random(frame, 127);
+  frame_len = 127;
+  buffer_len = slip_codec_encode(buffer, frame, frame_len);
+}
+/*---------------------------------------------------------------------------*/
+static int
+run_slip_encode(void)
+{
+  sink = slip_codec_encode(buffer, frame, frame_len);
+  return frame_len;
+}
+/*---------------------------------------------------------------------------*/
+static int
+run_slip_decode(void)
+{
+  uint8_t state = 0;
+  int i, pos = 0;
+
+  for(i = 0; i < buffer_len; i++) {
+    slip_codec_decode(&state, buffer[i], frame, &pos);
+  }
+  sink = pos;
+  return buffer_len;
+}
+/*---------------------------------------------------------------------------*/
+static void
+setup_crc32(void)
+{
+  fill_random(frame, CRC_DATA_LEN);
+  frame_len = CRC_DATA_LEN;
+}
+/*---------------------------------------------------------------------------*/
+static int
+run_crc32(void)
+{
+  sink = crc32(frame, frame_len);
+  return frame_len;
+}
+/*---------------------------------------------------------------------------*/
+static frame802154_t frame802154;
+/*---------------------------------------------------------------------------*/
+static void
+setup_frame802154(void)
+{
+  static uint8_t payload[FRAME_PAYLOAD_LEN];
+  int hdr_len;
+
+  memset(&frame802154, 0, sizeof(frame802154));
+  frame802154.fcf.frame_type = FRAME802154_DATAFRAME;
+  frame802154.fcf.ack_required = 1;
+  frame802154.fcf.panid_compression = 1;
+  frame802154.fcf.frame_version = FRAME802154_IEEE802154_2006;
+  frame802154.fcf.dest_addr_mode = FRAME802154_LONGADDRMODE;
+  frame802154.fcf.src_addr_mode = FRAME802154_LONGADDRMODE;
+  frame802154.seq = 17;
+  frame802154.dest_pid = 0xabcd;
+  frame802154.src_pid = 0xabcd;
+  fill_random(frame802154.dest_addr, 8);
+  fill_random(frame802154.src_addr, 8);
+  fill_random(payload, sizeof(payload));
+  frame802154.payload = payload;
+  frame802154.payload_len = sizeof(payload);
+
+  hdr_len = frame802154_hdrlen(&frame802154);
+  frame802154_create(&frame802154, frame, hdr_len);
+  memcpy(frame + hdr_len, payload, sizeof(payload));
+  frame_len = hdr_len + sizeof(payload);
+}
+/*---------------------------------------------------------------------------*/
+static int
+run_frame802154_create(void)
+{
+  int hdr_len;
+
+  hdr_len = frame802154_hdrlen(&frame802154);
+  sink = frame802154_create(&frame802154, buffer, hdr_len);
+  return hdr_len;
+}
+/*---------------------------------------------------------------------------*/
+static int
+run_frame802154_parse(void)
+{
+  frame802154_t parsed;
+
+  sink = frame802154_parse(frame, frame_len, &parsed);
+  return frame_len;
+}
+/*---------------------------------------------------------------------------*/
+static linkaddr_t iphc_src;
+static linkaddr_t iphc_dest;
+static uint8_t iphc_ip[UIP_IPH_LEN + UIP_UDPH_LEN];
+static int iphc_len;
+/*---------------------------------------------------------------------------*/
+static void
+setup_iphc(void)
+{
+  struct uip_ip_hdr *ip;
+  struct uip_udp_hdr *udp;
+
+  /* OAM reply from a node in the DODAG prefix to the border router */
+  memset(iphc_ip, 0, sizeof(iphc_ip));
+  ip = (struct uip_ip_hdr *)iphc_ip;
+  udp = (struct uip_udp_hdr *)&iphc_ip[UIP_IPH_LEN];
+  ip->vtc = 0x60;
+  ip->proto = UIP_PROTO_UDP;
+  ip->ttl = 64;
+  ip->len[1] = UIP_UDPH_LEN + IPHC_PAYLOAD_LEN;
+  uip_ip6addr(&ip->srcipaddr, UIP_DS6_DEFAULT_PREFIX, 0, 0, 0,
+              0x0212, 0x4b00, 0, 0x1234);
+  uip_ip6addr(&ip->destipaddr, UIP_DS6_DEFAULT_PREFIX, 0, 0, 0,
+              0x0212, 0x4b00, 0, 0x0001);
+  udp->srcport = UIP_HTONS(SPARROW_OAM_PORT);
+  udp->destport = UIP_HTONS(SPARROW_OAM_PORT);
+  udp->udplen = UIP_HTONS(UIP_UDPH_LEN + IPHC_PAYLOAD_LEN);
+  udp->udpchksum = 0x4711;
+  iphc_len = UIP_IPH_LEN + UIP_UDPH_LEN + IPHC_PAYLOAD_LEN;
+
+  /* Link addresses derived from the IID as for autoconfigured addresses */
+  memcpy(iphc_src.u8, &ip->srcipaddr.u8[16 - LINKADDR_SIZE], LINKADDR_SIZE);
+  iphc_src.u8[0] ^= 0x02;
+  memcpy(iphc_dest.u8, &ip->destipaddr.u8[16 - LINKADDR_SIZE], LINKADDR_SIZE);
+  iphc_dest.u8[0] ^= 0x02;
+  memcpy(uip_lladdr.addr, iphc_src.u8, sizeof(uip_lladdr.addr));
+
+  memcpy(UIP_IP_BUF, iphc_ip, sizeof(iphc_ip));
+  uip_len = iphc_len;
+  sicslowpan_iphc_bench_compress(&iphc_dest, 1);
+  frame_len = packetbuf_datalen();
+  memcpy(frame, packetbuf_dataptr(), frame_len);
+}
+/*---------------------------------------------------------------------------*/
+static int
+run_iphc_compress(void)
+{
+  /* Only the headers are needed for the compression */
+  memcpy(UIP_IP_BUF, iphc_ip, sizeof(iphc_ip));
+  uip_len = iphc_len;
+  sink = sicslowpan_iphc_bench_compress(&iphc_dest, 1);
+  /* Bytes are counted as the uncompressed headers in both directions */
+  return sizeof(iphc_ip);
+}
+/*---------------------------------------------------------------------------*/
+static int
+run_iphc_uncompress(void)
+{
+  memcpy(packetbuf_dataptr(), frame, frame_len);
+  packetbuf_set_datalen(frame_len);
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &iphc_src);
+  packetbuf_set_addr(PACKETBUF_ADDR_RECEIVER, &iphc_dest);
+  sink = sicslowpan_iphc_bench_uncompress(buffer, 1);
+  return sizeof(iphc_ip);
+}
+/*---------------------------------------------------------------------------*/
+static coap_packet_t coap_request;
+static const char coap_payload[] = "{\"temperature\":295150,\"unit\":\"mK\"}";
+/*---------------------------------------------------------------------------*/
+static void
+setup_coap(void)
+{
+  static const uint8_t token[] = { 0x4a, 0x11, 0x0c, 0x3e };
+
+  coap_init_message(&coap_request, COAP_TYPE_CON, COAP_PUT, 0x1234);
+  coap_set_token(&coap_request, token, sizeof(token));
+  coap_set_header_uri_path(&coap_request, "sensors/temperature");
+  coap_set_header_content_format(&coap_request, APPLICATION_JSON);
+  coap_set_payload(&coap_request, coap_payload, sizeof(coap_payload) - 1);
+  frame_len = coap_serialize_message(&coap_request, frame);
+}
+/*---------------------------------------------------------------------------*/
+static int
+run_coap_serialize(void)
+{
+  /* The payload is copied into the buffer when serializing */
+  coap_set_payload(&coap_request, coap_payload, sizeof(coap_payload) - 1);
+  sink = coap_serialize_message(&coap_request, buffer);
+  return sink;
+}
+/*---------------------------------------------------------------------------*/
+static int
+run_coap_parse(void)
+{
+  static coap_packet_t parsed;
+
+  /* Parsing is done in place and modifies the message */
+  memcpy(buffer, frame, frame_len);
+  sink = coap_parse_message(&parsed, buffer, frame_len);
+  return frame_len;
+}
+/*---------------------------------------------------------------------------*/
+static int rx_count;
+/*---------------------------------------------------------------------------*/
+static void
+set_rx_atts(void)
+{
+  /* Attributes of a received frame with slightly varying link quality */
+  rx_count++;
+  packetbuf_set_attr(PACKETBUF_ATTR_CHANNEL, 26);
+  packetbuf_set_attr(PACKETBUF_ATTR_RSSI, (uint16_t)(-70 + (rx_count & 3)));
+  packetbuf_set_attr(PACKETBUF_ATTR_LINK_QUALITY, 100 + (rx_count & 7));
+  packetbuf_set_attr(PACKETBUF_ATTR_TIMESTAMP, rx_count * 17);
+  packetbuf_set_attr(PACKETBUF_ATTR_MAC_SEQNO, rx_count);
+}
+/*---------------------------------------------------------------------------*/
+static void
+setup_atts_legacy(void)
+{
+  packetbuf_clear();
+  packetutils_set_atts_encoding(PACKETUTILS_ATTS_LEGACY);
+}
+/*---------------------------------------------------------------------------*/
+static void
+setup_atts_compact(void)
+{
+  packetbuf_clear();
+  packetutils_set_atts_encoding(PACKETUTILS_ATTS_COMPACT);
+}
+/*---------------------------------------------------------------------------*/
+static int
+run_serialize_atts(void)
+{
+  set_rx_atts();
+  sink = packetutils_serialize_atts(buffer, sizeof(buffer));
+  return sink;
+}
+/*---------------------------------------------------------------------------*/
+static const struct bench benchmarks[] = {
+  { "encap_parse_and_verify", setup_serial_frame, run_encap_parse },
+  { "encap_finalize", setup_serial_frame, run_encap_finalize },
+  { "oam_process_request", setup_oam_request, run_oam_process_request },
+  { "slip_encode", setup_slip, run_slip_encode },
+  { "slip_decode", setup_slip, run_slip_decode },
+  { "crc32", setup_crc32, run_crc32 },
+  { "frame802154_create", setup_frame802154, run_frame802154_create },
+  { "frame802154_parse", setup_frame802154, run_frame802154_parse },
+  { "iphc_compress", setup_iphc, run_iphc_compress },
+  { "iphc_uncompress", setup_iphc, run_iphc_uncompress },
+  { "coap_serialize", setup_coap, run_coap_serialize },
+  { "coap_parse", setup_coap, run_coap_parse },
+  { "serialize_atts_legacy", setup_atts_legacy, run_serialize_atts },
+  { "serialize_atts_compact", setup_atts_compact, run_serialize_atts },
+};
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/*---------------------------------------------------------------------------*/
+static double
+run_ops(const struct bench *b, long ops, long *bytes)
+{
+  double start;
+  long i;
+
+  *bytes = 0;
+  start = now();
+  for(i = 0; i < ops; i++) {
+    *bytes += b->run();
+  }
+  return now() - start;
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(FILE *out, const struct bench *b)
+{
+  double elapsed, best;
+  long ops, bytes;
+  int rep;
+
+  srand(4711);
+  if(b->setup) {
+    b->setup();
+  }
+
+  /* Find the number of operations needed for a stable timing */
+  for(ops = 16; run_ops(b, ops, &bytes) < MIN_TIME; ops *= 2);
+
+  /* Best of several repetitions to reduce the noise */
+  best = 0;
+  for(rep = 0; rep < REPETITIONS; rep++) {
+    elapsed = run_ops(b, ops, &bytes);
+    if(rep == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+
+  fprintf(out, "%s,%ld,%.1f,%ld,%.0f\n", b->name, ops, best * 1e9 / ops,
+          bytes / ops, bytes / best);
+  fflush(out);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(sparrow_bench_process, ev, data)
+{
+  FILE *out;
+  int i;
+
+  PROCESS_BEGIN();
+
+  out = stdout;
+  if(contiki_argc > 1 && strcmp(contiki_argv[1], "-") != 0) {
+    out = fopen(contiki_argv[1], "w");
+    if(out == NULL) {
+      perror(contiki_argv[1]);
+      exit(1);
+    }
+  }
+
+  fprintf(out, "# sparrow-bench %s\n", sparrow_getswrevision());
+  fprintf(out, "benchmark,ops,ns_per_op,bytes_per_op,bytes_per_s\n");
+  for(i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+    /* Optionally only run the benchmarks matching a name */
+    if(contiki_argc > 2 && strstr(benchmarks[i].name, contiki_argv[2]) == NULL) {
+      continue;
+    }
+    run(out, &benchmarks[i]);
+  }
+  if(out != stdout) {
+    fclose(out);
+  }
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2016, Yanzi Networks AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *    3. Neither the name of the copyright holders nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Benchmark of the TSCH enhanced ACK and enhanced beacon
+ *         parsing.
+ *
+ *         Checks that created frames parse back to the same fields and
+ *         reports ns and cycles per frame for each operation.
+ */
+
+#include "contiki.h"
+#include "net/mac/frame802154.h"
+#include "net/mac/tsch/tsch.h"
+#include "net/mac/tsch/tsch-packet.h"
+#include "net/mac/tsch/tsch-private.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#define DEFAULT_ROUNDS    1000000
+#define REPETITIONS       5
+#define TSCH_SEQNO        17
+#define TSCH_DRIFT        -120
+
+/*
+ * Cycles are read from the time stamp counter on x86 hosts, which runs
+ * at the nominal clock rate. Other hosts report 0 cycles.
+ */
+#if defined(__i386__) || defined(__x86_64__)
+#define read_cycles() __rdtsc()
+#else
+#define read_cycles() 0
+#endif
+
+/* TSCH state read by tsch-packet.c, the rest of TSCH is not built */
+struct tsch_asn_t tsch_current_asn;
+uint8_t tsch_join_priority;
+
+struct bench {
+  const char *name;
+  int (* run)(void);
+};
+
+static uint8_t eack[TSCH_PACKET_MAX_LEN];
+static int eack_len;
+static uint8_t eb[TSCH_PACKET_MAX_LEN];
+static int eb_len;
+static uint8_t buffer[TSCH_PACKET_MAX_LEN];
+static volatile int sink;
+
+extern int contiki_argc;
+extern char **contiki_argv;
+
+PROCESS(tsch_packet_bench_process, "TSCH packet benchmark");
+AUTOSTART_PROCESSES(&tsch_packet_bench_process);
+/*---------------------------------------------------------------------------*/
+static int
+check_eack(const uint8_t *buf, int len, uint8_t seqno, int16_t drift)
+{
+  frame802154_t frame;
+  struct ieee802154_ies ies;
+  uint8_t hdr_len;
+
+  memset(&ies, 0, sizeof(ies));
+  if(len <= 0 || tsch_packet_parse_eack(buf, len, seqno, &frame, &ies, &hdr_len) == 0) {
+    printf("EACK %u: not parsed\n", seqno);
+    return 0;
+  }
+  if(ies.ie_time_correction != drift || ies.ie_is_nack) {
+    printf("EACK %u: time correction %d, expected %d\n",
+           seqno, ies.ie_time_correction, drift);
+    return 0;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+check_eb(const uint8_t *buf, int len)
+{
+  frame802154_t frame;
+  struct ieee802154_ies ies;
+  uint8_t hdr_len;
+
+  memset(&ies, 0, sizeof(ies));
+  if(len <= 0 || tsch_packet_parse_eb(buf, len, &frame, &ies, &hdr_len, 0) == 0) {
+    printf("EB: not parsed\n");
+    return 0;
+  }
+  if(ies.ie_asn.ls4b != tsch_current_asn.ls4b ||
+     ies.ie_asn.ms1b != tsch_current_asn.ms1b ||
+     ies.ie_join_priority != tsch_join_priority) {
+    printf("EB: ASN %02x.%08lx join priority %u, expected %02x.%08lx %u\n",
+           ies.ie_asn.ms1b, (unsigned long)ies.ie_asn.ls4b,
+           ies.ie_join_priority, tsch_current_asn.ms1b,
+           (unsigned long)tsch_current_asn.ls4b, tsch_join_priority);
+    return 0;
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+create_eb(uint8_t *buf)
+{
+  uint8_t hdr_len;
+  uint8_t sync_ie_offset;
+  int len;
+
+  len = tsch_packet_create_eb(buf, TSCH_PACKET_MAX_LEN, &hdr_len, &sync_ie_offset);
+  if(len > 0) {
+    /* The ASN is written into the EB just before it is sent */
+    tsch_packet_update_eb(buf, len, sync_ie_offset);
+  }
+  return len;
+}
+/*---------------------------------------------------------------------------*/
+static int
+verify(void)
+{
+  int i, errors;
+  int16_t drift;
+
+  errors = 0;
+
+  /* Enhanced ACK with time correction to this node, as for every unicast */
+  eack_len = tsch_packet_create_eack(eack, sizeof(eack), &linkaddr_node_addr,
+                                     TSCH_SEQNO, TSCH_DRIFT, 0);
+  if(!check_eack(eack, eack_len, TSCH_SEQNO, TSCH_DRIFT)) {
+    errors++;
+  }
+  for(i = 0; i < 256; i++) {
+    /* Cover the whole sequence number and time correction range */
+    drift = (int16_t)(i * 16) - 2048;
+    if(!check_eack(buffer,
+                   tsch_packet_create_eack(buffer, sizeof(buffer), &linkaddr_node_addr,
+                                           i, drift, 0), i, drift)) {
+      errors++;
+    }
+  }
+
+  tsch_current_asn.ms1b = 0;
+  tsch_current_asn.ls4b = 0x12345678;
+  tsch_join_priority = 1;
+  eb_len = create_eb(eb);
+  if(!check_eb(eb, eb_len)) {
+    errors++;
+  }
+  for(i = 0; i < 256; i++) {
+    /* A new ASN for every EB and a new join priority when the rank changes */
+    tsch_current_asn.ms1b = i;
+    tsch_current_asn.ls4b += 0x01010101;
+    tsch_join_priority = i & 0x3f;
+    if(!check_eb(buffer, create_eb(buffer))) {
+      errors++;
+    }
+  }
+  tsch_current_asn.ms1b = 0;
+  tsch_current_asn.ls4b = 0x12345678;
+  tsch_join_priority = 1;
+  return errors;
+}
+/*---------------------------------------------------------------------------*/
+static int
+run_eack_parse(void)
+{
+  frame802154_t frame;
+  struct ieee802154_ies ies;
+  uint8_t hdr_len;
+
+  return tsch_packet_parse_eack(eack, eack_len, TSCH_SEQNO, &frame, &ies, &hdr_len);
+}
+/*---------------------------------------------------------------------------*/
+static int
+run_eb_parse(void)
+{
+  frame802154_t frame;
+  struct ieee802154_ies ies;
+  uint8_t hdr_len;
+
+  return tsch_packet_parse_eb(eb, eb_len, &frame, &ies, &hdr_len, 0);
+}
+/*---------------------------------------------------------------------------*/
+static const struct bench benchmarks[] = {
+  { "eack_parse", run_eack_parse },
+  { "eb_parse", run_eb_parse },
+};
+/*---------------------------------------------------------------------------*/
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/*---------------------------------------------------------------------------*/
+static void
+run(const struct bench *b, long rounds)
+{
+  double start, elapsed, best;
+  uint64_t start_cycles, cycles, best_cycles;
+  long i;
+  int rep;
+
+  /* Best of several repetitions to reduce the noise */
+  best = 0;
+  best_cycles = 0;
+  for(rep = 0; rep < REPETITIONS; rep++) {
+    start = now();
+    start_cycles = read_cycles();
+    for(i = 0; i < rounds; i++) {
+      sink = b->run();
+    }
+    cycles = read_cycles() - start_cycles;
+    elapsed = now() - start;
+    if(rep == 0 || elapsed < best) {
+      best = elapsed;
+      best_cycles = cycles;
+    }
+  }
+
+  printf("%-12s %8.1f ns %8.1f cycles\n", b->name, best * 1e9 / rounds,
+         (double)best_cycles / rounds);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(tsch_packet_bench_process, ev, data)
+{
+  long rounds;
+  int i;
+
+  PROCESS_BEGIN();
+
+  rounds = DEFAULT_ROUNDS;
+  if(contiki_argc > 1) {
+    rounds = atol(contiki_argv[1]);
+  }
+
+  if(verify() > 0) {
+    printf("created frames do not parse back\n");
+    exit(1);
+  }
+  printf("EACK %d bytes, EB %d bytes, %ld rounds\n", eack_len, eb_len, rounds);
+  for(i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+    run(&benchmarks[i], rounds);
+  }
+  exit(0);
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
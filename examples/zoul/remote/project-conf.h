@@ -47,6 +47,7 @@
 /* Network statistics */
 #define RPL_CONF_STATS 1
 /* #define HANDLER_802154_CONF_STATS 1 */
+#define NETSCAN_CONF_STATS 1
 
 /* #define RPL_CALLBACK_PARENT_SWITCH \ */
 /*   instance_nstats_preferred_parent_callback */
@@ -46,6 +46,16 @@ int IMAGE_TRAILER_MEMCMP(const void *s1, const void *s2, size_t n);
 #define IMAGE_TRAILER_MEMCMP memcmp
 #endif /* IMAGE_TRAILER_MEMCMP */
 
+/*
+ * Returns an address inside the running image. Platforms that do not
+ * execute from the image slots (such as native) provide their own.
+ */
+#ifdef IMAGE_TRAILER_RUNNING_ADDRESS
+uint32_t IMAGE_TRAILER_RUNNING_ADDRESS(void);
+#else
+#define IMAGE_TRAILER_RUNNING_ADDRESS() ((uintptr_t)image_trailer_get_image_status)
+#endif /* IMAGE_TRAILER_RUNNING_ADDRESS */
+
 #define CRC32_MAGIC_REMAINDER   0x2144DF1C
 
 #ifndef TRUE
@@ -104,7 +114,7 @@ image_trailer_find(uint8_t *start, uint32_t len, uint64_t type)
       }
     }
 
-    if((ntohl(T->image_start) != (uint32_t)start)) {
+    if((ntohl(T->image_start) != (uint32_t)(uintptr_t)start)) {
       return NULL;
     }
 
@@ -133,8 +143,8 @@ image_trailer_verify_checksum(const image_trailer_t *T)
 {
   uint32_t len;
   uint8_t *start;
-  start = (uint8_t *)ntohl(T->image_start);
-  len = (uint32_t)T + sizeof(image_trailer_t) - (uint32_t)start;
+  start = (uint8_t *)(uintptr_t)ntohl(T->image_start);
+  len = (uint32_t)((const uint8_t *)T + sizeof(image_trailer_t) - start);
   return check_crc32(start, len);
 }
 /*----------------------------------------------------------------*/
@@ -197,6 +207,7 @@ image_trailer_get_image_status(const image_info_t *image)
 {
   const image_trailer_t *T;
   uint32_t status;
+  uintptr_t running;
   uint32_t *p;
   uint32_t erased = TRUE;
   uint8_t compare_type[8];
@@ -210,8 +221,8 @@ image_trailer_get_image_status(const image_info_t *image)
   compare_type[6] = (image->image_type >> 8) & 0xff;
   compare_type[7] = (image->image_type) & 0xff;
 
-  for(p = (uint32_t *)image->start_address;
-      (uint8_t *)p < (uint8_t *)(image->start_address + image->length);
+  for(p = (uint32_t *)(uintptr_t)image->start_address;
+      (uint8_t *)p < (uint8_t *)(uintptr_t)(image->start_address + image->length);
       p++) {
     if(*p != 0xffffffff) {
       erased = FALSE;
@@ -222,7 +233,7 @@ image_trailer_get_image_status(const image_info_t *image)
     return IMAGE_STATUS_ERASED;
   }
 
-  T = image_trailer_find((uint8_t *)image->start_address, image->length, image->image_type);
+  T = image_trailer_find((uint8_t *)(uintptr_t)image->start_address, image->length, image->image_type);
   if(T == NULL) {
     return IMAGE_STATUS_BAD_SIZE;
   }
@@ -232,8 +243,9 @@ image_trailer_get_image_status(const image_info_t *image)
     if(IMAGE_TRAILER_MEMCMP(T->image_type, compare_type, 8) != 0) {
       status |= IMAGE_STATUS_BAD_TYPE;
     }
-    if(((uint32_t)image_trailer_get_image_status > image->start_address) &&
-       ((uint32_t)image_trailer_get_image_status < (image->start_address + image->length))) {
+    running = IMAGE_TRAILER_RUNNING_ADDRESS();
+    if((running > image->start_address) &&
+       (running < (image->start_address + image->length))) {
       status |= IMAGE_STATUS_ACTIVE;
     } else {
       status |= IMAGE_STATUS_WRITABLE;
@@ -251,12 +263,12 @@ image_trailer_get_image_crc32(const image_info_t *image)
   uint8_t *start;
   uint32_t len;
 
-  T = image_trailer_find((uint8_t *)image->start_address, image->length, image->image_type);
+  T = image_trailer_find((uint8_t *)(uintptr_t)image->start_address, image->length, image->image_type);
   if(T == NULL) {
     return 0xffffffff;
   }
-  start = (uint8_t *)ntohl(T->image_start);
-  len = (uint32_t)T + sizeof(image_trailer_t) - (uint32_t)start;
+  start = (uint8_t *)(uintptr_t)ntohl(T->image_start);
+  len = (uint32_t)((const uint8_t *)T + sizeof(image_trailer_t) - start);
   return crc32(start, len);
 }
 /*----------------------------------------------------------------*/
@@ -271,7 +283,7 @@ image_trailer_get_image_version(const image_info_t *image)
   const image_trailer_t *T;
   uint64_t version = 0;
 
-  T = image_trailer_find((uint8_t *)image->start_address, image->length, image->image_type);
+  T = image_trailer_find((uint8_t *)(uintptr_t)image->start_address, image->length, image->image_type);
   if(T == NULL) {
     return 0;
   }
@@ -297,11 +309,11 @@ image_trailer_get_image_length(const image_info_t *image)
 {
   const image_trailer_t *T;
 
-  T = image_trailer_find((uint8_t *)image->start_address, image->length, image->image_type);
+  T = image_trailer_find((uint8_t *)(uintptr_t)image->start_address, image->length, image->image_type);
   if(T == NULL) {
     return image->length;
   }
 
-  return (uint32_t)((uint8_t *)T - image->start_address + sizeof(image_trailer_t));
+  return (uint32_t)((uintptr_t)T - image->start_address + sizeof(image_trailer_t));
 }
 /*----------------------------------------------------------------*/
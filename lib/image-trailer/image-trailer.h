@@ -120,6 +120,47 @@ typedef enum {
   IMAGE_TRAILER_DIGEST_CRC32    = 0x04,
 } image_trailer_digest_algorithm_t;
 
+/*
+ * Compressed images are the complete image, including trailer,
+ * compressed and prefixed with this header. The image is decompressed
+ * when written and the trailer is verified as usual. All header fields
+ * are in network byte order.
+ */
+#define IMAGE_COMPRESSED_MAGIC 0x53505a31 /* "SPZ1" */
+
+typedef struct {
+  uint32_t magic;
+  uint8_t algorithm;
+  uint8_t window_bits;
+  uint8_t lookahead_bits;
+  uint8_t reserved;
+  uint32_t length; /* length of the decompressed image */
+  uint32_t crc32;  /* CRC32 of the decompressed image */
+} image_compressed_header_t;
+
+typedef enum {
+  IMAGE_COMPRESSION_NONE = 0x00,
+  IMAGE_COMPRESSION_LZSS = 0x01,
+} image_compression_algorithm_t;
+
+/*
+ * Delta images describe the new image as copy and insert operations
+ * on the running image and are only accepted when the running image
+ * matches the source version, length and CRC32 in this header. All
+ * header fields are in network byte order.
+ */
+#define IMAGE_DELTA_MAGIC 0x53504431 /* "SPD1" */
+
+typedef struct {
+  uint32_t magic;
+  uint32_t reserved;
+  uint64_t source_version;
+  uint32_t source_length;
+  uint32_t source_crc32;
+  uint32_t length; /* length of the new image */
+  uint32_t crc32;  /* CRC32 of the new image */
+} image_delta_header_t;
+
 #define IMAGE_STATUS_OK            0x00
 #define IMAGE_STATUS_BAD_CHECKSUM  0x01
 #define IMAGE_STATUS_BAD_TYPE      0x02
@@ -86,6 +86,19 @@ typedef uint32_t rtimer_clock_t;
 #endif
 /** @} */
 /*---------------------------------------------------------------------------*/
+/**
+ * \name Network cache configuration
+ *
+ * The netscan network cache is stored in the reserved flash sector
+ * after the key storage, see cc2538-image.lds.
+ *
+ * @{
+ */
+#ifndef NETSCAN_CONF_FLASH_CACHE_ADDRESS
+#define NETSCAN_CONF_FLASH_CACHE_ADDRESS 0x00202000
+#endif
+/** @} */
+/*---------------------------------------------------------------------------*/
 /**
  * \name Watchdog Timer configuration
  *
@@ -398,6 +411,11 @@ typedef uint32_t rtimer_clock_t;
 #ifndef CC2538_RF_CONF_RX_USE_DMA
 #define CC2538_RF_CONF_RX_USE_DMA            1 /**< RF RX over DMA */
 #endif
+
+/* RX frame ring statistics shown in the serial radio status */
+#ifndef SERIAL_RADIO_CONF_RX_STATS
+#define SERIAL_RADIO_CONF_RX_STATS           cc2538_rf_get_rx_stats
+#endif
 /** @} */
 /*---------------------------------------------------------------------------*/
 /**
@@ -493,9 +511,10 @@ typedef uint32_t rtimer_clock_t;
 /* Timeout for packet reassembly at the 6LoWPAN layer (1/16 seconds) */
 #define SICSLOWPAN_CONF_MAXAGE              16
 
-/* Define our IPv6 prefixes/contexts here */
+/* Define our IPv6 prefixes/contexts here. Room for all 16 context
+   numbers since the border router distributes contexts in DIOs. */
 #ifndef SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS
-#define SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS    2
+#define SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS    16
 #endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS */
 
 #ifndef SICSLOWPAN_CONF_FRAGMENT_BUFFERS
@@ -112,7 +112,9 @@ typedef unsigned short uip_stats_t;
 /* Timeout for packet reassembly at the 6LoWPAN layer (1/16 seconds) */
 #define SICSLOWPAN_CONF_MAXAGE                 16
 #endif /* SICSLOWPAN_CONF_FRAG */
-#define SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS       2
+#ifndef SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS
+#define SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS       16
+#endif /* SICSLOWPAN_CONF_MAX_ADDR_CONTEXTS */
 #ifndef SICSLOWPAN_CONF_MAX_MAC_TRANSMISSIONS
 #define SICSLOWPAN_CONF_MAX_MAC_TRANSMISSIONS   5
 #endif /* SICSLOWPAN_CONF_MAX_MAC_TRANSMISSIONS */
@@ -185,4 +187,13 @@ int strcasecmp(const char*, const char*);
 #include PROJECT_CONF_H
 #endif /* PROJECT_CONF_H */
 
+/* The netscan network cache is kept in the flash emulation when enabled */
+#include "dev/native-flash.h"
+
+#ifndef NETSCAN_CONF_FLASH_CACHE_ADDRESS
+#define NETSCAN_CONF_FLASH_CACHE_ADDRESS NATIVE_FLASH_NETSCAN_CACHE_START
+#define NETSCAN_CONF_FLASH_CACHE_SIZE    NATIVE_FLASH_SECTOR_SIZE
+#define NETSCAN_CONF_FLASH_CACHE_IS_AVAILABLE native_flash_is_enabled
+#endif /* NETSCAN_CONF_FLASH_CACHE_ADDRESS */
+
 #endif /* CONTIKI_CONF_H_ */
@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2016, SICS, Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Sparrow Flash implementation for the native platform
+ */
+
+#include "dev/native-flash.h"
+#include "dev/sparrow-flash.h"
+#include "image-trailer.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <err.h>
+
+#define DEBUG 0
+#if DEBUG
+#define PRINTF(...) printf(__VA_ARGS__)
+#else
+#define PRINTF(...)
+#endif
+
+#define SECTOR_MASK   (~(uint32_t)(NATIVE_FLASH_SECTOR_SIZE - 1))
+
+static int flash_fd = -1;
+static const uint8_t *flash_mem = NULL;
+static uint8_t is_unlocked = 0;
+static uint8_t has_timing = 1;
+static uint32_t pending_usec = 0;
+static native_flash_stats_t stats;
+/*---------------------------------------------------------------------------*/
+/*
+ * Emulate the time the MCU is stalled by the flash controller. Short
+ * program operations are accumulated to avoid sleeping for every word.
+ */
+static void
+flash_busy(uint32_t usec)
+{
+  struct timespec ts;
+
+  stats.busy_usec += usec;
+  if(!has_timing) {
+    return;
+  }
+  pending_usec += usec;
+  if(pending_usec < 1000) {
+    return;
+  }
+  ts.tv_sec = pending_usec / 1000000;
+  ts.tv_nsec = (pending_usec % 1000000) * 1000;
+  pending_usec = 0;
+  nanosleep(&ts, NULL);
+}
+/*---------------------------------------------------------------------------*/
+static int
+flash_write(uint32_t address, const void *data, size_t len)
+{
+  ssize_t ret;
+  ret = pwrite(flash_fd, data, len, address - NATIVE_FLASH_BASE);
+  return ret == (ssize_t)len;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Write a manufacturing area with two image slots to a new flash file.
+ */
+static int
+format_mfg_area(void)
+{
+  uint8_t buf[sizeof(mfg_area_t) + sizeof(image_info_t) * NATIVE_FLASH_IMAGE_COUNT];
+  mfg_area_t *mfg = (mfg_area_t *)buf;
+  int i;
+
+  memset(buf, 0, sizeof(buf));
+  mfg->revision = IMAGE_TRAILER_MFG_MAGIC0;
+  mfg->magic1 = IMAGE_TRAILER_MFG_MAGIC1;
+  mfg->magic2 = IMAGE_TRAILER_MFG_MAGIC2;
+  mfg->magic3 = IMAGE_TRAILER_MFG_MAGIC3;
+  mfg->number_of_images = NATIVE_FLASH_IMAGE_COUNT;
+  for(i = 0; i < NATIVE_FLASH_IMAGE_COUNT; i++) {
+    mfg->images[i].image_type = NATIVE_FLASH_IMAGE_TYPE;
+    mfg->images[i].start_address = NATIVE_FLASH_IMAGE_START + i * NATIVE_FLASH_IMAGE_LENGTH;
+    mfg->images[i].length = NATIVE_FLASH_IMAGE_LENGTH;
+  }
+  return flash_write(NATIVE_FLASH_MFG_START, buf, sizeof(buf));
+}
+/*---------------------------------------------------------------------------*/
+int
+native_flash_init(const char *filename)
+{
+  uint8_t erased[NATIVE_FLASH_SECTOR_SIZE];
+  struct stat st;
+  off_t size;
+  void *p;
+  int flags;
+
+  if(filename == NULL || *filename == '\0') {
+    return 0;
+  }
+
+  flash_fd = open(filename, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if(flash_fd < 0) {
+    warn("native-flash: failed to open %s", filename);
+    return 0;
+  }
+  if(fstat(flash_fd, &st) < 0) {
+    warn("native-flash: fstat");
+    goto failed;
+  }
+
+  if(st.st_size < NATIVE_FLASH_SIZE) {
+    /* New (or truncated) flash file - fill with erased sectors */
+    memset(erased, 0xff, sizeof(erased));
+    for(size = st.st_size & SECTOR_MASK; size < NATIVE_FLASH_SIZE;
+        size += NATIVE_FLASH_SECTOR_SIZE) {
+      if(pwrite(flash_fd, erased, sizeof(erased), size) != sizeof(erased)) {
+        warn("native-flash: failed to format %s", filename);
+        goto failed;
+      }
+    }
+    if(st.st_size < NATIVE_FLASH_MFG_END - NATIVE_FLASH_BASE
+       && !format_mfg_area()) {
+      warn("native-flash: failed to write mfg area");
+      goto failed;
+    }
+  }
+
+  /*
+   * The flash must be mapped at its 32-bit address. Writes must go
+   * through the flash API so map it read-only.
+   */
+  flags = MAP_SHARED;
+#ifdef MAP_FIXED_NOREPLACE
+  flags |= MAP_FIXED_NOREPLACE;
+#endif /* MAP_FIXED_NOREPLACE */
+  p = mmap((void *)(uintptr_t)NATIVE_FLASH_BASE, NATIVE_FLASH_SIZE,
+           PROT_READ, flags, flash_fd, 0);
+  if(p == MAP_FAILED) {
+    warn("native-flash: failed to map flash at 0x%08x", NATIVE_FLASH_BASE);
+    goto failed;
+  }
+  if(p != (void *)(uintptr_t)NATIVE_FLASH_BASE) {
+    warnx("native-flash: flash mapped at %p instead of 0x%08x", p,
+          NATIVE_FLASH_BASE);
+    munmap(p, NATIVE_FLASH_SIZE);
+    goto failed;
+  }
+  flash_mem = p;
+
+  if(getenv(NATIVE_FLASH_ENV_NO_TIMING) != NULL) {
+    has_timing = 0;
+  }
+
+  printf("Flash emulation: %s, %u KB at 0x%08x, %u images of %u KB\n",
+         filename, NATIVE_FLASH_SIZE / 1024, NATIVE_FLASH_BASE,
+         NATIVE_FLASH_IMAGE_COUNT, NATIVE_FLASH_IMAGE_LENGTH / 1024);
+  return 1;
+
+ failed:
+  close(flash_fd);
+  flash_fd = -1;
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+native_flash_is_enabled(void)
+{
+  return flash_mem != NULL;
+}
+/*---------------------------------------------------------------------------*/
+void
+native_flash_sync(void)
+{
+  if(flash_fd >= 0) {
+    fsync(flash_fd);
+  }
+}
+/*---------------------------------------------------------------------------*/
+const native_flash_stats_t *
+native_flash_get_stats(void)
+{
+  return &stats;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * The manufacturing area is write protected, same as the bootloader
+ * area on real hardware.
+ */
+static int
+is_writable(uint32_t address)
+{
+  return flash_mem != NULL && is_unlocked
+    && address >= NATIVE_FLASH_MFG_END
+    && address < NATIVE_FLASH_BASE + NATIVE_FLASH_SIZE;
+}
+/*---------------------------------------------------------------------------*/
+sparrow_flash_status_t
+sparrow_flash_unlock(void)
+{
+  if(flash_mem == NULL) {
+    return SPARROW_FLASH_ERROR_WRP;
+  }
+  is_unlocked = 1;
+  return SPARROW_FLASH_COMPLETE;
+}
+/*---------------------------------------------------------------------------*/
+sparrow_flash_status_t
+sparrow_flash_lock(void)
+{
+  is_unlocked = 0;
+  return SPARROW_FLASH_COMPLETE;
+}
+/*---------------------------------------------------------------------------*/
+sparrow_flash_status_t
+sparrow_flash_erase_sector(uint32_t address)
+{
+  uint8_t erased[NATIVE_FLASH_SECTOR_SIZE];
+
+  address &= SECTOR_MASK;
+  if(!is_writable(address)) {
+    PRINTF("native-flash: erase protected 0x%08lx\n", (unsigned long)address);
+    stats.error_count++;
+    return SPARROW_FLASH_ERROR_WRP;
+  }
+
+  memset(erased, 0xff, sizeof(erased));
+  if(!flash_write(address, erased, sizeof(erased))) {
+    stats.error_count++;
+    return SPARROW_FLASH_ERROR_WRP;
+  }
+  stats.erase_count++;
+  flash_busy(NATIVE_FLASH_ERASE_TIME);
+  return SPARROW_FLASH_COMPLETE;
+}
+/*---------------------------------------------------------------------------*/
+sparrow_flash_status_t
+sparrow_flash_program_word(uint32_t address, uint32_t data)
+{
+  uint32_t present;
+  uint32_t value;
+
+  if((address & 3) != 0) {
+    stats.error_count++;
+    return SPARROW_FLASH_ERROR_PG;
+  }
+  if(!is_writable(address)) {
+    PRINTF("native-flash: write protected 0x%08lx\n", (unsigned long)address);
+    stats.error_count++;
+    return SPARROW_FLASH_ERROR_WRP;
+  }
+
+  /* Programming can only clear bits - same as NOR flash */
+  memcpy(&present, flash_mem + (address - NATIVE_FLASH_BASE), sizeof(present));
+  value = present & data;
+  if(value != present && !flash_write(address, &value, sizeof(value))) {
+    stats.error_count++;
+    return SPARROW_FLASH_ERROR_PG;
+  }
+  stats.program_count++;
+  flash_busy(NATIVE_FLASH_PROGRAM_TIME);
+
+  if(value != data) {
+    PRINTF("native-flash: mismatch 0x%08lx %08lx %08lx\n",
+           (unsigned long)address, (unsigned long)data, (unsigned long)value);
+    stats.error_count++;
+    return SPARROW_FLASH_ERROR_PG;
+  }
+  return SPARROW_FLASH_COMPLETE;
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2016, SICS, Swedish ICT AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         File backed flash emulation for the native platform.
+ *
+ *         The flash is a file mapped read-only at a fixed low address
+ *         so that the 32-bit addresses used by the image trailer and
+ *         the flash instance stay valid. All modifications go through
+ *         the Sparrow Flash API which enforces sector erase and NOR
+ *         programming rules (bits can only be cleared) and emulates
+ *         the erase/program time of the CC2538 flash.
+ *
+ *         The first sector holds a manufacturing area describing two
+ *         image slots, created when the flash file is new. The sectors
+ *         between the manufacturing area and the image slots are
+ *         reserved for data, laid out as on the CC2538.
+ */
+
+#ifndef NATIVE_FLASH_H_
+#define NATIVE_FLASH_H_
+
+#include <stdint.h>
+
+#ifdef NATIVE_FLASH_CONF_BASE
+#define NATIVE_FLASH_BASE NATIVE_FLASH_CONF_BASE
+#else
+#define NATIVE_FLASH_BASE                0x00200000
+#endif
+
+#ifdef NATIVE_FLASH_CONF_SIZE
+#define NATIVE_FLASH_SIZE NATIVE_FLASH_CONF_SIZE
+#else
+#define NATIVE_FLASH_SIZE                (512 * 1024)
+#endif
+
+#ifdef NATIVE_FLASH_CONF_SECTOR_SIZE
+#define NATIVE_FLASH_SECTOR_SIZE NATIVE_FLASH_CONF_SECTOR_SIZE
+#else
+#define NATIVE_FLASH_SECTOR_SIZE         2048
+#endif
+
+/* Time to erase one sector and program one word, in microseconds */
+#ifdef NATIVE_FLASH_CONF_ERASE_TIME
+#define NATIVE_FLASH_ERASE_TIME NATIVE_FLASH_CONF_ERASE_TIME
+#else
+#define NATIVE_FLASH_ERASE_TIME          20000
+#endif
+
+#ifdef NATIVE_FLASH_CONF_PROGRAM_TIME
+#define NATIVE_FLASH_PROGRAM_TIME NATIVE_FLASH_CONF_PROGRAM_TIME
+#else
+#define NATIVE_FLASH_PROGRAM_TIME        20
+#endif
+
+#ifdef NATIVE_FLASH_CONF_IMAGE_TYPE
+#define NATIVE_FLASH_IMAGE_TYPE NATIVE_FLASH_CONF_IMAGE_TYPE
+#else
+#define NATIVE_FLASH_IMAGE_TYPE          0x70B3D57D510000F0ULL
+#endif
+
+/* The manufacturing area is placed in the first (protected) sectors */
+#define NATIVE_FLASH_MFG_START           NATIVE_FLASH_BASE
+#define NATIVE_FLASH_MFG_END             (NATIVE_FLASH_BASE + 0x2000)
+
+/* The netscan network cache, followed by reserved sectors */
+#define NATIVE_FLASH_NETSCAN_CACHE_START NATIVE_FLASH_MFG_END
+#define NATIVE_FLASH_DATA_END            (NATIVE_FLASH_BASE + 0x4000)
+
+#define NATIVE_FLASH_IMAGE_COUNT         2
+#define NATIVE_FLASH_IMAGE_START         NATIVE_FLASH_DATA_END
+#define NATIVE_FLASH_IMAGE_LENGTH                                       \
+  (((NATIVE_FLASH_SIZE - (NATIVE_FLASH_IMAGE_START - NATIVE_FLASH_BASE)) \
+    / NATIVE_FLASH_IMAGE_COUNT) & ~(NATIVE_FLASH_SECTOR_SIZE - 1))
+
+/* Environment variables used to configure the flash emulation */
+#define NATIVE_FLASH_ENV_FILE            "SPARROW_FLASH_FILE"
+#define NATIVE_FLASH_ENV_IMAGE           "SPARROW_FLASH_IMAGE"
+#define NATIVE_FLASH_ENV_NO_TIMING       "SPARROW_FLASH_NO_TIMING"
+
+typedef struct {
+  uint32_t erase_count;
+  uint32_t program_count;
+  uint32_t error_count;
+  uint64_t busy_usec;
+} native_flash_stats_t;
+
+/**
+ * Map the flash file (created and formatted if needed). Returns
+ * non-zero on success.
+ */
+int native_flash_init(const char *filename);
+
+int native_flash_is_enabled(void);
+
+/** Flush all changes to the flash file, typically before a reboot */
+void native_flash_sync(void);
+
+const native_flash_stats_t *native_flash_get_stats(void);
+
+#endif /* NATIVE_FLASH_H_ */
@@ -37,12 +37,39 @@
 
 #include "contiki.h"
 #include "dev/sparrow-device.h"
+#include "dev/native-flash.h"
+#include "image-trailer.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+extern char **contiki_argv;
+
+static int running_image = -1;
 /*---------------------------------------------------------------------------*/
 static void
 init(void)
 {
-  /* Nothing to initialize */
+  const char *image;
+
+  if(!native_flash_init(getenv(NATIVE_FLASH_ENV_FILE))) {
+    /* No flash emulation */
+    return;
+  }
+
+  if(!image_trailer_find_mfg_area((const uint8_t *)NATIVE_FLASH_MFG_START,
+                                  (const uint8_t *)NATIVE_FLASH_MFG_END)) {
+    printf("Could not find mfg area\n");
+    return;
+  }
+
+  /* The image to run is selected by the emulated bootloader at reboot */
+  image = getenv(NATIVE_FLASH_ENV_IMAGE);
+  running_image = image != NULL ? atoi(image) : 1;
+  if(running_image < 1 || running_image > NATIVE_FLASH_IMAGE_COUNT) {
+    running_image = 1;
+  }
+  printf("Running image: %d\n", running_image);
 }
 /*---------------------------------------------------------------------------*/
 static uint8_t
@@ -66,8 +93,10 @@ reset_cause(void)
 static int
 get_capabilities(uint64_t *capabilities)
 {
+  const mfg_area_t *flash_mfg_area;
+  flash_mfg_area = image_trailer_get_mfg_area();
   if(capabilities) {
-    *capabilities = 0ULL;
+    *capabilities = flash_mfg_area != NULL ? flash_mfg_area->capabilities : 0ULL;
   }
   return 1;
 }
@@ -78,16 +107,73 @@ get_bootloader_version(void)
   return 0;
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * Emulated bootloader: boot the selected image if it has a valid
+ * trailer and checksum, otherwise fall back to any other valid image.
+ */
+static int
+select_boot_image(int image)
+{
+  const image_info_t *images;
+  const image_trailer_t *t;
+  int i, n;
+
+  images = image_trailer_get_images();
+  for(i = 0; i < NATIVE_FLASH_IMAGE_COUNT; i++) {
+    n = (image - 1 + i) % NATIVE_FLASH_IMAGE_COUNT;
+    t = image_trailer_find((uint8_t *)(uintptr_t)images[n].start_address,
+                           images[n].length, images[n].image_type);
+    if(t != NULL && image_trailer_verify_checksum(t)) {
+      return n + 1;
+    }
+  }
+  /* No valid image - keep running the current one */
+  return running_image;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Reboot by replacing the process with a new instance of itself,
+ * passing the selected image through the environment.
+ */
+static void
+reboot_process(int image)
+{
+  const native_flash_stats_t *stats;
+  char buf[8];
+
+  stats = native_flash_get_stats();
+  printf("*** Rebooting to image %d (flash erase %lu, program %lu, errors %lu, busy %lu ms)\n",
+         image, (unsigned long)stats->erase_count,
+         (unsigned long)stats->program_count,
+         (unsigned long)stats->error_count,
+         (unsigned long)(stats->busy_usec / 1000));
+  native_flash_sync();
+  snprintf(buf, sizeof(buf), "%d", image);
+  setenv(NATIVE_FLASH_ENV_IMAGE, buf, 1);
+  fflush(NULL);
+  execv("/proc/self/exe", contiki_argv);
+  perror("*** Reboot failed");
+}
+/*---------------------------------------------------------------------------*/
 static void
 do_reboot(void)
 {
   printf("*** Reboot called\n");
+  if(running_image > 0) {
+    reboot_process(select_boot_image(running_image));
+  }
 }
 /*---------------------------------------------------------------------------*/
 static void
 reboot_to_selected_image(int image)
 {
   printf("*** Reboot to image %u called\n", image);
+  if(running_image > 0) {
+    if(image < 1 || image > NATIVE_FLASH_IMAGE_COUNT) {
+      image = running_image;
+    }
+    reboot_process(select_boot_image(image));
+  }
 }
 /*---------------------------------------------------------------------------*/
 /*
@@ -96,13 +182,34 @@ reboot_to_selected_image(int image)
 static int
 get_running_image(void)
 {
-  return -1;
+  return running_image;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * The code does not execute from the emulated flash. Used by the image
+ * trailer to mark the running image slot as active.
+ */
+uint32_t
+native_sparrow_get_running_address(void)
+{
+  const image_info_t *images;
+
+  images = image_trailer_get_images();
+  if(running_image < 1 || images == NULL) {
+    return 0;
+  }
+  return images[running_image - 1].start_address + 1;
 }
 /*---------------------------------------------------------------------------*/
 static int
 get_image_count(void)
 {
-  return -1;
+  const mfg_area_t *flash_mfg_area;
+  flash_mfg_area = image_trailer_get_mfg_area();
+  if(flash_mfg_area == NULL) {
+    return -1;
+  }
+  return flash_mfg_area->number_of_images;
 }
 /*---------------------------------------------------------------------------*/
 const struct sparrow_device native_sparrow_device = {
@@ -44,4 +44,7 @@
 
 #define SPARROW_DEVICE native_sparrow_device
 
+/* The segmented CRC API is provided by lib/crc32-flash */
+#define HAVE_CRC_SEGMENTED              1
+
 #endif /* PLATFORM_NATIVE_H_ */
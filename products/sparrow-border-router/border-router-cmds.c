@@ -39,10 +39,19 @@
 #include "cmd.h"
 #include "border-router.h"
 #include "br-config.h"
+#include "br-snapshot.h"
+#include "br-standby.h"
+#include "br-radios.h"
 #include "border-router-rdc.h"
 #include "border-router-cmds.h"
 #include "instance-brm.h"
 #include "latency-stats.h"
+#if BR_CONTEXTS
+#include "br-contexts.h"
+#endif /* BR_CONTEXTS */
+#if BR_AQM
+#include "br-aqm.h"
+#endif /* BR_AQM */
 #include "dev/serial-line.h"
 #include "net/rpl/rpl.h"
 #include "net/rpl/rpl-private.h"
@@ -51,6 +60,7 @@
 #include "net/net-control.h"
 #include "sparrow-oam.h"
 #include "enc-dev.h"
+#include "brm-stats.h"
 #include <string.h>
 #include <stdlib.h>
 #include "net/packetbuf.h"
@@ -74,6 +84,9 @@
 /* initial value of 0 */
 uint32_t radio_control_version = 0;
 
+/* Radio API version with support for compact packet attributes */
+#define BORDER_ROUTER_COMPACT_ATTS_API_VERSION 6
+
 extern uint8_t radio_info;
 
 #define PRINT_TIME_ONCE       (1 << 0)
@@ -104,6 +117,16 @@ get_net_control_key(void)
 /* The SR time is the exepected time (e.g. diff) in the serial radio */
 static clock_time_t sr_time_diff;
 
+/* Serial throughput test (!xs) */
+static struct {
+  clock_time_t start;
+  uint32_t serial_start;
+  uint32_t bytes;
+  uint16_t expected;
+  uint16_t received;
+  uint16_t first_seqno;
+} debug_test;
+
 /* set min rtt to 100 ms at first... */
 static int sr_min_rtt = 100;
 
@@ -213,6 +236,12 @@ get_nbr_state_name(uint8_t state)
 int
 border_router_cmd_handler(const uint8_t *data, int len)
 {
+  if(command_context == CMD_CONTEXT_RADIO && enc_dev_get_radio() > 0
+     && data[0] == '!' && data[1] != '!' && data[1] != 'S' && data[1] != 'R') {
+    /* Only frames and replies are handled from the additional radios */
+    return br_radios_radio_input(enc_dev_get_radio(), data, len);
+  }
+
   /* handle global repair, etc here */
   if(data[0] == '!') {
     switch(data[1]) {
@@ -230,6 +259,7 @@ border_router_cmd_handler(const uint8_t *data, int len)
     case 'S':
       if(command_context == CMD_CONTEXT_RADIO) {
 
+	packetutils_set_atts_context(enc_dev_get_radio());
 	if(packetutils_deserialize_packetbuf(&data[2], len - 2) <= 0) {
 	  PRINTF("NBR: illegal packet attributes\n");
 	  return 1;
@@ -574,6 +604,9 @@ border_router_cmd_handler(const uint8_t *data, int len)
         v |= data[5];
         radio_control_version = v;
         YLOG_INFO("Radio protocol version: %u\n", v);
+        packetutils_set_atts_encoding(
+          v >= BORDER_ROUTER_COMPACT_ATTS_API_VERSION
+          ? PACKETUTILS_ATTS_COMPACT : PACKETUTILS_ATTS_LEGACY);
       }
       return 1;
     case 'V':
@@ -688,6 +721,8 @@ border_router_cmd_handler(const uint8_t *data, int len)
 	  }
 	  buf[3] = (count >> 8) & 0xff;
 	  buf[4] = count & 0xff;
+	  debug_test.expected = count;
+	  debug_test.received = 0;
 	  buf[5] = (size >> 8) & 0xff;
 	  buf[6] = size & 0xff;
 	  buf[7] = (rate >> 8) & 0xff;
@@ -718,6 +753,37 @@ border_router_cmd_handler(const uint8_t *data, int len)
 	    putchar('.');
 	  }
 	  last_seqno = seqno;
+
+	  if(debug_test.expected > 0) {
+	    if(debug_test.received == 0) {
+	      debug_test.start = clock_time();
+	      debug_test.serial_start =
+		BRM_STATS_DEBUG_GET(BRM_STATS_DEBUG_SLIP_RECV);
+	      debug_test.first_seqno = seqno;
+	      debug_test.bytes = 0;
+	    } else {
+	      debug_test.bytes += len;
+	    }
+	    debug_test.received++;
+	    if((uint16_t)(seqno - debug_test.first_seqno) + 1 >= debug_test.expected) {
+	      clock_time_t elapsed = clock_time() - debug_test.start;
+	      uint32_t serial;
+	      serial = BRM_STATS_DEBUG_GET(BRM_STATS_DEBUG_SLIP_RECV)
+		- debug_test.serial_start;
+	      if(elapsed == 0) {
+		elapsed = 1;
+	      }
+	      /* The first frame only starts the measurement */
+	      YLOG_INFO("Serial test: %u/%u frames, %lu payload bytes/s, %lu serial bytes/s, %lu%% overhead\n",
+			debug_test.received, debug_test.expected,
+			(unsigned long)((uint64_t)debug_test.bytes * CLOCK_SECOND / elapsed),
+			(unsigned long)((uint64_t)serial * CLOCK_SECOND / elapsed),
+			serial > debug_test.bytes
+			? (unsigned long)((serial - debug_test.bytes) * 100UL / debug_test.bytes)
+			: 0UL);
+	      debug_test.expected = 0;
+	    }
+	  }
 	  break;
         }
         case 'W': {
@@ -1015,6 +1081,32 @@ border_router_cmd_handler(const uint8_t *data, int len)
       }
       printf("RDC logging: 0x%x  print flags: 0x%x\n", log, print_flags);
       return 1;
+#if BR_CONTEXTS
+    } else if(strcmp("contexts", (char *)data) == 0) {
+      br_contexts_print();
+      return 1;
+#endif /* BR_CONTEXTS */
+#if BR_AQM
+    } else if(strcmp("aqm", (char *)data) == 0) {
+      br_aqm_print();
+      return 1;
+#endif /* BR_AQM */
+    } else if(strcmp("snapshot", (char *)data) == 0) {
+      br_snapshot_print();
+      return 1;
+    } else if(strcmp("snapshot save", (char *)data) == 0) {
+      if(br_snapshot_save()) {
+        printf("Checkpoint saved\n");
+      } else {
+        printf("No checkpoint saved\n");
+      }
+      return 1;
+    } else if(strcmp("standby", (char *)data) == 0) {
+      br_standby_print();
+      return 1;
+    } else if(strcmp("radios", (char *)data) == 0) {
+      br_radios_print();
+      return 1;
     } else if(strcmp("rssi", (char *)data) == 0) {
       uint8_t buf[4];
       int p;
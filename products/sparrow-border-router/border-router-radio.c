@@ -40,8 +40,12 @@
 #include "dev/radio.h"
 #include "net/netstack.h"
 #include "net/packetbuf.h"
+#include "net/mac/frame802154.h"
 #include "packetutils.h"
+#include "sparrow-encap.h"
 #include "border-router.h"
+#include "br-radios.h"
+#include "enc-dev.h"
 #include <string.h>
 
 #define DEBUG 0
@@ -68,10 +72,37 @@ prepare(const void *payload, unsigned short payload_len)
   return 1;
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * Rewrite the source PAN and address of a frame, such as a beacon,
+ * for the radio it is sent on.
+ */
+static int
+create_for_radio(int radio, uint8_t *buf, int size, unsigned short len)
+{
+  frame802154_t frame;
+  int hdr_len;
+
+  if(frame802154_parse((uint8_t *)data_to_send, len, &frame) <= 0
+     || frame.fcf.src_addr_mode != FRAME802154_LONGADDRMODE) {
+    return 0;
+  }
+  frame.src_pid = br_radios_get_panid(radio);
+  linkaddr_copy((linkaddr_t *)&frame.src_addr, br_radios_get_mac(radio));
+
+  hdr_len = frame802154_hdrlen(&frame);
+  if(hdr_len + frame.payload_len > size
+     || frame802154_create(&frame, buf, hdr_len) == 0) {
+    return 0;
+  }
+  memcpy(&buf[hdr_len], frame.payload, frame.payload_len);
+  return hdr_len + frame.payload_len;
+}
+/*---------------------------------------------------------------------------*/
 static int
 transmit(unsigned short transmit_len)
 {
   uint8_t buf[transmit_len + 2];
+  int radio, len;
 
   if(data_to_send == NULL) {
     return RADIO_TX_ERR;
@@ -80,10 +111,20 @@ transmit(unsigned short transmit_len)
   buf[0] = '!';
   buf[1] = 's';
 
-  /* Copy packet data */
-  memcpy(&buf[2], data_to_send, transmit_len);
+  /* Beacons are sent on the radio that received the beacon request */
+  radio = br_radios_get_beacon_radio();
+  if(radio == 0) {
+    /* Copy packet data */
+    memcpy(&buf[2], data_to_send, transmit_len);
+    len = transmit_len;
+  } else {
+    len = create_for_radio(radio, &buf[2], transmit_len, transmit_len);
+    if(len == 0) {
+      return RADIO_TX_ERR;
+    }
+  }
 
-  write_to_slip(buf, transmit_len + 2);
+  enc_dev_write(radio, buf, len + 2, SPARROW_ENCAP_PAYLOAD_SERIAL);
   return RADIO_TX_OK;
 }
 /*---------------------------------------------------------------------------*/
@@ -40,6 +40,8 @@
 #include "net/packetbuf.h"
 #include "net/queuebuf.h"
 #include "net/netstack.h"
+#include "net/ipv6/uip-icmp6.h"
+#include "net/ipv6/sicslowpan.h"
 #include "net/mac/frame802154.h"
 #include "dev/radio.h"
 #include "packetutils.h"
@@ -47,6 +49,11 @@
 #include "border-router-rdc.h"
 #include <string.h>
 #include "sparrow-oam.h"
+#include "lib/instrument.h"
+#include "br-metrics.h"
+#include "br-radios.h"
+#include "enc-dev.h"
+#include "sparrow-encap.h"
 
 #define YLOG_LEVEL YLOG_LEVEL_INFO
 #define YLOG_NAME  "br-rdc"
@@ -58,11 +65,20 @@
 /* from border-router-cmds */
 clock_time_t get_sr_time(void);
 
+#define UIP_IP_BUF ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+/* DSCP class selectors for network control and lower effort traffic */
+#define DSCP_CS6 48
+#define DSCP_CS1 8
+#define DSCP_LE  1
+
 static uint8_t log_rx = 0;
 static uint8_t log_tx = 0;
 
 /* The number of callbacks must fit in 8 bit */
 #define MAX_CALLBACKS 255
+/* Session id for copies of broadcasts sent on the additional radios */
+#define NO_CALLBACK   MAX_CALLBACKS
 static uint8_t callback_pos;
 
 /* a structure for calling back when packet data is coming back
@@ -141,7 +157,10 @@ border_router_rdc_set_logging(uint8_t flags)
 void
 packet_sent(uint8_t sessionid, uint8_t status, uint8_t tx)
 {
-  if(sessionid < MAX_CALLBACKS) {
+  br_radios_tx_done(enc_dev_get_radio(), status);
+  if(sessionid == NO_CALLBACK) {
+    /* Broadcast copy on an additional radio */
+  } else if(sessionid < MAX_CALLBACKS) {
     struct tx_callback *callback;
     callback = &callbacks[sessionid];
     packetbuf_clear();
@@ -159,6 +178,8 @@ packet_sent(uint8_t sessionid, uint8_t status, uint8_t tx)
              (unsigned long)(clock_time() - callback->timeout.start));
     }
     callback->len = 0;
+    INSTRUMENT_LINK_TX(packetbuf_addr(PACKETBUF_ADDR_RECEIVER), status, tx);
+    BR_METRICS_TX_DONE(status, tx, clock_time() - callback->timeout.start);
     mac_call_sent_callback(callback->cback, callback->ptr, status, tx);
   } else {
     YLOG_DEBUG("*** ERROR: too high session id %d\n", sessionid);
@@ -192,21 +213,83 @@ setup_callback(mac_callback_t sent, void *ptr, uint8_t *send_id)
   return 1;
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * Traffic class on the serial line. Frames are created from the IPv6
+ * packet in uip_buf, except fragments that might have been queued.
+ * Large datagrams, such as firmware images, are fragmented and bulk.
+ */
+static uint8_t
+get_tx_class(void)
+{
+  const uint8_t *data;
+  uint8_t proto, dscp;
+  int pos, end;
+
+  data = packetbuf_dataptr();
+  if(packetbuf_datalen() > 0
+     && ((data[0] & 0xf8) == SICSLOWPAN_DISPATCH_FRAG1
+         || (data[0] & 0xf8) == SICSLOWPAN_DISPATCH_FRAGN)) {
+    return ENC_DEV_TX_BULK;
+  }
+  if(uip_len < UIP_IPH_LEN) {
+    return ENC_DEV_TX_INTERACTIVE;
+  }
+
+  dscp = ((UIP_IP_BUF->vtc & 0x0f) << 2) | (UIP_IP_BUF->tcflow >> 6);
+  if(dscp >= DSCP_CS6) {
+    return ENC_DEV_TX_CONTROL;
+  }
+  if(dscp == DSCP_CS1 || dscp == DSCP_LE) {
+    return ENC_DEV_TX_BULK;
+  }
+
+  /* Skip extension headers such as the RPL hop-by-hop option */
+  proto = UIP_IP_BUF->proto;
+  pos = UIP_LLH_LEN + UIP_IPH_LEN;
+  end = UIP_LLH_LEN + uip_len;
+  while((proto == UIP_PROTO_HBHO || proto == UIP_PROTO_ROUTING
+         || proto == UIP_PROTO_DESTO) && pos + 2 <= end) {
+    proto = uip_buf[pos];
+    pos += (uip_buf[pos + 1] + 1) * 8;
+  }
+
+  if(proto == UIP_PROTO_ICMP6 && pos < end) {
+    switch(uip_buf[pos]) {
+    case ICMP6_RPL:
+    case ICMP6_RS:
+    case ICMP6_RA:
+    case ICMP6_NS:
+    case ICMP6_NA:
+    case ICMP6_REDIRECT:
+      return ENC_DEV_TX_CONTROL;
+    }
+  }
+  return ENC_DEV_TX_INTERACTIVE;
+}
+/*---------------------------------------------------------------------------*/
 static unsigned long txcount;
 static void
-send_packet(mac_callback_t sent, void *ptr)
+send_to_radio(int radio, mac_callback_t sent, void *ptr, int has_callback,
+              uint8_t tx_class)
 {
-  int size;
-  /* 3 bytes per packet attribute is required for serialization */
+  int size, ret;
+  /* At most 3 bytes per packet attribute is required for serialization */
   uint8_t buf[PACKETBUF_NUM_ATTRS * 3 + PACKETBUF_SIZE + 3];
   uint8_t sid;
+  uint16_t pan_id;
 
-  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, &linkaddr_node_addr);
+  packetbuf_set_addr(PACKETBUF_ADDR_SENDER, br_radios_get_mac(radio));
 
   /* ack or not ? */
   packetbuf_set_attr(PACKETBUF_ATTR_MAC_ACK, 1);
 
-  if(NETSTACK_FRAMER.create() < 0) {
+  /* Each radio serves its own PAN */
+  pan_id = frame802154_get_pan_id();
+  frame802154_set_pan_id(br_radios_get_panid(radio));
+  ret = NETSTACK_FRAMER.create();
+  frame802154_set_pan_id(pan_id);
+
+  if(ret < 0) {
     /* Failed to allocate space for headers */
     YLOG_DEBUG("send failed, too large header\n");
     mac_call_sent_callback(sent, ptr, MAC_TX_ERR_FATAL, 0);
@@ -217,34 +300,74 @@ send_packet(mac_callback_t sent, void *ptr)
     /* here we send the data over SLIP to the radio-chip */
     type = 'S'; /* default for sending down to SR */
 
-    size = packetutils_serialize_atts(&buf[3], sizeof(buf) - 3);
-    if(size < 0 || size + packetbuf_totlen() + 3 > sizeof(buf)) {
+    /* Serialize packet attributes and packet data. The attributes
+       are encoded by enc-dev when the frame is sent to the radio. */
+    size = packetutils_serialize_packetbuf_queued(&buf[3], sizeof(buf) - 3);
+    if(size < 0) {
       YLOG_DEBUG("send failed, too large header\n");
       mac_call_sent_callback(sent, ptr, MAC_TX_ERR_FATAL, 0);
 
+    } else if(!has_callback) {
+      sid = NO_CALLBACK;
+
     } else if(!setup_callback(sent, ptr, &sid)) {
       /* Failed to allocate a new callback for the transmission. The
          packet can not be sent at this time. */
       mac_call_sent_callback(sent, ptr, MAC_TX_ERR, 0);
+      size = -1;
+    }
 
-    } else {
+    if(size >= 0) {
       buf[0] = '!';
       buf[1] = type;
       buf[2] = sid; /* sequence or session number for this packet */
 
-      /* Copy packet data */
-      memcpy(&buf[3 + size], packetbuf_hdrptr(), packetbuf_totlen());
-
       txcount++;
-      YLOG_DEBUG("sent %u/%u bytes with %c session %u (total %lu)\n",
-                 packetbuf_totlen(), packetbuf_totlen() + size + 3,
-                 type, sid, txcount);
-      write_to_slip(buf, packetbuf_totlen() + size + 3);
+      BR_METRICS_OBSERVE(BR_METRICS_SERIAL_QUEUE, enc_dev_buffered(radio));
+      YLOG_DEBUG("sent %u/%u bytes with %c session %u on radio %d (total %lu)\n",
+                 packetbuf_totlen(), size + 3,
+                 type, sid, radio, txcount);
+      enc_dev_write_class(radio, buf, size + 3, SPARROW_ENCAP_PAYLOAD_SERIAL,
+                          tx_class);
     }
   }
 }
 /*---------------------------------------------------------------------------*/
 static void
+send_packet(mac_callback_t sent, void *ptr)
+{
+  struct queuebuf *q;
+  uint8_t tx_class;
+  int radio;
+
+  tx_class = get_tx_class();
+
+  if(enc_dev_count() < 2) {
+    send_to_radio(0, sent, ptr, 1, tx_class);
+
+  } else if(!packetbuf_holds_broadcast()) {
+    /* Unicast on the radio where the neighbor was last heard */
+    send_to_radio(br_radios_lookup(packetbuf_addr(PACKETBUF_ADDR_RECEIVER)),
+                  sent, ptr, 1, tx_class);
+
+  } else {
+    /* Broadcast to all PANs - only the primary radio reports back */
+    q = queuebuf_new_from_packetbuf();
+    if(q == NULL) {
+      YLOG_ERROR("no queuebuf for broadcast to all radios\n");
+    } else {
+      for(radio = 1; radio < enc_dev_count(); radio++) {
+        queuebuf_to_packetbuf(q);
+        send_to_radio(radio, NULL, NULL, 0, tx_class);
+      }
+      queuebuf_to_packetbuf(q);
+      queuebuf_free(q);
+    }
+    send_to_radio(0, sent, ptr, 1, tx_class);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
 send_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
 {
   if(buf_list != NULL) {
@@ -255,10 +378,22 @@ send_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
 /*---------------------------------------------------------------------------*/
 static int drop_all = 0;
 int border_router_rdc_dropped;
+/*---------------------------------------------------------------------------*/
+static int
+is_beacon_request(void)
+{
+  frame802154_t frame;
+
+  return frame802154_parse(packetbuf_dataptr(), packetbuf_datalen(), &frame) > 0
+    && frame.fcf.frame_type == FRAME802154_CMDFRAME
+    && frame.payload_len > 0 && frame.payload[0] == FRAME802154_BEACONREQ;
+}
+/*---------------------------------------------------------------------------*/
 static void
 packet_input(void)
 {
-  int ret;
+  int ret, radio;
+  uint16_t pan_id;
   uint16_t recv_time;
   uint16_t recv_len;
 
@@ -269,9 +404,24 @@ packet_input(void)
   }
 
   recv_len = packetbuf_datalen();
+  radio = enc_dev_get_radio();
+  pan_id = frame802154_get_pan_id();
+  if(enc_dev_count() > 1) {
+    if(is_beacon_request() && !br_radios_beacon_request(radio)) {
+      /* Balance new joins over the PANs */
+      return;
+    }
+    frame802154_set_pan_id(br_radios_get_panid(radio));
+  }
   ret = NETSTACK_FRAMER.parse();
+  frame802154_set_pan_id(pan_id);
+  if(ret != FRAMER_FAILED) {
+    br_radios_input(radio, packetbuf_addr(PACKETBUF_ADDR_SENDER));
+  }
   if(ret == FRAMER_FRAME_HANDLED) {
     /* Packet has already been handled by the framer */
+    INSTRUMENT_LINK_RX(packetbuf_addr(PACKETBUF_ADDR_SENDER),
+                       (int8_t)packetbuf_attr(PACKETBUF_ATTR_RSSI));
     if(log_rx) {
       YLOG_PRINT("[FRX%3d] %-6s [", recv_len,
              get_frame_type(packetbuf_attr(PACKETBUF_ATTR_FRAME_TYPE)));
@@ -290,6 +440,8 @@ packet_input(void)
                ret, packetbuf_datalen());
   } else {
     YLOG_DEBUG("RECV %u\n", packetbuf_datalen());
+    INSTRUMENT_LINK_RX(packetbuf_addr(PACKETBUF_ADDR_SENDER),
+                       (int8_t)packetbuf_attr(PACKETBUF_ATTR_RSSI));
 
     if(log_rx) {
       YLOG_PRINT("[RX %3d] %-6s [", recv_len,
@@ -58,6 +58,20 @@
 #include "border-router-cmds.h"
 #include "brm-stats.h"
 #include "br-config.h"
+#include "br-snapshot.h"
+#include "br-standby.h"
+#include "br-radios.h"
+#include "enc-dev.h"
+#include "sparrow-encap.h"
+#if BR_CONTEXTS
+#include "br-contexts.h"
+#endif /* BR_CONTEXTS */
+#if BR_AQM
+#include "br-aqm.h"
+#endif /* BR_AQM */
+#ifdef HAVE_BORDER_ROUTER_METRICS
+#include "br-metrics.h"
+#endif /* HAVE_BORDER_ROUTER_METRICS */
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -366,11 +380,15 @@ void
 border_router_set_radio_mode(uint8_t mode)
 {
   uint8_t buf[3];
+  int i;
   buf[0] = '!';
   buf[1] = 'm';
   buf[2] = mode;
   radio_mode = mode;
-  write_to_slip(buf, 3);
+  /* All PANs follow the radio mode */
+  for(i = 0; i < enc_dev_count(); i++) {
+    enc_dev_write(i, buf, 3, SPARROW_ENCAP_PAYLOAD_SERIAL);
+  }
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -392,12 +410,15 @@ void
 border_router_set_radio_watchdog(uint16_t seconds)
 {
   uint8_t buf[5];
+  int i;
   buf[0] = '!';
   buf[1] = 'x';
   buf[2] = 'W';
   buf[3] = (seconds >> 8) & 0xff;
   buf[4] = seconds & 0xff;
-  write_to_slip(buf, 5);
+  for(i = 0; i < enc_dev_count(); i++) {
+    enc_dev_write(i, buf, 5, SPARROW_ENCAP_PAYLOAD_SERIAL);
+  }
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -557,6 +578,19 @@ border_router_print_stat()
   YLOG_INFO("SLIP: sent %lu bytes, %lu frames, %ld packets pending\n",
             slip_sent_to_fd, slip_sent, slip_buffered());
   YLOG_INFO("SLIP: max read buffer usage: %lu bytes\n", slip_max_buffer_usage);
+  YLOG_INFO("SLIP: aggregated %u sent, %u received in %u frames\n",
+            BRM_STATS_DEBUG_GET(BRM_STATS_DEBUG_SLIP_AGGREGATED_SENT),
+            BRM_STATS_DEBUG_GET(BRM_STATS_DEBUG_SLIP_AGGREGATED_RECV),
+            BRM_STATS_GET(BRM_STATS_ENCAP_AGGREGATE));
+  YLOG_INFO("SLIP: %u retransmits (%u fast, %u failed)\n",
+            BRM_STATS_DEBUG_GET(BRM_STATS_DEBUG_SLIP_RETRANSMITS),
+            BRM_STATS_DEBUG_GET(BRM_STATS_DEBUG_SLIP_FAST_RETRANSMITS),
+            BRM_STATS_DEBUG_GET(BRM_STATS_DEBUG_SLIP_RETRANSMIT_FAILED));
+  YLOG_INFO("SLIP: %u gaps, %u out of order, %u duplicates, %u lost\n",
+            BRM_STATS_DEBUG_GET(BRM_STATS_DEBUG_SLIP_GAPS),
+            BRM_STATS_DEBUG_GET(BRM_STATS_DEBUG_SLIP_OUT_OF_ORDER),
+            BRM_STATS_DEBUG_GET(BRM_STATS_DEBUG_SLIP_DUPLICATES),
+            BRM_STATS_DEBUG_GET(BRM_STATS_DEBUG_SLIP_LOST));
 }
 /*---------------------------------------------------------------------------*/
 static void
@@ -630,6 +664,8 @@ PROCESS_THREAD(border_router_process, ev, data)
   dis = 2; /* send a couple of DIS at startup to detect any existing network */
 
   br_config_handle_arguments(contiki_argc, contiki_argv);
+  br_snapshot_init(snapshot_config_file);
+  br_standby_init(&border_router_process);
 
   YLOG_INFO("RPL-Border router started\n");
 
@@ -646,6 +682,7 @@ PROCESS_THREAD(border_router_process, ev, data)
 
   /* First init enc-dev so we can get the mac address from the radio */
   enc_dev_init();
+  br_radios_init();
 
   etimer_set(&et, CLOCK_SECOND / 32);
   PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
@@ -752,7 +789,7 @@ PROCESS_THREAD(border_router_process, ev, data)
 
   watchdog_periodic();
 
-  if(!br_config_wait_for_address) {
+  if(!br_config_wait_for_address && !br_standby_is_standby()) {
     /* Stand alone mode - configure radio to defaults */
     border_router_set_radio_mode(RADIO_MODE_NORMAL);
   }
@@ -775,6 +812,22 @@ PROCESS_THREAD(border_router_process, ev, data)
     border_router_request_radio_version();
   }
 
+  if(enc_dev_count() > 1) {
+    /* Configure the additional radios, one PAN each */
+    wait_turns = 0;
+    while(!br_radios_is_ready()) {
+      if(wait_turns++ > 10) {
+        YLOG_ERROR("no response from the additional radios\n");
+        exit(EXIT_FAILURE);
+      }
+      br_radios_start();
+      etimer_set(&et, CLOCK_SECOND);
+      PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+      watchdog_periodic();
+    }
+    YLOG_INFO("Serving %d PANs\n", enc_dev_count());
+  }
+
   /* Have all info from radio, init OAM and UDP server */
   udp_cmd_start();
   sparrow_oam_init();
@@ -787,6 +840,10 @@ PROCESS_THREAD(border_router_process, ev, data)
   border_router_server_init();
 #endif /* HAVE_BORDER_ROUTER_SERVER */
 
+#ifdef HAVE_BORDER_ROUTER_METRICS
+  br_metrics_init();
+#endif /* HAVE_BORDER_ROUTER_METRICS */
+
   if(br_config_is_slave) {
     YLOG_INFO("in slave mode\n");
 
@@ -802,6 +859,32 @@ PROCESS_THREAD(border_router_process, ev, data)
     }
   }
 
+  if(br_standby_is_standby()) {
+    YLOG_INFO("in standby mode\n");
+
+    /* Keep the radio idle until the active border router is lost */
+    while(br_standby_is_waiting()) {
+      etimer_set(&et, CLOCK_SECOND * 10);
+      PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et) || ev == PROCESS_EVENT_POLL);
+#if BORDER_ROUTER_SET_RADIO_WATCHDOG > 0
+      border_router_set_radio_watchdog(BORDER_ROUTER_SET_RADIO_WATCHDOG);
+#endif /* BORDER_ROUTER_SET_RADIO_WATCHDOG > 0 */
+      watchdog_periodic();
+    }
+
+    YLOG_INFO("taking over from the active border router\n");
+    border_router_set_radio_mode(RADIO_MODE_NORMAL);
+    if(br_standby_get_dag_id(&dag_id)) {
+      /* Continue as root of the same DODAG - no need to probe the PAN */
+      memcpy(&prefix, &dag_id, 8);
+      memset(&prefix.u8[8], 0, 8);
+      prefix_set = 1;
+      uip_ds6_addr_add(&dag_id, 0, ADDR_AUTOCONF);
+      br_config_wait_for_address = 0;
+      dis = 0;
+    }
+  }
+
 #if WEBSERVER > 0
   process_start(&webserver_nogui_process, NULL);
 #endif /* WEBSERVER > 0 */
@@ -838,7 +921,7 @@ PROCESS_THREAD(border_router_process, ev, data)
     YLOG_DEBUG("RPL-Border router have address\n");
   }
 
-  if(br_config_ipaddr != NULL) {
+  if(br_config_ipaddr != NULL && !prefix_set) {
     uip_ipaddr_t prefix;
 
     if(uiplib_ipaddrconv((const char *)br_config_ipaddr, &prefix)) {
@@ -870,10 +953,21 @@ PROCESS_THREAD(border_router_process, ev, data)
     }
   }
 
+  /* The border router has an address in the PAN of each radio */
+  br_radios_add_addresses(prefix_set ? &prefix : NULL);
+
   /* tun init is also responsible for setting up the SLIP connection */
   tun_init();
 
-  if(has_dag_version) {
+  /* Continue with the replicated DODAG after a takeover, or with the
+     checkpointed DODAG if the PAN has not moved on */
+  dag = br_standby_takeover();
+  if(dag == NULL) {
+    dag = br_snapshot_restore(&dag_id, has_dag_version ? &dag_init_version : NULL);
+  }
+  if(dag != NULL) {
+    has_dag_version = 0;
+  } else if(has_dag_version) {
     /* increase if we found a version */
     RPL_LOLLIPOP_INCREMENT(dag_init_version);
     dag = rpl_set_root_with_version(RPL_DEFAULT_INSTANCE, &dag_id,
@@ -884,6 +978,8 @@ PROCESS_THREAD(border_router_process, ev, data)
   if(dag != NULL) {
     dag->grounded = 1;
     rpl_set_prefix(dag, &prefix, 64);
+    br_snapshot_start();
+    br_standby_start();
     if(has_dag_version) {
       YLOG_DEBUG("created a new RPL dag with version %u\n", dag_init_version);
     } else {
@@ -893,6 +989,13 @@ PROCESS_THREAD(border_router_process, ev, data)
 
   print_local_addresses();
 
+#if BR_CONTEXTS
+  br_contexts_init();
+#endif /* BR_CONTEXTS */
+#if BR_AQM
+  br_aqm_init();
+#endif /* BR_AQM */
+
   if(br_config_beacon != NULL) {
     /* Reply to beacon requests */
     border_router_set_beacon(br_config_beacon);
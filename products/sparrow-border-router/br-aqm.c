@@ -0,0 +1,424 @@
+/*
+ * Copyright (c) 2016, Yanzi Networks AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *    3. Neither the name of the copyright holders nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Active queue management for packets from the tun interface.
+ *
+ *         The packets to the PAN are hashed into flows by destination
+ *         address and each flow is managed by CoDel. The sojourn time
+ *         of a packet is measured when it is written to the serial
+ *         radio. When the sojourn time of a flow has been above the
+ *         target for an interval, new packets of the flow are marked
+ *         with ECN CE, or dropped if the flow is not ECN capable, at
+ *         an increasing rate until the delay is below target again.
+ *         Flows that stay overloaded are dropped even if ECN capable.
+ *
+ *         ICMPv6 has no error for congestion, so dropped packets are
+ *         by default dropped silently. With BR_AQM_CONF_ICMP the
+ *         sender of an overloaded flow instead gets a rate limited
+ *         destination unreachable with code "administratively
+ *         prohibited". That code is not a claim that the destination
+ *         is gone, but senders may still report it to applications.
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ip/tcpip.h"
+#include "net/ipv6/uip-icmp6.h"
+#include "net/ip/uip-debug.h"
+#include "br-aqm.h"
+#include <string.h>
+#include <stdio.h>
+
+#define YLOG_LEVEL YLOG_LEVEL_INFO
+#define YLOG_NAME  "aqm"
+#include "ylog.h"
+
+/* Number of flows - must be a power of two */
+#ifdef BR_AQM_CONF_FLOWS
+#define BR_AQM_FLOWS BR_AQM_CONF_FLOWS
+#else
+#define BR_AQM_FLOWS 256
+#endif
+
+/* Acceptable queueing delay in milliseconds */
+#ifdef BR_AQM_CONF_TARGET
+#define BR_AQM_TARGET BR_AQM_CONF_TARGET
+#else
+#define BR_AQM_TARGET 50
+#endif
+
+/* Milliseconds above target before dropping starts */
+#ifdef BR_AQM_CONF_INTERVAL
+#define BR_AQM_INTERVAL BR_AQM_CONF_INTERVAL
+#else
+#define BR_AQM_INTERVAL 500
+#endif
+
+/* Milliseconds of dropping before ECN capable packets are dropped (0 = never) */
+#ifdef BR_AQM_CONF_OVERLOAD_TIME
+#define BR_AQM_OVERLOAD_TIME BR_AQM_CONF_OVERLOAD_TIME
+#else
+#define BR_AQM_OVERLOAD_TIME 5000
+#endif
+
+/* Send ICMPv6 errors for packets dropped from overloaded flows */
+#ifdef BR_AQM_CONF_ICMP
+#define BR_AQM_ICMP BR_AQM_CONF_ICMP
+#else
+#define BR_AQM_ICMP 0
+#endif
+
+/* Minimum milliseconds between ICMPv6 errors per flow */
+#ifdef BR_AQM_CONF_ICMP_INTERVAL
+#define BR_AQM_ICMP_INTERVAL BR_AQM_CONF_ICMP_INTERVAL
+#else
+#define BR_AQM_ICMP_INTERVAL 1000
+#endif
+
+#if BR_AQM_FLOWS & (BR_AQM_FLOWS - 1)
+#error "BR_AQM_FLOWS must be a power of two"
+#endif
+
+#define UIP_IP_BUF ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+/* ECN bits in the second byte of the IPv6 header */
+#define ECN_MASK 0x30
+#define ECN_CE   0x30
+
+struct flow {
+  /* last destination hashed to the flow */
+  uip_ipaddr_t addr;
+  unsigned long first_above_time;
+  unsigned long drop_next;
+  unsigned long dropping_since;
+  unsigned long last_sample;
+  unsigned long last_icmp;
+  uint16_t count;
+  uint16_t lastcount;
+  uint8_t dropping;
+  uint8_t used;
+
+  uint32_t packets;
+  uint32_t drops;
+  uint32_t marks;
+  uint32_t samples;
+  unsigned long delay_total;
+  unsigned long delay_max;
+  unsigned long delay_last;
+};
+
+static struct flow flows[BR_AQM_FLOWS];
+static struct br_aqm_stats stats;
+static uint16_t current_flow = BR_AQM_NO_FLOW;
+/*---------------------------------------------------------------------------*/
+static unsigned long
+now_ms(void)
+{
+  return (unsigned long)clock_time() * 1000 / CLOCK_SECOND;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+get_flow_index(const uip_ipaddr_t *addr)
+{
+  uint32_t hash = 2166136261UL;
+  int i;
+
+  for(i = 0; i < sizeof(addr->u8); i++) {
+    hash = (hash ^ addr->u8[i]) * 16777619UL;
+  }
+  return (hash ^ (hash >> 16)) & (BR_AQM_FLOWS - 1);
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+isqrt(uint32_t v)
+{
+  uint32_t root = 0;
+  uint32_t bit = 1UL << 30;
+
+  while(bit > v) {
+    bit >>= 2;
+  }
+  while(bit != 0) {
+    if(v >= root + bit) {
+      v -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return root;
+}
+/*---------------------------------------------------------------------------*/
+/* The next drop is interval / sqrt(count) after the previous */
+static unsigned long
+control_law(unsigned long t, uint16_t count)
+{
+  return t + (BR_AQM_INTERVAL * 256UL) / isqrt((uint32_t)count << 16);
+}
+/*---------------------------------------------------------------------------*/
+#if BR_AQM_ICMP && BR_AQM_OVERLOAD_TIME > 0
+static void
+send_icmp_error(struct flow *f, unsigned long now)
+{
+  if(now - f->dropping_since < BR_AQM_OVERLOAD_TIME ||
+     (f->last_icmp != 0 && now - f->last_icmp < BR_AQM_ICMP_INTERVAL)) {
+    return;
+  }
+  f->last_icmp = now;
+  if(f->last_icmp == 0) {
+    f->last_icmp = 1;
+  }
+
+  uip_ext_len = 0;
+  uip_icmp6_error_output(ICMP6_DST_UNREACH, ICMP6_DST_UNREACH_ADMIN, 0);
+  if(uip_len > 0) {
+    stats.icmp_sent++;
+    tcpip_ipv6_output();
+  }
+}
+#endif /* BR_AQM_ICMP && BR_AQM_OVERLOAD_TIME > 0 */
+/*---------------------------------------------------------------------------*/
+int
+br_aqm_input(void)
+{
+  struct flow *f;
+  unsigned long now;
+
+  current_flow = BR_AQM_NO_FLOW;
+
+  if(uip_len < UIP_IPH_LEN || (UIP_IP_BUF->vtc & 0xf0) != 0x60
+     || uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
+    return 1;
+  }
+
+  current_flow = get_flow_index(&UIP_IP_BUF->destipaddr);
+  f = &flows[current_flow];
+  uip_ipaddr_copy(&f->addr, &UIP_IP_BUF->destipaddr);
+  f->used = 1;
+  f->packets++;
+  stats.packets++;
+
+  if(!f->dropping) {
+    return 1;
+  }
+
+  now = now_ms();
+  if(now - f->last_sample > BR_AQM_INTERVAL) {
+    /* Nothing has been sent for the flow - the queue has drained */
+    f->dropping = 0;
+    f->first_above_time = 0;
+    return 1;
+  }
+
+  if((long)(now - f->drop_next) < 0) {
+    return 1;
+  }
+
+  f->count++;
+  if(f->count == 0) {
+    f->count = 0xffff;
+  }
+  /* Keep the drop schedule unless it has fallen far behind */
+  f->drop_next = control_law(now - f->drop_next > BR_AQM_INTERVAL
+                             ? now : f->drop_next, f->count);
+
+  /* ECN capable flows are dropped when they do not respond to marks */
+  if((UIP_IP_BUF->tcflow & ECN_MASK) != 0
+     && (BR_AQM_OVERLOAD_TIME == 0
+         || now - f->dropping_since < BR_AQM_OVERLOAD_TIME)) {
+    UIP_IP_BUF->tcflow |= ECN_CE;
+    f->marks++;
+    stats.marks++;
+    return 1;
+  }
+
+  f->drops++;
+  stats.drops++;
+  YLOG_DEBUG("drop packet to flow %u (count %u)\n", current_flow, f->count);
+  current_flow = BR_AQM_NO_FLOW;
+#if BR_AQM_ICMP && BR_AQM_OVERLOAD_TIME > 0
+  send_icmp_error(f, now);
+#endif /* BR_AQM_ICMP && BR_AQM_OVERLOAD_TIME > 0 */
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+br_aqm_input_done(void)
+{
+  current_flow = BR_AQM_NO_FLOW;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+br_aqm_get_flow(void)
+{
+  return current_flow;
+}
+/*---------------------------------------------------------------------------*/
+void
+br_aqm_sojourn(uint16_t flow, unsigned long delay_ms, long backlog)
+{
+  struct flow *f;
+  unsigned long now;
+  uint16_t delta;
+
+  if(flow >= BR_AQM_FLOWS) {
+    return;
+  }
+  f = &flows[flow];
+  now = now_ms();
+
+  f->samples++;
+  f->delay_total += delay_ms;
+  f->delay_last = delay_ms;
+  if(delay_ms > f->delay_max) {
+    f->delay_max = delay_ms;
+  }
+  f->last_sample = now;
+
+  if(delay_ms < BR_AQM_TARGET || backlog <= 0) {
+    f->first_above_time = 0;
+    if(f->dropping) {
+      YLOG_DEBUG("flow %u below target after %u drops\n",
+                 flow, f->count - f->lastcount);
+      f->dropping = 0;
+    }
+    return;
+  }
+
+  if(f->dropping) {
+    return;
+  }
+
+  if(f->first_above_time == 0) {
+    f->first_above_time = now + BR_AQM_INTERVAL;
+    if(f->first_above_time == 0) {
+      f->first_above_time = 1;
+    }
+    return;
+  }
+
+  if((long)(now - f->first_above_time) < 0) {
+    return;
+  }
+
+  /* Above target for an interval - start dropping */
+  delta = f->count - f->lastcount;
+  if(delta > 1 && now - f->drop_next < 16 * BR_AQM_INTERVAL) {
+    /* Recently in dropping state - continue at the previous rate */
+    f->count = delta;
+  } else {
+    f->count = 1;
+  }
+  f->lastcount = f->count;
+  /* The next packet of the flow is the first drop */
+  f->count--;
+  f->drop_next = now;
+  f->dropping_since = now;
+  f->dropping = 1;
+  YLOG_DEBUG("flow %u delay %lu ms above target\n", flow, delay_ms);
+}
+/*---------------------------------------------------------------------------*/
+const struct br_aqm_stats *
+br_aqm_get_stats(void)
+{
+  return &stats;
+}
+/*---------------------------------------------------------------------------*/
+int
+br_aqm_get_dropping(void)
+{
+  int i, n;
+
+  for(i = n = 0; i < BR_AQM_FLOWS; i++) {
+    if(flows[i].dropping) {
+      n++;
+    }
+  }
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+unsigned long
+br_aqm_get_max_delay(void)
+{
+  unsigned long now, max;
+  int i;
+
+  now = now_ms();
+  for(i = max = 0; i < BR_AQM_FLOWS; i++) {
+    if(flows[i].samples > 0 && now - flows[i].last_sample <= BR_AQM_INTERVAL
+       && flows[i].delay_last > max) {
+      max = flows[i].delay_last;
+    }
+  }
+  return max;
+}
+/*---------------------------------------------------------------------------*/
+void
+br_aqm_print(void)
+{
+  const struct flow *f;
+  int i;
+
+  printf("AQM: target %u ms, interval %u ms, %u flows\n",
+         BR_AQM_TARGET, BR_AQM_INTERVAL, BR_AQM_FLOWS);
+  printf(" packets %lu drops %lu marks %lu icmp %lu dropping %d\n",
+         (unsigned long)stats.packets, (unsigned long)stats.drops,
+         (unsigned long)stats.marks, (unsigned long)stats.icmp_sent,
+         br_aqm_get_dropping());
+
+  for(i = 0; i < BR_AQM_FLOWS; i++) {
+    f = &flows[i];
+    if(!f->used) {
+      continue;
+    }
+    printf(" %3u ", i);
+    uip_debug_ipaddr_print(&f->addr);
+    printf(" packets %lu drops %lu marks %lu",
+           (unsigned long)f->packets, (unsigned long)f->drops,
+           (unsigned long)f->marks);
+    if(f->samples > 0) {
+      printf(" delay avg %lu max %lu last %lu ms",
+             f->delay_total / f->samples, f->delay_max, f->delay_last);
+    }
+    printf("%s\n", f->dropping ? " dropping" : "");
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+br_aqm_init(void)
+{
+  memset(flows, 0, sizeof(flows));
+  memset(&stats, 0, sizeof(stats));
+  current_flow = BR_AQM_NO_FLOW;
+  YLOG_INFO("target %u ms interval %u ms\n", BR_AQM_TARGET, BR_AQM_INTERVAL);
+}
+/*---------------------------------------------------------------------------*/
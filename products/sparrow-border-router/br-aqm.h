@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2016, Yanzi Networks AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *    3. Neither the name of the copyright holders nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Active queue management for packets from the tun interface
+ */
+
+#ifndef BR_AQM_H_
+#define BR_AQM_H_
+
+#include "contiki.h"
+
+/* Packets not from the tun interface */
+#define BR_AQM_NO_FLOW 0xffff
+
+struct br_aqm_stats {
+  uint32_t packets;
+  uint32_t drops;
+  uint32_t marks;
+  uint32_t icmp_sent;
+};
+
+void br_aqm_init(void);
+
+/*
+ * Called with each IPv6 packet from the tun interface in uip_buf
+ * before it is processed. Returns zero if the packet should be dropped.
+ */
+int br_aqm_input(void);
+/* Called when the packet from the tun interface has been processed */
+void br_aqm_input_done(void);
+
+/* Returns the flow of the packet from the tun interface being processed */
+uint16_t br_aqm_get_flow(void);
+
+/* A packet of the flow has been sent to the serial radio */
+void br_aqm_sojourn(uint16_t flow, unsigned long delay_ms, long backlog);
+
+const struct br_aqm_stats *br_aqm_get_stats(void);
+/* Returns the number of flows in the dropping state */
+int br_aqm_get_dropping(void);
+/* Returns the largest recent queueing delay of a flow in milliseconds */
+unsigned long br_aqm_get_max_delay(void);
+void br_aqm_print(void);
+
+#endif /* BR_AQM_H_ */
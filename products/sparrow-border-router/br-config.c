@@ -84,10 +84,16 @@ const char *br_config_run_command = NULL;
 const char *br_config_beacon = NULL;
 const char *ctrl_config_port = NULL;
 const char *server_config_port = NULL;
+const char *metrics_config_port = NULL;
+const char *snapshot_config_file = NULL;
+const char *standby_config_port = NULL;
+const char *standby_config_active = NULL;
 char br_config_tundev[1024] = { "" };
 uint16_t br_config_siodev_delay = SEND_DELAY_DEFAULT;
 uint16_t br_config_unit_controller_port = 4444;
 uint8_t br_config_is_slave = 0;
+struct br_config_radio br_config_radios[BR_MAX_RADIOS - 1];
+uint8_t br_config_radio_count = 0;
 
 #ifndef BAUDRATE
 #define BAUDRATE B460800
@@ -127,7 +133,61 @@ handle_config(const char *arg)
 }
 
 /*---------------------------------------------------------------------------*/
-#define GET_OPT_OPTIONS "_?hB:HD:Ls:t:v::b::d::i:l:a:p:SP:C:c:X:"
+/* Parse <siodev|host:port>[,channel[,panid]] */
+static int
+handle_radio(const char *arg)
+{
+  struct br_config_radio *r;
+  char *dev, *opt, *sep;
+
+  if(br_config_radio_count >= BR_MAX_RADIOS - 1) {
+    fprintf(stderr, "*** too many radios (max %u)\n", BR_MAX_RADIOS);
+    return 0;
+  }
+
+  dev = strdup(arg);
+  if(dev == NULL) {
+    return 0;
+  }
+  r = &br_config_radios[br_config_radio_count];
+  memset(r, 0, sizeof(struct br_config_radio));
+  r->channel = -1;
+  r->panid = -1;
+
+  opt = strchr(dev, ',');
+  if(opt != NULL) {
+    *opt++ = '\0';
+    sep = strchr(opt, ',');
+    if(sep != NULL) {
+      *sep++ = '\0';
+      dectoi((const uint8_t *)sep, strlen(sep), &r->panid);
+    }
+    if(*opt != '\0') {
+      dectoi((const uint8_t *)opt, strlen(opt), &r->channel);
+    }
+  }
+
+  sep = strrchr(dev, ':');
+  if(sep != NULL) {
+    *sep++ = '\0';
+    r->host = dev;
+    r->port = sep;
+  } else if(strncmp("/dev/", dev, 5) == 0) {
+    r->siodev = dev + 5;
+  } else {
+    r->siodev = dev;
+  }
+
+  if(*dev == '\0' || (r->port != NULL && *r->port == '\0')) {
+    fprintf(stderr, "*** illegal radio: %s\n", arg);
+    free(dev);
+    return 0;
+  }
+  br_config_radio_count++;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+#define GET_OPT_OPTIONS "_?hB:HD:Ls:t:v::b::d::i:l:a:p:SP:C:c:m:R:r:y:Y:X:"
 /*---------------------------------------------------------------------------*/
 int
 br_config_handle_arguments(int argc, char **argv)
@@ -208,6 +268,28 @@ br_config_handle_arguments(int argc, char **argv)
       server_config_port = optarg;
       break;
 
+    case 'm':
+      metrics_config_port = optarg;
+      break;
+
+    case 'R':
+      snapshot_config_file = optarg;
+      break;
+
+    case 'r':
+      if(! handle_radio(optarg)) {
+        exit(EXIT_FAILURE);
+      }
+      break;
+
+    case 'y':
+      standby_config_port = optarg;
+      break;
+
+    case 'Y':
+      standby_config_active = optarg;
+      break;
+
     case 'S':
       /* Start as slave */
       br_config_is_slave = 1;
@@ -262,6 +344,15 @@ fprintf(stderr," -i ipaddr      border router IP address\n");
 fprintf(stderr," -a host        Connect via TCP to server at <host>\n");
 fprintf(stderr," -p port        Connect via TCP to server at <host>:<port>\n");
 fprintf(stderr," -c port        Open UDP control at localhost:<port>\n");
+fprintf(stderr," -m [addr:]port Serve OpenMetrics at <addr>:<port> (default localhost)\n");
+fprintf(stderr," -R file        Checkpoint and restore the RPL root state in <file>\n");
+fprintf(stderr," -r siodev[,channel[,panid]]\n");
+fprintf(stderr,"                Serve another PAN with the serial radio at <siodev>\n");
+fprintf(stderr,"    -r host:port[,channel[,panid]] or via TCP at <host>:<port>\n");
+fprintf(stderr," -y [addr:]port Replicate the RPL root state to a standby at <addr>:<port>\n");
+fprintf(stderr,"    -y path     or at the Unix socket <path>\n");
+fprintf(stderr," -Y [addr:]port Run as hot standby of the border router at <addr>:<port>\n");
+fprintf(stderr,"    -Y path     or at the Unix socket <path>\n");
 fprintf(stderr," -t tundev      Name of interface (default tun0)\n");
 fprintf(stderr," -X cmd         Run the command and then exit\n");
 fprintf(stderr," -b0            Reply with default beacon to beacon requests from start\n");
@@ -32,6 +32,22 @@
 
 #include <stdint.h>
 
+/* Max number of serial radios, including the primary radio */
+#ifdef BR_CONF_MAX_RADIOS
+#define BR_MAX_RADIOS BR_CONF_MAX_RADIOS
+#else
+#define BR_MAX_RADIOS 4
+#endif
+
+/* An additional serial radio serving its own PAN */
+struct br_config_radio {
+  const char *siodev;
+  const char *host;
+  const char *port;
+  int channel;
+  int panid;
+};
+
 extern int br_config_radio_channel;
 extern int br_config_radio_panid;
 extern uint8_t br_config_wait_for_address;
@@ -45,9 +61,15 @@ extern const char *br_config_run_command;
 extern const char *br_config_beacon;
 extern const char *ctrl_config_port;
 extern const char *server_config_port;
+extern const char *metrics_config_port;
+extern const char *snapshot_config_file;
+extern const char *standby_config_port;
+extern const char *standby_config_active;
 extern char br_config_tundev[];
 extern uint16_t br_config_siodev_delay;
 extern uint16_t br_config_unit_controller_port;
 extern uint8_t br_config_is_slave;
+extern struct br_config_radio br_config_radios[BR_MAX_RADIOS - 1];
+extern uint8_t br_config_radio_count;
 
 #endif /* BR_CONFIG_H_ */
@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2016, Yanzi Networks AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *    3. Neither the name of the copyright holders nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Learning of 6LoWPAN address contexts for external prefixes.
+ *
+ *         The /64 prefixes of external addresses in the traffic
+ *         through the tun interface are counted and prefixes with
+ *         enough traffic are given a context number. A new context is
+ *         first distributed to the PAN for decompression only and is
+ *         used for compression after BR_CONTEXTS_ACTIVATE_DELAY.
+ *         Idle contexts are distributed as decompression only until
+ *         they expire and their numbers are reused after a hold time.
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ipv6/sicslowpan.h"
+#include "net/rpl/rpl.h"
+#include "net/rpl/rpl-private.h"
+#include "br-contexts.h"
+#include <string.h>
+#include <stdio.h>
+
+#define YLOG_LEVEL YLOG_LEVEL_INFO
+#define YLOG_NAME  "ctx"
+#include "ylog.h"
+
+/* Highest context number + 1 to allocate - must be supported by all nodes */
+#ifdef BR_CONTEXTS_CONF_MAX
+#define BR_CONTEXTS_MAX BR_CONTEXTS_CONF_MAX
+#else
+#define BR_CONTEXTS_MAX SICSLOWPAN_MAX_ADDR_CONTEXTS
+#endif
+
+/* Number of external prefixes to keep traffic statistics for */
+#ifdef BR_CONTEXTS_CONF_PREFIXES
+#define BR_CONTEXTS_PREFIXES BR_CONTEXTS_CONF_PREFIXES
+#else
+#define BR_CONTEXTS_PREFIXES 32
+#endif
+
+/* Statistics interval in seconds */
+#ifdef BR_CONTEXTS_CONF_INTERVAL
+#define BR_CONTEXTS_INTERVAL BR_CONTEXTS_CONF_INTERVAL
+#else
+#define BR_CONTEXTS_INTERVAL 60
+#endif
+
+/* Packets per interval needed for a prefix to get a context */
+#ifdef BR_CONTEXTS_CONF_MIN_PACKETS
+#define BR_CONTEXTS_MIN_PACKETS BR_CONTEXTS_CONF_MIN_PACKETS
+#else
+#define BR_CONTEXTS_MIN_PACKETS 20
+#endif
+
+/* Advertised context lifetime in seconds */
+#ifdef BR_CONTEXTS_CONF_LIFETIME
+#define BR_CONTEXTS_LIFETIME BR_CONTEXTS_CONF_LIFETIME
+#else
+#define BR_CONTEXTS_LIFETIME (60 * 60)
+#endif
+
+/* Seconds before a new context is used for compression */
+#ifdef BR_CONTEXTS_CONF_ACTIVATE_DELAY
+#define BR_CONTEXTS_ACTIVATE_DELAY BR_CONTEXTS_CONF_ACTIVATE_DELAY
+#else
+#define BR_CONTEXTS_ACTIVATE_DELAY (5 * 60)
+#endif
+
+/* Intervals without traffic before a context is retired */
+#ifdef BR_CONTEXTS_CONF_IDLE_INTERVALS
+#define BR_CONTEXTS_IDLE_INTERVALS BR_CONTEXTS_CONF_IDLE_INTERVALS
+#else
+#define BR_CONTEXTS_IDLE_INTERVALS 30
+#endif
+
+/* Seconds after expiry before a context number is reused */
+#ifdef BR_CONTEXTS_CONF_HOLD_TIME
+#define BR_CONTEXTS_HOLD_TIME BR_CONTEXTS_CONF_HOLD_TIME
+#else
+#define BR_CONTEXTS_HOLD_TIME (5 * 60)
+#endif
+
+#if BR_CONTEXTS_MAX > 16
+#error "BR_CONTEXTS_MAX can be at most 16"
+#endif
+
+struct prefix_entry {
+  uint8_t prefix[8];
+  /* packets in the current interval */
+  uint32_t hits;
+  /* allocated context number or 0 */
+  uint8_t context;
+};
+
+#define CONTEXT_FREE     0
+#define CONTEXT_PENDING  1
+#define CONTEXT_ACTIVE   2
+#define CONTEXT_RETIRED  3
+
+struct context_state {
+  uint8_t state;
+  uint8_t idle;
+  /* allocation time when pending, expiry time when retired */
+  unsigned long time;
+  struct prefix_entry *entry;
+};
+
+static struct prefix_entry prefixes[BR_CONTEXTS_PREFIXES];
+static struct context_state contexts[BR_CONTEXTS_MAX];
+static struct ctimer periodic_timer;
+/*---------------------------------------------------------------------------*/
+static void
+print_prefix(const uint8_t *prefix)
+{
+  printf("%02x%02x:%02x%02x:%02x%02x:%02x%02x::/64",
+         prefix[0], prefix[1], prefix[2], prefix[3],
+         prefix[4], prefix[5], prefix[6], prefix[7]);
+}
+/*---------------------------------------------------------------------------*/
+static int
+is_static_context(const uint8_t *prefix)
+{
+  const struct sicslowpan_addr_context *c;
+  int i;
+
+  for(i = 0; i < SICSLOWPAN_MAX_ADDR_CONTEXTS; i++) {
+    c = sicslowpan_context_get(i);
+    if(c != NULL &&
+       sicslowpan_context_lifetime(c) == SICSLOWPAN_CONTEXT_LIFETIME_INFINITE &&
+       memcmp(c->prefix, prefix, sizeof(c->prefix)) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+br_contexts_handle_packet(const uint8_t *buf, int size, uint8_t topan)
+{
+  const struct uip_ip_hdr *ipbuf = (const struct uip_ip_hdr *)buf;
+  const uip_ipaddr_t *addr;
+  struct prefix_entry *e;
+  int i;
+
+  if(size < UIP_IPH_LEN || (buf[0] & 0xf0) != 0x60) {
+    return;
+  }
+
+  /* The external address is the source for traffic to the PAN */
+  addr = topan ? &ipbuf->srcipaddr : &ipbuf->destipaddr;
+  if(uip_is_addr_mcast(addr) || uip_is_addr_linklocal(addr)
+     || uip_is_addr_unspecified(addr)) {
+    return;
+  }
+
+  e = NULL;
+  for(i = 0; i < BR_CONTEXTS_PREFIXES; i++) {
+    if(memcmp(prefixes[i].prefix, addr->u8, 8) == 0) {
+      prefixes[i].hits++;
+      return;
+    }
+    /* Remember the least used entry without context */
+    if(prefixes[i].context == 0 && (e == NULL || prefixes[i].hits < e->hits)) {
+      e = &prefixes[i];
+    }
+  }
+
+  if(e == NULL || is_static_context(addr->u8)) {
+    return;
+  }
+  memcpy(e->prefix, addr->u8, 8);
+  e->hits = 1;
+}
+/*---------------------------------------------------------------------------*/
+static struct prefix_entry *
+find_hot_prefix(void)
+{
+  struct prefix_entry *best;
+  int i;
+
+  best = NULL;
+  for(i = 0; i < BR_CONTEXTS_PREFIXES; i++) {
+    if(prefixes[i].context == 0 && prefixes[i].hits >= BR_CONTEXTS_MIN_PACKETS
+       && (best == NULL || prefixes[i].hits > best->hits)) {
+      best = &prefixes[i];
+    }
+  }
+  return best;
+}
+/*---------------------------------------------------------------------------*/
+static void
+periodic(void *ptr)
+{
+  struct context_state *s;
+  struct prefix_entry *e;
+  const struct sicslowpan_addr_context *c;
+  rpl_instance_t *instance;
+  unsigned long now, lifetime;
+  int i, changed;
+
+  now = clock_seconds();
+  changed = 0;
+
+  /* Context 0 is the PAN prefix configured on all nodes */
+  for(i = 1; i < BR_CONTEXTS_MAX; i++) {
+    s = &contexts[i];
+    if(s->state == CONTEXT_PENDING || s->state == CONTEXT_ACTIVE) {
+      if(s->entry->hits == 0) {
+        s->idle++;
+      } else {
+        s->idle = 0;
+      }
+
+      if(s->idle >= BR_CONTEXTS_IDLE_INTERVALS) {
+        /* Stop compressing and let the context expire in the PAN */
+        c = sicslowpan_context_get(i);
+        s->time = now;
+        if(c != NULL) {
+          lifetime = sicslowpan_context_lifetime(c);
+          s->time += lifetime;
+          sicslowpan_context_set(i, s->entry->prefix, 0, lifetime);
+        }
+        YLOG_INFO("retiring idle context %u\n", i);
+        s->entry->context = 0;
+        s->entry = NULL;
+        s->state = CONTEXT_RETIRED;
+        changed = 1;
+        continue;
+      }
+
+      if(s->state == CONTEXT_PENDING &&
+         now - s->time >= BR_CONTEXTS_ACTIVATE_DELAY) {
+        YLOG_INFO("context %u used for compression\n", i);
+        s->state = CONTEXT_ACTIVE;
+      }
+      if(sicslowpan_context_set(i, s->entry->prefix,
+                                s->state == CONTEXT_ACTIVE ?
+                                SICSLOWPAN_CONTEXT_COMPRESS : 0,
+                                BR_CONTEXTS_LIFETIME) > 0) {
+        changed = 1;
+      }
+
+    } else if(s->state == CONTEXT_RETIRED) {
+      if((long)(now - s->time) >= BR_CONTEXTS_HOLD_TIME) {
+        sicslowpan_context_remove(i);
+        s->state = CONTEXT_FREE;
+      }
+    }
+  }
+
+  /* Give free context numbers to the most used prefixes */
+  for(i = 1; i < BR_CONTEXTS_MAX; i++) {
+    s = &contexts[i];
+    if(s->state != CONTEXT_FREE) {
+      continue;
+    }
+    c = sicslowpan_context_get(i);
+    if(c != NULL &&
+       sicslowpan_context_lifetime(c) == SICSLOWPAN_CONTEXT_LIFETIME_INFINITE) {
+      /* Configured context number - never reused */
+      continue;
+    }
+    e = find_hot_prefix();
+    if(e == NULL) {
+      break;
+    }
+    if(sicslowpan_context_set(i, e->prefix, 0, BR_CONTEXTS_LIFETIME) < 0) {
+      break;
+    }
+    YLOG_INFO("context %u allocated for ", i);
+    print_prefix(e->prefix);
+    printf(" (%lu packets)\n", (unsigned long)e->hits);
+    e->context = i;
+    s->entry = e;
+    s->state = CONTEXT_PENDING;
+    s->idle = 0;
+    s->time = now;
+    changed = 1;
+  }
+
+  for(i = 0; i < BR_CONTEXTS_PREFIXES; i++) {
+    prefixes[i].hits = 0;
+  }
+
+  if(changed) {
+    /* Distribute the changes quickly */
+    instance = rpl_get_instance(RPL_DEFAULT_INSTANCE);
+    if(instance != NULL) {
+      rpl_reset_dio_timer(instance);
+    }
+  }
+
+  ctimer_reset(&periodic_timer);
+}
+/*---------------------------------------------------------------------------*/
+void
+br_contexts_print(void)
+{
+  static const char *state_names[] = { "free", "pending", "active", "retired" };
+  const struct sicslowpan_addr_context *c;
+  unsigned long lifetime;
+  int i;
+
+  printf("6LoWPAN contexts:\n");
+  for(i = 0; i < SICSLOWPAN_MAX_ADDR_CONTEXTS; i++) {
+    c = sicslowpan_context_get(i);
+    if(c == NULL) {
+      continue;
+    }
+    printf(" %2u ", i);
+    print_prefix(c->prefix);
+    lifetime = sicslowpan_context_lifetime(c);
+    if(lifetime == SICSLOWPAN_CONTEXT_LIFETIME_INFINITE) {
+      printf(" static ");
+    } else {
+      printf(" %s %lus ",
+             i < BR_CONTEXTS_MAX ? state_names[contexts[i].state] : "learned",
+             lifetime);
+    }
+#if SICSLOWPAN_CONTEXT_STATS
+    printf("packets %lu saved %lu bytes",
+           (unsigned long)c->packets, (unsigned long)c->bytes_saved);
+#endif /* SICSLOWPAN_CONTEXT_STATS */
+    printf("\n");
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+br_contexts_init(void)
+{
+  ctimer_set(&periodic_timer, BR_CONTEXTS_INTERVAL * CLOCK_SECOND,
+             periodic, NULL);
+}
+/*---------------------------------------------------------------------------*/
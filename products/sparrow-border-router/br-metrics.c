@@ -0,0 +1,778 @@
+/*
+ * Copyright (c) 2016, Yanzi Networks AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *    3. Neither the name of the copyright holders nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         OpenMetrics exporter for the native border router.
+ *
+ *         The metrics are rendered periodically into a snapshot from
+ *         the Contiki event loop. A scrape only copies the latest
+ *         snapshot to the socket from the select loop and never
+ *         touches the network stack.
+ */
+
+#include "contiki.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uip-ds6-route.h"
+#include "net/rpl/rpl.h"
+#include "net/rpl/rpl-private.h"
+#include "net/mac/mac.h"
+#include "border-router.h"
+#include "br-config.h"
+#include "br-metrics.h"
+#include "br-radios.h"
+#include "brm-stats.h"
+#include "enc-dev.h"
+#if BR_AQM
+#include "br-aqm.h"
+#endif /* BR_AQM */
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef HAVE_BORDER_ROUTER_METRICS
+
+#define YLOG_LEVEL YLOG_LEVEL_INFO
+#define YLOG_NAME  "metrics"
+#include "ylog.h"
+
+#ifdef BR_METRICS_CONF_INTERVAL
+#define RENDER_INTERVAL BR_METRICS_CONF_INTERVAL
+#else
+#define RENDER_INTERVAL (5 * CLOCK_SECOND)
+#endif
+
+#ifdef BR_METRICS_CONF_MAX_CLIENTS
+#define MAX_CLIENTS BR_METRICS_CONF_MAX_CLIENTS
+#else
+#define MAX_CLIENTS 4
+#endif
+
+#define CLIENT_TIMEOUT (5 * CLOCK_SECOND)
+#define REQUEST_MAX    512
+#define HEADER_MAX     160
+#define SNAPSHOT_MAX   16384
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+#define NOT_FOUND "Not Found\n"
+
+extern unsigned long slip_sent;
+extern unsigned long slip_sent_to_fd;
+extern unsigned int  slip_max_buffer_usage;
+long slip_buffered(void);
+extern int border_router_rdc_dropped;
+
+struct snapshot {
+  int refs;
+  int len;
+  char data[SNAPSHOT_MAX];
+};
+
+struct client {
+  int fd;
+  uint8_t is_writing;
+  int request_len;
+  int pos;
+  int header_len;
+  const char *body;
+  int body_len;
+  struct snapshot *snapshot;
+  struct timer timeout;
+  char header[HEADER_MAX];
+  char request[REQUEST_MAX];
+};
+
+#define HISTOGRAM_MAX_BOUNDS 10
+
+struct histogram {
+  const char *name;
+  const char *help;
+  /* Bucket bounds are divided by scale when rendered */
+  uint32_t scale;
+  uint8_t bound_count;
+  uint32_t bounds[HISTOGRAM_MAX_BOUNDS];
+  uint32_t buckets[HISTOGRAM_MAX_BOUNDS + 1];
+  uint64_t sum;
+  uint32_t count;
+};
+
+static struct histogram histograms[BR_METRICS_HISTOGRAM_MAX] = {
+  [BR_METRICS_SERIAL_RTT] = {
+    "br_serial_rtt_seconds",
+    "Time from serial transmission to radio TX confirmation",
+    1000, 9, { 2, 5, 10, 20, 50, 100, 200, 500, 1000 }
+  },
+  [BR_METRICS_SERIAL_QUEUE] = {
+    "br_serial_queue_depth",
+    "Packets pending to the serial radio at each transmission",
+    1, 8, { 0, 1, 2, 4, 8, 16, 32, 64 }
+  },
+};
+
+static const char *brm_stats_names[BRM_STATS_MAX] = {
+  [BRM_STATS_ENCAP_RECV] = "encap_recv_bytes",
+  [BRM_STATS_ENCAP_TLV] = "encap_tlv",
+  [BRM_STATS_ENCAP_SERIAL] = "encap_serial",
+  [BRM_STATS_ENCAP_UNPROCESSED] = "encap_unprocessed",
+  [BRM_STATS_ENCAP_ERRORS] = "encap_errors",
+  [BRM_STATS_ENCAP_AGGREGATE] = "encap_aggregate",
+};
+
+static const char *brm_stats_debug_names[BRM_STATS_DEBUG_MAX] = {
+  [BRM_STATS_DEBUG_SLIP_RECV] = "slip_recv_bytes",
+  [BRM_STATS_DEBUG_SLIP_FRAMES] = "slip_frames",
+  [BRM_STATS_DEBUG_SLIP_DROPPED] = "slip_dropped",
+  [BRM_STATS_DEBUG_SLIP_OVERFLOWS] = "slip_overflows",
+  [BRM_STATS_DEBUG_SLIP_ERRORS] = "slip_errors",
+  [BRM_STATS_DEBUG_SLIP_AGGREGATED_SENT] = "slip_aggregated_sent",
+  [BRM_STATS_DEBUG_SLIP_AGGREGATED_RECV] = "slip_aggregated_recv",
+  [BRM_STATS_DEBUG_SLIP_RETRANSMITS] = "slip_retransmits",
+  [BRM_STATS_DEBUG_SLIP_FAST_RETRANSMITS] = "slip_fast_retransmits",
+  [BRM_STATS_DEBUG_SLIP_RETRANSMIT_FAILED] = "slip_retransmit_failed",
+  [BRM_STATS_DEBUG_SLIP_OUT_OF_ORDER] = "slip_out_of_order",
+  [BRM_STATS_DEBUG_SLIP_DUPLICATES] = "slip_duplicates",
+  [BRM_STATS_DEBUG_SLIP_GAPS] = "slip_gaps",
+  [BRM_STATS_DEBUG_SLIP_LOST] = "slip_lost",
+};
+
+#define TX_STATUS_MAX (MAC_TX_ERR_FATAL + 1)
+static const char *tx_status_names[TX_STATUS_MAX] = {
+  [MAC_TX_OK] = "ok",
+  [MAC_TX_COLLISION] = "collision",
+  [MAC_TX_NOACK] = "noack",
+  [MAC_TX_DEFERRED] = "deferred",
+  [MAC_TX_ERR] = "err",
+  [MAC_TX_ERR_FATAL] = "err_fatal",
+};
+static uint32_t tx_status[TX_STATUS_MAX];
+static uint32_t tx_other;
+static uint32_t tx_attempts;
+
+static int server_fd = -1;
+static struct client clients[MAX_CLIENTS];
+static struct snapshot *current;
+static struct ctimer render_timer;
+
+static int set_fd(fd_set *rset, fd_set *wset);
+static void handle_fd(fd_set *rset, fd_set *wset);
+static const struct select_callback metrics_callback = { set_fd, handle_fd };
+/*---------------------------------------------------------------------------*/
+void
+br_metrics_observe(br_metrics_histogram_t histogram, uint32_t value)
+{
+  struct histogram *h;
+  int i;
+
+  if(histogram >= BR_METRICS_HISTOGRAM_MAX) {
+    return;
+  }
+  h = &histograms[histogram];
+  for(i = 0; i < h->bound_count && value > h->bounds[i]; i++);
+  h->buckets[i]++;
+  h->sum += value;
+  h->count++;
+}
+/*---------------------------------------------------------------------------*/
+void
+br_metrics_tx_done(int status, int transmissions, clock_time_t rtt)
+{
+  if(status >= 0 && status < TX_STATUS_MAX) {
+    tx_status[status]++;
+  } else {
+    tx_other++;
+  }
+  tx_attempts += transmissions;
+  br_metrics_observe(BR_METRICS_SERIAL_RTT, (uint32_t)((rtt * 1000) / CLOCK_SECOND));
+}
+/*---------------------------------------------------------------------------*/
+static void
+snapshot_release(struct snapshot *s)
+{
+  if(s != NULL && --s->refs == 0) {
+    free(s);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+out(struct snapshot *s, const char *fmt, ...)
+{
+  va_list ap;
+  int n;
+
+  if(s->len >= SNAPSHOT_MAX) {
+    return;
+  }
+  va_start(ap, fmt);
+  n = vsnprintf(&s->data[s->len], SNAPSHOT_MAX - s->len, fmt, ap);
+  va_end(ap);
+  if(n < 0 || s->len + n >= SNAPSHOT_MAX) {
+    /* Mark as overflowed */
+    s->len = SNAPSHOT_MAX;
+  } else {
+    s->len += n;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+out_family(struct snapshot *s, const char *name, const char *type, const char *help)
+{
+  out(s, "# TYPE %s %s\n# HELP %s %s\n", name, type, name, help);
+}
+/*---------------------------------------------------------------------------*/
+static void
+out_counters(struct snapshot *s, const char *name, const char *help,
+             const char *label, const char **names,
+             const uint32_t *values, int count)
+{
+  int i;
+  out_family(s, name, "counter", help);
+  for(i = 0; i < count; i++) {
+    if(names[i] != NULL) {
+      out(s, "%s_total{%s=\"%s\"} %lu\n", name, label, names[i],
+          (unsigned long)values[i]);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+out_scaled(struct snapshot *s, uint64_t value, uint32_t scale)
+{
+  if(scale == 1) {
+    out(s, "%llu", (unsigned long long)value);
+  } else {
+    out(s, "%llu.%03llu", (unsigned long long)(value / scale),
+        (unsigned long long)(((value % scale) * 1000) / scale));
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+out_histogram(struct snapshot *s, const struct histogram *h)
+{
+  uint32_t total;
+  int i;
+
+  out_family(s, h->name, "histogram", h->help);
+  for(i = 0, total = 0; i < h->bound_count; i++) {
+    total += h->buckets[i];
+    out(s, "%s_bucket{le=\"", h->name);
+    out_scaled(s, h->bounds[i], h->scale);
+    out(s, "\"} %lu\n", (unsigned long)total);
+  }
+  out(s, "%s_bucket{le=\"+Inf\"} %lu\n", h->name, (unsigned long)h->count);
+  out(s, "%s_count %lu\n%s_sum ", h->name, (unsigned long)h->count, h->name);
+  out_scaled(s, h->sum, h->scale);
+  out(s, "\n");
+}
+/*---------------------------------------------------------------------------*/
+/* Statistics per serial radio and PAN */
+static void
+out_radios(struct snapshot *s)
+{
+  const struct br_radios_stats *rs;
+  const struct enc_dev_stats *es;
+  int i, c;
+
+  out_family(s, "br_radio_frames", "counter", "Frames per radio by direction");
+  for(i = 0; i < enc_dev_count(); i++) {
+    rs = br_radios_get_stats(i);
+    out(s, "br_radio_frames_total{radio=\"%d\",dir=\"rx\"} %lu\n",
+        i, (unsigned long)rs->rx);
+    out(s, "br_radio_frames_total{radio=\"%d\",dir=\"tx\"} %lu\n",
+        i, (unsigned long)rs->tx);
+  }
+  out_family(s, "br_radio_tx_failed", "counter", "Failed transmissions per radio");
+  for(i = 0; i < enc_dev_count(); i++) {
+    rs = br_radios_get_stats(i);
+    out(s, "br_radio_tx_failed_total{radio=\"%d\",status=\"noack\"} %lu\n",
+        i, (unsigned long)rs->tx_noack);
+    out(s, "br_radio_tx_failed_total{radio=\"%d\",status=\"error\"} %lu\n",
+        i, (unsigned long)rs->tx_err);
+  }
+  out_family(s, "br_radio_beacon_requests", "counter", "Beacon requests per radio");
+  for(i = 0; i < enc_dev_count(); i++) {
+    rs = br_radios_get_stats(i);
+    out(s, "br_radio_beacon_requests_total{radio=\"%d\"} %lu\n",
+        i, (unsigned long)rs->beacon_requests);
+  }
+  out_family(s, "br_radio_joins_rejected", "counter",
+             "Beacon requests not answered to balance the PANs");
+  for(i = 0; i < enc_dev_count(); i++) {
+    rs = br_radios_get_stats(i);
+    out(s, "br_radio_joins_rejected_total{radio=\"%d\"} %lu\n",
+        i, (unsigned long)rs->joins_rejected);
+  }
+  if(enc_dev_count() > 1) {
+    out_family(s, "br_radio_neighbors", "gauge", "Neighbors recently heard per radio");
+    for(i = 0; i < enc_dev_count(); i++) {
+      out(s, "br_radio_neighbors{radio=\"%d\"} %d\n", i, br_radios_get_neighbors(i));
+    }
+  }
+  out_family(s, "br_radio_serial_bytes", "counter", "Serial bytes per radio by direction");
+  for(i = 0; i < enc_dev_count(); i++) {
+    es = enc_dev_get_stats(i);
+    out(s, "br_radio_serial_bytes_total{radio=\"%d\",dir=\"rx\"} %lu\n",
+        i, es->recv_bytes);
+    out(s, "br_radio_serial_bytes_total{radio=\"%d\",dir=\"tx\"} %lu\n",
+        i, es->sent_bytes);
+  }
+  out_family(s, "br_radio_serial_pending_packets", "gauge",
+             "Packets pending to each serial radio");
+  for(i = 0; i < enc_dev_count(); i++) {
+    out(s, "br_radio_serial_pending_packets{radio=\"%d\"} %ld\n",
+        i, enc_dev_buffered(i));
+  }
+  out_family(s, "br_radio_serial_queued_packets", "gauge",
+             "Packets waiting per serial traffic class");
+  for(i = 0; i < enc_dev_count(); i++) {
+    for(c = 0; c < ENC_DEV_TX_CLASSES; c++) {
+      out(s, "br_radio_serial_queued_packets{radio=\"%d\",class=\"%s\"} %d\n",
+          i, enc_dev_get_class_name(c), enc_dev_get_queued(i, c));
+    }
+  }
+  out_family(s, "br_radio_serial_tx_packets", "counter",
+             "Packets sent per serial traffic class");
+  for(i = 0; i < enc_dev_count(); i++) {
+    es = enc_dev_get_stats(i);
+    for(c = 0; c < ENC_DEV_TX_CLASSES; c++) {
+      out(s, "br_radio_serial_tx_packets_total{radio=\"%d\",class=\"%s\"} %lu\n",
+          i, enc_dev_get_class_name(c), es->tx_class[c].sent);
+    }
+  }
+  out_family(s, "br_radio_serial_tx_dropped", "counter",
+             "Packets dropped per serial traffic class");
+  for(i = 0; i < enc_dev_count(); i++) {
+    es = enc_dev_get_stats(i);
+    for(c = 0; c < ENC_DEV_TX_CLASSES; c++) {
+      out(s, "br_radio_serial_tx_dropped_total{radio=\"%d\",class=\"%s\"} %lu\n",
+          i, enc_dev_get_class_name(c), es->tx_class[c].dropped);
+    }
+  }
+  out_family(s, "br_radio_serial_queue_delay_seconds", "counter",
+             "Total queueing delay per serial traffic class");
+  for(i = 0; i < enc_dev_count(); i++) {
+    es = enc_dev_get_stats(i);
+    for(c = 0; c < ENC_DEV_TX_CLASSES; c++) {
+      out(s, "br_radio_serial_queue_delay_seconds_total{radio=\"%d\",class=\"%s\"} %lu.%03lu\n",
+          i, enc_dev_get_class_name(c), es->tx_class[c].delay_total / 1000,
+          es->tx_class[c].delay_total % 1000);
+    }
+  }
+  out_family(s, "br_radio_serial_queue_delay_max_seconds", "gauge",
+             "Max queueing delay per serial traffic class");
+  for(i = 0; i < enc_dev_count(); i++) {
+    es = enc_dev_get_stats(i);
+    for(c = 0; c < ENC_DEV_TX_CLASSES; c++) {
+      out(s, "br_radio_serial_queue_delay_max_seconds{radio=\"%d\",class=\"%s\"} %lu.%03lu\n",
+          i, enc_dev_get_class_name(c), es->tx_class[c].delay_max / 1000,
+          es->tx_class[c].delay_max % 1000);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+#if BR_AQM
+static void
+out_aqm(struct snapshot *s)
+{
+  const struct br_aqm_stats *st = br_aqm_get_stats();
+  unsigned long delay;
+
+  out_family(s, "br_aqm_packets", "counter", "Packets from the tun interface checked by AQM");
+  out(s, "br_aqm_packets_total %lu\n", (unsigned long)st->packets);
+  out_family(s, "br_aqm_drops", "counter", "Packets dropped by AQM");
+  out(s, "br_aqm_drops_total %lu\n", (unsigned long)st->drops);
+  out_family(s, "br_aqm_marks", "counter", "Packets marked with ECN CE by AQM");
+  out(s, "br_aqm_marks_total %lu\n", (unsigned long)st->marks);
+  out_family(s, "br_aqm_icmp_errors", "counter", "ICMPv6 errors sent for overloaded flows");
+  out(s, "br_aqm_icmp_errors_total %lu\n", (unsigned long)st->icmp_sent);
+  out_family(s, "br_aqm_flows_dropping", "gauge", "Flows in the AQM dropping state");
+  out(s, "br_aqm_flows_dropping %d\n", br_aqm_get_dropping());
+  delay = br_aqm_get_max_delay();
+  out_family(s, "br_aqm_max_sojourn_seconds", "gauge", "Largest recent queueing delay of a flow");
+  out(s, "br_aqm_max_sojourn_seconds %lu.%03lu\n", delay / 1000, delay % 1000);
+}
+#endif /* BR_AQM */
+/*---------------------------------------------------------------------------*/
+static void
+render(void)
+{
+  struct snapshot *s;
+  rpl_instance_t *instance;
+  int i;
+
+  s = malloc(sizeof(struct snapshot));
+  if(s == NULL) {
+    YLOG_ERROR("failed to allocate snapshot\n");
+    return;
+  }
+  s->refs = 1;
+  s->len = 0;
+
+  out_family(s, "br_uptime_seconds", "gauge", "Time since border router start");
+  out(s, "br_uptime_seconds %lu\n", (unsigned long)clock_seconds());
+
+  out_counters(s, "br_stats", "Border router management statistics", "stat",
+               brm_stats_names, brm_stats_values, BRM_STATS_MAX);
+  out_counters(s, "br_debug_stats", "Border router serial statistics", "stat",
+               brm_stats_debug_names, brm_stats_debug_values, BRM_STATS_DEBUG_MAX);
+
+  out_family(s, "br_slip_sent_frames", "counter", "SLIP frames sent to the serial radio");
+  out(s, "br_slip_sent_frames_total %lu\n", slip_sent);
+  out_family(s, "br_slip_sent_bytes", "counter", "SLIP bytes sent to the serial radio");
+  out(s, "br_slip_sent_bytes_total %lu\n", slip_sent_to_fd);
+  out_family(s, "br_slip_pending_packets", "gauge", "Packets pending to the serial radio");
+  out(s, "br_slip_pending_packets %ld\n", slip_buffered());
+  out_family(s, "br_slip_max_buffer_usage_bytes", "gauge", "Max SLIP read buffer usage");
+  out(s, "br_slip_max_buffer_usage_bytes %u\n", slip_max_buffer_usage);
+
+  out_counters(s, "br_rdc_tx", "Radio transmissions by status", "status",
+               tx_status_names, tx_status, TX_STATUS_MAX);
+  out(s, "br_rdc_tx_total{status=\"other\"} %lu\n", (unsigned long)tx_other);
+  out_family(s, "br_rdc_tx_attempts", "counter", "Radio transmission attempts");
+  out(s, "br_rdc_tx_attempts_total %lu\n", (unsigned long)tx_attempts);
+  out_family(s, "br_rdc_dropped_frames", "gauge", "Received frames dropped while the radio is off");
+  out(s, "br_rdc_dropped_frames %d\n", border_router_rdc_dropped);
+
+  for(i = 0; i < BR_METRICS_HISTOGRAM_MAX; i++) {
+    out_histogram(s, &histograms[i]);
+  }
+
+  out_radios(s);
+#if BR_AQM
+  out_aqm(s);
+#endif /* BR_AQM */
+
+  out_family(s, "br_routes", "gauge", "Routes in the routing table");
+  out(s, "br_routes %d\n", uip_ds6_route_num_routes());
+  out_family(s, "br_neighbors", "gauge", "IPv6 neighbors");
+  out(s, "br_neighbors %d\n", uip_ds6_nbr_num());
+
+  instance = rpl_get_instance(RPL_DEFAULT_INSTANCE);
+  if(instance != NULL && instance->current_dag != NULL) {
+    out_family(s, "br_rpl_dag_version", "gauge", "RPL DAG version");
+    out(s, "br_rpl_dag_version %u\n", instance->current_dag->version);
+  }
+
+#if RPL_CONF_STATS
+  out_family(s, "br_rpl_events", "counter", "RPL fault management statistics");
+  out(s, "br_rpl_events_total{event=\"mem_overflows\"} %u\n", rpl_stats.mem_overflows);
+  out(s, "br_rpl_events_total{event=\"local_repairs\"} %u\n", rpl_stats.local_repairs);
+  out(s, "br_rpl_events_total{event=\"global_repairs\"} %u\n", rpl_stats.global_repairs);
+  out(s, "br_rpl_events_total{event=\"malformed_msgs\"} %u\n", rpl_stats.malformed_msgs);
+  out(s, "br_rpl_events_total{event=\"resets\"} %u\n", rpl_stats.resets);
+  out(s, "br_rpl_events_total{event=\"parent_switch\"} %u\n", rpl_stats.parent_switch);
+  out(s, "br_rpl_events_total{event=\"forward_errors\"} %u\n", rpl_stats.forward_errors);
+  out(s, "br_rpl_events_total{event=\"loop_errors\"} %u\n", rpl_stats.loop_errors);
+  out(s, "br_rpl_events_total{event=\"loop_warnings\"} %u\n", rpl_stats.loop_warnings);
+  out(s, "br_rpl_events_total{event=\"root_repairs\"} %u\n", rpl_stats.root_repairs);
+#endif /* RPL_CONF_STATS */
+
+  out(s, "# EOF\n");
+
+  if(s->len >= SNAPSHOT_MAX) {
+    YLOG_ERROR("metrics snapshot too large\n");
+    snapshot_release(s);
+    return;
+  }
+
+  snapshot_release(current);
+  current = s;
+}
+/*---------------------------------------------------------------------------*/
+static void
+close_client(struct client *c)
+{
+  select_set_callback(c->fd, NULL);
+  close(c->fd);
+  c->fd = -1;
+  snapshot_release(c->snapshot);
+  c->snapshot = NULL;
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_timeouts(void)
+{
+  int i;
+  for(i = 0; i < MAX_CLIENTS; i++) {
+    if(clients[i].fd >= 0 && timer_expired(&clients[i].timeout)) {
+      YLOG_DEBUG("client <%d> timed out\n", clients[i].fd);
+      close_client(&clients[i]);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+render_callback(void *ptr)
+{
+  ctimer_reset(&render_timer);
+  check_timeouts();
+  render();
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_request(struct client *c)
+{
+  const char *status;
+
+  if(strncmp(c->request, "GET /metrics", 12) == 0 &&
+     (c->request[12] == ' ' || c->request[12] == '?')) {
+    if(current == NULL) {
+      render();
+    }
+    c->snapshot = current;
+  }
+
+  if(c->snapshot != NULL) {
+    c->snapshot->refs++;
+    c->body = c->snapshot->data;
+    c->body_len = c->snapshot->len;
+    status = "200 OK";
+  } else {
+    c->body = NOT_FOUND;
+    c->body_len = sizeof(NOT_FOUND) - 1;
+    status = "404 Not Found";
+  }
+  c->header_len = snprintf(c->header, sizeof(c->header),
+                           "HTTP/1.0 %s\r\nContent-Type: %s\r\n"
+                           "Content-Length: %d\r\nConnection: close\r\n\r\n",
+                           status, c->snapshot != NULL ? CONTENT_TYPE : "text/plain",
+                           c->body_len);
+  c->pos = 0;
+  c->is_writing = 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_read(struct client *c)
+{
+  int n;
+
+  n = recv(c->fd, &c->request[c->request_len],
+           sizeof(c->request) - 1 - c->request_len, 0);
+  if(n < 0 && (errno == EAGAIN || errno == EINTR)) {
+    return;
+  }
+  if(n <= 0) {
+    close_client(c);
+    return;
+  }
+  c->request_len += n;
+  c->request[c->request_len] = '\0';
+  if(strstr(c->request, "\r\n\r\n") != NULL || strstr(c->request, "\n\n") != NULL) {
+    handle_request(c);
+  } else if(c->request_len >= sizeof(c->request) - 1) {
+    /* Request too large */
+    close_client(c);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_write(struct client *c)
+{
+  const char *data;
+  int len, n;
+
+  if(c->pos < c->header_len) {
+    data = &c->header[c->pos];
+    len = c->header_len - c->pos;
+  } else {
+    data = &c->body[c->pos - c->header_len];
+    len = c->body_len - (c->pos - c->header_len);
+  }
+  n = send(c->fd, data, len, MSG_NOSIGNAL);
+  if(n < 0 && (errno == EAGAIN || errno == EINTR)) {
+    return;
+  }
+  if(n <= 0) {
+    close_client(c);
+    return;
+  }
+  c->pos += n;
+  if(c->pos >= c->header_len + c->body_len) {
+    close_client(c);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_accept(void)
+{
+  struct client *c = NULL;
+  int i, fd;
+
+  fd = accept(server_fd, NULL, NULL);
+  if(fd < 0) {
+    if(errno != EAGAIN && errno != EINTR) {
+      YLOG_ERROR("failed to accept connection: %s\n", strerror(errno));
+    }
+    return;
+  }
+  for(i = 0; i < MAX_CLIENTS; i++) {
+    if(clients[i].fd < 0) {
+      c = &clients[i];
+      break;
+    }
+  }
+  if(c == NULL || !select_set_callback(fd, &metrics_callback)) {
+    YLOG_DEBUG("no room for new client\n");
+    close(fd);
+    return;
+  }
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  c->fd = fd;
+  c->is_writing = 0;
+  c->request_len = 0;
+  c->snapshot = NULL;
+  timer_set(&c->timeout, CLIENT_TIMEOUT);
+}
+/*---------------------------------------------------------------------------*/
+static int
+set_fd(fd_set *rset, fd_set *wset)
+{
+  int i;
+
+  if(server_fd >= 0) {
+    FD_SET(server_fd, rset);
+  }
+  for(i = 0; i < MAX_CLIENTS; i++) {
+    if(clients[i].fd >= 0) {
+      FD_SET(clients[i].fd, clients[i].is_writing ? wset : rset);
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_fd(fd_set *rset, fd_set *wset)
+{
+  struct client *c;
+  int i;
+
+  /* Called once per registered fd - clear each fd after handling it */
+  for(i = 0; i < MAX_CLIENTS; i++) {
+    c = &clients[i];
+    if(c->fd < 0) {
+      continue;
+    }
+    if(FD_ISSET(c->fd, rset)) {
+      FD_CLR(c->fd, rset);
+      handle_read(c);
+    } else if(FD_ISSET(c->fd, wset)) {
+      FD_CLR(c->fd, wset);
+      handle_write(c);
+    }
+  }
+  check_timeouts();
+
+  if(server_fd >= 0 && FD_ISSET(server_fd, rset)) {
+    FD_CLR(server_fd, rset);
+    handle_accept();
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+br_metrics_init(void)
+{
+  struct sockaddr_in address;
+  const char *port;
+  char host[64];
+  int i, on = 1;
+
+  for(i = 0; i < MAX_CLIENTS; i++) {
+    clients[i].fd = -1;
+  }
+
+  if(metrics_config_port == NULL) {
+    /* Metrics are disabled */
+    return;
+  }
+
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  /* Only access from localhost 127.0.0.1 unless an address is given */
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  port = strrchr(metrics_config_port, ':');
+  if(port == NULL) {
+    port = metrics_config_port;
+  } else {
+    i = port - metrics_config_port;
+    port++;
+    if(i >= sizeof(host)) {
+      i = sizeof(host) - 1;
+    }
+    memcpy(host, metrics_config_port, i);
+    host[i] = '\0';
+    if(inet_pton(AF_INET, host, &address.sin_addr) != 1) {
+      YLOG_ERROR("Illegal metrics address '%s'. Disabling metrics.\n", host);
+      return;
+    }
+  }
+  address.sin_port = htons(atoi(port));
+  if(address.sin_port == 0) {
+    YLOG_ERROR("Illegal metrics port '%s'. Disabling metrics.\n", port);
+    return;
+  }
+
+  if((server_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) == -1) {
+    YLOG_ERROR("Error creating metrics socket: %s\n", strerror(errno));
+    return;
+  }
+  setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  if(bind(server_fd, (struct sockaddr *)&address, sizeof(address)) == -1
+     || listen(server_fd, MAX_CLIENTS) < 0) {
+    YLOG_ERROR("Error binding metrics port %s: %s\n", port, strerror(errno));
+    close(server_fd);
+    server_fd = -1;
+    return;
+  }
+
+  fcntl(server_fd, F_SETFL, O_NONBLOCK);
+  if(!select_set_callback(server_fd, &metrics_callback)) {
+    YLOG_ERROR("Too many open files for metrics\n");
+    close(server_fd);
+    server_fd = -1;
+    return;
+  }
+
+  YLOG_INFO("Serving metrics on %s\n", metrics_config_port);
+  ctimer_set(&render_timer, RENDER_INTERVAL, render_callback, NULL);
+}
+/*---------------------------------------------------------------------------*/
+#endif /* HAVE_BORDER_ROUTER_METRICS */
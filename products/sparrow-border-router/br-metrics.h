@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2016, Yanzi Networks AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *    3. Neither the name of the copyright holders nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         OpenMetrics exporter for the native border router
+ */
+
+#ifndef BR_METRICS_H_
+#define BR_METRICS_H_
+
+#include "contiki.h"
+
+/* Histograms updated by the border router */
+typedef enum {
+  BR_METRICS_SERIAL_RTT,
+  BR_METRICS_SERIAL_QUEUE,
+
+  BR_METRICS_HISTOGRAM_MAX
+} br_metrics_histogram_t;
+
+void br_metrics_init(void);
+void br_metrics_observe(br_metrics_histogram_t histogram, uint32_t value);
+void br_metrics_tx_done(int status, int transmissions, clock_time_t rtt);
+
+#ifdef HAVE_BORDER_ROUTER_METRICS
+#define BR_METRICS_OBSERVE(histogram, value) br_metrics_observe(histogram, value)
+#define BR_METRICS_TX_DONE(status, tx, rtt)  br_metrics_tx_done(status, tx, rtt)
+#else /* HAVE_BORDER_ROUTER_METRICS */
+#define BR_METRICS_OBSERVE(histogram, value)
+#define BR_METRICS_TX_DONE(status, tx, rtt)
+#endif /* HAVE_BORDER_ROUTER_METRICS */
+
+#endif /* BR_METRICS_H_ */
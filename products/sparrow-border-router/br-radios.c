@@ -0,0 +1,540 @@
+/*
+ * Copyright (c) 2016, Yanzi Networks AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *    3. Neither the name of the copyright holders nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Serial radios serving one PAN each from the border router.
+ *
+ *         Radio 0 is the primary radio and additional radios (-r) serve
+ *         their own PAN on another channel. All PANs share the tun
+ *         interface, the routing table and the RPL DODAG. Each radio
+ *         has its own MAC address and the border router owns one
+ *         link-local and one global address per radio, matching the
+ *         addresses the nodes in each PAN derive from the frames.
+ *
+ *         Neighbors are mapped to the radio they were last heard on
+ *         and new joins are balanced by only answering beacon requests
+ *         on radios that do not have more neighbors than the least
+ *         loaded radio plus a margin.
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/mac/mac.h"
+#include "net/mac/frame802154.h"
+#include "net/netstack.h"
+#include "dev/radio.h"
+#include "sparrow-encap.h"
+#include "border-router.h"
+#include "br-config.h"
+#include "br-radios.h"
+#include "enc-dev.h"
+#include <stdio.h>
+#include <string.h>
+
+#define DEBUG DEBUG_NONE
+#include "net/ip/uip-debug.h"
+
+#define YLOG_LEVEL YLOG_LEVEL_INFO
+#define YLOG_NAME  "radios"
+#include "ylog.h"
+
+/* Number of neighbors mapped to radios - must be a power of two */
+#ifdef BR_RADIOS_CONF_NBR_TABLE_SIZE
+#define NBR_TABLE_SIZE BR_RADIOS_CONF_NBR_TABLE_SIZE
+#else
+#define NBR_TABLE_SIZE 2048
+#endif
+
+/* Seconds before a neighbor that has not been heard is no longer counted */
+#ifdef BR_RADIOS_CONF_NBR_TIMEOUT
+#define NBR_TIMEOUT BR_RADIOS_CONF_NBR_TIMEOUT
+#else
+#define NBR_TIMEOUT (30 * 60)
+#endif
+
+/*
+ * Max number of neighbors a radio may have above the least loaded
+ * radio and still answer beacon requests. Zero disables balancing.
+ */
+#ifdef BR_RADIOS_CONF_BALANCE_MARGIN
+#define BALANCE_MARGIN BR_RADIOS_CONF_BALANCE_MARGIN
+#else
+#define BALANCE_MARGIN 8
+#endif
+
+/* Number of slots searched for a neighbor */
+#define PROBE_WINDOW 8
+#define NO_RADIO     0xff
+
+struct radio {
+  linkaddr_t mac;
+  uint8_t has_mac;
+  int channel;
+  /* -1 to use the PAN id of the primary radio */
+  int panid;
+  struct br_radios_stats stats;
+};
+
+struct nbr {
+  linkaddr_t addr;
+  uint8_t radio;
+  unsigned long last_seen;
+};
+
+extern uint32_t radio_control_version;
+
+static struct radio radios[BR_MAX_RADIOS];
+static struct nbr nbrs[NBR_TABLE_SIZE];
+static uint8_t beacon_radio;
+/*---------------------------------------------------------------------------*/
+static int
+radio_count(void)
+{
+  return enc_dev_count();
+}
+/*---------------------------------------------------------------------------*/
+static unsigned
+hash(const linkaddr_t *addr)
+{
+  unsigned h = 2166136261U;
+  int i;
+  for(i = 0; i < LINKADDR_SIZE; i++) {
+    h = (h ^ addr->u8[i]) * 16777619U;
+  }
+  return h;
+}
+/*---------------------------------------------------------------------------*/
+static int
+is_active(const struct nbr *n, unsigned long now)
+{
+  return n->radio != NO_RADIO && now - n->last_seen < NBR_TIMEOUT;
+}
+/*---------------------------------------------------------------------------*/
+static void
+write_to_radio(int radio, const uint8_t *buf, int len)
+{
+  enc_dev_write(radio, buf, len, SPARROW_ENCAP_PAYLOAD_SERIAL);
+}
+/*---------------------------------------------------------------------------*/
+void
+br_radios_init(void)
+{
+  int i;
+
+  memset(radios, 0, sizeof(radios));
+  for(i = 0; i < NBR_TABLE_SIZE; i++) {
+    nbrs[i].radio = NO_RADIO;
+  }
+  radios[0].channel = -1;
+  radios[0].panid = -1;
+  for(i = 1; i < radio_count(); i++) {
+    radios[i].channel = br_config_radios[i - 1].channel;
+    radios[i].panid = br_config_radios[i - 1].panid;
+  }
+  beacon_radio = 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+br_radios_start(void)
+{
+  uint8_t buf[6];
+  uint16_t panid;
+  int i;
+
+  for(i = 1; i < radio_count(); i++) {
+    buf[0] = '?';
+    buf[1] = 'v';
+    buf[2] = buf[3] = buf[4] = 0;
+    buf[5] = BORDER_ROUTER_CONTROL_API_VERSION;
+    write_to_radio(i, buf, 6);
+
+    if(!radios[i].has_mac) {
+      buf[0] = '?';
+      buf[1] = 'M';
+      write_to_radio(i, buf, 2);
+    }
+
+    panid = br_radios_get_panid(i);
+    buf[0] = '!';
+    buf[1] = 'P';
+    buf[2] = (panid >> 8) & 0xff;
+    buf[3] = panid & 0xff;
+    write_to_radio(i, buf, 4);
+
+    if(br_config_radios[i - 1].channel >= 0) {
+      buf[0] = '!';
+      buf[1] = 'C';
+      buf[2] = br_config_radios[i - 1].channel & 0xff;
+      write_to_radio(i, buf, 3);
+    } else {
+      /* Keep the channel of the radio */
+      buf[0] = '?';
+      buf[1] = 'C';
+      write_to_radio(i, buf, 2);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+br_radios_is_ready(void)
+{
+  int i;
+  for(i = 1; i < radio_count(); i++) {
+    if(!radios[i].has_mac || radios[i].channel < 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+void
+br_radios_add_addresses(const uip_ipaddr_t *prefix)
+{
+  uip_ipaddr_t addr;
+  int i;
+
+  for(i = 1; i < radio_count(); i++) {
+    if(!radios[i].has_mac) {
+      continue;
+    }
+    uip_ip6addr(&addr, 0xfe80, 0, 0, 0, 0, 0, 0, 0);
+    uip_ds6_set_addr_iid(&addr, (uip_lladdr_t *)&radios[i].mac);
+    if(uip_ds6_addr_lookup(&addr) == NULL) {
+      uip_ds6_addr_add(&addr, 0, ADDR_AUTOCONF);
+    }
+    if(prefix != NULL) {
+      memcpy(&addr, prefix, 8);
+      uip_ds6_set_addr_iid(&addr, (uip_lladdr_t *)&radios[i].mac);
+      if(uip_ds6_addr_lookup(&addr) == NULL) {
+        uip_ds6_addr_add(&addr, 0, ADDR_AUTOCONF);
+      }
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+const linkaddr_t *
+br_radios_get_mac(int radio)
+{
+  if(radio > 0 && radio < radio_count()) {
+    return &radios[radio].mac;
+  }
+  return &linkaddr_node_addr;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+br_radios_get_panid(int radio)
+{
+  if(radio > 0 && radio < radio_count() && radios[radio].panid >= 0) {
+    return radios[radio].panid & 0xffff;
+  }
+  return frame802154_get_pan_id();
+}
+/*---------------------------------------------------------------------------*/
+int
+br_radios_get_channel(int radio)
+{
+  radio_value_t value;
+
+  if(radio > 0 && radio < radio_count()) {
+    return radios[radio].channel;
+  }
+  if(NETSTACK_RADIO.get_value(RADIO_PARAM_CHANNEL, &value) == RADIO_RESULT_OK) {
+    return value;
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+int
+br_radios_get_current_channel(void)
+{
+  return br_radios_get_channel(enc_dev_get_radio());
+}
+/*---------------------------------------------------------------------------*/
+void
+br_radios_input(int radio, const linkaddr_t *sender)
+{
+  struct nbr *n, *oldest;
+  unsigned long now;
+  unsigned h;
+  int i;
+
+  if(radio < 0 || radio >= radio_count()) {
+    return;
+  }
+  radios[radio].stats.rx++;
+
+  if(radio_count() < 2 || sender == NULL
+     || linkaddr_cmp(sender, &linkaddr_null)) {
+    return;
+  }
+
+  now = clock_seconds();
+  h = hash(sender);
+  oldest = NULL;
+  for(i = 0; i < PROBE_WINDOW; i++) {
+    n = &nbrs[(h + i) & (NBR_TABLE_SIZE - 1)];
+    if(n->radio != NO_RADIO && linkaddr_cmp(&n->addr, sender)) {
+      if(n->radio != radio) {
+        YLOG_DEBUG("neighbor moved from radio %u to %u\n", n->radio, radio);
+      }
+      n->radio = radio;
+      n->last_seen = now;
+      return;
+    }
+    if(oldest == NULL || n->radio == NO_RADIO
+       || (oldest->radio != NO_RADIO && now - n->last_seen > now - oldest->last_seen)) {
+      oldest = n;
+    }
+  }
+
+  /* Replace a free slot or the neighbor heard least recently */
+  linkaddr_copy(&oldest->addr, sender);
+  oldest->radio = radio;
+  oldest->last_seen = now;
+}
+/*---------------------------------------------------------------------------*/
+int
+br_radios_lookup(const linkaddr_t *addr)
+{
+  struct nbr *n;
+  unsigned h;
+  int i;
+
+  if(radio_count() < 2 || addr == NULL) {
+    return 0;
+  }
+  h = hash(addr);
+  for(i = 0; i < PROBE_WINDOW; i++) {
+    n = &nbrs[(h + i) & (NBR_TABLE_SIZE - 1)];
+    if(n->radio != NO_RADIO && linkaddr_cmp(&n->addr, addr)) {
+      return n->radio < radio_count() ? n->radio : 0;
+    }
+  }
+  /* Unknown neighbors are assumed to be in the primary PAN */
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+count_neighbors(int *counts)
+{
+  unsigned long now;
+  int i;
+
+  memset(counts, 0, sizeof(int) * BR_MAX_RADIOS);
+  now = clock_seconds();
+  for(i = 0; i < NBR_TABLE_SIZE; i++) {
+    if(is_active(&nbrs[i], now) && nbrs[i].radio < BR_MAX_RADIOS) {
+      counts[nbrs[i].radio]++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+br_radios_get_neighbors(int radio)
+{
+  int counts[BR_MAX_RADIOS];
+
+  if(radio < 0 || radio >= BR_MAX_RADIOS) {
+    return 0;
+  }
+  count_neighbors(counts);
+  return counts[radio];
+}
+/*---------------------------------------------------------------------------*/
+int
+br_radios_beacon_request(int radio)
+{
+  int counts[BR_MAX_RADIOS];
+  int i, min;
+
+  if(radio < 0 || radio >= radio_count()) {
+    return 0;
+  }
+  radios[radio].stats.beacon_requests++;
+
+  if(BALANCE_MARGIN > 0 && radio_count() > 1) {
+    count_neighbors(counts);
+    min = counts[0];
+    for(i = 1; i < radio_count(); i++) {
+      if(counts[i] < min) {
+        min = counts[i];
+      }
+    }
+    if(counts[radio] > min + BALANCE_MARGIN) {
+      /* Let the node find a less loaded PAN */
+      radios[radio].stats.joins_rejected++;
+      YLOG_DEBUG("no beacon on radio %u (%d neighbors, min %d)\n",
+                 radio, counts[radio], min);
+      return 0;
+    }
+  }
+
+  beacon_radio = radio;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+br_radios_get_beacon_radio(void)
+{
+  return beacon_radio < radio_count() ? beacon_radio : 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+br_radios_tx_done(int radio, int status)
+{
+  if(radio < 0 || radio >= radio_count()) {
+    return;
+  }
+  radios[radio].stats.tx++;
+  if(status == MAC_TX_NOACK) {
+    radios[radio].stats.tx_noack++;
+  } else if(status != MAC_TX_OK) {
+    radios[radio].stats.tx_err++;
+  }
+}
+/*---------------------------------------------------------------------------*/
+const struct br_radios_stats *
+br_radios_get_stats(int radio)
+{
+  if(radio >= 0 && radio < radio_count()) {
+    return &radios[radio].stats;
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+int
+br_radios_radio_input(int radio, const uint8_t *data, int len)
+{
+  struct radio *r;
+  uint32_t v;
+
+  if(radio <= 0 || radio >= radio_count() || len < 2) {
+    return 0;
+  }
+  r = &radios[radio];
+
+  switch(data[1]) {
+  case 'M':
+    if(len >= 2 + LINKADDR_SIZE) {
+      memcpy(r->mac.u8, &data[2], LINKADDR_SIZE);
+      r->has_mac = 1;
+      if(YLOG_IS_LEVEL(YLOG_LEVEL_INFO)) {
+        YLOG_INFO("Radio %u MAC address is ", radio);
+        net_debug_lladdr_print((const uip_lladdr_t *)&r->mac);
+        printf("\n");
+      }
+    }
+    return 1;
+  case 'C':
+    if(len >= 3) {
+      r->channel = data[2];
+      YLOG_INFO("Radio %u channel is: %d\n", radio, data[2]);
+    }
+    return 1;
+  case 'P':
+    if(len >= 4) {
+      YLOG_INFO("Radio %u pan id is: 0x%04x\n", radio,
+                ((uint16_t)data[2] << 8) | data[3]);
+    }
+    return 1;
+  case 'v':
+    if(len >= 6) {
+      v  = (uint32_t)data[2] << 24;
+      v |= data[3] << 16;
+      v |= data[4] <<  8;
+      v |= data[5];
+      enc_dev_set_control_version(radio, v);
+      YLOG_INFO("Radio %u protocol version: %u\n", radio, v);
+      if(v != radio_control_version && radio_control_version != 0) {
+        /* The packet attribute encoding is shared by all radios */
+        YLOG_ERROR("radio %u has protocol version %u but primary radio has %u\n",
+                   radio, v, radio_control_version);
+      }
+    }
+    return 1;
+  case 'm':
+    if(len >= 3) {
+      YLOG_INFO("Radio %u mode: %u\n", radio, data[2]);
+    }
+    return 1;
+  case 'E':
+    if(len >= 4) {
+      YLOG_ERROR("SR%u: Unknown command: %c%c (0x%02x%02x)\n", radio,
+                 data[2], data[3], data[2], data[3]);
+    }
+    return 1;
+  default:
+    /* Only the primary radio controls the border router */
+    return 1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+br_radios_print(void)
+{
+  const struct br_radios_stats *s;
+  const struct enc_dev_stats *es;
+  int counts[BR_MAX_RADIOS];
+  int i, c;
+
+  count_neighbors(counts);
+  printf("Radios: %d (balance margin %d)\n", radio_count(), BALANCE_MARGIN);
+  for(i = 0; i < radio_count(); i++) {
+    s = &radios[i].stats;
+    es = enc_dev_get_stats(i);
+    printf(" %d: ", i);
+    net_debug_lladdr_print((const uip_lladdr_t *)br_radios_get_mac(i));
+    printf(" channel %d pan 0x%04x%s\n", br_radios_get_channel(i),
+           br_radios_get_panid(i), i == beacon_radio ? " (last beacon)" : "");
+    printf("    %d neighbors, rx %lu, tx %lu (%lu noack, %lu err)\n",
+           radio_count() > 1 ? counts[i] : uip_ds6_nbr_num(),
+           (unsigned long)s->rx, (unsigned long)s->tx,
+           (unsigned long)s->tx_noack, (unsigned long)s->tx_err);
+    printf("    %lu beacon requests, %lu joins rejected, %ld pending\n",
+           (unsigned long)s->beacon_requests, (unsigned long)s->joins_rejected,
+           enc_dev_buffered(i));
+    if(es != NULL) {
+      printf("    serial sent %lu frames %lu bytes, received %lu frames %lu bytes, %lu dropped\n",
+             es->sent_frames, es->sent_bytes, es->recv_frames, es->recv_bytes,
+             es->dropped);
+      for(c = 0; c < ENC_DEV_TX_CLASSES; c++) {
+        printf("    %-11s %d queued, %lu sent, %lu dropped, delay avg %lu max %lu ms\n",
+               enc_dev_get_class_name(c), enc_dev_get_queued(i, c),
+               es->tx_class[c].sent, es->tx_class[c].dropped,
+               es->tx_class[c].sent > 0
+               ? es->tx_class[c].delay_total / es->tx_class[c].sent : 0,
+               es->tx_class[c].delay_max);
+      }
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
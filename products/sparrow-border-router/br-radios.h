@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2016, Yanzi Networks AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *    3. Neither the name of the copyright holders nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Serial radios serving one PAN each from the border router
+ */
+
+#ifndef BR_RADIOS_H_
+#define BR_RADIOS_H_
+
+#include "contiki.h"
+#include "net/linkaddr.h"
+#include "net/ip/uip.h"
+
+/* Per PAN statistics */
+struct br_radios_stats {
+  uint32_t rx;
+  uint32_t tx;
+  uint32_t tx_noack;
+  uint32_t tx_err;
+  uint32_t beacon_requests;
+  uint32_t joins_rejected;
+};
+
+void br_radios_init(void);
+void br_radios_start(void);
+int br_radios_is_ready(void);
+void br_radios_add_addresses(const uip_ipaddr_t *prefix);
+
+const linkaddr_t *br_radios_get_mac(int radio);
+uint16_t br_radios_get_panid(int radio);
+int br_radios_get_channel(int radio);
+/* Channel of the radio the frame being handled belongs to */
+int br_radios_get_current_channel(void);
+
+/* Learn which radio a neighbor is reached through */
+void br_radios_input(int radio, const linkaddr_t *sender);
+int br_radios_lookup(const linkaddr_t *addr);
+
+/* Returns non-zero if the radio should answer the beacon request */
+int br_radios_beacon_request(int radio);
+int br_radios_get_beacon_radio(void);
+
+void br_radios_tx_done(int radio, int status);
+int br_radios_get_neighbors(int radio);
+const struct br_radios_stats *br_radios_get_stats(int radio);
+
+/* Handle a command from an additional radio */
+int br_radios_radio_input(int radio, const uint8_t *data, int len);
+void br_radios_print(void);
+
+#endif /* BR_RADIOS_H_ */
@@ -0,0 +1,498 @@
+/*
+ * Copyright (c) 2016, Yanzi Networks AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *    3. Neither the name of the copyright holders nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Persistent RPL root state for fast border router restart.
+ *
+ *         The DODAG id, version and DTSN, the neighbor cache and the
+ *         DAO routes are periodically checkpointed to a memory mapped
+ *         file. The mapping is shared with the page cache so the last
+ *         checkpoint survives a crash or watchdog exit of the border
+ *         router. At start the checkpoint is restored when it belongs
+ *         to the same DODAG, is younger than the route lifetime, and
+ *         no other version of the DODAG has been seen in the PAN. The
+ *         PAN then continues with the same DODAG version and the
+ *         nodes do not need to rejoin or send new DAOs.
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uip-ds6-route.h"
+#include "net/rpl/rpl.h"
+#include "net/rpl/rpl-private.h"
+#include "lib/crc32.h"
+#include "sys/uptime.h"
+#include "br-snapshot.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#define YLOG_LEVEL YLOG_LEVEL_INFO
+#define YLOG_NAME  "snapshot"
+#include "ylog.h"
+
+/* Checkpoint interval in seconds */
+#ifdef BR_SNAPSHOT_CONF_INTERVAL
+#define BR_SNAPSHOT_INTERVAL BR_SNAPSHOT_CONF_INTERVAL
+#else
+#define BR_SNAPSHOT_INTERVAL 30
+#endif
+
+/* Max age in seconds of a checkpoint to restore */
+#ifdef BR_SNAPSHOT_CONF_MAX_AGE
+#define BR_SNAPSHOT_MAX_AGE BR_SNAPSHOT_CONF_MAX_AGE
+#else
+#define BR_SNAPSHOT_MAX_AGE ((unsigned long)RPL_DEFAULT_LIFETIME * RPL_DEFAULT_LIFETIME_UNIT)
+#endif
+
+/* Seconds to track the route count for the reachability time */
+#define REACHABILITY_TIMEOUT (60 * 60)
+
+#define SNAPSHOT_MAGIC   0x42525353UL
+#define SNAPSHOT_FORMAT  1
+
+#define MAX_NBRS   NBR_TABLE_MAX_NEIGHBORS
+#define MAX_ROUTES UIP_DS6_ROUTE_NB
+
+struct snapshot_header {
+  uint32_t magic;
+  uint16_t format;
+  uint16_t max_nbrs;
+  uint16_t max_routes;
+  uint16_t nbr_count;
+  uint16_t route_count;
+  uint8_t valid;
+  uint8_t instance_id;
+  uint8_t version;
+  uint8_t dtsn_out;
+  uint16_t reserved;
+  uint32_t generation;
+  /* wall clock time in seconds when saved */
+  int64_t saved_at;
+  uip_ipaddr_t dag_id;
+  /* CRC of the header from generation and the used entries */
+  uint32_t crc;
+};
+
+struct snapshot {
+  struct snapshot_header header;
+  struct br_snapshot_nbr nbrs[MAX_NBRS];
+  struct br_snapshot_route routes[MAX_ROUTES];
+};
+
+static struct snapshot *snapshot;
+static const char *snapshot_file;
+static uint8_t is_restorable;
+static uint8_t is_restored;
+static uint16_t restored_nbrs;
+static uint16_t restored_routes;
+static unsigned long restore_time;
+static unsigned long save_count;
+static unsigned long save_time;
+static uint64_t last_save;
+
+/* Time to reach the checkpointed number of routes after start */
+static uint16_t reachability_target;
+static uint64_t reachability_time;
+static uint64_t started;
+
+static struct ctimer save_timer;
+static struct ctimer reachability_timer;
+/*---------------------------------------------------------------------------*/
+static uint32_t
+snapshot_crc(const struct snapshot *s)
+{
+  uint32_t crc;
+  const struct snapshot_header *h = &s->header;
+
+  crc = crc32((const uint8_t *)&h->generation,
+              offsetof(struct snapshot_header, crc) -
+              offsetof(struct snapshot_header, generation));
+  crc ^= crc32((const uint8_t *)s->nbrs, h->nbr_count * sizeof(struct br_snapshot_nbr));
+  crc ^= crc32((const uint8_t *)s->routes, h->route_count * sizeof(struct br_snapshot_route));
+  return crc;
+}
+/*---------------------------------------------------------------------------*/
+static int
+is_valid(const struct snapshot *s)
+{
+  const struct snapshot_header *h = &s->header;
+  return h->magic == SNAPSHOT_MAGIC && h->format == SNAPSHOT_FORMAT
+    && h->max_nbrs == MAX_NBRS && h->max_routes == MAX_ROUTES
+    && h->valid && h->nbr_count <= MAX_NBRS && h->route_count <= MAX_ROUTES
+    && h->crc == snapshot_crc(s);
+}
+/*---------------------------------------------------------------------------*/
+void
+br_snapshot_init(const char *filename)
+{
+  struct stat st;
+  int fd;
+  void *map;
+
+  started = uptime_read();
+  if(filename == NULL) {
+    return;
+  }
+
+  fd = open(filename, O_RDWR | O_CREAT, 0644);
+  if(fd < 0) {
+    YLOG_ERROR("failed to open %s: %s\n", filename, strerror(errno));
+    return;
+  }
+  if(fstat(fd, &st) < 0 ||
+     (st.st_size != sizeof(struct snapshot) &&
+      ftruncate(fd, sizeof(struct snapshot)) < 0)) {
+    YLOG_ERROR("failed to size %s: %s\n", filename, strerror(errno));
+    close(fd);
+    return;
+  }
+  map = mmap(NULL, sizeof(struct snapshot), PROT_READ | PROT_WRITE,
+             MAP_SHARED, fd, 0);
+  /* The mapping stays valid after the file is closed */
+  close(fd);
+  if(map == MAP_FAILED) {
+    YLOG_ERROR("failed to map %s: %s\n", filename, strerror(errno));
+    return;
+  }
+
+  snapshot = map;
+  snapshot_file = filename;
+  if(st.st_size == sizeof(struct snapshot) && is_valid(snapshot)) {
+    is_restorable = 1;
+    reachability_target = snapshot->header.route_count;
+    YLOG_INFO("found checkpoint %lu with %u routes and %u neighbors from %ld seconds ago\n",
+              (unsigned long)snapshot->header.generation,
+              snapshot->header.route_count, snapshot->header.nbr_count,
+              (long)(time(NULL) - snapshot->header.saved_at));
+  } else {
+    YLOG_INFO("no valid checkpoint in %s\n", filename);
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+br_snapshot_get_dag(struct br_snapshot_dag *d)
+{
+  rpl_instance_t *instance;
+  rpl_dag_t *dag;
+
+  instance = rpl_get_instance(RPL_DEFAULT_INSTANCE);
+  if(instance == NULL || (dag = instance->current_dag) == NULL ||
+     dag->rank != ROOT_RANK(instance)) {
+    return 0;
+  }
+  memset(d, 0, sizeof(struct br_snapshot_dag));
+  uip_ipaddr_copy(&d->dag_id, &dag->dag_id);
+  d->instance_id = instance->instance_id;
+  d->version = dag->version;
+  d->dtsn_out = instance->dtsn_out;
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+int
+br_snapshot_get_nbrs(struct br_snapshot_nbr *nbrs, int max)
+{
+  struct br_snapshot_nbr *sn;
+  uip_ds6_nbr_t *nbr;
+  const uip_lladdr_t *lladdr;
+  int i;
+
+  i = 0;
+  for(nbr = nbr_table_head(ds6_neighbors);
+      nbr != NULL && i < max;
+      nbr = nbr_table_next(ds6_neighbors, nbr)) {
+    lladdr = uip_ds6_nbr_get_ll(nbr);
+    if(lladdr == NULL || nbr->state == NBR_INCOMPLETE) {
+      continue;
+    }
+    sn = &nbrs[i++];
+    memset(sn, 0, sizeof(struct br_snapshot_nbr));
+    uip_ipaddr_copy(&sn->ipaddr, &nbr->ipaddr);
+    memcpy(&sn->lladdr, lladdr, sizeof(uip_lladdr_t));
+    sn->reachable = stimer_expired(&nbr->reachable) ? 0 : stimer_remaining(&nbr->reachable);
+    sn->state = nbr->state;
+    sn->isrouter = nbr->isrouter;
+  }
+  return i;
+}
+/*---------------------------------------------------------------------------*/
+int
+br_snapshot_get_routes(struct br_snapshot_route *routes, int max)
+{
+  struct br_snapshot_route *sr;
+  uip_ds6_route_t *r;
+  uip_ipaddr_t *nexthop;
+  int i;
+
+  i = 0;
+  for(r = uip_ds6_route_head();
+      r != NULL && i < max;
+      r = uip_ds6_route_next(r)) {
+    nexthop = uip_ds6_route_nexthop(r);
+    if(nexthop == NULL || r->state.lifetime == 0 ||
+       RPL_ROUTE_IS_NOPATH_RECEIVED(r)) {
+      continue;
+    }
+    sr = &routes[i++];
+    memset(sr, 0, sizeof(struct br_snapshot_route));
+    uip_ipaddr_copy(&sr->prefix, &r->ipaddr);
+    uip_ipaddr_copy(&sr->nexthop, nexthop);
+    sr->lifetime = r->state.lifetime;
+    sr->length = r->length;
+    sr->dao_seqno_in = r->state.dao_seqno_in;
+  }
+  return i;
+}
+/*---------------------------------------------------------------------------*/
+rpl_dag_t *
+br_snapshot_set_state(const struct br_snapshot_dag *d,
+                      const struct br_snapshot_nbr *nbrs, int nbr_count,
+                      const struct br_snapshot_route *routes, int route_count,
+                      long age)
+{
+  const struct br_snapshot_nbr *sn;
+  const struct br_snapshot_route *sr;
+  uip_ds6_nbr_t *nbr;
+  uip_ds6_route_t *r;
+  rpl_dag_t *dag;
+  uip_ipaddr_t dag_id;
+  int i;
+
+  uip_ipaddr_copy(&dag_id, &d->dag_id);
+  dag = rpl_set_root_with_version(d->instance_id, &dag_id, d->version);
+  if(dag == NULL) {
+    return NULL;
+  }
+  /* Keep the DTSN to avoid triggering new DAOs from the PAN */
+  dag->instance->dtsn_out = d->dtsn_out;
+
+  restored_nbrs = 0;
+  for(i = 0; i < nbr_count; i++) {
+    sn = &nbrs[i];
+    nbr = uip_ds6_nbr_lookup(&sn->ipaddr);
+    if(nbr == NULL) {
+      nbr = uip_ds6_nbr_add(&sn->ipaddr, &sn->lladdr, sn->isrouter,
+                            sn->reachable > 0 ? NBR_REACHABLE : NBR_STALE,
+                            NBR_TABLE_REASON_UNDEFINED, NULL);
+      if(nbr == NULL) {
+        YLOG_ERROR("neighbor table full after %u neighbors\n", restored_nbrs);
+        break;
+      }
+    }
+    if(nbr->state == NBR_REACHABLE && sn->reachable > 0) {
+      stimer_set(&nbr->reachable, sn->reachable);
+    }
+    restored_nbrs++;
+  }
+
+  restored_routes = 0;
+  for(i = 0; i < route_count; i++) {
+    sr = &routes[i];
+    if((long)sr->lifetime <= age) {
+      continue;
+    }
+    r = rpl_add_route(dag, (uip_ipaddr_t *)&sr->prefix, sr->length,
+                      (uip_ipaddr_t *)&sr->nexthop);
+    if(r == NULL) {
+      continue;
+    }
+    r->state.lifetime = sr->lifetime - age;
+    r->state.dao_seqno_in = sr->dao_seqno_in;
+    restored_routes++;
+  }
+  is_restored = 1;
+  return dag;
+}
+/*---------------------------------------------------------------------------*/
+rpl_dag_t *
+br_snapshot_restore(uip_ipaddr_t *dag_id, const uint8_t *seen_version)
+{
+  const struct snapshot_header *h;
+  struct br_snapshot_dag d;
+  rpl_dag_t *dag;
+  uint64_t start;
+  long age;
+
+  if(!is_restorable) {
+    return NULL;
+  }
+  start = uptime_read();
+  h = &snapshot->header;
+  age = (long)(time(NULL) - h->saved_at);
+
+  if(!uip_ipaddr_cmp(&h->dag_id, dag_id)) {
+    YLOG_INFO("checkpoint is for another DODAG - not restoring\n");
+    return NULL;
+  }
+  if(age < 0 || (unsigned long)age > BR_SNAPSHOT_MAX_AGE) {
+    YLOG_INFO("checkpoint is %ld seconds old - not restoring\n", age);
+    return NULL;
+  }
+  if(seen_version != NULL && *seen_version != h->version) {
+    /* The PAN has moved on since the checkpoint */
+    YLOG_INFO("DODAG version %u seen in PAN, checkpoint has %u - not restoring\n",
+              *seen_version, h->version);
+    return NULL;
+  }
+
+  memset(&d, 0, sizeof(d));
+  uip_ipaddr_copy(&d.dag_id, &h->dag_id);
+  d.instance_id = h->instance_id;
+  d.version = h->version;
+  d.dtsn_out = h->dtsn_out;
+  dag = br_snapshot_set_state(&d, snapshot->nbrs, h->nbr_count,
+                              snapshot->routes, h->route_count, age);
+  if(dag == NULL) {
+    return NULL;
+  }
+
+  restore_time = (unsigned long)uptime_elapsed(start);
+  YLOG_INFO("restored DODAG version %u with %u routes and %u neighbors in %lu ms\n",
+            h->version, restored_routes, restored_nbrs, restore_time);
+  return dag;
+}
+/*---------------------------------------------------------------------------*/
+int
+br_snapshot_save(void)
+{
+  struct snapshot_header *h;
+  struct br_snapshot_dag d;
+  uint64_t start;
+
+  if(snapshot == NULL || !br_snapshot_get_dag(&d)) {
+    return 0;
+  }
+
+  start = uptime_read();
+  h = &snapshot->header;
+  h->valid = 0;
+  __sync_synchronize();
+
+  h->nbr_count = br_snapshot_get_nbrs(snapshot->nbrs, MAX_NBRS);
+  h->route_count = br_snapshot_get_routes(snapshot->routes, MAX_ROUTES);
+  h->magic = SNAPSHOT_MAGIC;
+  h->format = SNAPSHOT_FORMAT;
+  h->max_nbrs = MAX_NBRS;
+  h->max_routes = MAX_ROUTES;
+  h->instance_id = d.instance_id;
+  h->version = d.version;
+  h->dtsn_out = d.dtsn_out;
+  h->reserved = 0;
+  h->generation++;
+  h->saved_at = time(NULL);
+  uip_ipaddr_copy(&h->dag_id, &d.dag_id);
+  h->crc = snapshot_crc(snapshot);
+  __sync_synchronize();
+  h->valid = 1;
+
+  /* Schedule write back to disk - a crash is covered by the page cache */
+  msync(snapshot, sizeof(struct snapshot), MS_ASYNC);
+
+  save_count++;
+  save_time = (unsigned long)uptime_elapsed(start);
+  last_save = uptime_read();
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+periodic_save(void *ptr)
+{
+  br_snapshot_save();
+  ctimer_reset(&save_timer);
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_reachability(void *ptr)
+{
+  if(uip_ds6_route_num_routes() >= reachability_target) {
+    reachability_time = uptime_elapsed(started);
+    YLOG_INFO("%u routes reachable %lu.%03lu seconds after start (%s)\n",
+              reachability_target,
+              (unsigned long)(reachability_time / 1000),
+              (unsigned long)(reachability_time % 1000),
+              is_restored ? "restored" : "relearned");
+  } else if(uptime_elapsed(started) < REACHABILITY_TIMEOUT * 1000UL) {
+    ctimer_reset(&reachability_timer);
+  } else {
+    YLOG_INFO("only %u of %u routes reachable after %u seconds\n",
+              uip_ds6_route_num_routes(), reachability_target,
+              REACHABILITY_TIMEOUT);
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+br_snapshot_start(void)
+{
+  if(snapshot == NULL) {
+    return;
+  }
+  if(reachability_target > 0) {
+    ctimer_set(&reachability_timer, CLOCK_SECOND / 4, check_reachability, NULL);
+  }
+  ctimer_set(&save_timer, BR_SNAPSHOT_INTERVAL * CLOCK_SECOND,
+             periodic_save, NULL);
+}
+/*---------------------------------------------------------------------------*/
+void
+br_snapshot_print(void)
+{
+  if(snapshot == NULL) {
+    printf("No checkpoint file\n");
+    return;
+  }
+  printf("Checkpoint file %s\n", snapshot_file);
+  if(snapshot->header.valid) {
+    printf(" generation %lu: version %u, %u routes, %u neighbors\n",
+           (unsigned long)snapshot->header.generation, snapshot->header.version,
+           snapshot->header.route_count, snapshot->header.nbr_count);
+  }
+  if(save_count > 0) {
+    printf(" %lu checkpoints, last %lu seconds ago in %lu ms\n", save_count,
+           (unsigned long)(uptime_elapsed(last_save) / 1000), save_time);
+  }
+  if(is_restored) {
+    printf(" restored %u routes and %u neighbors in %lu ms\n",
+           restored_routes, restored_nbrs, restore_time);
+  }
+  if(reachability_time > 0) {
+    printf(" %u routes reachable after %lu.%03lu seconds\n", reachability_target,
+           (unsigned long)(reachability_time / 1000),
+           (unsigned long)(reachability_time % 1000));
+  }
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2016, Yanzi Networks AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *    3. Neither the name of the copyright holders nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/**
+ * \file
+ *         Persistent RPL root state for fast border router restart
+ */
+
+#ifndef BR_SNAPSHOT_H_
+#define BR_SNAPSHOT_H_
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/rpl/rpl.h"
+
+/* RPL root state shared by checkpoints and standby replication */
+struct br_snapshot_dag {
+  uip_ipaddr_t dag_id;
+  uint8_t instance_id;
+  uint8_t version;
+  uint8_t dtsn_out;
+};
+
+struct br_snapshot_nbr {
+  uip_ipaddr_t ipaddr;
+  uip_lladdr_t lladdr;
+  /* remaining reachable time in seconds */
+  uint32_t reachable;
+  uint8_t state;
+  uint8_t isrouter;
+};
+
+struct br_snapshot_route {
+  uip_ipaddr_t prefix;
+  uip_ipaddr_t nexthop;
+  /* remaining lifetime in seconds */
+  uint32_t lifetime;
+  uint8_t length;
+  uint8_t dao_seqno_in;
+};
+
+int br_snapshot_get_dag(struct br_snapshot_dag *dag);
+int br_snapshot_get_nbrs(struct br_snapshot_nbr *nbrs, int max);
+int br_snapshot_get_routes(struct br_snapshot_route *routes, int max);
+rpl_dag_t *br_snapshot_set_state(const struct br_snapshot_dag *dag,
+                                 const struct br_snapshot_nbr *nbrs, int nbr_count,
+                                 const struct br_snapshot_route *routes, int route_count,
+                                 long age);
+
+void br_snapshot_init(const char *filename);
+rpl_dag_t *br_snapshot_restore(uip_ipaddr_t *dag_id, const uint8_t *seen_version);
+void br_snapshot_start(void);
+int br_snapshot_save(void);
+void br_snapshot_print(void);
+
+#endif /* BR_SNAPSHOT_H_ */
@@ -0,0 +1,1275 @@
+/*
+ * Copyright (c) 2016, Yanzi Networks AB.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *    1. Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *    2. Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *    3. Neither the name of the copyright holders nor the
+ *       names of its contributors may be used to endorse or promote products
+ *       derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+ * USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *         Hot standby border router with RPL root state replication.
+ *
+ *         The active border router (-y) diffs its DODAG state, neighbor
+ *         cache and DAO routes against what it last sent once per
+ *         interval and streams the changes as a compact binary log to
+ *         a standby border router (-Y) over TCP or a Unix socket. A new
+ *         standby first gets a full copy. The standby keeps a warm copy
+ *         of the tables and takes over when the active is lost,
+ *         continuing with the same DODAG id, version and DTSN so the
+ *         nodes only need to switch parent locally.
+ *
+ *         The active is only lost when no heartbeat has been received
+ *         for the takeover timeout and it can not be reconnected - a
+ *         lost connection alone is not enough. After a takeover the
+ *         standby keeps connecting to the old active and reports the
+ *         takeover, which makes an active of the same DODAG leave the
+ *         PAN instead of competing as root.
+ *
+ *         If the takeover can not be reported, for example when the
+ *         link between the border routers is cut while both still
+ *         reach the PAN, both act as root of the same DODAG until the
+ *         link is back. This is accepted by default since the active
+ *         can not tell a cut link from a failed standby, and should
+ *         keep the PAN running when the standby has failed. With
+ *         BR_STANDBY_CONF_SILENCE_TIMEOUT the active instead leaves the
+ *         PAN when a standby that was in sync has not acknowledged a
+ *         batch for that long. This bounds a split brain to about the
+ *         silence timeout, but leaves the PAN without a root if it is
+ *         the standby that has failed.
+ */
+
+#include "contiki.h"
+#include "net/ip/uip.h"
+#include "net/ipv6/uip-ds6.h"
+#include "net/ipv6/uip-ds6-route.h"
+#include "net/rpl/rpl.h"
+#include "sys/uptime.h"
+#include "border-router.h"
+#include "br-config.h"
+#include "br-snapshot.h"
+#include "br-standby.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define YLOG_LEVEL YLOG_LEVEL_INFO
+#define YLOG_NAME  "standby"
+#include "ylog.h"
+
+/* Replication interval - changes within an interval are batched */
+#ifdef BR_STANDBY_CONF_INTERVAL
+#define BR_STANDBY_INTERVAL BR_STANDBY_CONF_INTERVAL
+#else
+#define BR_STANDBY_INTERVAL CLOCK_SECOND
+#endif
+
+/* Milliseconds without data from the active before taking over */
+#ifdef BR_STANDBY_CONF_TAKEOVER_TIMEOUT
+#define BR_STANDBY_TAKEOVER_TIMEOUT BR_STANDBY_CONF_TAKEOVER_TIMEOUT
+#else
+#define BR_STANDBY_TAKEOVER_TIMEOUT 3000
+#endif
+
+/* Milliseconds without acknowledgement from a standby that has been in
+   sync before the active leaves the PAN, or 0 to never leave */
+#ifdef BR_STANDBY_CONF_SILENCE_TIMEOUT
+#define BR_STANDBY_SILENCE_TIMEOUT BR_STANDBY_CONF_SILENCE_TIMEOUT
+#else
+#define BR_STANDBY_SILENCE_TIMEOUT 0
+#endif
+
+/* Milliseconds a standby may leave a batch unread before it is dropped */
+#define STALL_TIMEOUT    30000
+#define CONNECT_INTERVAL 1000
+#define CHECK_INTERVAL   (CLOCK_SECOND / 10)
+/* Milliseconds between takeover reports to an old active that got one */
+#define FENCE_INTERVAL   10000
+
+#define FORMAT 1
+
+#define MAX_NBRS   NBR_TABLE_MAX_NEIGHBORS
+#define MAX_ROUTES UIP_DS6_ROUTE_NB
+
+/* Records are [type][payload length][payload] in network byte order */
+#define REC_HELLO        1
+#define REC_CLEAR        2
+#define REC_DAG          3
+#define REC_NBR          4
+#define REC_NBR_REMOVE   5
+#define REC_ROUTE        6
+#define REC_ROUTE_REMOVE 7
+#define REC_SYNC         8
+/* From a standby that has taken over, with the DODAG as in REC_DAG */
+#define REC_TAKEOVER     9
+/* From a standby in sync, for each batch */
+#define REC_ALIVE        10
+
+#define LLADDR_LEN       sizeof(uip_lladdr_t)
+#define DAG_LEN          (3 + 16)
+#define NBR_LEN          (16 + LLADDR_LEN + 2 + 2)
+#define NBR_REMOVE_LEN   16
+#define ROUTE_LEN        (16 + 1 + 16 + 4 + 1)
+#define ROUTE_REMOVE_LEN (16 + 1)
+#define SYNC_LEN         4
+
+/* Room for removing and adding every entry in a single batch */
+#define OUT_MAX (2 * (MAX_NBRS * (2 + NBR_LEN) + MAX_ROUTES * (2 + ROUTE_LEN)) + 128)
+#define IN_MAX  4096
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/* Replicated entries with the time they were received */
+struct standby_nbr {
+  struct br_snapshot_nbr nbr;
+  uint64_t received;
+};
+
+struct standby_route {
+  struct br_snapshot_route route;
+  uint64_t received;
+};
+
+static int set_fd(fd_set *rset, fd_set *wset);
+static void handle_fd(fd_set *rset, fd_set *wset);
+static const struct select_callback standby_callback = { set_fd, handle_fd };
+
+static struct process *notify_process;
+static struct ctimer periodic_timer;
+static int server_fd = -1;
+/* The connection to the standby, or to the active when standby */
+static int peer_fd = -1;
+static struct sockaddr_storage peer_address;
+static socklen_t peer_address_len;
+static uint8_t is_connecting;
+static uint8_t is_standby;
+static uint8_t is_synced;
+static uint8_t is_active_lost;
+static uint8_t has_taken_over;
+static uint8_t is_demoted;
+static const char *demote_reason;
+
+/* Connection to the old active for reporting the takeover */
+static int fence_fd = -1;
+static uint8_t is_fence_sent;
+static uint64_t fence_started;
+static uint64_t fence_done;
+static unsigned long fence_reports;
+
+/* Acknowledgements from the standby on the active */
+static uint8_t has_standby_alive;
+static uint64_t last_standby_alive;
+
+/* The state last sent to the standby, sorted by key */
+static struct br_snapshot_dag dag_sent;
+static uint8_t has_dag_sent;
+static struct br_snapshot_nbr nbrs_sent[MAX_NBRS];
+static struct br_snapshot_route routes_sent[MAX_ROUTES];
+static int nbr_sent_count;
+static int route_sent_count;
+
+/* Current tables on the active, takeover state on the standby */
+static struct br_snapshot_nbr nbrs[MAX_NBRS];
+static struct br_snapshot_route routes[MAX_ROUTES];
+
+static uint8_t out[OUT_MAX];
+static int out_len;
+static int out_pos;
+static uint64_t out_started;
+
+/* The replicated state on the standby, sorted by key */
+static struct br_snapshot_dag dag_copy;
+static uint8_t has_dag_copy;
+static struct standby_nbr nbr_copy[MAX_NBRS];
+static struct standby_route route_copy[MAX_ROUTES];
+static int nbr_copy_count;
+static int route_copy_count;
+
+static uint8_t in[IN_MAX];
+static int in_len;
+static uint64_t last_input;
+static uint64_t last_heartbeat;
+static uint64_t last_connect;
+static uint64_t sync_started;
+static uint64_t lost_at;
+
+static unsigned long batches;
+static unsigned long bytes_sent;
+static unsigned long full_copies;
+static unsigned long records_received;
+static unsigned long silence_time;
+static unsigned long takeover_time;
+/*---------------------------------------------------------------------------*/
+static int
+get_address(const char *spec, struct sockaddr_storage *address, socklen_t *len)
+{
+  struct sockaddr_un *sun;
+  struct sockaddr_in *sin;
+  const char *port;
+  char host[64];
+  int i;
+
+  memset(address, 0, sizeof(struct sockaddr_storage));
+  if(*spec == '/') {
+    sun = (struct sockaddr_un *)address;
+    if(strlen(spec) >= sizeof(sun->sun_path)) {
+      return 0;
+    }
+    sun->sun_family = AF_UNIX;
+    strcpy(sun->sun_path, spec);
+    *len = sizeof(struct sockaddr_un);
+    return 1;
+  }
+
+  sin = (struct sockaddr_in *)address;
+  sin->sin_family = AF_INET;
+  /* Localhost 127.0.0.1 unless an address is given */
+  sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  port = strrchr(spec, ':');
+  if(port == NULL) {
+    port = spec;
+  } else {
+    i = port - spec;
+    port++;
+    if(i >= sizeof(host)) {
+      i = sizeof(host) - 1;
+    }
+    memcpy(host, spec, i);
+    host[i] = '\0';
+    if(inet_pton(AF_INET, host, &sin->sin_addr) != 1) {
+      return 0;
+    }
+  }
+  sin->sin_port = htons(atoi(port));
+  if(sin->sin_port == 0) {
+    return 0;
+  }
+  *len = sizeof(struct sockaddr_in);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t *
+put16(uint8_t *p, uint16_t v)
+{
+  p[0] = v >> 8;
+  p[1] = v & 0xff;
+  return p + 2;
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t *
+put32(uint8_t *p, uint32_t v)
+{
+  p[0] = v >> 24;
+  p[1] = (v >> 16) & 0xff;
+  p[2] = (v >> 8) & 0xff;
+  p[3] = v & 0xff;
+  return p + 4;
+}
+/*---------------------------------------------------------------------------*/
+static uint16_t
+get16(const uint8_t *p)
+{
+  return (p[0] << 8) | p[1];
+}
+/*---------------------------------------------------------------------------*/
+static uint32_t
+get32(const uint8_t *p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | (p[2] << 8) | p[3];
+}
+/*---------------------------------------------------------------------------*/
+static uint8_t *
+add_record(uint8_t type, uint8_t len)
+{
+  uint8_t *p;
+  p = &out[out_len];
+  p[0] = type;
+  p[1] = len;
+  out_len += 2 + len;
+  return p + 2;
+}
+/*---------------------------------------------------------------------------*/
+static int
+nbr_cmp(const void *a, const void *b)
+{
+  return memcmp(&((const struct br_snapshot_nbr *)a)->ipaddr,
+                &((const struct br_snapshot_nbr *)b)->ipaddr,
+                sizeof(uip_ipaddr_t));
+}
+/*---------------------------------------------------------------------------*/
+static int
+route_key_cmp(const uip_ipaddr_t *prefix_a, uint8_t length_a,
+              const uip_ipaddr_t *prefix_b, uint8_t length_b)
+{
+  int c;
+  c = memcmp(prefix_a, prefix_b, sizeof(uip_ipaddr_t));
+  return c != 0 ? c : (int)length_a - (int)length_b;
+}
+/*---------------------------------------------------------------------------*/
+static int
+route_cmp(const void *a, const void *b)
+{
+  const struct br_snapshot_route *ra = a;
+  const struct br_snapshot_route *rb = b;
+  return route_key_cmp(&ra->prefix, ra->length, &rb->prefix, rb->length);
+}
+/*---------------------------------------------------------------------------*/
+static int
+is_nbr_changed(const struct br_snapshot_nbr *n, const struct br_snapshot_nbr *o)
+{
+  return memcmp(&n->lladdr, &o->lladdr, LLADDR_LEN) != 0
+    || n->state != o->state || n->isrouter != o->isrouter;
+}
+/*---------------------------------------------------------------------------*/
+static int
+is_route_changed(const struct br_snapshot_route *n, const struct br_snapshot_route *o)
+{
+  /* The lifetime counts down between DAOs - only a refresh is a change */
+  return !uip_ipaddr_cmp(&n->nexthop, &o->nexthop)
+    || n->dao_seqno_in != o->dao_seqno_in || n->lifetime > o->lifetime;
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_dag(const struct br_snapshot_dag *d)
+{
+  uint8_t *p;
+  p = add_record(REC_DAG, DAG_LEN);
+  p[0] = d->instance_id;
+  p[1] = d->version;
+  p[2] = d->dtsn_out;
+  memcpy(&p[3], &d->dag_id, sizeof(uip_ipaddr_t));
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_nbr(const struct br_snapshot_nbr *n)
+{
+  uint8_t *p;
+  p = add_record(REC_NBR, NBR_LEN);
+  memcpy(p, &n->ipaddr, sizeof(uip_ipaddr_t));
+  p += sizeof(uip_ipaddr_t);
+  memcpy(p, &n->lladdr, LLADDR_LEN);
+  p += LLADDR_LEN;
+  p[0] = n->state;
+  p[1] = n->isrouter;
+  put16(&p[2], n->reachable > 0xffff ? 0xffff : n->reachable);
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_nbr_remove(const struct br_snapshot_nbr *n)
+{
+  memcpy(add_record(REC_NBR_REMOVE, NBR_REMOVE_LEN), &n->ipaddr,
+         sizeof(uip_ipaddr_t));
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_route(const struct br_snapshot_route *r)
+{
+  uint8_t *p;
+  p = add_record(REC_ROUTE, ROUTE_LEN);
+  memcpy(p, &r->prefix, sizeof(uip_ipaddr_t));
+  p += sizeof(uip_ipaddr_t);
+  *p++ = r->length;
+  memcpy(p, &r->nexthop, sizeof(uip_ipaddr_t));
+  p += sizeof(uip_ipaddr_t);
+  p = put32(p, r->lifetime);
+  *p = r->dao_seqno_in;
+}
+/*---------------------------------------------------------------------------*/
+static void
+add_route_remove(const struct br_snapshot_route *r)
+{
+  uint8_t *p;
+  p = add_record(REC_ROUTE_REMOVE, ROUTE_REMOVE_LEN);
+  memcpy(p, &r->prefix, sizeof(uip_ipaddr_t));
+  p[sizeof(uip_ipaddr_t)] = r->length;
+}
+/*---------------------------------------------------------------------------*/
+static void
+replicate(void)
+{
+  struct br_snapshot_dag d;
+  int nbr_count, route_count;
+  int i, j, c;
+
+  if(!br_snapshot_get_dag(&d)) {
+    return;
+  }
+
+  if(!has_dag_sent || memcmp(&d, &dag_sent, sizeof(d)) != 0) {
+    add_dag(&d);
+    memcpy(&dag_sent, &d, sizeof(d));
+    has_dag_sent = 1;
+  }
+
+  /* Merge the sorted tables with what was last sent */
+  nbr_count = br_snapshot_get_nbrs(nbrs, MAX_NBRS);
+  qsort(nbrs, nbr_count, sizeof(struct br_snapshot_nbr), nbr_cmp);
+  for(i = 0, j = 0; i < nbr_count || j < nbr_sent_count;) {
+    if(i >= nbr_count) {
+      c = 1;
+    } else if(j >= nbr_sent_count) {
+      c = -1;
+    } else {
+      c = nbr_cmp(&nbrs[i], &nbrs_sent[j]);
+    }
+    if(c < 0) {
+      add_nbr(&nbrs[i++]);
+    } else if(c > 0) {
+      add_nbr_remove(&nbrs_sent[j++]);
+    } else {
+      if(is_nbr_changed(&nbrs[i], &nbrs_sent[j])) {
+        add_nbr(&nbrs[i]);
+      }
+      i++;
+      j++;
+    }
+  }
+  memcpy(nbrs_sent, nbrs, nbr_count * sizeof(struct br_snapshot_nbr));
+  nbr_sent_count = nbr_count;
+
+  route_count = br_snapshot_get_routes(routes, MAX_ROUTES);
+  qsort(routes, route_count, sizeof(struct br_snapshot_route), route_cmp);
+  for(i = 0, j = 0; i < route_count || j < route_sent_count;) {
+    if(i >= route_count) {
+      c = 1;
+    } else if(j >= route_sent_count) {
+      c = -1;
+    } else {
+      c = route_cmp(&routes[i], &routes_sent[j]);
+    }
+    if(c < 0) {
+      add_route(&routes[i++]);
+    } else if(c > 0) {
+      add_route_remove(&routes_sent[j++]);
+    } else {
+      if(is_route_changed(&routes[i], &routes_sent[j])) {
+        add_route(&routes[i]);
+      }
+      i++;
+      j++;
+    }
+  }
+  memcpy(routes_sent, routes, route_count * sizeof(struct br_snapshot_route));
+  route_sent_count = route_count;
+
+  /* Ends each batch and doubles as heartbeat */
+  put16(put16(add_record(REC_SYNC, SYNC_LEN), nbr_count), route_count);
+
+  batches++;
+  out_started = uptime_read();
+}
+/*---------------------------------------------------------------------------*/
+static int
+find_nbr(const uip_ipaddr_t *ipaddr, int *found)
+{
+  int low, high, mid, c;
+
+  low = 0;
+  high = nbr_copy_count - 1;
+  while(low <= high) {
+    mid = (low + high) / 2;
+    c = memcmp(&nbr_copy[mid].nbr.ipaddr, ipaddr, sizeof(uip_ipaddr_t));
+    if(c == 0) {
+      *found = 1;
+      return mid;
+    }
+    if(c < 0) {
+      low = mid + 1;
+    } else {
+      high = mid - 1;
+    }
+  }
+  *found = 0;
+  return low;
+}
+/*---------------------------------------------------------------------------*/
+static int
+find_route(const uip_ipaddr_t *prefix, uint8_t length, int *found)
+{
+  int low, high, mid, c;
+
+  low = 0;
+  high = route_copy_count - 1;
+  while(low <= high) {
+    mid = (low + high) / 2;
+    c = route_key_cmp(&route_copy[mid].route.prefix, route_copy[mid].route.length,
+                      prefix, length);
+    if(c == 0) {
+      *found = 1;
+      return mid;
+    }
+    if(c < 0) {
+      low = mid + 1;
+    } else {
+      high = mid - 1;
+    }
+  }
+  *found = 0;
+  return low;
+}
+/*---------------------------------------------------------------------------*/
+static int
+update_nbr(const uint8_t *data)
+{
+  struct standby_nbr *sn;
+  uip_ipaddr_t ipaddr;
+  int i, found;
+
+  memcpy(&ipaddr, data, sizeof(uip_ipaddr_t));
+  i = find_nbr(&ipaddr, &found);
+  if(!found) {
+    if(nbr_copy_count >= MAX_NBRS) {
+      return 0;
+    }
+    memmove(&nbr_copy[i + 1], &nbr_copy[i],
+            (nbr_copy_count - i) * sizeof(struct standby_nbr));
+    nbr_copy_count++;
+  }
+  sn = &nbr_copy[i];
+  memset(sn, 0, sizeof(struct standby_nbr));
+  uip_ipaddr_copy(&sn->nbr.ipaddr, &ipaddr);
+  data += sizeof(uip_ipaddr_t);
+  memcpy(&sn->nbr.lladdr, data, LLADDR_LEN);
+  data += LLADDR_LEN;
+  sn->nbr.state = data[0];
+  sn->nbr.isrouter = data[1];
+  sn->nbr.reachable = get16(&data[2]);
+  sn->received = uptime_read();
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_nbr(const uint8_t *data)
+{
+  uip_ipaddr_t ipaddr;
+  int i, found;
+
+  memcpy(&ipaddr, data, sizeof(uip_ipaddr_t));
+  i = find_nbr(&ipaddr, &found);
+  if(found) {
+    nbr_copy_count--;
+    memmove(&nbr_copy[i], &nbr_copy[i + 1],
+            (nbr_copy_count - i) * sizeof(struct standby_nbr));
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+update_route(const uint8_t *data)
+{
+  struct standby_route *sr;
+  uip_ipaddr_t prefix;
+  uint8_t length;
+  int i, found;
+
+  memcpy(&prefix, data, sizeof(uip_ipaddr_t));
+  length = data[sizeof(uip_ipaddr_t)];
+  i = find_route(&prefix, length, &found);
+  if(!found) {
+    if(route_copy_count >= MAX_ROUTES) {
+      return 0;
+    }
+    memmove(&route_copy[i + 1], &route_copy[i],
+            (route_copy_count - i) * sizeof(struct standby_route));
+    route_copy_count++;
+  }
+  sr = &route_copy[i];
+  memset(sr, 0, sizeof(struct standby_route));
+  uip_ipaddr_copy(&sr->route.prefix, &prefix);
+  sr->route.length = length;
+  data += sizeof(uip_ipaddr_t) + 1;
+  memcpy(&sr->route.nexthop, data, sizeof(uip_ipaddr_t));
+  data += sizeof(uip_ipaddr_t);
+  sr->route.lifetime = get32(data);
+  sr->route.dao_seqno_in = data[4];
+  sr->received = uptime_read();
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+remove_route(const uint8_t *data)
+{
+  uip_ipaddr_t prefix;
+  int i, found;
+
+  memcpy(&prefix, data, sizeof(uip_ipaddr_t));
+  i = find_route(&prefix, data[sizeof(uip_ipaddr_t)], &found);
+  if(found) {
+    route_copy_count--;
+    memmove(&route_copy[i], &route_copy[i + 1],
+            (route_copy_count - i) * sizeof(struct standby_route));
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+handle_record(uint8_t type, const uint8_t *data, uint8_t len)
+{
+  records_received++;
+  switch(type) {
+  case REC_HELLO:
+    if(len < 1 || data[0] != FORMAT) {
+      YLOG_ERROR("unsupported replication format %u\n", len < 1 ? 0 : data[0]);
+      return 0;
+    }
+    return 1;
+  case REC_CLEAR:
+    nbr_copy_count = 0;
+    route_copy_count = 0;
+    has_dag_copy = 0;
+    is_synced = 0;
+    sync_started = uptime_read();
+    return 1;
+  case REC_DAG:
+    if(len != DAG_LEN) {
+      return 0;
+    }
+    dag_copy.instance_id = data[0];
+    dag_copy.version = data[1];
+    dag_copy.dtsn_out = data[2];
+    memcpy(&dag_copy.dag_id, &data[3], sizeof(uip_ipaddr_t));
+    has_dag_copy = 1;
+    return 1;
+  case REC_NBR:
+    return len == NBR_LEN && update_nbr(data);
+  case REC_NBR_REMOVE:
+    if(len != NBR_REMOVE_LEN) {
+      return 0;
+    }
+    remove_nbr(data);
+    return 1;
+  case REC_ROUTE:
+    return len == ROUTE_LEN && update_route(data);
+  case REC_ROUTE_REMOVE:
+    if(len != ROUTE_REMOVE_LEN) {
+      return 0;
+    }
+    remove_route(data);
+    return 1;
+  case REC_SYNC:
+    if(len != SYNC_LEN) {
+      return 0;
+    }
+    if(get16(data) != nbr_copy_count || get16(&data[2]) != route_copy_count) {
+      YLOG_ERROR("copy has %d neighbors and %d routes, active has %u and %u\n",
+                 nbr_copy_count, route_copy_count, get16(data), get16(&data[2]));
+      return 0;
+    }
+    last_heartbeat = uptime_read();
+    if(!is_synced && has_dag_copy) {
+      is_synced = 1;
+      YLOG_INFO("in sync with %d routes and %d neighbors after %lu ms\n",
+                route_copy_count, nbr_copy_count,
+                (unsigned long)uptime_elapsed(sync_started));
+    }
+    return 1;
+  default:
+    /* Ignore records from newer versions */
+    return 1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+close_peer(void)
+{
+  select_set_callback(peer_fd, NULL);
+  close(peer_fd);
+  peer_fd = -1;
+  is_connecting = 0;
+  in_len = 0;
+  out_len = 0;
+  out_pos = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+connect_active(void)
+{
+  last_connect = uptime_read();
+  peer_fd = socket(peer_address.ss_family, SOCK_STREAM, 0);
+  if(peer_fd < 0) {
+    YLOG_ERROR("failed to create socket: %s\n", strerror(errno));
+    return;
+  }
+  if(!select_set_callback(peer_fd, &standby_callback)) {
+    YLOG_ERROR("Too many open files for standby\n");
+    close(peer_fd);
+    peer_fd = -1;
+    return;
+  }
+  fcntl(peer_fd, F_SETFL, O_NONBLOCK);
+  last_input = last_connect;
+  if(connect(peer_fd, (struct sockaddr *)&peer_address, peer_address_len) == 0) {
+    YLOG_INFO("connected to active border router %s\n", standby_config_active);
+  } else if(errno == EINPROGRESS) {
+    is_connecting = 1;
+  } else {
+    YLOG_DEBUG("failed to connect to %s: %s\n", standby_config_active, strerror(errno));
+    close_peer();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_connect(void)
+{
+  socklen_t len;
+  int error;
+
+  len = sizeof(error);
+  if(getsockopt(peer_fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0) {
+    error = errno;
+  }
+  if(error != 0) {
+    YLOG_DEBUG("failed to connect to %s: %s\n", standby_config_active, strerror(error));
+    close_peer();
+    return;
+  }
+  is_connecting = 0;
+  last_input = uptime_read();
+  YLOG_INFO("connected to active border router %s\n", standby_config_active);
+}
+/*---------------------------------------------------------------------------*/
+static void
+demote(const char *reason)
+{
+  is_demoted = 1;
+  demote_reason = reason;
+  close_peer();
+  if(server_fd >= 0) {
+    select_set_callback(server_fd, NULL);
+    close(server_fd);
+    server_fd = -1;
+  }
+  ctimer_stop(&periodic_timer);
+  /* Keep the radio off the air to leave the PAN to the standby */
+  border_router_set_radio_mode(RADIO_MODE_IDLE);
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_standby_input(int n)
+{
+  struct br_snapshot_dag d;
+  int pos;
+
+  in_len += n;
+  for(pos = 0; in_len - pos >= 2 && in_len - pos >= 2 + in[pos + 1];
+      pos += 2 + in[pos + 1]) {
+    if(in[pos] == REC_ALIVE) {
+      has_standby_alive = 1;
+      last_standby_alive = uptime_read();
+      continue;
+    }
+    if(in[pos] != REC_TAKEOVER || in[pos + 1] != DAG_LEN) {
+      continue;
+    }
+    if(br_snapshot_get_dag(&d)
+       && memcmp(&d.dag_id, &in[pos + 5], sizeof(uip_ipaddr_t)) == 0) {
+      YLOG_ERROR("standby took over DODAG version %u (ours %u) - leaving the PAN\n",
+                 in[pos + 3], d.version);
+      demote("took over");
+      return;
+    }
+  }
+  in_len -= pos;
+  memmove(in, &in[pos], in_len);
+  if(in_len >= sizeof(in)) {
+    in_len = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Acknowledges a batch - a full socket buffer only skips this one */
+static void
+send_alive(void)
+{
+  uint8_t buf[2];
+
+  buf[0] = REC_ALIVE;
+  buf[1] = 0;
+  send(peer_fd, buf, sizeof(buf), MSG_NOSIGNAL);
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_read(void)
+{
+  int n, pos, has_sync;
+
+  n = recv(peer_fd, &in[in_len], sizeof(in) - in_len, 0);
+  if(n < 0 && (errno == EAGAIN || errno == EINTR)) {
+    return;
+  }
+  if(n <= 0) {
+    if(n < 0) {
+      YLOG_ERROR("connection <%d> failed: %s\n", peer_fd, strerror(errno));
+    } else {
+      YLOG_INFO("connection <%d> closed\n", peer_fd);
+    }
+    close_peer();
+    return;
+  }
+  if(!br_standby_is_standby()) {
+    /* Only a takeover report is expected from the standby */
+    handle_standby_input(n);
+    return;
+  }
+  if(is_active_lost) {
+    return;
+  }
+
+  last_input = uptime_read();
+  in_len += n;
+  has_sync = 0;
+  for(pos = 0; in_len - pos >= 2 && in_len - pos >= 2 + in[pos + 1];
+      pos += 2 + in[pos + 1]) {
+    if(!handle_record(in[pos], &in[pos + 2], in[pos + 1])) {
+      /* Start over with a full copy instead of taking over */
+      YLOG_ERROR("bad record %u from active - resyncing\n", in[pos]);
+      is_synced = 0;
+      close_peer();
+      return;
+    }
+    if(in[pos] == REC_SYNC) {
+      has_sync = 1;
+    }
+  }
+  in_len -= pos;
+  memmove(in, &in[pos], in_len);
+  if(has_sync && is_synced) {
+    send_alive();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_write(void)
+{
+  int n;
+
+  n = send(peer_fd, &out[out_pos], out_len - out_pos, MSG_NOSIGNAL);
+  if(n < 0 && (errno == EAGAIN || errno == EINTR)) {
+    return;
+  }
+  if(n <= 0) {
+    YLOG_ERROR("connection <%d> failed: %s\n", peer_fd, strerror(errno));
+    close_peer();
+    return;
+  }
+  out_pos += n;
+  bytes_sent += n;
+  if(out_pos >= out_len) {
+    out_pos = 0;
+    out_len = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_accept(void)
+{
+  int fd;
+
+  fd = accept(server_fd, NULL, NULL);
+  if(fd < 0) {
+    if(errno != EAGAIN && errno != EINTR) {
+      YLOG_ERROR("failed to accept connection: %s\n", strerror(errno));
+    }
+    return;
+  }
+  if(peer_fd >= 0) {
+    YLOG_INFO("new standby <%d> replaces <%d>\n", fd, peer_fd);
+    close_peer();
+  }
+  if(!select_set_callback(fd, &standby_callback)) {
+    YLOG_ERROR("Too many open files for standby\n");
+    close(fd);
+    return;
+  }
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  peer_fd = fd;
+  YLOG_INFO("standby connected <%d>\n", fd);
+
+  /* Start over with a full copy */
+  has_dag_sent = 0;
+  nbr_sent_count = 0;
+  route_sent_count = 0;
+  *add_record(REC_HELLO, 1) = FORMAT;
+  add_record(REC_CLEAR, 0);
+  replicate();
+  full_copies++;
+}
+/*---------------------------------------------------------------------------*/
+static int
+set_fd(fd_set *rset, fd_set *wset)
+{
+  if(server_fd >= 0) {
+    FD_SET(server_fd, rset);
+  }
+  if(peer_fd >= 0) {
+    if(is_connecting) {
+      FD_SET(peer_fd, wset);
+    } else {
+      FD_SET(peer_fd, rset);
+      if(out_pos < out_len) {
+        FD_SET(peer_fd, wset);
+      }
+    }
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_fd(fd_set *rset, fd_set *wset)
+{
+  /* Called once per registered fd - clear each fd after handling it */
+  if(peer_fd >= 0 && FD_ISSET(peer_fd, wset)) {
+    FD_CLR(peer_fd, wset);
+    if(is_connecting) {
+      handle_connect();
+    } else {
+      handle_write();
+    }
+  }
+  if(peer_fd >= 0 && FD_ISSET(peer_fd, rset)) {
+    FD_CLR(peer_fd, rset);
+    handle_read();
+  }
+  if(server_fd >= 0 && FD_ISSET(server_fd, rset)) {
+    FD_CLR(server_fd, rset);
+    handle_accept();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_active(void)
+{
+  if(peer_fd >= 0) {
+    if(uptime_elapsed(last_input) > BR_STANDBY_TAKEOVER_TIMEOUT) {
+      if(is_synced) {
+        YLOG_ERROR("no data from the active border router in %lu ms\n",
+                   (unsigned long)uptime_elapsed(last_input));
+      }
+      close_peer();
+    }
+  } else if(is_synced && !is_active_lost
+            && uptime_elapsed(last_heartbeat) >= BR_STANDBY_TAKEOVER_TIMEOUT) {
+    /* Neither heartbeat nor a new connection within the timeout */
+    is_active_lost = 1;
+    lost_at = uptime_read();
+    silence_time = (unsigned long)(lost_at - last_heartbeat);
+    YLOG_INFO("lost the active border router, last heartbeat %lu ms ago\n",
+              silence_time);
+    process_poll(notify_process);
+  } else if(!is_active_lost && uptime_elapsed(last_connect) >= CONNECT_INTERVAL) {
+    connect_active();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+close_fence(void)
+{
+  close(fence_fd);
+  fence_fd = -1;
+  is_fence_sent = 0;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Report the takeover to the old active until it has been told. The
+ * connection is polled from the periodic timer since it is only used
+ * for this single record.
+ */
+static void
+fence_active(void)
+{
+  uint8_t buf[2 + DAG_LEN];
+  struct pollfd pfd;
+  socklen_t len;
+  int error, n;
+
+  if(fence_fd < 0) {
+    if(uptime_elapsed(fence_started)
+       < (fence_done != 0 ? FENCE_INTERVAL : CONNECT_INTERVAL)) {
+      return;
+    }
+    fence_started = uptime_read();
+    fence_fd = socket(peer_address.ss_family, SOCK_STREAM, 0);
+    if(fence_fd < 0) {
+      return;
+    }
+    fcntl(fence_fd, F_SETFL, O_NONBLOCK);
+    if(connect(fence_fd, (struct sockaddr *)&peer_address, peer_address_len) < 0
+       && errno != EINPROGRESS) {
+      close_fence();
+    }
+    return;
+  }
+
+  if(is_fence_sent) {
+    /* Wait for the old active to close the connection when leaving */
+    while((n = recv(fence_fd, buf, sizeof(buf), 0)) > 0);
+    if(n == 0 || errno != EAGAIN
+       || uptime_elapsed(fence_started) > BR_STANDBY_TAKEOVER_TIMEOUT) {
+      close_fence();
+    }
+    return;
+  }
+
+  pfd.fd = fence_fd;
+  pfd.events = POLLOUT;
+  if(poll(&pfd, 1, 0) <= 0) {
+    if(uptime_elapsed(fence_started) > CONNECT_INTERVAL) {
+      close_fence();
+    }
+    return;
+  }
+  len = sizeof(error);
+  if(getsockopt(fence_fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0) {
+    close_fence();
+    return;
+  }
+
+  buf[0] = REC_TAKEOVER;
+  buf[1] = DAG_LEN;
+  buf[2] = dag_copy.instance_id;
+  buf[3] = dag_copy.version;
+  buf[4] = dag_copy.dtsn_out;
+  memcpy(&buf[5], &dag_copy.dag_id, sizeof(uip_ipaddr_t));
+  if(send(fence_fd, buf, sizeof(buf), MSG_NOSIGNAL) == sizeof(buf)) {
+    if(fence_done == 0) {
+      YLOG_INFO("reported the takeover to the old active border router\n");
+    }
+    fence_done = uptime_read();
+    fence_reports++;
+    is_fence_sent = 1;
+    return;
+  }
+  close_fence();
+}
+/*---------------------------------------------------------------------------*/
+static void
+periodic(void *ptr)
+{
+  ctimer_reset(&periodic_timer);
+
+  if(is_standby) {
+    if(!has_taken_over) {
+      check_active();
+      return;
+    }
+    fence_active();
+  }
+
+  if(BR_STANDBY_SILENCE_TIMEOUT > 0 && has_standby_alive
+     && uptime_elapsed(last_standby_alive) > BR_STANDBY_SILENCE_TIMEOUT) {
+    YLOG_ERROR("no acknowledgement from the standby in %lu ms - leaving the PAN\n",
+               (unsigned long)uptime_elapsed(last_standby_alive));
+    demote("went silent");
+    return;
+  }
+
+  if(peer_fd < 0) {
+    return;
+  }
+  if(out_len > 0) {
+    /* The standby has not read the last batch - the next one covers both */
+    if(uptime_elapsed(out_started) > STALL_TIMEOUT) {
+      YLOG_ERROR("standby <%d> stalled - closing connection\n", peer_fd);
+      close_peer();
+    }
+    return;
+  }
+  replicate();
+}
+/*---------------------------------------------------------------------------*/
+int
+br_standby_is_standby(void)
+{
+  return is_standby && !has_taken_over;
+}
+/*---------------------------------------------------------------------------*/
+int
+br_standby_is_waiting(void)
+{
+  return is_standby && !is_active_lost;
+}
+/*---------------------------------------------------------------------------*/
+int
+br_standby_get_dag_id(uip_ipaddr_t *dag_id)
+{
+  if(!is_standby || !is_synced) {
+    return 0;
+  }
+  uip_ipaddr_copy(dag_id, &dag_copy.dag_id);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+rpl_dag_t *
+br_standby_takeover(void)
+{
+  const struct standby_nbr *sn;
+  const struct standby_route *sr;
+  rpl_dag_t *dag;
+  uint64_t now;
+  uint32_t age;
+  int i, nbr_count, route_count;
+
+  if(!is_active_lost || !is_synced || has_taken_over) {
+    return NULL;
+  }
+  has_taken_over = 1;
+  /* Keep the timer for reporting the takeover to the old active */
+
+  /* Age the copy by the time since each entry was received */
+  now = uptime_read();
+  for(i = 0, nbr_count = 0; i < nbr_copy_count; i++) {
+    sn = &nbr_copy[i];
+    age = (uint32_t)((now - sn->received) / 1000);
+    memcpy(&nbrs[nbr_count], &sn->nbr, sizeof(struct br_snapshot_nbr));
+    nbrs[nbr_count].reachable = sn->nbr.reachable > age ? sn->nbr.reachable - age : 0;
+    nbr_count++;
+  }
+  for(i = 0, route_count = 0; i < route_copy_count; i++) {
+    sr = &route_copy[i];
+    age = (uint32_t)((now - sr->received) / 1000);
+    if(sr->route.lifetime > age) {
+      memcpy(&routes[route_count], &sr->route, sizeof(struct br_snapshot_route));
+      routes[route_count].lifetime -= age;
+      route_count++;
+    }
+  }
+
+  dag = br_snapshot_set_state(&dag_copy, nbrs, nbr_count, routes, route_count, 0);
+  takeover_time = (unsigned long)uptime_elapsed(lost_at);
+  if(dag == NULL) {
+    YLOG_ERROR("failed to take over the DODAG\n");
+    return NULL;
+  }
+  YLOG_INFO("took over DODAG version %u with %d routes and %d neighbors %lu ms after losing the active\n",
+            dag_copy.version, route_count, nbr_count, takeover_time);
+  return dag;
+}
+/*---------------------------------------------------------------------------*/
+void
+br_standby_print(void)
+{
+  if(is_standby) {
+    if(has_taken_over) {
+      printf("Took over from %s %lu ms after it was lost (%lu ms silent)\n",
+             standby_config_active, takeover_time, silence_time);
+      printf(" Takeover reported to the old active %lu times\n", fence_reports);
+    } else {
+      printf("Standby of %s: %s\n", standby_config_active,
+             is_active_lost ? "taking over" : peer_fd < 0 ? "not connected"
+             : is_synced ? "in sync" : "syncing");
+      printf(" DODAG version %u, %d routes, %d neighbors, %lu records\n",
+             dag_copy.version, route_copy_count, nbr_copy_count, records_received);
+    }
+  }
+  if(server_fd >= 0) {
+    printf("Replicating to standby on %s: %s\n", standby_config_port,
+           peer_fd >= 0 ? "connected" : "no standby");
+    printf(" %lu batches, %lu bytes, %lu full copies\n",
+           batches, bytes_sent, full_copies);
+    if(has_standby_alive) {
+      printf(" Last acknowledged %lu ms ago\n",
+             (unsigned long)uptime_elapsed(last_standby_alive));
+    }
+  }
+  if(is_demoted) {
+    printf("Left the PAN after the standby %s\n", demote_reason);
+  } else if(!is_standby && server_fd < 0) {
+    printf("No standby replication\n");
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+br_standby_init(struct process *p)
+{
+  notify_process = p;
+  if(standby_config_active == NULL) {
+    return;
+  }
+  if(!get_address(standby_config_active, &peer_address, &peer_address_len)) {
+    YLOG_ERROR("Illegal active border router address '%s'. Disabling standby.\n",
+               standby_config_active);
+    return;
+  }
+  is_standby = 1;
+  YLOG_INFO("standby of active border router %s\n", standby_config_active);
+  connect_active();
+  ctimer_set(&periodic_timer, CHECK_INTERVAL, periodic, NULL);
+}
+/*---------------------------------------------------------------------------*/
+void
+br_standby_start(void)
+{
+  struct sockaddr_storage address;
+  socklen_t len;
+  int on = 1;
+
+  if(standby_config_port == NULL || server_fd >= 0 || is_demoted) {
+    return;
+  }
+  if(!get_address(standby_config_port, &address, &len)) {
+    YLOG_ERROR("Illegal standby address '%s'. Disabling replication.\n",
+               standby_config_port);
+    return;
+  }
+  if(address.ss_family == AF_UNIX) {
+    /* Remove any socket left by an earlier run */
+    unlink(((struct sockaddr_un *)&address)->sun_path);
+  }
+
+  if((server_fd = socket(address.ss_family, SOCK_STREAM, 0)) == -1) {
+    YLOG_ERROR("Error creating standby socket: %s\n", strerror(errno));
+    return;
+  }
+  setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  if(bind(server_fd, (struct sockaddr *)&address, len) == -1
+     || listen(server_fd, 1) < 0) {
+    YLOG_ERROR("Error binding standby address %s: %s\n", standby_config_port,
+               strerror(errno));
+    close(server_fd);
+    server_fd = -1;
+    return;
+  }
+
+  fcntl(server_fd, F_SETFL, O_NONBLOCK);
+  if(!select_set_callback(server_fd, &standby_callback)) {
+    YLOG_ERROR("Too many open files for standby\n");
+    close(server_fd);
+    server_fd = -1;
+    return;
+  }
+
+  YLOG_INFO("Replicating to standby on %s\n", standby_config_port);
+  ctimer_set(&periodic_timer, BR_STANDBY_INTERVAL, periodic, NULL);
+}
+/*---------------------------------------------------------------------------*/
@@ -39,6 +39,7 @@
 #define BRM_STATS_H_
 
 #include "contiki-conf.h"
+#include "lib/instrument.h"
 
 enum {
   BRM_STATS_ENCAP_RECV,
@@ -46,23 +47,16 @@ enum {
   BRM_STATS_ENCAP_SERIAL,
   BRM_STATS_ENCAP_UNPROCESSED,
   BRM_STATS_ENCAP_ERRORS,
+  BRM_STATS_ENCAP_AGGREGATE,
 
   BRM_STATS_MAX
 };
 
-extern uint32_t brm_stats[];
+INSTRUMENT_DECLARE(brm_stats);
 
-#define BRM_STATS_INC(x) do {                                        \
-    uint32_t tmp_brm_stats = ntohl(brm_stats[x]);                    \
-    tmp_brm_stats++;                                                 \
-    brm_stats[x] = htonl(tmp_brm_stats);                             \
-  } while(0)
-#define BRM_STATS_ADD(x, y) do {                                     \
-    uint32_t tmp_brm_stats = ntohl(brm_stats[x]);                    \
-    tmp_brm_stats += y;                                              \
-    brm_stats[x] = htonl(tmp_brm_stats);                             \
-  } while(0)
-#define BRM_STATS_GET(x) (ntohl(brm_stats[x]))
+#define BRM_STATS_INC(x)    INSTRUMENT_INC(brm_stats, x)
+#define BRM_STATS_ADD(x, y) INSTRUMENT_ADD(brm_stats, x, y)
+#define BRM_STATS_GET(x)    INSTRUMENT_GET(brm_stats, x)
 
 enum {
   BRM_STATS_DEBUG_SLIP_RECV,
@@ -70,22 +64,23 @@ enum {
   BRM_STATS_DEBUG_SLIP_DROPPED,
   BRM_STATS_DEBUG_SLIP_OVERFLOWS,
   BRM_STATS_DEBUG_SLIP_ERRORS,
+  BRM_STATS_DEBUG_SLIP_AGGREGATED_SENT,
+  BRM_STATS_DEBUG_SLIP_AGGREGATED_RECV,
+  BRM_STATS_DEBUG_SLIP_RETRANSMITS,
+  BRM_STATS_DEBUG_SLIP_FAST_RETRANSMITS,
+  BRM_STATS_DEBUG_SLIP_RETRANSMIT_FAILED,
+  BRM_STATS_DEBUG_SLIP_OUT_OF_ORDER,
+  BRM_STATS_DEBUG_SLIP_DUPLICATES,
+  BRM_STATS_DEBUG_SLIP_GAPS,
+  BRM_STATS_DEBUG_SLIP_LOST,
 
   BRM_STATS_DEBUG_MAX
 };
 
-extern uint32_t brm_stats_debug[];
+INSTRUMENT_DECLARE(brm_stats_debug);
 
-#define BRM_STATS_DEBUG_INC(x) do {                                   \
-    uint32_t tmp_brm_stats = ntohl(brm_stats_debug[x]);               \
-    tmp_brm_stats++;                                                  \
-    brm_stats_debug[x] = htonl(tmp_brm_stats);                        \
-  } while(0)
-#define BRM_STATS_DEBUG_ADD(x, y) do {                                \
-    uint32_t tmp_brm_stats = ntohl(brm_stats_debug[x]);               \
-    tmp_brm_stats += y;                                               \
-    brm_stats_debug[x] = htonl(tmp_brm_stats);                        \
-  } while(0)
-#define BRM_STATS_DEBUG_GET(x) (ntohl(brm_stats_debug[x]))
+#define BRM_STATS_DEBUG_INC(x)    INSTRUMENT_INC(brm_stats_debug, x)
+#define BRM_STATS_DEBUG_ADD(x, y) INSTRUMENT_ADD(brm_stats_debug, x, y)
+#define BRM_STATS_DEBUG_GET(x)    INSTRUMENT_GET(brm_stats_debug, x)
 
 #endif /* BRM_STATS_H_ */
@@ -63,6 +63,7 @@
 #include "net/netstack.h"
 #include "net/packetbuf.h"
 #include "cmd.h"
+#include "slip-codec.h"
 #include "border-router.h"
 #include "border-router-cmds.h"
 #include "udp-cmd.h"
@@ -71,6 +72,10 @@
 #include "sparrow-encap.h"
 #include "enc-dev.h"
 #include "br-config.h"
+#include "packetutils.h"
+#if BR_AQM
+#include "br-aqm.h"
+#endif /* BR_AQM */
 
 #define YLOG_LEVEL YLOG_LEVEL_INFO
 #define YLOG_NAME  "enc"
@@ -84,6 +89,7 @@
 #endif
 
 extern speed_t br_config_b_rate;
+extern uint32_t radio_control_version;
 
 PROCESS_NAME(serial_input_process);
 
@@ -119,7 +125,6 @@ int devopen(const char *dev, int flags);
 static const struct enc_dev_tunnel *tunnel = NULL;
 
 /* delay between serial packets */
-static struct ctimer send_delay_timer;
 static uint32_t send_delay = 0;
 
 /* for statistics */
@@ -127,65 +132,237 @@ unsigned long slip_sent = 0;
 unsigned long slip_sent_to_fd = 0;
 unsigned int  slip_max_buffer_usage = 0;
 
-static int serialfd = -1;
-
 #define PACKET_MAX_COUNT 64
-#define PACKET_MAX_TRANSMISSIONS 2
 #define PACKET_MAX_SIZE 1280
 
+/*
+ * Max number of waiting packets per traffic class. The limits may add
+ * up to more than PACKET_MAX_COUNT - when all packets are in use, the
+ * latest packet of a less urgent class is dropped to make room.
+ */
+#ifdef ENC_DEV_CONF_TX_LIMITS
+#define ENC_DEV_TX_LIMITS ENC_DEV_CONF_TX_LIMITS
+#else
+#define ENC_DEV_TX_LIMITS { 32, 48, 32 }
+#endif
+
+/*
+ * Share of the serial line per traffic class when several classes have
+ * packets waiting. Each class may send weight * ENC_DEV_TX_QUANTUM
+ * bytes per round. The weights must not be zero.
+ */
+#ifdef ENC_DEV_CONF_TX_WEIGHTS
+#define ENC_DEV_TX_WEIGHTS ENC_DEV_CONF_TX_WEIGHTS
+#else
+#define ENC_DEV_TX_WEIGHTS { 8, 4, 1 }
+#endif
+
+#define ENC_DEV_TX_QUANTUM 128
+
+/* OAM payloads to the serial radio larger than this, such as firmware, are bulk */
+#ifdef ENC_DEV_CONF_TX_BULK_SIZE
+#define ENC_DEV_TX_BULK_SIZE ENC_DEV_CONF_TX_BULK_SIZE
+#else
+#define ENC_DEV_TX_BULK_SIZE 256
+#endif
+
+/* Encap header with LENOPT fingerprint, sequence number field and CRC32 */
+#define ENCAP_HEADER_SIZE 8
+#define ENCAP_OVERHEAD    (ENCAP_HEADER_SIZE + SPARROW_ENCAP_SEQNO_LEN + 4)
+
+/*
+ * Packets waiting to be sent are aggregated into one encap frame when
+ * supported by the serial radio. Only packets that are already queued
+ * are aggregated, which means aggregation never delays a packet.
+ */
+#ifdef ENC_DEV_CONF_AGGREGATE
+#define ENC_DEV_AGGREGATE ENC_DEV_CONF_AGGREGATE
+#else
+#define ENC_DEV_AGGREGATE 1
+#endif
+
+/* Max size of aggregated payloads - must fit the serial radio input buffer */
+#ifdef ENC_DEV_CONF_AGGREGATE_MAX_SIZE
+#define ENC_DEV_AGGREGATE_MAX_SIZE ENC_DEV_CONF_AGGREGATE_MAX_SIZE
+#else
+#define ENC_DEV_AGGREGATE_MAX_SIZE 512
+#endif
+
+/* Radio control API version with support for aggregate payloads */
+#define ENC_DEV_AGGREGATE_API_VERSION 4
+
+#if BR_AQM
+/* Max number of frames from the tun interface in one packet */
+#if ENC_DEV_AGGREGATE
+#define ENC_DEV_AQM_FLOWS 8
+#else
+#define ENC_DEV_AQM_FLOWS 1
+#endif
+#endif /* BR_AQM */
+
+/*
+ * Frames are sequenced and acknowledged when supported by the serial
+ * radio. Unacknowledged frames are sent again, go-back-N style, after
+ * a timeout or directly when the radio reports a gap.
+ */
+#ifdef ENC_DEV_CONF_RELIABLE
+#define ENC_DEV_RELIABLE ENC_DEV_CONF_RELIABLE
+#else
+#define ENC_DEV_RELIABLE 1
+#endif
+
+/* Max number of unacknowledged frames */
+#ifdef ENC_DEV_CONF_WINDOW_SIZE
+#define ENC_DEV_WINDOW_SIZE ENC_DEV_CONF_WINDOW_SIZE
+#else
+#define ENC_DEV_WINDOW_SIZE 8
+#endif
+
+#ifdef ENC_DEV_CONF_RETRANSMIT_TIMEOUT
+#define ENC_DEV_RETRANSMIT_TIMEOUT ENC_DEV_CONF_RETRANSMIT_TIMEOUT
+#else
+#define ENC_DEV_RETRANSMIT_TIMEOUT (CLOCK_SECOND / 4)
+#endif
+
+#define ENC_DEV_MAX_TRANSMISSIONS 8
+#define ENC_DEV_ACK_DELAY         (CLOCK_SECOND / 50)
+/* Number of received frames before an ack is sent without delay */
+#define ENC_DEV_ACK_FRAMES        2
+/* Max time to wait for missing frames before continuing after a gap */
+#define ENC_DEV_GAP_TIMEOUT       (CLOCK_SECOND / 2)
+
+/* Radio control API version with support for sequenced frames */
+#define ENC_DEV_RELIABLE_API_VERSION 5
+
+/* 16 KB buffer size */
+#define INPUT_BUFFER_SIZE 16384
+
+/* The payload is encapsulated when sent */
 typedef struct {
   void *next;
   uint16_t len;
-  uint8_t data[PACKET_MAX_SIZE];
+  uint8_t payload_type;
+  uint8_t transmissions;
+  uint16_t seqno;
+  uint8_t tx_class;
+  clock_time_t queued;
+#if BR_AQM
+  /* flow and queue time of each frame from the tun interface */
+  uint8_t flow_count;
+  uint16_t flow[ENC_DEV_AQM_FLOWS];
+  clock_time_t flow_queued[ENC_DEV_AQM_FLOWS];
+#endif /* BR_AQM */
+  uint8_t data[PACKET_MAX_SIZE - ENCAP_OVERHEAD];
 } packet_t;
 
-MEMB(packet_memb, packet_t, PACKET_MAX_COUNT);
-LIST(pending_packets);
-static packet_t *active_packet = NULL;
+/* Packets of one traffic class waiting to be sent */
+struct tx_queue {
+  LIST_STRUCT(packets);
+  uint16_t count;
+  /* Bytes the class may send in the current round */
+  int deficit;
+};
+
+static const uint16_t tx_limits[ENC_DEV_TX_CLASSES] = ENC_DEV_TX_LIMITS;
+static const uint8_t tx_weights[ENC_DEV_TX_CLASSES] = ENC_DEV_TX_WEIGHTS;
+static const char *tx_class_names[ENC_DEV_TX_CLASSES] = {
+  "control", "interactive", "bulk"
+};
+
+/* The serial connection and encap state of one serial radio */
+struct enc_dev {
+  int fd;
+  uint8_t index;
+  uint32_t control_version;
+
+  /* Input buffered by the reader thread */
+  pthread_t thread;
+  uint8_t input_buffer[INPUT_BUFFER_SIZE];
+  volatile uint16_t write_pos;
+  volatile uint16_t read_pos;
+
+  /* the unslipped input buffer */
+  unsigned char inbuf[ENC_DEV_BUFFER_SIZE];
+  int inbufptr;
+  uint8_t state;
+
+  /* Packets waiting to be sent, one queue per traffic class */
+  struct tx_queue queues[ENC_DEV_TX_CLASSES];
+  uint8_t tx_class;
+  packet_t *active_packet;
+  uint16_t packet_count;
+  /* Ensure the slip buffer will be large enough for worst case encoding */
+  uint8_t slip_buf[SLIP_CODEC_MAX_ENCODED_LEN(PACKET_MAX_SIZE)];
+  uint16_t slip_begin;
+  uint16_t slip_end;
+  struct ctimer send_delay_timer;
+
+#if ENC_DEV_RELIABLE
+  /* Packets to send again, before any new packets */
+  LIST_STRUCT(retransmit_packets);
+  LIST_STRUCT(unacked_packets);
+  /* Only carries the ack */
+  packet_t ack_packet;
+  struct ctimer ack_timer;
+  struct ctimer retransmit_timer;
+  uint16_t tx_seqno;
+  uint8_t tx_outstanding;
+  uint8_t fast_retransmit;
+  /* Last frame received in order - sent as ack */
+  uint16_t rx_seqno;
+  uint8_t rx_unacked;
+  uint8_t rx_gap;
+  clock_time_t rx_gap_start;
+  uint8_t ack_pending;
+  uint8_t gap_report;
+#endif /* ENC_DEV_RELIABLE */
+
+  struct enc_dev_stats stats;
+};
+
+static struct enc_dev devs[BR_MAX_RADIOS];
+static uint8_t dev_count = 1;
+/* The radio that sent the command being processed */
+static struct enc_dev *current_dev = &devs[0];
+
+static long pending_count(struct enc_dev *dev);
+static int encap_packet(struct enc_dev *dev, const packet_t *packet,
+                        uint8_t *buffer, int size);
+
+MEMB(packet_memb, packet_t, PACKET_MAX_COUNT * BR_MAX_RADIOS);
 
 //#define PROGRESS(s) fprintf(stderr, s)
 #define PROGRESS(s) do { } while(0)
 
-#define SLIP_END     0300
-#define SLIP_ESC     0333
-#define SLIP_ESC_END 0334
-#define SLIP_ESC_ESC 0335
-
 
 /*---------------------------------------------------------------------------*/
 /* Read thread */
 
-static pthread_t thread;
-
-/* 16 KB buffer size */
-#define INPUT_BUFFER_SIZE 16384
-static uint8_t input_buffer[INPUT_BUFFER_SIZE];
-static volatile uint16_t write_pos = 0;
-static volatile uint16_t read_pos = 0;
-
-void *
+static void *
 read_code(void *argument)
 {
+   struct enc_dev *dev = argument;
    int i;
    uint16_t next_pos;
+   uint16_t usage;
 
-   YLOG_DEBUG("Serial Reader started!\n");
-   if(serialfd > 0) {
+   YLOG_DEBUG("Serial Reader %u started!\n", dev->index);
+   if(dev->fd > 0) {
      size_t free_size;
      ssize_t size;
      while(1) {
-       if(read_pos > write_pos) {
-         free_size = read_pos - write_pos;
+       if(dev->read_pos > dev->write_pos) {
+         free_size = dev->read_pos - dev->write_pos;
        } else {
-         free_size = INPUT_BUFFER_SIZE - write_pos;
+         free_size = INPUT_BUFFER_SIZE - dev->write_pos;
        }
-       size = read(serialfd, &input_buffer[write_pos], free_size);
+       size = read(dev->fd, &dev->input_buffer[dev->write_pos], free_size);
 
        if(size <= 0) {
 
          if(size == 0) {
            /* Serial connection has closed */
-           YLOG_ERROR("*** serial connection closed.\n");
+           YLOG_ERROR("*** serial connection %u closed.\n", dev->index);
            for(i = 5; i > 0; i--) {
              YLOG_ERROR("*** exit in %d seconds\n", i);
              sleep(1);
@@ -199,23 +376,28 @@ read_code(void *argument)
          continue;
        }
 
-       next_pos = (write_pos + size) % INPUT_BUFFER_SIZE;
+       next_pos = (dev->write_pos + size) % INPUT_BUFFER_SIZE;
 
-       if(next_pos == read_pos) {
+       if(next_pos == dev->read_pos) {
          BRM_STATS_DEBUG_INC(BRM_STATS_DEBUG_SLIP_DROPPED);
          LOG_LIMIT_ERROR("*** reader has not read... overwriting read buffer! (%u)\n",
                          BRM_STATS_DEBUG_GET(BRM_STATS_DEBUG_SLIP_DROPPED));
-         slip_max_buffer_usage = INPUT_BUFFER_SIZE;
-       } else if(read_pos > next_pos) {
-         if(next_pos + INPUT_BUFFER_SIZE - read_pos > slip_max_buffer_usage) {
-           slip_max_buffer_usage = next_pos + INPUT_BUFFER_SIZE - read_pos;
-         }
-       } else if(next_pos - read_pos > slip_max_buffer_usage) {
-         slip_max_buffer_usage = next_pos - read_pos;
+         usage = INPUT_BUFFER_SIZE;
+       } else if(dev->read_pos > next_pos) {
+         usage = next_pos + INPUT_BUFFER_SIZE - dev->read_pos;
+       } else {
+         usage = next_pos - dev->read_pos;
+       }
+       if(usage > dev->stats.max_buffer_usage) {
+         dev->stats.max_buffer_usage = usage;
+       }
+       if(usage > slip_max_buffer_usage) {
+         slip_max_buffer_usage = usage;
        }
 
-       write_pos = next_pos;
-       PRINTF("Read %d bytes WP:%d RP:%d\n", (int) size, write_pos, read_pos);
+       dev->write_pos = next_pos;
+       PRINTF("Read %d bytes WP:%d RP:%d\n", (int) size, dev->write_pos,
+              dev->read_pos);
 
        process_poll(&serial_input_process);
      }
@@ -235,9 +417,10 @@ serial_get_baudrate(void)
 void
 serial_set_baudrate(unsigned speed)
 {
+  /* The baudrate is only negotiated with the primary radio */
   br_config_b_rate = speed;
-  if(br_config_host == NULL && serialfd > 0) {
-    stty_telos(serialfd);
+  if(br_config_host == NULL && devs[0].fd > 0) {
+    stty_telos(devs[0].fd);
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -251,8 +434,8 @@ void
 serial_set_ctsrts(int ctsrts)
 {
   br_config_flowcontrol = ctsrts;
-  if(br_config_host == NULL && serialfd > 0) {
-    stty_telos(serialfd);
+  if(br_config_host == NULL && devs[0].fd > 0) {
+    stty_telos(devs[0].fd);
   } else if(ctsrts) {
     YLOG_ERROR("can not set cts/rts - no serial connection\n");
   }
@@ -278,6 +461,8 @@ serial_get_send_delay(void)
 void
 serial_set_send_delay(uint32_t delayms)
 {
+  int i;
+
   if(send_delay != delayms) {
     send_delay = delayms;
 
@@ -285,46 +470,509 @@ serial_set_send_delay(uint32_t delayms)
 #warning "send delay is assuming CLOCK_SECOND is milliseconds on native platform"
 #endif
 
-    if(send_delay > 0) {
-      /* No callback function is needed here - the callback timer is just
-         to make sure that the application is not sleeping when it is time
-         to continue sending data. set_fd()/handle_fd() will be called
-         anyway when the application is awake.
-      */
-      ctimer_set(&send_delay_timer, send_delay, NULL, NULL);
+    for(i = 0; i < dev_count; i++) {
+      if(send_delay > 0) {
+        /* No callback function is needed here - the callback timer is just
+           to make sure that the application is not sleeping when it is time
+           to continue sending data. set_fd()/handle_fd() will be called
+           anyway when the application is awake.
+        */
+        ctimer_set(&devs[i].send_delay_timer, send_delay, NULL, NULL);
+      }
+      /* Make sure the send delay timer is expired from start */
+      ctimer_stop(&devs[i].send_delay_timer);
     }
-    /* Make sure the send delay timer is expired from start */
-    ctimer_stop(&send_delay_timer);
   }
 }
 /*---------------------------------------------------------------------------*/
+static void
+packet_dropped(struct enc_dev *dev, uint8_t tx_class)
+{
+  BRM_STATS_DEBUG_INC(BRM_STATS_DEBUG_SLIP_OVERFLOWS);
+  dev->stats.dropped++;
+  dev->stats.tx_class[tx_class].dropped++;
+  LOG_LIMIT_ERROR("*** dropping pending %s packet (%u)\n",
+                  tx_class_names[tx_class],
+                  BRM_STATS_DEBUG_GET(BRM_STATS_DEBUG_SLIP_OVERFLOWS));
+}
+/*---------------------------------------------------------------------------*/
+#if BR_AQM
+/* Remember the flow of the frame being written, if from the tun interface */
+static void
+add_flow(packet_t *p)
+{
+  uint16_t flow;
+
+  flow = br_aqm_get_flow();
+  if(flow != BR_AQM_NO_FLOW && p->flow_count < ENC_DEV_AQM_FLOWS) {
+    p->flow[p->flow_count] = flow;
+    p->flow_queued[p->flow_count] = clock_time();
+    p->flow_count++;
+  }
+}
+#endif /* BR_AQM */
+/*---------------------------------------------------------------------------*/
 static packet_t *
-alloc_packet(void)
+alloc_packet(struct enc_dev *dev, uint8_t tx_class)
 {
-  packet_t *p;
-  p = memb_alloc(&packet_memb);
+  struct tx_queue *q = &dev->queues[tx_class];
+  packet_t *p = NULL;
+  int i;
 
-  if(p == NULL) {
-    BRM_STATS_DEBUG_INC(BRM_STATS_DEBUG_SLIP_OVERFLOWS);
-    LOG_LIMIT_ERROR("*** dropping pending packet (%u)\n",
-                    BRM_STATS_DEBUG_GET(BRM_STATS_DEBUG_SLIP_OVERFLOWS));
+  if(q->count < tx_limits[tx_class]) {
+    /* Each radio has its share of the packets */
+    if(dev->packet_count < PACKET_MAX_COUNT) {
+      p = memb_alloc(&packet_memb);
+      if(p != NULL) {
+        dev->packet_count++;
+      }
+    }
+
+    /* Make room by dropping the latest packet of a less urgent class */
+    for(i = ENC_DEV_TX_CLASSES - 1; p == NULL && i > tx_class; i--) {
+      p = list_chop(dev->queues[i].packets);
+      if(p != NULL) {
+        dev->queues[i].count--;
+        packet_dropped(dev, i);
+      }
+    }
 
-    /* Drop latest pending packet */
-    p = list_chop(pending_packets);
+    if(p != NULL) {
+      q->count++;
+    }
+  }
+
+  if(p == NULL) {
+    /* Drop latest pending packet of the class */
+    packet_dropped(dev, tx_class);
+    p = list_chop(q->packets);
   }
 
   if(p) {
     memset(p, 0, sizeof(packet_t));
+    p->tx_class = tx_class;
+    p->queued = clock_time();
+#if BR_AQM
+    add_flow(p);
+#endif /* BR_AQM */
   }
   return p;
 }
 /*---------------------------------------------------------------------------*/
 static void
-free_packet(packet_t *p)
+free_packet(struct enc_dev *dev, packet_t *p)
 {
+#if ENC_DEV_RELIABLE
+  if(p->seqno != 0) {
+    dev->tx_outstanding--;
+  }
+#endif /* ENC_DEV_RELIABLE */
+  dev->packet_count--;
   memb_free(&packet_memb, p);
 }
 /*---------------------------------------------------------------------------*/
+static uint32_t
+control_version(const struct enc_dev *dev)
+{
+  /* The version of the primary radio is kept by the border router */
+  return dev->index == 0 ? radio_control_version : dev->control_version;
+}
+/*---------------------------------------------------------------------------*/
+#if ENC_DEV_RELIABLE
+static uint16_t
+next_seqno(uint16_t seqno)
+{
+  seqno++;
+  return seqno == 0 ? 1 : seqno;
+}
+/*---------------------------------------------------------------------------*/
+/* Returns non-zero if sequence number a is before or equal to b */
+static int
+seqno_before_eq(uint16_t a, uint16_t b)
+{
+  return (uint16_t)(b - a) < 0x8000;
+}
+/*---------------------------------------------------------------------------*/
+static int
+is_reliable(const struct enc_dev *dev)
+{
+  /*
+   * Frames are only sequenced after the version exchange. The radio
+   * restarts its receive sequence on the version request and acks
+   * received before the reply belong to an earlier session.
+   */
+  return control_version(dev) >= ENC_DEV_RELIABLE_API_VERSION;
+}
+/*---------------------------------------------------------------------------*/
+static void
+ack_timeout(void *ptr)
+{
+  struct enc_dev *dev = ptr;
+  if(dev->rx_unacked > 0) {
+    dev->ack_pending = 1;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+retransmit(struct enc_dev *dev)
+{
+  packet_t *p;
+
+  ctimer_stop(&dev->retransmit_timer);
+
+  /* Go back N - all unacked packets are sent again before new packets */
+  while((p = list_chop(dev->unacked_packets)) != NULL) {
+    if(p->transmissions >= ENC_DEV_MAX_TRANSMISSIONS) {
+      /* Give up - the radio will continue after the gap */
+      BRM_STATS_DEBUG_INC(BRM_STATS_DEBUG_SLIP_RETRANSMIT_FAILED);
+      free_packet(dev, p);
+    } else {
+      BRM_STATS_DEBUG_INC(BRM_STATS_DEBUG_SLIP_RETRANSMITS);
+      list_push(dev->retransmit_packets, p);
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+retransmit_timeout(void *ptr)
+{
+  retransmit(ptr);
+}
+/*---------------------------------------------------------------------------*/
+/* Keep the unacked packets ordered by sequence number */
+static void
+add_unacked(struct enc_dev *dev, packet_t *packet)
+{
+  packet_t *p, *prev = NULL;
+
+  for(p = list_head(dev->unacked_packets);
+      p != NULL && seqno_before_eq(p->seqno, packet->seqno);
+      p = list_item_next(p)) {
+    prev = p;
+  }
+  list_insert(dev->unacked_packets, prev, packet);
+
+  if(ctimer_expired(&dev->retransmit_timer)) {
+    ctimer_set(&dev->retransmit_timer, ENC_DEV_RETRANSMIT_TIMEOUT,
+               retransmit_timeout, dev);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+free_acked(struct enc_dev *dev, list_t list, uint16_t ack)
+{
+  packet_t *p, *next;
+  int count = 0;
+
+  for(p = list_head(list); p != NULL; p = next) {
+    next = list_item_next(p);
+    if(p->seqno != 0 && seqno_before_eq(p->seqno, ack)) {
+      list_remove(list, p);
+      free_packet(dev, p);
+      count++;
+    }
+  }
+  return count;
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_ack(struct enc_dev *dev, uint16_t ack, int is_report)
+{
+  packet_t *p;
+
+  if(ack == 0) {
+    /* Nothing received yet */
+    return;
+  }
+
+  /* Retransmissions waiting to be sent might also have been acked */
+  if(free_acked(dev, dev->unacked_packets, ack)
+     + free_acked(dev, dev->retransmit_packets, ack) > 0) {
+    dev->fast_retransmit = 0;
+    if(list_head(dev->unacked_packets) != NULL) {
+      ctimer_restart(&dev->retransmit_timer);
+    } else {
+      ctimer_stop(&dev->retransmit_timer);
+    }
+    return;
+  }
+
+  /* A report still waiting for the first unacked frame means it was lost */
+  p = list_head(dev->unacked_packets);
+  if(is_report && !dev->fast_retransmit
+     && p != NULL && p->seqno == next_seqno(ack)) {
+    dev->fast_retransmit = 1;
+    BRM_STATS_DEBUG_INC(BRM_STATS_DEBUG_SLIP_FAST_RETRANSMITS);
+    retransmit(dev);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Handle the sequence number and ack of a received frame. Returns
+ * non-zero if the payload should be processed.
+ */
+static int
+handle_seqno(struct enc_dev *dev, const uint8_t *field, uint8_t payload_type)
+{
+  uint16_t seqno, ack;
+
+  seqno = ((uint16_t)field[0] << 8) | field[1];
+  ack = ((uint16_t)field[2] << 8) | field[3];
+
+  handle_ack(dev, ack, seqno == 0
+             && payload_type == SPARROW_ENCAP_PAYLOAD_RECEIVE_REPORT);
+
+  if(seqno == 0) {
+    /* Not sequenced */
+    return 1;
+  }
+
+  if(dev->rx_seqno == 0 || seqno == next_seqno(dev->rx_seqno)) {
+    /* First frame from the radio or next frame in order */
+  } else if(seqno_before_eq(seqno, dev->rx_seqno)) {
+    /* Already received - the ack might have been lost */
+    BRM_STATS_DEBUG_INC(BRM_STATS_DEBUG_SLIP_DUPLICATES);
+    dev->ack_pending = 1;
+    return 0;
+  } else {
+    BRM_STATS_DEBUG_INC(BRM_STATS_DEBUG_SLIP_OUT_OF_ORDER);
+    if(!dev->rx_gap) {
+      dev->rx_gap = 1;
+      dev->rx_gap_start = clock_time();
+      BRM_STATS_DEBUG_INC(BRM_STATS_DEBUG_SLIP_GAPS);
+      /* Report the gap directly to trigger a fast retransmit */
+      dev->gap_report = 1;
+      return 0;
+    }
+    if(clock_time() - dev->rx_gap_start < ENC_DEV_GAP_TIMEOUT) {
+      return 0;
+    }
+    /* The missing frames will not arrive - continue from this frame */
+    BRM_STATS_DEBUG_ADD(BRM_STATS_DEBUG_SLIP_LOST,
+                        (uint16_t)(seqno - next_seqno(dev->rx_seqno)));
+    LOG_LIMIT_ERROR("*** lost serial frames %u - %u from radio %u\n",
+                    next_seqno(dev->rx_seqno), seqno - 1, dev->index);
+  }
+
+  dev->rx_seqno = seqno;
+  dev->rx_gap = 0;
+  dev->rx_unacked++;
+  if(dev->rx_unacked >= ENC_DEV_ACK_FRAMES) {
+    dev->ack_pending = 1;
+  } else if(ctimer_expired(&dev->ack_timer)) {
+    ctimer_set(&dev->ack_timer, ENC_DEV_ACK_DELAY, ack_timeout, dev);
+  }
+  return 1;
+}
+#endif /* ENC_DEV_RELIABLE */
+/*---------------------------------------------------------------------------*/
+/*
+ * Deficit round robin over the traffic classes. Returns the queue to
+ * send from next, or NULL if all queues are empty. The deficit is
+ * charged when the packet is removed from the queue, which means the
+ * same queue is returned until then.
+ */
+static struct tx_queue *
+schedule(struct enc_dev *dev)
+{
+  struct tx_queue *q;
+  packet_t *p;
+  int i;
+
+  for(i = 0; i < ENC_DEV_TX_CLASSES; i++) {
+    if(list_head(dev->queues[i].packets) != NULL) {
+      break;
+    }
+  }
+  if(i == ENC_DEV_TX_CLASSES) {
+    return NULL;
+  }
+
+  for(;;) {
+    q = &dev->queues[dev->tx_class];
+    p = list_head(q->packets);
+    if(p == NULL) {
+      /* An idle class does not save its share for later */
+      q->deficit = 0;
+    } else if(p->len <= q->deficit) {
+      return q;
+    }
+    dev->tx_class = (dev->tx_class + 1) % ENC_DEV_TX_CLASSES;
+    dev->queues[dev->tx_class].deficit +=
+      tx_weights[dev->tx_class] * ENC_DEV_TX_QUANTUM;
+  }
+}
+/*---------------------------------------------------------------------------*/
+/* Returns the next packet to send without removing it */
+static packet_t *
+peek_packet(struct enc_dev *dev)
+{
+  struct tx_queue *q;
+  packet_t *p;
+
+#if ENC_DEV_RELIABLE
+  if(dev->gap_report) {
+    return &dev->ack_packet;
+  }
+  p = list_head(dev->retransmit_packets);
+  if(p != NULL) {
+    return p;
+  }
+#endif /* ENC_DEV_RELIABLE */
+
+  /* Receive reports are not sequenced and never wait */
+  p = list_head(dev->queues[ENC_DEV_TX_CONTROL].packets);
+  if(p != NULL && p->payload_type == SPARROW_ENCAP_PAYLOAD_RECEIVE_REPORT) {
+    return p;
+  }
+
+#if ENC_DEV_RELIABLE
+  if(is_reliable(dev) && dev->tx_outstanding >= ENC_DEV_WINDOW_SIZE) {
+    /* The window is full - wait for acks */
+    return dev->ack_pending ? &dev->ack_packet : NULL;
+  }
+#endif /* ENC_DEV_RELIABLE */
+
+  q = schedule(dev);
+  p = q != NULL ? list_head(q->packets) : NULL;
+
+#if ENC_DEV_RELIABLE
+  if(p == NULL && dev->ack_pending) {
+    return &dev->ack_packet;
+  }
+#endif /* ENC_DEV_RELIABLE */
+  return p;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Encode the packet attributes of a frame to send ("!S") in place.
+ * Returns the new length of the frame.
+ */
+static int
+encode_frame_atts(uint8_t *data, int len, int size)
+{
+  int n;
+
+  if(len < 3 || data[0] != '!' || data[1] != 'S') {
+    return len;
+  }
+  n = packetutils_encode_queued_atts(&data[3], len - 3, size - 3);
+  return n < 0 ? len : n + 3;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * The RDC queues frames with absolute attribute values. They are delta
+ * coded when the packet leaves its queue to be sent, since packets can
+ * be dropped from the queues and the delta coding must follow the
+ * frames as the serial radio receives them.
+ */
+static void
+encode_packet_atts(struct enc_dev *dev, packet_t *p)
+{
+#if ENC_DEV_AGGREGATE
+  uint8_t buf[ENC_DEV_AGGREGATE_MAX_SIZE];
+  uint8_t frame[ENC_DEV_AGGREGATE_MAX_SIZE];
+  const uint8_t *data;
+  size_t pos, len, data_len;
+  uint8_t payload_type;
+#endif /* ENC_DEV_AGGREGATE */
+
+  packetutils_set_atts_context(dev->index);
+
+  if(p->payload_type == SPARROW_ENCAP_PAYLOAD_SERIAL) {
+    p->len = encode_frame_atts(p->data, p->len, sizeof(p->data));
+  }
+
+#if ENC_DEV_AGGREGATE
+  if(p->payload_type == SPARROW_ENCAP_PAYLOAD_AGGREGATE) {
+    /* The sub frames may not grow since the aggregate is already full */
+    pos = len = 0;
+    while(sparrow_encap_aggregate_next(p->data, p->len, &pos, &payload_type,
+                                       &data, &data_len) > 0) {
+      memcpy(frame, data, data_len);
+      if(payload_type == SPARROW_ENCAP_PAYLOAD_SERIAL) {
+        data_len = encode_frame_atts(frame, data_len, data_len);
+      }
+      len = sparrow_encap_aggregate_add(buf, sizeof(buf), len, payload_type,
+                                        frame, data_len);
+    }
+    if(len > 0) {
+      memcpy(p->data, buf, len);
+      p->len = len;
+    }
+  }
+#endif /* ENC_DEV_AGGREGATE */
+}
+/*---------------------------------------------------------------------------*/
+/* Remove the packet returned by peek_packet() from its queue */
+static void
+dequeue_packet(struct enc_dev *dev, packet_t *p)
+{
+  struct enc_dev_class_stats *stats;
+  struct tx_queue *q;
+  unsigned long delay;
+#if BR_AQM
+  int i;
+#endif /* BR_AQM */
+
+#if ENC_DEV_RELIABLE
+  if(p == &dev->ack_packet) {
+    return;
+  }
+  if(p->seqno != 0) {
+    list_remove(dev->retransmit_packets, p);
+    return;
+  }
+#endif /* ENC_DEV_RELIABLE */
+
+  /*
+   * The class queues reorder the packets, so the attributes are delta
+   * coded only now. The deficit is then charged with the sent length.
+   */
+  encode_packet_atts(dev, p);
+
+  q = &dev->queues[p->tx_class];
+  list_remove(q->packets, p);
+  q->count--;
+  if(p->payload_type != SPARROW_ENCAP_PAYLOAD_RECEIVE_REPORT) {
+    q->deficit -= p->len;
+  }
+
+  stats = &dev->stats.tx_class[p->tx_class];
+  delay = (clock_time() - p->queued) * 1000 / CLOCK_SECOND;
+  stats->sent++;
+  stats->delay_total += delay;
+  if(delay > stats->delay_max) {
+    stats->delay_max = delay;
+  }
+
+#if BR_AQM
+  /* Each aggregated frame has been queued for its own time */
+  for(i = 0; i < p->flow_count; i++) {
+    br_aqm_sojourn(p->flow[i],
+                   (clock_time() - p->flow_queued[i]) * 1000 / CLOCK_SECOND,
+                   pending_count(dev));
+  }
+#endif /* BR_AQM */
+}
+/*---------------------------------------------------------------------------*/
+/* The packet has been written to serial */
+static void
+packet_sent(struct enc_dev *dev, packet_t *p)
+{
+#if ENC_DEV_RELIABLE
+  if(p == &dev->ack_packet) {
+    return;
+  }
+  if(p->seqno != 0) {
+    /* Keep until acked by the radio */
+    add_unacked(dev, p);
+    return;
+  }
+#endif /* ENC_DEV_RELIABLE */
+  free_packet(dev, p);
+}
+/*---------------------------------------------------------------------------*/
 #if 0
 static void *
 get_in_addr(struct sockaddr *sa)
@@ -348,6 +996,35 @@ enc_dev_set_tunnel(const struct enc_dev_tunnel *t)
   tunnel = t;
 }
 /*---------------------------------------------------------------------------*/
+int
+enc_dev_count(void)
+{
+  return dev_count;
+}
+/*---------------------------------------------------------------------------*/
+int
+enc_dev_get_radio(void)
+{
+  return current_dev->index;
+}
+/*---------------------------------------------------------------------------*/
+void
+enc_dev_set_control_version(int radio, uint32_t version)
+{
+  if(radio >= 0 && radio < dev_count) {
+    devs[radio].control_version = version;
+  }
+}
+/*---------------------------------------------------------------------------*/
+const struct enc_dev_stats *
+enc_dev_get_stats(int radio)
+{
+  if(radio >= 0 && radio < dev_count) {
+    return &devs[radio].stats;
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
 static int
 connect_to_server(const char *host, const char *port)
 {
@@ -425,27 +1102,78 @@ serial_packet_input(const uint8_t *data, int len)
   NETSTACK_RDC.input();
 }
 /*---------------------------------------------------------------------------*/
+static void
+serial_payload_input(struct enc_dev *dev, uint8_t payload_type,
+                     uint8_t *payload, int len)
+{
+  if(payload_type == SPARROW_ENCAP_PAYLOAD_SERIAL) {
+    BRM_STATS_INC(BRM_STATS_ENCAP_SERIAL);
+    /* Replies are sent to the radio that sent the command */
+    current_dev = dev;
+    if(payload[0] == '!') {
+      command_context = CMD_CONTEXT_RADIO;
+      cmd_input(payload, len);
+    } else if(payload[0] == '?') {
+      /* no queries expected over slip? */
+    } else {
+      if(br_config_verbose_output > 1) {
+        YLOG_DEBUG("Raw packet from serial of length %d\n", len);
+      }
+      serial_packet_input(payload, len);
+    }
+    current_dev = &devs[0];
+  } else if(payload_type == SPARROW_ENCAP_PAYLOAD_TLV && dev->index == 0) {
+    /* The OAM radio instances are proxied to the primary radio */
+    BRM_STATS_INC(BRM_STATS_ENCAP_TLV);
+    udp_cmd_process_tlv_from_radio(payload, len);
+  } else if(payload_type == SPARROW_ENCAP_PAYLOAD_RECEIVE_REPORT) {
+    /* Ignore reports */
+  } else {
+    BRM_STATS_INC(BRM_STATS_ENCAP_UNPROCESSED);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+serial_aggregate_input(struct enc_dev *dev, uint8_t *payload, int len)
+{
+  const uint8_t *data;
+  size_t pos, data_len;
+  uint8_t payload_type;
+  int status;
+
+  BRM_STATS_INC(BRM_STATS_ENCAP_AGGREGATE);
+  pos = 0;
+  while((status = sparrow_encap_aggregate_next(payload, len, &pos,
+                                               &payload_type, &data,
+                                               &data_len)) > 0) {
+    BRM_STATS_DEBUG_INC(BRM_STATS_DEBUG_SLIP_AGGREGATED_RECV);
+    serial_payload_input(dev, payload_type, (uint8_t *)data, data_len);
+  }
+  if(status < 0) {
+    BRM_STATS_INC(BRM_STATS_ENCAP_ERRORS);
+    LOG_LIMIT_ERROR("malformed aggregate from serial, len: %d, error: %d\n",
+                    len, status);
+  }
+}
+/*---------------------------------------------------------------------------*/
 /*
  * Read from serial, when we have a packet call serial_packet_input. No output
  * buffering, input buffered by the reader thread...
  */
 static void
-serial_input(void)
+serial_input(struct enc_dev *dev)
 {
-  /* the unslipped input buffer */
-  static unsigned char inbuf[ENC_DEV_BUFFER_SIZE];
-  static int inbufptr = 0;
-  static int state = 0;
+  unsigned char *inbuf = dev->inbuf;
   int i, enclen, j;
   sparrow_encap_pdu_info_t pinfo;
   int insize;
 
-  if(write_pos == read_pos) {
+  if(dev->write_pos == dev->read_pos) {
     /* nothing to read */
     PRINTF("Nothing to read...\n");
     return;
   }
-  insize = write_pos - read_pos;
+  insize = dev->write_pos - dev->read_pos;
   if(insize < 0) {
     /* Wrapped - add a BUF_SIZE */
     insize += INPUT_BUFFER_SIZE;
@@ -458,20 +1186,23 @@ serial_input(void)
   PRINTF("Reading: %d\n", insize);
 
   BRM_STATS_DEBUG_ADD(BRM_STATS_DEBUG_SLIP_RECV, insize);
+  dev->stats.recv_bytes += insize;
 
-  if(tunnel != NULL) {
+  if(tunnel != NULL && dev->index == 0) {
     if(tunnel->input) {
       /* tunnel->input(inputbuf[read_buf], bufsize[read_buf]); */
-      if(read_pos + insize > INPUT_BUFFER_SIZE) {
+      if(dev->read_pos + insize > INPUT_BUFFER_SIZE) {
         /* first read the end-part of the buffer */
-        tunnel->input(&input_buffer[read_pos], INPUT_BUFFER_SIZE - read_pos);
+        tunnel->input(&dev->input_buffer[dev->read_pos],
+                      INPUT_BUFFER_SIZE - dev->read_pos);
         /* then read the rest at the beginning */
-        tunnel->input(&input_buffer[0], insize - (INPUT_BUFFER_SIZE - read_pos));
+        tunnel->input(&dev->input_buffer[0],
+                      insize - (INPUT_BUFFER_SIZE - dev->read_pos));
       } else {
-        tunnel->input(&input_buffer[read_pos], insize);
+        tunnel->input(&dev->input_buffer[dev->read_pos], insize);
       }
       /* update the read_pos */
-      read_pos = (read_pos + insize) % INPUT_BUFFER_SIZE;
+      dev->read_pos = (dev->read_pos + insize) % INPUT_BUFFER_SIZE;
     }
     return;
   }
@@ -479,194 +1210,244 @@ serial_input(void)
   /* handle the data */
   for(j = 0; j < insize; j++) {
     /* step one step forward */
-    unsigned char c = input_buffer[read_pos];
-    read_pos = (read_pos + 1) % INPUT_BUFFER_SIZE;
-    switch(c) {
-    case SLIP_END:
-      state = 0;
-      if(inbufptr > 0) {
+    unsigned char c = dev->input_buffer[dev->read_pos];
+    dev->read_pos = (dev->read_pos + 1) % INPUT_BUFFER_SIZE;
+    if(slip_codec_decode(&dev->state, c, inbuf, &dev->inbufptr)) {
+      if(dev->inbufptr > 0) {
         BRM_STATS_DEBUG_INC(BRM_STATS_DEBUG_SLIP_FRAMES);
         /* debug line marker is the only one that goes without encap... */
         if(inbuf[0] == DEBUG_LINE_MARKER) {
-          YLOG_INFO("SR: ");
-          fwrite(inbuf + 1, inbufptr - 1, 1, stdout);
-          if(inbuf[inbufptr - 1] != '\n') {
+          if(dev->index == 0) {
+            YLOG_INFO("SR: ");
+          } else {
+            YLOG_INFO("SR%u: ", dev->index);
+          }
+          fwrite(inbuf + 1, dev->inbufptr - 1, 1, stdout);
+          if(inbuf[dev->inbufptr - 1] != '\n') {
             printf("\n");
           }
         } else {
           if(br_config_verbose_output > 4) {
-            printf("IN(%03u): ", inbufptr);
-            for(i = 0; i < inbufptr; i++) printf("%02x", inbuf[i]);
+            printf("IN%u(%03u): ", dev->index, dev->inbufptr);
+            for(i = 0; i < dev->inbufptr; i++) printf("%02x", inbuf[i]);
             printf("\n");
           }
 
-          BRM_STATS_ADD(BRM_STATS_ENCAP_RECV, inbufptr);
+          BRM_STATS_ADD(BRM_STATS_ENCAP_RECV, dev->inbufptr);
+          dev->stats.recv_frames++;
 
-          enclen = sparrow_encap_parse_and_verify(inbuf, inbufptr, &pinfo);
+          enclen = sparrow_encap_parse_and_verify(inbuf, dev->inbufptr, &pinfo);
           if(enclen <  0) {
             BRM_STATS_INC(BRM_STATS_ENCAP_ERRORS);
             if(br_config_verbose_output) {
               if(enclen == SPARROW_ENCAP_ERROR_BAD_CHECKSUM) {
                 YLOG_ERROR("packet input failed (bad CRC), len: %d, error: %d\n",
-                           inbufptr, enclen);
+                           dev->inbufptr, enclen);
               } else {
                 YLOG_ERROR("packet input failed, len: %d, error: %d\n",
-                           inbufptr, enclen);
+                           dev->inbufptr, enclen);
               }
 
               if(br_config_verbose_output > 1 && br_config_verbose_output < 5) {
-                for(i = 0; i < inbufptr; i++) printf("%02x", inbuf[i]);
+                for(i = 0; i < dev->inbufptr; i++) printf("%02x", inbuf[i]);
                 printf("\n");
               }
             }
 
             /* empty the input buffer and continue */
-            inbufptr = 0;
+            dev->inbufptr = 0;
             continue;
           }
 
           if(pinfo.fpmode == SPARROW_ENCAP_FP_MODE_LENOPT
              && pinfo.fplen == 4 && pinfo.fp
              && pinfo.fp[1] == SPARROW_ENCAP_FP_LENOPT_OPTION_SEQNO_CRC) {
-            /* Ignore the sequence number */
-            enclen += 4;
+#if ENC_DEV_RELIABLE
+            if(!handle_seqno(dev, &inbuf[enclen], pinfo.payload_type)) {
+              dev->inbufptr = 0;
+              continue;
+            }
+#endif /* ENC_DEV_RELIABLE */
+            enclen += SPARROW_ENCAP_SEQNO_LEN;
           }
 
-          if(pinfo.payload_type == SPARROW_ENCAP_PAYLOAD_SERIAL) {
-            BRM_STATS_INC(BRM_STATS_ENCAP_SERIAL);
-            if(inbuf[enclen] == '!') {
-              command_context = CMD_CONTEXT_RADIO;
-              cmd_input(&inbuf[enclen], pinfo.payload_len);
-            } else if(inbuf[enclen] == '?') {
-              /* no queries expected over slip? */
-            } else {
-              if(br_config_verbose_output > 1) {
-                YLOG_DEBUG("Raw packet from serial of length %d\n", inbufptr);
-              }
-              serial_packet_input(&inbuf[enclen], pinfo.payload_len);
-            }
-          } else if(pinfo.payload_type == SPARROW_ENCAP_PAYLOAD_TLV) {
-            BRM_STATS_INC(BRM_STATS_ENCAP_TLV);
-            udp_cmd_process_tlv_from_radio(&inbuf[enclen], pinfo.payload_len);
-          } else if(pinfo.payload_type == SPARROW_ENCAP_PAYLOAD_RECEIVE_REPORT) {
-	    /* Ignore reports */
+          if(pinfo.payload_type == SPARROW_ENCAP_PAYLOAD_AGGREGATE) {
+            serial_aggregate_input(dev, &inbuf[enclen], pinfo.payload_len);
           } else {
-            BRM_STATS_INC(BRM_STATS_ENCAP_UNPROCESSED);
+            serial_payload_input(dev, pinfo.payload_type, &inbuf[enclen],
+                                 pinfo.payload_len);
           }
         }
         /* empty the input buffer and continue */
-        inbufptr = 0;
-      }
-      break;
-
-    case SLIP_ESC:
-      state = SLIP_ESC;
-      break;
-    case SLIP_ESC_END:
-      if(state == SLIP_ESC) {
-        inbuf[inbufptr++] =  SLIP_END;
-        state = 0;
-      } else {
-        inbuf[inbufptr++] =  SLIP_ESC_END;
-      }
-      break;
-    case SLIP_ESC_ESC:
-      if(state == SLIP_ESC) {
-        inbuf[inbufptr++] = SLIP_ESC;
-        state = 0;
-      } else {
-        inbuf[inbufptr++] = SLIP_ESC_ESC;
+        dev->inbufptr = 0;
       }
-      break;
-
-    default:
-      inbuf[inbufptr++] = c;
-      state = 0;
-      break;
     }
 
-    if(inbufptr >= ENC_DEV_BUFFER_SIZE) {
+    if(dev->inbufptr >= ENC_DEV_BUFFER_SIZE) {
       /* slip buffer is full, drop everything */
       BRM_STATS_DEBUG_INC(BRM_STATS_DEBUG_SLIP_OVERFLOWS);
       LOG_LIMIT_ERROR("*** serial input buffer overflow\n");
-      inbufptr = 0;
-      state = 0;
+      dev->inbufptr = 0;
+      dev->state = 0;
     }
   }
-  if(write_pos != read_pos) {
+  if(dev->write_pos != dev->read_pos) {
     /* Still more to read */
     process_poll(&serial_input_process);
   }
 }
 /*---------------------------------------------------------------------------*/
+static int
+has_input(void)
+{
+  int i;
+  for(i = 0; i < dev_count; i++) {
+    if(devs[i].write_pos != devs[i].read_pos) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Number of packets waiting to be sent, including retransmissions */
+static long
+pending_count(struct enc_dev *dev)
+{
+  long count = 0;
+  int i;
+
+  for(i = 0; i < ENC_DEV_TX_CLASSES; i++) {
+    count += dev->queues[i].count;
+  }
+#if ENC_DEV_RELIABLE
+  count += list_length(dev->retransmit_packets);
+#endif /* ENC_DEV_RELIABLE */
+  return count;
+}
+/*---------------------------------------------------------------------------*/
+long
+enc_dev_buffered(int radio)
+{
+  if(radio >= 0 && radio < dev_count) {
+    return pending_count(&devs[radio]);
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+enc_dev_get_queued(int radio, int tx_class)
+{
+  if(radio >= 0 && radio < dev_count
+     && tx_class >= 0 && tx_class < ENC_DEV_TX_CLASSES) {
+    return devs[radio].queues[tx_class].count;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+const char *
+enc_dev_get_class_name(int tx_class)
+{
+  if(tx_class >= 0 && tx_class < ENC_DEV_TX_CLASSES) {
+    return tx_class_names[tx_class];
+  }
+  return "unknown";
+}
+/*---------------------------------------------------------------------------*/
 long
 slip_buffered(void)
 {
-  return list_length(pending_packets);
+  long buffered = 0;
+  int i;
+  for(i = 0; i < dev_count; i++) {
+    buffered += pending_count(&devs[i]);
+  }
+  return buffered;
 }
 /*---------------------------------------------------------------------------*/
 int
 slip_empty()
 {
-  return active_packet == NULL && list_head(pending_packets) == NULL;
+  int i;
+  for(i = 0; i < dev_count; i++) {
+    if(devs[i].active_packet != NULL || pending_count(&devs[i]) > 0) {
+      return 0;
+    }
+  }
+  return 1;
 }
 /*---------------------------------------------------------------------------*/
-void
-slip_flushbuf(int fd)
+static void
+slip_flushbuf(struct enc_dev *dev)
 {
-  /* Ensure the slip buffer will be large enough for worst case encoding */
-  static uint8_t slip_buf[PACKET_MAX_SIZE * 2];
-  static uint16_t slip_begin, slip_end = 0;
-
-  int i, n;
+  uint8_t buffer[PACKET_MAX_SIZE];
+  int i, n, len;
+#if ENC_DEV_RELIABLE
+  int is_new;
+#endif /* ENC_DEV_RELIABLE */
 
-  if(active_packet == NULL) {
+  if(dev->active_packet == NULL) {
 
-    if(slip_empty()) {
+    dev->active_packet = peek_packet(dev);
+    if(dev->active_packet == NULL) {
       /* Nothing to send */
       return;
     }
+    dequeue_packet(dev, dev->active_packet);
 
-    active_packet = list_pop(pending_packets);
-    if(active_packet == NULL) {
-      /* Nothing to send */
+    dev->slip_begin = dev->slip_end = 0;
+
+#if ENC_DEV_RELIABLE
+    /* The sequence number is only used if the packet can be encapsulated */
+    is_new = dev->active_packet->seqno == 0
+      && dev->active_packet->payload_type != SPARROW_ENCAP_PAYLOAD_RECEIVE_REPORT
+      && is_reliable(dev);
+    if(is_new) {
+      dev->active_packet->seqno = next_seqno(dev->tx_seqno);
+    }
+#endif /* ENC_DEV_RELIABLE */
+
+    len = encap_packet(dev, dev->active_packet, buffer, sizeof(buffer));
+    if(len == 0) {
+      LOG_LIMIT_ERROR("*** dropping packet to radio %u - failed to encap %u bytes\n",
+                      dev->index, dev->active_packet->len);
+#if ENC_DEV_RELIABLE
+      if(is_new) {
+        dev->active_packet->seqno = 0;
+      }
+      if(dev->active_packet != &dev->ack_packet)
+#endif /* ENC_DEV_RELIABLE */
+      {
+        free_packet(dev, dev->active_packet);
+      }
+      dev->active_packet = NULL;
       return;
     }
 
-    slip_begin = slip_end = 0;
+#if ENC_DEV_RELIABLE
+    if(is_new) {
+      dev->tx_seqno = dev->active_packet->seqno;
+      dev->tx_outstanding++;
+    }
+#endif /* ENC_DEV_RELIABLE */
+    dev->active_packet->transmissions++;
 
     if(br_config_verbose_output > 4) {
-      printf("OUT(%03u): ", active_packet->len);
-      for(i = 0; i < active_packet->len; i++) {
-        printf("%02x", active_packet->data[i]);
+      printf("OUT%u(%03u): ", dev->index, len);
+      for(i = 0; i < len; i++) {
+        printf("%02x", buffer[i]);
       }
       printf("\n");
     }
 
-    slip_buf[slip_end++] = SLIP_END;
-    for(i = 0; i < active_packet->len; i++) {
-      switch(active_packet->data[i]) {
-      case SLIP_END:
-        slip_buf[slip_end++] = SLIP_ESC;
-        slip_buf[slip_end++] = SLIP_ESC_END;
-        break;
-      case SLIP_ESC:
-        slip_buf[slip_end++] = SLIP_ESC;
-        slip_buf[slip_end++] = SLIP_ESC_ESC;
-        break;
-      default:
-        slip_buf[slip_end++] = active_packet->data[i];
-        break;
-      }
-    }
-    slip_buf[slip_end++] = SLIP_END;
+    dev->slip_end = slip_codec_encode(dev->slip_buf, buffer, len);
 
     if(br_config_verbose_output > 2) {
-      PRINTF("send %u/%u\n", slip_end, active_packet->len);
+      PRINTF("send %u/%u\n", dev->slip_end, len);
     }
   }
 
-  n = write(fd, slip_buf + slip_begin, slip_end - slip_begin);
+  n = write(dev->fd, dev->slip_buf + dev->slip_begin,
+            dev->slip_end - dev->slip_begin);
 
   if(n == -1) {
     if(errno == EAGAIN) {
@@ -677,53 +1458,49 @@ slip_flushbuf(int fd)
   } else {
 
     slip_sent_to_fd += n;
-    slip_begin += n;
-    if(slip_begin == slip_end) {
-      slip_begin = slip_end = 0;
+    dev->stats.sent_bytes += n;
+    dev->slip_begin += n;
+    if(dev->slip_begin == dev->slip_end) {
+      dev->slip_begin = dev->slip_end = 0;
       slip_sent++;
+      dev->stats.sent_frames++;
 
-      if(active_packet != NULL) {
-	/* This packet is no longer needed */
-	free_packet(active_packet);
-        active_packet = NULL;
+      if(dev->active_packet != NULL) {
+        packet_sent(dev, dev->active_packet);
+        dev->active_packet = NULL;
 
 	/* a delay between non acked slip packets to avoid losing data */
 	if(send_delay != 0) {
-	  ctimer_restart(&send_delay_timer);
+	  ctimer_restart(&dev->send_delay_timer);
 	}
       }
     }
   }
 }
 /*---------------------------------------------------------------------------*/
-static void
-write_to_serial(int outfd, const uint8_t *inbuf, int len, uint8_t payload_type)
+/*
+ * Write the encap header + payload + CRC32 of the packet to the buffer.
+ */
+static int
+encap_packet(struct enc_dev *dev, const packet_t *packet,
+             uint8_t *buffer, int size)
 {
-  const uint8_t *p = inbuf;
-  uint8_t *buffer;
   uint8_t finger[4];
   int enc_res;
   uint32_t crc_value;
   sparrow_encap_pdu_info_t pinfo;
-  packet_t *packet;
-
-  if(tunnel) {
-    /* In tunnel mode - only the tunnel can write to serial */
-    return;
-  }
+  int len = packet->len;
+  int seqno_len = 0;
 
-  packet = alloc_packet();
-  if(packet == NULL) {
-    /* alloc_packet will log the overflow */
-    return;
+#if ENC_DEV_RELIABLE
+  if(packet == &dev->ack_packet || packet->seqno != 0 || is_reliable(dev)) {
+    seqno_len = SPARROW_ENCAP_SEQNO_LEN;
   }
-
-  buffer = packet->data;
-
-  /* do encap header + CRC32 here!!! */
+#endif /* ENC_DEV_RELIABLE */
 
   finger[0] = 0;
-  finger[1] = SPARROW_ENCAP_FP_LENOPT_OPTION_CRC;
+  finger[1] = seqno_len > 0 ? SPARROW_ENCAP_FP_LENOPT_OPTION_SEQNO_CRC
+    : SPARROW_ENCAP_FP_LENOPT_OPTION_CRC;
   finger[2] = (len >> 8);
   finger[3] = len & 0xff;
 
@@ -731,37 +1508,154 @@ write_to_serial(int outfd, const uint8_t *inbuf, int len, uint8_t payload_type)
   pinfo.fp = finger;
   pinfo.iv = NULL;
   pinfo.payload_len = len;
-  pinfo.payload_type = payload_type;
+  pinfo.payload_type = packet->payload_type;
   pinfo.fpmode = SPARROW_ENCAP_FP_MODE_LENOPT;
   pinfo.fplen = 4;
   pinfo.ivmode = SPARROW_ENCAP_IVMODE_NONE;
   pinfo.ivlen = 0;
 
-  enc_res = sparrow_encap_write_header(buffer, PACKET_MAX_SIZE, &pinfo);
+  enc_res = sparrow_encap_write_header(buffer, size, &pinfo);
+  if(enc_res == 0 || enc_res + seqno_len + len + 4 > size) {
+    return 0;
+  }
 
-  if(enc_res) {
+#if ENC_DEV_RELIABLE
+  if(seqno_len > 0) {
+    buffer[enc_res++] = (packet->seqno >> 8) & 0xff;
+    buffer[enc_res++] = packet->seqno & 0xff;
+    buffer[enc_res++] = (dev->rx_seqno >> 8) & 0xff;
+    buffer[enc_res++] = dev->rx_seqno & 0xff;
+
+    /* The ack is sent with this frame */
+    dev->rx_unacked = 0;
+    dev->ack_pending = 0;
+    dev->gap_report = 0;
+    ctimer_stop(&dev->ack_timer);
+  }
+#endif /* ENC_DEV_RELIABLE */
 
-    /* copy the data into the buffer */
-    memcpy(buffer + enc_res, p, len);
+  /* copy the data into the buffer */
+  memcpy(buffer + enc_res, packet->data, len);
 
-    /* do a crc32 calculation of the whole message */
-    crc_value = crc32(buffer, len + enc_res);
+  /* do a crc32 calculation of the whole message */
+  crc_value = crc32(buffer, len + enc_res);
 
-    buffer[len + enc_res + 0] = (crc_value >> 0L) & 0xff;
-    buffer[len + enc_res + 1] = (crc_value >> 8L) & 0xff;
-    buffer[len + enc_res + 2] = (crc_value >> 16L) & 0xff;
-    buffer[len + enc_res + 3] = (crc_value >> 24L) & 0xff;
+  buffer[len + enc_res + 0] = (crc_value >> 0L) & 0xff;
+  buffer[len + enc_res + 1] = (crc_value >> 8L) & 0xff;
+  buffer[len + enc_res + 2] = (crc_value >> 16L) & 0xff;
+  buffer[len + enc_res + 3] = (crc_value >> 24L) & 0xff;
 
-    packet->len = len + enc_res + 4;
+  return len + enc_res + 4;
+}
+/*---------------------------------------------------------------------------*/
+#if ENC_DEV_AGGREGATE
+static int
+is_aggregation_supported(const struct enc_dev *dev)
+{
+  return control_version(dev) >= ENC_DEV_AGGREGATE_API_VERSION;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Add the payload to a packet that is waiting to be sent.
+ */
+static int
+aggregate_packet(packet_t *packet, const uint8_t *data, int len,
+                 uint8_t payload_type)
+{
+  size_t pos;
 
-    if(payload_type == SPARROW_ENCAP_PAYLOAD_RECEIVE_REPORT) {
-      /* Prioritize control messages */
-      list_push(pending_packets, packet);
-    } else {
-      list_add(pending_packets, packet);
+  if(packet->payload_type != SPARROW_ENCAP_PAYLOAD_AGGREGATE) {
+    /* Convert the waiting packet to an aggregate with one sub frame */
+    if(packet->len + SPARROW_ENCAP_AGGREGATE_HEADER_LEN * 2 + len
+       > ENC_DEV_AGGREGATE_MAX_SIZE) {
+      return 0;
     }
+    memmove(packet->data + SPARROW_ENCAP_AGGREGATE_HEADER_LEN,
+            packet->data, packet->len);
+    packet->data[0] = packet->payload_type;
+    packet->data[1] = (packet->len >> 8) & 0xff;
+    packet->data[2] = packet->len & 0xff;
+    packet->len += SPARROW_ENCAP_AGGREGATE_HEADER_LEN;
+    packet->payload_type = SPARROW_ENCAP_PAYLOAD_AGGREGATE;
+  }
+
+  pos = sparrow_encap_aggregate_add(packet->data, ENC_DEV_AGGREGATE_MAX_SIZE,
+                                    packet->len, payload_type, data, len);
+  if(pos == 0) {
+    return 0;
+  }
+  packet->len = pos;
+  BRM_STATS_DEBUG_INC(BRM_STATS_DEBUG_SLIP_AGGREGATED_SENT);
+  return 1;
+}
+#endif /* ENC_DEV_AGGREGATE */
+/*---------------------------------------------------------------------------*/
+/* Traffic class of packets not classified by the caller */
+static uint8_t
+get_tx_class(const uint8_t *buf, int len, uint8_t payload_type)
+{
+  if(payload_type == SPARROW_ENCAP_PAYLOAD_RECEIVE_REPORT
+     || payload_type == SPARROW_ENCAP_PAYLOAD_SERIAL) {
+    /* Radio commands and frames not sent via the RDC, such as beacons */
+    return ENC_DEV_TX_CONTROL;
+  }
+  if(len > ENC_DEV_TX_BULK_SIZE) {
+    return ENC_DEV_TX_BULK;
+  }
+  return ENC_DEV_TX_INTERACTIVE;
+}
+/*---------------------------------------------------------------------------*/
+static void
+write_to_serial(struct enc_dev *dev, const uint8_t *inbuf, int len,
+                uint8_t payload_type, uint8_t tx_class)
+{
+  packet_t *packet;
+
+  if(tunnel && dev->index == 0) {
+    /* In tunnel mode - only the tunnel can write to serial */
+    return;
+  }
+
+  if(len > sizeof(packet->data)) {
+    LOG_LIMIT_ERROR("*** too large packet to serial: %d bytes\n", len);
+    return;
+  }
+
+#if ENC_DEV_AGGREGATE
+  if(payload_type != SPARROW_ENCAP_PAYLOAD_RECEIVE_REPORT
+     && is_aggregation_supported(dev)) {
+    packet = list_tail(dev->queues[tx_class].packets);
+    if(packet != NULL
+       && packet->payload_type != SPARROW_ENCAP_PAYLOAD_RECEIVE_REPORT
+#if BR_AQM
+       && (br_aqm_get_flow() == BR_AQM_NO_FLOW
+           || packet->flow_count < ENC_DEV_AQM_FLOWS)
+#endif /* BR_AQM */
+       && aggregate_packet(packet, inbuf, len, payload_type)) {
+#if BR_AQM
+      add_flow(packet);
+#endif /* BR_AQM */
+      PROGRESS("a");
+      return;
+    }
+  }
+#endif /* ENC_DEV_AGGREGATE */
+
+  packet = alloc_packet(dev, tx_class);
+  if(packet == NULL) {
+    /* alloc_packet will log the overflow */
+    return;
+  }
+
+  memcpy(packet->data, inbuf, len);
+  packet->len = len;
+  packet->payload_type = payload_type;
+
+  if(payload_type == SPARROW_ENCAP_PAYLOAD_RECEIVE_REPORT) {
+    /* Prioritize control messages */
+    list_push(dev->queues[tx_class].packets, packet);
   } else {
-    free_packet(packet);
+    list_add(dev->queues[tx_class].packets, packet);
   }
   PROGRESS("t");
 }
@@ -770,16 +1664,37 @@ write_to_serial(int outfd, const uint8_t *inbuf, int len, uint8_t payload_type)
 void
 write_to_slip(const uint8_t *buf, int len)
 {
-  if(serialfd > 0) {
-    write_to_serial(serialfd, buf, len, SPARROW_ENCAP_PAYLOAD_SERIAL);
+  if(current_dev->fd > 0) {
+    write_to_serial(current_dev, buf, len, SPARROW_ENCAP_PAYLOAD_SERIAL,
+                    ENC_DEV_TX_CONTROL);
   }
 }
 /*---------------------------------------------------------------------------*/
 void
 write_to_slip_payload_type(const uint8_t *buf, int len, uint8_t payload_type)
 {
-  if(serialfd > 0) {
-    write_to_serial(serialfd, buf, len, payload_type);
+  if(current_dev->fd > 0) {
+    write_to_serial(current_dev, buf, len, payload_type,
+                    get_tx_class(buf, len, payload_type));
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+enc_dev_write(int radio, const uint8_t *buf, int len, uint8_t payload_type)
+{
+  enc_dev_write_class(radio, buf, len, payload_type,
+                      get_tx_class(buf, len, payload_type));
+}
+/*---------------------------------------------------------------------------*/
+void
+enc_dev_write_class(int radio, const uint8_t *buf, int len,
+                    uint8_t payload_type, uint8_t tx_class)
+{
+  if(tx_class >= ENC_DEV_TX_CLASSES) {
+    tx_class = ENC_DEV_TX_BULK;
+  }
+  if(radio >= 0 && radio < dev_count && devs[radio].fd > 0) {
+    write_to_serial(&devs[radio], buf, len, payload_type, tx_class);
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -834,17 +1749,27 @@ stty_telos(int fd)
 static int
 set_fd(fd_set *rset, fd_set *wset)
 {
-  if(tunnel != NULL) {
-    if(tunnel->has_output && tunnel->has_output()) {
-      FD_SET(serialfd, wset);
+  struct enc_dev *dev;
+  int i;
+
+  for(i = 0; i < dev_count; i++) {
+    dev = &devs[i];
+    if(dev->fd <= 0) {
+      continue;
     }
-    return 1;
-  }
 
-  /* Anything to flush? */
-  if(!slip_empty()
-     && (send_delay == 0 || ctimer_expired(&send_delay_timer))) {
-    FD_SET(serialfd, wset);
+    if(tunnel != NULL && i == 0) {
+      if(tunnel->has_output && tunnel->has_output()) {
+        FD_SET(dev->fd, wset);
+      }
+      continue;
+    }
+
+    /* Anything to flush? */
+    if((dev->active_packet != NULL || peek_packet(dev) != NULL)
+       && (send_delay == 0 || ctimer_expired(&dev->send_delay_timer))) {
+      FD_SET(dev->fd, wset);
+    }
   }
 
   return 1;
@@ -853,16 +1778,27 @@ set_fd(fd_set *rset, fd_set *wset)
 static void
 handle_fd(fd_set *rset, fd_set *wset)
 {
-  int ret, i;
+  struct enc_dev *dev;
+  int ret, i, d;
 
   /* Reading is handled by a pthread */
   /* if(serialfd > 0 && FD_ISSET(serialfd, rset)) { */
   /* } */
 
-  if(serialfd > 0 && FD_ISSET(serialfd, wset)) {
-    if(tunnel != NULL) {
+  /*
+   * The callback is registered for all serial radios and each radio
+   * is cleared after it has been handled.
+   */
+  for(d = 0; d < dev_count; d++) {
+    dev = &devs[d];
+    if(dev->fd <= 0 || !FD_ISSET(dev->fd, wset)) {
+      continue;
+    }
+    FD_CLR(dev->fd, wset);
+
+    if(tunnel != NULL && d == 0) {
       if(tunnel->output) {
-        ret = tunnel->output(serialfd);
+        ret = tunnel->output(dev->fd);
         if(ret == 0) {
           /* Serial connection has closed */
           YLOG_ERROR("*** serial connection closed.\n");
@@ -878,7 +1814,7 @@ handle_fd(fd_set *rset, fd_set *wset)
         }
       }
     } else {
-      slip_flushbuf(serialfd);
+      slip_flushbuf(dev);
     }
   }
 }
@@ -886,11 +1822,54 @@ handle_fd(fd_set *rset, fd_set *wset)
 /*---------------------------------------------------------------------------*/
 static const struct select_callback slip_callback = { set_fd, handle_fd };
 /*---------------------------------------------------------------------------*/
+static void
+init_dev(struct enc_dev *dev, int index)
+{
+  int i;
+
+  memset(dev, 0, sizeof(struct enc_dev));
+  dev->fd = -1;
+  dev->index = index;
+  for(i = 0; i < ENC_DEV_TX_CLASSES; i++) {
+    LIST_STRUCT_INIT(&dev->queues[i], packets);
+  }
+  /* The first round starts with the most urgent class */
+  dev->queues[0].deficit = tx_weights[0] * ENC_DEV_TX_QUANTUM;
+#if ENC_DEV_RELIABLE
+  LIST_STRUCT_INIT(dev, retransmit_packets);
+  LIST_STRUCT_INIT(dev, unacked_packets);
+  dev->ack_packet.payload_type = SPARROW_ENCAP_PAYLOAD_RECEIVE_REPORT;
+#endif /* ENC_DEV_RELIABLE */
+}
+/*---------------------------------------------------------------------------*/
+/* Open an additional serial radio */
+static void
+open_dev(struct enc_dev *dev, const struct br_config_radio *radio)
+{
+  if(radio->host != NULL) {
+    dev->fd = connect_to_server(radio->host, radio->port);
+    if(dev->fd == -1) {
+      err(1, "can't connect to ``%s:%s''", radio->host, radio->port);
+    }
+    YLOG_INFO("******** radio %u opened to ``%s:%s''\n", dev->index,
+              radio->host, radio->port);
+  } else {
+    dev->fd = devopen(radio->siodev, O_RDWR | O_NDELAY);
+    if(dev->fd == -1) {
+      err(1, "can't open siodev ``/dev/%s''", radio->siodev);
+    }
+    YLOG_INFO("******** radio %u started on ``/dev/%s''\n", dev->index,
+              radio->siodev);
+    stty_telos(dev->fd);
+  }
+}
+/*---------------------------------------------------------------------------*/
 void
 enc_dev_init(void)
 {
   static uint8_t is_initialized = 0;
-  int rc;
+  struct enc_dev *dev;
+  int i, rc;
 
   if(is_initialized) {
     return;
@@ -898,7 +1877,10 @@ enc_dev_init(void)
   is_initialized = 1;
 
   memb_init(&packet_memb);
-  list_init(pending_packets);
+  for(i = 0; i < BR_MAX_RADIOS; i++) {
+    init_dev(&devs[i], i);
+  }
+  dev = &devs[0];
 
   setvbuf(stdout, NULL, _IOLBF, 0); /* Line buffered output. */
 
@@ -906,8 +1888,8 @@ enc_dev_init(void)
     if(br_config_port == NULL) {
       br_config_port = "60001";
     }
-    serialfd = connect_to_server(br_config_host, br_config_port);
-    if(serialfd == -1) {
+    dev->fd = connect_to_server(br_config_host, br_config_port);
+    if(dev->fd == -1) {
       err(1, "can't connect to ``%s:%s''", br_config_host, br_config_port);
     }
 
@@ -916,8 +1898,8 @@ enc_dev_init(void)
       /* Disable slip */
       return;
     }
-    serialfd = devopen(br_config_siodev, O_RDWR | O_NDELAY);
-    if(serialfd == -1) {
+    dev->fd = devopen(br_config_siodev, O_RDWR | O_NDELAY);
+    if(dev->fd == -1) {
       err(1, "can't open siodev ``/dev/%s''", br_config_siodev);
     }
 
@@ -925,28 +1907,35 @@ enc_dev_init(void)
     static const char *siodevs[] = {
       "ttyUSB0", "ttyACM0", "ttyACM1", "cuaU0", "ucom0" /* linux, fbsd6, fbsd5 */
     };
-    int i;
     for(i = 0; i < sizeof(siodevs) / sizeof(const char *); i++) {
       br_config_siodev = siodevs[i];
-      serialfd = devopen(br_config_siodev, O_RDWR | O_NDELAY);
-      if(serialfd != -1) {
+      dev->fd = devopen(br_config_siodev, O_RDWR | O_NDELAY);
+      if(dev->fd != -1) {
         break;
       }
     }
-    if(serialfd == -1) {
+    if(dev->fd == -1) {
       err(1, "can't open siodev");
     }
   }
 
   /* will only be for the write */
-  select_set_callback(serialfd, &slip_callback);
+  select_set_callback(dev->fd, &slip_callback);
 
   if(br_config_host != NULL) {
     YLOG_INFO("******** opened to ``%s:%s''\n", br_config_host,
               br_config_port);
   } else {
     YLOG_INFO("******** started on ``/dev/%s''\n", br_config_siodev);
-    stty_telos(serialfd);
+    stty_telos(dev->fd);
+  }
+
+  /* Additional serial radios - one per PAN */
+  for(i = 0; i < br_config_radio_count; i++) {
+    dev = &devs[dev_count];
+    open_dev(dev, &br_config_radios[i]);
+    select_set_callback(dev->fd, &slip_callback);
+    dev_count++;
   }
 
   if(br_config_siodev_delay > 0) {
@@ -957,10 +1946,12 @@ enc_dev_init(void)
 
   process_start(&serial_input_process, NULL);
 
-  rc = pthread_create(&thread, NULL, read_code, NULL);
-  if(rc) {
-    YLOG_ERROR("failed to start the serial reader thread: %d\n", rc);
-    exit(EXIT_FAILURE);
+  for(i = 0; i < dev_count; i++) {
+    rc = pthread_create(&devs[i].thread, NULL, read_code, &devs[i]);
+    if(rc) {
+      YLOG_ERROR("failed to start the serial reader thread: %d\n", rc);
+      exit(EXIT_FAILURE);
+    }
   }
 }
 /*---------------------------------------------------------------------------*/
@@ -968,10 +1959,14 @@ PROCESS(serial_input_process, "Input Process");
 
 PROCESS_THREAD(serial_input_process, ev, data)
 {
+  int i;
+
   PROCESS_BEGIN();
   while(1) {
-    PROCESS_WAIT_EVENT_UNTIL(write_pos != read_pos);
-    serial_input();
+    PROCESS_WAIT_EVENT_UNTIL(has_input());
+    for(i = 0; i < dev_count; i++) {
+      serial_input(&devs[i]);
+    }
   }
   PROCESS_END();
 }
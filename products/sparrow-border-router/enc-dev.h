@@ -40,6 +40,7 @@
 #define ENC_DEV_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 /*
  * Returns TRUE if connected with a remote serial radio and FALSE otherwise.
@@ -54,4 +55,54 @@ struct enc_dev_tunnel {
 
 void enc_dev_set_tunnel(const struct enc_dev_tunnel *t);
 
+/*
+ * Packets to the serial radio are queued per traffic class and the
+ * queues share the serial line by weighted scheduling. Lower classes
+ * are more urgent.
+ */
+#define ENC_DEV_TX_CONTROL      0
+#define ENC_DEV_TX_INTERACTIVE  1
+#define ENC_DEV_TX_BULK         2
+#define ENC_DEV_TX_CLASSES      3
+
+/* Serial TX statistics per traffic class */
+struct enc_dev_class_stats {
+  unsigned long sent;
+  unsigned long dropped;
+  /* Time from queued until first sent, in milliseconds */
+  unsigned long delay_total;
+  unsigned long delay_max;
+};
+
+/* Serial statistics per radio */
+struct enc_dev_stats {
+  unsigned long sent_frames;
+  unsigned long sent_bytes;
+  unsigned long recv_frames;
+  unsigned long recv_bytes;
+  unsigned long dropped;
+  unsigned int max_buffer_usage;
+  struct enc_dev_class_stats tx_class[ENC_DEV_TX_CLASSES];
+};
+
+/*
+ * The border router can serve several PANs using one serial radio
+ * per PAN. Radio 0 is the primary radio that also provides the
+ * link-layer address of the border router.
+ */
+int enc_dev_count(void);
+
+/* Returns the radio that sent the command currently being processed */
+int enc_dev_get_radio(void);
+
+void enc_dev_write(int radio, const uint8_t *buf, int len, uint8_t payload_type);
+/* Write a packet classified by the caller */
+void enc_dev_write_class(int radio, const uint8_t *buf, int len,
+                         uint8_t payload_type, uint8_t tx_class);
+void enc_dev_set_control_version(int radio, uint32_t version);
+long enc_dev_buffered(int radio);
+int enc_dev_get_queued(int radio, int tx_class);
+const char *enc_dev_get_class_name(int tx_class);
+const struct enc_dev_stats *enc_dev_get_stats(int radio);
+
 #endif /* ENC_DEV_H_ */
@@ -61,6 +61,8 @@ typedef enum {
 #define VARIABLE_BRM_STAT_DATA 0x109
 #define VARIABLE_BRM_COMMAND 0x10a
 #define VARIABLE_BRM_RPL_DAG_VERSION 0x10b
+#define VARIABLE_BRM_INSTRUMENT_LENGTH 0x10c
+#define VARIABLE_BRM_INSTRUMENT_DATA 0x10d
 
 #define INSTANCE_BRM_DEBUG 1
 
@@ -82,6 +84,8 @@ static const sparrow_oam_variable_t instance_brm_variables[] = {
   { 0x109,  4, SPARROW_OAM_WRITABILITY_RO, SPARROW_OAM_FORMAT_ARRAY  , SPARROW_OAM_VECTOR_DEPTH_DONT_CHECK }, /* VARIABLE_BRM_STAT_DATA */
   { 0x10a,  4, SPARROW_OAM_WRITABILITY_WO, SPARROW_OAM_FORMAT_INTEGER,  0 }, /* VARIABLE_BRM_COMMAND */
   { 0x10b,  4, SPARROW_OAM_WRITABILITY_RO, SPARROW_OAM_FORMAT_INTEGER,  0 }, /* VARIABLE_BRM_RPL_DAG_VERSION */
+  { 0x10c,  4, SPARROW_OAM_WRITABILITY_RO, SPARROW_OAM_FORMAT_INTEGER,  0 }, /* VARIABLE_BRM_INSTRUMENT_LENGTH */
+  { 0x10d,  4, SPARROW_OAM_WRITABILITY_RO, SPARROW_OAM_FORMAT_ARRAY  , SPARROW_OAM_VECTOR_DEPTH_DONT_CHECK }, /* VARIABLE_BRM_INSTRUMENT_DATA */
 
 #if INSTANCE_BRM_DEBUG
   { 0x200,  4, SPARROW_OAM_WRITABILITY_RO, SPARROW_OAM_FORMAT_INTEGER,  0 }, /* VARIABLE_BRM_STAT_DEBUG_LENGTH */
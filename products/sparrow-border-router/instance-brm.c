@@ -54,8 +54,10 @@ static uint32_t radio_bootloader_version;
 static uint64_t radio_capabilities;
 static char radio_sw_revision[16];
 
-uint32_t brm_stats[BRM_STATS_MAX];
-uint32_t brm_stats_debug[BRM_STATS_DEBUG_MAX];
+INSTRUMENT_GROUP(brm_stats, INSTRUMENT_TYPE_COUNTERS,
+                 INSTRUMENT_ID_BRM, BRM_STATS_MAX);
+INSTRUMENT_GROUP(brm_stats_debug, INSTRUMENT_TYPE_COUNTERS,
+                 INSTRUMENT_ID_BRM_DEBUG, BRM_STATS_DEBUG_MAX);
 
 /*---------------------------------------------------------------------------*/
 uint32_t
@@ -94,6 +96,27 @@ instance_brm_set_radio_sw_revision(const char *revision)
   strncpy(radio_sw_revision, revision, sizeof(radio_sw_revision) - 1);
 }
 /*---------------------------------------------------------------------------*/
+static size_t
+write_reply_values(sparrow_tlv_t *request, uint8_t *reply, size_t len,
+                   const uint32_t *data, int count, uint8_t to_network)
+{
+  uint32_t values[MAX(BRM_STATS_MAX, BRM_STATS_DEBUG_MAX)];
+
+  if(request->opcode != SPARROW_TLV_OPCODE_VECTOR_GET_REQUEST) {
+    return sparrow_tlv_write_reply_error(request, SPARROW_TLV_ERROR_NO_VECTOR_ACCESS, reply, len);
+  }
+  if(request->offset >= count) {
+    request->elements = 0;
+  } else {
+    request->elements = MIN(request->elements, (count - request->offset));
+  }
+  if(to_network) {
+    instrument_copy_to_network(values, data, count);
+    data = values;
+  }
+  return sparrow_tlv_write_reply_vector(request, reply, len, (const uint8_t *)data);
+}
+/*---------------------------------------------------------------------------*/
 /**
  * Process a request TLV.
  *
@@ -193,17 +216,8 @@ brm_process_request(const sparrow_oam_instance_t *instance,
     }
 
     if(request->variable == VARIABLE_BRM_STAT_DATA) {
-      if(request->opcode == SPARROW_TLV_OPCODE_VECTOR_GET_REQUEST) {
-        if(request->offset >= BRM_STATS_MAX ) {
-          request->elements = 0;
-        } else {
-          request->elements = MIN(request->elements, (BRM_STATS_MAX - request->offset));
-        }
-        return sparrow_tlv_write_reply_vector(request, reply, len, ((uint8_t *)brm_stats));
-
-      } else {
-        return sparrow_tlv_write_reply_error(request, SPARROW_TLV_ERROR_NO_VECTOR_ACCESS, reply, len);
-      }
+      return write_reply_values(request, reply, len, brm_stats_values,
+                                BRM_STATS_MAX, 1);
     }
 
     if(request->variable == VARIABLE_BRM_RPL_DAG_VERSION) {
@@ -228,27 +242,40 @@ brm_process_request(const sparrow_oam_instance_t *instance,
 
 #ifdef VARIABLE_BRM_STAT_DEBUG_DATA
     if(request->variable == VARIABLE_BRM_STAT_DEBUG_DATA) {
-      if(request->opcode == SPARROW_TLV_OPCODE_VECTOR_GET_REQUEST) {
-        if(request->offset >= BRM_STATS_DEBUG_MAX ) {
-          request->elements = 0;
-        } else {
-          request->elements = MIN(request->elements, (BRM_STATS_DEBUG_MAX - request->offset));
-        }
-        return sparrow_tlv_write_reply_vector(request, reply, len, ((uint8_t *)brm_stats_debug));
-
-      } else {
-        return sparrow_tlv_write_reply_error(request, SPARROW_TLV_ERROR_NO_VECTOR_ACCESS, reply, len);
-      }
+      return write_reply_values(request, reply, len, brm_stats_debug_values,
+                                BRM_STATS_DEBUG_MAX, 1);
     }
 #endif /* VARIABLE_BRM_STAT_DEBUG_DATA */
 
+    if(request->variable == VARIABLE_BRM_INSTRUMENT_LENGTH) {
+      /* Take a new snapshot to be read from VARIABLE_BRM_INSTRUMENT_DATA */
+      local32 = instrument_snapshot_update();
+      return sparrow_tlv_write_reply32int(request, reply, len, local32);
+    }
+
+    if(request->variable == VARIABLE_BRM_INSTRUMENT_DATA) {
+      const uint32_t *snapshot;
+      int words;
+      snapshot = instrument_snapshot_get(&words);
+      /* The snapshot is already in network byte order */
+      return write_reply_values(request, reply, len, snapshot, words, 0);
+    }
+
     return sparrow_tlv_write_reply_error(request, SPARROW_TLV_ERROR_UNKNOWN_VARIABLE, reply, len);
   }
   return sparrow_tlv_write_reply_error(request, SPARROW_TLV_ERROR_UNKNOWN_OP_CODE, reply, len);
 }
 /*---------------------------------------------------------------------------*/
+static void
+init(const sparrow_oam_instance_t *instance)
+{
+  instrument_register(&brm_stats_debug);
+  instrument_register(&brm_stats);
+}
+/*---------------------------------------------------------------------------*/
 SPARROW_OAM_INSTANCE(instance_brm,
                      INSTANCE_BRM_OBJECT_TYPE, INSTANCE_BRM_LABEL,
                      instance_brm_variables,
+                     .init = init,
                      .process_request = brm_process_request);
 /*---------------------------------------------------------------------------*/
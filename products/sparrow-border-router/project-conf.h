@@ -47,7 +47,7 @@
 #define CLOCK_USE_RELATIVE_TIME 1
 #endif
 
-#define SELECT_CONF_MAX 16
+#define SELECT_CONF_MAX 32
 
 #ifndef RF_CHANNEL
 #define RF_CHANNEL 26
@@ -76,6 +76,11 @@
 #undef SICSLOWPAN_CONF_REASS_CONTEXTS
 #define SICSLOWPAN_CONF_REASS_CONTEXTS   16
 
+/* Queue and pace outgoing fragments per next hop */
+#define SICSLOWPAN_CONF_FRAG_QUEUE                1
+#define SICSLOWPAN_CONF_FRAG_QUEUE_NBRS           16
+#define SICSLOWPAN_CONF_FRAG_QUEUE_DATAGRAMS      16
+
 #undef UIP_CONF_BUFFER_SIZE
 #define UIP_CONF_BUFFER_SIZE    1280
 
@@ -110,6 +115,16 @@
 #undef UIP_CONF_DS6_ROUTE_NBU
 #define UIP_CONF_DS6_ROUTE_NBU 2500
 
+/* Serial radios served by one border router, each with its own PAN */
+#define BR_CONF_MAX_RADIOS 4
+
+/* Separate packet attribute delta coding per serial radio */
+#define PACKETUTILS_CONF_ATTS_CONTEXTS BR_CONF_MAX_RADIOS
+
+/* A link-local and a global address per radio */
+#undef UIP_CONF_DS6_ADDR_NBU
+#define UIP_CONF_DS6_ADDR_NBU (2 * BR_CONF_MAX_RADIOS)
+
 /* used by wpcap (see /cpu/native/net/wpcap-drv.c) */
 #define SELECT_CALLBACK 1
 
@@ -126,7 +141,7 @@
 #define RADIO_INSTANCES 3
 #define SPARROW_OAM_INSTANCE0_NAME instance_br
 
-#define BORDER_ROUTER_CONTROL_API_VERSION 3
+#define BORDER_ROUTER_CONTROL_API_VERSION 6
 
 /*
  * Set the radio watchdog in seconds as long as unit controller is
@@ -151,6 +166,19 @@
 
 #define LATENCY_STATISTICS 1
 
+/* Per neighbor and per channel link statistics */
+#define INSTRUMENT_CONF_LINK_STATS 1
+#define INSTRUMENT_CONF_LINK_NBRS  32
+/* Count each frame on the channel of the serial radio that handled it */
+#define INSTRUMENT_CONF_LINK_CHANNEL br_radios_get_current_channel
+
+/* Learn and distribute 6LoWPAN contexts for external prefixes */
+#define BR_CONTEXTS 1
+#define SICSLOWPAN_CONF_CONTEXT_STATS 1
+
+/* CoDel per destination for packets from the tun interface */
+#define BR_AQM 1
+
 #if LLSEC_CONF_LEVEL
 #undef LLSEC802154_CONF_ENABLED
 #define LLSEC802154_CONF_ENABLED          1
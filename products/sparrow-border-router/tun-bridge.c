@@ -66,6 +66,12 @@
 #if LATENCY_STATISTICS
 #include "latency-stats.h"
 #endif
+#if BR_CONTEXTS
+#include "br-contexts.h"
+#endif
+#if BR_AQM
+#include "br-aqm.h"
+#endif
 
 #include <err.h>
 #include "net/netstack.h"
@@ -269,6 +275,9 @@ output(void)
 #if LATENCY_STATISTICS
     latency_stats_handle_packet(&uip_buf[UIP_LLH_LEN], uip_len, LATENCY_STATISTICS_FROM_PAN);
 #endif /* LATENCY_STATISTICS */
+#if BR_CONTEXTS
+    br_contexts_handle_packet(&uip_buf[UIP_LLH_LEN], uip_len, BR_CONTEXTS_FROM_PAN);
+#endif /* BR_CONTEXTS */
     return tun_output(&uip_buf[UIP_LLH_LEN], uip_len);
   }
   return 0;
@@ -307,9 +316,22 @@ handle_fd(fd_set *rset, fd_set *wset)
 #if LATENCY_STATISTICS
       latency_stats_handle_packet(&uip_buf[UIP_LLH_LEN], size, LATENCY_STATISTICS_TO_PAN);
 #endif
+#if BR_CONTEXTS
+      br_contexts_handle_packet(&uip_buf[UIP_LLH_LEN], size, BR_CONTEXTS_TO_PAN);
+#endif /* BR_CONTEXTS */
+
+#if BR_AQM
+      if(!br_aqm_input()) {
+        uip_clear_buf();
+        return;
+      }
+#endif /* BR_AQM */
 
       PRINTF("TUN data incoming read:%d PROCESS\n", size);
       tcpip_input();
+#if BR_AQM
+      br_aqm_input_done();
+#endif /* BR_AQM */
     }
   }
 }
@@ -47,6 +47,7 @@
 #include "serial-radio-stats.h"
 #include "dev/radio-802154-dev.h"
 #include "sparrow-encap.h"
+#include "lib/instrument.h"
 #include "enc-net.h"
 #include <stdio.h>
 
@@ -74,6 +75,112 @@ static int debug_frame = 0;
 
 static uint16_t slip_fragment_delay = 1000;
 static uint16_t slip_fragment_size = 62;
+
+/*
+ * Frames to the border router are aggregated into one encap frame
+ * when supported by the border router. A frame is held back at most
+ * ENC_NET_AGGREGATE_LATENCY clock ticks waiting for more frames. With
+ * no latency, only frames generated before the next process poll are
+ * aggregated.
+ */
+#ifdef ENC_NET_CONF_AGGREGATE
+#define ENC_NET_AGGREGATE ENC_NET_CONF_AGGREGATE
+#else
+#define ENC_NET_AGGREGATE 1
+#endif
+
+#ifdef ENC_NET_CONF_AGGREGATE_LATENCY
+#define ENC_NET_AGGREGATE_LATENCY ENC_NET_CONF_AGGREGATE_LATENCY
+#else
+#define ENC_NET_AGGREGATE_LATENCY 0
+#endif
+
+#ifdef ENC_NET_CONF_AGGREGATE_MAX_SIZE
+#define ENC_NET_AGGREGATE_MAX_SIZE ENC_NET_CONF_AGGREGATE_MAX_SIZE
+#else
+#define ENC_NET_AGGREGATE_MAX_SIZE 256
+#endif
+
+/* Border router API version with support for aggregate payloads */
+#define ENC_NET_AGGREGATE_API_VERSION 4
+
+#if ENC_NET_AGGREGATE
+static uint8_t aggregate_buffer[ENC_NET_AGGREGATE_MAX_SIZE];
+static uint16_t aggregate_len;
+static uint8_t aggregate_count;
+#if ENC_NET_AGGREGATE_LATENCY > 0
+static struct ctimer aggregate_timer;
+#endif /* ENC_NET_AGGREGATE_LATENCY > 0 */
+PROCESS(enc_net_aggregate_process, "Encap aggregate");
+#endif /* ENC_NET_AGGREGATE */
+
+/*
+ * Frames to the border router are sequenced and kept until acked when
+ * supported by the border router. Unacked frames are sent again after
+ * a timeout or directly when the border router reports a gap. Frames
+ * larger than a window slot, or sent when the window is full, are sent
+ * without sequence number.
+ */
+#ifdef ENC_NET_CONF_RELIABLE
+#define ENC_NET_RELIABLE ENC_NET_CONF_RELIABLE
+#else
+#define ENC_NET_RELIABLE 1
+#endif
+
+#ifdef ENC_NET_CONF_WINDOW_SIZE
+#define ENC_NET_WINDOW_SIZE ENC_NET_CONF_WINDOW_SIZE
+#else
+#define ENC_NET_WINDOW_SIZE 4
+#endif
+
+#ifdef ENC_NET_CONF_WINDOW_SLOT_SIZE
+#define ENC_NET_WINDOW_SLOT_SIZE ENC_NET_CONF_WINDOW_SLOT_SIZE
+#else
+#define ENC_NET_WINDOW_SLOT_SIZE 256
+#endif
+
+/* Frames are written directly to the UART and acked within the ack delay */
+#ifdef ENC_NET_CONF_RETRANSMIT_TIMEOUT
+#define ENC_NET_RETRANSMIT_TIMEOUT ENC_NET_CONF_RETRANSMIT_TIMEOUT
+#else
+#define ENC_NET_RETRANSMIT_TIMEOUT (CLOCK_SECOND / 10)
+#endif
+
+#define ENC_NET_MAX_TRANSMISSIONS 8
+#define ENC_NET_ACK_DELAY         (CLOCK_SECOND / 50)
+/* Number of received frames before an ack is sent without delay */
+#define ENC_NET_ACK_FRAMES        2
+/* Max time to wait for missing frames before continuing after a gap */
+#define ENC_NET_GAP_TIMEOUT       (CLOCK_SECOND / 2)
+
+/* Border router API version with support for sequenced frames */
+#define ENC_NET_RELIABLE_API_VERSION 5
+
+#if ENC_NET_RELIABLE
+typedef struct {
+  uint16_t seqno;
+  uint16_t len;
+  uint8_t payload_type;
+  uint8_t transmissions;
+  uint8_t data[ENC_NET_WINDOW_SLOT_SIZE];
+} window_slot_t;
+
+static window_slot_t window[ENC_NET_WINDOW_SIZE];
+/* The oldest unacked frame */
+static uint8_t window_head;
+static uint8_t window_count;
+static uint16_t tx_seqno;
+static uint8_t fast_retransmit;
+static struct ctimer retransmit_timer;
+/* Last frame received in order - sent as ack */
+static uint16_t rx_seqno;
+static uint8_t rx_unacked;
+static uint8_t rx_gap;
+static clock_time_t rx_gap_start;
+static struct ctimer ack_timer;
+
+static int handle_seqno(const uint8_t *field, uint8_t payload_type);
+#endif /* ENC_NET_RELIABLE */
 /*---------------------------------------------------------------------------*/
 #define WRITE_STATUS_OK 1
 
@@ -128,6 +235,18 @@ slip_frame_start(void)
   return WRITE_STATUS_OK;
 }
 /*---------------------------------------------------------------------------*/
+void
+enc_net_reset_sequence(void)
+{
+#if ENC_NET_RELIABLE
+  /* The border router starts a new sequence after the version request */
+  rx_seqno = 0;
+  rx_unacked = 0;
+  rx_gap = 0;
+  ctimer_stop(&ack_timer);
+#endif /* ENC_NET_RELIABLE */
+}
+/*---------------------------------------------------------------------------*/
 static int
 slip_frame_end(void)
 {
@@ -191,6 +310,9 @@ encnet_init(void)
   slip_arch_init(BAUD2UBR(115200));
   process_start(&slip_process, NULL);
   slip_set_input_callback(enc_net_input);
+#if ENC_NET_AGGREGATE
+  process_start(&enc_net_aggregate_process, NULL);
+#endif /* ENC_NET_AGGREGATE */
 }
 /*---------------------------------------------------------------------------*/
 static int
@@ -222,6 +344,40 @@ send_to_slip(const uint8_t *buf, int len)
 }
 /*---------------------------------------------------------------------------*/
 static void
+aggregate_input(sparrow_encap_pdu_info_t *pinfo, uint8_t *payload, int enclen)
+{
+  sparrow_encap_pdu_info_t sub;
+  const uint8_t *data;
+  size_t pos, data_len;
+  uint8_t payload_type;
+  int status;
+
+  SERIAL_RADIO_STATS_INC(SERIAL_RADIO_STATS_ENCAP_AGGREGATE);
+  pos = 0;
+  while((status = sparrow_encap_aggregate_next(payload + enclen,
+                                               pinfo->payload_len, &pos,
+                                               &payload_type, &data,
+                                               &data_len)) > 0) {
+    SERIAL_RADIO_STATS_DEBUG_INC(SERIAL_RADIO_STATS_DEBUG_SLIP_AGGREGATED_RECV);
+    if(payload_type == SPARROW_ENCAP_PAYLOAD_RECEIVE_REPORT) {
+      /* Ignore any reports */
+      continue;
+    }
+    sub = *pinfo;
+    sub.payload_type = payload_type;
+    sub.payload_len = data_len;
+    serial_radio_input(&sub, payload, data - payload);
+  }
+  if(status < 0) {
+    if(verbose_output) {
+      printf("Aggregate input failed: %d (len:%u)\n", status,
+             (unsigned)pinfo->payload_len);
+    }
+    SERIAL_RADIO_STATS_INC(SERIAL_RADIO_STATS_ENCAP_ERRORS);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
 enc_net_input(void)
 {
   int payload_len, enclen;
@@ -275,8 +431,12 @@ enc_net_input(void)
   if(pinfo.fpmode == SPARROW_ENCAP_FP_MODE_LENOPT
      && pinfo.fplen == 4 && pinfo.fp
      && pinfo.fp[1] == SPARROW_ENCAP_FP_LENOPT_OPTION_SEQNO_CRC) {
-    /* Ignore the packet sequence number */
-    enclen += 4;
+#if ENC_NET_RELIABLE
+    if(!handle_seqno(payload + enclen, pinfo.payload_type)) {
+      return;
+    }
+#endif /* ENC_NET_RELIABLE */
+    enclen += SPARROW_ENCAP_SEQNO_LEN;
   }
 
   if(pinfo.payload_type == SPARROW_ENCAP_PAYLOAD_RECEIVE_REPORT) {
@@ -284,6 +444,11 @@ enc_net_input(void)
     return;
   }
 
+  if(pinfo.payload_type == SPARROW_ENCAP_PAYLOAD_AGGREGATE) {
+    aggregate_input(&pinfo, payload, enclen);
+    return;
+  }
+
   /* Pass the packet over to the serial radio */
   serial_radio_input(&pinfo, payload, enclen);
 }
@@ -294,8 +459,9 @@ enc_net_send_packet(const uint8_t *ptr, int len)
   enc_net_send_packet_payload_type(ptr, len, SPARROW_ENCAP_PAYLOAD_SERIAL);
 }
 /*---------------------------------------------------------------------------*/
-void
-enc_net_send_packet_payload_type(const uint8_t *ptr, int len, uint8_t payload_type)
+static void
+send_frame(const uint8_t *ptr, int len, uint8_t payload_type,
+           uint16_t seqno, int seqno_len)
 {
   uint8_t buffer[len + 68];
   uint8_t finger[4];
@@ -304,7 +470,8 @@ enc_net_send_packet_payload_type(const uint8_t *ptr, int len, uint8_t payload_ty
   sparrow_encap_pdu_info_t pinfo;
 
   finger[0] = 0;
-  finger[1] = SPARROW_ENCAP_FP_LENOPT_OPTION_CRC;
+  finger[1] = seqno_len > 0 ? SPARROW_ENCAP_FP_LENOPT_OPTION_SEQNO_CRC
+    : SPARROW_ENCAP_FP_LENOPT_OPTION_CRC;
   finger[2] = (len >> 8);
   finger[3] = len & 0xff;
 
@@ -325,14 +492,29 @@ enc_net_send_packet_payload_type(const uint8_t *ptr, int len, uint8_t payload_ty
     return;
   }
 
-  if(len + enc_res + 4 > sizeof(buffer)) {
+  if(len + enc_res + seqno_len + 4 > sizeof(buffer)) {
     /* Too large packet */
     printf("Too large packet to send - hdr %u, len %u\n", enc_res, len);
     return;
   }
 
+#if ENC_NET_RELIABLE
+  if(seqno_len > 0) {
+    buffer[enc_res++] = (seqno >> 8) & 0xff;
+    buffer[enc_res++] = seqno & 0xff;
+    buffer[enc_res++] = (rx_seqno >> 8) & 0xff;
+    buffer[enc_res++] = rx_seqno & 0xff;
+
+    /* The ack is sent with this frame */
+    rx_unacked = 0;
+    ctimer_stop(&ack_timer);
+  }
+#endif /* ENC_NET_RELIABLE */
+
   /* copy the data into the buffer */
-  memcpy(buffer + enc_res, ptr, len);
+  if(len > 0) {
+    memcpy(buffer + enc_res, ptr, len);
+  }
 
   len += enc_res;
 
@@ -355,9 +537,319 @@ enc_net_send_packet_payload_type(const uint8_t *ptr, int len, uint8_t payload_ty
   }
 }
 /*---------------------------------------------------------------------------*/
+#if ENC_NET_RELIABLE
+static uint16_t
+next_seqno(uint16_t seqno)
+{
+  seqno++;
+  return seqno == 0 ? 1 : seqno;
+}
+/*---------------------------------------------------------------------------*/
+/* Returns non-zero if sequence number a is before or equal to b */
+static int
+seqno_before_eq(uint16_t a, uint16_t b)
+{
+  return (uint16_t)(b - a) < 0x8000;
+}
+/*---------------------------------------------------------------------------*/
+static int
+is_reliable(void)
+{
+  /* The border router supports sequenced frames if it sends them */
+  return border_router_api_version >= ENC_NET_RELIABLE_API_VERSION
+    || rx_seqno != 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+send_ack(void)
+{
+  send_frame(NULL, 0, SPARROW_ENCAP_PAYLOAD_RECEIVE_REPORT,
+             0, SPARROW_ENCAP_SEQNO_LEN);
+}
+/*---------------------------------------------------------------------------*/
+static void
+ack_timeout(void *ptr)
+{
+  if(rx_unacked > 0) {
+    send_ack();
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Free the oldest window slot, when acked or given up. Aggregated
+ * frames might be waiting for the window to open.
+ */
+static void
+release_window_head(void)
+{
+  window_head = (window_head + 1) % ENC_NET_WINDOW_SIZE;
+  window_count--;
+#if ENC_NET_AGGREGATE
+  if(aggregate_count > 0) {
+    process_poll(&enc_net_aggregate_process);
+  }
+#endif /* ENC_NET_AGGREGATE */
+}
+/*---------------------------------------------------------------------------*/
+static void
+retransmit_timeout(void *ptr)
+{
+  window_slot_t *slot;
+  int i;
+
+  /* Give up on frames sent too many times - the border router will continue */
+  while(window_count > 0
+        && window[window_head].transmissions >= ENC_NET_MAX_TRANSMISSIONS) {
+    SERIAL_RADIO_STATS_DEBUG_INC(SERIAL_RADIO_STATS_DEBUG_SLIP_RETRANSMIT_FAILED);
+    release_window_head();
+  }
+
+  /* Go back N - send all unacked frames again */
+  for(i = 0; i < window_count; i++) {
+    slot = &window[(window_head + i) % ENC_NET_WINDOW_SIZE];
+    slot->transmissions++;
+    SERIAL_RADIO_STATS_DEBUG_INC(SERIAL_RADIO_STATS_DEBUG_SLIP_RETRANSMITS);
+    send_frame(slot->data, slot->len, slot->payload_type,
+               slot->seqno, SPARROW_ENCAP_SEQNO_LEN);
+  }
+
+  if(window_count > 0) {
+    ctimer_set(&retransmit_timer, ENC_NET_RETRANSMIT_TIMEOUT,
+               retransmit_timeout, NULL);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+handle_ack(uint16_t ack, int is_report)
+{
+  int acked = 0;
+
+  if(ack == 0) {
+    /* Nothing received yet */
+    return;
+  }
+
+  while(window_count > 0 && seqno_before_eq(window[window_head].seqno, ack)) {
+    release_window_head();
+    acked++;
+  }
+
+  if(acked > 0) {
+    fast_retransmit = 0;
+    if(window_count > 0) {
+      ctimer_restart(&retransmit_timer);
+    } else {
+      ctimer_stop(&retransmit_timer);
+    }
+  } else if(is_report && !fast_retransmit && window_count > 0
+            && window[window_head].seqno == next_seqno(ack)) {
+    /* A report still waiting for the first unacked frame means it was lost */
+    fast_retransmit = 1;
+    SERIAL_RADIO_STATS_DEBUG_INC(SERIAL_RADIO_STATS_DEBUG_SLIP_FAST_RETRANSMITS);
+    retransmit_timeout(NULL);
+  }
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Handle the sequence number and ack of a received frame. Returns
+ * non-zero if the payload should be processed.
+ */
+static int
+handle_seqno(const uint8_t *field, uint8_t payload_type)
+{
+  uint16_t seqno, ack;
+
+  seqno = ((uint16_t)field[0] << 8) | field[1];
+  ack = ((uint16_t)field[2] << 8) | field[3];
+
+  handle_ack(ack, seqno == 0
+             && payload_type == SPARROW_ENCAP_PAYLOAD_RECEIVE_REPORT);
+
+  if(seqno == 0) {
+    /* Not sequenced */
+    return 1;
+  }
+
+  if(rx_seqno == 0 || seqno == next_seqno(rx_seqno)) {
+    /* First frame since the version request or next frame in order */
+  } else if(seqno_before_eq(seqno, rx_seqno)) {
+    /* Already received - the ack might have been lost */
+    SERIAL_RADIO_STATS_DEBUG_INC(SERIAL_RADIO_STATS_DEBUG_SLIP_DUPLICATES);
+    send_ack();
+    return 0;
+  } else {
+    SERIAL_RADIO_STATS_DEBUG_INC(SERIAL_RADIO_STATS_DEBUG_SLIP_OUT_OF_ORDER);
+    if(!rx_gap) {
+      rx_gap = 1;
+      rx_gap_start = clock_time();
+      SERIAL_RADIO_STATS_DEBUG_INC(SERIAL_RADIO_STATS_DEBUG_SLIP_GAPS);
+      /* Report the gap directly to trigger a fast retransmit */
+      send_ack();
+      return 0;
+    }
+    if(clock_time() - rx_gap_start < ENC_NET_GAP_TIMEOUT) {
+      return 0;
+    }
+    /* The missing frames will not arrive - continue from this frame */
+    SERIAL_RADIO_STATS_DEBUG_ADD(SERIAL_RADIO_STATS_DEBUG_SLIP_LOST,
+                                 (uint16_t)(seqno - next_seqno(rx_seqno)));
+    if(verbose_output) {
+      printf("Lost serial frames %u - %u\n", next_seqno(rx_seqno), seqno - 1);
+    }
+  }
+
+  rx_seqno = seqno;
+  rx_gap = 0;
+  rx_unacked++;
+  if(rx_unacked >= ENC_NET_ACK_FRAMES) {
+    send_ack();
+  } else if(ctimer_expired(&ack_timer)) {
+    ctimer_set(&ack_timer, ENC_NET_ACK_DELAY, ack_timeout, NULL);
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+is_window_full(void)
+{
+  return is_reliable() && window_count >= ENC_NET_WINDOW_SIZE;
+}
+#endif /* ENC_NET_RELIABLE */
+/*---------------------------------------------------------------------------*/
+static void
+send_encap(const uint8_t *ptr, int len, uint8_t payload_type)
+{
+#if ENC_NET_RELIABLE
+  window_slot_t *slot;
+
+  if(is_reliable()) {
+    if(payload_type == SPARROW_ENCAP_PAYLOAD_RECEIVE_REPORT) {
+      send_frame(ptr, len, payload_type, 0, SPARROW_ENCAP_SEQNO_LEN);
+      return;
+    }
+    if(len > ENC_NET_WINDOW_SLOT_SIZE || window_count >= ENC_NET_WINDOW_SIZE) {
+      /* Not possible to send again - only carries the ack */
+      SERIAL_RADIO_STATS_DEBUG_INC(SERIAL_RADIO_STATS_DEBUG_SLIP_UNSEQUENCED);
+      send_frame(ptr, len, payload_type, 0, SPARROW_ENCAP_SEQNO_LEN);
+      return;
+    }
+
+    slot = &window[(window_head + window_count) % ENC_NET_WINDOW_SIZE];
+    window_count++;
+    tx_seqno = next_seqno(tx_seqno);
+    slot->seqno = tx_seqno;
+    slot->len = len;
+    slot->payload_type = payload_type;
+    slot->transmissions = 1;
+    memcpy(slot->data, ptr, len);
+    if(ctimer_expired(&retransmit_timer)) {
+      ctimer_set(&retransmit_timer, ENC_NET_RETRANSMIT_TIMEOUT,
+                 retransmit_timeout, NULL);
+    }
+    send_frame(slot->data, slot->len, slot->payload_type,
+               slot->seqno, SPARROW_ENCAP_SEQNO_LEN);
+    return;
+  }
+#endif /* ENC_NET_RELIABLE */
+  send_frame(ptr, len, payload_type, 0, 0);
+}
+/*---------------------------------------------------------------------------*/
+#if ENC_NET_AGGREGATE
+/*
+ * Send the aggregated frames. Unless forced, the frames are kept while
+ * the window is full and sent when acks have been received.
+ */
+static void
+aggregate_flush(int force)
+{
+#if ENC_NET_RELIABLE
+  if(!force && aggregate_count > 0 && is_window_full()) {
+    return;
+  }
+#endif /* ENC_NET_RELIABLE */
+
+  if(aggregate_count == 1) {
+    /* A single frame is sent as is */
+    send_encap(&aggregate_buffer[SPARROW_ENCAP_AGGREGATE_HEADER_LEN],
+               aggregate_len - SPARROW_ENCAP_AGGREGATE_HEADER_LEN,
+               aggregate_buffer[0]);
+  } else if(aggregate_count > 1) {
+    SERIAL_RADIO_STATS_DEBUG_ADD(SERIAL_RADIO_STATS_DEBUG_SLIP_AGGREGATED_SENT,
+                                 aggregate_count);
+    send_encap(aggregate_buffer, aggregate_len,
+               SPARROW_ENCAP_PAYLOAD_AGGREGATE);
+  }
+  aggregate_len = 0;
+  aggregate_count = 0;
+}
+/*---------------------------------------------------------------------------*/
+#if ENC_NET_AGGREGATE_LATENCY > 0
+static void
+aggregate_timeout(void *ptr)
+{
+  aggregate_flush(0);
+}
+#endif /* ENC_NET_AGGREGATE_LATENCY > 0 */
+/*---------------------------------------------------------------------------*/
+static int
+aggregate_add(const uint8_t *ptr, int len, uint8_t payload_type)
+{
+  if(SPARROW_ENCAP_AGGREGATE_HEADER_LEN + len > sizeof(aggregate_buffer)) {
+    /* Too large to aggregate */
+    aggregate_flush(1);
+    return 0;
+  }
+
+  if(aggregate_len + SPARROW_ENCAP_AGGREGATE_HEADER_LEN + len
+     > sizeof(aggregate_buffer)) {
+    aggregate_flush(1);
+  }
+
+  aggregate_len = sparrow_encap_aggregate_add(aggregate_buffer,
+                                              sizeof(aggregate_buffer),
+                                              aggregate_len, payload_type,
+                                              ptr, len);
+  aggregate_count++;
+  if(aggregate_count == 1) {
+#if ENC_NET_AGGREGATE_LATENCY > 0
+    ctimer_set(&aggregate_timer, ENC_NET_AGGREGATE_LATENCY,
+               aggregate_timeout, NULL);
+#else
+    process_poll(&enc_net_aggregate_process);
+#endif /* ENC_NET_AGGREGATE_LATENCY > 0 */
+  }
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(enc_net_aggregate_process, ev, data)
+{
+  PROCESS_BEGIN();
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_POLL);
+    aggregate_flush(0);
+  }
+  PROCESS_END();
+}
+#endif /* ENC_NET_AGGREGATE */
+/*---------------------------------------------------------------------------*/
+void
+enc_net_send_packet_payload_type(const uint8_t *ptr, int len, uint8_t payload_type)
+{
+#if ENC_NET_AGGREGATE
+  if(border_router_api_version >= ENC_NET_AGGREGATE_API_VERSION
+     && aggregate_add(ptr, len, payload_type)) {
+    return;
+  }
+#endif /* ENC_NET_AGGREGATE */
+  send_encap(ptr, len, payload_type);
+}
+/*---------------------------------------------------------------------------*/
 static void
 encnet_input(void)
 {
+  INSTRUMENT_LINK_RX(packetbuf_addr(PACKETBUF_ADDR_SENDER),
+                     (int8_t)packetbuf_attr(PACKETBUF_ATTR_RSSI));
+
   if(border_router_api_version < 3) {
     /* old style */
     int i;
@@ -392,19 +884,15 @@ encnet_input(void)
 #endif
     uip_buf[0] = '!';
     uip_buf[1] = 'S';
-    pos = packetutils_serialize_atts(&uip_buf[2], UIP_BUFSIZE - 2);
-    uip_len = 2 + pos + packetbuf_datalen();
+    pos = packetutils_serialize_packetbuf(&uip_buf[2], UIP_BUFSIZE - 2);
 
     if(pos < 0) {
       if(verbose_output > 1) {
-        PRINTF("slip-net: failed to serialize atts\n");
-      }
-    } else if(uip_len > UIP_BUFSIZE) {
-      if(verbose_output > 1) {
-        PRINTF("slip-net: too large packet: %d\n", uip_len);
+        PRINTF("slip-net: failed to serialize packet: %d\n",
+               packetbuf_totlen());
       }
     } else {
-      packetbuf_copyto(&uip_buf[pos + 2]);
+      uip_len = 2 + pos;
 
       if(verbose_output > 1) {
         printf("Slipnet got input of len: %d, total out: %d\n",
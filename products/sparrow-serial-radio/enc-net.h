@@ -43,6 +43,9 @@
 void enc_net_set_fragment_size(uint16_t size);
 void enc_net_set_fragment_delay(uint16_t delay);
 
+/* Accept the next sequenced frame from the border router as the first */
+void enc_net_reset_sequence(void);
+
 void enc_net_send_packet(const uint8_t *ptr, int len);
 void enc_net_send_packet_payload_type(const uint8_t *ptr, int len,
                                       uint8_t payload_type);
@@ -1,7 +1,7 @@
 
 /*--------------------------------------------------------------------*/
 /* Sparrow OAM Instance - DO NOT EDIT - automatically generated file. */
-/* Generated by instance-gen.py on 2016-06-30 17:39:03.               */
+/* Generated by instance-gen.py on 2026-10-19 04:53:32.               */
 /*--------------------------------------------------------------------*/
 
 /*
@@ -86,6 +86,8 @@ typedef enum {
 #define VARIABLE_RADIO_UNIT_BOOT_TIMER   0x200
 #define VARIABLE_RADIO_STAT_DEBUG_LENGTH 0x201
 #define VARIABLE_RADIO_STAT_DEBUG_DATA   0x202
+#define VARIABLE_RADIO_INSTRUMENT_LENGTH 0x203
+#define VARIABLE_RADIO_INSTRUMENT_DATA   0x204
 
 static const sparrow_oam_variable_t instance_radio_variables[] = {
 { 0x100,  4, SPARROW_OAM_WRITABILITY_RW, SPARROW_OAM_FORMAT_INTEGER,  0 },
@@ -107,6 +109,8 @@ static const sparrow_oam_variable_t instance_radio_variables[] = {
 { 0x200,  8, SPARROW_OAM_WRITABILITY_RO, SPARROW_OAM_FORMAT_INTEGER,  0 },
 { 0x201,  4, SPARROW_OAM_WRITABILITY_RO, SPARROW_OAM_FORMAT_INTEGER,  0 },
 { 0x202,  4, SPARROW_OAM_WRITABILITY_RO, SPARROW_OAM_FORMAT_ARRAY,    SPARROW_OAM_VECTOR_DEPTH_DONT_CHECK },
+{ 0x203,  4, SPARROW_OAM_WRITABILITY_RO, SPARROW_OAM_FORMAT_INTEGER,  0 },
+{ 0x204,  4, SPARROW_OAM_WRITABILITY_RO, SPARROW_OAM_FORMAT_ARRAY,    SPARROW_OAM_VECTOR_DEPTH_DONT_CHECK },
 };
 
 #endif /* INSTANCE_RADIO_VAR_H_ */
@@ -50,8 +50,10 @@
 #include <stdio.h>
 #include "instance-radio-var.h"
 
-uint32_t serial_radio_stats[SERIAL_RADIO_STATS_MAX];
-uint32_t serial_radio_stats_debug[SERIAL_RADIO_STATS_DEBUG_MAX];
+INSTRUMENT_GROUP(serial_radio_stats, INSTRUMENT_TYPE_COUNTERS,
+                 INSTRUMENT_ID_SERIAL_RADIO, SERIAL_RADIO_STATS_MAX);
+INSTRUMENT_GROUP(serial_radio_stats_debug, INSTRUMENT_TYPE_COUNTERS,
+                 INSTRUMENT_ID_SERIAL_RADIO_DEBUG, SERIAL_RADIO_STATS_DEBUG_MAX);
 static uint16_t reset_info = 0;
 
 #ifdef WITH_868
@@ -72,6 +74,27 @@ radio_get_reset_cause(void)
   return reset_info;
 }
 /*----------------------------------------------------------------*/
+static size_t
+write_reply_values(sparrow_tlv_t *request, uint8_t *reply, size_t len,
+                   const uint32_t *data, int count, uint8_t to_network)
+{
+  uint32_t values[MAX(SERIAL_RADIO_STATS_MAX, SERIAL_RADIO_STATS_DEBUG_MAX)];
+
+  if(request->opcode != SPARROW_TLV_OPCODE_VECTOR_GET_REQUEST) {
+    return sparrow_tlv_write_reply_error(request, SPARROW_TLV_ERROR_NO_VECTOR_ACCESS, reply, len);
+  }
+  if(request->offset >= count) {
+    request->elements = 0;
+  } else {
+    request->elements = MIN(request->elements, (count - request->offset));
+  }
+  if(to_network) {
+    instrument_copy_to_network(values, data, count);
+    data = values;
+  }
+  return sparrow_tlv_write_reply_vector(request, reply, len, (const uint8_t *)data);
+}
+/*----------------------------------------------------------------*/
 /**
  * Process a request TLV.
  *
@@ -285,16 +308,8 @@ radio_process_request(const sparrow_oam_instance_t *instance,
 
 #ifdef VARIABLE_RADIO_STAT_DATA
     if(request->variable == VARIABLE_RADIO_STAT_DATA) {
-      if(request->opcode == SPARROW_TLV_OPCODE_VECTOR_GET_REQUEST) {
-        if(request->offset >= SERIAL_RADIO_STATS_MAX) {
-          request->elements = 0;
-        } else {
-          request->elements = MIN(request->elements, (SERIAL_RADIO_STATS_MAX - request->offset));
-        }
-        return sparrow_tlv_write_reply_vector(request, reply, len, ((uint8_t *)serial_radio_stats));
-      } else {
-        return sparrow_tlv_write_reply_error(request, SPARROW_TLV_ERROR_NO_VECTOR_ACCESS, reply, len);
-      }
+      return write_reply_values(request, reply, len, serial_radio_stats_values,
+                                SERIAL_RADIO_STATS_MAX, 1);
     }
 #endif /* VARIABLE_RADIO_STAT_DATA */
 
@@ -385,19 +400,29 @@ radio_process_request(const sparrow_oam_instance_t *instance,
 
 #ifdef VARIABLE_RADIO_STAT_DEBUG_DATA
     if(request->variable == VARIABLE_RADIO_STAT_DEBUG_DATA) {
-      if(request->opcode == SPARROW_TLV_OPCODE_VECTOR_GET_REQUEST) {
-        if(request->offset >= SERIAL_RADIO_STATS_DEBUG_MAX) {
-          request->elements = 0;
-        } else {
-          request->elements = MIN(request->elements, (SERIAL_RADIO_STATS_DEBUG_MAX - request->offset));
-        }
-        return sparrow_tlv_write_reply_vector(request, reply, len, ((uint8_t *)serial_radio_stats_debug));
-      } else {
-        return sparrow_tlv_write_reply_error(request, SPARROW_TLV_ERROR_NO_VECTOR_ACCESS, reply, len);
-      }
+      return write_reply_values(request, reply, len, serial_radio_stats_debug_values,
+                                SERIAL_RADIO_STATS_DEBUG_MAX, 1);
     }
 #endif /* VARIABLE_RADIO_STAT_DEBUG_DATA */
 
+#ifdef VARIABLE_RADIO_INSTRUMENT_LENGTH
+    if(request->variable == VARIABLE_RADIO_INSTRUMENT_LENGTH) {
+      /* Take a new snapshot to be read from VARIABLE_RADIO_INSTRUMENT_DATA */
+      local32 = instrument_snapshot_update();
+      return sparrow_tlv_write_reply32int(request, reply, len, local32);
+    }
+#endif /* VARIABLE_RADIO_INSTRUMENT_LENGTH */
+
+#ifdef VARIABLE_RADIO_INSTRUMENT_DATA
+    if(request->variable == VARIABLE_RADIO_INSTRUMENT_DATA) {
+      const uint32_t *snapshot;
+      int words;
+      snapshot = instrument_snapshot_get(&words);
+      /* The snapshot is already in network byte order */
+      return write_reply_values(request, reply, len, snapshot, words, 0);
+    }
+#endif /* VARIABLE_RADIO_INSTRUMENT_DATA */
+
     return sparrow_tlv_write_reply_error(request, SPARROW_TLV_ERROR_UNKNOWN_VARIABLE, reply, len);
   }
 
@@ -409,6 +434,9 @@ init(const sparrow_oam_instance_t *instance)
 {
   instance->data->event_array[1] = 1;
 
+  instrument_register(&serial_radio_stats_debug);
+  instrument_register(&serial_radio_stats);
+
   if(reset_info == 0) {
     reset_info = SPARROW_DEVICE.get_reset_cause();
     reset_info <<= 8;
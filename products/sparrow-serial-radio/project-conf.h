@@ -129,6 +129,10 @@
 #define PRODUCT_TYPE_INT64 0x0090DA0301010482ULL
 #define PRODUCT_LABEL "Serial Radio"
 
-#define SERIAL_RADIO_CONTROL_API_VERSION 3L
+#define SERIAL_RADIO_CONTROL_API_VERSION 6L
+
+/* Per neighbor and per channel link statistics */
+#define INSTRUMENT_CONF_LINK_STATS 1
+#define INSTRUMENT_CONF_LINK_NBRS  8
 
 #endif /* PROJECT_CONF_H_ */
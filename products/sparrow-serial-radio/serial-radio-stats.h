@@ -39,6 +39,7 @@
 #define SERIAL_RADIO_STATS_H_
 
 #include "contiki-conf.h"
+#include "lib/instrument.h"
 
 enum {
   SERIAL_RADIO_STATS_ENCAP_RECV,
@@ -46,23 +47,16 @@ enum {
   SERIAL_RADIO_STATS_ENCAP_SERIAL,
   SERIAL_RADIO_STATS_ENCAP_UNPROCESSED,
   SERIAL_RADIO_STATS_ENCAP_ERRORS,
+  SERIAL_RADIO_STATS_ENCAP_AGGREGATE,
 
   SERIAL_RADIO_STATS_MAX
 };
 
-extern uint32_t serial_radio_stats[];
+INSTRUMENT_DECLARE(serial_radio_stats);
 
-#define SERIAL_RADIO_STATS_INC(x) do {                                  \
-    uint32_t tmp_radio_stats = ntohl(serial_radio_stats[x]);            \
-    tmp_radio_stats++;                                                  \
-    serial_radio_stats[x] = htonl(tmp_radio_stats);                     \
-  } while(0)
-#define SERIAL_RADIO_STATS_ADD(x, y) do {                               \
-    uint32_t tmp_radio_stats = ntohl(serial_radio_stats[x]);            \
-    tmp_radio_stats += y;                                               \
-    serial_radio_stats[x] = htonl(tmp_radio_stats);                     \
-  } while(0)
-#define SERIAL_RADIO_STATS_GET(x) (ntohl(serial_radio_stats[x]))
+#define SERIAL_RADIO_STATS_INC(x)    INSTRUMENT_INC(serial_radio_stats, x)
+#define SERIAL_RADIO_STATS_ADD(x, y) INSTRUMENT_ADD(serial_radio_stats, x, y)
+#define SERIAL_RADIO_STATS_GET(x)    INSTRUMENT_GET(serial_radio_stats, x)
 
 enum {
   SERIAL_RADIO_STATS_DEBUG_SLIP_RECV,
@@ -70,22 +64,24 @@ enum {
   SERIAL_RADIO_STATS_DEBUG_SLIP_DROPPED,
   SERIAL_RADIO_STATS_DEBUG_SLIP_OVERFLOWS,
   SERIAL_RADIO_STATS_DEBUG_SLIP_ERRORS,
+  SERIAL_RADIO_STATS_DEBUG_SLIP_AGGREGATED_SENT,
+  SERIAL_RADIO_STATS_DEBUG_SLIP_AGGREGATED_RECV,
+  SERIAL_RADIO_STATS_DEBUG_SLIP_RETRANSMITS,
+  SERIAL_RADIO_STATS_DEBUG_SLIP_FAST_RETRANSMITS,
+  SERIAL_RADIO_STATS_DEBUG_SLIP_RETRANSMIT_FAILED,
+  SERIAL_RADIO_STATS_DEBUG_SLIP_OUT_OF_ORDER,
+  SERIAL_RADIO_STATS_DEBUG_SLIP_DUPLICATES,
+  SERIAL_RADIO_STATS_DEBUG_SLIP_GAPS,
+  SERIAL_RADIO_STATS_DEBUG_SLIP_LOST,
+  SERIAL_RADIO_STATS_DEBUG_SLIP_UNSEQUENCED,
 
   SERIAL_RADIO_STATS_DEBUG_MAX
 };
 
-extern uint32_t serial_radio_stats_debug[];
+INSTRUMENT_DECLARE(serial_radio_stats_debug);
 
-#define SERIAL_RADIO_STATS_DEBUG_INC(x) do {                            \
-    uint32_t tmp_radio_stats = ntohl(serial_radio_stats_debug[x]);      \
-    tmp_radio_stats++;                                                  \
-    serial_radio_stats_debug[x] = htonl(tmp_radio_stats);               \
-  } while(0)
-#define SERIAL_RADIO_STATS_DEBUG_ADD(x, y) do {                         \
-    uint32_t tmp_radio_stats = ntohl(serial_radio_stats_debug[x]);      \
-    tmp_radio_stats += y;                                               \
-    serial_radio_stats_debug[x] = htonl(tmp_radio_stats);               \
-  } while(0)
-#define SERIAL_RADIO_STATS_DEBUG_GET(x) (ntohl(serial_radio_stats_debug[x]))
+#define SERIAL_RADIO_STATS_DEBUG_INC(x)    INSTRUMENT_INC(serial_radio_stats_debug, x)
+#define SERIAL_RADIO_STATS_DEBUG_ADD(x, y) INSTRUMENT_ADD(serial_radio_stats_debug, x, y)
+#define SERIAL_RADIO_STATS_DEBUG_GET(x)    INSTRUMENT_GET(serial_radio_stats_debug, x)
 
 #endif /* SERIAL_RADIO_STATS_H_ */
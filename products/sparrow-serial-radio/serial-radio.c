@@ -51,6 +51,7 @@
 #include "radio-scan.h"
 #include "packetutils.h"
 #include "serial-radio-stats.h"
+#include "lib/instrument.h"
 #include "radio-frontpanel.h"
 #include "transmit-buffer.h"
 #include "sparrow-oam.h"
@@ -67,6 +68,11 @@ extern const struct radio_driver cc2538_rf_driver;
 extern const struct radio_driver cc1200_driver;
 #endif /* CONTIKI_BOARD_IOT_U42 */
 
+#ifdef SERIAL_RADIO_CONF_RX_STATS
+#include "dev/radio-802154-dev.h"
+const struct radio_802154_rx_stats *SERIAL_RADIO_CONF_RX_STATS(void);
+#endif /* SERIAL_RADIO_CONF_RX_STATS */
+
 #define DEBUG DEBUG_NONE
 #include "net/ip/uip-debug.h"
 
@@ -75,6 +81,9 @@ extern const struct radio_driver cc1200_driver;
 
 #define BOOT_CMD "!!SERIAL RADIO BOOTED"
 
+/* Border router API version with support for compact packet attributes */
+#define SERIAL_RADIO_COMPACT_ATTS_API_VERSION 6
+
 uint32_t border_router_api_version = 1;
 
 #ifdef HAVE_SERIAL_RADIO_UART
@@ -388,6 +397,7 @@ packet_sent(void *ptr, int status, int transmissions)
   }
   /* packet callback from lower layers */
   /*  neighbor_info_packet_sent(status, transmissions); */
+  INSTRUMENT_LINK_TX(packetbuf_addr(PACKETBUF_ADDR_RECEIVER), status, transmissions);
   pos = 0;
   buf[pos++] = '!';
   buf[pos++] = 'R';
@@ -812,6 +822,11 @@ serial_radio_cmd_handler(const uint8_t *data, int len)
           (data[2] << 24) | (data[3] << 16) | (data[4] << 8) | data[5];
       }
       printf("Got BR API version:%"PRIu32"\n", border_router_api_version);
+      packetutils_set_atts_encoding(
+        border_router_api_version >= SERIAL_RADIO_COMPACT_ATTS_API_VERSION
+        ? PACKETUTILS_ATTS_COMPACT : PACKETUTILS_ATTS_LEGACY);
+      /* The version request starts a new session with the border router */
+      enc_net_reset_sequence();
       send_version(0);
       return 1;
     }
@@ -835,6 +850,16 @@ serial_radio_cmd_handler(const uint8_t *data, int len)
              SERIAL_RADIO_STATS_DEBUG_GET(SERIAL_RADIO_STATS_DEBUG_SLIP_OVERFLOWS),
              SERIAL_RADIO_STATS_DEBUG_GET(SERIAL_RADIO_STATS_DEBUG_SLIP_DROPPED),
              SERIAL_RADIO_STATS_DEBUG_GET(SERIAL_RADIO_STATS_DEBUG_SLIP_ERRORS));
+      printf("SLIP: %lu retransmits (%lu fast, %lu failed), %lu unsequenced\n",
+             SERIAL_RADIO_STATS_DEBUG_GET(SERIAL_RADIO_STATS_DEBUG_SLIP_RETRANSMITS),
+             SERIAL_RADIO_STATS_DEBUG_GET(SERIAL_RADIO_STATS_DEBUG_SLIP_FAST_RETRANSMITS),
+             SERIAL_RADIO_STATS_DEBUG_GET(SERIAL_RADIO_STATS_DEBUG_SLIP_RETRANSMIT_FAILED),
+             SERIAL_RADIO_STATS_DEBUG_GET(SERIAL_RADIO_STATS_DEBUG_SLIP_UNSEQUENCED));
+      printf("SLIP: %lu gaps, %lu out of order, %lu duplicates, %lu lost\n",
+             SERIAL_RADIO_STATS_DEBUG_GET(SERIAL_RADIO_STATS_DEBUG_SLIP_GAPS),
+             SERIAL_RADIO_STATS_DEBUG_GET(SERIAL_RADIO_STATS_DEBUG_SLIP_OUT_OF_ORDER),
+             SERIAL_RADIO_STATS_DEBUG_GET(SERIAL_RADIO_STATS_DEBUG_SLIP_DUPLICATES),
+             SERIAL_RADIO_STATS_DEBUG_GET(SERIAL_RADIO_STATS_DEBUG_SLIP_LOST));
 #ifdef HAVE_SERIAL_RADIO_UART
       /* Only show UART statistics if at least one error has occurred */
       if(uart1_framerr || uart1_parerr || uart1_overrunerr || uart1_timeout) {
@@ -852,6 +877,15 @@ serial_radio_cmd_handler(const uint8_t *data, int len)
         }
       }
 
+#ifdef SERIAL_RADIO_CONF_RX_STATS
+      {
+        const struct radio_802154_rx_stats *rx = SERIAL_RADIO_CONF_RX_STATS();
+        printf("RX: max %u bytes in %u frames, dropped %"PRIu32" full, %"PRIu32" too long, %"PRIu32" bad\n",
+               rx->high_water_bytes, rx->high_water_frames,
+               rx->drop_full, rx->drop_too_long, rx->drop_bad);
+      }
+#endif /* SERIAL_RADIO_CONF_RX_STATS */
+
 #ifdef HAVE_RADIO_FRONTPANEL
       {
         uint32_t r = radio_get_reset_cause();
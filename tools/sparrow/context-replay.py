@@ -0,0 +1,283 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2016, SICS, Swedish ICT
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+# 3. Neither the name of the Institute nor the names of its contributors
+#    may be used to endorse or promote products derived from this software
+#    without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+# Author: Niclas Finne, nfi@sics.se
+#
+# Replay a pcap of border router traffic through the context learning
+# policy in products/sparrow-border-router/br-contexts.c and estimate
+# the 6LoWPAN header bytes and 802.15.4 frames with and without the
+# learned contexts.
+#
+# The pcap should be captured on the tun interface of the border router
+# (raw IPv6) or on an Ethernet interface carrying the PAN traffic.
+# Packets with a destination in the PAN prefix are treated as traffic
+# to the PAN and all other packets as traffic from the PAN.
+#
+
+import sys, struct, argparse
+
+LINKTYPE_ETHERNET = 1
+LINKTYPE_RAW = 101
+LINKTYPE_IPV6 = 229
+
+# Max 802.15.4 payload after MAC header (long addresses, PAN id
+# compression) and FCS
+FRAME_PAYLOAD = 127 - 23 - 2
+FRAG1_HDR_LEN = 4
+FRAGN_HDR_LEN = 5
+
+parser = argparse.ArgumentParser(description='Estimate 6LoWPAN bytes saved by learned contexts.')
+parser.add_argument("pcap", help="pcap file with IPv6 traffic.")
+parser.add_argument("-p", "--prefix", default="fd02::",
+                    help="PAN prefix (context 0) - fd02:: is default.")
+parser.add_argument("-c", "--contexts", type=int, default=16,
+                    help="number of contexts including context 0.")
+parser.add_argument("-i", "--interval", type=int, default=60,
+                    help="learning interval in seconds.")
+parser.add_argument("-m", "--min-packets", type=int, default=20,
+                    help="packets per interval needed to allocate a context.")
+parser.add_argument("-d", "--activate-delay", type=int, default=5 * 60,
+                    help="seconds before a new context is used for compression.")
+parser.add_argument("-I", "--idle-intervals", type=int, default=30,
+                    help="idle intervals before a context is retired.")
+parser.add_argument("-l", "--lifetime", type=int, default=60 * 60,
+                    help="context lifetime in seconds.")
+parser.add_argument("-H", "--hold-time", type=int, default=5 * 60,
+                    help="seconds a retired context is kept after expiry.")
+parser.add_argument("-v", "--verbose", action="store_true",
+                    help="print context changes.")
+args = parser.parse_args()
+
+def parse_prefix(text):
+    if "/" in text:
+        text = text.split("/")[0]
+    head, sep, tail = text.partition("::")
+    words = [int(w, 16) for w in head.split(":") if w]
+    words += [0] * (8 - len(words) - len([w for w in tail.split(":") if w]))
+    words += [int(w, 16) for w in tail.split(":") if w]
+    return struct.pack("!8H", *words)[:8]
+
+def format_prefix(prefix):
+    words = struct.unpack("!4H", prefix)
+    return ":".join("%04x" % w for w in words) + "::/64"
+
+def read_pcap(filename):
+    with open(filename, "rb") as f:
+        data = f.read()
+    if len(data) < 24:
+        raise ValueError("too short pcap file")
+    magic = struct.unpack("<L", data[:4])[0]
+    if magic in (0xa1b2c3d4, 0xa1b23c4d):
+        endian = "<"
+    elif magic in (0xd4c3b2a1, 0x4d3cb2a1):
+        endian = ">"
+    else:
+        raise ValueError("not a pcap file")
+    linktype = struct.unpack(endian + "L", data[20:24])[0]
+    pos = 24
+    while pos + 16 <= len(data):
+        sec, usec, caplen, origlen = struct.unpack(endian + "LLLL", data[pos:pos + 16])
+        pos += 16
+        frame = data[pos:pos + caplen]
+        pos += caplen
+        if linktype == LINKTYPE_ETHERNET:
+            if len(frame) < 14 or frame[12:14] != b"\x86\xdd":
+                continue
+            frame = frame[14:]
+            origlen -= 14
+        elif linktype not in (LINKTYPE_RAW, LINKTYPE_IPV6):
+            raise ValueError("unsupported link type %d" % linktype)
+        if len(frame) < 40 or (bytearray(frame[:1])[0] >> 4) != 6:
+            continue
+        yield sec, bytearray(frame[:40]), origlen
+
+def is_unicast_global(addr):
+    return addr[0] != 0xff and not (addr[0] == 0xfe and (addr[1] & 0xc0) == 0x80) \
+        and addr != bytearray(16)
+
+def iid_inline(addr):
+    # IIDs of the form 0000:00ff:fe00:XXXX are compressed to 16 bits
+    if addr[8:14] == bytearray(b"\x00\x00\x00\xff\xfe\x00"):
+        return 2
+    return 8
+
+def addr_inline(addr, contexts):
+    """Returns (inline bytes, context number) for an address."""
+    if addr[0] == 0xff:
+        return (1 if addr[1] == 0x02 and addr[2:15] == bytearray(13) else 6), None
+    if addr[0] == 0xfe and (addr[1] & 0xc0) == 0x80:
+        return iid_inline(addr), None
+    prefix = bytes(addr[:8])
+    if prefix in contexts:
+        return iid_inline(addr), contexts[prefix]
+    return 16, None
+
+def header_size(hdr, contexts):
+    # IPHC base, traffic class/flow label elided, next header inline,
+    # hop limit compressed
+    size = 2 + 1
+    src_size, src_cid = addr_inline(hdr[8:24], contexts)
+    dst_size, dst_cid = addr_inline(hdr[24:40], contexts)
+    size += src_size + dst_size
+    # Context 0 is implied, any other context needs the CID byte
+    if src_cid or dst_cid:
+        size += 1
+    return size, src_cid, dst_cid
+
+def frames(hdr_size, payload):
+    if hdr_size + payload <= FRAME_PAYLOAD:
+        return 1
+    # Fragment offsets are in units of 8 bytes of uncompressed packet
+    first = (FRAME_PAYLOAD - FRAG1_HDR_LEN - hdr_size) & ~7
+    rest = (FRAME_PAYLOAD - FRAGN_HDR_LEN) & ~7
+    first = max(first, 0)
+    left = payload - first
+    return 1 + (left + rest - 1) // rest
+
+class Learner:
+    FREE, PENDING, ACTIVE, RETIRED = range(4)
+    NAMES = ["free", "pending", "active", "retired"]
+
+    def __init__(self, pan_prefix):
+        self.pan_prefix = pan_prefix
+        self.hits = {}
+        self.slots = [None] * args.contexts
+        self.saved = [0] * args.contexts
+        self.packets = [0] * args.contexts
+
+    def log(self, now, msg):
+        if args.verbose:
+            print("%8d %s" % (now, msg))
+
+    def handle_packet(self, hdr, topan):
+        addr = hdr[8:24] if topan else hdr[24:40]
+        if not is_unicast_global(addr):
+            return
+        prefix = bytes(addr[:8])
+        if prefix != self.pan_prefix:
+            self.hits[prefix] = self.hits.get(prefix, 0) + 1
+
+    def compress_contexts(self):
+        contexts = {self.pan_prefix: 0}
+        for i, s in enumerate(self.slots):
+            if s is not None and s["state"] == Learner.ACTIVE:
+                contexts[s["prefix"]] = i
+        return contexts
+
+    def periodic(self, now):
+        for i in range(1, len(self.slots)):
+            s = self.slots[i]
+            if s is None:
+                continue
+            if s["state"] in (Learner.PENDING, Learner.ACTIVE):
+                if self.hits.get(s["prefix"], 0) == 0:
+                    s["idle"] += 1
+                else:
+                    s["idle"] = 0
+                if s["idle"] >= args.idle_intervals:
+                    self.log(now, "retiring idle context %d" % i)
+                    s["state"] = Learner.RETIRED
+                    s["time"] = s["expires"]
+                    continue
+                if s["state"] == Learner.PENDING and now - s["time"] >= args.activate_delay:
+                    self.log(now, "context %d used for compression" % i)
+                    s["state"] = Learner.ACTIVE
+                s["expires"] = now + args.lifetime
+            elif s["state"] == Learner.RETIRED and now - s["time"] >= args.hold_time:
+                self.slots[i] = None
+
+        used = set(s["prefix"] for s in self.slots
+                   if s is not None and s["state"] != Learner.RETIRED)
+        hot = sorted([(h, p) for p, h in self.hits.items()
+                      if h >= args.min_packets and p not in used], reverse=True)
+        for i in range(1, len(self.slots)):
+            if not hot:
+                break
+            if self.slots[i] is None:
+                h, p = hot.pop(0)
+                self.log(now, "context %d allocated for %s (%d packets)"
+                         % (i, format_prefix(p), h))
+                self.slots[i] = {"state": Learner.PENDING, "prefix": p, "idle": 0,
+                                 "time": now, "expires": now + args.lifetime}
+        self.hits = {}
+
+def main():
+    if args.contexts < 1 or args.contexts > 16:
+        print("the number of contexts must be 1 - 16")
+        sys.exit(1)
+    pan_prefix = parse_prefix(args.prefix)
+    learner = Learner(pan_prefix)
+    next_time = None
+    contexts = learner.compress_contexts()
+    packets = 0
+    base_bytes = ctx_bytes = base_frames = ctx_frames = 0
+
+    for sec, hdr, length in read_pcap(args.pcap):
+        if next_time is None:
+            next_time = sec + args.interval
+        while sec >= next_time:
+            learner.periodic(next_time)
+            contexts = learner.compress_contexts()
+            next_time += args.interval
+
+        topan = bytes(hdr[24:32]) == pan_prefix
+        learner.handle_packet(hdr, topan)
+
+        payload = length - 40
+        base, _, _ = header_size(hdr, {pan_prefix: 0})
+        size, src_cid, dst_cid = header_size(hdr, contexts)
+        packets += 1
+        base_bytes += base
+        ctx_bytes += size
+        base_frames += frames(base, payload)
+        ctx_frames += frames(size, payload)
+        if base != size:
+            cid = src_cid or dst_cid
+            learner.packets[cid] += 1
+            learner.saved[cid] += base - size
+
+    if packets == 0:
+        print("no IPv6 packets found")
+        return
+    print("Packets:        %d" % packets)
+    print("Header bytes:   %d without contexts, %d with contexts (%.1f%% saved)"
+          % (base_bytes, ctx_bytes, 100.0 * (base_bytes - ctx_bytes) / base_bytes))
+    print("802.15.4 frames: %d without contexts, %d with contexts"
+          % (base_frames, ctx_frames))
+    print("Contexts:")
+    for i, s in enumerate(learner.slots):
+        if learner.packets[i] == 0 and s is None:
+            continue
+        state = Learner.NAMES[s["state"]] if s is not None else "free"
+        prefix = format_prefix(s["prefix"]) if s is not None else "-"
+        print("  %2d %-26s %-8s packets %d saved %d bytes"
+              % (i, prefix, state, learner.packets[i], learner.saved[i]))
+
+if __name__ == "__main__":
+    main()
@@ -30,6 +30,7 @@
 # ===================================================================
 #
 # Description : Create firmware archive from two images.
+#               With -z the archive also contains compressed images.
 #
 # ===================================================================
 #
@@ -47,9 +48,12 @@ VARIANT=felicia
 while [ -n "$1" ]; do
     case $1 in
         -\? | -h | --help)
-            echo "Usage: $PROGNAME [-v variant] [-o output] [flash] [flash2]"
+            echo "Usage: $PROGNAME [-z] [-v variant] [-o output] [flash] [flash2]"
             exit
             ;;
+        -z)
+            COMPRESS=1
+            ;;
         -o)
             ARCHIVE=$2
             shift
@@ -197,6 +201,36 @@ Imageversion: $IMAGEVERSIONTWO
 Checksum: $CHECKSUMTWO
 EOF
 
-$JAR cmf $MANIFEST ${ARCHIVE} "$FILEONE" "$FILETWO"
+if [ -n "$COMPRESS" ] ; then
+    if ! $TRAILER -Z -i "$FILEONE" > "${FILEONE}.lz" ; then
+        echo "Failed to compress $FILEONE"
+        exit 1
+    fi
+    if ! $TRAILER -Z -i "$FILETWO" > "${FILETWO}.lz" ; then
+        echo "Failed to compress $FILETWO"
+        exit 1
+    fi
+
+    cat >> ${MANIFEST} <<EOF
+
+Name: ${FILEONE}.lz
+Startaddress: $STARTADDRESSONE
+Imagetype: $IMAGETYPEONE
+Imageversion: $IMAGEVERSIONONE
+Checksum: $CHECKSUMONE
+Compression: lzss
+
+Name: ${FILETWO}.lz
+Startaddress: $STARTADDRESSTWO
+Imagetype: $IMAGETYPETWO
+Imageversion: $IMAGEVERSIONTWO
+Checksum: $CHECKSUMTWO
+Compression: lzss
+EOF
+
+    $JAR cmf $MANIFEST ${ARCHIVE} "$FILEONE" "$FILETWO" "${FILEONE}.lz" "${FILETWO}.lz"
+else
+    $JAR cmf $MANIFEST ${ARCHIVE} "$FILEONE" "$FILETWO"
+fi
 
 rm $MANIFEST
@@ -34,7 +34,7 @@
 #
 
 import tlvlib, nstatslib, sys, struct, binascii, socket, time, threading
-import subprocess, re, dscli, logging
+import subprocess, re, dscli, logging, otacampaign
 
 EVENT_DISCOVERY = "discovery"
 EVENT_BUTTON = "button"
@@ -340,11 +340,14 @@ class DeviceServer:
     grab_all = 0
     _accept_nodes = None
 
+    campaign = None
+
     fetch_time = 120
 
     def __init__(self):
         self._devices = {}
         self._callbacks = []
+        self._tlv_listeners = []
         self.log = logging.getLogger("server")
 
     def send_event(self, device_event):
@@ -362,6 +365,14 @@ class DeviceServer:
     def remove_event_listener(self, callback):
         self._callbacks.remove(callback)
 
+    # TLV listeners are called with all TLVs received from discovered devices
+    def add_tlv_listener(self, callback):
+        self._tlv_listeners.append(callback)
+
+    def remove_tlv_listener(self, callback):
+        if callback in self._tlv_listeners:
+            self._tlv_listeners.remove(callback)
+
     # 24-bit reserved, 8-bit type = 02
     # 16-bit reserved, 16-bit port
     # 16-byte IPv6 address
@@ -760,6 +771,30 @@ class DeviceServer:
         else:
             print device.address,"is not a sleepy device"
 
+    # Start a firmware upgrade campaign for the specified devices or all
+    # devices when none is specified. Running campaigns are stopped.
+    def start_campaign(self, filename, addresses=None):
+        if self.campaign is not None:
+            self.campaign.stop()
+        campaign = otacampaign.OtaCampaign(self, filename)
+        for dev in self.get_devices():
+            if not addresses or dev.address in addresses:
+                campaign.add_device(dev)
+        if addresses:
+            for addr in addresses:
+                if self.get_device(addr) is None:
+                    print "could not find device with address",addr
+        if len(campaign.get_upgrades()) == 0:
+            print "No devices to upgrade"
+            return None
+        self.campaign = campaign
+        campaign.start()
+        return campaign
+
+    def stop_campaign(self):
+        if self.campaign is not None:
+            self.campaign.stop()
+
     def set_channel_panid(self):
         # set radio channel
         t1 = tlvlib.create_set_tlv32(self.radio_instance,
@@ -876,6 +911,11 @@ class DeviceServer:
         elif device.is_discovered():
 #                    time.sleep(0.005)
             device._process_tlvs(tlvs)
+            for callback in self._tlv_listeners[:]:
+                try:
+                    callback(device, tlvs)
+                except Exception as e:
+                    device.log.error("*** TLV listener error: %s", str(e))
             if not device.is_sleepy_device() and ping_device and device.get_pending_packet_count() == 0:
                 t = tlvlib.create_get_tlv64(0, tlvlib.VARIABLE_UNIT_BOOT_TIMER)
                 device.send_tlv(t)
@@ -33,7 +33,7 @@
 #
 
 import readline,threading
-COMMANDS = ['list', 'wakeup', 'exit', 'bye', 'quit', 'q']
+COMMANDS = ['list', 'wakeup', 'upgrade', 'campaign', 'exit', 'bye', 'quit', 'q']
 deviceServer = None
 
 def complete(text, state):
@@ -79,6 +79,21 @@ def cli_loop():
                     deviceServer.wakeup(cmds[1], int(cmds[2]))
                 else:
                     deviceServer.wakeup(cmds[1])
+            elif cmd == "upgrade":
+                if len(cmds) == 1:
+                    print "Usage: upgrade <image-archive> [device ...]"
+                else:
+                    deviceServer.start_campaign(cmds[1], cmds[2:])
+            elif cmd == "campaign":
+                campaign = deviceServer.campaign
+                if campaign is None:
+                    print "No upgrade campaign"
+                elif len(cmds) > 1 and cmds[1] == "stop":
+                    deviceServer.stop_campaign()
+                elif len(cmds) > 1 and cmds[1] == "resume":
+                    campaign.start()
+                else:
+                    campaign.print_status()
         except Exception as e:
             print "Error:", e
 
@@ -0,0 +1,181 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2016, SICS, Swedish ICT
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+# 3. Neither the name of the Institute nor the names of its contributors
+#    may be used to endorse or promote products derived from this software
+#    without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+# Author: Niclas Finne, nfi@sics.se
+#
+# Create delta images between two flash files (with trailers) for the
+# same image slot. The format matches the decoder in
+# apps/sparrow-instances/instance-flash/delta-decoder.c and the delta
+# header in lib/image-trailer/image-trailer.h.
+#
+# The device only accepts the delta when running the exact source
+# image, identified by its version, length and CRC32.
+#
+
+import sys, struct, binascii, argparse, time
+
+MAGIC = 0x53504431
+HEADER_FORMAT = "!LLQLLLL"
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+
+OP_COPY = 0x80
+MAX_INSERT = 128
+MAX_COPY = 65536
+# A copy operation is 7 bytes and should replace more than that
+MIN_COPY = 12
+KEY_SIZE = 8
+MAX_CANDIDATES = 16
+
+def get_version(data):
+    # Image version is found 24 bytes from the end of the trailer
+    return struct.unpack_from("!Q", data, len(data) - 24)[0]
+
+def get_crc(data):
+    return binascii.crc32(bytes(data)) & 0xffffffff
+
+def is_delta(data):
+    if len(data) < HEADER_SIZE:
+        return False
+    magic, = struct.unpack_from("!L", data, 0)
+    return magic == MAGIC
+
+def get_header(data):
+    magic, reserved, source_version, source_length, source_crc32, length, crc32 = struct.unpack_from(HEADER_FORMAT, data, 0)
+    return {'source_version':source_version, 'source_length':source_length,
+            'source_crc32':source_crc32, 'length':length, 'crc32':crc32}
+
+def match_length(src, p, tgt, t):
+    n = 0
+    limit = min(len(src) - p, len(tgt) - t, MAX_COPY)
+    while n < limit and src[p + n] == tgt[t + n]:
+        n += 1
+    return n
+
+def add_insert(out, data):
+    for i in range(0, len(data), MAX_INSERT):
+        chunk = data[i:i + MAX_INSERT]
+        out.append(len(chunk) - 1)
+        out += chunk
+
+def diff(source, target):
+    src = bytearray(source)
+    tgt = bytearray(target)
+    index = {}
+    for i in range(len(src) - KEY_SIZE + 1):
+        index.setdefault(bytes(src[i:i + KEY_SIZE]), []).append(i)
+
+    out = bytearray(struct.pack(HEADER_FORMAT, MAGIC, 0, get_version(src),
+                                len(src), get_crc(src), len(tgt), get_crc(tgt)))
+    insert = bytearray()
+    # Source position following the last copy - code that has only
+    # moved usually continues to match from there
+    expected = 0
+    t = 0
+    while t < len(tgt):
+        best_length = 0
+        best_pos = 0
+        if expected < len(src):
+            best_length = match_length(src, expected, tgt, t)
+            best_pos = expected
+        if best_length < MIN_COPY and t + KEY_SIZE <= len(tgt):
+            candidates = index.get(bytes(tgt[t:t + KEY_SIZE]), [])
+            if len(candidates) > MAX_CANDIDATES:
+                # Prefer matches near the same position in the image
+                candidates = sorted(candidates, key=lambda p: abs(p - t))[:MAX_CANDIDATES]
+            for p in candidates:
+                n = match_length(src, p, tgt, t)
+                if n > best_length:
+                    best_length = n
+                    best_pos = p
+        if best_length >= MIN_COPY:
+            add_insert(out, insert)
+            insert = bytearray()
+            out += struct.pack("!BLH", OP_COPY, best_pos, best_length - 1)
+            t += best_length
+            expected = best_pos + best_length
+        else:
+            insert.append(tgt[t])
+            t += 1
+            expected += 1
+    add_insert(out, insert)
+    if len(out) % 4 > 0:
+        out += bytearray(4 - (len(out) % 4))
+    return bytes(out)
+
+def apply(source, delta):
+    src = bytearray(source)
+    delta = bytearray(delta)
+    if not is_delta(delta):
+        raise ValueError("not a delta image")
+    header = get_header(delta)
+    if header['source_length'] != len(src) or header['source_crc32'] != get_crc(src):
+        raise ValueError("delta is for another source image")
+    out = bytearray()
+    pos = HEADER_SIZE
+    while len(out) < header['length']:
+        op = delta[pos]
+        if op == OP_COPY:
+            offset, n = struct.unpack_from("!LH", bytes(delta[pos + 1:pos + 7]))
+            out += src[offset:offset + n + 1]
+            pos += 7
+        elif op < OP_COPY:
+            out += delta[pos + 1:pos + op + 2]
+            pos += op + 2
+        else:
+            raise ValueError("bad delta operation 0x%02x"%op)
+    if len(out) != header['length'] or get_crc(out) != header['crc32']:
+        raise ValueError("bad CRC32 of new image")
+    return bytes(out)
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description='Create delta images.')
+    parser.add_argument("-s", required=True, help="source (running) flash file")
+    parser.add_argument("-t", help="target (new) flash file")
+    parser.add_argument("-a", help="apply this delta to the source instead")
+    parser.add_argument("-o", help="output file")
+    parser.add_argument("-v", action="store_true", help="verbose output")
+    args = parser.parse_args()
+
+    source = open(args.s, 'rb').read()
+    start = time.time()
+    if args.a:
+        result = apply(source, open(args.a, 'rb').read())
+    elif args.t:
+        target = open(args.t, 'rb').read()
+        result = diff(source, target)
+        # Always verify the delta before it is used
+        apply(source, result)
+        if args.v:
+            sys.stderr.write("Delta %d bytes for %d bytes image (%.1f%%)\n"%(len(result), len(target), 100.0 * len(result) / len(target)))
+    else:
+        parser.error("specify target file or delta to apply")
+    if args.v:
+        sys.stderr.write("Done in %.1f s\n"%(time.time() - start))
+    outfile = open(args.o, 'wb') if args.o else getattr(sys.stdout, 'buffer', sys.stdout)
+    outfile.write(result)
@@ -0,0 +1,243 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2016, Yanzi Networks AB.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#   1. Redistributions of source code must retain the above copyright
+#      notice, this list of conditions and the following disclaimer.
+#   2. Redistributions in binary form must reproduce the above copyright
+#      notice, this list of conditions and the following disclaimer in the
+#      documentation and/or other materials provided with the distribution.
+#   3. Neither the name of the copyright holders nor the
+#      names of its contributors may be used to endorse or promote products
+#      derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+# FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+# LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+# USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+# OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+# OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+# Author: Niclas Finne, nfi@sics.se
+#
+# Reads instrumentation snapshots from a border router or serial radio
+# and prints the counter deltas between snapshots.
+#
+
+import tlvlib, sys, struct, time, getopt
+
+TYPE_END      = 0
+TYPE_COUNTERS = 1
+TYPE_GAUGES   = 2
+TYPE_NBRS     = 3
+TYPE_CHANNELS = 4
+
+GROUP_NAMES = { 1: "brm", 2: "brm-debug", 3: "radio", 4: "radio-debug" }
+LINK_NAMES = [ "rx", "tx", "tx-attempts", "noack", "cca-fail", "tx-err", "crc" ]
+RSSI_BUCKETS = 8
+RSSI_MIN = -100
+RSSI_STEP = 8
+
+# The instrumentation variables in each instance
+INSTANCES = {
+    "brm": (tlvlib.INSTANCE_BORDER_ROUTER_MANAGEMENT, 0x10c, 0x10d),
+    "radio": (tlvlib.INSTANCE_RADIO, 0x203, 0x204)
+}
+
+# Read the snapshot in chunks to fit in a single reply
+CHUNK_WORDS = 64
+
+def usage():
+    print "Usage:", sys.argv[0], "[-v] [-r] [-p port] [-i interval] [-n count] [-o file] <host>"
+    print "      ", sys.argv[0], "<snapshot-file> <snapshot-file>"
+    print "  -r  read from the serial radio instance instead of the border router"
+    print "  -i  seconds between snapshots (default 10)"
+    print "  -n  number of intervals to print (default forever)"
+    print "  -o  save the first snapshot to file"
+    exit(2)
+
+def read_snapshot(host, port, instance, var_length, var_data):
+    t = tlvlib.create_get_tlv32(instance, var_length)
+    enc,tlvs = tlvlib.send_tlv(t, host, port)
+    if tlvs[0].error != 0:
+        return None
+    words = tlvs[0].int_value
+    data = ""
+    offset = 0
+    while offset < words:
+        count = min(CHUNK_WORDS, words - offset)
+        t = tlvlib.create_get_vector_tlv(instance, var_data, tlvlib.SIZE32,
+                                         offset, count)
+        enc,tlvs = tlvlib.send_tlv(t, host, port)
+        if tlvs[0].error != 0 or tlvs[0].element_count == 0:
+            return None
+        data += tlvs[0].value[:tlvs[0].element_count * 4]
+        offset += tlvs[0].element_count
+    return data
+
+def parse_link(data, pos, is_nbr):
+    if is_nbr:
+        key = "".join("%02x" % ord(c) for c in data[pos:pos + 8])
+    else:
+        key = None
+    pos += 8
+    counters = list(struct.unpack("!" + "L" * len(LINK_NAMES),
+                                  data[pos:pos + 4 * len(LINK_NAMES)]))
+    pos += 4 * len(LINK_NAMES)
+    rssi = list(struct.unpack("!" + "H" * RSSI_BUCKETS,
+                              data[pos:pos + 2 * RSSI_BUCKETS]))
+    pos += 2 * RSSI_BUCKETS
+    return pos, key, counters, rssi
+
+def parse_snapshot(data):
+    magic, seconds = struct.unpack("!LL", data[0:8])
+    if (magic >> 16) != 0x4953 or ((magic >> 8) & 0xff) != 0:
+        raise ValueError("unsupported snapshot format 0x%08x" % magic)
+    snapshot = { "time": seconds, "groups": {}, "gauges": {},
+                 "nbrs": {}, "channels": {} }
+    pos = 8
+    while pos + 4 <= len(data):
+        header, = struct.unpack("!L", data[pos:pos + 4])
+        pos += 4
+        type = header >> 24
+        id = (header >> 16) & 0xff
+        count = header & 0xffff
+        if type == TYPE_END:
+            break
+        elif type == TYPE_COUNTERS or type == TYPE_GAUGES:
+            values = list(struct.unpack("!" + "L" * count, data[pos:pos + 4 * count]))
+            pos += 4 * count
+            name = GROUP_NAMES.get(id, "group-%u" % id)
+            if type == TYPE_COUNTERS:
+                snapshot["groups"][name] = values
+            else:
+                snapshot["gauges"][name] = values
+        elif type == TYPE_NBRS or type == TYPE_CHANNELS:
+            for i in range(count):
+                pos, key, counters, rssi = parse_link(data, pos, type == TYPE_NBRS)
+                if type == TYPE_CHANNELS:
+                    key = id + i
+                    if sum(counters) == 0:
+                        continue
+                    snapshot["channels"][key] = (counters, rssi)
+                else:
+                    snapshot["nbrs"][key] = (counters, rssi)
+        else:
+            raise ValueError("unknown section type %u" % type)
+    return snapshot
+
+def delta(new, old):
+    # Counters are 32 bits and may wrap
+    return [(n - o) & 0xffffffffL for n, o in zip(new, old)]
+
+def format_rssi(rssi):
+    if sum(rssi) == 0:
+        return ""
+    # Print the RSSI histogram as "<lower bound>:<count>"
+    return " rssi " + " ".join("%d:%u" % (RSSI_MIN + i * RSSI_STEP, r)
+                               for i, r in enumerate(rssi) if r > 0)
+
+def format_link(counters, rssi):
+    return " ".join("%s=%u" % (n, c) for n, c in zip(LINK_NAMES, counters)) + format_rssi(rssi)
+
+def print_diff(new, old):
+    print "--- %u seconds (uptime %u)" % (new["time"] - old["time"], new["time"])
+    for name in sorted(new["groups"]):
+        values = new["groups"][name]
+        if name in old["groups"] and len(old["groups"][name]) == len(values):
+            values = delta(values, old["groups"][name])
+        print "%-12s" % name, " ".join("%u" % v for v in values)
+    for name in sorted(new["gauges"]):
+        print "%-12s" % name, " ".join("%u" % v for v in new["gauges"][name])
+    for kind in ["channels", "nbrs"]:
+        for key in sorted(new[kind]):
+            counters, rssi = new[kind][key]
+            if key in old[kind]:
+                counters = delta(counters, old[kind][key][0])
+                rssi = [(n - o) & 0xffff for n, o in zip(rssi, old[kind][key][1])]
+            if sum(counters) == 0:
+                continue
+            if kind == "channels":
+                print "channel %-4u" % key, format_link(counters, rssi)
+            else:
+                print "nbr %s" % key, format_link(counters, rssi)
+
+#
+# Read command line arguments
+#
+verbose = False
+product = "brm"
+port = tlvlib.UDP_PORT
+interval = 10
+count = None
+outfile = None
+
+try:
+    opts, args = getopt.getopt(sys.argv[1:], "hvrp:i:n:o:")
+except getopt.GetoptError as e:
+    sys.stderr.write("Error: {}\n".format(e))
+    usage()
+for opt, arg in opts:
+    if opt == "-h":
+        usage()
+    elif opt == "-v":
+        verbose = True
+    elif opt == "-r":
+        product = "radio"
+    elif opt == "-p":
+        port = int(arg)
+    elif opt == "-i":
+        interval = float(arg)
+    elif opt == "-n":
+        count = int(arg)
+    elif opt == "-o":
+        outfile = arg
+
+if len(args) == 2:
+    # Diff two saved snapshots
+    with open(args[0], "rb") as f:
+        old = parse_snapshot(f.read())
+    with open(args[1], "rb") as f:
+        new = parse_snapshot(f.read())
+    print_diff(new, old)
+    exit()
+
+if len(args) != 1:
+    usage()
+
+host = args[0]
+instance_type, var_length, var_data = INSTANCES[product]
+instance = tlvlib.find_instance_with_type(host, instance_type, verbose)
+if not instance:
+    print "Could not find a", product, "instance in", host
+    exit(1)
+
+data = read_snapshot(host, port, instance, var_length, var_data)
+if data is None:
+    print "Failed to read instrumentation from", host
+    exit(1)
+if outfile is not None:
+    with open(outfile, "wb") as f:
+        f.write(data)
+old = parse_snapshot(data)
+
+while count is None or count > 0:
+    time.sleep(interval)
+    data = read_snapshot(host, port, instance, var_length, var_data)
+    if data is None:
+        print "Failed to read instrumentation from", host
+        continue
+    new = parse_snapshot(data)
+    print_diff(new, old)
+    old = new
+    if count is not None:
+        count -= 1
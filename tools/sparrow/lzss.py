@@ -0,0 +1,200 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2016, SICS, Swedish ICT
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+# 3. Neither the name of the Institute nor the names of its contributors
+#    may be used to endorse or promote products derived from this software
+#    without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+# Author: Niclas Finne, nfi@sics.se
+#
+# LZSS compression of firmware images. The format matches the decoder
+# in apps/sparrow-instances/instance-flash/lzss-decoder.c and the
+# compressed image header in lib/image-trailer/image-trailer.h.
+#
+# The compressed stream is a sequence of bit fields, most significant
+# bit first. A '1' tag is followed by an 8-bit literal and a '0' tag by
+# a back reference of window_bits (distance - 1) and lookahead_bits
+# (count - 1). The compressed image is zero padded to 32-bit words.
+#
+
+import sys, struct, binascii, argparse
+
+MAGIC = 0x53505a31
+ALGORITHM_LZSS = 1
+HEADER_FORMAT = "!LBBBBLL"
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+
+WINDOW_BITS = 11
+LOOKAHEAD_BITS = 4
+# Only the most recent positions are tried for each match
+MAX_CHAIN = 64
+
+class BitWriter:
+    def __init__(self):
+        self.data = bytearray()
+        self.bits = 0
+        self.count = 0
+
+    def write(self, value, count):
+        self.bits = (self.bits << count) | (value & ((1 << count) - 1))
+        self.count += count
+        while self.count >= 8:
+            self.count -= 8
+            self.data.append((self.bits >> self.count) & 0xff)
+        self.bits &= (1 << self.count) - 1
+
+    def flush(self):
+        if self.count > 0:
+            self.data.append((self.bits << (8 - self.count)) & 0xff)
+            self.bits = 0
+            self.count = 0
+        return self.data
+
+class BitReader:
+    def __init__(self, data, pos):
+        self.data = data
+        self.pos = pos
+        self.bits = 0
+        self.count = 0
+
+    def read(self, count):
+        while self.count < count:
+            if self.pos >= len(self.data):
+                raise ValueError("truncated compressed image")
+            self.bits = (self.bits << 8) | self.data[self.pos]
+            self.pos += 1
+            self.count += 8
+        self.count -= count
+        value = self.bits >> self.count
+        self.bits &= (1 << self.count) - 1
+        return value
+
+def is_compressed(data):
+    if len(data) < HEADER_SIZE:
+        return False
+    magic, = struct.unpack_from("!L", data, 0)
+    return magic == MAGIC
+
+def get_header(data):
+    magic, algorithm, window_bits, lookahead_bits, reserved, length, crc32 = struct.unpack_from(HEADER_FORMAT, data, 0)
+    return {'algorithm':algorithm, 'window_bits':window_bits,
+            'lookahead_bits':lookahead_bits, 'length':length, 'crc32':crc32}
+
+def compress(data, window_bits=WINDOW_BITS, lookahead_bits=LOOKAHEAD_BITS):
+    data = bytearray(data)
+    window = 1 << window_bits
+    max_count = 1 << lookahead_bits
+    n = len(data)
+    chains = {}
+    out = BitWriter()
+    i = 0
+    while i < n:
+        best_count = 0
+        best_distance = 0
+        if i + 1 < n:
+            candidates = chains.get((data[i] << 8) | data[i + 1], [])
+            for p in reversed(candidates[-MAX_CHAIN:]):
+                if i - p > window:
+                    break
+                count = 2
+                while count < max_count and i + count < n and data[p + count] == data[i + count]:
+                    count += 1
+                if count > best_count:
+                    best_count = count
+                    best_distance = i - p
+                    if count == max_count:
+                        break
+        # Use a back reference only when shorter than the literals it replaces
+        if best_count >= 2 and 1 + window_bits + lookahead_bits < best_count * 9:
+            out.write(0, 1)
+            out.write(best_distance - 1, window_bits)
+            out.write(best_count - 1, lookahead_bits)
+            step = best_count
+        else:
+            out.write(1, 1)
+            out.write(data[i], 8)
+            step = 1
+        for j in range(i, min(i + step, n - 1)):
+            key = (data[j] << 8) | data[j + 1]
+            chain = chains.setdefault(key, [])
+            chain.append(j)
+            if len(chain) > MAX_CHAIN * 4:
+                del chain[:-MAX_CHAIN]
+        i += step
+    stream = out.flush()
+    crc32 = binascii.crc32(bytes(data)) & 0xffffffff
+    header = struct.pack(HEADER_FORMAT, MAGIC, ALGORITHM_LZSS, window_bits,
+                         lookahead_bits, 0, n, crc32)
+    stream = bytearray(header) + stream
+    if len(stream) % 4 > 0:
+        stream += bytearray(4 - (len(stream) % 4))
+    return bytes(stream)
+
+def decompress(data):
+    data = bytearray(data)
+    if not is_compressed(data):
+        raise ValueError("not a compressed image")
+    header = get_header(data)
+    if header['algorithm'] != ALGORITHM_LZSS:
+        raise ValueError("unsupported compression %d"%header['algorithm'])
+    window_bits = header['window_bits']
+    lookahead_bits = header['lookahead_bits']
+    length = header['length']
+    out = bytearray()
+    bits = BitReader(data, HEADER_SIZE)
+    while len(out) < length:
+        if bits.read(1):
+            out.append(bits.read(8))
+        else:
+            distance = bits.read(window_bits) + 1
+            n = bits.read(lookahead_bits) + 1
+            if distance > len(out) or len(out) + n > length:
+                raise ValueError("bad back reference")
+            for i in range(n):
+                out.append(out[-distance])
+    if (binascii.crc32(bytes(out)) & 0xffffffff) != header['crc32']:
+        raise ValueError("bad CRC32 of decompressed image")
+    return bytes(out)
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description='Compress firmware images.')
+    parser.add_argument("-d", action="store_true", help="decompress")
+    parser.add_argument("-W", type=int, default=WINDOW_BITS,
+                        help="window bits (default: %(default)s)")
+    parser.add_argument("-L", type=int, default=LOOKAHEAD_BITS,
+                        help="lookahead bits (default: %(default)s)")
+    parser.add_argument("-i", help="input file")
+    parser.add_argument("-o", help="output file")
+    args = parser.parse_args()
+
+    infile = open(args.i, 'rb') if args.i else getattr(sys.stdin, 'buffer', sys.stdin)
+    data = infile.read()
+    if args.d:
+        result = decompress(data)
+    else:
+        result = compress(data, args.W, args.L)
+    sys.stderr.write("%d -> %d bytes\n"%(len(data), len(result)))
+    outfile = open(args.o, 'wb') if args.o else getattr(sys.stdout, 'buffer', sys.stdout)
+    outfile.write(result)
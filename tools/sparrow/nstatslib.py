@@ -42,6 +42,7 @@ NSTATS_TYPE_BEACONS     = 3
 NSTATS_TYPE_NETSELECT   = 4
 NSTATS_TYPE_RADIO       = 5
 NSTATS_TYPE_CONFIG      = 6
+NSTATS_TYPE_NETSCAN     = 8
 
 class NstatsData:
     def __init__(self, data_type):
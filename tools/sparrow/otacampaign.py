@@ -0,0 +1,735 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2016, SICS, Swedish ICT
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+# 3. Neither the name of the Institute nor the names of its contributors
+#    may be used to endorse or promote products derived from this software
+#    without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+# Author: Niclas Finne, nfi@sics.se
+#
+# Firmware upgrade campaigns for the devices managed by the device
+# server. Many devices are upgraded concurrently using write sessions
+# (see instance-flash) without blocking the device server:
+#
+#  - each device has a bounded number of request PDUs in flight and
+#    the device's reported write progress is used as cumulative ack
+#  - all PDUs share an airtime budget per border router, where a PDU
+#    to a device N hops away costs N times its size
+#  - devices closest to the border router are upgraded first
+#  - the write session id is derived from the image so that an
+#    interrupted upgrade resumes from the device's reported progress
+#
+
+import tlvlib, lzss, binascii, struct, zipfile, threading, time, logging
+
+STATE_WAITING = "waiting"
+STATE_PREPARE = "prepare"
+STATE_OPEN    = "open"
+STATE_WRITE   = "write"
+STATE_VERIFY  = "verify"
+STATE_CLOSE   = "close"
+STATE_RESTART = "restart"
+STATE_DONE    = "done"
+STATE_FAILED  = "failed"
+
+# Default RPL min hop rank increase, used to estimate the hop count
+MIN_HOP_RANK_INCREASE = 256
+
+ERROR_INVALID_VECTOR_OFFSET = 15
+
+def get_manifest_data(zip):
+    f = zip.open('META-INF/MANIFEST.MF')
+    lines = f.readlines()
+    image = 0
+    data = {}
+    for l in lines:
+        kv = l.lower().split(':')
+        if len(kv) != 2:
+            image = 0
+        else:
+            k = kv[0].strip()
+            v = kv[1].strip()
+            if k == 'producttype':
+                data['producttype'] = v
+            elif k == 'name':
+                if '1.flash' in v:
+                    image = 1
+                elif '2.flash' in v:
+                    image = 2
+                else:
+                    image = 0
+            elif k == 'imagetype':
+                if image != 0:
+                    data['image.' + str(image) + '.type'] = v
+    f.close()
+    return data
+
+def get_image_version(data):
+    # Image version is found 24 bytes from the end of the trailer
+    return struct.unpack_from("!Q", data, len(data) - 24)[0]
+
+#
+# Token bucket limiting the number of bytes per second sent through
+# a border router.
+#
+class AirtimeBudget:
+
+    def __init__(self, rate, burst=None):
+        self.rate = float(rate)
+        self.burst = float(burst or rate / 4)
+        self.tokens = self.burst
+        self.last_update = time.time()
+        self.used = 0
+
+    def _update(self, now):
+        self.tokens = min(self.burst, self.tokens + (now - self.last_update) * self.rate)
+        self.last_update = now
+
+    def consume(self, cost, now):
+        self._update(now)
+        # Always allow a PDU larger than the burst when the bucket is full
+        if self.tokens < min(cost, self.burst):
+            return False
+        self.tokens -= cost
+        self.used += cost
+        return True
+
+#
+# Image to upgrade, read from an image archive.
+#
+class CampaignImage:
+
+    def __init__(self, image, image_type, data, version, zdata=None):
+        self.image = image
+        self.image_type = image_type
+        self.data = data
+        self.version = version
+        self.crc32 = binascii.crc32(data) & 0xffffffff
+        self.zdata = zdata
+
+    def get_upload_data(self, compressed):
+        if compressed and self.zdata is not None:
+            return self.zdata
+        return self.data
+
+def read_archive(filename):
+    zip = zipfile.ZipFile(filename)
+    manifest = get_manifest_data(zip)
+    images = {}
+    for image in (1, 2):
+        key = 'image.' + str(image) + '.type'
+        if key not in manifest:
+            continue
+        data = None
+        zdata = None
+        for info in zip.infolist():
+            if info.filename.endswith(str(image) + ".flash"):
+                data = zip.read(info)
+            elif info.filename.endswith(str(image) + ".flash.lz"):
+                zdata = zip.read(info)
+        if data is None and zdata is not None:
+            data = lzss.decompress(zdata)
+        if data is not None:
+            images[image] = CampaignImage(image, manifest[key], data,
+                                          get_image_version(data), zdata)
+    zip.close()
+    return manifest.get('producttype'), images
+
+#
+# Upgrade state for a single device.
+#
+class DeviceUpgrade:
+
+    def __init__(self, device):
+        self.device = device
+        self.log = device.log
+        self.state = STATE_WAITING
+        self.instance = None
+        self.image = None
+        self.data = None
+        self.compressed = False
+        self.session = 0
+        self.chunk_size = 0
+        self.acked = 0
+        self.resumed = 0
+        self.next_offset = 0
+        self.in_flight = []
+        self.request_time = 0
+        self.retries = 0
+        self.restarts = 0
+        self.started = None
+        self.finished = None
+        self.error = None
+
+    def get_depth(self):
+        rpl = self.device.nstats_rpl
+        if rpl is None or rpl.dag_rank() == 0 or rpl.dag_rank() == 0xffff:
+            return None
+        return max(1, rpl.dag_rank() / MIN_HOP_RANK_INCREASE)
+
+    def is_active(self):
+        return self.state not in (STATE_WAITING, STATE_DONE, STATE_FAILED)
+
+    def remaining(self):
+        if self.data is None:
+            return 0
+        return len(self.data) - self.acked
+
+    def __str__(self):
+        s = "[" + self.device.address + "] " + self.state
+        if self.data is not None:
+            s += " %d/%d bytes"%(self.acked, len(self.data))
+            if self.compressed:
+                s += " (compressed)"
+        depth = self.get_depth()
+        if depth is not None:
+            s += " depth " + str(depth)
+        if self.error:
+            s += " - " + self.error
+        return s
+
+class OtaCampaign:
+
+    # Max number of devices upgraded at the same time
+    max_active = 8
+    # Request PDUs in flight per device
+    window = 2
+    # Image chunks per request PDU
+    chunks_per_pdu = 2
+    # Preferred chunk size, adjusted to the device block size
+    chunk_size = 256
+    # Airtime budget in bytes per second for each border router
+    airtime_rate = 4000
+    # Use compressed images when available in the archive
+    compressed = True
+    reboot = True
+    timeout = 2.5
+    close_timeout = 10.0
+    max_retries = 20
+    max_restarts = 3
+    report_interval = 10
+
+    def __init__(self, server, filename):
+        self.server = server
+        self.filename = filename
+        self.product_type, self.images = read_archive(filename)
+        if not self.images:
+            raise Exception("no images found in " + filename)
+        self.log = logging.getLogger("campaign")
+        self.running = False
+        self._upgrades = {}
+        self._budgets = {}
+        self._lock = threading.RLock()
+        self._thread = None
+        self.started = None
+        self.finished = None
+        self.bytes_acked = 0
+        self._next_report = 0
+
+    def add_device(self, device):
+        with self._lock:
+            if device.address not in self._upgrades:
+                self._upgrades[device.address] = DeviceUpgrade(device)
+
+    def get_upgrades(self):
+        with self._lock:
+            return list(self._upgrades.values())
+
+    def start(self):
+        if self.running:
+            return
+        # Failed upgrades are retried from the device's reported progress
+        with self._lock:
+            for upgrade in self._upgrades.values():
+                if upgrade.state == STATE_FAILED:
+                    upgrade.state = STATE_WAITING
+                    upgrade.error = None
+                    upgrade.retries = 0
+                    upgrade.restarts = 0
+        self.running = True
+        self.started = time.time()
+        self.finished = None
+        self.bytes_acked = 0
+        # The network depth is needed to prioritise the devices
+        for upgrade in self.get_upgrades():
+            if upgrade.get_depth() is None:
+                self.server.fetch_nstats()
+                break
+        self.server.add_tlv_listener(self._process_tlvs)
+        self._thread = threading.Thread(target=self._run)
+        self._thread.daemon = True
+        self._thread.start()
+
+    def stop(self):
+        self.running = False
+        self.server.remove_tlv_listener(self._process_tlvs)
+
+    def is_running(self):
+        return self.running
+
+    def _get_budget(self, upgrade):
+        # All devices are currently reached through the same border router
+        router = self.server.router_host
+        budget = self._budgets.get(router)
+        if budget is None:
+            budget = AirtimeBudget(self.airtime_rate)
+            self._budgets[router] = budget
+        return budget
+
+    def _get_cost(self, upgrade, size):
+        depth = upgrade.get_depth()
+        if depth is None:
+            # Unknown depth - assume a few hops
+            depth = 3
+        return size * depth
+
+    # Shallow devices first, unknown depth last
+    def _get_priority(self, upgrade):
+        depth = upgrade.get_depth()
+        if depth is None:
+            return (1000, upgrade.device.address)
+        return (depth, upgrade.device.address)
+
+    def _send(self, upgrade, tlvs, now):
+        upgrade.request_time = now
+        upgrade.device.send_tlv(tlvs)
+
+    def _fail(self, upgrade, error):
+        upgrade.state = STATE_FAILED
+        upgrade.error = error
+        upgrade.finished = time.time()
+        upgrade.in_flight = []
+        upgrade.log.error("upgrade failed: %s", error)
+
+    def _done(self, upgrade, message=None):
+        upgrade.state = STATE_DONE
+        upgrade.error = message
+        upgrade.finished = time.time()
+        upgrade.log.info("upgrade done%s", " - " + message if message else "")
+
+    # ----------------------------------------------------------------
+    # Scheduling
+    # ----------------------------------------------------------------
+    def _run(self):
+        while self.running:
+            now = time.time()
+            with self._lock:
+                self._schedule(now)
+                if now >= self._next_report:
+                    self._next_report = now + self.report_interval
+                    self.log.info(self.get_status())
+                if self._is_finished():
+                    self.finished = now
+                    self.log.info("campaign finished: %s", self.get_status())
+                    self.stop()
+            time.sleep(0.02)
+
+    def _is_finished(self):
+        for upgrade in self._upgrades.values():
+            if upgrade.state not in (STATE_DONE, STATE_FAILED):
+                return False
+        return True
+
+    def _schedule(self, now):
+        upgrades = sorted(self._upgrades.values(), key=self._get_priority)
+        active = [u for u in upgrades if u.is_active()]
+        for upgrade in upgrades:
+            if len(active) >= self.max_active:
+                break
+            if upgrade.state == STATE_WAITING:
+                if not upgrade.device.is_discovered():
+                    continue
+                if upgrade.device.is_sleepy_device():
+                    self._fail(upgrade, "sleepy devices are not supported")
+                    continue
+                self._prepare(upgrade, now)
+                active.append(upgrade)
+
+        for upgrade in active:
+            if upgrade.state == STATE_WRITE:
+                self._check_write_timeout(upgrade, now)
+            elif upgrade.state in (STATE_PREPARE, STATE_OPEN, STATE_VERIFY, STATE_RESTART):
+                if now > upgrade.request_time + self.timeout:
+                    self._retry(upgrade, now)
+            elif upgrade.state == STATE_CLOSE:
+                if now > upgrade.request_time + self.close_timeout:
+                    self._retry(upgrade, now)
+
+        # Share the airtime between the writing devices in priority
+        # order, one PDU at a time
+        sending = True
+        while sending:
+            sending = False
+            for upgrade in active:
+                if upgrade.state != STATE_WRITE:
+                    continue
+                if len(upgrade.in_flight) >= self.window:
+                    continue
+                if upgrade.next_offset >= len(upgrade.data):
+                    continue
+                if not self._send_chunks(upgrade, now):
+                    # Out of airtime for now
+                    return
+                sending = True
+
+    def _retry(self, upgrade, now):
+        upgrade.retries += 1
+        if upgrade.retries > self.max_retries:
+            self._fail(upgrade, "no response in state " + upgrade.state)
+        elif upgrade.state == STATE_PREPARE:
+            self._prepare(upgrade, now)
+        elif upgrade.state == STATE_OPEN:
+            self._open(upgrade, now)
+        elif upgrade.state == STATE_VERIFY:
+            self._verify(upgrade, now)
+        elif upgrade.state == STATE_CLOSE:
+            self._close(upgrade, now)
+        elif upgrade.state == STATE_RESTART:
+            self._restart(upgrade, now)
+
+    def _check_write_timeout(self, upgrade, now):
+        if len(upgrade.in_flight) == 0:
+            if upgrade.next_offset >= len(upgrade.data):
+                # Everything is sent but not acked - ask for the progress
+                upgrade.next_offset = upgrade.acked
+            return
+        if now > upgrade.in_flight[0][1] + self.timeout:
+            # Go back to the device's reported progress
+            upgrade.retries += 1
+            upgrade.in_flight = []
+            upgrade.next_offset = upgrade.acked
+            if upgrade.retries > self.max_retries:
+                self._fail(upgrade, "too many retries at %d bytes"%upgrade.acked)
+
+    # ----------------------------------------------------------------
+    # Requests
+    # ----------------------------------------------------------------
+    def _prepare(self, upgrade, now):
+        upgrade.state = STATE_PREPARE
+        if upgrade.started is None:
+            upgrade.started = now
+        tlvs = []
+        i = 1
+        for data in upgrade.device.device_info[1]:
+            if data[0] == tlvlib.INSTANCE_IMAGE:
+                tlvs.append(tlvlib.create_get_tlv64(i, tlvlib.VARIABLE_IMAGE_VERSION))
+                tlvs.append(tlvlib.create_get_tlv32(i, tlvlib.VARIABLE_IMAGE_STATUS))
+                tlvs.append(tlvlib.create_get_tlv64(i, tlvlib.VARIABLE_IMAGE_TYPE))
+            i += 1
+        if not tlvs:
+            self._fail(upgrade, "no image instances")
+            return
+        self._send(upgrade, tlvs, now)
+
+    def _open(self, upgrade, now):
+        upgrade.state = STATE_OPEN
+        instance = upgrade.instance
+        progress = tlvlib.VARIABLE_WRITE_PROGRESS
+        if upgrade.compressed:
+            progress = tlvlib.VARIABLE_COMPRESSED_PROGRESS
+        t1 = tlvlib.create_set_tlv32(instance, tlvlib.VARIABLE_WRITE_SESSION, upgrade.session)
+        t2 = tlvlib.create_get_tlv32(instance, tlvlib.VARIABLE_WRITE_BLOCK_SIZE)
+        t3 = tlvlib.create_get_tlv32(instance, progress)
+        self._send(upgrade, [t1, t2, t3], now)
+
+    def _send_chunks(self, upgrade, now):
+        instance = upgrade.instance
+        tlvs = []
+        size = 0
+        offset = upgrade.next_offset
+        for i in range(self.chunks_per_pdu):
+            if offset >= len(upgrade.data):
+                break
+            chunk = upgrade.data[offset:offset + upgrade.chunk_size]
+            if len(chunk) % 4 > 0:
+                chunk += "\0" * (4 - (len(chunk) % 4))
+            if upgrade.compressed:
+                var = tlvlib.VARIABLE_COMPRESSED_FLASH
+            else:
+                var = tlvlib.VARIABLE_FLASH
+            tlvs.append(tlvlib.create_set_vector_tlv(instance, var, tlvlib.SIZE32,
+                                                     offset / 4, len(chunk) / 4, chunk))
+            offset += len(chunk)
+            size += len(chunk)
+        if upgrade.compressed:
+            tlvs.append(tlvlib.create_get_tlv32(instance, tlvlib.VARIABLE_COMPRESSED_PROGRESS))
+        else:
+            tlvs.append(tlvlib.create_get_tlv32(instance, tlvlib.VARIABLE_WRITE_PROGRESS))
+        # Include headers in the airtime
+        if not self._get_budget(upgrade).consume(self._get_cost(upgrade, size + 16 * len(tlvs)), now):
+            return False
+        upgrade.in_flight.append((offset, now))
+        upgrade.next_offset = offset
+        self._send(upgrade, tlvs, now)
+        return True
+
+    def _verify(self, upgrade, now):
+        upgrade.state = STATE_VERIFY
+        t = tlvlib.create_get_tlv32(upgrade.instance, tlvlib.VARIABLE_WRITE_CRC32)
+        self._send(upgrade, t, now)
+
+    def _close(self, upgrade, now):
+        upgrade.state = STATE_CLOSE
+        # Closing the session erases any old data after the image
+        t1 = tlvlib.create_set_tlv32(upgrade.instance, tlvlib.VARIABLE_WRITE_SESSION, 0)
+        t2 = tlvlib.create_get_tlv32(upgrade.instance, tlvlib.VARIABLE_IMAGE_STATUS)
+        self._send(upgrade, [t1, t2], now)
+
+    def _restart(self, upgrade, now):
+        # The session must be reopened after a decoding failure
+        upgrade.state = STATE_RESTART
+        upgrade.in_flight = []
+        t = tlvlib.create_set_tlv32(upgrade.instance, tlvlib.VARIABLE_WRITE_SESSION, 0)
+        self._send(upgrade, t, now)
+
+    # ----------------------------------------------------------------
+    # Responses - called from the device server receive threads
+    # ----------------------------------------------------------------
+    def _process_tlvs(self, device, tlvs):
+        with self._lock:
+            upgrade = self._upgrades.get(device.address)
+            if upgrade is None or not upgrade.is_active():
+                return
+            now = time.time()
+            try:
+                if upgrade.state == STATE_PREPARE:
+                    self._handle_prepare(upgrade, tlvs, now)
+                elif upgrade.state == STATE_OPEN:
+                    self._handle_open(upgrade, tlvs, now)
+                elif upgrade.state == STATE_WRITE:
+                    self._handle_write(upgrade, tlvs, now)
+                elif upgrade.state == STATE_VERIFY:
+                    self._handle_verify(upgrade, tlvs, now)
+                elif upgrade.state == STATE_CLOSE:
+                    self._handle_close(upgrade, tlvs, now)
+                elif upgrade.state == STATE_RESTART:
+                    self._handle_restart(upgrade, tlvs, now)
+            except Exception as e:
+                self._fail(upgrade, "bad response: " + str(e))
+
+    def _find(self, upgrade, tlvs, variable, instance=None):
+        if instance is None:
+            instance = upgrade.instance
+        for t in tlvs:
+            if t.instance == instance and t.variable == variable:
+                return t
+        return None
+
+    def _handle_prepare(self, upgrade, tlvs, now):
+        instances = {}
+        for t in tlvs:
+            if t.error == 0 and t.variable in (tlvlib.VARIABLE_IMAGE_VERSION,
+                                               tlvlib.VARIABLE_IMAGE_STATUS,
+                                               tlvlib.VARIABLE_IMAGE_TYPE):
+                instances.setdefault(t.instance, {})[t.variable] = t
+        if not instances:
+            return
+        running_version = None
+        upgrade.instance = None
+        for i in sorted(instances.keys()):
+            vars = instances[i]
+            if len(vars) != 3:
+                return
+            status = vars[tlvlib.VARIABLE_IMAGE_STATUS].int_value
+            if (status & tlvlib.IMAGE_STATUS_ACTIVE) != 0:
+                running_version = vars[tlvlib.VARIABLE_IMAGE_VERSION].int_value & 0xffffffffffffffff
+            elif upgrade.instance is None:
+                upgrade.instance = i
+                upgrade_type = binascii.hexlify(vars[tlvlib.VARIABLE_IMAGE_TYPE].value)
+
+        if upgrade.instance is None:
+            self._fail(upgrade, "no unused image found")
+            return
+        label = upgrade.device.device_info[1][upgrade.instance - 1][1]
+        if label == "Primary firmware":
+            image = 1
+        elif label == "Backup firmware":
+            image = 2
+        else:
+            self._fail(upgrade, "unknown image " + label)
+            return
+        if image not in self.images:
+            self._fail(upgrade, "image " + str(image) + " not found in archive")
+            return
+        upgrade.image = self.images[image]
+        if upgrade.image.image_type != upgrade_type:
+            self._fail(upgrade, "wrong image type " + upgrade.image.image_type + " != " + upgrade_type)
+            return
+        if running_version == upgrade.image.version:
+            self._done(upgrade, "already running version %016x"%running_version)
+            return
+
+        upgrade.compressed = self.compressed and upgrade.image.zdata is not None
+        upgrade.data = upgrade.image.get_upload_data(upgrade.compressed)
+        if upgrade.compressed:
+            session_crc32 = lzss.get_header(upgrade.data)['crc32']
+        else:
+            session_crc32 = upgrade.image.crc32
+        upgrade.session = (session_crc32 & 0x7fffffff) | 1
+        upgrade.retries = 0
+        self._open(upgrade, now)
+
+    def _handle_open(self, upgrade, tlvs, now):
+        session = self._find(upgrade, tlvs, tlvlib.VARIABLE_WRITE_SESSION)
+        block_size = self._find(upgrade, tlvs, tlvlib.VARIABLE_WRITE_BLOCK_SIZE)
+        if upgrade.compressed:
+            progress = self._find(upgrade, tlvs, tlvlib.VARIABLE_COMPRESSED_PROGRESS)
+        else:
+            progress = self._find(upgrade, tlvs, tlvlib.VARIABLE_WRITE_PROGRESS)
+        if session is None or block_size is None or progress is None:
+            return
+        if session.error != 0 or block_size.error != 0 or progress.error != 0:
+            # Try again after the timeout
+            return
+        device_block_size = block_size.int_value & 0xffffffff
+        if upgrade.compressed:
+            # Compressed data is decoded as a stream and can be sent in any size
+            upgrade.chunk_size = max(4, self.chunk_size / 4 * 4)
+        else:
+            # Chunks must be a multiple of the device block size
+            upgrade.chunk_size = max(1, self.chunk_size / device_block_size) * device_block_size
+        upgrade.acked = min((progress.int_value & 0xffffffff) * 4, len(upgrade.data))
+        if upgrade.resumed == 0 and upgrade.acked > 0:
+            upgrade.resumed = upgrade.acked
+            upgrade.log.info("resuming upgrade at %d of %d bytes", upgrade.acked, len(upgrade.data))
+        upgrade.next_offset = upgrade.acked
+        upgrade.in_flight = []
+        upgrade.retries = 0
+        upgrade.state = STATE_WRITE
+        if upgrade.acked >= len(upgrade.data):
+            self._verify(upgrade, now)
+
+    def _handle_write(self, upgrade, tlvs, now):
+        if upgrade.compressed:
+            for t in tlvs:
+                if t.variable == tlvlib.VARIABLE_COMPRESSED_FLASH and t.error not in (0, ERROR_INVALID_VECTOR_OFFSET):
+                    upgrade.restarts += 1
+                    if upgrade.restarts > self.max_restarts:
+                        self._fail(upgrade, "decompression failed")
+                    else:
+                        upgrade.log.warning("decompression failed - restarting session")
+                        self._restart(upgrade, now)
+                    return
+            progress = self._find(upgrade, tlvs, tlvlib.VARIABLE_COMPRESSED_PROGRESS)
+        else:
+            progress = self._find(upgrade, tlvs, tlvlib.VARIABLE_WRITE_PROGRESS)
+        if progress is None:
+            return
+        if upgrade.in_flight:
+            # Replies arrive in order unless lost
+            upgrade.in_flight.pop(0)
+        if progress.error != 0:
+            return
+        acked = min((progress.int_value & 0xffffffff) * 4, len(upgrade.data))
+        if acked > upgrade.acked:
+            self.bytes_acked += acked - upgrade.acked
+            upgrade.acked = acked
+            upgrade.retries = 0
+        # Drop requests that are already acked
+        upgrade.in_flight = [f for f in upgrade.in_flight if f[0] > upgrade.acked]
+        if upgrade.next_offset < upgrade.acked:
+            upgrade.next_offset = upgrade.acked
+        if upgrade.acked >= len(upgrade.data):
+            upgrade.in_flight = []
+            self._verify(upgrade, now)
+
+    def _handle_verify(self, upgrade, tlvs, now):
+        t = self._find(upgrade, tlvs, tlvlib.VARIABLE_WRITE_CRC32)
+        if t is None or t.error != 0:
+            return
+        write_crc32 = t.int_value & 0xffffffff
+        if write_crc32 != upgrade.image.crc32:
+            self._fail(upgrade, "session CRC32 mismatch %08x != %08x"%(write_crc32, upgrade.image.crc32))
+            return
+        upgrade.retries = 0
+        self._close(upgrade, now)
+
+    def _handle_close(self, upgrade, tlvs, now):
+        session = self._find(upgrade, tlvs, tlvlib.VARIABLE_WRITE_SESSION)
+        status = self._find(upgrade, tlvs, tlvlib.VARIABLE_IMAGE_STATUS)
+        if session is None or status is None or session.error != 0 or status.error != 0:
+            return
+        if status.int_value != tlvlib.IMAGE_STATUS_WRITABLE:
+            self._fail(upgrade, "bad image status: " + tlvlib.get_image_status_as_string(status.int_value))
+            return
+        if self.reboot:
+            t = tlvlib.create_set_tlv32(0, tlvlib.VARIABLE_HARDWARE_RESET, 1)
+            upgrade.device.send_tlv(t)
+            self._done(upgrade, "rebooting to new image")
+        else:
+            self._done(upgrade)
+
+    def _handle_restart(self, upgrade, tlvs, now):
+        session = self._find(upgrade, tlvs, tlvlib.VARIABLE_WRITE_SESSION)
+        if session is None or session.error != 0:
+            return
+        upgrade.retries = 0
+        self._open(upgrade, now)
+
+    # ----------------------------------------------------------------
+    # Status
+    # ----------------------------------------------------------------
+    def get_throughput(self):
+        if self.started is None:
+            return 0
+        elapsed = (self.finished or time.time()) - self.started
+        if elapsed <= 0:
+            return 0
+        return self.bytes_acked / elapsed
+
+    def get_eta(self):
+        throughput = self.get_throughput()
+        remaining = 0
+        for upgrade in self.get_upgrades():
+            if upgrade.state in (STATE_DONE, STATE_FAILED):
+                continue
+            if upgrade.data is not None:
+                remaining += upgrade.remaining()
+            else:
+                # Not yet prepared - estimate using the largest image
+                remaining += max([len(i.get_upload_data(self.compressed)) for i in self.images.values()])
+        if remaining == 0:
+            return 0
+        if throughput <= 0:
+            return None
+        return remaining / throughput
+
+    def get_status(self):
+        states = {}
+        for upgrade in self.get_upgrades():
+            states[upgrade.state] = states.get(upgrade.state, 0) + 1
+        s = ", ".join([k + ": " + str(v) for k,v in sorted(states.items())])
+        s += " - %d bytes acked, %.0f bytes/s"%(self.bytes_acked, self.get_throughput())
+        eta = self.get_eta()
+        if self.finished is not None:
+            s += ", finished in %.0f s"%(self.finished - self.started)
+        elif eta is not None:
+            s += ", ETA %.0f s"%eta
+        return s
+
+    def print_status(self):
+        print "Campaign", self.filename, "-", self.get_status()
+        for upgrade in sorted(self.get_upgrades(), key=self._get_priority):
+            print "  ", upgrade
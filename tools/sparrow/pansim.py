@@ -0,0 +1,1828 @@
+#!/usr/bin/env python
+#
+# Copyright (c) 2016, Yanzi Networks AB.
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions are met:
+#   1. Redistributions of source code must retain the above copyright
+#      notice, this list of conditions and the following disclaimer.
+#   2. Redistributions in binary form must reproduce the above copyright
+#      notice, this list of conditions and the following disclaimer in the
+#      documentation and/or other materials provided with the distribution.
+#   3. Neither the name of the copyright holders nor the
+#      names of its contributors may be used to endorse or promote products
+#      derived from this software without specific prior written permission.
+#
+# THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+# "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+# LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+# FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+# COPYRIGHT HOLDERS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+# SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+# LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF
+# USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+# ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+# OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+# OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+# Author: Niclas Finne, nfi@sics.se
+#
+# PAN simulator for scaling tests of the native border router.
+#
+# The simulator emulates a serial radio that the border router connects
+# to over TCP and a PAN of lightweight virtual nodes behind it. The
+# nodes run a model of RPL storing mode (DIS, DIO trickle, DAO with
+# DAO-ACK and retransmissions), answer neighbor solicitations, echo
+# requests and OAM instance 0 requests. Only the nodes within range of
+# the border router exchange real 802.15.4/6LoWPAN frames with it, all
+# other hops are modelled by the link model.
+#
+# The PAN side is deterministic for a given seed: topology, link loss
+# and node timers are drawn from seeded generators and the timers of
+# the nodes are accelerated with the time factor. The border router
+# itself runs in real time.
+#
+# Usage:
+#   ./pansim.py -n 500 -x 10 -s coldstart,repair,reports,ota &
+#   sudo ./border-router.native -a localhost -p 60001 -i fd02::1/64
+#
+# The global repair phase sends !G to the UDP control port of the
+# border router. The report and OTA phases send traffic between the
+# host and the PAN through the tun interface of the border router.
+#
+# With --standby-port a second serial radio, co-located with the first,
+# is emulated for a hot standby border router:
+#   ./pansim.py -n 500 -x 10 --standby-port 60002 --kill-pid <pid> \
+#       -s coldstart,failover,reports &
+#   sudo ./border-router.native -a localhost -p 60001 -y /tmp/br.sock ...
+#   sudo ./border-router.native -a localhost -p 60002 -Y /tmp/br.sock ...
+# The failover phase kills the active border router and measures how
+# long it takes until the nodes have moved to the standby.
+#
+# The restart phase kills the border router, or waits for it to stop,
+# and measures how long it takes after it is back until the host
+# reaches the nodes again. The border router must be started again
+# by hand or by a supervisor, for example with and without -R to
+# compare a restored checkpoint with a relearned DODAG:
+#   ./pansim.py -n 100 -s coldstart,restart -b border-router.native &
+#   while true; do sudo ./border-router.native -a localhost -p 60001 \
+#       -R /tmp/br.snapshot ...; done
+#
+
+import tlvlib, serialradio
+import sys, os, signal, socket, select, struct, time, random, heapq, math, argparse
+
+RADIO_API_VERSION = 3
+SUPPORTED_RADIO_TYPE = 0x0090DA0301010482
+NODE_PRODUCT_TYPE = 0x0090DA0302010015
+SW_REVISION = "pansim"
+
+RADIO_MAC = "\x00\x12\x4b\x00\x00\x00\x00\x01"
+STANDBY_RADIO_MAC = "\x00\x12\x4b\x00\x00\x00\x00\x02"
+NODE_MAC_BASE = 0x00124b0001000000
+
+OAM_PORT = 49111
+REPORT_PORT = 47011
+
+# Serial radio
+ATTR_CHANNEL = 1
+ATTR_LINK_QUALITY = 2
+ATTR_RSSI = 3
+ATTR_TIMESTAMP = 4
+ATTR_MAX_MAC_TRANSMISSIONS = 8
+
+MAC_TX_OK = 0
+MAC_TX_NOACK = 2
+
+# 802.15.4
+FRAME_MAX = 127 - 2
+FRAME_TYPE_DATA = 1
+ADDR_NONE = 0
+ADDR_SHORT = 2
+ADDR_LONG = 3
+BROADCAST = "\xff\xff"
+MAX_MAC_TRANSMISSIONS = 3
+HOP_DELAY = 0.008
+
+# IPv6 and 6LoWPAN
+PROTO_HBHO = 0
+PROTO_UDP = 17
+PROTO_ROUTING = 43
+PROTO_FRAG = 44
+PROTO_ICMP6 = 58
+PROTO_DESTO = 60
+EXT_HEADERS = { PROTO_HBHO, PROTO_ROUTING, PROTO_DESTO }
+NHC_EXT_PROTO = { 0: PROTO_HBHO, 1: PROTO_ROUTING, 2: PROTO_FRAG, 3: PROTO_DESTO }
+
+ICMP6_ECHO_REQUEST = 128
+ICMP6_ECHO_REPLY = 129
+ICMP6_NS = 135
+ICMP6_NA = 136
+ICMP6_RPL = 155
+
+LINKLOCAL_PREFIX = "\xfe\x80" + "\x00" * 6
+ALL_NODES = "\xff\x02" + "\x00" * 13 + "\x01"
+ALL_RPL_NODES = "\xff\x02" + "\x00" * 13 + "\x1a"
+SOLICITED_NODE = "\xff\x02" + "\x00" * 9 + "\x01\xff"
+REASS_TIMEOUT = 8.0
+
+# RPL
+RPL_CODE_DIS = 0
+RPL_CODE_DIO = 1
+RPL_CODE_DAO = 2
+RPL_CODE_DAO_ACK = 3
+RPL_OPTION_DAG_CONF = 4
+RPL_OPTION_TARGET = 5
+RPL_OPTION_TRANSIT = 6
+RPL_OPTION_PREFIX_INFO = 8
+RPL_OPTION_6CO = 34
+RPL_DAO_K_FLAG = 0x80
+RPL_DAO_D_FLAG = 0x40
+RPL_LOLLIPOP_INIT = 240
+INFINITE_RANK = 0xffff
+
+RPL_DIS_START_DELAY = 5
+RPL_DIS_INTERVAL = 60
+RPL_DAO_DELAY = 4
+RPL_DAO_RETRANSMISSION_TIMEOUT = 5
+RPL_DAO_MAX_RETRANSMISSIONS = 5
+RPL_DAO_GIVE_UP_DELAY = 60
+RPL_PROBING_INTERVAL = 120
+
+def lollipop_increment(counter):
+    if counter > 127:
+        return (counter + 1) & 0xff
+    return (counter + 1) & 0x7f
+
+def lollipop_greater(a, b):
+    def local(a, b):
+        return (a < b and 128 - b + a < 16) or (a > b and a - b < 16)
+    if a > 127:
+        return local(a, b) if b > 127 else False
+    return True if b > 127 else local(a, b)
+
+def format_addr(addr):
+    return socket.inet_ntop(socket.AF_INET6, addr)
+
+def iid_from_mac(mac):
+    if len(mac) == 2:
+        return "\x00\x00\x00\xff\xfe\x00" + mac
+    return chr(ord(mac[0]) ^ 0x02) + mac[1:]
+
+def checksum(src, dst, proto, payload):
+    data = src + dst + struct.pack("!LxxxB", len(payload), proto) + payload
+    if len(data) & 1:
+        data += "\x00"
+    total = sum(struct.unpack("!%dH" % (len(data) / 2), data))
+    while total >> 16:
+        total = (total & 0xffff) + (total >> 16)
+    return ~total & 0xffff
+
+def create_ipv6(src, dst, proto, payload, hlim=64):
+    return struct.pack("!LHBB", 6 << 28, len(payload), proto, hlim) + src + dst + payload
+
+def create_icmp6(src, dst, type, code, body, hlim=64):
+    msg = struct.pack("!BBH", type, code, 0) + body
+    msg = msg[:2] + struct.pack("!H", checksum(src, dst, PROTO_ICMP6, msg)) + msg[4:]
+    return create_ipv6(src, dst, PROTO_ICMP6, msg, hlim)
+
+def create_udp(src, dst, sport, dport, data):
+    msg = struct.pack("!HHHH", sport, dport, 8 + len(data), 0) + data
+    c = checksum(src, dst, PROTO_UDP, msg) or 0xffff
+    return create_ipv6(src, dst, PROTO_UDP, msg[:6] + struct.pack("!H", c) + msg[8:])
+
+# Returns the upper layer protocol and its offset in the datagram
+def upper_layer(packet):
+    proto = ord(packet[6])
+    pos = 40
+    while proto in EXT_HEADERS and pos + 2 <= len(packet):
+        proto, length = ord(packet[pos]), ord(packet[pos + 1])
+        pos += (length + 1) * 8
+    return proto, pos
+
+#
+# 802.15.4 frames
+#
+def create_frame(seqno, panid, src, dst):
+    ack = 1 if dst != BROADCAST else 0
+    dst_mode = ADDR_SHORT if len(dst) == 2 else ADDR_LONG
+    fcf = FRAME_TYPE_DATA | (ack << 5) | (1 << 6) | (dst_mode << 10) | (1 << 12) | (ADDR_LONG << 14)
+    return struct.pack("<HBH", fcf, seqno & 0xff, panid) + dst[::-1] + src[::-1]
+
+def frame_header_len(dst):
+    return 5 + len(dst) + 8
+
+# Returns (dst panid, src address, dst address, payload) or None
+def parse_frame(data):
+    if len(data) < 3:
+        return None
+    fcf, = struct.unpack_from("<H", data)
+    frame_type = fcf & 7
+    security = (fcf >> 3) & 1
+    compression = (fcf >> 6) & 1
+    suppress_seqno = (fcf >> 8) & 1
+    dst_mode = (fcf >> 10) & 3
+    version = (fcf >> 12) & 3
+    src_mode = (fcf >> 14) & 3
+    if frame_type != FRAME_TYPE_DATA or security:
+        return None
+    pos = 2 if suppress_seqno and version == 2 else 3
+
+    if version == 2:
+        # IEEE 802.15.4-2015 table 7-2
+        has_dst_pan = ((dst_mode == 0 and src_mode == 0 and compression) or
+                       (dst_mode != 0 and src_mode == 0 and not compression) or
+                       (dst_mode == ADDR_LONG and src_mode == ADDR_LONG and not compression) or
+                       (dst_mode == ADDR_SHORT and src_mode != 0) or
+                       (dst_mode != 0 and src_mode == ADDR_SHORT))
+        has_src_pan = not compression and (
+            (dst_mode == 0 and src_mode != 0) or
+            (dst_mode == ADDR_SHORT and src_mode != 0) or
+            (dst_mode == ADDR_LONG and src_mode == ADDR_SHORT))
+    else:
+        has_dst_pan = dst_mode != 0
+        has_src_pan = src_mode != 0 and not compression
+
+    panid = None
+    dst = src = None
+    if dst_mode:
+        if has_dst_pan:
+            panid, = struct.unpack_from("<H", data, pos)
+            pos += 2
+        n = 2 if dst_mode == ADDR_SHORT else 8
+        dst = data[pos:pos + n][::-1]
+        pos += n
+    if src_mode:
+        if has_src_pan:
+            if panid is None:
+                panid, = struct.unpack_from("<H", data, pos)
+            pos += 2
+        n = 2 if src_mode == ADDR_SHORT else 8
+        src = data[pos:pos + n][::-1]
+        pos += n
+    if pos > len(data):
+        return None
+    return panid, src, dst, data[pos:]
+
+#
+# 6LoWPAN
+#
+
+# IPHC with inline next header and only the addresses compressed that
+# can be derived from the link layer. Returns the IPHC header and the
+# part of the datagram that follows the 40 byte IPv6 header.
+def compress(packet, src_mac, dst_mac):
+    hlim = ord(packet[7])
+    src = packet[8:24]
+    dst = packet[24:40]
+    iphc0 = 0x60 | 0x18
+    iphc1 = 0
+    inline = packet[6]
+    if hlim == 1:
+        iphc0 |= 1
+    elif hlim == 64:
+        iphc0 |= 2
+    elif hlim == 255:
+        iphc0 |= 3
+    else:
+        inline += packet[7]
+
+    if src[:8] == LINKLOCAL_PREFIX and src[8:] == iid_from_mac(src_mac):
+        iphc1 |= 0x30
+    elif src[:8] == LINKLOCAL_PREFIX:
+        iphc1 |= 0x10
+        inline += src[8:]
+    else:
+        inline += src
+
+    if dst[0] == "\xff":
+        iphc1 |= 0x08
+        if dst[:2] == "\xff\x02" and dst[2:15] == "\x00" * 13:
+            iphc1 |= 0x03
+            inline += dst[15]
+        else:
+            inline += dst
+    elif dst[:8] == LINKLOCAL_PREFIX and dst_mac != BROADCAST and dst[8:] == iid_from_mac(dst_mac):
+        iphc1 |= 0x03
+    elif dst[:8] == LINKLOCAL_PREFIX:
+        iphc1 |= 0x01
+        inline += dst[8:]
+    else:
+        inline += dst
+    return chr(iphc0) + chr(iphc1) + inline, packet[40:]
+
+def decompress_addr(data, pos, mode, prefix, mac):
+    if mode == 0:
+        if prefix != LINKLOCAL_PREFIX:
+            # Unspecified address
+            return "\x00" * 16, pos
+        return data[pos:pos + 16], pos + 16
+    if mode == 1:
+        return prefix + data[pos:pos + 8], pos + 8
+    if mode == 2:
+        return prefix + "\x00\x00\x00\xff\xfe\x00" + data[pos:pos + 2], pos + 2
+    return prefix + iid_from_mac(mac), pos
+
+# Decompress the IPHC header at data[pos:]. Returns the uncompressed
+# headers (with zero length fields), the position after the compressed
+# headers, and the offset of a decompressed UDP header or None.
+def decompress(data, pos, src_mac, dst_mac, contexts):
+    iphc0, iphc1 = ord(data[pos]), ord(data[pos + 1])
+    pos += 2
+    sci = dci = 0
+    if iphc1 & 0x80:
+        sci, dci = ord(data[pos]) >> 4, ord(data[pos]) & 0x0f
+        pos += 1
+
+    # The traffic class and flow label are not needed by the nodes
+    tf = (iphc0 >> 3) & 3
+    pos += (4, 3, 1, 0)[tf]
+
+    nh = None
+    if not iphc0 & 0x04:
+        nh = ord(data[pos])
+        pos += 1
+    if iphc0 & 3:
+        hlim = (0, 1, 64, 255)[iphc0 & 3]
+    else:
+        hlim = ord(data[pos])
+        pos += 1
+
+    sam = (iphc1 >> 4) & 3
+    if iphc1 & 0x40:
+        if sci not in contexts:
+            raise ValueError("unknown context %u" % sci)
+        src, pos = decompress_addr(data, pos, sam, contexts[sci], src_mac)
+    else:
+        src, pos = decompress_addr(data, pos, sam, LINKLOCAL_PREFIX, src_mac)
+
+    dam = iphc1 & 3
+    if iphc1 & 0x08:
+        if iphc1 & 0x04:
+            raise ValueError("unsupported multicast compression")
+        if dam == 0:
+            dst = data[pos:pos + 16]
+            pos += 16
+        elif dam == 1:
+            dst = "\xff" + data[pos] + "\x00" * 9 + data[pos + 1:pos + 6]
+            pos += 6
+        elif dam == 2:
+            dst = "\xff" + data[pos] + "\x00" * 11 + data[pos + 1:pos + 4]
+            pos += 4
+        else:
+            dst = "\xff\x02" + "\x00" * 13 + data[pos]
+            pos += 1
+    elif iphc1 & 0x04:
+        if dci not in contexts:
+            raise ValueError("unknown context %u" % dci)
+        dst, pos = decompress_addr(data, pos, dam, contexts[dci], dst_mac)
+    else:
+        dst, pos = decompress_addr(data, pos, dam, LINKLOCAL_PREFIX, dst_mac)
+
+    headers = []
+    udp_offset = None
+    length = 40
+    nhc = nh is None
+    while nhc and (ord(data[pos]) & 0xf0) == 0xe0:
+        eid = (ord(data[pos]) >> 1) & 7
+        nhc = ord(data[pos]) & 1
+        pos += 1
+        next = None
+        if not nhc:
+            next = ord(data[pos])
+            pos += 1
+        n = ord(data[pos])
+        if eid not in NHC_EXT_PROTO:
+            raise ValueError("unsupported extension header %u" % eid)
+        headers.append([NHC_EXT_PROTO[eid], next, data[pos + 1:pos + 1 + n]])
+        pos += 1 + n
+    if nhc and (ord(data[pos]) & 0xf8) == 0xf0:
+        udp = ord(data[pos])
+        pos += 1
+        ports = udp & 3
+        if ports == 0:
+            sport, dport = struct.unpack_from("!HH", data, pos)
+            pos += 4
+        elif ports == 1:
+            sport, = struct.unpack_from("!H", data, pos)
+            dport = 0xf000 | ord(data[pos + 2])
+            pos += 3
+        elif ports == 2:
+            sport = 0xf000 | ord(data[pos])
+            dport, = struct.unpack_from("!H", data, pos + 1)
+            pos += 3
+        else:
+            sport = 0xf0b0 | (ord(data[pos]) >> 4)
+            dport = 0xf0b0 | (ord(data[pos]) & 0x0f)
+            pos += 1
+        # The nodes do not verify the checksum of received datagrams
+        csum = 0
+        if not udp & 0x04:
+            csum, = struct.unpack_from("!H", data, pos)
+            pos += 2
+        headers.append([PROTO_UDP, None, struct.pack("!HHHH", sport, dport, 0, csum)])
+    elif nhc:
+        raise ValueError("unsupported next header compression")
+
+    # Link the next header fields of the decompressed headers
+    for i in range(len(headers)):
+        if headers[i][1] is None and i + 1 < len(headers):
+            headers[i][1] = headers[i + 1][0]
+    if headers:
+        nh = headers[0][0]
+    out = struct.pack("!LHBB", 6 << 28, 0, nh, hlim) + src + dst
+    for proto, next, body in headers:
+        if proto == PROTO_UDP:
+            udp_offset = len(out)
+            out += body
+        else:
+            body = chr(next) + chr((2 + len(body) + 7) / 8 - 1) + body
+            out += body + "\x00" * (-len(body) % 8)
+    return out, pos, udp_offset
+
+def set_lengths(datagram, udp_offset):
+    datagram[4:6] = struct.pack("!H", len(datagram) - 40)
+    if udp_offset is not None:
+        datagram[udp_offset + 4:udp_offset + 6] = struct.pack("!H", len(datagram) - udp_offset)
+    return str(datagram)
+
+# Split a datagram into 6LoWPAN frame payloads with FRAG1/FRAGN headers
+# when needed.
+def fragment(packet, src_mac, dst_mac, max_payload, tag):
+    hdr, rest = compress(packet, src_mac, dst_mac)
+    if len(hdr) + len(rest) <= max_payload:
+        return [hdr + rest]
+    size = len(packet)
+    first = (max_payload - 4 - len(hdr)) & ~7
+    frames = [struct.pack("!HH", 0xc000 | size, tag) + hdr + rest[:first]]
+    offset = 40 + first
+    chunk = (max_payload - 5) & ~7
+    while offset < size:
+        frames.append(struct.pack("!HHB", 0xe000 | size, tag, offset / 8) + packet[offset:offset + chunk])
+        offset += chunk
+    return frames
+
+#
+# OAM
+#
+class Tlv:
+    def __init__(self, op, instance, variable, element_size, error, offset, count, data):
+        self.op = op
+        self.instance = instance
+        self.variable = variable
+        self.element_size = element_size
+        self.error = error
+        self.offset = offset
+        self.count = count
+        self.data = data
+
+def parse_tlvs(data):
+    tlvs = []
+    pos = 0
+    while pos + 8 <= len(data):
+        length = (((ord(data[pos]) & 0x0f) << 8) | ord(data[pos + 1])) * 4
+        if length < 8 or pos + length > len(data):
+            break
+        variable, instance, op, element_size, error = struct.unpack_from("!HBBBB", data, pos + 2)
+        hdr = 8
+        offset = count = 0
+        if op & 0x80:
+            offset, count = struct.unpack_from("!LL", data, pos + 8)
+            hdr = 16
+        tlvs.append(Tlv(op, instance, variable, element_size, error,
+                        offset, count, data[pos + hdr:pos + length]))
+        pos += length
+    return tlvs
+
+def create_tlv_reply(request, error=0, data=""):
+    op = request.op | 1
+    body = struct.pack("!HBBBB", request.variable, request.instance, op,
+                       request.element_size, error)
+    if op & 0x80:
+        body += struct.pack("!LL", request.offset, request.count)
+    body += data + "\x00" * (-len(data) % 4)
+    words = (2 + len(body)) / 4
+    return struct.pack("!BB", (words >> 8) & 0x0f, words & 0xff) + body
+
+def pad_value(value, size_code):
+    size = 4 << size_code
+    return (value + "\x00" * size)[:size]
+
+#
+# Serial radio emulation
+#
+class SerialRadio:
+
+    def __init__(self, sim, port, mac, primary=True):
+        self.sim = sim
+        self.port = port
+        self.mac = mac
+        self.ll = LINKLOCAL_PREFIX + iid_from_mac(mac)
+        self.primary = primary
+        self.server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.server.bind(("", port))
+        self.server.listen(1)
+        self.conn = None
+        self.slip = serialradio.Slip()
+        self.started = time.time()
+        self.channel = 26
+        self.panid = 0xabcd
+        self.mode = 0
+        self.configured = False
+        self.tx_frames = 0
+        self.rx_frames = 0
+        self.first_dio_at = None
+        self.first_dio_real = None
+
+    def sockets(self):
+        return [self.conn if self.conn else self.server]
+
+    # A standby radio stays off the air until its border router has
+    # taken over and set the radio mode
+    def is_up(self):
+        return self.conn is not None and (self.primary or self.mode != 0)
+
+    def handle_read(self, sock):
+        if sock == self.server:
+            self.conn, addr = self.server.accept()
+            self.conn.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            self.sim.log("border router connected to port %u from %s:%d"
+                         % ((self.port,) + addr))
+            return True
+        data = self.conn.recv(4096)
+        if not data:
+            self.sim.log("border router on port %u disconnected" % self.port)
+            self.conn.close()
+            self.conn = None
+            return False
+        frames = self.slip.decode(data)
+        for frame in frames or []:
+            self.handle_frame(frame.data)
+        return True
+
+    def uptime(self):
+        return int((time.time() - self.started) * 1000)
+
+    def send(self, payload_type, data):
+        if not self.conn:
+            return
+        enc = tlvlib.EncapHeader()
+        enc.set_serial(data)
+        enc.payload_type = payload_type
+        self.conn.sendall(serialradio.SLIP_END + self.slip.encode(enc.pack()))
+
+    def handle_frame(self, data):
+        if len(data) < 4 or data[0] == "\r":
+            return
+        version, payload_type, error, modes = struct.unpack_from("!BBBB", data)
+        pos = 4
+        length = len(data) - pos
+        if modes >> 4 == tlvlib.ENC_FP_LENOPT:
+            option, length = struct.unpack_from("!HH", data, pos)
+            pos += 4
+            if len(data) < pos + length + 4:
+                return
+            import binascii
+            if binascii.crc32(data[:pos + length + 4]) & 0xffffffff != tlvlib.CRC_MAGIC_REMAINDER:
+                self.sim.log("serial frame with bad CRC")
+                return
+            if option == tlvlib.ENC_FP_LENOPT_OPTION_SEQNO_CRC:
+                pos += 4
+                length -= 4
+        payload = data[pos:pos + length]
+        if payload_type == tlvlib.ENC_PAYLOAD_TLV:
+            self.handle_tlvs(payload)
+        elif payload_type == tlvlib.ENC_PAYLOAD_SERIAL and len(payload) >= 2:
+            self.handle_command(payload)
+
+    def handle_tlvs(self, data):
+        reply = ""
+        for t in parse_tlvs(data):
+            if t.op != tlvlib.TLV_GET_REQUEST or t.instance != 0:
+                reply += create_tlv_reply(t, 3 if t.instance != 0 else 4)
+            elif t.variable == tlvlib.VARIABLE_OBJECT_TYPE:
+                reply += create_tlv_reply(t, 0, struct.pack("!Q", SUPPORTED_RADIO_TYPE))
+            elif t.variable == tlvlib.VARIABLE_OBJECT_ID:
+                reply += create_tlv_reply(t, 0, "\x00" * 8 + self.mac)
+            elif t.variable == tlvlib.VARIABLE_SW_REVISION:
+                reply += create_tlv_reply(t, 0, pad_value(SW_REVISION, t.element_size))
+            elif t.variable == tlvlib.VARIABLE_BOOTLOADER_VERSION:
+                reply += create_tlv_reply(t, 0, struct.pack("!L", 0))
+            elif t.variable == tlvlib.VARIABLE_CHASSIS_CAPABILITIES:
+                reply += create_tlv_reply(t, 0, struct.pack("!Q", 0))
+            elif t.variable == tlvlib.VARIABLE_NUMBER_OF_INSTANCES:
+                reply += create_tlv_reply(t, 0, struct.pack("!L", 0))
+            else:
+                reply += create_tlv_reply(t, 2)
+        self.send(tlvlib.ENC_PAYLOAD_TLV, reply + tlvlib.NULL_TLV)
+
+    def handle_command(self, data):
+        cmd = data[:2]
+        if cmd == "?v":
+            self.send(tlvlib.ENC_PAYLOAD_SERIAL, "!v" + struct.pack("!L", RADIO_API_VERSION))
+        elif cmd == "?t" and len(data) >= 10:
+            self.send(tlvlib.ENC_PAYLOAD_SERIAL, "!t" + data[2:10] + struct.pack("!Q", self.uptime()))
+        elif cmd == "!S" and len(data) > 3:
+            sid = ord(data[2])
+            status, tx = self.transmit(data[3:])
+            self.send(tlvlib.ENC_PAYLOAD_SERIAL, "!R" + chr(sid) + chr(status) + chr(tx))
+        elif cmd == "!m" and len(data) >= 3:
+            self.mode = ord(data[2])
+        elif cmd == "!P" and len(data) >= 4:
+            self.panid = (ord(data[2]) << 8) | ord(data[3])
+        elif cmd == "!C" and len(data) >= 3:
+            self.channel = ord(data[2])
+            self.configured = True
+        elif cmd == "?C":
+            self.send(tlvlib.ENC_PAYLOAD_SERIAL, "!C" + chr(self.channel))
+        elif cmd == "?P":
+            self.send(tlvlib.ENC_PAYLOAD_SERIAL, "!P" + struct.pack("!H", self.panid))
+        elif cmd == "?m":
+            self.send(tlvlib.ENC_PAYLOAD_SERIAL, "!m" + chr(self.mode))
+
+    def transmit(self, data):
+        # Legacy packet attributes: count followed by index and 16-bit value
+        if not data or ord(data[0]) & 0x80:
+            return MAC_TX_NOACK, 1
+        count = ord(data[0])
+        max_tx = MAX_MAC_TRANSMISSIONS
+        for i in range(count):
+            attr, value = struct.unpack_from("!BH", data, 1 + i * 3)
+            if attr == ATTR_MAX_MAC_TRANSMISSIONS and value > 0:
+                max_tx = value
+        self.tx_frames += 1
+        return self.sim.radio_output(self, data[1 + count * 3:], max_tx)
+
+    def input(self, frame, prr):
+        rssi = int(-45 - 50 * (1.0 - prr)) & 0xffff
+        atts = [(ATTR_CHANNEL, self.channel), (ATTR_LINK_QUALITY, int(prr * 255)),
+                (ATTR_RSSI, rssi), (ATTR_TIMESTAMP, self.uptime() & 0xffff)]
+        data = chr(len(atts)) + "".join(struct.pack("!BH", a, v) for a, v in atts)
+        self.rx_frames += 1
+        self.send(tlvlib.ENC_PAYLOAD_SERIAL, "!S" + data + frame)
+
+#
+# Virtual nodes
+#
+class Node:
+
+    def __init__(self, sim, index, x, y):
+        self.sim = sim
+        self.index = index
+        self.x = x
+        self.y = y
+        self.mac = struct.pack("!Q", NODE_MAC_BASE + index)
+        self.ll = LINKLOCAL_PREFIX + iid_from_mac(self.mac)
+        self.addr = None
+        self.nbrs = []
+        self.root_prr = 0.0
+        self.reset()
+
+    def reset(self):
+        self.booted = False
+        self.version = None
+        self.parent = None
+        self.rank = INFINITE_RANK
+        self.joined_at = None
+        self.registered_at = None
+        self.registered_version = None
+        self.path_seq = RPL_LOLLIPOP_INIT
+        self.dao_seq = RPL_LOLLIPOP_INIT
+        self.dao_out_seq = RPL_LOLLIPOP_INIT
+        self.dao_forwarded = {}
+        self.dao_tries = 0
+        self.dao_timer = None
+        self.dis_timer = None
+        self.trickle_timer = None
+        self.trickle_interval = 0
+        self.trickle_counter = 0
+        self.mac_seqno = self.index & 0xff
+        self.frag_tag = 0
+        self.reassembly = {}
+        self.report_seq = 0
+        self.ota_bytes = 0
+        self.root_radio = self.sim.radios[0]
+        self.switched_at = None
+
+    def name(self):
+        return "node %u" % self.index
+
+    def boot(self):
+        self.booted = True
+        self.dis_timer = self.sim.after(RPL_DIS_START_DELAY * self.sim.timer_rng.random(), self.dis_output)
+
+    def is_root_neighbor(self):
+        return self.root_prr > 0
+
+    # Upward path as a list of (node, prr to next hop) ending with a node
+    # that is a neighbor of the border router, or None without a route
+    def path_up(self):
+        path = []
+        node = self
+        while node is not None and node is not ROOT:
+            if len(path) > len(self.sim.nodes):
+                return None
+            if node.parent is ROOT:
+                path.append((node, node.root_prr))
+                return path
+            if node.parent is None:
+                return None
+            path.append((node, node.parent_prr))
+            node = node.parent
+        return None
+
+    #
+    # RPL
+    #
+    def dis_output(self):
+        if self.parent is not None:
+            return
+        self.sim.mesh_broadcast(self, lambda n: n.dis_input())
+        if self.is_root_neighbor():
+            body = struct.pack("!BB", 0, 0)
+            self.send_to_root(create_icmp6(self.ll, ALL_RPL_NODES, ICMP6_RPL, RPL_CODE_DIS, body), BROADCAST)
+        self.dis_timer = self.sim.after(RPL_DIS_INTERVAL, self.dis_output)
+
+    def dis_input(self):
+        if self.parent is not None:
+            self.reset_trickle()
+
+    def dio_body(self):
+        dag = self.sim.dag
+        return struct.pack("!BBHBBBB", dag.instance, self.version, self.rank,
+                           dag.mop_prf, dag.dtsn, 0, 0) + dag.dag_id + dag.conf
+
+    def dio_output(self):
+        self.sim.mesh_broadcast(self, lambda n, v=self.version, r=self.rank: n.dio_input(self, v, r))
+        if self.is_root_neighbor():
+            self.send_to_root(create_icmp6(self.ll, ALL_RPL_NODES, ICMP6_RPL, RPL_CODE_DIO,
+                                           self.dio_body()), BROADCAST)
+
+    # Unicast DIO to the border router as parent probing in RPL. An idle
+    # node only notices a lost border router radio when a unicast fails.
+    def probe_root(self):
+        if self.parent is ROOT:
+            self.send_to_root(create_icmp6(self.ll, self.root_radio.ll, ICMP6_RPL, RPL_CODE_DIO,
+                                           self.dio_body()), self.root_radio.mac)
+
+    def root_lost(self):
+        self.sim.debug("%s: lost the border router radio on port %u"
+                       % (self.name(), self.root_radio.port))
+        self.parent = None
+        self.rank = INFINITE_RANK
+        self.sim.cancel(self.trickle_timer)
+        self.sim.cancel(self.dao_timer)
+        self.sim.cancel(self.dis_timer)
+        self.dis_timer = self.sim.after(RPL_DIS_START_DELAY * self.sim.timer_rng.random(), self.dis_output)
+
+    def dio_input(self, sender, version, rank, radio=None):
+        if not self.booted or rank == INFINITE_RANK or self.sim.dag is None:
+            return
+        if self.version is None or lollipop_greater(version, self.version):
+            if self.version is not None:
+                self.sim.stats["repairs"] += 1
+            self.version = version
+            self.parent = None
+            self.rank = INFINITE_RANK
+            self.registered_at = None
+            self.path_seq = lollipop_increment(self.path_seq)
+        elif version != self.version:
+            return
+        else:
+            self.trickle_counter += 1
+
+        if sender is ROOT and self.parent is ROOT and radio is not self.root_radio:
+            # Another radio of the border router with the same rank
+            return
+        prr = self.root_prr if sender is ROOT else self.link_prr(sender)
+        if prr <= 0:
+            return
+        dag = self.sim.dag
+        new_rank = rank + int(dag.min_hop_rank_inc * min(1.0 / prr, 8.0))
+        if sender is self.parent:
+            self.rank = new_rank
+        elif self.parent is None or new_rank + dag.min_hop_rank_inc / 2 < self.rank:
+            if sender is ROOT and radio is not None and radio is not self.root_radio:
+                self.root_radio = radio
+                self.switched_at = self.sim.now
+            self.set_parent(sender, prr, new_rank)
+
+    def link_prr(self, other):
+        for n, prr in self.nbrs:
+            if n is other:
+                return prr
+        return 0.0
+
+    def set_parent(self, parent, prr, rank):
+        first = self.parent is None
+        self.parent = parent
+        self.parent_prr = prr
+        self.rank = rank
+        if self.joined_at is None:
+            self.joined_at = self.sim.now
+        if self.addr is None and self.sim.prefix is not None:
+            self.addr = self.sim.prefix + iid_from_mac(self.mac)
+            self.sim.addresses[self.addr] = self
+        self.sim.cancel(self.dis_timer)
+        self.reset_trickle()
+        if first or self.registered_at is None:
+            self.dao_tries = 0
+            self.schedule_dao(RPL_DAO_DELAY * (0.5 + self.sim.timer_rng.random()))
+        else:
+            self.path_seq = lollipop_increment(self.path_seq)
+            self.schedule_dao(RPL_DAO_DELAY * (0.5 + self.sim.timer_rng.random()))
+
+    def reset_trickle(self):
+        dag = self.sim.dag
+        self.trickle_interval = dag.imin
+        self.start_trickle_interval()
+
+    def start_trickle_interval(self):
+        self.sim.cancel(self.trickle_timer)
+        self.trickle_counter = 0
+        i = self.trickle_interval
+        self.trickle_timer = self.sim.after(i / 2.0 + i / 2.0 * self.sim.timer_rng.random(),
+                                            self.trickle_fire, i)
+
+    def trickle_fire(self, interval):
+        dag = self.sim.dag
+        if dag.redundancy == 0 or self.trickle_counter < dag.redundancy:
+            self.dio_output()
+        self.trickle_timer = self.sim.after(interval / 2.0, self.trickle_end)
+
+    def trickle_end(self):
+        dag = self.sim.dag
+        self.trickle_interval = min(self.trickle_interval * 2, dag.imax)
+        self.start_trickle_interval()
+
+    def schedule_dao(self, delay):
+        self.sim.cancel(self.dao_timer)
+        self.dao_timer = self.sim.after(delay, self.dao_output)
+
+    def dao_output(self):
+        if self.parent is None or self.addr is None:
+            return
+        if self.dao_tries == 0:
+            self.dao_seq = lollipop_increment(self.dao_seq)
+        self.dao_tries += 1
+        self.sim.stats["dao"] += 1
+        if self.dao_tries > 1:
+            self.sim.stats["dao-retransmissions"] += 1
+        self.sim.send_up(self, lambda a: a.dao_forward(self, self.dao_seq))
+        if self.dao_tries <= RPL_DAO_MAX_RETRANSMISSIONS:
+            self.dao_timer = self.sim.after(RPL_DAO_RETRANSMISSION_TIMEOUT, self.dao_output)
+        else:
+            # Give up for now and start over later
+            self.sim.stats["dao-failures"] += 1
+            self.dao_tries = 0
+            self.dao_timer = self.sim.after(RPL_DAO_GIVE_UP_DELAY, self.dao_output)
+
+    # Called on the neighbor of the border router that forwards the DAO
+    def dao_forward(self, target, seq):
+        dag = self.sim.dag
+        self.dao_out_seq = lollipop_increment(self.dao_out_seq)
+        self.dao_forwarded[self.dao_out_seq] = (target, seq)
+        body = struct.pack("!BBBB", dag.instance, RPL_DAO_K_FLAG | RPL_DAO_D_FLAG, 0, self.dao_out_seq)
+        body += dag.dag_id
+        body += struct.pack("!BBBB", RPL_OPTION_TARGET, 18, 0, 128) + target.addr
+        body += struct.pack("!BBBBBB", RPL_OPTION_TRANSIT, 4, 0, 0, target.path_seq, dag.default_lifetime)
+        self.sim.stats["dao-to-br"] += 1
+        self.send_to_root(create_icmp6(self.ll, self.root_radio.ll, ICMP6_RPL, RPL_CODE_DAO, body),
+                          self.root_radio.mac)
+
+    def dao_ack_input(self, body):
+        seq, status = ord(body[2]), ord(body[3])
+        if seq not in self.dao_forwarded:
+            return
+        target, target_seq = self.dao_forwarded.pop(seq)
+        if status >= 128:
+            self.sim.stats["dao-nacks"] += 1
+        else:
+            self.sim.stats["dao-acks"] += 1
+        self.sim.send_down(self, target, lambda n: n.dao_ack(target_seq, status))
+
+    def dao_ack(self, seq, status):
+        if seq != self.dao_seq or self.dao_tries == 0:
+            return
+        self.sim.cancel(self.dao_timer)
+        self.dao_tries = 0
+        if status >= 128:
+            self.dao_timer = self.sim.after(RPL_DAO_GIVE_UP_DELAY, self.dao_output)
+            return
+        if self.registered_at is None:
+            self.registered_at = self.sim.now
+            self.registered_version = self.version
+        dag = self.sim.dag
+        refresh = dag.default_lifetime * dag.lifetime_unit / 2.0
+        self.dao_timer = self.sim.after(refresh * (0.75 + 0.25 * self.sim.timer_rng.random()),
+                                        self.dao_output)
+
+    #
+    # Link layer and IPv6
+    #
+    # Broadcasts reach all border router radios that are up while
+    # unicasts go to the radio of the current parent
+    def send_to_root(self, packet, dst_mac):
+        if dst_mac == BROADCAST:
+            radios = [r for r in self.sim.radios if r.is_up()]
+        elif self.root_radio.is_up():
+            radios = [self.root_radio]
+        else:
+            # No acknowledgement from the lost radio
+            self.sim.stats["frames-lost"] += 1
+            if self.parent is ROOT:
+                self.root_lost()
+            return False
+        max_payload = FRAME_MAX - frame_header_len(dst_mac)
+        self.frag_tag = (self.frag_tag + 1) & 0xffff
+        delay = 0.0
+        for payload in fragment(packet, self.mac, dst_mac, max_payload, self.frag_tag):
+            self.mac_seqno = (self.mac_seqno + 1) & 0xff
+            frame = create_frame(self.mac_seqno, self.sim.radio.panid, self.mac, dst_mac) + payload
+            ok, tx = self.sim.link_tx(self.root_prr, dst_mac == BROADCAST)
+            delay += tx * HOP_DELAY
+            if not ok:
+                self.sim.stats["frames-lost"] += 1
+                return False
+            for radio in radios:
+                self.sim.after(delay, radio.input, frame, self.root_prr)
+        return True
+
+    def frame_input(self, src_mac, dst_mac, payload):
+        if not payload:
+            return
+        dispatch = ord(payload[0])
+        try:
+            if dispatch & 0xe0 == 0x60:
+                hdr, pos, udp_offset = decompress(payload, 0, src_mac, dst_mac, self.sim.contexts)
+                self.ip_input(set_lengths(bytearray(hdr + payload[pos:]), udp_offset))
+            elif dispatch == 0x41:
+                self.ip_input(payload[1:])
+            elif dispatch & 0xf8 == 0xc0:
+                size, tag = struct.unpack_from("!HH", payload)
+                size &= 0x7ff
+                hdr, pos, udp_offset = decompress(payload, 4, src_mac, dst_mac, self.sim.contexts)
+                buf = bytearray(size)
+                first = hdr + payload[pos:]
+                buf[0:len(first)] = first
+                self.reassembly[(src_mac, tag)] = [buf, len(first), udp_offset, self.sim.now]
+            elif dispatch & 0xf8 == 0xe0:
+                size, tag, offset = struct.unpack_from("!HHB", payload)
+                entry = self.reassembly.get((src_mac, tag))
+                if entry is None or self.sim.now - entry[3] > REASS_TIMEOUT:
+                    self.reassembly.pop((src_mac, tag), None)
+                    return
+                data = payload[5:]
+                entry[0][offset * 8:offset * 8 + len(data)] = data
+                entry[1] += len(data)
+                if entry[1] >= len(entry[0]):
+                    del self.reassembly[(src_mac, tag)]
+                    self.ip_input(set_lengths(entry[0], entry[2]))
+        except (ValueError, IndexError, struct.error) as e:
+            self.sim.stats["decompress-errors"] += 1
+            self.sim.debug("%s: failed to decompress frame: %s" % (self.name(), e))
+
+    def ip_input(self, packet):
+        if len(packet) < 40:
+            return
+        dst = packet[24:40]
+        if dst[0] == "\xff":
+            if dst == ALL_RPL_NODES or dst == ALL_NODES:
+                self.local_input(packet)
+            elif dst[:13] == SOLICITED_NODE and self.addr and dst[13:] == self.ll[13:]:
+                self.local_input(packet)
+        elif dst == self.ll or dst == self.addr:
+            self.local_input(packet)
+        elif dst in self.sim.addresses:
+            self.sim.send_down(self, self.sim.addresses[dst], lambda n, p=packet: n.local_input(p))
+        else:
+            self.sim.stats["down-no-route"] += 1
+
+    def local_input(self, packet):
+        src = packet[8:24]
+        proto, pos = upper_layer(packet)
+        if proto == PROTO_ICMP6 and pos + 4 <= len(packet):
+            type, code = ord(packet[pos]), ord(packet[pos + 1])
+            body = packet[pos + 4:]
+            if type == ICMP6_RPL and code == RPL_CODE_DIO and self.sim.root_dio_input(body):
+                dag = self.sim.dag
+                rank, = struct.unpack_from("!H", body, 2)
+                radio = self.sim.radio_by_ll.get(src)
+                if radio is not None and radio.first_dio_at is None:
+                    radio.first_dio_at = self.sim.now
+                    radio.first_dio_real = time.time()
+                self.dio_input(ROOT, ord(body[1]), rank, radio)
+            elif type == ICMP6_RPL and code == RPL_CODE_DAO_ACK and len(body) >= 4:
+                self.dao_ack_input(body)
+            elif type == ICMP6_RPL and code == RPL_CODE_DIS:
+                self.dis_input()
+            elif type == ICMP6_NS and len(body) >= 20:
+                target = body[4:20]
+                if target == self.ll or target == self.addr:
+                    na = struct.pack("!L", 0xe0000000) + target + struct.pack("!BB", 2, 2) + self.mac + "\x00" * 6
+                    self.send_up(create_icmp6(target, src, ICMP6_NA, 0, na, 255))
+            elif type == ICMP6_ECHO_REQUEST:
+                self.send_up(create_icmp6(self.addr or self.ll, src, ICMP6_ECHO_REPLY, 0, body))
+        elif proto == PROTO_UDP and pos + 8 <= len(packet):
+            sport, dport = struct.unpack_from("!HH", packet, pos)
+            if dport == OAM_PORT and self.addr is not None:
+                reply = self.oam_input(packet[pos + 8:])
+                if reply:
+                    self.send_up(create_udp(self.addr, src, OAM_PORT, sport, reply))
+
+    def send_up(self, packet):
+        self.sim.send_up(self, lambda a, p=packet: a.send_to_root(p, a.root_radio.mac))
+
+    def send_report(self, size):
+        if self.addr is None or self.sim.collector is None:
+            return
+        self.report_seq += 1
+        data = struct.pack("!HLL", self.index, self.report_seq, int(self.sim.now * 1000) & 0xffffffff)
+        data += "\x00" * max(0, size - len(data))
+        self.sim.stats["reports-sent"] += 1
+        self.send_up(create_udp(self.addr, self.sim.collector, REPORT_PORT, self.sim.collector_port, data))
+
+    #
+    # OAM instance 0 and an image instance for OTA
+    #
+    def oam_input(self, data):
+        if len(data) < 4:
+            return None
+        version, payload_type, error, modes = struct.unpack_from("!BBBB", data)
+        if payload_type != tlvlib.ENC_PAYLOAD_TLV:
+            return None
+        pos = 4 + { tlvlib.ENC_FP_NONE: 0, tlvlib.ENC_FP_DEVID: 8,
+                    tlvlib.ENC_FP_LENOPT: 4, tlvlib.ENC_FP_DID_AND_FP: 16 }.get(modes >> 4, 0)
+        reply = ""
+        for t in parse_tlvs(data[pos:]):
+            reply += self.tlv_input(t)
+        self.sim.stats["oam-requests"] += 1
+        return struct.pack("!BBBB", 0x10, tlvlib.ENC_PAYLOAD_TLV, 0, 0) + reply + tlvlib.NULL_TLV
+
+    def tlv_input(self, t):
+        get = (t.op & 0x7f) == tlvlib.TLV_GET_REQUEST
+        if t.instance == 0 and get:
+            if t.variable == tlvlib.VARIABLE_OBJECT_TYPE:
+                return create_tlv_reply(t, 0, struct.pack("!Q", NODE_PRODUCT_TYPE))
+            if t.variable == tlvlib.VARIABLE_OBJECT_ID:
+                return create_tlv_reply(t, 0, "\x00" * 8 + self.mac)
+            if t.variable == tlvlib.VARIABLE_OBJECT_LABEL:
+                return create_tlv_reply(t, 0, pad_value("pansim %u" % self.index, t.element_size))
+            if t.variable == tlvlib.VARIABLE_NUMBER_OF_INSTANCES:
+                return create_tlv_reply(t, 0, struct.pack("!L", 1))
+            if t.variable == tlvlib.VARIABLE_SW_REVISION:
+                return create_tlv_reply(t, 0, pad_value(SW_REVISION, t.element_size))
+            return create_tlv_reply(t, 2)
+        if t.instance == 1:
+            if get and t.variable == tlvlib.VARIABLE_OBJECT_TYPE:
+                return create_tlv_reply(t, 0, struct.pack("!Q", tlvlib.INSTANCE_IMAGE))
+            if not get and t.variable == tlvlib.VARIABLE_WRITE_CONTROL:
+                return create_tlv_reply(t)
+            if not get and t.variable == tlvlib.VARIABLE_FLASH:
+                self.ota_bytes += len(t.data)
+                self.sim.stats["ota-segments-received"] += 1
+                return create_tlv_reply(t)
+            return create_tlv_reply(t, 2)
+        return create_tlv_reply(t, 3)
+
+class RootMarker:
+    def name(self):
+        return "border router"
+
+ROOT = RootMarker()
+
+class Dag:
+    def __init__(self):
+        self.instance = 0
+        self.version = None
+        self.dtsn = 0
+        self.mop_prf = 0
+        self.dag_id = None
+        self.conf = ""
+        self.imin = 4.096
+        self.imax = 4.096 * 2 ** 8
+        self.redundancy = 10
+        self.min_hop_rank_inc = 256
+        self.default_lifetime = 30
+        self.lifetime_unit = 60
+
+#
+# Scheduler with time in network seconds
+#
+class Scheduler:
+
+    def __init__(self):
+        self.queue = []
+        self.seq = 0
+        self.now = 0.0
+
+    def at(self, t, fn, *args):
+        event = [t, self.seq, fn, args, True]
+        self.seq += 1
+        heapq.heappush(self.queue, event)
+        return event
+
+    def after(self, delay, fn, *args):
+        return self.at(self.now + delay, fn, *args)
+
+    def cancel(self, event):
+        if event is not None:
+            event[4] = False
+
+    def next_time(self):
+        while self.queue and not self.queue[0][4]:
+            heapq.heappop(self.queue)
+        return self.queue[0][0] if self.queue else None
+
+    def run_until(self, t):
+        while self.queue and self.queue[0][0] <= t:
+            event = heapq.heappop(self.queue)
+            if event[4]:
+                self.now = event[0]
+                event[2](*event[3])
+        self.now = max(self.now, t)
+
+#
+# Border router CPU and memory from /proc
+#
+class BrMonitor:
+
+    # The border router is given by pid or by process name. A name is
+    # looked up again when the process is gone, to follow a border
+    # router that is started after the simulator or restarted.
+    def __init__(self, process):
+        self.name = None if process.isdigit() else process[:15]
+        self.pid = int(process) if process.isdigit() else None
+        self.ticks = os.sysconf("SC_CLK_TCK")
+        self.samples = []
+
+    def find_pid(self):
+        for pid in os.listdir("/proc"):
+            if pid.isdigit():
+                try:
+                    with open("/proc/%s/comm" % pid) as f:
+                        if f.read().strip() == self.name:
+                            return int(pid)
+                except IOError:
+                    pass
+        return None
+
+    def sample(self):
+        if self.name and (self.pid is None or not os.path.exists("/proc/%d" % self.pid)):
+            self.pid = self.find_pid()
+            if self.pid is None:
+                return
+        try:
+            with open("/proc/%d/stat" % self.pid) as f:
+                fields = f.read().rsplit(")", 1)[1].split()
+            cpu = float(int(fields[11]) + int(fields[12])) / self.ticks
+            rss = hwm = 0
+            with open("/proc/%d/status" % self.pid) as f:
+                for line in f:
+                    if line.startswith("VmRSS:"):
+                        rss = int(line.split()[1])
+                    elif line.startswith("VmHWM:"):
+                        hwm = int(line.split()[1])
+        except (IOError, IndexError, ValueError):
+            return
+        self.samples.append((time.time(), cpu, rss, hwm, self.pid))
+
+    def summary(self, start):
+        samples = [s for s in self.samples if s[0] >= start]
+        if len(samples) < 2:
+            return None
+        first, last = samples[0], samples[-1]
+        elapsed = last[0] - first[0]
+        used = peak = 0.0
+        for a, b in zip(samples, samples[1:]):
+            # The CPU time starts over with a new process
+            if b[0] > a[0] and b[4] == a[4]:
+                used += b[1] - a[1]
+                peak = max(peak, 100.0 * (b[1] - a[1]) / (b[0] - a[0]))
+        return { "br-cpu-avg": 100.0 * used / elapsed if elapsed > 0 else 0.0,
+                 "br-cpu-peak": peak,
+                 "br-rss-kb": last[2],
+                 "br-rss-peak-kb": max(s[3] for s in samples) }
+
+#
+# The simulation
+#
+class Simulation(Scheduler):
+
+    STATS = [ "dao", "dao-retransmissions", "dao-failures", "dao-to-br", "dao-acks",
+              "dao-nacks", "repairs", "frames-lost", "mesh-lost", "down-no-route",
+              "decompress-errors", "oam-requests", "reports-sent", "reports-received",
+              "ota-segments-sent", "ota-segments-received", "ota-segments-acked",
+              "ota-retries", "ota-failures" ]
+
+    def __init__(self, args):
+        Scheduler.__init__(self)
+        self.args = args
+        self.verbose = args.verbose
+        self.topo_rng = random.Random(args.seed)
+        self.link_rng = random.Random(args.seed + 1)
+        self.timer_rng = random.Random(args.seed + 2)
+        self.accel = args.time_factor
+        self.stats = dict((name, 0) for name in self.STATS)
+        self.dag = None
+        self.prefix = None
+        self.contexts = { 0: socket.inet_pton(socket.AF_INET6, args.context0)[:8] }
+        self.addresses = {}
+        self.macs = {}
+        self.collector = None
+        self.collector_port = args.collector_port
+        self.results = []
+        self.monitor = BrMonitor(args.br_pid) if args.br_pid else None
+        self.radio = SerialRadio(self, args.port, RADIO_MAC)
+        self.radios = [self.radio]
+        if args.standby_port:
+            self.radios.append(SerialRadio(self, args.standby_port, STANDBY_RADIO_MAC, False))
+        self.radio_by_ll = dict((r.ll, r) for r in self.radios)
+        self.host = socket.socket(socket.AF_INET6, socket.SOCK_DGRAM)
+        self.host.bind(("::", args.collector_port))
+        self.ota = {}
+        self.probes = {}
+        self.restarting = False
+        self.create_topology()
+
+    def log(self, msg):
+        print("[%9.2f] %s" % (self.now, msg))
+        sys.stdout.flush()
+
+    def debug(self, msg):
+        if self.verbose:
+            self.log(msg)
+
+    def create_topology(self):
+        args = self.args
+        n = args.nodes
+        side = int(math.ceil(math.sqrt(n)))
+        self.nodes = []
+        for i in range(n):
+            if args.topology == "line":
+                x, y = (i + 1) * args.spacing, 0.0
+            elif args.topology == "random":
+                x = (self.topo_rng.random() - 0.5) * side * args.spacing
+                y = (self.topo_rng.random() - 0.5) * side * args.spacing
+            else:
+                # Grid with the border router in one corner
+                x, y = ((i + 1) % side) * args.spacing, ((i + 1) / side) * args.spacing
+            node = Node(self, i, x, y)
+            self.nodes.append(node)
+            self.macs[node.mac] = node
+
+        # Bucket the nodes by radio range to find the neighbors
+        r = args.range
+        cells = {}
+        for node in self.nodes:
+            cells.setdefault((int(node.x // r), int(node.y // r)), []).append(node)
+        for node in self.nodes:
+            node.root_prr = self.prr(math.hypot(node.x, node.y))
+            cx, cy = int(node.x // r), int(node.y // r)
+            for dx in (-1, 0, 1):
+                for dy in (-1, 0, 1):
+                    for other in cells.get((cx + dx, cy + dy), []):
+                        if other is not node:
+                            prr = self.prr(math.hypot(node.x - other.x, node.y - other.y))
+                            if prr > 0:
+                                node.nbrs.append((other, prr))
+        self.log("%u nodes, %u neighbors of the border router, %.1f neighbors per node"
+                 % (n, sum(1 for node in self.nodes if node.root_prr > 0),
+                    float(sum(len(node.nbrs) for node in self.nodes)) / max(n, 1)))
+
+    # Packet reception ratio: perfect up to half the range and then
+    # falling linearly to zero at the range
+    def prr(self, distance):
+        r = self.args.range
+        if distance >= r:
+            return 0.0
+        prr = min(1.0, 2.0 * (1.0 - distance / r)) * (1.0 - self.args.loss)
+        return prr if prr >= 0.1 else 0.0
+
+    def link_tx(self, prr, broadcast):
+        if broadcast:
+            return self.link_rng.random() < prr, 1
+        for tx in range(1, MAX_MAC_TRANSMISSIONS + 1):
+            if self.link_rng.random() < prr:
+                return True, tx
+        return False, MAX_MAC_TRANSMISSIONS
+
+    def mesh_broadcast(self, sender, fn):
+        for node, prr in sender.nbrs:
+            if self.link_rng.random() < prr:
+                self.after(HOP_DELAY, fn, node)
+
+    # Forward along the upward path and call fn on the neighbor of the
+    # border router at the end of the path
+    def send_up(self, node, fn):
+        path = node.path_up()
+        if path is None:
+            self.stats["mesh-lost"] += 1
+            return
+        delay = 0.0
+        for n, prr in path[:-1]:
+            ok, tx = self.link_tx(prr, False)
+            delay += tx * HOP_DELAY
+            if not ok:
+                self.stats["mesh-lost"] += 1
+                return
+        self.after(delay, fn, path[-1][0])
+
+    # Forward downward from a neighbor of the border router to a node
+    def send_down(self, first, target, fn):
+        path = target.path_up()
+        if path is None or path[-1][0] is not first:
+            self.stats["down-no-route"] += 1
+            return
+        delay = 0.0
+        for n, prr in path[:-1]:
+            ok, tx = self.link_tx(prr, False)
+            delay += tx * HOP_DELAY
+            if not ok:
+                self.stats["mesh-lost"] += 1
+                return
+        self.after(delay, fn, target)
+
+    # A frame transmitted by the border router
+    def radio_output(self, radio, data, max_tx):
+        if not radio.is_up():
+            return MAC_TX_NOACK, 1
+        frame = parse_frame(data)
+        if frame is None:
+            return MAC_TX_OK, 1
+        panid, src, dst, payload = frame
+        if panid is not None and panid != radio.panid and panid != 0xffff:
+            return MAC_TX_OK, 1
+        if dst == BROADCAST:
+            for node in self.nodes:
+                if node.booted and node.root_prr > 0 and self.link_rng.random() < node.root_prr:
+                    self.after(HOP_DELAY, node.frame_input, src, dst, payload)
+            return MAC_TX_OK, 1
+        node = self.macs.get(dst)
+        if node is None or not node.booted or node.root_prr == 0:
+            return MAC_TX_NOACK, max_tx
+        for tx in range(1, max_tx + 1):
+            if self.link_rng.random() < node.root_prr:
+                self.after(tx * HOP_DELAY, node.frame_input, src, dst, payload)
+                return MAC_TX_OK, tx
+        return MAC_TX_NOACK, max_tx
+
+    # Updates the DAG from a DIO sent by the border router
+    def root_dio_input(self, body):
+        if len(body) < 24:
+            return False
+        instance, version, rank, mop_prf, dtsn = struct.unpack_from("!BBHBB", body)
+        if self.dag is None:
+            self.dag = Dag()
+            self.log("joined DAG %s" % format_addr(body[8:24]))
+        dag = self.dag
+        if dag.version is not None and lollipop_greater(version, dag.version):
+            self.log("new DAG version %u" % version)
+            self.repair_started = self.now
+        dag.instance = instance
+        dag.version = version
+        dag.mop_prf = mop_prf
+        dag.dtsn = dtsn
+        dag.dag_id = body[8:24]
+        pos = 24
+        while pos < len(body):
+            type = ord(body[pos])
+            if type == 0:
+                pos += 1
+                continue
+            length = ord(body[pos + 1])
+            opt = body[pos + 2:pos + 2 + length]
+            if type == RPL_OPTION_DAG_CONF and length >= 14:
+                dag.conf = body[pos:pos + 2 + length]
+                doublings, intmin, redundancy = struct.unpack_from("!BBB", opt, 1)
+                dag.imin = (1 << intmin) / 1000.0
+                dag.imax = dag.imin * (1 << doublings)
+                dag.redundancy = redundancy
+                dag.min_hop_rank_inc, = struct.unpack_from("!H", opt, 6)
+                dag.default_lifetime = ord(opt[11])
+                dag.lifetime_unit, = struct.unpack_from("!H", opt, 12)
+            elif type == RPL_OPTION_PREFIX_INFO and length >= 30 and self.prefix is None:
+                self.prefix = opt[14:22]
+                self.log("prefix %s/64" % format_addr(self.prefix + "\x00" * 8))
+                if self.args.collector:
+                    self.collector = socket.inet_pton(socket.AF_INET6, self.args.collector)
+                else:
+                    self.collector = self.prefix + "\x00" * 7 + "\x01"
+            elif type == RPL_OPTION_6CO and length >= 14 and ord(opt[0]) == 64:
+                self.contexts[ord(opt[1]) & 0x0f] = opt[6:14]
+            pos += 2 + length
+        return True
+
+    #
+    # Host side traffic
+    #
+    def host_input(self):
+        data, addr = self.host.recvfrom(2048)
+        src = socket.inet_pton(socket.AF_INET6, addr[0].split("%")[0])
+        session = self.ota.get(src)
+        if session is not None:
+            session.response(data)
+        elif src in self.probes and addr[1] == OAM_PORT:
+            if self.probes[src] is None:
+                self.probes[src] = (self.now, time.time())
+        elif len(data) >= 10:
+            index, seq = struct.unpack_from("!HL", data)
+            if index < len(self.nodes):
+                self.stats["reports-received"] += 1
+
+    def host_send(self, addr, port, data):
+        try:
+            self.host.sendto(data, (format_addr(addr), port))
+            return True
+        except socket.error as e:
+            self.debug("failed to send to %s: %s" % (format_addr(addr), e))
+            return False
+
+    #
+    # Main loop
+    #
+    def run(self, phases):
+        self.repair_started = None
+        self.log("waiting for the border router on port %u" % self.args.port)
+        phase_iter = iter(phases)
+        current = None
+        real_start = None
+        last_sample = 0
+        while True:
+            if real_start is None and self.radio.configured:
+                # Start the network time when the radio has been configured
+                real_start = time.time()
+                self.log("serial radio configured: channel %u, PAN id 0x%04x"
+                         % (self.radio.channel, self.radio.panid))
+            if real_start is not None:
+                self.run_until((time.time() - real_start) * self.accel)
+                if current is None or self.now >= current[1]:
+                    try:
+                        delay = current[0].next() if current is not None else None
+                    except StopIteration:
+                        delay = None
+                        current = None
+                    if delay is not None:
+                        current = (current[0], self.now + delay)
+                    else:
+                        name = next(phase_iter, None)
+                        if name is None:
+                            break
+                        current = (getattr(self, "phase_" + name)(), self.now)
+                        continue
+            if self.monitor and time.time() - last_sample >= 1.0:
+                self.monitor.sample()
+                last_sample = time.time()
+
+            timeout = 0.5
+            if real_start is not None:
+                t = self.next_time()
+                if current is not None and (t is None or current[1] < t):
+                    t = current[1]
+                if t is not None:
+                    timeout = max(0.0, min(timeout, (t - self.now) / self.accel))
+            socks = [self.host]
+            for radio in self.radios:
+                socks += radio.sockets()
+            r, w, x = select.select(socks, [], [], timeout)
+            for sock in r:
+                if sock == self.host:
+                    self.host_input()
+                    continue
+                radio = [radio for radio in self.radios if sock in radio.sockets()][0]
+                if not radio.handle_read(sock) and not self.restarting and \
+                   not any(other.conn for other in self.radios):
+                    self.log("stopping")
+                    return
+
+    def begin_phase(self, name):
+        self.log("phase %s" % name)
+        self.phase_name = name
+        self.phase_start = self.now
+        self.phase_real_start = time.time()
+        self.phase_stats = dict(self.stats)
+
+    def end_phase(self, values):
+        elapsed = self.now - self.phase_start
+        real = time.time() - self.phase_real_start
+        result = [("duration", elapsed), ("duration-real", real)]
+        result += values
+        for name in self.STATS:
+            d = self.stats[name] - self.phase_stats[name]
+            if d:
+                result.append((name, d))
+        d = self.stats["dao-to-br"] - self.phase_stats["dao-to-br"]
+        if elapsed > 0:
+            result.append(("dao-to-br-per-min", 60.0 * d / elapsed))
+        if self.monitor:
+            self.monitor.sample()
+            summary = self.monitor.summary(self.phase_real_start)
+            if summary:
+                result += sorted(summary.items())
+        self.results.append((self.phase_name, result))
+        for name, value in result:
+            if isinstance(value, float):
+                print("  %-26s %.2f" % (name, value))
+            else:
+                print("  %-26s %s" % (name, value))
+        sys.stdout.flush()
+
+    def convergence(self, times, start, n=None):
+        values = []
+        if n is None:
+            n = len(self.nodes)
+        times = sorted(t - start for t in times)
+        for p in (50, 90, 100):
+            k = int(math.ceil(n * p / 100.0))
+            values.append(("converged-%u" % p, times[k - 1] if 0 < k <= len(times) else "-"))
+        return values
+
+    def registered(self, version=None):
+        return [n for n in self.nodes if n.registered_at is not None and
+                (version is None or n.registered_version == version)]
+
+    def phase_coldstart(self):
+        self.begin_phase("coldstart")
+        start = self.now
+        for node in self.nodes:
+            self.after(self.args.boot_spread * self.timer_rng.random(), node.boot)
+        while self.now - start < self.args.timeout and len(self.registered()) < len(self.nodes):
+            yield 1.0
+        joined = [n.joined_at for n in self.nodes if n.joined_at is not None]
+        registered = [n.registered_at for n in self.registered()]
+        self.end_phase([("nodes", len(self.nodes)), ("joined", len(joined)),
+                        ("registered", len(registered))] + self.convergence(registered, start))
+
+    def phase_repair(self):
+        self.begin_phase("repair")
+        start = self.now
+        old = self.dag.version if self.dag else None
+        ctrl = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        ctrl.sendto("!G\n", ("127.0.0.1", self.args.br_ctrl))
+        ctrl.close()
+        while self.now - start < self.args.timeout and self.dag.version == old:
+            yield 0.5
+        registered = []
+        if self.dag.version == old:
+            self.log("no new DAG version - is the control port %u enabled?" % self.args.br_ctrl)
+        else:
+            start = self.repair_started
+            while self.now - start < self.args.timeout and \
+                  len(self.registered(self.dag.version)) < len(self.nodes):
+                yield 1.0
+            registered = [n.registered_at for n in self.registered(self.dag.version)]
+        self.end_phase([("version", self.dag.version), ("registered", len(registered))]
+                       + self.convergence(registered, start))
+
+    # Kills the active border router and waits for the nodes next to it
+    # to move to the standby radio
+    def phase_failover(self):
+        self.begin_phase("failover")
+        if len(self.radios) < 2:
+            self.log("no standby radio - use --standby-port")
+            self.end_phase([])
+            return
+        active, standby = self.radios
+        version = self.dag.version if self.dag else None
+        nodes = [n for n in self.nodes if n.parent is ROOT and n.root_radio is active]
+        start = self.now
+        if self.args.kill_pid:
+            os.kill(self.args.kill_pid, signal.SIGKILL)
+        else:
+            self.log("waiting for the active border router to stop")
+        while active.is_up() and self.now - start < self.args.timeout:
+            yield 0.1
+        lost = self.now
+        lost_real = time.time()
+        standby.first_dio_at = None
+        standby.first_dio_real = None
+        for node in nodes:
+            self.after(RPL_PROBING_INTERVAL * self.timer_rng.random(), node.probe_root)
+        while self.now - lost < self.args.timeout and \
+              (standby.first_dio_at is None or any(n.root_radio is not standby for n in nodes)):
+            yield 1.0
+        switched = [n.switched_at for n in nodes if n.root_radio is standby]
+        dio = standby.first_dio_at
+        self.end_phase([("nodes", len(nodes)), ("switched", len(switched)),
+                        ("first-standby-dio", dio - lost if dio is not None else "-"),
+                        ("first-standby-dio-real",
+                         standby.first_dio_real - lost_real if dio is not None else "-"),
+                        ("version-changed", int(self.dag.version != version))]
+                       + self.convergence(switched, lost, len(nodes)))
+
+    # Kills the border router and waits for it to come back. Then probes
+    # the nodes that were registered with OAM requests from the host
+    # until all of them answer.
+    def phase_restart(self):
+        self.begin_phase("restart")
+        version = self.dag.version if self.dag else None
+        nodes = self.registered()
+        start = self.now
+        self.restarting = True
+        if self.args.kill_pid:
+            os.kill(self.args.kill_pid, signal.SIGKILL)
+        else:
+            self.log("waiting for the border router to restart")
+        while self.radio.conn is not None and self.now - start < self.args.timeout:
+            yield 0.1
+        lost = self.now
+        lost_real = time.time()
+        self.radio.configured = False
+        while not self.radio.configured and self.now - lost < self.args.timeout:
+            yield 0.1
+        self.restarting = False
+        up = self.now
+        up_real = time.time()
+        self.log("border router restarted")
+        self.probes = dict((n.addr, None) for n in nodes)
+        request = tlvlib.create_encap([tlvlib.create_get_tlv64(0, tlvlib.VARIABLE_OBJECT_TYPE)])
+        while self.now - up < self.args.timeout and None in self.probes.values():
+            for addr, reached in self.probes.items():
+                if reached is None:
+                    self.host_send(addr, OAM_PORT, request)
+            yield self.accel
+        reached = [r for r in self.probes.values() if r is not None]
+        self.probes = {}
+        self.end_phase([("nodes", len(nodes)), ("reachable", len(reached)),
+                        ("down-real", up_real - lost_real),
+                        ("reachable-100-real",
+                         max(r[1] for r in reached) - up_real
+                         if len(reached) == len(nodes) and reached else "-"),
+                        ("version-changed", int(self.dag.version != version))]
+                       + self.convergence([r[0] for r in reached], up, len(nodes)))
+
+    def phase_reports(self):
+        self.begin_phase("reports")
+        start = self.now
+        interval = self.args.report_interval
+        nodes = self.registered()
+        timers = []
+        for node in nodes:
+            t = interval * self.timer_rng.random()
+            while t < self.args.duration:
+                timers.append(self.after(t, node.send_report, self.args.report_size))
+                t += interval
+        while self.now - start < self.args.duration:
+            yield 1.0
+        # Wait for the last reports
+        drain = self.now
+        while self.now - drain < 5 * self.accel:
+            yield 1.0
+        sent = self.stats["reports-sent"] - self.phase_stats["reports-sent"]
+        received = self.stats["reports-received"] - self.phase_stats["reports-received"]
+        self.end_phase([("nodes", len(nodes)),
+                        ("pdr-up", float(received) / sent if sent else "-")])
+
+    def phase_ota(self):
+        self.begin_phase("ota")
+        targets = self.registered()[:self.args.ota_nodes]
+        pending = list(targets)
+        image = "".join(chr(self.topo_rng.randint(0, 255)) for i in range(self.args.ota_size))
+        done = []
+        while pending or self.ota:
+            while pending and len(self.ota) < self.args.ota_parallel:
+                node = pending.pop(0)
+                session = OtaSession(self, node, image)
+                self.ota[node.addr] = session
+                session.send()
+            for session in self.ota.values():
+                session.poll()
+                if session.finished:
+                    del self.ota[session.node.addr]
+                    done.append(session)
+            yield 0.1 * self.accel
+        sent = self.stats["ota-segments-sent"] - self.phase_stats["ota-segments-sent"]
+        received = self.stats["ota-segments-received"] - self.phase_stats["ota-segments-received"]
+        completed = [s for s in done if s.ok]
+        elapsed = time.time() - self.phase_real_start
+        self.end_phase([("nodes", len(targets)), ("completed", len(completed)),
+                        ("pdr-down", float(received) / sent if sent else "-"),
+                        ("throughput-bytes-per-s",
+                         float(sum(s.offset for s in done)) / elapsed if elapsed > 0 else 0.0)])
+
+    def write_results(self, filename):
+        with open(filename, "w") as f:
+            f.write("phase,metric,value\n")
+            for phase, values in self.results:
+                for name, value in values:
+                    f.write("%s,%s,%s\n" % (phase, name, value))
+
+# OTA of an image to one node with TLV writes from the host
+class OtaSession:
+    SEGMENT = 256
+    TIMEOUT = 2.0
+    RETRIES = 3
+
+    def __init__(self, sim, node, image):
+        self.sim = sim
+        self.node = node
+        self.image = image
+        self.offset = 0
+        self.retries = 0
+        self.sent = 0
+        self.finished = False
+        self.ok = False
+
+    def request(self):
+        segment = self.image[self.offset:self.offset + self.SEGMENT]
+        segment += "\x00" * (-len(segment) % 4)
+        t1 = tlvlib.create_set_tlv32(1, tlvlib.VARIABLE_WRITE_CONTROL,
+                                     tlvlib.FLASH_WRITE_CONTROL_WRITE_ENABLE)
+        t2 = tlvlib.create_set_vector_tlv(1, tlvlib.VARIABLE_FLASH, tlvlib.SIZE32,
+                                          self.offset / 4, len(segment) / 4, segment)
+        return tlvlib.create_encap([t1, t2])
+
+    def send(self):
+        self.sent = time.time()
+        self.sim.stats["ota-segments-sent"] += 1
+        if not self.sim.host_send(self.node.addr, OAM_PORT, self.request()):
+            self.finish(False)
+
+    def response(self, data):
+        tlvs = parse_tlvs(data[4:])
+        if len(tlvs) < 2 or any(t.error != 0 for t in tlvs):
+            self.finish(False)
+            return
+        self.sim.stats["ota-segments-acked"] += 1
+        self.offset += self.SEGMENT
+        self.retries = 0
+        if self.offset >= len(self.image):
+            self.finish(True)
+        else:
+            self.send()
+
+    def poll(self):
+        if not self.finished and time.time() - self.sent > self.TIMEOUT:
+            self.retries += 1
+            self.sim.stats["ota-retries"] += 1
+            if self.retries > self.RETRIES:
+                self.finish(False)
+            else:
+                self.send()
+
+    def finish(self, ok):
+        self.finished = True
+        self.ok = ok
+        if not ok:
+            self.sim.stats["ota-failures"] += 1
+
+def main():
+    parser = argparse.ArgumentParser(description='Simulate a PAN behind a serial radio for border router scaling tests.')
+    parser.add_argument("-p", "--port", type=int, default=60001,
+                        help="TCP port for the border router to connect to - 60001 is default.")
+    parser.add_argument("-n", "--nodes", type=int, default=100, help="number of nodes.")
+    parser.add_argument("-t", "--topology", choices=["grid", "random", "line"], default="grid",
+                        help="node placement - grid with the border router in a corner is default.")
+    parser.add_argument("--spacing", type=float, default=1.0, help="distance between nodes.")
+    parser.add_argument("--range", type=float, default=2.5, help="radio range in the same unit as the spacing.")
+    parser.add_argument("--loss", type=float, default=0.0, help="extra frame loss ratio on all links.")
+    parser.add_argument("--seed", type=int, default=1, help="random seed.")
+    parser.add_argument("-x", "--time-factor", type=float, default=1.0,
+                        help="time acceleration of the node timers.")
+    parser.add_argument("-s", "--scenario", default="coldstart,reports",
+                        help="comma separated phases: coldstart, repair, failover, restart, reports, ota.")
+    parser.add_argument("--boot-spread", type=float, default=10.0,
+                        help="seconds over which the nodes boot at cold start.")
+    parser.add_argument("--timeout", type=float, default=1800.0,
+                        help="max seconds for convergence in the coldstart and repair phases.")
+    parser.add_argument("--report-interval", type=float, default=60.0, help="seconds between reports.")
+    parser.add_argument("--report-size", type=int, default=32, help="report payload size.")
+    parser.add_argument("--duration", type=float, default=600.0, help="seconds of the reports phase.")
+    parser.add_argument("--collector", help="report destination - <prefix>::1 is default.")
+    parser.add_argument("--collector-port", type=int, default=47010, help="report UDP port on the host.")
+    parser.add_argument("--ota-nodes", type=int, default=10, help="number of nodes to upgrade.")
+    parser.add_argument("--ota-size", type=int, default=16384, help="image size in bytes.")
+    parser.add_argument("--ota-parallel", type=int, default=4, help="concurrent upgrades.")
+    parser.add_argument("--context0", default="fd02::", help="6LoWPAN context 0 prefix.")
+    parser.add_argument("-c", "--br-ctrl", type=int, default=47000,
+                        help="UDP control port of the border router.")
+    parser.add_argument("-b", "--br-pid",
+                        help="border router pid or process name for CPU and memory figures.")
+    parser.add_argument("--standby-port", type=int,
+                        help="TCP port of a second serial radio for a hot standby border router.")
+    parser.add_argument("--kill-pid", type=int,
+                        help="border router pid to kill in the failover and restart phases.")
+    parser.add_argument("-o", "--output", help="write the results as CSV.")
+    parser.add_argument("-v", "--verbose", action="store_true", help="verbose output.")
+    args = parser.parse_args()
+
+    phases = [p.strip() for p in args.scenario.split(",") if p.strip()]
+    for p in phases:
+        if not hasattr(Simulation, "phase_" + p):
+            parser.error("unknown phase '%s'" % p)
+    if args.time_factor <= 0:
+        parser.error("the time factor must be positive")
+
+    sim = Simulation(args)
+    try:
+        sim.run(phases)
+    except KeyboardInterrupt:
+        pass
+    if args.output:
+        sim.write_results(args.output)
+
+if __name__ == "__main__":
+    main()
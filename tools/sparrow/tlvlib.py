@@ -128,6 +128,13 @@ VARIABLE_IMAGE_STATUS          =  0x105
 VARIABLE_IMAGE_VERSION         =  0x106
 VARIABLE_IMAGE_LENGTH          =  0x107
 VARIABLE_IMAGE_CRC32           =  0x108
+VARIABLE_WRITE_SESSION         =  0x10a
+VARIABLE_WRITE_PROGRESS        =  0x10b
+VARIABLE_WRITE_BITMAP          =  0x10c
+VARIABLE_WRITE_CRC32           =  0x10d
+VARIABLE_WRITE_BLOCK_SIZE      =  0x10e
+VARIABLE_COMPRESSED_FLASH      =  0x10f
+VARIABLE_COMPRESSED_PROGRESS   =  0x110
 
 FLASH_WRITE_CONTROL_ERASE        = 0x911
 FLASH_WRITE_CONTROL_WRITE_ENABLE = 0x23
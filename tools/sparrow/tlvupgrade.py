@@ -31,13 +31,15 @@
 #         Niclas Finne, nfi@sics.se
 #
 
-import sys, binascii, datetime, argparse, zipfile, tlvlib, struct, socket
+import sys, binascii, datetime, argparse, zipfile, tlvlib, struct, socket, time, lzss, imagediff
 
-def get_flash(zip, image):
+def get_flash(zip, image, compressed=False):
     findstr = str(image) + ".flash"
+    if compressed:
+        findstr = findstr + ".lz"
     infolist = zip.infolist()
     for info in infolist:
-        if info.filename.find(findstr) > 0:
+        if info.filename.find(findstr) > 0 and info.filename.endswith(".lz") == compressed:
             return info
     return None
 
@@ -141,6 +143,194 @@ def do_reboot(host, port, image=0):
         pass
     return True
 
+#
+# Streaming upgrade using a write session. Several chunks are sent in
+# each PDU followed by a read of the write progress (cumulative ack).
+# Gaps are found by reading the received block bitmap after each pass.
+# The session id is derived from the image so that an interrupted
+# upgrade is resumed from the device's reported progress.
+#
+def get_session_var(instance, var, host, port):
+    t = tlvlib.create_get_tlv32(instance, var)
+    try:
+        enc,tlvs = tlvlib.send_tlv(t, host, port, 2.5)
+    except socket.timeout:
+        return None
+    if tlvs[0].error != 0:
+        return None
+    return tlvs[0].int_value & 0xffffffff
+
+def set_session(instance, session, host, port, timeout=2.5):
+    t = tlvlib.create_set_tlv32(instance, tlvlib.VARIABLE_WRITE_SESSION, session)
+    try:
+        enc,tlvs = tlvlib.send_tlv(t, host, port, timeout)
+    except socket.timeout:
+        return False
+    return tlvs[0].error == 0
+
+def get_received_blocks(instance, blocks, host, port):
+    received = set()
+    words = (blocks + 31) / 32
+    offset = 0
+    while offset < words:
+        count = min(32, words - offset)
+        t = tlvlib.create_get_vector_tlv(instance, tlvlib.VARIABLE_WRITE_BITMAP,
+                                         tlvlib.SIZE32, offset, count)
+        try:
+            enc,tlvs = tlvlib.send_tlv(t, host, port, 2.5)
+        except socket.timeout:
+            return None
+        if tlvs[0].error != 0 or not tlvs[0].data:
+            return None
+        for w in range(count):
+            word, = struct.unpack_from("!L", tlvs[0].data, w * 4)
+            for b in range(32):
+                if word & (1 << b):
+                    received.add((offset + w) * 32 + b)
+        offset += count
+    return received
+
+def send_stream(segments, size, instance, host, port):
+    tlvs = []
+    for segment in segments:
+        tlvs.append(tlvlib.create_set_vector_tlv(instance, tlvlib.VARIABLE_FLASH,
+                                                 tlvlib.SIZE32, segment[0] * size / 4,
+                                                 len(segment[1]) / 4, segment[1]))
+    tlvs.append(tlvlib.create_get_tlv32(instance, tlvlib.VARIABLE_WRITE_PROGRESS))
+    try:
+        enc,reply = tlvlib.send_tlv(tlvs, host, port, 2.5, show_error=verbose)
+    except socket.timeout:
+        return None
+    for t in reply:
+        if t.variable == tlvlib.VARIABLE_WRITE_PROGRESS and t.error == 0:
+            return (t.int_value & 0xffffffff) * 4
+    return None
+
+def do_stream_upgrade(data, instance, host, port, block_size, window, retry_passes=50):
+    session = (binascii.crc32(data) & 0x7fffffff) | 1
+    if not set_session(instance, session, host, port):
+        print "ERROR: failed to open write session"
+        return False
+    device_block_size = get_session_var(instance, tlvlib.VARIABLE_WRITE_BLOCK_SIZE, host, port)
+    if not device_block_size:
+        print "ERROR: failed to read session block size"
+        return False
+    # Chunks must be a multiple of the device block size
+    size = max(1, block_size / device_block_size) * device_block_size
+    segments = create_segments(data, size)
+    blocks_per_segment = size / device_block_size
+    blocks = (len(data) + device_block_size - 1) / device_block_size
+
+    progress = get_session_var(instance, tlvlib.VARIABLE_WRITE_PROGRESS, host, port) or 0
+    print "Got", len(segments.keys()), "segments of", size, "bytes, resuming at", progress
+    to_upgrade = [s for s in sorted(segments.keys()) if s * size >= progress]
+
+    start = time.time()
+    i = 0
+    while i < retry_passes and len(to_upgrade) > 0:
+        i += 1
+        for n in range(0, len(to_upgrade), window):
+            batch = [segments[s] for s in to_upgrade[n:n + window]]
+            progress = send_stream(batch, size, instance, host, port)
+            if progress is not None:
+                print "Writing pass", i, "acked", progress, "of", len(data), "bytes", "\b" * 45,
+                sys.stdout.flush()
+        received = get_received_blocks(instance, blocks, host, port)
+        if received is None:
+            continue
+        to_upgrade = [s for s in sorted(segments.keys())
+                      if s * blocks_per_segment not in received]
+    print
+    elapsed = time.time() - start
+    if len(to_upgrade) > 0:
+        return False
+    if elapsed > 0:
+        print "Wrote", len(data), "bytes in %.1f s (%.0f bytes/s)"%(elapsed, len(data) / elapsed)
+
+    write_crc32 = get_session_var(instance, tlvlib.VARIABLE_WRITE_CRC32, host, port)
+    data_crc32 = binascii.crc32(data) & 0xffffffff
+    if write_crc32 != data_crc32:
+        print "ERROR: session CRC32 mismatch:", write_crc32, "!=", data_crc32
+        return False
+    # Closing the session erases any old data after the image
+    if not set_session(instance, 0, host, port, 10.0):
+        print "ERROR: failed to close write session"
+        return False
+    return True
+
+#
+# Compressed or delta upgrade using a write session. The compressed
+# image or delta must be written in order and is decoded by the device
+# directly into the image slot. The compressed progress read in each
+# PDU tells where to continue after lost PDUs.
+#
+def send_compressed(zdata, offset, size, window, instance, host, port):
+    tlvs = []
+    for n in range(window):
+        chunk = zdata[offset:offset + size]
+        if len(chunk) == 0:
+            break
+        tlvs.append(tlvlib.create_set_vector_tlv(instance, tlvlib.VARIABLE_COMPRESSED_FLASH,
+                                                 tlvlib.SIZE32, offset / 4,
+                                                 len(chunk) / 4, chunk))
+        offset += len(chunk)
+    tlvs.append(tlvlib.create_get_tlv32(instance, tlvlib.VARIABLE_COMPRESSED_PROGRESS))
+    try:
+        enc,reply = tlvlib.send_tlv(tlvs, host, port, 2.5, show_error=verbose)
+    except socket.timeout:
+        return None,0
+    error = 0
+    for t in reply:
+        # Invalid vector offset only means an earlier chunk was lost
+        if t.variable == tlvlib.VARIABLE_COMPRESSED_FLASH and t.error not in (0, 15):
+            error = t.error
+        elif t.variable == tlvlib.VARIABLE_COMPRESSED_PROGRESS and t.error == 0:
+            return (t.int_value & 0xffffffff) * 4,error
+    return None,error
+
+def do_compressed_upgrade(zdata, header, instance, host, port, block_size, window, retries=50):
+    session = (header['crc32'] & 0x7fffffff) | 1
+    if not set_session(instance, session, host, port):
+        print "ERROR: failed to open write session"
+        return False
+    size = block_size - (block_size % 4)
+    progress = get_session_var(instance, tlvlib.VARIABLE_COMPRESSED_PROGRESS, host, port) or 0
+    print "Sending", len(zdata), "compressed bytes (" + str(header['length']), "bytes image), resuming at", progress
+
+    start = time.time()
+    failures = 0
+    while progress < len(zdata) and failures < retries:
+        p,error = send_compressed(zdata, progress, size, max(1, window), instance, host, port)
+        if error != 0:
+            print
+            print "ERROR: device failed to decode image:", tlvlib.get_tlv_error_as_string(error)
+            # The session must be reopened after a decoding failure
+            set_session(instance, 0, host, port, 10.0)
+            return False
+        if p is None or p <= progress:
+            failures += 1
+            continue
+        failures = 0
+        progress = p
+        print "Writing", progress, "of", len(zdata), "compressed bytes", "\b" * 45,
+        sys.stdout.flush()
+    print
+    elapsed = time.time() - start
+    if progress < len(zdata):
+        return False
+    if elapsed > 0:
+        print "Wrote", len(zdata), "bytes in %.1f s (%.0f bytes/s, %.0f image bytes/s)"%(elapsed, len(zdata) / elapsed, header['length'] / elapsed)
+
+    # The device has verified the CRC32 but check what was written
+    write_crc32 = get_session_var(instance, tlvlib.VARIABLE_WRITE_CRC32, host, port)
+    if write_crc32 != header['crc32']:
+        print "ERROR: session CRC32 mismatch:", write_crc32, "!=", header['crc32']
+        return False
+    if not set_session(instance, 0, host, port, 10.0):
+        print "ERROR: failed to close write session"
+        return False
+    return True
+
 def do_upgrade(data, instance, host, port, block_size, retry_passes=50):
     to_upgrade = create_segments(data, block_size)
 
@@ -160,6 +350,7 @@ def do_upgrade(data, instance, host, port, block_size, retry_passes=50):
     return len(to_upgrade.keys()) == 0
 
 block_size = 512
+window = 0
 port = tlvlib.UDP_PORT
 firmware = None
 verbose = False
@@ -173,6 +364,11 @@ parser.add_argument("-s", action="store_true", help="only show status")
 parser.add_argument("-p", help="port (default: %(default)s)", default=port)
 parser.add_argument("-b", help="block size (default: %(default)s)",
                     default=block_size)
+parser.add_argument("-w", help="streaming write with this number of chunks per request (default: %(default)s, not streaming)",
+                    default=window)
+parser.add_argument("-z", action="store_true",
+                    help="send compressed image (streaming write)")
+parser.add_argument("-D", help="delta image from the running image (see imagediff.py)")
 parser.add_argument("-v", action="store_true", help="verbose output")
 
 args = parser.parse_args()
@@ -194,13 +390,27 @@ if args.p:
 if args.b:
     block_size = int(args.b)
 
+if args.w:
+    window = int(args.w)
+
 if args.v:
     verbose = True
 
+compressed = args.z
+delta = None
+if args.D:
+    delta = open(args.D, 'rb').read()
+    if not imagediff.is_delta(delta):
+        print "ERROR: bad delta image", args.D
+        exit()
+    compressed = True
+if compressed and window == 0:
+    window = 4
+
 if args.k:
     keep_running = True
 
-if not args.s:
+if not args.s and delta is None:
     if not firmware:
         print "Specify image file"
         parser.print_help()
@@ -221,6 +431,7 @@ print "Booted at:",tlvlib.get_start_ieee64_time_as_string(d[0][2]),"-",tlvlib.co
 
 i = 1
 upgrade = 0
+running_version = None
 for data in d[1]:
     if data[0] == tlvlib.INSTANCE_IMAGE:
         print "Instance " + str(data[2]) + ": type: %016x"%data[0], " ", data[1]
@@ -233,7 +444,9 @@ for data in d[1]:
         tlvtype = tlvs[2]
         print "\tVersion:    %016x"%tlv.int_value, "  ", tlvlib.parse_image_version(tlv.int_value), "inc:", str(tlv.int_value & 0x1f)
         print "\tImage Type: %016x"%tlvtype.int_value,"   Status:", tlvlib.get_image_status_as_string(tlvstatus.int_value)
-        if (tlvstatus.int_value & tlvlib.IMAGE_STATUS_ACTIVE) == 0:
+        if (tlvstatus.int_value & tlvlib.IMAGE_STATUS_ACTIVE) != 0:
+            running_version = tlv.int_value & 0xffffffffffffffff
+        else:
             upgrade = i
             label = data[1]
             upgrade_status = tlvstatus.int_value
@@ -255,28 +468,49 @@ if upgrade == 0 or upgrade_image == 0:
     print "ERROR: no unused image found in the device"
     exit()
 
-manifest = get_manifest_data(zip)
-if manifest['producttype'] != producttype:
-    if manifest['producttype'] == '0090da0301010482' and producttype == '0090da0302010014':
-        # Sparrow serial radio has two product types: one for border router and
-        # and one for serial radio. No need to warn for this.
-        pass
-    else:
-        print "WARNING: different product type in firmware file and in device:",manifest['producttype'],"!=",producttype
+def get_image_data():
+    if delta is not None:
+        header = imagediff.get_header(delta)
+        if header['source_version'] != running_version:
+            print "ERROR: delta is for image version %016x"%header['source_version']
+            exit()
+        print "Upgrading instance", upgrade, label, "with delta", args.D, " (" + str(len(delta)) + " bytes)"
+        return delta,header
+    data = read_archive()
+    header = lzss.get_header(data) if compressed else None
+    return data,header
+
+def read_archive():
+    manifest = get_manifest_data(zip)
+    if manifest['producttype'] != producttype:
+        if manifest['producttype'] == '0090da0301010482' and producttype == '0090da0302010014':
+            # Sparrow serial radio has two product types: one for border router and
+            # and one for serial radio. No need to warn for this.
+            pass
+        else:
+            print "WARNING: different product type in firmware file and in device:",manifest['producttype'],"!=",producttype
 
-imagetype = manifest['image.' + str(upgrade_image) + '.type']
-if imagetype != upgrade_type:
-    print "ERROR: wrong image type in firmware file:",imagetype,"!=",upgrade_type
-    exit()
+    imagetype = manifest['image.' + str(upgrade_image) + '.type']
+    if imagetype != upgrade_type:
+        print "ERROR: wrong image type in firmware file:",imagetype,"!=",upgrade_type
+        exit()
 
-zfile = get_flash(zip, upgrade_image)
-if zfile is None:
-    print "ERROR: could not find firmware data in firmware file"
-    exit()
+    zfile = get_flash(zip, upgrade_image, compressed)
+    if zfile is None:
+        print "ERROR: could not find firmware data in firmware file"
+        exit()
+
+    data = zip.read(zfile)
+    if compressed and not lzss.is_compressed(data):
+        print "ERROR: bad compressed image in firmware file"
+        exit()
+    print "Upgrading instance", upgrade, label, "with image", zfile.filename," (" + str(len(data)) + " bytes)"
+    return data
 
-data = zip.read(zfile)
-print "Upgrading instance", upgrade, label, "with image", zfile.filename," (" + str(len(data)) + " bytes)"
-if (upgrade_status & tlvlib.IMAGE_STATUS_ERASED) == 0:
+data,header = get_image_data()
+
+# Sectors are erased on demand during a streaming write
+if window == 0 and (upgrade_status & tlvlib.IMAGE_STATUS_ERASED) == 0:
     print "Erasing image",upgrade
     i = 5
     while i >= 0:
@@ -288,7 +522,15 @@ if (upgrade_status & tlvlib.IMAGE_STATUS_ERASED) == 0:
         else:
             break
 
-if not do_upgrade(data, upgrade, host, port, block_size):
+if compressed:
+    if not do_compressed_upgrade(data, header, upgrade, host, port, block_size, window):
+        print "ERROR: failed to write firmware file"
+        exit()
+elif window > 0:
+    if not do_stream_upgrade(data, upgrade, host, port, block_size, window):
+        print "ERROR: failed to write firmware file"
+        exit()
+elif not do_upgrade(data, upgrade, host, port, block_size):
     print "ERROR: failed to write firmware file"
     exit()
 
@@ -32,8 +32,11 @@
 # Read out trailer info from a flash file. Or generate a trailer info
 # and append to a file (to create a flash file).
 #
+# Compressed flash files are decompressed before reading the trailer
+# and -Z outputs the (new) flash file compressed.
+#
 
-import sys, binascii,datetime,argparse
+import sys, binascii,datetime,argparse,lzss
 magic = 0x2144DF1C
 inc = 0
 
@@ -72,6 +75,7 @@ parser.add_argument("-T", help="image type");
 parser.add_argument("-A", help="image start address");
 parser.add_argument("-P", help="product type");
 parser.add_argument("-i", help="input file");
+parser.add_argument("-Z", action="store_true", help="output compressed flash file");
 
 args = parser.parse_args()
 
@@ -94,6 +98,11 @@ if args.A:
 
 data = file.read()
 
+if lzss.is_compressed(data):
+    if args.v:
+        print >> sys.stderr, "Decompressing", len(data), "bytes"
+    data = lzss.decompress(data)
+
 # only add if multiple things are set so that trailer can be created
 add = ('image_start' in globals()) & ('product' in globals()) & ('version' in globals())
 
@@ -157,4 +166,11 @@ if add:
     data = data + chr((crc >> 24) & 0xff) + chr((crc >> 16) & 0xff) + chr((crc >> 8) & 0xff) + chr((crc >> 0) & 0xff)
     if args.v:
         print >> sys.stderr, "Trailer:", binascii.hexlify(data[-40:]), " CRC:", hex(get_crc(data)), " Size: ", len(data)
+
+if args.Z:
+    compressed = lzss.compress(data)
+    if args.v:
+        print >> sys.stderr, "Compressed", len(data), "to", len(compressed), "bytes"
+    sys.stdout.write(compressed)
+elif add:
     sys.stdout.write(data)